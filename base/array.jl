@@ -79,9 +79,8 @@ function unsafe_copy!{T}(dest::Array{T}, doffs, src::Array{T}, soffs, n)
     if isbits(T)
         unsafe_copy!(pointer(dest, doffs), pointer(src, soffs), n)
     else
-        for i=0:n-1
-            @inbounds arrayset(dest, src[i+soffs], i+doffs)
-        end
+        ccall(:jl_array_ptr_copy, Void, (Any, Ptr{Void}, Any, Ptr{Void}, UInt),
+              dest, pointer(dest, doffs), src, pointer(src, soffs), n)
     end
     return dest
 end
@@ -370,6 +369,7 @@ function _growat_beg!(a::Vector, i::Integer, delta::Integer)
     if i > 1
         ccall(:memmove, Ptr{Void}, (Ptr{Void}, Ptr{Void}, Csize_t),
               pointer(a, 1), pointer(a, 1+delta), (i-1)*elsize(a))
+        isbits(eltype(a)) || ccall(:jl_gc_array_moved, Void, (Any,), a)
     end
     return a
 end
@@ -380,6 +380,7 @@ function _growat_end!(a::Vector, i::Integer, delta::Integer)
     if n >= i+delta
         ccall(:memmove, Ptr{Void}, (Ptr{Void}, Ptr{Void}, Csize_t),
               pointer(a, i+delta), pointer(a, i), (n-i-delta+1)*elsize(a))
+        isbits(eltype(a)) || ccall(:jl_gc_array_moved, Void, (Any,), a)
     end
     return a
 end
@@ -401,6 +402,7 @@ function _deleteat_beg!(a::Vector, i::Integer, delta::Integer)
     if i > 1
         ccall(:memmove, Ptr{Void}, (Ptr{Void}, Ptr{Void}, Csize_t),
               pointer(a, 1+delta), pointer(a, 1), (i-1)*elsize(a))
+        isbits(eltype(a)) || ccall(:jl_gc_array_moved, Void, (Any,), a)
     end
     ccall(:jl_array_del_beg, Void, (Any, UInt), a, delta)
     return a
@@ -411,6 +413,7 @@ function _deleteat_end!(a::Vector, i::Integer, delta::Integer)
     if n >= i+delta
         ccall(:memmove, Ptr{Void}, (Ptr{Void}, Ptr{Void}, Csize_t),
               pointer(a, i), pointer(a, i+delta), (n-i-delta+1)*elsize(a))
+        isbits(eltype(a)) || ccall(:jl_gc_array_moved, Void, (Any,), a)
     end
     ccall(:jl_array_del_end, Void, (Any, UInt), a, delta)
     return a
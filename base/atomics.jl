@@ -1,6 +1,7 @@
 # This file is a part of Julia. License is MIT: http://julialang.org/license
 
-using Base.Intrinsics: llvmcall
+using Base.Intrinsics: llvmcall, atomic_pointerref, atomic_pointerset,
+    atomic_pointerrmw, atomic_pointercas
 
 import Base: setindex!, getindex
 
@@ -10,7 +11,10 @@ export
     atomic_xchg!,
     atomic_add!, atomic_sub!,
     atomic_and!, atomic_nand!, atomic_or!, atomic_xor!,
-    atomic_max!, atomic_min!
+    atomic_max!, atomic_min!,
+    unsafe_atomic_load, unsafe_atomic_store!, unsafe_atomic_cas!, unsafe_atomic_modify!,
+    atomic_getindex, atomic_setindex!, atomic_casindex!, atomic_modifyindex!,
+    atomic_getfield, atomic_setfield!, atomic_casfield!, atomic_modifyfield!
 
 type Atomic{T<:Integer}
     value::T
@@ -72,3 +76,73 @@ for (typ, lt) in atomicintsmap
                 """, $typ, Tuple{Ptr{$typ}, $typ}, unsafe_convert(Ptr{$typ}, x), v)
     end
 end
+
+# atomic access to isbits values of 1, 2, 4 or 8 bytes through pointers, in
+# arrays and in the fields of mutable objects. `order` is one of :monotonic,
+# :acquire, :release, :acquire_release and :sequentially_consistent, where
+# loads can't release and stores can't acquire; the access is compiled inline
+# when the order is a literal. `op` is one of :xchg, :add, :sub, :and, :nand,
+# :or, :xor, :max and :min, the arithmetic ones for integers only. the cas and
+# modify functions return the value found before the operation, the cas ones
+# store `new` only if that value is `cmp`.
+
+unsafe_atomic_load{T}(p::Ptr{T}, order::Symbol=:sequentially_consistent) =
+    atomic_pointerref(p, order)
+unsafe_atomic_store!{T}(p::Ptr{T}, x, order::Symbol=:sequentially_consistent) =
+    atomic_pointerset(p, convert(T, x)::T, order)
+unsafe_atomic_cas!{T}(p::Ptr{T}, cmp, new, order::Symbol=:sequentially_consistent) =
+    atomic_pointercas(p, convert(T, cmp)::T, convert(T, new)::T, order)
+unsafe_atomic_modify!{T}(p::Ptr{T}, op::Symbol, x, order::Symbol=:sequentially_consistent) =
+    atomic_pointerrmw(p, op, convert(T, x)::T, order)
+
+function atomic_elpointer(a::Array, i::Integer)
+    checkbounds(a, i)
+    isbits(eltype(a)) || throw(ArgumentError("atomic access to an array of non-isbits elements"))
+    pointer(a, i)
+end
+
+atomic_getindex(a::Array, i::Integer, order::Symbol=:sequentially_consistent) =
+    unsafe_atomic_load(atomic_elpointer(a, i), order)
+function atomic_setindex!(a::Array, x, i::Integer, order::Symbol=:sequentially_consistent)
+    unsafe_atomic_store!(atomic_elpointer(a, i), x, order)
+    a
+end
+atomic_casindex!(a::Array, cmp, new, i::Integer, order::Symbol=:sequentially_consistent) =
+    unsafe_atomic_cas!(atomic_elpointer(a, i), cmp, new, order)
+atomic_modifyindex!(a::Array, op::Symbol, x, i::Integer, order::Symbol=:sequentially_consistent) =
+    unsafe_atomic_modify!(atomic_elpointer(a, i), op, x, order)
+
+# the field is resolved when the method is generated, so for a given type and
+# field the pointer is an addition of a constant offset. the field can be
+# given as Val{f} to pick the method at compile time, a Symbol dispatches once
+# on Val{f} at run time.
+@generated function atomic_fieldpointer{f}(x, ::Type{Val{f}})
+    T = x
+    T.mutable || return :(throw(ArgumentError("atomic access to a field of an immutable object")))
+    i = ccall(:jl_field_index, Cint, (Any, Any, Cint), T, f, 0)
+    i < 0 && return :(error($("type $T has no field $f")))
+    FT = fieldtype(T, i + 1)
+    isbits(FT) || return :(throw(ArgumentError("atomic access to a non-isbits field")))
+    :(convert(Ptr{$FT}, pointer_from_objref(x) + $(Base.field_offset(T, i))))
+end
+atomic_fieldpointer(x, f::Symbol) = atomic_fieldpointer(x, Val{f})
+
+atomic_getfield{f}(x, ::Type{Val{f}}, order::Symbol=:sequentially_consistent) =
+    unsafe_atomic_load(atomic_fieldpointer(x, Val{f}), order)
+function atomic_setfield!{f}(x, ::Type{Val{f}}, v, order::Symbol=:sequentially_consistent)
+    unsafe_atomic_store!(atomic_fieldpointer(x, Val{f}), v, order)
+    v
+end
+atomic_casfield!{f}(x, ::Type{Val{f}}, cmp, new, order::Symbol=:sequentially_consistent) =
+    unsafe_atomic_cas!(atomic_fieldpointer(x, Val{f}), cmp, new, order)
+atomic_modifyfield!{f}(x, ::Type{Val{f}}, op::Symbol, v, order::Symbol=:sequentially_consistent) =
+    unsafe_atomic_modify!(atomic_fieldpointer(x, Val{f}), op, v, order)
+
+atomic_getfield(x, f::Symbol, order::Symbol=:sequentially_consistent) =
+    atomic_getfield(x, Val{f}, order)
+atomic_setfield!(x, f::Symbol, v, order::Symbol=:sequentially_consistent) =
+    atomic_setfield!(x, Val{f}, v, order)
+atomic_casfield!(x, f::Symbol, cmp, new, order::Symbol=:sequentially_consistent) =
+    atomic_casfield!(x, Val{f}, cmp, new, order)
+atomic_modifyfield!(x, f::Symbol, op::Symbol, v, order::Symbol=:sequentially_consistent) =
+    atomic_modifyfield!(x, Val{f}, op, v, order)
@@ -132,7 +132,7 @@ export
     Box, Function, IntrinsicFunction, LambdaStaticData, Method, MethodTable,
     Module, Symbol, Task, Array, WeakRef,
     # numeric types
-    Number, Real, Integer, Bool, Ref, Ptr,
+    Number, Real, Integer, Bool, Ref, Ptr, VecElement,
     AbstractFloat, Float16, Float32, Float64,
     Signed, Int, Int8, Int16, Int32, Int64, Int128,
     Unsigned, UInt, UInt8, UInt16, UInt32, UInt64, UInt128,
@@ -272,6 +272,13 @@ type WeakRef
     WeakRef(v::ANY) = ccall(:jl_gc_new_weakref, Any, (Any,), v)::WeakRef
 end
 
+# a tuple of VecElements of the same bits type is represented as an LLVM vector
+immutable VecElement{T}
+    value::T
+    VecElement(value::T) = new(value) # disable converting constructor in Core
+end
+VecElement{T}(arg::T) = VecElement{T}(arg)
+
 TypeVar(n::Symbol) =
     ccall(:jl_new_typevar, Any, (Any, Any, Any), n, Union{}, Any)::TypeVar
 TypeVar(n::Symbol, ub::ANY) =
@@ -293,6 +293,15 @@ function _atreplinit(repl)
     end
 end
 
+# in a child of the fork server (see ui/repl.c), before it runs its program:
+# the streams over its own stdio, and random numbers of its own
+function _reinit_forked()
+    reinit_stdio()
+    Multimedia.reinit_displays()
+    Random.srand()
+    nothing
+end
+
 function _start()
     empty!(ARGS)
     append!(ARGS, Core.ARGS)
@@ -81,3 +81,170 @@ Profile.retrieve
 Clear any existing backtraces from the internal buffer.
 """
 Profile.clear
+
+"""
+    fetch_threads() -> data, tids, tasks
+
+Returns a copy of the buffer of backtraces, with one thread id (as returned by
+`Threads.threadid()`) and one task address per backtrace. Every Julia thread is sampled at
+each tick; the addresses only serve to tell the tasks apart. Not available in the mode of
+[`init_ring`](:func:`init_ring`).
+"""
+Profile.fetch_threads
+
+"""
+    fetch_thread(tid::Integer) -> data
+
+Returns the backtraces taken on thread `tid`, in the format of [`fetch`](:func:`fetch`), so
+they can be passed to [`print`](:func:`print`).
+"""
+Profile.fetch_thread
+
+"""
+    init_perf(n::Integer, event::Symbol, period::Integer)
+
+Configure the profiler to take a backtrace of a thread every `period` occurrences of the
+hardware `event` on it, rather than at a fixed delay, with room for `n` instruction
+pointers. `event` is one of `:cycles`, `:instructions`, `:cache_misses` (last level cache)
+and `:branch_misses`. The number of backtraces that land on a line is then proportional to
+the events it caused. Only available on Linux when the kernel allows `perf_event_open`. Use
+`init(n, delay)` to return to sampling on the timer.
+"""
+Profile.init_perf
+
+"""
+    fetch_counts() -> counts
+
+Returns, for each backtrace, the value of the counter of [`init_perf`](:func:`init_perf`)
+on the thread it was taken on, at the time it was taken; 0 when sampling on the timer.
+"""
+Profile.fetch_counts
+
+"""
+    init_ring(n::Integer, delay::Float64)
+
+Like [`init`](:func:`init`), but keep the `n` instruction pointers in a ring buffer, so the
+profiler keeps taking backtraces after the buffer fills up as long as they are consumed
+with [`drain`](:func:`drain`). Use `init(n, delay)` to return to the default mode.
+"""
+Profile.init_ring
+
+"""
+    drain([maxlen]) -> data
+    drain(fd::RawFD)
+    drain(io::IO)
+
+Removes the backtraces taken so far from the ring buffer set up by
+[`init_ring`](:func:`init_ring`), while the profiler may still be running. The first form
+returns at most `maxlen` instruction pointers as whole backtraces, in the format of
+[`fetch`](:func:`fetch`). The other forms write them to a file descriptor or stream as raw
+`UInt` values, and return their number. Backtraces taken while the ring buffer was full
+are dropped; [`dropped`](:func:`dropped`) returns how many.
+"""
+Profile.drain
+
+"""
+    dropped()
+
+Returns the number of backtraces lost because the ring buffer of
+[`init_ring`](:func:`init_ring`) was full. [`clear`](:func:`clear`) resets it.
+"""
+Profile.dropped
+
+"""
+    init_alloc(n::Integer, interval::Integer)
+
+Configure the allocation profiler to sample an allocation every `interval` bytes allocated
+by a thread, and set the number `n` of instruction pointers that may be stored for the
+backtraces of the samples. `Profile.@profile_alloc <expression>` runs the expression with the
+allocation profiler on. This also clears the samples.
+"""
+Profile.init_alloc
+
+"""
+    fetch_alloc() -> types, sizes, data
+
+Returns the types (`nothing` for buffers such as the data of arrays), the sizes in bytes and
+the backtraces of the allocations sampled by `Profile.@profile_alloc`. `data` holds one
+backtrace per sample in the format of [`fetch`](:func:`fetch`), so it can be passed to
+[`print`](:func:`print`).
+"""
+Profile.fetch_alloc
+
+"""
+    print_alloc([io::IO = STDOUT]; kwargs...)
+
+Prints the bytes and the number of samples for each type sampled by the allocation
+profiler, followed by the backtraces of the samples. The keyword arguments are passed to
+[`print`](:func:`print`).
+"""
+Profile.print_alloc
+
+"""
+    clear_alloc()
+
+Clear the samples of the allocation profiler.
+"""
+Profile.clear_alloc
+
+"""
+    fetch_dispatch() -> names, stats
+
+Returns the names of the generic functions called while running `Profile.@profile_dispatch
+<expression>`, and a `DispatchStats` for each. It holds the number of `calls` dispatched at
+run time (not inlined or specialized at compile time), the `misses` of the method caches and
+the `miss_time` spent resolving them, and the number of `specializations` inferred and the
+`infer_time` spent on them. Times are in nanoseconds.
+"""
+Profile.fetch_dispatch
+
+"""
+    print_dispatch([io::IO = STDOUT])
+
+Prints the statistics collected by the dispatch profiler, the functions with the most cache
+misses first.
+"""
+Profile.print_dispatch
+
+"""
+    clear_dispatch()
+
+Clear the statistics of the dispatch profiler.
+"""
+Profile.clear_dispatch
+
+"""
+    fetch_compile() -> lambdas, stats
+
+Returns the `LambdaStaticData` compiled while running `Profile.@profile_compile
+<expression>`, and a `CompileStats` for each. It holds the `infer_time` spent in type
+inference, the `codegen_time` spent generating LLVM IR, the `llvm_opt_time` spent in the
+LLVM optimization passes and the `emit_time` spent emitting machine code. Times are in
+nanoseconds and exclude the time spent compiling other lambdas on the way.
+"""
+Profile.fetch_compile
+
+"""
+    print_compile([io::IO = STDOUT])
+
+Prints the statistics collected by the compile time profiler, the lambdas that took the
+longest to compile first.
+"""
+Profile.print_compile
+
+"""
+    clear_compile()
+
+Clear the statistics of the compile time profiler.
+"""
+Profile.clear_compile
+
+"""
+    log_compile(io)
+
+Writes a line of JSON to `io`, an `IOStream` or a libuv stream, for every compilation phase
+of every lambda compiled from now on, with the `lambda`, the `phase` (`"inference"`,
+`"codegen"`, `"llvm_opt"` or `"emit"`) and the time it took in `ns`. `log_compile(nothing)`
+stops the log.
+"""
+Profile.log_compile
@@ -1183,11 +1183,13 @@ export
     redirect_stdout,
     recv,
     recvfrom,
+    recvmany,
     reset,
     seek,
     seekend,
     seekstart,
     send,
+    sendmany,
     serialize,
     skip,
     skipchars,
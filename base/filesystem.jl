@@ -40,7 +40,8 @@ export File,
 
 import Base: uvtype, uvhandle, eventloop, fd, position, stat, close,
             write, read, read!, readbytes, isopen, show,
-            check_open, _sizeof_uv_fs, uv_error, UVError
+            check_open, _sizeof_uv_fs, uv_error, UVError,
+            LibuvStream, flush, uv_write
 
 include("path.jl")
 include("stat.jl")
@@ -104,6 +105,31 @@ function sendfile(dst::File, src::File, src_offset::Int64, bytes::Int)
     nothing
 end
 
+# streaming a file out over a socket: the kernel copies straight from the page
+# cache whenever the socket has room; when it is backed up, one chunk goes
+# through the normal write queue, which waits on the event loop for it to drain
+function sendfile(dst::LibuvStream, src::File, src_offset::Int64, bytes::Int)
+    check_open(src)
+    flush(dst)
+    buf = UInt8[]
+    while bytes > 0
+        n = ccall(:jl_uv_sendfile, Int64, (Ptr{Void}, Int32, Int64, Csize_t),
+                  dst.handle, src.handle, src_offset, bytes)
+        if n <= 0
+            n == 0 || n == Base.UV_ENOSYS || uv_error("sendfile", n)
+            resize!(buf, min(bytes, 65536))
+            n = ccall(:jl_fs_pread, Int32, (Int32, Ptr{UInt8}, Csize_t, Int64),
+                      src.handle, buf, length(buf), src_offset)
+            uv_error("read", n)
+            n == 0 && throw(EOFError())
+            uv_write(dst, pointer(buf), UInt(n))
+        end
+        src_offset += n
+        bytes -= n
+    end
+    nothing
+end
+
 function write(f::File, buf::Ptr{UInt8}, len::Integer, offset::Integer=-1)
     check_open(f)
     err = ccall(:jl_fs_write, Int32, (Int32, Ptr{UInt8}, Csize_t, Int64),
@@ -91,6 +91,10 @@ _ieval(x::ANY) =
     ccall(:jl_interpret_toplevel_expr_in, Any, (Any, Any, Ptr{Void}, Csize_t),
           (inference_stack::CallStack).mod, x, C_NULL, 0)
 _iisdefined(x::ANY) = isdefined((inference_stack::CallStack).mod, x)
+# read a global like _ieval, without running a pending __init__ of M
+_ieval_global(M::Module, s::Symbol) =
+    ccall(:jl_interpret_toplevel_expr_in, Any, (Any, Any, Ptr{Void}, Csize_t),
+          M, s, C_NULL, 0)
 
 function _topmod()
     m = (inference_stack::CallStack).mod
@@ -177,6 +181,11 @@ add_tfunc(applicable, 1, IInf, (f, args...)->Bool)
 add_tfunc(arraysize, 2, 2, (a,d)->Int)
 add_tfunc(pointerref, 2, 2, (a,i)->(isa(a,DataType) && a<:Ptr && isa(a.parameters[1],Union{Type,TypeVar}) ? a.parameters[1] : Any))
 add_tfunc(pointerset, 3, 3, (a,v,i)->a)
+atomic_pointer_tfunc = a->(isa(a,DataType) && a<:Ptr && isa(a.parameters[1],Union{Type,TypeVar}) ? a.parameters[1] : Any)
+add_tfunc(atomic_pointerref, 2, 2, (a,order)->atomic_pointer_tfunc(a))
+add_tfunc(atomic_pointerset, 3, 3, (a,v,order)->a)
+add_tfunc(atomic_pointerrmw, 4, 4, (a,op,v,order)->atomic_pointer_tfunc(a))
+add_tfunc(atomic_pointercas, 4, 4, (a,cmp,v,order)->atomic_pointer_tfunc(a))
 
 const typeof_tfunc = function (t)
     if isType(t)
@@ -285,7 +294,7 @@ const getfield_tfunc = function (A, s0, name)
         fld = A[2].value
         A1 = A[1]
         if isa(A1,Module) && isdefined(A1,fld) && isconst(A1, fld)
-            return abstract_eval_constant(eval(A1,fld)), true
+            return abstract_eval_constant(_ieval_global(A1,fld)), true
         end
         if s === Module
             return Any, false
@@ -1169,7 +1178,7 @@ abstract_eval_global(s::Symbol) =
 
 function abstract_eval_global(M, s::Symbol)
     if isconst(M,s)
-        return abstract_eval_constant(eval(M,s))
+        return abstract_eval_constant(_ieval_global(M,s))
     end
     return Any
 end
@@ -1419,6 +1428,74 @@ typeinf(linfo,atypes::ANY,sparams::ANY,def) = typeinf(linfo,atypes,sparams,def,t
 
 CYCLE_ID = 1
 
+# The t-function cache of a method (def.tfunc) is a flat array of triples:
+# argument types, inferred tree (or just a return type) and whether it was
+# inferred in a cycle. Once it has TFUNC_INDEX_MIN entries, lookups go through
+# a TfuncIndex instead of comparing every entry with typeseq: the leaf argument
+# types (which are unique objects) are found by identity, only the others are
+# compared. The entries are only ever appended, except when the serializer
+# compacts the cache, so an index whose positions don't check out is rebuilt.
+# The index is kept in def.tfunc_index, so it goes away with the method. It
+# hashes by object address, so it isn't saved with the lambda, and is rebuilt
+# on the first lookups after loading.
+const TFUNC_INDEX_MIN = 8
+
+type TfuncIndex
+    cache::Array{Any,1}  # the cache indexed
+    leaf::ObjectIdDict   # leaf argument types => position
+    other::Array{Int,1}  # positions of the other argument types
+    n::Int               # length of the cache indexed
+end
+
+function tfunc_index(def::LambdaStaticData, tfarr::Array{Any,1})
+    idx = def.tfunc_index
+    if !isa(idx, TfuncIndex) || !is((idx::TfuncIndex).cache, tfarr) || (idx::TfuncIndex).n > length(tfarr)
+        idx = TfuncIndex(tfarr, ObjectIdDict(), Int[], 0)
+        def.tfunc_index = idx
+    end
+    idx = idx::TfuncIndex
+    for i = idx.n+1:3:length(tfarr)
+        t = tfarr[i]
+        if isleaftype(t)
+            haskey(idx.leaf, t) || (idx.leaf[t] = i)
+        else
+            push!(idx.other, i)
+        end
+    end
+    idx.n = length(tfarr)
+    idx
+end
+
+# the position of the entry for atypes in the t-function cache of def, or -1
+function tfunc_lookup(def::LambdaStaticData, atypes::ANY)
+    tfarr = def.tfunc::Array{Any,1}
+    n = length(tfarr)
+    if n >= 3*TFUNC_INDEX_MIN
+        idx = tfunc_index(def, tfarr)
+        if isleaftype(atypes)
+            i = get(idx.leaf, atypes, -1)::Int
+            (i == -1 || (i <= n && tfarr[i] === atypes)) && return i
+        else
+            valid = true
+            for i in idx.other
+                if i > n || isleaftype(tfarr[i])
+                    valid = false; break
+                end
+                typeseq(tfarr[i],atypes) && return i
+            end
+            valid && return -1
+        end
+        # compacted since it was indexed
+        def.tfunc_index = nothing
+    end
+    for i = 1:3:n
+        if typeseq(tfarr[i],atypes)
+            return i
+        end
+    end
+    return -1
+end
+
 #trace_inf = false
 #enable_trace_inf() = (global trace_inf=true)
 
@@ -1437,26 +1514,23 @@ function typeinf(linfo::LambdaStaticData,atypes::ANY,sparams::SimpleVector, def,
     tf = def.tfunc
     if !is(tf,nothing)
         tfarr = tf::Array{Any,1}
-        for i = 1:3:length(tfarr)
-            if typeseq(tfarr[i],atypes)
-                code = tfarr[i+1]
-                if tfarr[i+2]
-                    redo = true
-                    tfunc_idx = i+1
-                    curtype = code
-                    break
-                end
-                if isa(code,Type)
-                    curtype = code::Type
-                    # sometimes just a return type is stored here. if a full AST
-                    # is not needed, we can return it.
-                    if !needtree
-                        return (nothing, code)
-                    end
-                else
-                    curtype = ccall(:jl_ast_rettype, Any, (Any,Any), def, code)::Type
-                    return (code, curtype)
+        i = tfunc_lookup(def, atypes)
+        if i != -1
+            code = tfarr[i+1]
+            if tfarr[i+2]
+                redo = true
+                tfunc_idx = i+1
+                curtype = code
+            elseif isa(code,Type)
+                curtype = code::Type
+                # sometimes just a return type is stored here. if a full AST
+                # is not needed, we can return it.
+                if !needtree
+                    return (nothing, code)
                 end
+            else
+                curtype = ccall(:jl_ast_rettype, Any, (Any,Any), def, code)::Type
+                return (code, curtype)
             end
         end
     end
@@ -1475,12 +1549,7 @@ function typeinf(linfo::LambdaStaticData,atypes::ANY,sparams::SimpleVector, def,
             def.tfunc = Any[]
         end
         tfarr = def.tfunc::Array{Any,1}
-        idx = -1
-        for i = 1:3:length(tfarr)
-            if typeseq(tfarr[i],atypes)
-                idx = i; break
-            end
-        end
+        idx = tfunc_lookup(def, atypes)
         if idx == -1
             l = length(tfarr)
             idx = l+1
@@ -2164,6 +2233,10 @@ function is_pure_builtin(f)
     if isa(f,IntrinsicFunction)
         if !(f === Intrinsics.pointerref || # this one is volatile
              f === Intrinsics.pointerset || # this one is never effect-free
+             f === Intrinsics.atomic_pointerref || # this one is volatile
+             f === Intrinsics.atomic_pointerset || # these are never effect-free
+             f === Intrinsics.atomic_pointerrmw ||
+             f === Intrinsics.atomic_pointercas ||
              f === Intrinsics.ccall ||      # this one is never effect-free
              f === Intrinsics.llvmcall)     # this one is never effect-free
             return true
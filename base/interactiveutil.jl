@@ -582,6 +582,8 @@ function summarysize(obj::MethodTable, seen, excl)
     size += summarysize(obj.cache, seen, excl)::Int
     size += summarysize(obj.cache_arg1, seen, excl)::Int
     size += summarysize(obj.cache_targ, seen, excl)::Int
+    size += summarysize(obj.cache_exact, seen, excl)::Int
+    size += summarysize(obj.cache_matches, seen, excl)::Int
     if isdefined(obj, :kwsorter)
         size += summarysize(obj.kwsorter, seen, excl)::Int
     end
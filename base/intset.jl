@@ -49,6 +49,27 @@ function sizehint!(s::IntSet, top::Integer)
     s
 end
 
+# the operations of bitvector_combine, see support/bitvector.h
+const BITVECTOR_AND = Cint(0)
+const BITVECTOR_OR = Cint(1)
+const BITVECTOR_XOR = Cint(2)
+const BITVECTOR_ANDNOT = Cint(3)
+
+# s.bits = s.bits op s2.bits over the words of s2, which sizehint! has made
+# room for in s. returns the number of words combined.
+function combine_bits!(s::IntSet, s2::IntSet, op::Cint)
+    lim = length(s2.bits)
+    lim <= length(s.bits) || throw(BoundsError(s.bits, lim))
+    ccall(:bitvector_combine, Void, (Ptr{UInt32}, Ptr{UInt32}, Ptr{UInt32}, Csize_t, Cint),
+          s.bits, s.bits, s2.bits, lim, op)
+    lim
+end
+
+# set (or clear) the words of s from word lim+1 on
+fill_bits!(s::IntSet, lim::Int, c::Bool) =
+    ccall(:bitvector_fill, Void, (Ptr{UInt32}, UInt64, UInt64, UInt32),
+          s.bits, lim<<5, (length(s.bits)-lim)<<5, c)
+
 function push!(s::IntSet, n::Integer)
     if n >= s.limit
         if s.fill1s
@@ -121,6 +142,18 @@ function setdiff!(s::IntSet, ns)
     return s
 end
 
+function setdiff!(s::IntSet, s2::IntSet)
+    if s2.limit > s.limit
+        sizehint!(s, s2.limit)
+    end
+    lim = combine_bits!(s, s2, BITVECTOR_ANDNOT)
+    if s2.fill1s
+        fill_bits!(s, lim, false)
+    end
+    s.fill1s &= !s2.fill1s
+    s
+end
+
 setdiff(a::IntSet, b::IntSet) = setdiff!(copy(a),b)
 symdiff(s1::IntSet, s2::IntSet) =
     (s1.limit >= s2.limit ? symdiff!(copy(s1), s2) : symdiff!(copy(s2), s1))
@@ -220,18 +253,14 @@ length(s::IntSet) = Int(ccall(:bitvector_count, UInt64, (Ptr{UInt32}, UInt64, UI
 
 
 # Math functions
+
 function union!(s::IntSet, s2::IntSet)
     if s2.limit > s.limit
         sizehint!(s, s2.limit)
     end
-    lim = length(s2.bits)
-    for n = 1:lim
-        s.bits[n] |= s2.bits[n]
-    end
+    lim = combine_bits!(s, s2, BITVECTOR_OR)
     if s2.fill1s
-        for n=lim+1:length(s.bits)
-            s.bits[n] = UInt32(-1)
-        end
+        fill_bits!(s, lim, true)
     end
     s.fill1s |= s2.fill1s
     s
@@ -245,14 +274,9 @@ function intersect!(s::IntSet, s2::IntSet)
     if s2.limit > s.limit
         sizehint!(s, s2.limit)
     end
-    lim = length(s2.bits)
-    for n = 1:lim
-        s.bits[n] &= s2.bits[n]
-    end
+    lim = combine_bits!(s, s2, BITVECTOR_AND)
     if !s2.fill1s
-        for n=lim+1:length(s.bits)
-            s.bits[n] = UInt32(0)
-        end
+        fill_bits!(s, lim, false)
     end
     s.fill1s &= s2.fill1s
     s
@@ -272,10 +296,7 @@ function symdiff!(s::IntSet, s2::IntSet)
     if s2.limit > s.limit
         sizehint!(s, s2.limit)
     end
-    lim = length(s2.bits)
-    for n = 1:lim
-        s.bits[n] $= s2.bits[n]
-    end
+    lim = combine_bits!(s, s2, BITVECTOR_XOR)
     if s2.fill1s
         for n=lim+1:length(s.bits)
             s.bits[n] = ~s.bits[n]
@@ -98,6 +98,15 @@ function open(fname::AbstractString, rd::Bool, wr::Bool, cr::Bool, tr::Bool, ff:
 end
 open(fname::AbstractString) = open(fname, true, false, false, false, false)
 
+# read-only stream over a memory-mapped file; reads and readline work directly
+# on the mapped pages instead of copying through a read buffer
+function open_mapped(fname::AbstractString)
+    s = IOStream(string("<file ",fname,">"))
+    systemerror("opening file $fname",
+                ccall(:ios_mmap, Ptr{Void}, (Ptr{UInt8}, Cstring), s.ios, fname) == C_NULL)
+    return s
+end
+
 function open(fname::AbstractString, mode::AbstractString)
     mode == "r"  ? open(fname, true , false, false, false, false) :
     mode == "r+" ? open(fname, true , true , false, false, false) :
@@ -106,7 +106,7 @@ const UV_MUTEX_SIZE = ccall(:jl_sizeof_uv_mutex, Cint, ())
 type Mutex <: AbstractLock
     ownertid::Int16
     handle::Array{Int8}
-    Mutex() = (m = new(zero(Int16), zeros(Int8, UV_MUTEX_SIZE));
+    Mutex() = (m = new(zero(Int16), Base.zeros(Int8, UV_MUTEX_SIZE));
                ccall(:uv_mutex_init, Void, (Ptr{Void},), m.handle);
                finalizer(m, (x -> ccall(:uv_mutex_destroy, Void, (Ptr{Void},), x.handle)));
                m)
@@ -47,6 +47,56 @@ end
 
 clear() = ccall(:jl_profile_clear_data, Void, ())
 
+## Sampling on hardware counters (Linux): each thread is sampled every
+## `period` occurrences of the event on it
+
+const perf_events = Dict(:cycles => 0, :instructions => 1, :cache_misses => 2, :branch_misses => 3)
+
+function init_perf(n::Integer, event::Symbol, period::Integer)
+    haskey(perf_events, event) || throw(ArgumentError("unknown hardware event $event, expected one of $(join(keys(perf_events), ", "))"))
+    status = ccall(:jl_profile_init_perf, Cint, (Csize_t, Cint, UInt64), n, perf_events[event], period)
+    if status == -1
+        error("could not allocate space for ", n, " instruction pointers")
+    elseif status == -2
+        error("the hardware counter of $event is not available for profiling")
+    end
+end
+
+# the value of the counter of the thread each backtrace was taken on, in the
+# order of the backtraces
+function fetch_counts()
+    n = Int(ccall(:jl_profile_len_samples, Csize_t, ()))
+    UInt64[ccall(:jl_profile_sample_count, UInt64, (Csize_t,), i-1) for i = 1:n]
+end
+
+## Streaming mode: the backtraces go to a ring buffer that is drained while
+## the profiler keeps running
+
+function init_ring(n::Integer, delay::Float64)
+    status = ccall(:jl_profile_init_ring, Cint, (Csize_t, UInt64), n, round(UInt64,10^9*delay))
+    if status == -1
+        error("could not allocate space for ", n, " instruction pointers")
+    end
+end
+
+is_ring() = ccall(:jl_profile_is_ring, Cint, ())!=0
+
+function drain(maxlen::Integer = len_data())
+    data = Array(UInt, maxlen)
+    n = ccall(:jl_profile_ring_read, Csize_t, (Ptr{UInt}, Csize_t), data, maxlen)
+    resize!(data, n)
+end
+
+function drain(fd::RawFD)
+    n = ccall(:jl_profile_ring_write_fd, Int64, (Int32,), fd.fd)
+    Base.uv_error("Profile.drain", n)
+    Int(n)
+end
+drain(f::Base.Filesystem.File) = drain(f.handle)
+drain(io::IO) = div(write(io, drain()), sizeof(UInt))
+
+dropped() = Int(ccall(:jl_profile_ring_dropped, Csize_t, ()))
+
 function print{T<:Unsigned}(io::IO, data::Vector{T} = fetch(), lidict::Dict = getdict(data);
         format = :tree,
         C = false,
@@ -71,7 +121,8 @@ end
 
 function getdict(data::Vector{UInt})
     uip = unique(data)
-    Dict{UInt, LineInfo}([ip=>lookup(ip) for ip in uip])
+    infos = ccall(:jl_lookup_code_addresses, Any, (Ptr{UInt}, Csize_t, Cint), uip, length(uip), false)
+    Dict{UInt, LineInfo}([uip[i]=>lineinfo(infos[i]) for i in 1:length(uip)])
 end
 
 function callers(funcname::ByteString, bt::Vector{UInt}, lidict; filename = nothing, linerange = nothing)
@@ -97,6 +148,188 @@ callers(func::Function; kwargs...) = callers(string(func), retrieve()...; kwargs
 # compilation.
 clear_malloc_data() = ccall(:jl_clear_malloc_data, Void, ())
 
+##
+## Sampling allocation profiler
+##
+macro profile_alloc(ex)
+    quote
+        try
+            alloc_init_default()
+            ccall(:jl_alloc_profile_start, Void, ())
+            $(esc(ex))
+        finally
+            ccall(:jl_alloc_profile_stop, Void, ())
+        end
+    end
+end
+
+function init_alloc(n::Integer, interval::Integer)
+    status = ccall(:jl_alloc_profile_init, Cint, (Csize_t, UInt64), n, interval)
+    if status == -1
+        error("could not allocate space for ", n, " instruction pointers")
+    end
+end
+
+# the allocation profiler is rarely used, so its buffer is only allocated by
+# the first @profile_alloc, unless init_alloc was called before: sample an
+# allocation every 512 kB, with room for 1M instruction pointers
+function alloc_init_default()
+    if ccall(:jl_alloc_profile_maxlen_data, Csize_t, ()) == 0
+        init_alloc(1_000_000, 512*1024)
+    end
+end
+
+clear_alloc() = ccall(:jl_alloc_profile_clear_data, Void, ())
+
+immutable AllocSample
+    typ::Ptr{Void} # C_NULL for buffers
+    size::Csize_t
+end
+
+# the types (`nothing` for buffers) and sizes of the sampled allocations, and
+# their backtraces in the format of `fetch`
+function fetch_alloc()
+    ptr = convert(Ptr{AllocSample}, ccall(:jl_alloc_profile_get_samples, Ptr{UInt8}, ()))
+    n = Int(ccall(:jl_alloc_profile_len_samples, Csize_t, ()))
+    types = Array(Any, n)
+    sizes = Array(Int, n)
+    for i = 1:n
+        s = unsafe_load(ptr, i)
+        types[i] = s.typ == C_NULL ? nothing : unsafe_pointer_to_objref(s.typ)
+        sizes[i] = s.size
+    end
+    len = Int(ccall(:jl_alloc_profile_len_data, Csize_t, ()))
+    if len == ccall(:jl_alloc_profile_maxlen_data, Csize_t, ())
+        warn("The allocation profile buffer is full; call Profile.init_alloc with a larger buffer and/or interval.")
+    end
+    data = copy(pointer_to_array(convert(Ptr{UInt}, ccall(:jl_alloc_profile_get_data, Ptr{UInt8}, ())), (len,)))
+    types, sizes, data
+end
+
+# print the sampled bytes per type, then the call sites of the sampled allocations
+function print_alloc(io::IO = STDOUT; kwargs...)
+    types, sizes, data = fetch_alloc()
+    bytes = Dict{Any,Int}()
+    count = Dict{Any,Int}()
+    for i = 1:length(types)
+        bytes[types[i]] = get(bytes, types[i], 0) + sizes[i]
+        count[types[i]] = get(count, types[i], 0) + 1
+    end
+    println(io, lpad("bytes", 12), lpad("count", 8), "  type")
+    for t in sort!(collect(keys(bytes)), by = t -> -bytes[t])
+        println(io, lpad(bytes[t], 12), lpad(count[t], 8), "  ", t === nothing ? "(buffer)" : t)
+    end
+    isempty(data) || print(io, data, getdict(data); kwargs...)
+end
+
+
+##
+## Dispatch profiler
+##
+macro profile_dispatch(ex)
+    quote
+        try
+            ccall(:jl_dispatch_profile_start, Void, ())
+            $(esc(ex))
+        finally
+            ccall(:jl_dispatch_profile_stop, Void, ())
+        end
+    end
+end
+
+clear_dispatch() = ccall(:jl_dispatch_profile_clear, Void, ())
+
+immutable DispatchStats
+    calls::UInt64
+    misses::UInt64
+    miss_time::UInt64 # ns
+    specializations::UInt64
+    infer_time::UInt64 # ns
+end
+
+# the names of the profiled generic functions and their DispatchStats
+function fetch_dispatch()
+    tables = copy(ccall(:jl_dispatch_profile_tables, Any, ())::Vector{Any})
+    ptr = convert(Ptr{DispatchStats}, ccall(:jl_dispatch_profile_get_data, Ptr{UInt8}, ()))
+    n = min(length(tables), Int(ccall(:jl_dispatch_profile_len_data, Csize_t, ())))
+    names = Symbol[tables[i].name for i = 1:n]
+    stats = DispatchStats[unsafe_load(ptr, i) for i = 1:n]
+    names, stats
+end
+
+# print the profiled functions, the most frequently missing first
+function print_dispatch(io::IO = STDOUT)
+    names, stats = fetch_dispatch()
+    println(io, lpad("calls", 12), lpad("misses", 10), lpad("miss ms", 10),
+            lpad("specs", 8), lpad("infer ms", 10), "  function")
+    for i in sortperm(stats, by = s -> -Int(s.misses))
+        s = stats[i]
+        println(io, lpad(s.calls, 12), lpad(s.misses, 10), lpad(div(s.miss_time, 10^6), 10),
+                lpad(s.specializations, 8), lpad(div(s.infer_time, 10^6), 10), "  ", names[i])
+    end
+end
+
+
+##
+## Compile time profiler
+##
+macro profile_compile(ex)
+    quote
+        try
+            ccall(:jl_compile_profile_start, Void, ())
+            $(esc(ex))
+        finally
+            ccall(:jl_compile_profile_stop, Void, ())
+        end
+    end
+end
+
+clear_compile() = ccall(:jl_compile_profile_clear, Void, ())
+
+immutable CompileStats
+    infer_time::UInt64 # ns
+    codegen_time::UInt64 # ns
+    llvm_opt_time::UInt64 # ns
+    emit_time::UInt64 # ns
+end
+
+total_time(s::CompileStats) = s.infer_time + s.codegen_time + s.llvm_opt_time + s.emit_time
+
+# the profiled LambdaStaticData and their CompileStats
+function fetch_compile()
+    lambdas = copy(ccall(:jl_compile_profile_lambdas_list, Any, ())::Vector{Any})
+    ptr = convert(Ptr{CompileStats}, ccall(:jl_compile_profile_get_data, Ptr{UInt8}, ()))
+    n = min(length(lambdas), Int(ccall(:jl_compile_profile_len_data, Csize_t, ())))
+    stats = CompileStats[unsafe_load(ptr, i) for i = 1:n]
+    resize!(lambdas, n), stats
+end
+
+# print the profiled lambdas, the slowest to compile first
+function print_compile(io::IO = STDOUT)
+    lambdas, stats = fetch_compile()
+    println(io, lpad("total ms", 10), lpad("infer ms", 10), lpad("codegen ms", 12),
+            lpad("opt ms", 10), lpad("emit ms", 10), "  function")
+    ms(t) = div(t, 10^6)
+    for i in sortperm(stats, by = s -> -Int(total_time(s)))
+        s, li = stats[i], lambdas[i]
+        println(io, lpad(ms(total_time(s)), 10), lpad(ms(s.infer_time), 10),
+                lpad(ms(s.codegen_time), 12), lpad(ms(s.llvm_opt_time), 10),
+                lpad(ms(s.emit_time), 10), "  ", li.module, ".", li.name,
+                " at ", li.file, ":", li.line)
+    end
+end
+
+# the stream the compile log is written to, kept here so it is not collected
+const compile_log_stream = Any[nothing]
+
+function log_compile(::Void)
+    ccall(:jl_compile_log, Void, (Ptr{Void},), C_NULL)
+    compile_log_stream[1] = nothing
+end
+function log_compile(io::Union{IOStream,Base.LibuvStream})
+    compile_log_stream[1] = io
+    ccall(:jl_compile_log, Void, (Ptr{Void},), io.handle)
+end
 
 ####
 #### Internal interface
@@ -140,15 +373,16 @@ len_data() = convert(Int, ccall(:jl_profile_len_data, Csize_t, ()))
 
 maxlen_data() = convert(Int, ccall(:jl_profile_maxlen_data, Csize_t, ()))
 
-function lookup(ip::Ptr{Void})
-    info = ccall(:jl_lookup_code_address, Any, (Ptr{Void},Cint), ip, false)
+lookup(ip::Ptr{Void}) = lineinfo(ccall(:jl_lookup_code_address, Any, (Ptr{Void},Cint), ip, false))
+lookup(ip::UInt) = lookup(convert(Ptr{Void},ip))
+
+function lineinfo(info)
     if length(info) == 7
         return LineInfo(string(info[1]), string(info[2]), Int(info[3]), string(info[4]), Int(info[5]), info[6], Int64(info[7]))
     else
         return UNKNOWN
     end
 end
-lookup(ip::UInt) = lookup(convert(Ptr{Void},ip))
 
 error_codes = Dict{Int,ASCIIString}(
     -1=>"cannot specify signal action for profiling",
@@ -157,6 +391,7 @@ error_codes = Dict{Int,ASCIIString}(
     -4=>"cannot unblock SIGUSR1")
 
 function fetch()
+    is_ring() && return drain()
     len = len_data()
     maxlen = maxlen_data()
     if (len == maxlen)
@@ -165,6 +400,33 @@ function fetch()
     pointer_to_array(get_data_pointer(), (len,))
 end
 
+# the backtraces and, for each one, the id of the thread and the address of
+# the task it was taken on
+function fetch_threads()
+    is_ring() && error("backtraces are not tagged with their threads in ring-buffer mode")
+    data = copy(fetch())
+    n = Int(ccall(:jl_profile_len_samples, Csize_t, ()))
+    tids = Int[ccall(:jl_profile_sample_thread, Int16, (Csize_t,), i-1) + 1 for i = 1:n]
+    tasks = UInt[ccall(:jl_profile_sample_task, UInt, (Csize_t,), i-1) for i = 1:n]
+    data, tids, tasks
+end
+
+# the backtraces taken on thread `tid`, in the format of `fetch`
+function fetch_thread(tid::Integer)
+    data, tids = fetch_threads()
+    out = similar(data, 0)
+    k = 1
+    start = 1
+    for i = 1:length(data)
+        if data[i] == 0
+            tids[k] == tid && append!(out, sub(data, start:i))
+            k += 1
+            start = i + 1
+        end
+    end
+    out
+end
+
 
 # Number of backtrace "steps" that are triggered by taking the backtrace, e.g., inside profile_bt
 # May be platform-specific?
@@ -0,0 +1,37 @@
+# This file is a part of Julia. License is MIT: http://julialang.org/license
+
+import Base: push!, shift!, length, isempty
+
+export ThreadQueue, trypush!, tryshift!, capacity
+
+# Bounded multi-producer multi-consumer queue for handing values between
+# threads, implemented in the runtime without locks. push! waits for room
+# and shift! for a value, spinning and then sleeping like the threads that
+# wait for work; both take part in the collections that start meanwhile.
+type ThreadQueue
+    handle::Ptr{Void}
+    function ThreadQueue(capacity::Integer)
+        capacity > 0 || throw(ArgumentError("queue capacity must be positive"))
+        q = new(ccall(:jl_queue_new, Ptr{Void}, (Csize_t,), capacity))
+        finalizer(q, q->ccall(:jl_queue_free, Void, (Ptr{Void},), q.handle))
+        q
+    end
+end
+
+# the capacity is rounded up to a power of two
+capacity(q::ThreadQueue) = Int(ccall(:jl_queue_capacity, Csize_t, (Ptr{Void},), q.handle))
+length(q::ThreadQueue) = Int(ccall(:jl_queue_length, Csize_t, (Ptr{Void},), q.handle))
+isempty(q::ThreadQueue) = length(q) == 0
+
+function push!(q::ThreadQueue, x::ANY)
+    ccall(:jl_queue_push, Void, (Ptr{Void}, Any), q.handle, x)
+    q
+end
+trypush!(q::ThreadQueue, x::ANY) = ccall(:jl_queue_trypush, Cint, (Ptr{Void}, Any), q.handle, x) != 0
+
+shift!(q::ThreadQueue) = ccall(:jl_queue_pop, Any, (Ptr{Void},), q.handle)
+immutable QueueEmpty end
+function tryshift!(q::ThreadQueue)
+    x = ccall(:jl_queue_trypop_default, Any, (Ptr{Void}, Any), q.handle, QueueEmpty())
+    isa(x, QueueEmpty) ? Nullable{Any}() : Nullable{Any}(x)
+end
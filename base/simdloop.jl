@@ -89,4 +89,7 @@ macro simd(forloop)
     esc(compile(forloop))
 end
 
+# print whether each @simd loop compiled from now on gets vectorized
+simd_report(on::Bool=true) = ccall(:jl_simdloop_report, Void, (Cint,), on)
+
 end # module SimdLoop
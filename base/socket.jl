@@ -464,7 +464,17 @@ function setopt(sock::UDPSocket; multicast_loop = nothing, multicast_ttl=nothing
     end
 end
 
-alloc_buf_hook(sock::UDPSocket,size::UInt) = (Libc.malloc(size),size)
+# Every datagram is copied out of the receive buffer in uv_recvcb before the
+# event loop can call alloc_buf again, so a single buffer is reused for all
+# UDP sockets on the loop instead of a fresh malloc per datagram.
+const udp_recv_buffer = UInt8[]
+
+function alloc_buf_hook(sock::UDPSocket, size::UInt)
+    if length(udp_recv_buffer) < size
+        resize!(udp_recv_buffer, size)
+    end
+    (pointer(udp_recv_buffer), UInt(length(udp_recv_buffer)))
+end
 
 function _recv_start(sock::UDPSocket)
     if ccall(:uv_is_active,Cint,(Ptr{Void},),sock.handle) == 0
@@ -489,29 +499,68 @@ function recvfrom(sock::UDPSocket)
     stream_wait(sock,sock.recvnotify)::Tuple{Union{IPv4, IPv6}, Vector{UInt8}}
 end
 
+# staging area for recvmany: maxmsgs slots of msgsize bytes, plus their lengths
+# and source addresses; only the received bytes are copied out
+const udp_batch_buffer = UInt8[]
+const udp_batch_lens = Csize_t[]
+const udp_batch_addrs = UInt8[]
+
+"""
+    recvmany(socket::UDPSocket; maxmsgs=64, msgsize=65536) -> Vector{(address, data)}
+
+Wait for a UDP packet on `socket`, then return it together with any other packets
+already queued on the socket, up to `maxmsgs` in total, as a vector of
+`(address, data)` tuples. Queued packets are drained with a single `recvmmsg` call
+where the platform supports it; packets longer than `msgsize` are truncated.
+"""
+function recvmany(sock::UDPSocket; maxmsgs::Integer=64, msgsize::Integer=65536)
+    msgs = Tuple{Union{IPv4, IPv6}, Vector{UInt8}}[recvfrom(sock)]
+    n = Int(maxmsgs) - 1
+    n > 0 || return msgs
+    addrsize = Int(ccall(:jl_sizeof_sockaddr_storage, Csize_t, ()))
+    length(udp_batch_buffer) < n*msgsize && resize!(udp_batch_buffer, n*msgsize)
+    length(udp_batch_lens) < n && resize!(udp_batch_lens, n)
+    length(udp_batch_addrs) < n*addrsize && resize!(udp_batch_addrs, n*addrsize)
+    nrecv = ccall(:jl_udp_recvmmsg, Cint,
+                  (Ptr{Void}, Ptr{UInt8}, Csize_t, Ptr{Csize_t}, Ptr{UInt8}, Cuint),
+                  sock.handle, udp_batch_buffer, msgsize, udp_batch_lens, udp_batch_addrs, n)
+    nrecv == UV_ENOSYS && return msgs
+    uv_error("recvmany", nrecv)
+    for i = 1:nrecv
+        addr = pointer(udp_batch_addrs) + (i-1)*addrsize
+        off = (i-1)*msgsize
+        push!(msgs, (_sockaddr_to_ip(addr),
+                     udp_batch_buffer[off+1:off+Int(udp_batch_lens[i])]))
+    end
+    msgs
+end
+
+function _sockaddr_to_ip(addr::Ptr)
+    if ccall(:jl_sockaddr_in_is_ip4, Cint, (Ptr{Void},), addr) == 1
+        IPv4(ntoh(ccall(:jl_sockaddr_host4, UInt32, (Ptr{Void},), addr)))
+    else
+        tmp = [UInt128(0)]
+        ccall(:jl_sockaddr_host6, UInt32, (Ptr{Void}, Ptr{UInt8}), addr, pointer(tmp))
+        IPv6(ntoh(tmp[1]))
+    end
+end
+
 
 function uv_recvcb(handle::Ptr{Void}, nread::Cssize_t, buf::Ptr{Void}, addr::Ptr{Void}, flags::Cuint)
     sock = @handle_as handle UDPSocket
-    buf_addr = ccall(:jl_uv_buf_base, Ptr{Void}, (Ptr{Void},), buf)
-    buf_size = ccall(:jl_uv_buf_len, Csize_t, (Ptr{Void},), buf)
     # C signature documented as (*uv_udp_recv_cb)(...)
     if flags & UV_UDP_PARTIAL > 0
-        Libc.free(buf_addr)
         notify_error(sock.recvnotify,"Partial message received")
     end
 
     # need to check the address type in order to convert to a Julia IPAddr
-    addrout = if (addr == C_NULL)
-                  IPv4(0)
-              elseif ccall(:jl_sockaddr_in_is_ip4, Cint, (Ptr{Void},), addr) == 1
-                  IPv4(ntoh(ccall(:jl_sockaddr_host4, UInt32, (Ptr{Void},), addr)))
-              else
-                  tmp = [UInt128(0)]
-                  ccall(:jl_sockaddr_host6, UInt32, (Ptr{Void}, Ptr{UInt8}), addr, pointer(tmp))
-                  IPv6(ntoh(tmp[1]))
-              end
-    buf = pointer_to_array(convert(Ptr{UInt8},buf_addr),Int(buf_size),true)
-    notify(sock.recvnotify,(addrout,buf[1:nread]))
+    addrout = addr == C_NULL ? IPv4(0) : _sockaddr_to_ip(addr)
+    # nread == 0 with a NULL addr just means there was nothing to read
+    nread == 0 && addr == C_NULL && return nothing
+    notify(sock.recvnotify,(addrout,udp_recv_buffer[1:nread]))
+    # with nobody left waiting, leave further packets queued in the kernel
+    # (where recvmany can drain them in bulk) instead of dropping them here
+    isempty(sock.recvnotify.waitq) && _recv_stop(sock)
     nothing
 end
 
@@ -535,6 +584,44 @@ function send(sock::UDPSocket,ipaddr,port,msg)
     nothing
 end
 
+_sendmmsg(sock::UDPSocket, ipaddr::IPv4, port::UInt16, ptrs::Ptr, lens::Ptr, n::Int) =
+    ccall(:jl_udp_sendmmsg, Cint,
+          (Ptr{Void}, UInt16, Ptr{UInt32}, Cint, Ptr{Ptr{UInt8}}, Ptr{Csize_t}, Cuint),
+          sock.handle, hton(port), &hton(ipaddr.host), 0, ptrs, lens, n)
+_sendmmsg(sock::UDPSocket, ipaddr::IPv6, port::UInt16, ptrs::Ptr, lens::Ptr, n::Int) =
+    ccall(:jl_udp_sendmmsg, Cint,
+          (Ptr{Void}, UInt16, Ptr{UInt128}, Cint, Ptr{Ptr{UInt8}}, Ptr{Csize_t}, Cuint),
+          sock.handle, hton(port), &hton(ipaddr.host), 1, ptrs, lens, n)
+
+"""
+    sendmany(socket::UDPSocket, host::IPAddr, port::Integer, msgs)
+
+Send each message in `msgs` as a separate UDP packet over `socket` to `host:port`.
+Packets are handed to the kernel in batches with `sendmmsg` where the platform
+supports it; whenever the socket buffer is full, one packet is queued through
+[`send`](:func:`send`) so that the call waits for room instead of failing.
+"""
+function sendmany(sock::UDPSocket, ipaddr::IPAddr, port::Integer, msgs)
+    if sock.status != StatusInit && sock.status != StatusOpen
+        error("UDPSocket is not initialized and open")
+    end
+    bufs = collect(msgs)
+    ptrs = Ptr{UInt8}[pointer(b) for b in bufs]
+    lens = Csize_t[sizeof(b) for b in bufs]
+    i = 1
+    while i <= length(bufs)
+        n = _sendmmsg(sock, ipaddr, UInt16(port), pointer(ptrs, i), pointer(lens, i),
+                      length(bufs) - i + 1)
+        uv_error("sendmany", n)
+        i += n
+        if i <= length(bufs)
+            send(sock, ipaddr, port, bufs[i])
+            i += 1
+        end
+    end
+    nothing
+end
+
 function uv_sendcb(handle::Ptr{Void}, status::Cint)
     sock = @handle_as handle UDPSocket
     if status < 0
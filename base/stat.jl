@@ -83,6 +83,52 @@ lstat(path::AbstractString) = @stat_call jl_lstat Cstring path
 stat(path...) = stat(joinpath(path...))
 lstat(path...) = lstat(joinpath(path...))
 
+# batched stat: all requests go to the libuv threadpool at once and the
+# calling task (only) waits for the whole batch, so the latencies overlap
+
+function uv_fs_batchcb(data::Ptr{Void})
+    notify(unsafe_pointer_to_objref(data)::Condition)
+    nothing
+end
+
+function _stat_batch(paths, follow::Bool)
+    n = length(paths)
+    strs = [bytestring(p) for p in paths]
+    cpaths = Cstring[Base.unsafe_convert(Cstring, s) for s in strs]
+    sz = Int(ccall(:jl_sizeof_stat, Int32, ()))
+    bufs = zeros(UInt8, sz*n)
+    results = zeros(Int32, n)
+    c = Condition()
+    if ccall(:jl_fs_stat_batch, Cint,
+             (Ptr{Void}, Ptr{Cstring}, Csize_t, Cint, Ptr{UInt8}, Ptr{Int32}, Any, Ptr{Void}),
+             eventloop(), cpaths, n, follow, bufs, results, c,
+             cfunction(uv_fs_batchcb, Void, (Ptr{Void},))) != 0
+        wait(c)
+    end
+    sts = Array(StatStruct, n)
+    for i = 1:n
+        r = results[i]
+        r==0 || r==Base.UV_ENOENT || r==Base.UV_ENOTDIR || throw(UVError("stat",r))
+        sts[i] = r == 0 ? StatStruct(pointer(bufs, (i-1)*sz+1)) : StatStruct()
+    end
+    sts
+end
+
+"""
+    stat_batch(paths) -> Vector{StatStruct}
+
+Like `map(stat, paths)`, but every `stat` call is issued at once on the libuv
+threadpool. Only the calling task waits for the batch to finish.
+"""
+stat_batch(paths::AbstractVector) = _stat_batch(paths, true)
+
+"""
+    lstat_batch(paths) -> Vector{StatStruct}
+
+Like `map(lstat, paths)`, issuing the calls together as [`stat_batch`](:func:`stat_batch`) does.
+"""
+lstat_batch(paths::AbstractVector) = _stat_batch(paths, false)
+
 # some convenience functions
 
 filemode(st::StatStruct) = st.mode
@@ -617,6 +617,46 @@ function uv_asynccb(handle::Ptr{Void})
     nothing
 end
 
+# Run the finalizers of the objects found by the collections from a task, `batch`
+# finalizers at a time, instead of during the collection pauses, until
+# `stop_deferred_finalizers` is called. Returns the task.
+const deferred_finalizers = Any[]  # the async handle, condition and task
+
+function defer_finalizers(batch::Integer=100)
+    stop_deferred_finalizers()
+    cond = Condition()
+    work = SingleAsyncWork(w->notify(cond))
+    running = Ref(true)
+    t = @schedule begin
+        while running[]
+            while ccall(:jl_gc_run_pending_finalizers, Csize_t, (Csize_t,), batch) > 0
+                yield()
+            end
+            running[] && wait(cond)
+        end
+        # the ones left from before the collections stopped deferring
+        while ccall(:jl_gc_run_pending_finalizers, Csize_t, (Csize_t,), batch) > 0
+        end
+        close(work)
+    end
+    push!(deferred_finalizers, work, cond, t, running)
+    ccall(:jl_gc_defer_finalizers, Void, (Ptr{Void},), work.handle)
+    t
+end
+
+# Have the collections run the finalizers in their pauses again, after the task
+# started by `defer_finalizers` has run the ones it was left.
+function stop_deferred_finalizers()
+    isempty(deferred_finalizers) && return
+    work, cond, t, running = deferred_finalizers
+    empty!(deferred_finalizers)
+    ccall(:jl_gc_defer_finalizers, Void, (Ptr{Void},), C_NULL)
+    running[] = false
+    notify(cond)
+    wait(t)
+    nothing
+end
+
 ##########################################
 # Timer
 ##########################################
@@ -953,9 +993,32 @@ function uv_write(s::LibuvStream, p::Ptr, n::UInt)
     return Int(n)
 end
 
+# write several buffers with a single request (and syscall)
+function uv_writev(s::LibuvStream, bufs::Vector{UInt8}...)
+    check_open(s)
+    ptrs = Ptr{UInt8}[pointer(b) for b in bufs]
+    lens = UInt[length(b) for b in bufs]
+    uvw = Libc.malloc(_sizeof_uv_write)
+    uv_req_set_data(uvw,C_NULL)
+    err = ccall(:jl_uv_writev,
+                Int32,
+                (Ptr{Void}, Ptr{Ptr{UInt8}}, Ptr{UInt}, Cuint, Ptr{Void}, Ptr{Void}),
+                s, ptrs, lens, length(bufs), uvw,
+                uv_jl_writecb_task::Ptr{Void})
+    if err < 0
+        Libc.free(uvw)
+        uv_error("write", err)
+    end
+    ct = current_task()
+    uv_req_set_data(uvw,ct)
+    stream_wait(ct)
+    return Int(sum(lens))
+end
+
 # Optimized send
 # - smaller writes are buffered, final uv write on flush or when buffer full
 # - large isbits arrays are unbuffered and written directly
+# - several byte arrays written at once go out in a single request
 
 function buffer_or_write(s::LibuvStream, p::Ptr, n::Integer)
     if isnull(s.sendbuf)
@@ -1007,6 +1070,25 @@ end
 
 write(s::LibuvStream, p::Ptr, n::Integer) = buffer_or_write(s, p, n)
 
+function write(s::LibuvStream, a::Vector{UInt8}, b::Vector{UInt8}, bs::Vector{UInt8}...)
+    n = length(a) + length(b)
+    for x in bs
+        n += length(x)
+    end
+    if !isnull(s.sendbuf)
+        buf = get(s.sendbuf)
+        if nb_available(buf) + n < buf.maxsize
+            write(buf, a); write(buf, b)
+            for x in bs
+                write(buf, x)
+            end
+            return n
+        end
+        flush(s)
+    end
+    return uv_writev(s, a, b, bs...)
+end
+
 function uv_writecb_task(req::Ptr{Void}, status::Cint)
     d = uv_req_data(req)
     if d != C_NULL
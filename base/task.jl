@@ -82,6 +82,22 @@ function throwto(t::Task, exc)
     yieldto(t)
 end
 
+# This type must be kept in sync with the C struct in src/task.c
+immutable Task_Stats
+    ntasks        ::UInt64 # tasks created
+    nswitches     ::UInt64 # switches to another task
+    saved_bytes   ::UInt64 # copied off the stack by the switches
+    restored_bytes::UInt64 # copied back onto the stack
+    stack_allocs  ::UInt64 # task stacks mapped (only with separate task stacks)
+    stack_reuses  ::UInt64 # task stacks reused from the pool
+end
+
+function task_stats()
+    stats = Ref{Task_Stats}()
+    ccall(:jl_task_stats, Void, (Ptr{Task_Stats},), stats)
+    return stats[]
+end
+
 task_local_storage() = get_task_tls(current_task())
 function get_task_tls(t::Task)
     if is(t.storage, nothing)
@@ -4,16 +4,42 @@ export threadid, nthreads, @threads
 
 threadid() = Int(ccall(:jl_threadid, Int16, ())+1)
 
+# the thread of the threaded region being run, which within a nested region is
+# not unique among the running threads: only for partitioning work, never for
+# ownership
+regionthreadid() = Int(ccall(:jl_threadregionid, Int16, ())+1)
+
 # Inclusive upper bound on threadid()
 nthreads() = Int(unsafe_load(cglobal(:jl_n_threads, Cint)))
 
-function _threadsfor(iter,lbody)
+function _threadsfor(iter,lbody,schedule,chunk)
     fun = gensym("_threadsfor")
     lidx = iter.args[1]         # index
     range = iter.args[2]
+    if schedule !== :static
+        guided = schedule === :guided ? 1 : 0
+        return quote
+            function $fun()
+                r = $(esc(range))
+                n = length(r)
+                sz = Ref{Int}(0)
+                # take chunks of iterations until there are none left
+                while true
+                    f = ccall(:jl_threading_next_chunk, Int, (Int, Int, Cint, Ref{Int}),
+                              n, $(esc(chunk)), $guided, sz)
+                    sz[] == 0 && break
+                    for i = f+1:f+sz[]
+                        local $(esc(lidx)) = Base.unsafe_getindex(r,i)
+                        $(esc(lbody))
+                    end
+                end
+            end
+            ccall(:jl_threading_run, Void, (Any, Any), $fun, ())
+        end
+    end
     quote
         function $fun()
-            tid = threadid()
+            tid = regionthreadid()
             r = $(esc(range))
             # divide loop iterations among threads
             len, rem = divrem(length(r), nthreads())
@@ -47,19 +73,142 @@ function _threadsfor(iter,lbody)
     end
 end
 
+"""
+    Threads.spawn(f)
+
+Queue `f()` to be run by whichever thread is free, once the threaded region
+the caller is in ends, or at the next `Threads.sync()`. The first exception
+thrown by the work spawned in a region is thrown when the region ends.
+"""
+spawn(f::Function) = (ccall(:jl_threading_spawn, Void, (Any,), f); nothing)
+
+"""
+    Threads.sync()
+
+Run the work queued with `Threads.spawn` on all the threads and wait for it to
+finish. Throws the first exception thrown by that work, if any. Called from
+spawned work or a nested threaded region, it waits for all the work except
+the spawned work that is itself waiting in a `Threads.sync()`.
+"""
+function sync()
+    e = ccall(:jl_threading_sync, Any, ())
+    e === nothing || throw(e)
+    nothing
+end
+
+"""
+    Threads.reduce_threads(op, f)
+
+Run `f()` on every thread and return the values it returned combined with
+`op`, in a tree, like `reduce(op, [f() for each thread])`: `op` must be
+associative.
+"""
+reduce_threads(op::Function, f::Function) =
+    ccall(:jl_threading_run_reduce, Any, (Any, Any, Any), f, (), op)
+
+"""
+    @threads [schedule [chunk]] for ... end
+
+Run the iterations of the loop on all the threads. With the default
+`:static` schedule each thread runs one contiguous block of them; with
+`:dynamic` the threads take `chunk` iterations at a time (default 1) until
+none are left, and with `:guided` chunks that shrink from a share of what
+is left down to `chunk`, which balance loops with an uneven cost per
+iteration.
+"""
 macro threads(args...)
     na = length(args)
-    if na != 1
+    if na < 1 || na > 3
         throw(ArgumentError("wrong number of arguments in @threads"))
     end
-    ex = args[1]
+    ex = args[end]
     if !isa(ex, Expr)
         throw(ArgumentError("need an expression argument to @threads"))
     end
+    schedule = :static
+    if na > 1
+        s = args[1]
+        schedule = isa(s, QuoteNode) ? s.value :
+                   isa(s, Expr) && is(s.head, :quote) ? s.args[1] : s
+        if !(schedule in (:static, :dynamic, :guided))
+            throw(ArgumentError("unknown schedule $(args[1]) in @threads"))
+        end
+    end
+    chunk = na > 2 ? args[2] : 1
     if is(ex.head, :for)
-        return _threadsfor(ex.args[1],ex.args[2])
+        return _threadsfor(ex.args[1],ex.args[2],schedule,chunk)
     else
         throw(ArgumentError("unrecognized argument to @threads"))
     end
 end
 
+"""
+    Threads.fill(x, dims)
+
+Like `fill(x, dims)`, but the elements are written by all the threads, each
+one the block of linear indices a `:static` `@threads` loop over the array
+gives it. The memory of a big array is only placed when it is first written,
+so on a NUMA system each part of the array ends up on the node of the thread
+that goes on to work on it in later loops with the same schedule. Arrays of
+non-`isbits` elements are filled by the calling thread.
+"""
+function fill(x, dims::Dims)
+    isbits(typeof(x)) || return Base.fill(x, dims)
+    a = Array(typeof(x), dims)
+    @threads for i = 1:length(a)
+        @inbounds a[i] = x
+    end
+    a
+end
+fill(x, dims::Integer...) = fill(x, dims)
+
+"""
+    Threads.zeros(T, dims)
+
+Like `zeros(T, dims)`, with the pages placed like in `Threads.fill`.
+"""
+zeros(T::Type, dims::Dims) = fill(zero(T), dims)
+zeros(T::Type, dims::Integer...) = zeros(T, dims)
+
+
+# This type must be kept in sync with the C struct in src/threading.c
+immutable Thread_Profile
+    nregions      ::UInt64 # threaded regions run
+    prep          ::UInt64 # ns specializing and compiling them (thread 1 only)
+    fork          ::UInt64 # ns waiting to be released into them
+    fork_spin     ::UInt64 # ns waiting for a fork or barrier, spinning
+    fork_sleep    ::UInt64 # ns of that asleep
+    nsleeps       ::UInt64
+    user          ::UInt64 # ns running the regions
+    join          ::UInt64
+    gc            ::UInt64 # ns in collections, waiting at their barriers included
+    imbalance     ::UInt64 # ns behind the slowest thread, summed over the regions
+    user_hist     ::NTuple{24,UInt64} # regions that ran in [2^(i-2), 2^(i-1)) us
+    imbalance_hist::NTuple{24,UInt64} # regions this thread was as far behind
+end
+
+"""
+    Threads.profile()
+
+The time each thread spent in the threaded regions run so far (or since
+`Threads.clear_profile()`), as a vector of `Thread_Profile`s, one per thread.
+Tuning `JULIA_THREAD_SLEEP_THRESHOLD` trades `fork_spin` for `fork_sleep`, a
+high `imbalance` calls for a `:dynamic` or `:guided` `@threads` schedule.
+Empty if the runtime was built without threading profiling.
+"""
+function profile()
+    prof = Thread_Profile[]
+    p = Ref{Thread_Profile}()
+    while ccall(:jl_threading_profile_data, Cint, (Cint, Ptr{Thread_Profile}),
+                length(prof), p) == 0
+        push!(prof, p[])
+    end
+    prof
+end
+
+"""
+    Threads.clear_profile()
+
+Reset the profile returned by `Threads.profile()`.
+"""
+clear_profile() = ccall(:jl_threading_profile_clear, Void, ())
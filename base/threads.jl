@@ -5,6 +5,7 @@ module Threads
 include("threadingconstructs.jl")
 include("atomics.jl")
 include("locks.jl")
+include("queues.jl")
 
 end
 
@@ -26,6 +26,59 @@ end
 
 gc_num() = ccall(:jl_gc_num, GC_Num, ())
 
+# This type must be kept in sync with the C struct in src/gc.c
+immutable GC_Stats
+    last_mark_time     ::UInt64 # in ns, for the last collection
+    last_sweep_time    ::UInt64
+    last_finalize_time ::UInt64
+    total_mark_time    ::UInt64
+    total_sweep_time   ::UInt64
+    total_finalize_time::UInt64
+    max_pause          ::UInt64
+    promoted           ::Int64  # bytes promoted by the quick collections
+    freed_pages        ::UInt64
+    # pause_hist[1] counts the pauses under 1us, pause_hist[i] the ones in
+    # [2^(i-2), 2^(i-1)) us, and pause_hist[24] also the longer ones
+    pause_hist         ::NTuple{24,UInt64}
+end
+
+function gc_stats()
+    stats = Ref{GC_Stats}()
+    ccall(:jl_gc_stats, Void, (Ptr{GC_Stats},), stats)
+    return stats[]
+end
+
+# the pauses of the last (at most n, at most 4096) collections, in ns, the oldest first
+function gc_pauses(n::Integer=4096)
+    pauses = Array(UInt64, n)
+    resize!(pauses, ccall(:jl_gc_pause_log, Csize_t, (Ptr{UInt64}, Csize_t), pauses, n))
+end
+
+# This type must be kept in sync with the C struct in src/gc.c
+immutable GC_Heap_Stats
+    allocd          ::UInt64 # bytes allocated by the thread
+    poolalloc       ::UInt64
+    bigalloc        ::UInt64
+    malloc          ::UInt64
+    pages           ::UInt64 # pool pages owned by the heap
+    nbig            ::UInt64 # big objects in the list of the heap (not the old ones)
+    big_bytes       ::UInt64
+    nmalloc_arrays  ::UInt64
+    remset_len      ::UInt64
+    rem_bindings_len::UInt64
+    remset_ptrs     ::UInt64
+end
+
+# the statistics of the heap of each thread
+function gc_heap_stats()
+    stats = GC_Heap_Stats[]
+    s = Ref{GC_Heap_Stats}()
+    while ccall(:jl_gc_heap_stats, Cint, (Cint, Ptr{GC_Heap_Stats}), length(stats), s) == 0
+        push!(stats, s[])
+    end
+    return stats
+end
+
 # This type is to represent differences in the counters, so fields may be negative
 immutable GC_Diff
     allocd      ::Int64 # Bytes allocated
@@ -147,8 +147,14 @@ function link_sysimg(sysimg_path=nothing, cc=find_system_compiler(), debug=false
     push!(FLAGS, debug ? "-ljulia-debug" : "-ljulia")
     @windows_only push!(FLAGS, "-lssp")
 
+    # with JULIA_IMAGE_THREADS=n, sys.o is emitted as n partitions sys.o, sys.o.1, ...
+    objs = ["$sysimg_path.o"]
+    while isfile("$sysimg_path.o.$(length(objs))")
+        push!(objs, "$sysimg_path.o.$(length(objs))")
+    end
+
     info("Linking sys.$(Libdl.dlext)")
-    run(`$cc $FLAGS -o $sysimg_path.$(Libdl.dlext) $sysimg_path.o`)
+    run(`$cc $FLAGS -o $sysimg_path.$(Libdl.dlext) $objs`)
 
     info("System image successfully built at $sysimg_path.$(Libdl.dlext)")
     @windows_only begin
@@ -82,6 +82,23 @@ int main()
         printf("my_func(5.0) = %f\n", ret);
     }
 
+    {
+        // call a julia function many times through a call context
+
+        jl_function_t *func = jl_get_function(jl_current_module, "my_func");
+        jl_call_ctx_t *ctx = jl_call_ctx_new(func, 1);
+        jl_value_t **args = jl_call_ctx_args(ctx);
+        double sum = 0;
+        int i;
+        for (i = 0; i < 100; i++) {
+            args[0] = jl_box_float64(i);
+            sum += jl_unbox_float64(jl_call_ctx_invoke(ctx));
+        }
+        jl_call_ctx_free(ctx);
+
+        printf("sum of my_func(0:99) = %f\n", sum);
+    }
+
     {
         // call c function
 
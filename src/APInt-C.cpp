@@ -41,6 +41,17 @@ using namespace llvm;
     else \
         memcpy(p##r, a.getRawData(), RoundUpToAlignment(numbits, host_char_bit) / host_char_bit); \
 
+/* whole-word widths are handled a word at a time, without building an APInt */
+#define WHOLE_WORDS (numbits % integerPartWidth == 0)
+#define NWORDS (numbits / integerPartWidth)
+
+#define WORDWISE(r, a, op, b) \
+    if (WHOLE_WORDS) { \
+        for (unsigned i = 0; i < NWORDS; i++) \
+            p##r[i] = p##a[i] op p##b[i]; \
+        return; \
+    }
+
 extern "C" JL_DLLEXPORT
 void LLVMNeg(unsigned numbits, integerPart *pa, integerPart *pr) {
     APInt z(numbits, 0);
@@ -51,6 +62,15 @@ void LLVMNeg(unsigned numbits, integerPart *pa, integerPart *pr) {
 
 extern "C" JL_DLLEXPORT
 void LLVMAdd(unsigned numbits, integerPart *pa, integerPart *pb, integerPart *pr) {
+    if (WHOLE_WORDS) {
+        integerPart carry = 0;
+        for (unsigned i = 0; i < NWORDS; i++) {
+            integerPart a = pa[i], s = a + pb[i] + carry;
+            carry = carry ? s <= a : s < a;
+            pr[i] = s;
+        }
+        return;
+    }
     CREATE(a)
     CREATE(b)
     a += b;
@@ -59,6 +79,15 @@ void LLVMAdd(unsigned numbits, integerPart *pa, integerPart *pb, integerPart *pr
 
 extern "C" JL_DLLEXPORT
 void LLVMSub(unsigned numbits, integerPart *pa, integerPart *pb, integerPart *pr) {
+    if (WHOLE_WORDS) {
+        integerPart borrow = 0;
+        for (unsigned i = 0; i < NWORDS; i++) {
+            integerPart a = pa[i], b = pb[i];
+            pr[i] = a - b - borrow;
+            borrow = borrow ? a <= b : a < b;
+        }
+        return;
+    }
     CREATE(a)
     CREATE(b)
     a -= b;
@@ -107,6 +136,8 @@ void LLVMURem(unsigned numbits, integerPart *pa, integerPart *pb, integerPart *p
 
 extern "C" JL_DLLEXPORT
 int LLVMICmpEQ(unsigned numbits, integerPart *pa, integerPart *pb) {
+    if (WHOLE_WORDS)
+        return memcmp(pa, pb, NWORDS * sizeof(integerPart)) == 0;
     CREATE(a)
     CREATE(b)
     return a.eq(b);
@@ -114,6 +145,8 @@ int LLVMICmpEQ(unsigned numbits, integerPart *pa, integerPart *pb) {
 
 extern "C" JL_DLLEXPORT
 int LLVMICmpNE(unsigned numbits, integerPart *pa, integerPart *pb) {
+    if (WHOLE_WORDS)
+        return memcmp(pa, pb, NWORDS * sizeof(integerPart)) != 0;
     CREATE(a)
     CREATE(b)
     return a.ne(b);
@@ -128,6 +161,13 @@ int LLVMICmpSLT(unsigned numbits, integerPart *pa, integerPart *pb) {
 
 extern "C" JL_DLLEXPORT
 int LLVMICmpULT(unsigned numbits, integerPart *pa, integerPart *pb) {
+    if (WHOLE_WORDS) {
+        for (unsigned i = NWORDS; i-- > 0; ) {
+            if (pa[i] != pb[i])
+                return pa[i] < pb[i];
+        }
+        return 0;
+    }
     CREATE(a)
     CREATE(b)
     return a.ult(b);
@@ -149,6 +189,7 @@ int LLVMICmpULE(unsigned numbits, integerPart *pa, integerPart *pb) {
 
 extern "C" JL_DLLEXPORT
 void LLVMAnd(unsigned numbits, integerPart *pa, integerPart *pb, integerPart *pr) {
+    WORDWISE(r, a, &, b)
     CREATE(a)
     CREATE(b)
     a &= b;
@@ -157,6 +198,7 @@ void LLVMAnd(unsigned numbits, integerPart *pa, integerPart *pb, integerPart *pr
 
 extern "C" JL_DLLEXPORT
 void LLVMOr(unsigned numbits, integerPart *pa, integerPart *pb, integerPart *pr) {
+    WORDWISE(r, a, |, b)
     CREATE(a)
     CREATE(b)
     a |= b;
@@ -165,6 +207,7 @@ void LLVMOr(unsigned numbits, integerPart *pa, integerPart *pb, integerPart *pr)
 
 extern "C" JL_DLLEXPORT
 void LLVMXor(unsigned numbits, integerPart *pa, integerPart *pb, integerPart *pr) {
+    WORDWISE(r, a, ^, b)
     CREATE(a)
     CREATE(b)
     a ^= b;
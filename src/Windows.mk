@@ -32,6 +32,7 @@ OBJECTS = \
 	jl_uv.obj \
 	jlapi.obj \
 	llvm-simdloop.obj \
+	llvm-safepoint.obj \
 	gc.obj
 
 LIBFLISP = flisp\libflisp.lib
@@ -142,9 +142,25 @@ void classifyType(Classification& accum, jl_value_t* ty, uint64_t offset) {
     }
 }
 
+// the classifications of struct types, by uid (which, unlike the address of
+// a type, is never given to another type). every ccall and cfunction
+// signature asks for the classification of each of its struct arguments a
+// few times, which would otherwise walk their fields again each time
+static std::map<uint32_t, Classification> classification_cache;
+
 Classification classify(jl_value_t* ty) {
+    bool cacheable = jl_is_structtype(ty) && ((jl_datatype_t*)ty)->uid != 0 &&
+        jl_datatype_size(ty) <= 16;
+    if (cacheable) {
+        std::map<uint32_t, Classification>::iterator it =
+            classification_cache.find(((jl_datatype_t*)ty)->uid);
+        if (it != classification_cache.end())
+            return it->second;
+    }
     Classification cl;
     classifyType(cl, ty, 0);
+    if (cacheable)
+        classification_cache[((jl_datatype_t*)ty)->uid] = cl;
     return cl;
 }
 
@@ -7,6 +7,7 @@
 #include <string.h>
 #include <stdarg.h>
 #include <assert.h>
+#include <math.h>
 #include "julia.h"
 #include "julia_internal.h"
 #include "ia_misc.h"
@@ -35,6 +36,7 @@ jl_value_t *jl_array_any_type=NULL;
 jl_value_t *jl_array_symbol_type;
 jl_function_t *jl_bottom_func;
 jl_datatype_t *jl_weakref_type;
+jl_typename_t *jl_vecelement_typename;
 jl_datatype_t *jl_ascii_string_type;
 jl_datatype_t *jl_utf8_string_type;
 jl_datatype_t *jl_expr_type;
@@ -174,12 +176,67 @@ void jl_assign_bits(void *dest, jl_value_t *bits)
     }
 }
 
+// open addressing table of the field names of a type, keyed by symbol hash.
+// it is kept in the primary type of the typename, so all instances of a
+// parametric type share it, and like struct_decl it is never freed.
+typedef struct {
+    size_t mask;
+    struct {
+        jl_sym_t *name;
+        int idx;
+    } slots[];
+} jl_fieldindex_t;
+
+static jl_fieldindex_t *get_fieldindex(jl_datatype_t *p, jl_svec_t *fn)
+{
+    jl_fieldindex_t *fi = (jl_fieldindex_t*)p->fieldindex;
+    if (fi != NULL)
+        return fi;
+    size_t n = jl_svec_len(fn), sz = 1;
+    while (sz < 2*n)
+        sz <<= 1;
+    fi = (jl_fieldindex_t*)calloc(1, sizeof(jl_fieldindex_t) + sz*sizeof(fi->slots[0]));
+    fi->mask = sz-1;
+    for (size_t i = 0; i < n; i++) {
+        jl_sym_t *s = (jl_sym_t*)jl_svecref(fn, i);
+        size_t h = s->hash & fi->mask;
+        while (fi->slots[h].name != NULL)
+            h = (h+1) & fi->mask;
+        fi->slots[h].name = s;
+        fi->slots[h].idx = (int)i;
+    }
+    // another thread may have built it at the same time
+    if (!JL_ATOMIC_COMPARE_AND_SWAP(p->fieldindex, NULL, (void*)fi)) {
+        free(fi);
+        fi = (jl_fieldindex_t*)p->fieldindex;
+    }
+    return fi;
+}
+
+static int fieldindex_lookup(jl_fieldindex_t *fi, jl_sym_t *fld)
+{
+    size_t h = fld->hash & fi->mask;
+    while (fi->slots[h].name != NULL) {
+        if (fi->slots[h].name == fld)
+            return fi->slots[h].idx;
+        h = (h+1) & fi->mask;
+    }
+    return -1;
+}
+
 JL_DLLEXPORT int jl_field_index(jl_datatype_t *t, jl_sym_t *fld, int err)
 {
     jl_svec_t *fn = t->name->names;
-    for(size_t i=0; i < jl_svec_len(fn); i++) {
-        if (jl_svecref(fn,i) == (jl_value_t*)fld) {
-            return (int)i;
+    if (jl_svec_len(fn) >= FIELD_INDEX_MIN_FIELDS && jl_is_datatype(t->name->primary)) {
+        int i = fieldindex_lookup(get_fieldindex((jl_datatype_t*)t->name->primary, fn), fld);
+        if (i >= 0)
+            return i;
+    }
+    else {
+        for(size_t i=0; i < jl_svec_len(fn); i++) {
+            if (jl_svecref(fn,i) == (jl_value_t*)fld) {
+                return (int)i;
+            }
         }
     }
     if (err)
@@ -320,6 +377,7 @@ jl_lambda_info_t *jl_new_lambda_info(jl_value_t *ast, jl_svec_t *sparams,
     li->module = ctx;
     li->sparams = sparams;
     li->tfunc = jl_nothing;
+    li->tfunc_index = jl_nothing;
     li->fptr = &jl_trampoline;
     li->roots = NULL;
     li->functionObjects.functionObject = NULL;
@@ -331,6 +389,8 @@ jl_lambda_info_t *jl_new_lambda_info(jl_value_t *ast, jl_svec_t *sparams,
     li->inferred = 0;
     li->inInference = 0;
     li->inCompile = 0;
+    li->ninterp = 0;
+    li->feedback = NULL;
     li->unspecialized = NULL;
     li->specializations = NULL;
     li->name = anonymous_sym;
@@ -344,6 +404,7 @@ jl_lambda_info_t *jl_copy_lambda_info(jl_lambda_info_t *linfo)
     jl_lambda_info_t *new_linfo =
         jl_new_lambda_info(linfo->ast, linfo->sparams, linfo->module);
     new_linfo->tfunc = linfo->tfunc;
+    new_linfo->tfunc_index = linfo->tfunc_index;
     new_linfo->name = linfo->name;
     new_linfo->roots = linfo->roots;
     new_linfo->specTypes = linfo->specTypes;
@@ -365,7 +426,22 @@ jl_lambda_info_t *jl_copy_lambda_info(jl_lambda_info_t *linfo)
 
 JL_DEFINE_MUTEX(symbol_table)
 
-static jl_sym_t *volatile symtab = NULL;
+// Symbols are interned in a chained hash table. The buckets are linked
+// through `left`, and every symbol is also on a list through `right`, newest
+// first, for jl_get_root_symbol. Lookups take no lock: a symbol is fully
+// initialized before it is published with a store to its bucket head, and
+// the chains stay acyclic while the table grows. The lock serializes the
+// insertions, which also allocate from the symbol pool, and the growing.
+typedef struct {
+    size_t size; // a power of two
+    jl_sym_t *volatile buckets[];
+} jl_symtab_t;
+
+#define SYMTAB_INIT_SIZE 4096
+
+static jl_symtab_t *volatile symtab = NULL;
+static jl_sym_t *volatile symlist = NULL;
+static size_t nsymbols = 0;
 
 static uptrint_t hash_symbol(const char *str, size_t len)
 {
@@ -410,53 +486,87 @@ static jl_sym_t *mk_symbol(const char *str, size_t len)
     return sym;
 }
 
-static jl_sym_t *symtab_lookup(jl_sym_t *volatile *ptree, const char *str,
-                               size_t len, jl_sym_t *volatile **slot)
+static jl_symtab_t *symtab_alloc(size_t size)
 {
-    jl_sym_t *node = *ptree;
-    uptrint_t h = hash_symbol(str, len);
+    jl_symtab_t *t = (jl_symtab_t*)calloc(1, sizeof(jl_symtab_t) + size*sizeof(jl_sym_t*));
+    if (t != NULL)
+        t->size = size;
+    return t;
+}
 
-    // Tree nodes sorted by major key of (int(hash)) and minor key of (str).
+static jl_sym_t *symtab_lookup(jl_symtab_t *t, const char *str, size_t len,
+                               uptrint_t h)
+{
+    if (t == NULL)
+        return NULL;
+    jl_sym_t *node = t->buckets[h & (t->size-1)];
     while (node != NULL) {
-        intptr_t x = (intptr_t)(h - node->hash);
-        if (x == 0) {
-            x = strncmp(str, jl_symbol_name(node), len);
-            if (x == 0 && jl_symbol_name(node)[len] == 0) {
-                if (slot != NULL)
-                    *slot = ptree;
-                return node;
-            }
-        }
-        if (x < 0)
-            ptree = &node->left;
-        else
-            ptree = &node->right;
-        node = *ptree;
+        if (node->hash == h && strncmp(str, jl_symbol_name(node), len) == 0 &&
+            jl_symbol_name(node)[len] == 0)
+            return node;
+        node = node->left;
         // We may need a data dependency barrier here to pair with the
         // cpu write barrier in _jl_symbol so that we won't read a invalid
         // value from `node`. However, this shouldn't be a problem on all
         // the architectures we currently support.
         // https://www.kernel.org/doc/Documentation/memory-barriers.txt
     }
-    if (slot != NULL)
-        *slot = ptree;
-    return node;
+    return NULL;
+}
+
+// Double the table; called with the lock held. Each symbol is relinked into
+// its new bucket, so a concurrent lookup can miss a symbol on a chain while
+// this runs (never loop), which is why lookups that miss retry under the
+// lock. The old bucket array is not freed, since lookups may still read it.
+static void symtab_grow(void)
+{
+    jl_symtab_t *t = symtab;
+    jl_symtab_t *nt = symtab_alloc(t->size*2);
+    if (nt == NULL)
+        return; // keep using the longer chains
+    for (size_t i = 0; i < t->size; i++) {
+        jl_sym_t *node = t->buckets[i];
+        while (node != NULL) {
+            jl_sym_t *next = node->left;
+            jl_sym_t *volatile *b = &nt->buckets[node->hash & (nt->size-1)];
+            node->left = *b;
+            *b = node;
+            node = next;
+        }
+    }
+    cpu_sfence();
+    symtab = nt;
 }
 
 static jl_sym_t *_jl_symbol(const char *str, size_t len)
 {
-    jl_sym_t *volatile *slot;
-    jl_sym_t *node = symtab_lookup(&symtab, str, len, &slot);
+    uptrint_t h = hash_symbol(str, len);
+    jl_sym_t *node = symtab_lookup(symtab, str, len, h);
     if (node == NULL) {
         JL_LOCK(symbol_table); // Might GC
-        // Someone might have updated it, check and look up again
-        if (*slot != NULL && (node = symtab_lookup(slot, str, len, &slot))) {
+        // Someone might have added it, or moved it while growing the table
+        node = symtab_lookup(symtab, str, len, h);
+        if (node != NULL) {
             JL_UNLOCK(symbol_table);
             return node;
         }
+        if (symtab == NULL) {
+            symtab = symtab_alloc(SYMTAB_INIT_SIZE);
+            if (symtab == NULL) {
+                JL_UNLOCK(symbol_table);
+                jl_throw(jl_memory_exception);
+            }
+        }
+        else if (nsymbols >= symtab->size)
+            symtab_grow();
         node = mk_symbol(str, len);
+        jl_sym_t *volatile *b = &symtab->buckets[h & (symtab->size-1)];
+        node->left = *b;
+        node->right = symlist;
         cpu_sfence();
-        *slot = node;
+        *b = node;
+        symlist = node;
+        nsymbols++;
         JL_UNLOCK(symbol_table);
     }
     return node;
@@ -469,7 +579,15 @@ JL_DLLEXPORT jl_sym_t *jl_symbol(const char *str)
 
 JL_DLLEXPORT jl_sym_t *jl_symbol_lookup(const char *str)
 {
-    return symtab_lookup(&symtab, str, strlen(str), NULL);
+    size_t len = strlen(str);
+    uptrint_t h = hash_symbol(str, len);
+    jl_sym_t *node = symtab_lookup(symtab, str, len, h);
+    if (node == NULL) {
+        JL_LOCK(symbol_table);
+        node = symtab_lookup(symtab, str, len, h);
+        JL_UNLOCK(symbol_table);
+    }
+    return node;
 }
 
 JL_DLLEXPORT jl_sym_t *jl_symbol_n(const char *str, int32_t len)
@@ -479,7 +597,8 @@ JL_DLLEXPORT jl_sym_t *jl_symbol_n(const char *str, int32_t len)
     return _jl_symbol(str, len);
 }
 
-JL_DLLEXPORT jl_sym_t *jl_get_root_symbol(void) { return symtab; }
+// the newest symbol, from which `right` links all the others
+JL_DLLEXPORT jl_sym_t *jl_get_root_symbol(void) { return symlist; }
 
 static uint32_t gs_ctr = 0;  // TODO: per-thread
 uint32_t jl_get_gs_ctr(void) { return gs_ctr; }
@@ -552,9 +671,41 @@ JL_DLLEXPORT jl_datatype_t *jl_new_uninitialized_datatype(size_t nfields,
     t->fielddesc_type = fielddesc_type;
     t->nfields = nfields;
     t->haspadding = 0;
+    t->bitsequal = 0;
     return t;
 }
 
+// the alignment of a tuple of nfields elements of type t if it is laid out
+// as the LLVM vector <nfields x T> (see julia_struct_to_llvm), or 0 if it
+// follows the normal rules. only VecElements of 1, 2, 4 or 8 byte bits
+// types qualify, and only as long as the vector fits the 16 byte alignment
+// that the gc guarantees. this must not depend on LLVM being available.
+unsigned jl_special_vector_alignment(size_t nfields, jl_value_t *t)
+{
+    if (!jl_is_vecelement_type(t) || !jl_is_leaf_type(t))
+        return 0;
+    // LLVM 3.7 miscompiles many vector lengths with more than two bits set
+    size_t mask = nfields;
+    mask &= mask - 1;
+    mask &= mask - 1;
+    if (mask)
+        return 0;
+    jl_value_t *ty = jl_field_type((jl_datatype_t*)t, 0);
+    if (!jl_is_bitstype(ty))
+        return 0;
+    size_t elsz = jl_datatype_size(ty);
+    if (elsz != 1 && elsz != 2 && elsz != 4 && elsz != 8)
+        return 0;
+    size_t size = nfields * elsz;
+    // LLVM aligns vectors to their size rounded up to a power of two
+    size_t alignment = 1;
+    while (alignment < size)
+        alignment *= 2;
+    if (alignment > 16)
+        return 0;
+    return alignment;
+}
+
 void jl_compute_field_offsets(jl_datatype_t *st)
 {
     size_t sz = 0, alignm = 1;
@@ -566,8 +717,13 @@ void jl_compute_field_offsets(jl_datatype_t *st)
                            (1 << (3 + st->fielddesc_type))) - 1;
     uint64_t max_size = max_offset >> 1;
 
+    int homogeneous = 1;
+    jl_value_t *lastty = NULL;
     for(size_t i=0; i < jl_datatype_nfields(st); i++) {
         jl_value_t *ty = jl_field_type(st, i);
+        if (lastty != NULL && ty != lastty)
+            homogeneous = 0;
+        lastty = ty;
         size_t fsz, al;
         if (jl_isbits(ty) && jl_is_leaf_type(ty)) {
             fsz = jl_datatype_size(ty);
@@ -601,11 +757,18 @@ void jl_compute_field_offsets(jl_datatype_t *st)
             jl_throw(jl_overflow_exception);
         sz += fsz;
     }
+    if (homogeneous && lastty != NULL && jl_is_tuple_type(st)) {
+        // tuples of VecElements become LLVM vectors, which are more aligned
+        unsigned al = jl_special_vector_alignment(jl_datatype_nfields(st), lastty);
+        if (al > alignm)
+            alignm = al;
+    }
     st->alignment = alignm;
     st->size = LLT_ALIGN(sz, alignm);
     if (st->size > sz)
         st->haspadding = 1;
     st->pointerfree = ptrfree && !st->abstract;
+    st->bitsequal = st->pointerfree && !st->haspadding && !st->mutabl;
 }
 
 extern int jl_boot_file_loaded;
@@ -647,10 +810,12 @@ JL_DLLEXPORT jl_datatype_t *jl_new_datatype(jl_sym_t *name, jl_datatype_t *super
     t->ninitialized = ninitialized;
     t->instance = NULL;
     t->struct_decl = NULL;
+    t->fieldindex = NULL;
     t->ditype = NULL;
     t->size = 0;
     t->alignment = 1;
     t->haspadding = 0;
+    t->bitsequal = 0;
 
     if (tn == NULL) {
         t->name = NULL;
@@ -692,6 +857,7 @@ JL_DLLEXPORT jl_datatype_t *jl_new_bitstype(jl_value_t *name,
     if (bt->alignment > MAX_ALIGN)
         bt->alignment = MAX_ALIGN;
     bt->pointerfree = 1;
+    bt->bitsequal = 1;
     return bt;
 }
 
@@ -757,50 +923,74 @@ UNBOX_FUNC(gensym, ssize_t)
     }
 BOX_FUNC(float32, float,  jl_box, 1)
 BOX_FUNC(voidpointer, void*,  jl_box, 1)
-#ifdef _P64
-BOX_FUNC(float64, double, jl_box, 1)
-#else
-BOX_FUNC(float64, double, jl_box, 2)
-#endif
 
 #define NBOX_C 1024
 
-#define SIBOX_FUNC(typ,c_type,nw)                             \
-    static jl_value_t *boxed_##typ##_cache[NBOX_C];           \
+#define SIBOX_FUNC(typ,c_type,nw,nc)                          \
+    static jl_value_t *boxed_##typ##_cache[nc];               \
     JL_DLLEXPORT jl_value_t *jl_box_##typ(c_type x)           \
     {                                                         \
-        c_type idx = x+NBOX_C/2;                              \
-        if ((u##c_type)idx < (u##c_type)NBOX_C)               \
+        c_type idx = x+nc/2;                                  \
+        if ((u##c_type)idx < (u##c_type)nc)                   \
             return boxed_##typ##_cache[idx];                  \
         jl_value_t *v = (jl_value_t*)jl_gc_alloc_##nw##w();   \
         jl_set_typeof(v, jl_##typ##_type);                    \
         *(c_type*)jl_data_ptr(v) = x;                         \
         return v;                                             \
     }
-#define UIBOX_FUNC(typ,c_type,nw)                               \
-    static jl_value_t *boxed_##typ##_cache[NBOX_C];             \
+#define UIBOX_FUNC(typ,c_type,nw,nc)                            \
+    static jl_value_t *boxed_##typ##_cache[nc];                 \
     JL_DLLEXPORT jl_value_t *jl_box_##typ(c_type x)             \
     {                                                           \
-        if (x < NBOX_C)                                         \
+        if (x < nc)                                             \
             return boxed_##typ##_cache[x];                      \
         jl_value_t *v = (jl_value_t*)jl_gc_alloc_##nw##w();     \
         jl_set_typeof(v, jl_##typ##_type);                      \
         *(c_type*)jl_data_ptr(v) = x;                           \
         return v;                                               \
     }
-SIBOX_FUNC(int16,  int16_t, 1)
-SIBOX_FUNC(int32,  int32_t, 1)
-UIBOX_FUNC(uint16, uint16_t, 1)
-UIBOX_FUNC(uint32, uint32_t, 1)
-UIBOX_FUNC(char,   uint32_t, 1)
-UIBOX_FUNC(gensym, size_t, 1)
+SIBOX_FUNC(int16,  int16_t, 1, NBOX_C)
+SIBOX_FUNC(int32,  int32_t, 1, NBOX_C)
+UIBOX_FUNC(uint16, uint16_t, 1, NBOX_C)
+UIBOX_FUNC(uint32, uint32_t, 1, NBOX_C)
+UIBOX_FUNC(char,   uint32_t, 1, NBOX_C)
+UIBOX_FUNC(gensym, size_t, 1, NBOX_C)
+#ifdef _P64
+SIBOX_FUNC(int64,  int64_t, 1, NBOX_INT64_C)
+UIBOX_FUNC(uint64, uint64_t, 1, NBOX_INT64_C)
+#else
+SIBOX_FUNC(int64,  int64_t, 2, NBOX_INT64_C)
+UIBOX_FUNC(uint64, uint64_t, 2, NBOX_INT64_C)
+#endif
+
+static jl_value_t *_jl_box_float64(double x)
+{
 #ifdef _P64
-SIBOX_FUNC(int64,  int64_t, 1)
-UIBOX_FUNC(uint64, uint64_t, 1)
+    jl_value_t *v = (jl_value_t*)jl_gc_alloc_1w();
 #else
-SIBOX_FUNC(int64,  int64_t, 2)
-UIBOX_FUNC(uint64, uint64_t, 2)
+    jl_value_t *v = (jl_value_t*)jl_gc_alloc_2w();
 #endif
+    jl_set_typeof(v, jl_float64_type);
+    *(double*)jl_data_ptr(v) = x;
+    return v;
+}
+
+static jl_value_t *boxed_float64_cache[NBOX_FLOAT64_C];
+JL_DLLEXPORT jl_value_t *jl_box_float64(double x)
+{
+    // the range check comes first, so the conversion is defined; it also
+    // fails for NaN. -0.0 has to be told apart from 0.0 by its sign. the
+    // cache is only filled once boot.jl is loaded, whose literals come first
+    if (x >= -NBOX_FLOAT64_C/2 && x < NBOX_FLOAT64_C/2) {
+        int32_t i = (int32_t)x;
+        if ((double)i == x && (i != 0 || !signbit(x))) {
+            jl_value_t *v = boxed_float64_cache[i + NBOX_FLOAT64_C/2];
+            if (v != NULL)
+                return v;
+        }
+    }
+    return _jl_box_float64(x);
+}
 
 static jl_value_t *boxed_int8_cache[256];
 jl_value_t *jl_box_int8(int8_t x)
@@ -818,13 +1008,15 @@ void jl_init_int32_int64_cache(void)
     int64_t i;
     for(i=0; i < NBOX_C; i++) {
         boxed_int32_cache[i]  = jl_box32(jl_int32_type, i-NBOX_C/2);
-        boxed_int64_cache[i]  = jl_box64(jl_int64_type, i-NBOX_C/2);
 #ifdef _P64
         boxed_gensym_cache[i] = jl_box64(jl_gensym_type, i);
 #else
         boxed_gensym_cache[i] = jl_box32(jl_gensym_type, i);
 #endif
     }
+    for(i=0; i < NBOX_INT64_C; i++) {
+        boxed_int64_cache[i]  = jl_box64(jl_int64_type, i-NBOX_INT64_C/2);
+    }
 }
 
 void jl_init_box_caches(void)
@@ -839,8 +1031,13 @@ void jl_init_box_caches(void)
         boxed_uint16_cache[i] = jl_box16(jl_uint16_type, i);
         boxed_uint32_cache[i] = jl_box32(jl_uint32_type, i);
         boxed_char_cache[i]   = jl_box32(jl_char_type, i);
+    }
+    for(i=0; i < NBOX_INT64_C; i++) {
         boxed_uint64_cache[i] = jl_box64(jl_uint64_type, i);
     }
+    for(i=0; i < NBOX_FLOAT64_C; i++) {
+        boxed_float64_cache[i] = _jl_box_float64((double)(i-NBOX_FLOAT64_C/2));
+    }
 }
 
 void jl_mark_box_caches(void)
@@ -853,13 +1050,18 @@ void jl_mark_box_caches(void)
     for(i=0; i < NBOX_C; i++) {
         jl_gc_setmark(boxed_int16_cache[i]);
         jl_gc_setmark(boxed_int32_cache[i]);
-        jl_gc_setmark(boxed_int64_cache[i]);
         jl_gc_setmark(boxed_uint16_cache[i]);
         jl_gc_setmark(boxed_uint32_cache[i]);
         jl_gc_setmark(boxed_char_cache[i]);
-        jl_gc_setmark(boxed_uint64_cache[i]);
         jl_gc_setmark(boxed_gensym_cache[i]);
     }
+    for(i=0; i < NBOX_INT64_C; i++) {
+        jl_gc_setmark(boxed_int64_cache[i]);
+        jl_gc_setmark(boxed_uint64_cache[i]);
+    }
+    for(i=0; i < NBOX_FLOAT64_C; i++) {
+        jl_gc_setmark(boxed_float64_cache[i]);
+    }
 }
 
 jl_value_t *jl_box_bool(int8_t x)
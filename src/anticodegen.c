@@ -4,11 +4,13 @@
 #include "intrinsics.h"
 
 int globalUnique = 0;
+jl_array_t *jl_cfunction_cache_roots = NULL;
 
 #define UNAVAILABLE { jl_errorf("%s: not available in this build of Julia", __func__); }
 
 void jl_dump_bitcode(char *fname, const char *sysimg_data, size_t sysimg_len) UNAVAILABLE
 void jl_dump_objfile(char *fname, int jit_model, const char *sysimg_data, size_t sysimg_len) UNAVAILABLE
+void jl_defer_function_passes(int on) { }
 int32_t jl_get_llvm_gv(jl_value_t *p) UNAVAILABLE
 void jl_write_malloc_log(void) UNAVAILABLE
 void jl_write_coverage_data(void) UNAVAILABLE
@@ -25,8 +27,9 @@ JL_DLLEXPORT const jl_value_t *jl_dump_function_asm(void *f, int raw_mc) UNAVAIL
 JL_DLLEXPORT const jl_value_t *jl_dump_function_ir(void *f, uint8_t strip_ir_metadata, uint8_t dump_module) UNAVAILABLE
 
 void jl_init_codegen(void) { }
+int jl_host_supports_cpu(const char *cpu) { return 0; }
 void jl_compile_linfo(jl_lambda_info_t *li) { }
-void jl_fptr_to_llvm(void *fptr, jl_lambda_info_t *lam, int specsig)
+void jl_fptr_to_llvm(void *fptr, jl_lambda_info_t *lam, int specsig, jl_value_t *rettype)
 {
     if (!specsig)
         lam->fptr = (jl_fptr_t)fptr;
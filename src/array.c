@@ -261,6 +261,22 @@ JL_DLLEXPORT jl_array_t *jl_ptr_to_array_1d(jl_value_t *atype, void *data,
     return a;
 }
 
+// like jl_ptr_to_array_1d with own_buffer, for data that is freed by calling
+// freefunc(data, arg) once the array is unreachable. that happens during a
+// collection, so it must not call into julia. NULL freefunc doesn't own data
+JL_DLLEXPORT jl_array_t *jl_ptr_to_array_1d_free(jl_value_t *atype, void *data,
+                                                 size_t nel, jl_free_func_t freefunc,
+                                                 void *arg)
+{
+    jl_array_t *a = jl_ptr_to_array_1d(atype, data, nel, 0);
+    if (freefunc != NULL) {
+        a->how = 2;
+        jl_gc_track_foreign_array(a, freefunc, arg);
+        jl_gc_count_allocd(nel*a->elsize + (a->elsize == 1 ? 1 : 0));
+    }
+    return a;
+}
+
 JL_DLLEXPORT jl_array_t *jl_ptr_to_array(jl_value_t *atype, void *data,
                                          jl_value_t *dims, int own_buffer)
 {
@@ -371,6 +387,19 @@ JL_DLLEXPORT jl_value_t *jl_array_to_string(jl_array_t *a)
     return s;
 }
 
+// a string of the len bytes at str, without copying them. the data is owned
+// like in jl_ptr_to_array_1d_free, and doesn't need to be NUL-terminated
+JL_DLLEXPORT jl_value_t *jl_ptr_to_string(char *str, size_t len,
+                                          jl_free_func_t freefunc, void *arg)
+{
+    jl_array_t *a = jl_ptr_to_array_1d_free((jl_value_t*)jl_array_uint8_type,
+                                            str, len, freefunc, arg);
+    JL_GC_PUSH1(&a);
+    jl_value_t *s = jl_array_to_string(a);
+    JL_GC_POP();
+    return s;
+}
+
 JL_DLLEXPORT jl_value_t *jl_pchar_to_string(const char *str, size_t len)
 {
     jl_array_t *a = jl_pchar_to_array(str, len);
@@ -528,7 +557,7 @@ JL_DLLEXPORT void jl_arrayset(jl_array_t *a, jl_value_t *rhs, size_t i)
         if (a->how == 3) {
             owner = jl_array_data_owner(a);
         }
-        jl_gc_wb(owner, rhs);
+        jl_gc_wb_slot(owner, &((jl_value_t**)a->data)[i], rhs);
     }
 }
 
@@ -551,8 +580,29 @@ JL_DLLEXPORT void jl_arrayunset(jl_array_t *a, size_t i)
         memset(ptail, 0, a->elsize);
 }
 
-// at this size and bigger, allocate resized array data with malloc
-#define MALLOC_THRESH 1048576
+// copy n elements of the pointer array src, from src_p on, to dest_p in dest.
+// the ranges may overlap. instead of a write barrier per element, an old dest
+// is queued (or the cards of the range are dirtied) once, at the first young
+// element copied
+JL_DLLEXPORT void jl_array_ptr_copy(jl_array_t *dest, jl_value_t **dest_p,
+                                    jl_array_t *src, jl_value_t **src_p, size_t n)
+{
+    assert(dest->ptrarray && src->ptrarray);
+    (void)src;
+    memmove(dest_p, src_p, n*sizeof(jl_value_t*));
+    jl_value_t *owner = (jl_value_t*)dest;
+    if (dest->how == 3)
+        owner = jl_array_data_owner(dest);
+    if (__unlikely((jl_astaggedvalue(owner)->gc_bits & 1) == 1)) {
+        for (size_t i = 0; i < n; i++) {
+            jl_value_t *v = dest_p[i];
+            if (v != NULL && (jl_astaggedvalue(v)->gc_bits & 1) == 0) {
+                jl_gc_queue_slots(owner, &dest_p[i], n - i);
+                break;
+            }
+        }
+    }
+}
 
 // allocate buffer of newlen elements, placing old data at given offset (in #elts)
 //     newlen: new length (#elts), including offset
@@ -569,20 +619,30 @@ static void array_resize_buffer(jl_array_t *a, size_t newlen, size_t oldlen, siz
         nbytes++;
     assert(!a->isshared || a->how==3);
     char *newdata;
-    if (a->how == 2) {
-        // already malloc'd - use realloc
+    if (a->how == 2 && !a->isaligned && jl_gc_is_foreign_array(a)) {
+        // data adopted by jl_ptr_to_array_1d_free, which we can't realloc:
+        // it moves into a buffer of our own and goes back to its owner
+        newdata = (char*)jl_gc_managed_malloc(nbytes);
+        memcpy(newdata + offsnb, (char*)a->data, oldnbytes);
+        jl_gc_release_foreign_array(a, (char*)a->data - oldoffsnb);
+        a->isaligned = 1;
+    }
+    else if (a->how == 2) {
+        // already malloc'd - use realloc. the old size is the one the buffer
+        // was allocated with since the GC needs it to tell how to free it
+        size_t oldbufnb = a->maxsize * es + (es == 1 ? 1 : 0);
         newdata = (char*)jl_gc_managed_realloc((char*)a->data - oldoffsnb, nbytes,
-                                               oldnbytes+oldoffsnb, a->isaligned, (jl_value_t*)a);
+                                               oldbufnb, a->isaligned, (jl_value_t*)a);
         if (offs != a->offset) {
             memmove(&newdata[offsnb], &newdata[oldoffsnb], oldnbytes);
+            jl_gc_array_moved(a);
         }
     }
     else {
-        if (
-#ifdef _P64
-            nbytes >= MALLOC_THRESH
-#else
-            es > 4
+        // buffers too big to be inline are malloc'd, cache-line aligned
+        if (nbytes > ARRAY_INLINE_NBYTES
+#ifndef _P64
+            || es > 4
 #endif
             ) {
             newdata = (char*)jl_gc_managed_malloc(nbytes);
@@ -628,15 +688,25 @@ static size_t limit_overallocation(jl_array_t *a, size_t alen, size_t newlen, si
     return newlen;
 }
 
+// the capacity after len when growing at the end. the slack of a doubled
+// big array would be a lot of memory, and growing it again is cheap since
+// its data is mapped and can be remapped in place
+static size_t array_grow_len(jl_array_t *a, size_t len)
+{
+    if (len * a->elsize >= ARRAY_GROW_SLOW_NBYTES)
+        return len + len/2;
+    return len*2;
+}
+
 JL_DLLEXPORT void jl_array_grow_end(jl_array_t *a, size_t inc)
 {
     if (a->isshared && a->how!=3) jl_error("cannot resize array with shared data");
     // optimized for the case of only growing and shrinking at the end
     size_t alen = jl_array_nrows(a);
     if ((alen + inc) > a->maxsize - a->offset) {
-        size_t newlen = a->maxsize==0 ? (inc<4?4:inc) : a->maxsize*2;
+        size_t newlen = a->maxsize==0 ? (inc<4?4:inc) : array_grow_len(a, a->maxsize);
         while ((alen + inc) > newlen - a->offset)
-            newlen *= 2;
+            newlen = array_grow_len(a, newlen);
 
         newlen = limit_overallocation(a, alen, newlen, inc);
         array_resize_buffer(a, newlen, alen, a->offset);
@@ -714,6 +784,7 @@ JL_DLLEXPORT void jl_array_grow_beg(jl_array_t *a, size_t inc)
             memmove(&newdata[incnb], a->data, anb);
             a->data = newdata;
             a->offset = center;
+            jl_gc_array_moved(a);
         }
     }
 #ifdef STORE_ARRAY_LEN
@@ -755,6 +826,7 @@ JL_DLLEXPORT void jl_array_del_beg(jl_array_t *a, size_t dec)
         size_t delta = (offset - newoffs)*es;
         a->data = (char*)a->data - delta;
         memmove(a->data, (char*)a->data + delta, anb);
+        jl_gc_array_moved(a);
     }
     a->offset = newoffs;
 }
@@ -29,13 +29,14 @@ static uint8_t flisp_system_image[] = {
 #include <julia_flisp.boot.inc>
 };
 
-static fltype_t *jvtype=NULL;
+static FL_THREAD_LOCAL fltype_t *jvtype=NULL;
 
-static value_t true_sym;
-static value_t false_sym;
-static value_t fl_error_sym;
-static value_t fl_null_sym;
-static value_t fl_jlgensym_sym;
+static FL_THREAD_LOCAL value_t true_sym;
+static FL_THREAD_LOCAL value_t false_sym;
+static FL_THREAD_LOCAL value_t fl_error_sym;
+static FL_THREAD_LOCAL value_t fl_null_sym;
+static FL_THREAD_LOCAL value_t fl_jlgensym_sym;
+static FL_THREAD_LOCAL htable_t jlsym_to_flisp; // jl_sym_t* -> symbol_t*, see scmsym_to_julia
 
 static jl_value_t *scm_to_julia(value_t e, int expronly);
 static value_t julia_to_scm(jl_value_t *v);
@@ -120,6 +121,7 @@ extern int jl_parse_deperror(int err);
 void jl_init_frontend(void)
 {
     fl_init(4*1024*1024);
+    htable_new(&jlsym_to_flisp, 0);
 
     if (fl_load_system_image_str((char*)flisp_system_image,
                                  sizeof(flisp_system_image))) {
@@ -148,23 +150,51 @@ void jl_init_frontend(void)
         jl_parse_depwarn((int)jl_options.depwarn);
 }
 
+// the interpreter state is per thread, so every thread starts its own
+// front end the first time it parses or lowers something
+static inline void jl_frontend_thread_init(void)
+{
+    if (jvtype == NULL)
+        jl_init_frontend();
+}
+
 JL_DLLEXPORT void jl_lisp_prompt(void)
 {
-    if (jvtype==NULL) jl_init_frontend();
+    jl_frontend_thread_init();
     fl_applyn(1, symbol_value(symbol("__start")), fl_cons(FL_NIL,FL_NIL));
 }
 
+// symbols are converted through caches, since both symbol tables are
+// searched by name and an AST names the same few symbols over and over.
+// symbols of either side are never freed, so the caches are never stale:
+// the julia symbol of a flisp symbol is kept in its extcache field, and the
+// flisp symbol of a julia symbol in jlsym_to_flisp
+
 static jl_sym_t *scmsym_to_julia(value_t s)
 {
     assert(issymbol(s));
     if (fl_isgensym(s)) {
-        static char gsname[16];
+        static FL_THREAD_LOCAL char gsname[16];
         char *n = uint2str(&gsname[1], sizeof(gsname)-1,
                            ((gensym_t*)ptr(s))->id, 10);
         *(--n) = '#';
         return jl_symbol(n);
     }
-    return jl_symbol(symbol_name(s));
+    symbol_t *fsym = (symbol_t*)ptr(s);
+    if (fsym->extcache == NULL)
+        fsym->extcache = jl_symbol(fsym->name);
+    return (jl_sym_t*)fsym->extcache;
+}
+
+static value_t jlsym_to_scm(jl_sym_t *s)
+{
+    void **bp = ptrhash_bp(&jlsym_to_flisp, s);
+    if (*bp == HT_NOTFOUND) {
+        value_t fs = symbol(jl_symbol_name(s));
+        *bp = ptr(fs);
+        return fs;
+    }
+    return tagptr(*bp, TAG_SYM);
 }
 
 static jl_value_t *scm_to_julia_(value_t e, int expronly);
@@ -404,7 +434,7 @@ static jl_value_t *scm_to_julia_(value_t e, int eo)
 }
 
 static value_t julia_to_scm_(jl_value_t *v);
-static arraylist_t jlgensym_to_flisp;
+static FL_THREAD_LOCAL arraylist_t jlgensym_to_flisp;
 
 static value_t julia_to_scm(jl_value_t *v)
 {
@@ -450,7 +480,7 @@ static value_t julia_to_list2(jl_value_t *a, jl_value_t *b)
 static value_t julia_to_scm_(jl_value_t *v)
 {
     if (jl_is_symbol(v))
-        return symbol(jl_symbol_name((jl_sym_t*)v));
+        return jlsym_to_scm((jl_sym_t*)v);
     if (jl_is_gensym(v)) {
         size_t idx = ((jl_gensym_t*)v)->id;
         size_t i;
@@ -513,6 +543,7 @@ static value_t julia_to_scm_(jl_value_t *v)
 // this is used to parse a line of repl input
 JL_DLLEXPORT jl_value_t *jl_parse_input_line(const char *str, size_t len)
 {
+    jl_frontend_thread_init();
     value_t s = cvalue_static_cstrn(str, len);
     value_t e = fl_applyn(1, symbol_value(symbol("jl-parse-string")), s);
     if (e == FL_EOF)
@@ -525,6 +556,7 @@ JL_DLLEXPORT jl_value_t *jl_parse_input_line(const char *str, size_t len)
 JL_DLLEXPORT jl_value_t *jl_parse_string(const char *str, size_t len,
                                          int pos0, int greedy)
 {
+    jl_frontend_thread_init();
     value_t s = cvalue_static_cstrn(str, len);
     value_t p = fl_applyn(3, symbol_value(symbol("jl-parse-one-string")),
                           s, fixnum(pos0), greedy?FL_T:FL_F);
@@ -545,12 +577,24 @@ JL_DLLEXPORT jl_value_t *jl_parse_string(const char *str, size_t len,
 
 int jl_start_parsing_file(const char *fname)
 {
+    jl_frontend_thread_init();
     value_t s = cvalue_static_cstring(fname);
     if (fl_applyn(1, symbol_value(symbol("jl-parse-file")), s) == FL_F)
         return 1;
     return 0;
 }
 
+// text must stay alive until jl_stop_parsing
+void jl_start_parsing_string(const char *text, size_t len, const char *fname)
+{
+    jl_frontend_thread_init();
+    value_t t = cvalue_static_cstrn(text, len);
+    fl_gc_handle(&t);
+    value_t f = cvalue_static_cstring(fname);
+    fl_applyn(2, symbol_value(symbol("jl-parse-string-stream")), t, f);
+    fl_free_gc_handles(1);
+}
+
 void jl_stop_parsing(void)
 {
     fl_applyn(0, symbol_value(symbol("jl-parser-close-stream")));
@@ -558,6 +602,7 @@ void jl_stop_parsing(void)
 
 JL_DLLEXPORT int jl_parse_depwarn(int warn)
 {
+    jl_frontend_thread_init();
     value_t prev = fl_applyn(1, symbol_value(symbol("jl-parser-depwarn")),
                              warn ? FL_T : FL_F);
     return prev == FL_T ? 1 : 0;
@@ -565,6 +610,7 @@ JL_DLLEXPORT int jl_parse_depwarn(int warn)
 
 int jl_parse_deperror(int err)
 {
+    jl_frontend_thread_init();
     value_t prev = fl_applyn(1, symbol_value(symbol("jl-parser-deperror")),
                              err ? FL_T : FL_F);
     return prev == FL_T ? 1 : 0;
@@ -594,6 +640,7 @@ jl_value_t *jl_parse_next(void)
 JL_DLLEXPORT jl_value_t *jl_load_file_string(const char *text, size_t len,
                                              char *filename, size_t namelen)
 {
+    jl_frontend_thread_init();
     value_t t, f;
     t = cvalue_static_cstrn(text, len);
     fl_gc_handle(&t);
@@ -606,6 +653,7 @@ JL_DLLEXPORT jl_value_t *jl_load_file_string(const char *text, size_t len,
 // returns either an expression or a thunk
 JL_DLLEXPORT jl_value_t *jl_expand(jl_value_t *expr)
 {
+    jl_frontend_thread_init();
     int np = jl_gc_n_preserved_values();
     value_t arg = julia_to_scm(expr);
     value_t e = fl_applyn(1, symbol_value(symbol("jl-expand-to-thunk")), arg);
@@ -618,6 +666,7 @@ JL_DLLEXPORT jl_value_t *jl_expand(jl_value_t *expr)
 
 JL_DLLEXPORT jl_value_t *jl_macroexpand(jl_value_t *expr)
 {
+    jl_frontend_thread_init();
     int np = jl_gc_n_preserved_values();
     value_t arg = julia_to_scm(expr);
     value_t e = fl_applyn(1, symbol_value(symbol("jl-macroexpand")), arg);
@@ -998,11 +1047,13 @@ JL_DLLEXPORT jl_value_t *jl_prepare_ast(jl_lambda_info_t *li, jl_svec_t *sparams
 
 JL_DLLEXPORT int jl_is_operator(char *sym)
 {
+    jl_frontend_thread_init();
     return fl_applyn(1, symbol_value(symbol("operator?")), symbol(sym)) == FL_T;
 }
 
 JL_DLLEXPORT int jl_operator_precedence(char *sym)
 {
+    jl_frontend_thread_init();
     return numval(fl_applyn(1, symbol_value(symbol("operator-precedence")), symbol(sym)));
 }
 
@@ -191,13 +191,7 @@ JL_CALLABLE(jl_f_throw)
 
 JL_DLLEXPORT void jl_enter_handler(jl_handler_t *eh)
 {
-    JL_SIGATOMIC_BEGIN();
-    eh->prev = jl_current_task->eh;
-    eh->gcstack = jl_pgcstack;
-    jl_current_task->eh = eh;
-    // TODO: this should really go after setjmp(). see comment in
-    // ctx_switch in task.c.
-    JL_SIGATOMIC_END();
+    jl_eh_push_state(eh);
 }
 
 JL_DLLEXPORT void jl_pop_handler(int n)
@@ -304,8 +298,8 @@ JL_DLLEXPORT int jl_egal(jl_value_t *a, jl_value_t *b)
     if (dt->mutabl) return 0;
     size_t sz = dt->size;
     if (sz == 0) return 1;
-    size_t nf = jl_datatype_nfields(dt);
-    if (nf == 0)
+    // structs without pointers or padding compare as one block of memory
+    if (dt->bitsequal || jl_datatype_nfields(dt) == 0)
         return bits_equal(jl_data_ptr(a), jl_data_ptr(b), sz);
     return compare_fields(a, b, dt);
 }
@@ -504,6 +498,29 @@ JL_CALLABLE(jl_f_apply)
     return result;
 }
 
+// f(lead..., rest...), where both argument lists are already rooted by the
+// caller. emitted for _apply(f, tuple(...), va) when the varargs tuple `va`
+// was never allocated and still lives in the caller's argument array.
+JL_DLLEXPORT jl_value_t *jl_apply_2va(jl_function_t *f, jl_value_t **lead, uint32_t nlead,
+                                      jl_value_t **rest, uint32_t nrest)
+{
+    size_t n = (size_t)nlead + nrest;
+    jl_value_t **newargs;
+    int onstack = (n < jl_page_size/sizeof(jl_value_t*));
+    JL_GC_PUSHARGS(newargs, onstack ? n : 1);
+    if (!onstack) {
+        jl_svec_t *arg_heap = jl_alloc_svec(n);
+        newargs[0] = (jl_value_t*)arg_heap;
+        newargs = jl_svec_data(arg_heap);
+        // the elements are older than arg_heap, so no write barrier is needed
+    }
+    memcpy(newargs, lead, nlead*sizeof(jl_value_t*));
+    memcpy(newargs+nlead, rest, nrest*sizeof(jl_value_t*));
+    jl_value_t *result = jl_apply(f, newargs, n);
+    JL_GC_POP();
+    return result;
+}
+
 JL_CALLABLE(jl_f_kwcall)
 {
     if (nargs < 4)
@@ -823,6 +840,13 @@ JL_DLLEXPORT jl_nullable_float64_t jl_try_substrtod(char *str, size_t offset,
     char *pend = bstr+len;
     int err = 0;
 
+    double out;
+    size_t nread = jl_strtod_fast(bstr, len, &out);
+    if (nread > 0 && substr_isspace(bstr+nread, pend)) {
+        jl_nullable_float64_t ret = {0, out};
+        return ret;
+    }
+
     errno = 0;
     if (!(*pend == '\0' || isspace((unsigned char)*pend) || *pend == ',')) {
         // confusing data outside substring. must copy.
@@ -832,7 +856,7 @@ JL_DLLEXPORT jl_nullable_float64_t jl_try_substrtod(char *str, size_t offset,
         bstr = newstr;
         pend = bstr+len;
     }
-    double out = jl_strtod_c(bstr, &p);
+    out = jl_strtod_c(bstr, &p);
 
     if (errno==ERANGE && (out==0 || out==HUGE_VAL || out==-HUGE_VAL)) {
         err = 1;
@@ -876,6 +900,13 @@ JL_DLLEXPORT jl_nullable_float32_t jl_try_substrtof(char *str, size_t offset,
     char *pend = bstr+len;
     int err = 0;
 
+    float out;
+    size_t nread = jl_strtof_fast(bstr, len, &out);
+    if (nread > 0 && substr_isspace(bstr+nread, pend)) {
+        jl_nullable_float32_t ret = {0, out};
+        return ret;
+    }
+
     errno = 0;
     if (!(*pend == '\0' || isspace((unsigned char)*pend) || *pend == ',')) {
         // confusing data outside substring. must copy.
@@ -886,9 +917,9 @@ JL_DLLEXPORT jl_nullable_float32_t jl_try_substrtof(char *str, size_t offset,
         pend = bstr+len;
     }
 #if defined(_OS_WINDOWS_) && !defined(_COMPILER_MINGW_)
-    float out = (float)jl_strtod_c(bstr, &p);
+    out = (float)jl_strtod_c(bstr, &p);
 #else
-    float out = jl_strtof_c(bstr, &p);
+    out = jl_strtof_c(bstr, &p);
 #endif
 
     if (errno==ERANGE && (out==0 || out==HUGE_VALF || out==-HUGE_VALF)) {
@@ -991,7 +1022,7 @@ static int jl_eval_inner_with_compiler(jl_expr_t *e, jl_module_t *m)
 
 void jl_trampoline_compile_linfo(jl_lambda_info_t *linfo, int always_infer)
 {
-    JL_LOCK(codegen);
+    JL_LOCK_SAFEPOINT(codegen);
     assert(linfo);
     assert(linfo->specTypes);
     // to run inference on all thunks. slows down loading files.
@@ -1027,8 +1058,20 @@ JL_CALLABLE(jl_trampoline)
 {
     assert(jl_is_func(F));
     jl_function_t *f = (jl_function_t*)F;
-    if (!f->linfo->specTypes) f->linfo->specTypes = jl_anytuple_type; // no gc_wb needed
-    jl_trampoline_compile_linfo(f->linfo, 0);
+    jl_lambda_info_t *li = f->linfo;
+    if (jl_options.compile_enabled == JL_OPTIONS_COMPILE_TIERED &&
+        li->functionObjects.functionObject == NULL &&
+        li->ninterp < TIERED_COMPILE_CALLS) {
+        // cold code: interpret it, and compile only once it has been
+        // called a few times
+        li->ninterp++;
+        jl_value_t *r = jl_interpret_call(f, args, nargs);
+        if (r != NULL)
+            return r;
+        li->ninterp = TIERED_COMPILE_CALLS;
+    }
+    if (!li->specTypes) li->specTypes = jl_anytuple_type; // no gc_wb needed
+    jl_trampoline_compile_linfo(li, 0);
     jl_generate_fptr(f);
     return jl_apply(f, args, nargs);
 }
@@ -1157,7 +1200,7 @@ static uptrint_t jl_object_id_(jl_value_t *tv, jl_value_t *v)
     uptrint_t h = jl_object_id(tv);
     if (sz == 0) return ~h;
     size_t nf = jl_datatype_nfields(dt);
-    if (nf == 0) {
+    if (nf == 0 || dt->bitsequal) {
         return bits_hash(jl_data_ptr(v), sz) ^ h;
     }
     for (size_t f=0; f < nf; f++) {
@@ -11,7 +11,8 @@ static std::set<u_int64_t> llvmcallDecls;
 #endif
 
 static std::map<std::string, GlobalVariable*> libMapGV;
-static std::map<std::string, GlobalVariable*> symMapGV;
+// one lazily-bound slot per (library, symbol), shared by all call sites
+static std::map<std::pair<GlobalVariable*, std::string>, GlobalVariable*> symMapGV;
 
 static Value *GetStringPtr(llvm::IRBuilder <> *builder, GlobalValue *GV, const Twine &Name)
 {
@@ -33,6 +34,8 @@ static Value *runtime_sym_lookup(PointerType *funcptype, const char *f_lib, cons
     //       *llvmgv = jl_load_and_lookup(f_lib, f_name, libptrgv);
     //   }
     //   return (*llvmgv)
+    // the slot is shared by every call site of the same (library, symbol), and
+    // once it has been bound at compile time the check is omitted entirely
     void *libsym = NULL;
     bool runtime_lib = false;
     GlobalVariable *libptrgv;
@@ -78,7 +81,8 @@ static Value *runtime_sym_lookup(PointerType *funcptype, const char *f_lib, cons
 
     assert(libsym != NULL);
 
-    GlobalVariable *llvmgv = symMapGV[f_name];
+    std::pair<GlobalVariable*, std::string> symkey(libptrgv, f_name);
+    GlobalVariable *llvmgv = symMapGV[symkey];
     Constant *initnul = ConstantPointerNull::get((PointerType*)T_pvoidfunc);
     if (llvmgv == NULL) {
         // MCJIT forces this to have external linkage eventually, so we would clobber
@@ -88,17 +92,32 @@ static Value *runtime_sym_lookup(PointerType *funcptype, const char *f_lib, cons
         llvmgv = new GlobalVariable(imaging_mode ? *shadow_module : *active_module, T_pvoidfunc,
            false, GlobalVariable::PrivateLinkage,
            initnul, name);
-        symMapGV[f_name] = llvmgv;
+        symMapGV[symkey] = llvmgv;
+        void *symaddr = jl_dlsym_cached(libsym, f_name, 0);
+        if (symaddr != NULL && !imaging_mode) {
+            // bind the slot right away, so the code never needs to check it
+            llvmgv->setInitializer(ConstantExpr::getIntToPtr(
+                    ConstantInt::get(T_size, (uint64_t)(uintptr_t)symaddr), T_pvoidfunc));
+        }
 #ifdef USE_MCJIT
-        jl_llvm_to_jl_value[llvmgv] = jl_dlsym_e(libsym, f_name);
+        jl_llvm_to_jl_value[llvmgv] = symaddr;
 #else
-        *((void**)jl_ExecutionEngine->getPointerToGlobal(llvmgv)) = jl_dlsym_e(libsym, f_name);
+        *((void**)jl_ExecutionEngine->getPointerToGlobal(llvmgv)) = symaddr;
 #endif
     }
 
+    if (!imaging_mode && llvmgv->hasInitializer() && !llvmgv->getInitializer()->isNullValue()) {
+        // already bound: the slot never changes again, so the call site
+        // is just a load and an indirect call
+        Value *llvmf = builder.CreateLoad(llvmgv);
+        return builder.CreatePointerCast(llvmf, funcptype);
+    }
+
     BasicBlock *dlsym_lookup = BasicBlock::Create(jl_LLVMContext, "dlsym"),
                *ccall_bb = BasicBlock::Create(jl_LLVMContext, "ccall");
-    builder.CreateCondBr(builder.CreateICmpNE(builder.CreateLoad(llvmgv), initnul), ccall_bb, dlsym_lookup);
+    // binding only happens on the first call, keep it off the hot path
+    builder.CreateCondBr(builder.CreateICmpNE(builder.CreateLoad(llvmgv), initnul), ccall_bb, dlsym_lookup,
+                         mbuilder->createBranchWeights(1000, 1));
 
     assert(ctx->f->getParent() != NULL);
     ctx->f->getBasicBlockList().push_back(dlsym_lookup);
@@ -362,3 +362,10 @@ JL_DLLEXPORT void set_verbose(int level) {
 JL_DLLEXPORT void *test_echo_p(void *p) {
     return p;
 }
+
+//////////////////////////////////
+// Same name as the libjulia function, to check that ccall keeps the symbols
+// of different libraries apart
+JL_DLLEXPORT int jl_ver_major(void) {
+    return -1;
+}
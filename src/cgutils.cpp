@@ -609,8 +609,8 @@ static void jl_gen_llvm_globaldata(llvm::Module *mod, ValueToValueMapTy &VMap, c
                                  "jl_sysimg_cpu_target"));
 
 #ifdef HAVE_CPUID
-    // For native also store the cpuid
-    if (strcmp(jl_options.cpu_target,"native") == 0) {
+    // For native (anywhere in the list of targets) also store the cpuid
+    if (jl_cpu_target_has_native()) {
         uint32_t info[4];
 
         jl_cpuid((int32_t*)info, 1);
@@ -625,7 +625,9 @@ static void jl_gen_llvm_globaldata(llvm::Module *mod, ValueToValueMapTy &VMap, c
 
     if (sysimg_data) {
         Constant *data = ConstantDataArray::get(jl_LLVMContext, ArrayRef<uint8_t>((const unsigned char*)sysimg_data, sysimg_len));
-        addComdat(new GlobalVariable(*mod, data->getType(), true,
+        // not constant: arrays restored from the image keep pointing into
+        // this data, and may be written to
+        addComdat(new GlobalVariable(*mod, data->getType(), false,
                                      GlobalVariable::ExternalLinkage,
                                      data, "jl_system_image_data"));
         Constant *len = ConstantInt::get(T_size, sysimg_len);
@@ -635,6 +637,239 @@ static void jl_gen_llvm_globaldata(llvm::Module *mod, ValueToValueMapTy &VMap, c
     }
 }
 
+// The cpu target of the JIT and of the system image is the first of
+// the comma separated list in jl_options.cpu_target. For each of the others,
+// the functions of the system image that contain loops are cloned and
+// compiled for that cpu, and jl_sysimg_fvars_<n> lists the functions to use
+// on hosts that support the n-th. jl_load_sysimg_so picks the last one the
+// host supports.
+static std::string jl_cpu_target_base()
+{
+    std::string targets(jl_options.cpu_target);
+    return targets.substr(0, targets.find(','));
+}
+
+// is one of the targets "native"? (the image then records the host's cpuid)
+static bool jl_cpu_target_has_native()
+{
+    std::string targets(jl_options.cpu_target);
+    size_t start = 0;
+    while (true) {
+        size_t end = targets.find(',', start);
+        if (targets.compare(start, end == std::string::npos ? std::string::npos : end - start,
+                            "native") == 0)
+            return true;
+        if (end == std::string::npos)
+            return false;
+        start = end + 1;
+    }
+}
+
+#ifdef LLVM37
+// the host's features as a target-features string
+static bool jl_host_cpu_features(std::string &features)
+{
+    StringMap<bool> HostFeatures;
+    if (!sys::getHostCPUFeatures(HostFeatures))
+        return false;
+    for (StringMap<bool>::const_iterator it = HostFeatures.begin(); it != HostFeatures.end(); it++) {
+        if (!features.empty())
+            features += ",";
+        features += (it->getValue() ? "+" : "-") + it->getKey().str();
+    }
+    return true;
+}
+#endif
+
+#ifdef LLVM37
+static void jl_gen_sysimg_clones(Module *mod)
+{
+    std::string targets(jl_options.cpu_target);
+    size_t start = targets.find(',');
+    if (start == std::string::npos)
+        return;
+    GlobalVariable *fvars = mod->getGlobalVariable("jl_sysimg_fvars");
+    assert(fvars);
+    std::vector<Function*> hot;
+    for (auto &F : mod->functions()) {
+        SmallVector<std::pair<const BasicBlock*, const BasicBlock*>, 8> backedges;
+        if (F.isDeclaration())
+            continue;
+        FindFunctionBackedges(F, backedges);
+        if (!backedges.empty())
+            hot.push_back(&F);
+    }
+    int n = 0;
+    while (start != std::string::npos) {
+        size_t end = targets.find(',', start + 1);
+        std::string cpu = targets.substr(start + 1, end == std::string::npos ?
+                                         std::string::npos : end - start - 1);
+        start = end;
+        if (cpu.empty())
+            continue;
+        n++;
+        std::string target_cpu = cpu, target_features;
+        if (cpu == "native") {
+            // only used on a host with the same cpuid (see jl_select_sysimg_clone)
+            target_cpu = sys::getHostCPUName();
+            jl_host_cpu_features(target_features);
+        }
+        ValueToValueMapTy VMap;
+        for (Function *F : hot) {
+            Function *NF = Function::Create(F->getFunctionType(), GlobalValue::InternalLinkage,
+                                            F->getName() + "." + cpu, mod);
+            NF->copyAttributesFrom(F);
+            NF->setLinkage(GlobalValue::InternalLinkage);
+            NF->setDLLStorageClass(GlobalValue::DefaultStorageClass);
+            VMap[F] = NF;
+        }
+        for (Function *F : hot) {
+            Function *NF = cast<Function>(VMap[F]);
+            Function::arg_iterator DestI = NF->arg_begin();
+            for (Function::const_arg_iterator I = F->arg_begin(); I != F->arg_end(); ++I)
+                VMap[&*I] = &*DestI++;
+            SmallVector<ReturnInst*, 8> Returns;
+            CloneFunctionInto(NF, F, VMap, false, Returns);
+            NF->addFnAttr("target-cpu", target_cpu);
+            NF->addFnAttr("target-features", target_features);
+        }
+        std::stringstream name;
+        name << "jl_sysimg_fvars_" << n;
+        addComdat(new GlobalVariable(*mod, fvars->getType()->getElementType(), true,
+                                     GlobalVariable::ExternalLinkage,
+                                     MapValue(fvars->getInitializer(), VMap),
+                                     name.str()));
+    }
+    Constant *names = ConstantDataArray::getString(jl_LLVMContext,
+                                                   targets.substr(targets.find(',') + 1));
+    addComdat(new GlobalVariable(*mod, names->getType(), true,
+                                 GlobalVariable::ExternalLinkage,
+                                 names, "jl_sysimg_clone_targets"));
+}
+#endif
+
+#ifdef LLVM37
+// a system image emitted in n partitions is written to fname, fname.1, ..., fname.<n-1>;
+// delete the partitions left behind by a previous build that used more of them
+static void jl_remove_image_partitions(const char *fname, unsigned first)
+{
+    for (unsigned i = first; ; i++) {
+        std::string pname = std::string(fname) + "." + std::to_string(i);
+        if (!sys::fs::exists(pname) || sys::fs::remove(pname))
+            break;
+    }
+}
+
+// run the function passes that to_function deferred (see jl_defer_function_passes)
+static void jl_run_deferred_passes(Module *M, TargetMachine *TM)
+{
+    legacy::FunctionPassManager PM(M);
+    legacy::FunctionPassManager CheapPM(M);
+    addOptimizationPasses(&PM, false, TM);
+    addOptimizationPasses(&CheapPM, true, TM);
+    PM.doInitialization();
+    CheapPM.doInitialization();
+    for (Function &F : *M) {
+        if (F.isDeclaration() || !F.hasFnAttribute("julia-deferred-opt"))
+            continue;
+        if (F.hasFnAttribute("julia-cheap-opt"))
+            CheapPM.run(F);
+        else
+            PM.run(F);
+    }
+    PM.doFinalization();
+    CheapPM.doFinalization();
+}
+
+// the body of one image partition thread: it must not touch julia state or
+// jl_LLVMContext, so it reads its partition into a context of its own and
+// uses its own TargetMachine, configured like TM
+static bool jl_emit_image_partition(StringRef bc, raw_pwrite_stream &OS, TargetMachine *TM)
+{
+    LLVMContext ctx;
+    ErrorOr<std::unique_ptr<Module>> part =
+        parseBitcodeFile(MemoryBufferRef(bc, "julia-partition"), ctx);
+    if (!part)
+        return false;
+    Module *M = part.get().get();
+    std::unique_ptr<TargetMachine> PTM(TM->getTarget().createTargetMachine(
+        TM->getTargetTriple().str(), TM->getTargetCPU(), TM->getTargetFeatureString(),
+        TM->Options, TM->getRelocationModel(), TM->getCodeModel(), CodeGenOpt::Aggressive));
+    jl_run_deferred_passes(M, PTM.get());
+    legacy::PassManager PM;
+    PM.add(new TargetLibraryInfoWrapperPass(Triple(PTM->getTargetTriple())));
+    if (PTM->addPassesToEmitFile(PM, OS, TargetMachine::CGFT_ObjectFile, false))
+        return false;
+    PM.run(*M);
+    return true;
+}
+
+#ifndef LLVM38
+// SplitModule is LLVM 3.8; split M the same way, giving each global the
+// partition of the hash of its name (or of its aliasee's, for an alias). the
+// locals are made external first, so that the partitions can refer to those
+// of the others, and each partition is a clone of M in which the definitions
+// of the others are turned into declarations
+static void jl_split_module(Module *M, unsigned n, std::function<void(Module*)> emit)
+{
+    unsigned nunnamed = 0;
+    auto externalize = [&](GlobalValue &GV) {
+        if (GV.hasLocalLinkage()) {
+            GV.setLinkage(GlobalValue::ExternalLinkage);
+            GV.setVisibility(GlobalValue::HiddenVisibility);
+        }
+        if (!GV.hasName())
+            GV.setName("jl_partition_unnamed" + std::to_string(nunnamed++));
+    };
+    for (Function &F : *M)
+        externalize(F);
+    for (GlobalVariable &GV : M->globals())
+        externalize(GV);
+    for (GlobalAlias &GA : M->aliases())
+        externalize(GA);
+    std::hash<std::string> hash;
+    for (unsigned i = 0; i < n; i++) {
+        auto mine = [&](const GlobalValue *GV) {
+            return hash(GV->getName().str()) % n == i;
+        };
+        Module *part = CloneModule(M);
+        for (Function &F : *part) {
+            if (!F.isDeclaration() && !mine(&F)) {
+                F.deleteBody();
+                F.setComdat(nullptr);
+            }
+        }
+        for (GlobalVariable &GV : part->globals()) {
+            if (!GV.isDeclaration() && !mine(&GV)) {
+                GV.setInitializer(nullptr);
+                GV.setLinkage(GlobalValue::ExternalLinkage);
+                GV.setComdat(nullptr);
+            }
+        }
+        // an alias can't point to a declaration: elsewhere than in the
+        // partition of its function, it becomes a declaration too
+        std::vector<GlobalAlias*> aliases;
+        for (GlobalAlias &GA : part->aliases()) {
+            Function *F = dyn_cast<Function>(GA.getAliasee()->stripPointerCasts());
+            if (F && !mine(F))
+                aliases.push_back(&GA);
+        }
+        for (GlobalAlias *GA : aliases) {
+            std::string name = GA->getName();
+            GA->setName("");
+            Function *F = cast<Function>(GA->getAliasee()->stripPointerCasts());
+            Function *decl = Function::Create(F->getFunctionType(), GlobalValue::ExternalLinkage,
+                                              name, part);
+            GA->replaceAllUsesWith(ConstantExpr::getBitCast(decl, GA->getType()));
+            GA->eraseFromParent();
+        }
+        emit(part);
+        delete part;
+    }
+}
+#endif
+#endif
+
 static void jl_dump_shadow(char *fname, int jit_model, const char *sysimg_data, size_t sysimg_len, bool dump_as_bc)
 {
 #if defined(USE_MCJIT) || defined(USE_ORCJIT)
@@ -742,6 +977,60 @@ static void jl_dump_shadow(char *fname, int jit_model, const char *sysimg_data,
 
     // add metadata information
     jl_gen_llvm_globaldata(clone, VMap, sysimg_data, sysimg_len);
+#ifdef LLVM37
+    jl_gen_sysimg_clones(clone);
+#endif
+
+#ifdef LLVM37
+    unsigned nparts = jl_image_partitions();
+    if (!dump_as_bc && nparts > 1) {
+        // split the module, then optimize and emit each partition on its
+        // own thread; the partitions are linked together into the shared library
+        std::vector<std::unique_ptr<raw_fd_ostream>> parts;
+        std::vector<raw_pwrite_stream*> OSs(1, &OS);
+        for (unsigned i = 1; i < nparts; i++) {
+            std::string pname = std::string(fname) + "." + std::to_string(i);
+            parts.push_back(llvm::make_unique<raw_fd_ostream>(pname, err, sys::fs::F_None));
+            if (err)
+                jl_errorf("could not open \"%s\" for writing", pname.c_str());
+            OSs.push_back(parts.back().get());
+        }
+        // a module can't be moved between LLVMContexts, so the partitions
+        // travel to their threads as bitcode
+        std::vector<SmallString<0>> bcs;
+#ifdef LLVM38
+        SplitModule(std::unique_ptr<Module>(clone), nparts,
+                    [&](std::unique_ptr<Module> part) {
+                        bcs.emplace_back();
+                        raw_svector_ostream BCOS(bcs.back());
+                        WriteBitcodeToFile(part.get(), BCOS);
+                    });
+#else
+        jl_split_module(clone, nparts, [&](Module *part) {
+                bcs.emplace_back();
+                raw_svector_ostream BCOS(bcs.back());
+                WriteBitcodeToFile(part, BCOS);
+            });
+        delete clone;
+#endif
+        std::vector<std::thread> threads;
+        std::vector<char> ok(bcs.size(), 0);
+        for (size_t i = 0; i < bcs.size(); i++) {
+            threads.emplace_back([&, i]() {
+                ok[i] = jl_emit_image_partition(bcs[i], *OSs[i], TM.get());
+            });
+        }
+        for (std::thread &t : threads)
+            t.join();
+        jl_remove_image_partitions(fname, nparts);
+        for (size_t i = 0; i < ok.size(); i++) {
+            if (!ok[i])
+                jl_errorf("could not generate obj file for image partition %d", (int)i);
+        }
+        return;
+    }
+    jl_remove_image_partitions(fname, 1);
+#endif
 
     // do the actual work
     if (!dump_as_bc)
@@ -962,13 +1251,16 @@ static Type *julia_struct_to_llvm(jl_value_t *jt, bool *isboxed)
             if (ntypes == 0 || jst->size == 0)
                 return T_void;
             StructType *structdecl;
-            if (!isTuple) {
+            bool isvecelement = jl_is_vecelement_type(jt);
+            if (!isTuple && !isvecelement) {
                 structdecl = StructType::create(jl_LLVMContext, jl_symbol_name(jst->name->name));
                 jst->struct_decl = structdecl;
             }
             std::vector<Type*> latypes(0);
             size_t i;
+            bool isarray = true;
             bool isvector = true;
+            jl_value_t *lastjltype = NULL;
             Type *lasttype = NULL;
             for(i = 0; i < ntypes; i++) {
                 jl_value_t *ty = jl_svecref(jst->types, i);
@@ -978,20 +1270,28 @@ static Type *julia_struct_to_llvm(jl_value_t *jt, bool *isboxed)
                 else
                     lty = ty==(jl_value_t*)jl_bool_type ? T_int8 : julia_type_to_llvm(ty);
                 if (lasttype != NULL && lasttype != lty)
+                    isarray = false;
+                if (lastjltype != NULL && lastjltype != ty)
                     isvector = false;
                 lasttype = lty;
+                lastjltype = ty;
                 if (type_is_ghost(lty))
                     lty = NoopType;
                 latypes.push_back(lty);
             }
+            if (isvecelement) {
+                // a VecElement is just its value, so that tuples of them can be vectors
+                jst->struct_decl = latypes[0];
+                return latypes[0];
+            }
             if (!isTuple) {
                 structdecl->setBody(latypes);
             }
             else {
-                if (isvector && lasttype != T_int1 && !type_is_ghost(lasttype)) {
-                    // TODO: currently we get LLVM assertion failures for other vector sizes
-                    bool validVectorSize = (ntypes == 2 || ntypes == 4 || ntypes == 6);
-                    if (0 && lasttype->isSingleValueType() && !lasttype->isVectorTy() && validVectorSize) // currently disabled due to load/store alignment issues
+                if (isarray && lasttype != T_int1 && !type_is_ghost(lasttype)) {
+                    // jl_special_vector_alignment has already given the tuple the
+                    // layout of the vector, in the cases where LLVM handles them well
+                    if (isvector && jl_special_vector_alignment(ntypes, lastjltype) != 0)
                         jst->struct_decl = VectorType::get(lasttype, ntypes);
                     else
                         jst->struct_decl = ArrayType::get(lasttype, ntypes);
@@ -1032,10 +1332,12 @@ static bool is_tupletype_homogeneous(jl_svec_t *t)
     return true;
 }
 
+// small aggregates such as the (q, r) of divrem or the (value, state) of an
+// iterator's next come back in a register pair; only larger ones use sret
 static bool deserves_sret(jl_value_t *dt, Type *T)
 {
     assert(jl_is_datatype(dt));
-    return (size_t)jl_datatype_size(dt) > sizeof(void*) && !T->isFloatingPointTy();
+    return (size_t)jl_datatype_size(dt) > 2*sizeof(void*) && !T->isFloatingPointTy();
 }
 
 // --- generating various field accessors ---
@@ -1399,7 +1701,8 @@ static jl_cgval_t typed_load(Value *ptr, Value *idx_0based, jl_value_t *jltype,
 static void typed_store(Value *ptr, Value *idx_0based, const jl_cgval_t &rhs,
                         jl_value_t *jltype, jl_codectx_t *ctx, MDNode* tbaa,
                         Value* parent,  // for the write barrier, NULL if no barrier needed
-                        size_t alignment = 0)
+                        size_t alignment = 0,
+                        bool slot_barrier = false) // parent is an array, remember only the slot
 {
     Type *elty = julia_type_to_llvm(jltype);
     assert(elty != NULL);
@@ -1409,21 +1712,22 @@ static void typed_store(Value *ptr, Value *idx_0based, const jl_cgval_t &rhs,
         elty = T_int8;
     }
     Value *r;
+    Value *data;
+    if (ptr->getType()->getContainedType(0) != elty)
+        data = builder.CreateBitCast(ptr, PointerType::get(elty, 0));
+    else
+        data = ptr;
+    Value *slot = builder.CreateGEP(data, idx_0based);
     if (jl_isbits(jltype) && ((jl_datatype_t*)jltype)->size > 0) {
         r = emit_unbox(elty, rhs, jltype);
     }
     else {
         r = boxed(rhs, ctx, jltype);
-        if (parent != NULL) emit_write_barrier(ctx, parent, r);
+        if (parent != NULL) emit_write_barrier(ctx, parent, r, slot_barrier ? slot : NULL);
     }
-    Value *data;
-    if (ptr->getType()->getContainedType(0) != elty)
-        data = builder.CreateBitCast(ptr, PointerType::get(elty, 0));
-    else
-        data = ptr;
     if (data->getType()->getContainedType(0)->isVectorTy() && !alignment)
         alignment = ((jl_datatype_t*)jltype)->alignment; // prevent llvm from assuming 32 byte alignment of vectors
-    Instruction *store = builder.CreateAlignedStore(r, builder.CreateGEP(data, idx_0based), alignment);
+    Instruction *store = builder.CreateAlignedStore(r, slot, alignment);
     if (tbaa)
         tbaa_decorate(tbaa, store);
 }
@@ -1637,12 +1941,22 @@ static jl_cgval_t emit_getfield_knownidx(const jl_cgval_t &strct, unsigned idx,
         }
     }
     else if (strct.ispointer) { // something stack allocated
-        Value *addr = builder.CreateConstInBoundsGEP2_32(
-            LLVM37_param(cast<PointerType>(strct.V->getType()->getScalarType())->getElementType())
-            strct.V, 0, idx);
+        Value *addr;
+        if (jl_is_vecelement_type((jl_value_t*)jt))
+            addr = strct.V; // a VecElement is stored as its value
+        else
+            addr = builder.CreateConstInBoundsGEP2_32(
+                LLVM37_param(cast<PointerType>(strct.V->getType()->getScalarType())->getElementType())
+                strct.V, 0, idx);
         assert(!jt->mutabl);
         return typed_load(addr, NULL, jfty, ctx, tbaa_immut);
     }
+    else if (jl_is_vecelement_type((jl_value_t*)jt)) {
+        fldv = strct.V;
+        if (jfty == (jl_value_t*)jl_bool_type)
+            fldv = builder.CreateTrunc(fldv, T_int1);
+        return mark_julia_type(fldv, false, jfty);
+    }
     else {
         assert(strct.V->getType()->isVectorTy());
         fldv = builder.CreateExtractElement(strct.V, ConstantInt::get(T_int32, idx));
@@ -2011,8 +2325,8 @@ static Value *boxed(const jl_cgval_t &vinfo, jl_codectx_t *ctx, jl_value_t *jt)
     if (jb == jl_int32_type) return call_with_signed(box_int32_func, v);
     if (jb == jl_int64_type) return call_with_signed(box_int64_func, v);
     if (jb == jl_float32_type) return builder.CreateCall(prepare_call(box_float32_func), v);
-    //if (jb == jl_float64_type) return builder.CreateCall(box_float64_func, v);
-    // for Float64, fall through to generic case below, to inline alloc & init of Float64 box. cheap, I know.
+    // through jl_box_float64 rather than inline, so common values come from its cache
+    if (jb == jl_float64_type) return builder.CreateCall(prepare_call(box_float64_func), v);
     if (jb == jl_uint8_type)  return call_with_unsigned(box_uint8_func, v);
     if (jb == jl_uint16_type) return call_with_unsigned(box_uint16_func, v);
     if (jb == jl_uint32_type) return call_with_unsigned(box_uint32_func, v);
@@ -2088,9 +2402,38 @@ static Value* emit_allocobj(size_t static_size)
                                   ConstantInt::get(T_size, static_size));
 }
 
+// whether parent was allocated earlier in the current basic block with no
+// call in between that could run a collection. it is then young and unmarked
+// so no write barrier is needed to store into it.
+static bool is_fresh_alloc(Value *parent)
+{
+    CallInst *alloc = dyn_cast<CallInst>(parent->stripPointerCasts());
+    if (alloc == NULL)
+        return false;
+    Value *callee = alloc->getCalledValue();
+    if (callee != jlallocobj_func && callee != jlalloc1w_func &&
+        callee != jlalloc2w_func && callee != jlalloc3w_func)
+        return false;
+    BasicBlock *bb = builder.GetInsertBlock();
+    if (alloc->getParent() != bb)
+        return false;
+    BasicBlock::iterator it = builder.GetInsertPoint();
+    for (int n = 0; n < 100 && it != bb->begin(); n++) {
+        Instruction *I = &*--it;
+        if (I == alloc)
+            return true;
+        if ((isa<CallInst>(I) && !isa<IntrinsicInst>(I)) || isa<InvokeInst>(I))
+            return false;
+    }
+    return false;
+}
+
 // if ptr is NULL this emits a write barrier _back_
-static void emit_write_barrier(jl_codectx_t* ctx, Value *parent, Value *ptr)
+// if slot is not NULL, only the array slot that was stored to is remembered
+static void emit_write_barrier(jl_codectx_t* ctx, Value *parent, Value *ptr, Value *slot)
 {
+    if (is_fresh_alloc(parent))
+        return;
     Value* parenttag = builder.CreateBitCast(emit_typeptr_addr(parent), T_psize);
     Value* parent_type = builder.CreateLoad(parenttag);
     Value* parent_mark_bits = builder.CreateAnd(parent_type, 1);
@@ -2109,7 +2452,11 @@ static void emit_write_barrier(jl_codectx_t* ctx, Value *parent, Value *ptr)
     Value* ptr_not_marked = builder.CreateICmpEQ(ptr_mark_bit, ConstantInt::get(T_size, 0));
     builder.CreateCondBr(ptr_not_marked, barrier_trigger, cont);
     builder.SetInsertPoint(barrier_trigger);
-    builder.CreateCall(prepare_call(queuerootfun), builder.CreateBitCast(parent, T_pjlvalue));
+    if (slot != NULL)
+        builder.CreateCall(prepare_call(queueslotfun), {builder.CreateBitCast(parent, T_pjlvalue),
+                                                        builder.CreateBitCast(slot, T_pjlvalue)});
+    else
+        builder.CreateCall(prepare_call(queuerootfun), builder.CreateBitCast(parent, T_pjlvalue));
     builder.CreateBr(cont);
     ctx->f->getBasicBlockList().push_back(cont);
     builder.SetInsertPoint(cont);
@@ -2117,6 +2464,8 @@ static void emit_write_barrier(jl_codectx_t* ctx, Value *parent, Value *ptr)
 
 static void emit_checked_write_barrier(jl_codectx_t *ctx, Value *parent, Value *ptr)
 {
+    if (is_fresh_alloc(parent))
+        return;
     BasicBlock *cont;
     Value *not_null = builder.CreateICmpNE(ptr, V_null);
     BasicBlock *if_not_null = BasicBlock::Create(getGlobalContext(), "wb_not_null", ctx->f);
@@ -2183,7 +2532,9 @@ static jl_cgval_t emit_new_struct(jl_value_t *ty, size_t nargs, jl_value_t **arg
                     Value *fval = emit_unbox(fty, fval_info, jtype);
                     if (fty == T_int1)
                         fval = builder.CreateZExt(fval, T_int8);
-                    if (lt->isVectorTy())
+                    if (jl_is_vecelement_type(ty))
+                        strct = fval; // a VecElement is represented by its value
+                    else if (lt->isVectorTy())
                         strct = builder.CreateInsertElement(strct, fval, ConstantInt::get(T_int32,idx));
                     else
                         strct = builder.CreateInsertValue(strct, fval, ArrayRef<unsigned>(&idx,1));
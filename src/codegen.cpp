@@ -24,6 +24,10 @@
 #ifdef LLVM38
 #include <llvm/Analysis/BasicAliasAnalysis.h>
 #include <llvm/Analysis/TypeBasedAliasAnalysis.h>
+#include <llvm/Transforms/Utils/SplitModule.h>
+#endif
+#ifdef LLVM37
+#include <thread>
 #endif
 #ifdef LLVM37
 #include "llvm/IR/LegacyPassManager.h"
@@ -77,6 +81,10 @@
 #include <llvm/Support/SourceMgr.h>
 #include <llvm/Support/CommandLine.h>
 #include <llvm/Transforms/Utils/Cloning.h>
+#include <llvm/Analysis/CFG.h>
+#ifdef LLVM37
+#include <llvm/MC/MCSubtargetInfo.h>
+#endif
 
 #if defined(USE_ORCJIT)
 #include "llvm/ExecutionEngine/Orc/CompileUtils.h"
@@ -85,6 +93,8 @@
 #include "llvm/ExecutionEngine/Orc/LazyEmittingLayer.h"
 #include "llvm/ExecutionEngine/Orc/ObjectLinkingLayer.h"
 #include "llvm/ExecutionEngine/ObjectMemoryBuffer.h"
+#include <llvm/Support/Memory.h>
+#include <llvm/Support/Process.h>
 #elif defined(USE_MCJIT)
 #include <llvm/ExecutionEngine/MCJIT.h>
 #include <llvm/ExecutionEngine/SectionMemoryManager.h>
@@ -131,6 +141,8 @@ extern "C" {
 
 #include "builtin_proto.h"
 
+extern JL_DLLEXPORT int jl_n_threads;
+
 #ifdef HAVE_SSP
 extern uintptr_t __stack_chk_guard;
 extern void __stack_chk_fail();
@@ -181,11 +193,16 @@ extern JITEventListener* CreateJuliaJITEventListener();
 
 namespace llvm {
     extern Pass *createLowerSimdLoopPass();
+    extern Pass *createSimdLoopReportPass();
+    extern Pass *createLoopSafepointPass();
     extern bool annotateSimdLoop( BasicBlock* latch );
 }
 
 // for image reloading
 static bool imaging_mode = false;
+// functions emitted while this is set skip the FPM in to_function and are
+// optimized in parallel, per partition, by jl_dump_shadow
+static bool defer_function_passes = false;
 
 #include "jitlayers.cpp"
 
@@ -211,8 +228,12 @@ static MDBuilder *mbuilder;
 static std::map<int, std::string> argNumberStrings;
 #ifdef LLVM38
 static legacy::FunctionPassManager *FPM;
+static legacy::FunctionPassManager *FPMCheap;
 #else
 static FunctionPassManager *FPM;
+#ifdef LLVM37
+static FunctionPassManager *FPMCheap;
+#endif
 #endif
 
 #ifdef LLVM37
@@ -321,6 +342,9 @@ static GlobalVariable *jldomerr_var;
 static GlobalVariable *jlovferr_var;
 static GlobalVariable *jlinexacterr_var;
 static GlobalVariable *jlRTLD_DEFAULT_var;
+#ifdef JULIA_ENABLE_THREADING
+static GlobalVariable *jlsafepoint_page_var;
+#endif
 #ifdef _OS_WINDOWS_
 static GlobalVariable *jlexe_var;
 static GlobalVariable *jldll_var;
@@ -355,6 +379,11 @@ static Function *jlboundserrorv_func;
 static Function *jlcheckassign_func;
 static Function *jldeclareconst_func;
 static Function *jlgetbindingorerror_func;
+static Function *jlrunpendinginit_func;
+#ifdef JULIA_ENABLE_THREADING
+static Function *gcunsafeenter_func;
+static Function *gcstaterestore_func;
+#endif
 static Function *jlpref_func;
 static Function *jlpset_func;
 static Function *jltopeval_func;
@@ -362,6 +391,7 @@ static Function *jlcopyast_func;
 static Function *jltuple_func;
 static Function *jlnsvec_func;
 static Function *jlapplygeneric_func;
+static Function *jlapplycached_func;
 static Function *jlgetfield_func;
 static Function *jlbox_func;
 static Function *jlclosure_func;
@@ -395,6 +425,7 @@ static Function *box16_func;
 static Function *box32_func;
 static Function *box64_func;
 static Function *queuerootfun;
+static Function *queueslotfun;
 static Function *expect_func;
 static Function *jldlsym_func;
 static Function *jlnewbits_func;
@@ -405,6 +436,7 @@ static Function *jlpowf_func;
 #endif
 //static Function *jlgetnthfield_func;
 static Function *jlgetnthfieldchecked_func;
+static Function *jlapply2va_func;
 //static Function *jlsetnthfield_func;
 #ifdef _OS_WINDOWS_
 static Function *resetstkoflw_func;
@@ -496,6 +528,7 @@ struct jl_varinfo_t {
     bool escapes;
     bool usedUndef;
     bool used;
+    jl_expr_t *newexpr; // the `new` this var is scalar replaced with, or NULL
 
     jl_varinfo_t() : memloc(NULL), value(jl_cgval_t()),
 #ifdef LLVM37
@@ -505,7 +538,7 @@ struct jl_varinfo_t {
 #endif
                      closureidx(-1), isAssigned(true), isCaptured(false), isSA(false),
                      isVolatile(false), isArgument(false), isBox(false), hasGCRoot(false),
-                     escapes(true), usedUndef(false), used(false)
+                     escapes(true), usedUndef(false), used(false), newexpr(NULL)
     {
     }
 };
@@ -525,6 +558,31 @@ void jl_dump_objfile(char *fname, int jit_model, const char *sysimg_data, size_t
     jl_dump_shadow(fname, jit_model, sysimg_data, sysimg_len, false);
 }
 
+#ifdef LLVM37
+static unsigned jl_image_partitions(void)
+{
+    unsigned nparts = DEFAULT_IMAGE_THREADS;
+    if (const char *cp = getenv(IMAGE_THREADS_NAME))
+        nparts = std::max(atoi(cp), 1);
+    return nparts;
+}
+#endif
+
+// jl_compile_all brackets the methods it compiles only for the object file
+// with this. nothing runs them before jl_dump_objfile, so when the image is
+// emitted in partitions their function passes wait and run there, one
+// thread per partition
+extern "C"
+void jl_defer_function_passes(int on)
+{
+#ifdef LLVM37
+    defer_function_passes = on && imaging_mode && jl_options.outputo &&
+        !jl_options.outputbc && jl_image_partitions() > 1;
+#else
+    (void)on;
+#endif
+}
+
 
 // aggregate of array metadata
 typedef struct {
@@ -563,8 +621,11 @@ typedef struct {
     std::map<jl_sym_t*, jl_varinfo_t> vars;
     std::vector<jl_cgval_t> gensym_SAvalues;
     std::vector<bool> gensym_assigned;
+    std::vector<int> gensym_color; // gc root color of each GenSym, or -1
+    std::vector<int> gensym_slots; // gc frame slot of each color, or -1
     std::map<jl_sym_t*, jl_arrayvar_t> *arrayvars;
     std::map<int, BasicBlock*> *labels;
+    std::vector<jl_callsite_cache_t*> callsite_caches; // see alloc_callsite_cache
     std::map<int, Value*> *handlers;
     jl_module_t *module;
     jl_expr_t *ast;
@@ -616,6 +677,8 @@ static bool might_need_root(jl_value_t *ex);
 static Value *emit_condition(jl_value_t *cond, const std::string &msg, jl_codectx_t *ctx);
 static void allocate_gc_frame(size_t n_roots, BasicBlock *b0, jl_codectx_t *ctx);
 static void finalize_gc_frame(jl_codectx_t *ctx);
+static Value *emit_jlcall(Value *theFptr, Value *theF, int argStart,
+                          size_t nargs, jl_codectx_t *ctx);
 
 // --- convenience functions for tagging llvm values with julia types ---
 
@@ -703,7 +766,7 @@ extern "C" {
     int globalUnique = 0;
 }
 
-static void emit_write_barrier(jl_codectx_t*, Value*, Value*);
+static void emit_write_barrier(jl_codectx_t*, Value*, Value*, Value *slot = NULL);
 
 #include "cgutils.cpp"
 
@@ -814,6 +877,97 @@ void jl_dump_compiles(void *s)
     dump_compiles_stream = (JL_STREAM*)s;
 }
 
+// Native code generated at run time cannot be saved and reloaded by a
+// later process: it refers to heap objects by their address (see
+// literal_pointer_val), which is only relocatable in imaging mode. What
+// can be saved is the list of specializations that got compiled, written
+// as precompile statements. Replayed from userimg.jl while building a
+// system image, they put the same code in the image.
+JL_STREAM *dump_precompiles_stream = NULL;
+extern "C" JL_DLLEXPORT
+void jl_dump_precompiles(void *s)
+{
+    dump_precompiles_stream = (JL_STREAM*)s;
+}
+
+static void dump_precompile(jl_lambda_info_t *li)
+{
+    jl_tupletype_t *tt = li->specTypes;
+    if (tt == NULL || li->name == anonymous_sym || !jl_is_leaf_type((jl_value_t*)tt))
+        return;
+    // only generic functions bound to their name can be looked up again
+    jl_value_t *f = jl_get_global(li->module, li->name);
+    if (f == NULL || !jl_is_function(f) || !jl_is_gf(f) || jl_gf_name(f) != li->name)
+        return;
+    JL_STREAM *s = dump_precompiles_stream;
+    jl_printf(s, "precompile(getfield(");
+    jl_static_show(s, (jl_value_t*)li->module);
+    jl_printf(s, ", symbol(\"%s\")), (", jl_symbol_name(li->name));
+    size_t i, n = jl_nparams(tt);
+    for (i = 0; i < n; i++) {
+        jl_static_show(s, jl_tparam(tt, i));
+        jl_printf(s, ",");
+    }
+    jl_printf(s, "))\n");
+}
+
+// Functions without loops that are compiled at run time are mostly
+// toplevel code and glue between calls, which run too few times to repay
+// the full pass pipeline. emit_function marks them, and they only get the
+// cleanup passes (see addOptimizationPasses). -O and the system image
+// build always use the full pipeline.
+// the labels that a later statement jumps back to
+static void find_loop_headers(jl_array_t *stmts, std::set<int> &headers)
+{
+    std::set<int> labels;
+    size_t i, n = jl_array_len(stmts);
+    for (i = 0; i < n; i++) {
+        jl_value_t *stmt = jl_cellref(stmts, i);
+        if (jl_is_labelnode(stmt)) {
+            labels.insert(jl_labelnode_label(stmt));
+        }
+        else if (jl_is_gotonode(stmt)) {
+            if (labels.count(jl_gotonode_label(stmt)))
+                headers.insert(jl_gotonode_label(stmt));
+        }
+        else if (jl_is_expr(stmt) && ((jl_expr_t*)stmt)->head == goto_ifnot_sym) {
+            int label = jl_unbox_long(jl_exprarg(stmt, 1));
+            if (labels.count(label))
+                headers.insert(label);
+        }
+    }
+}
+
+static bool has_backward_branch(jl_array_t *stmts)
+{
+    std::set<int> headers;
+    find_loop_headers(stmts, headers);
+    return !headers.empty();
+}
+
+static void mark_cheap_to_optimize(Function *f)
+{
+#ifdef LLVM37
+    f->addFnAttr("julia-cheap-opt", "true");
+#endif
+}
+
+static void mark_deferred_passes(Function *f)
+{
+    f->addFnAttr("julia-deferred-opt", "true");
+}
+
+static void run_function_passes(Function *f)
+{
+#ifdef LLVM37
+    if (f->hasFnAttribute("julia-cheap-opt")) {
+        FPMCheap->run(*f);
+        return;
+    }
+#endif
+    FPM->run(*f);
+}
+
 // --- entry point ---
 //static int n_emit=0;
 static void emit_function(jl_lambda_info_t *lam, jl_llvm_functions_t *declarations,
@@ -822,7 +976,7 @@ static void jl_finalize_module(Module *m);
 //static int n_compile=0;
 static Function *to_function(jl_lambda_info_t *li, jl_cyclectx_t *cyclectx)
 {
-    JL_LOCK(codegen);
+    JL_LOCK_SAFEPOINT(codegen);
     JL_SIGATOMIC_BEGIN();
     assert(!li->inInference);
     BasicBlock *old = nested_compile ? builder.GetInsertBlock() : NULL;
@@ -833,6 +987,8 @@ static Function *to_function(jl_lambda_info_t *li, jl_cyclectx_t *cyclectx)
     nested_compile = true;
     jl_gc_inhibit_finalizers(nested_compile);
     Function *f = NULL;
+    jl_compile_timer_t timer;
+    jl_compile_timer_start(&timer);
     JL_TRY {
         jl_llvm_functions_t definitions;
         #if defined(USE_MCJIT) || defined(USE_ORCJIT)
@@ -869,10 +1025,20 @@ static Function *to_function(jl_lambda_info_t *li, jl_cyclectx_t *cyclectx)
         jl_rethrow_with_add("error compiling %s", jl_symbol_name(li->name));
     }
     assert(f != NULL);
+    jl_compile_timer_stop(&timer, li, JL_COMPILE_CODEGEN);
 #if defined(USE_MCJIT) || defined(ORCJIT)
     if (imaging_mode)
 #endif
-        FPM->run(*f);
+    {
+        if (defer_function_passes) {
+            mark_deferred_passes(f);
+        }
+        else {
+            jl_compile_timer_start(&timer);
+            run_function_passes(f);
+            jl_compile_timer_stop(&timer, li, JL_COMPILE_LLVM_OPT);
+        }
+    }
     if (old != NULL) {
         builder.SetInsertPoint(old);
         builder.SetCurrentDebugLocation(olddl);
@@ -881,6 +1047,8 @@ static Function *to_function(jl_lambda_info_t *li, jl_cyclectx_t *cyclectx)
     jl_gc_inhibit_finalizers(nested_compile);
     JL_UNLOCK(codegen);
     JL_SIGATOMIC_END();
+    if (dump_precompiles_stream != NULL && !imaging_mode)
+        dump_precompile(li);
     if (dump_compiles_stream != NULL) {
         uint64_t this_time = jl_hrtime();
         jl_printf(dump_compiles_stream, "%" PRIu64 "\t\"", this_time - last_time);
@@ -952,11 +1120,61 @@ static void writeRecoveryFile(llvm::Module *mod)
 }
 #endif
 
+#ifndef USE_ORCJIT
+// Functions are emitted into the active module until one of them needs an
+// address, then the whole module is optimized and finalized at once, so a
+// function and the callees compiled for it share one module and one object.
+// Before that, direct calls to small functions of the same batch are inlined
+// so that the function passes can optimize across them.
+#define BATCH_INLINE_THRESHOLD 50 // instructions
+
+static bool batch_inlinable(Function *caller, Function *callee)
+{
+    if (callee == NULL || callee == caller || callee->isDeclaration() ||
+        callee->getParent() != caller->getParent() || callee->isVarArg() ||
+        callee->hasFnAttribute(Attribute::NoInline) ||
+        callee->callsFunctionThatReturnsTwice())
+        return false;
+    size_t ninsts = 0;
+    for (auto &BB : *callee) {
+        ninsts += BB.size();
+        if (ninsts > BATCH_INLINE_THRESHOLD)
+            return false;
+    }
+    return true;
+}
+
+static void inline_batch_calls(Module *m)
+{
+    std::vector<CallInst*> calls;
+    for (auto &F : m->functions()) {
+        if (F.isDeclaration())
+            continue;
+        for (auto &BB : F) {
+            for (auto &I : BB) {
+                CallInst *call = dyn_cast<CallInst>(&I);
+                if (call && batch_inlinable(&F, call->getCalledFunction()))
+                    calls.push_back(call);
+            }
+        }
+    }
+    for (CallInst *call : calls) {
+        InlineFunctionInfo info;
+        (void)InlineFunction(call, info);
+    }
+}
+#endif
+
+// the lambda that the optimization and emission of the active module is
+// charged to by the compile time profiler
+static jl_lambda_info_t *compile_timing_li = NULL;
+
 static uint64_t getAddressForOrCompileFunction(llvm::Function *llvmf)
 {
     #ifdef JL_DEBUG_BUILD
     llvm::raw_fd_ostream out(1,false);
     #endif
+    jl_compile_timer_t timer;
     uint64_t addr = jl_mcjmm->getSymbolAddress(llvmf->getName());
     if (addr)
         return addr;
@@ -965,6 +1183,7 @@ static uint64_t getAddressForOrCompileFunction(llvm::Function *llvmf)
     // to emit it.
     if (!ActiveF || ActiveF->isDeclaration())
         return jl_ExecutionEngine->getFunctionAddress(llvmf->getName());
+    jl_compile_timer_start(&timer);
     if (!imaging_mode) {
         realize_pending_globals();
         #ifndef USE_ORCJIT
@@ -977,6 +1196,7 @@ static uint64_t getAddressForOrCompileFunction(llvm::Function *llvmf)
         if(verifyModule(*active_module))
             writeRecoveryFile(backup);
         #endif
+        inline_batch_calls(active_module);
         for (auto &F : active_module->functions()) {
             if (F.isDeclaration())
                 continue;
@@ -984,7 +1204,7 @@ static uint64_t getAddressForOrCompileFunction(llvm::Function *llvmf)
             if(verifyFunction(F))
                 writeRecoveryFile(backup);
             #endif
-            FPM->run(F);
+            run_function_passes(&F);
             #ifdef JL_DEBUG_BUILD
             if(verifyFunction(F))
                 writeRecoveryFile(backup);
@@ -996,10 +1216,13 @@ static uint64_t getAddressForOrCompileFunction(llvm::Function *llvmf)
         delete backup;
         #endif
         #endif
+        jl_compile_timer_stop(&timer, compile_timing_li, JL_COMPILE_LLVM_OPT);
+        jl_compile_timer_start(&timer);
         jl_finalize_module(active_module);
     }
     addr = jl_ExecutionEngine->getFunctionAddress(llvmf->getName());
     assert(addr != 0);
+    jl_compile_timer_stop(&timer, compile_timing_li, JL_COMPILE_EMIT);
     if (!imaging_mode) {
         active_module = new Module("julia", jl_LLVMContext);
         jl_setup_module(active_module);
@@ -1010,13 +1233,15 @@ static uint64_t getAddressForOrCompileFunction(llvm::Function *llvmf)
 
 extern "C" void jl_generate_fptr(jl_function_t *f)
 {
-    JL_LOCK(codegen);
+    JL_LOCK_SAFEPOINT(codegen);
     // objective: assign li->fptr
     jl_lambda_info_t *li = f->linfo;
     assert(li->functionObjects.functionObject);
     if (li->fptr == &jl_trampoline) {
         JL_SIGATOMIC_BEGIN();
         #ifdef USE_MCJIT
+        jl_lambda_info_t *last_timing_li = compile_timing_li;
+        compile_timing_li = li;
         if (imaging_mode) {
             // Copy the function out of the shadow module
             Module *m = new Module("julia", jl_LLVMContext);
@@ -1078,6 +1303,9 @@ extern "C" void jl_generate_fptr(jl_function_t *f)
                 ((Function*)li->functionObjects.specFunctionObject)->deleteBody();
 #endif
         }
+        #ifdef USE_MCJIT
+        compile_timing_li = last_timing_li;
+        #endif
         JL_SIGATOMIC_END();
     }
     f->fptr = li->fptr;
@@ -1172,19 +1400,23 @@ static Function *jl_cfunction_object(jl_function_t *f, jl_value_t *rt, jl_tuplet
     jl_error("cfunction: no method exactly matched the required type signature (function not yet c-callable)");
 }
 
-// get the address of a C-callable entry point for a function
-extern "C" JL_DLLEXPORT
-void *jl_function_ptr(jl_function_t *f, jl_value_t *rt, jl_value_t *argt)
+// entry points already handed out by jl_function_ptr, keyed by
+// (function, return type, argument types). an entry is only reused while no
+// method has been added since it was made, since that may change which
+// method the wrapper should call. the keys are kept alive by
+// jl_cfunction_cache_roots.
+typedef std::pair<jl_function_t*, std::pair<jl_value_t*, jl_value_t*> > cfunction_key_t;
+typedef struct {
+    size_t generation;
+    void *fptr;
+} cfunction_entry_t;
+static std::map<cfunction_key_t, cfunction_entry_t> cfunction_cache;
+extern "C" jl_array_t *jl_cfunction_cache_roots = NULL;
+
+static void *cfunction_object_ptr(jl_function_t *f, jl_value_t *rt, jl_value_t *argt)
 {
-    JL_GC_PUSH1(&argt);
-    if (jl_is_tuple(argt)) {
-        // TODO: maybe deprecation warning, better checking
-        argt = (jl_value_t*)jl_apply_tuple_type_v((jl_value_t**)jl_data_ptr(argt), jl_nfields(argt));
-    }
-    assert(jl_is_tuple_type(argt));
     Function *llvmf = jl_cfunction_object(f, rt, (jl_tupletype_t*)argt);
     assert(llvmf);
-    JL_GC_POP();
 
 #ifdef USE_MCJIT
     if (uint64_t addr = getAddressForOrCompileFunction(llvmf))
@@ -1205,6 +1437,51 @@ void *jl_function_ptr(jl_function_t *f, jl_value_t *rt, jl_value_t *argt)
 #endif
 }
 
+// get the address of a C-callable entry point for a function
+extern "C" JL_DLLEXPORT
+void *jl_function_ptr(jl_function_t *f, jl_value_t *rt, jl_value_t *argt)
+{
+    JL_GC_PUSH1(&argt);
+    if (jl_is_tuple(argt)) {
+        // TODO: maybe deprecation warning, better checking
+        argt = (jl_value_t*)jl_apply_tuple_type_v((jl_value_t**)jl_data_ptr(argt), jl_nfields(argt));
+    }
+    assert(jl_is_tuple_type(argt));
+
+    JL_LOCK_SAFEPOINT(codegen);
+    cfunction_key_t key(f, std::make_pair(rt, argt));
+    std::map<cfunction_key_t, cfunction_entry_t>::iterator it = cfunction_cache.find(key);
+    if (it != cfunction_cache.end() && it->second.generation == jl_method_table_generation) {
+        void *fptr = it->second.fptr;
+        JL_UNLOCK(codegen);
+        JL_GC_POP();
+        return fptr;
+    }
+    size_t generation = jl_method_table_generation;
+    void *fptr = NULL;
+    JL_TRY {
+        fptr = cfunction_object_ptr(f, rt, argt);
+    }
+    JL_CATCH {
+        JL_UNLOCK(codegen);
+        jl_rethrow();
+    }
+    if (it == cfunction_cache.end()) {
+        if (jl_cfunction_cache_roots == NULL)
+            jl_cfunction_cache_roots = jl_alloc_cell_1d(0);
+        jl_cell_1d_push(jl_cfunction_cache_roots, (jl_value_t*)f);
+        if (rt != NULL)
+            jl_cell_1d_push(jl_cfunction_cache_roots, rt);
+        jl_cell_1d_push(jl_cfunction_cache_roots, argt);
+    }
+    cfunction_entry_t &entry = cfunction_cache[key];
+    entry.generation = generation;
+    entry.fptr = fptr;
+    JL_UNLOCK(codegen);
+    JL_GC_POP();
+    return fptr;
+}
+
 
 extern "C" JL_DLLEXPORT
 void *jl_function_ptr_by_llvm_name(char* name) {
@@ -1328,13 +1605,13 @@ void *jl_get_llvmf(jl_function_t *f, jl_tupletype_t *tt, bool getwrapper, bool g
         }
         if (other)
             other->eraseFromParent();
-        FPM->run(*llvmf);
+        run_function_passes(llvmf);
         llvmf->removeFromParent();
     } else {
         ValueToValueMapTy VMap;
         llvmf = CloneFunction(llvmf,VMap,false);
         active_module->getFunctionList().push_back(llvmf);
-        FPM->run(*llvmf);
+        run_function_passes(llvmf);
         llvmf->removeFromParent();
     }
     JL_GC_POP();
@@ -1514,26 +1791,79 @@ const jl_value_t *jl_dump_function_asm(void *f, int raw_mc)
 
 // Code coverage
 
-typedef std::map<std::string,std::vector<GlobalVariable*> > logdata_t;
+// the counters of a function: one array global with a slot for each source
+// line it visits, and the file and line of each slot. the source lines are
+// only mapped to slots while the function is emitted.
+typedef struct {
+    GlobalVariable *counts;
+    size_t nslots;
+    std::vector<std::pair<std::string,int> > lines;
+    std::map<std::pair<std::string,int>,size_t> slots;
+} logblock_t;
+typedef std::vector<logblock_t*> logdata_t;
 static logdata_t coverageData;
+// set by JULIA_COVERAGE_MODE=once: only record that a line ran
+static bool coverage_once = false;
+
+// a block of nslots counters for the function being emitted
+static logblock_t *newLogBlock(logdata_t &logData, size_t nslots, const char *name)
+{
+    logblock_t *block = new logblock_t;
+    ArrayType *atype = ArrayType::get(T_int64, nslots);
+    block->counts = addComdat(new GlobalVariable(*jl_Module, atype, false,
+                                                 GlobalVariable::InternalLinkage,
+                                                 ConstantAggregateZero::get(atype), name));
+    block->nslots = nslots;
+    logData.push_back(block);
+    return block;
+}
 
-static void coverageVisitLine(std::string filename, int line)
+// the counter of a line, or NULL if it isn't a line of a file
+static Value *logBlockSlot(logblock_t *block, const std::string &filename, int line)
 {
     if (filename == "" || filename == "none" || filename == "no file")
+        return NULL;
+    std::pair<std::string,int> key(filename, line);
+    std::map<std::pair<std::string,int>,size_t>::iterator it = block->slots.find(key);
+    size_t slot;
+    if (it != block->slots.end()) {
+        slot = it->second;
+    }
+    else {
+        if (block->lines.size() >= block->nslots)
+            return NULL;
+        slot = block->lines.size();
+        block->lines.push_back(key);
+        block->slots[key] = slot;
+    }
+    return builder.CreateConstGEP1_32(builder.CreateBitCast(prepare_global(block->counts), T_pint64),
+                                      slot);
+}
+
+static void logBlockDone(logblock_t *block)
+{
+    std::map<std::pair<std::string,int>,size_t>().swap(block->slots);
+}
+
+static int64_t *logBlockCounts(logblock_t *block)
+{
+#ifdef USE_MCJIT
+    return (int64_t*)(intptr_t)jl_ExecutionEngine->getGlobalValueAddress(block->counts->getName());
+#else
+    return (int64_t*)jl_ExecutionEngine->getPointerToGlobal(block->counts);
+#endif
+}
+
+static void coverageVisitLine(logblock_t *block, std::string filename, int line)
+{
+    Value *v = logBlockSlot(block, filename, line);
+    if (v == NULL)
+        return;
+    if (coverage_once) {
+        // a store of a constant has no dependence on the last execution
+        builder.CreateStore(ConstantInt::get(T_int64,1), v, true);
         return;
-    logdata_t::iterator it = coverageData.find(filename);
-    if (it == coverageData.end()) {
-        coverageData[filename] = std::vector<GlobalVariable*>(0);
-    }
-    std::vector<GlobalVariable*> &vec = coverageData[filename];
-    if (vec.size() <= (size_t)line)
-        vec.resize(line+1, NULL);
-    if (vec[line] == NULL) {
-        vec[line] = addComdat(new GlobalVariable(*jl_Module, T_int64, false,
-                                                 GlobalVariable::InternalLinkage,
-                                                 ConstantInt::get(T_int64,0), "lcnt"));
     }
-    GlobalVariable *v = prepare_global(vec[line]);
     builder.CreateStore(builder.CreateAdd(builder.CreateLoad(v, true),
                                           ConstantInt::get(T_int64,1)),
                         v, true);
@@ -1541,14 +1871,35 @@ static void coverageVisitLine(std::string filename, int line)
 
 extern "C" int isabspath(const char *in);
 
-void write_log_data(logdata_t logData, const char *extension)
+// with once set, a line is 1 if any counter of it is
+void write_log_data(logdata_t &logData, const char *extension, bool once)
 {
     std::string base = std::string(jl_options.julia_home);
     base = base + "/../share/julia/base/";
+    // sum the counters of all the functions by file and line first, reading
+    // each block once
+    std::map<std::string,std::vector<int64_t> > files;
     logdata_t::iterator it = logData.begin();
     for (; it != logData.end(); it++) {
-        std::string filename = (*it).first;
-        std::vector<GlobalVariable*> &values = (*it).second;
+        logblock_t *block = *it;
+        if (block->lines.empty())
+            continue;
+        int64_t *counts = logBlockCounts(block);
+        if (counts == NULL)
+            continue;
+        for (size_t i = 0; i < block->lines.size(); i++) {
+            std::vector<int64_t> &values = files[block->lines[i].first];
+            size_t l = block->lines[i].second;
+            if (values.size() <= l)
+                values.resize(l+1, -1);
+            int64_t prev = values[l] == -1 ? 0 : values[l];
+            values[l] = once ? std::max(prev, counts[i]) : prev + counts[i];
+        }
+    }
+    std::map<std::string,std::vector<int64_t> >::iterator fit = files.begin();
+    for (; fit != files.end(); fit++) {
+        std::string filename = (*fit).first;
+        std::vector<int64_t> &values = (*fit).second;
         if (values.size() > 1) {
             if (!isabspath(filename.c_str()))
                 filename = base + filename;
@@ -1565,18 +1916,9 @@ void write_log_data(logdata_t logData, const char *extension)
                         inf.clear();
                         inf.ignore(std::numeric_limits<std::streamsize>::max(), '\n');
                     }
-                    int value = -1;
-                    if ((size_t)l < values.size()) {
-                        GlobalVariable *gv = values[l];
-                        if (gv) {
-#ifdef USE_MCJIT
-                            int *p = (int*)(intptr_t)jl_ExecutionEngine->getGlobalValueAddress(gv->getName());
-#else
-                            int *p = (int*)jl_ExecutionEngine->getPointerToGlobal(gv);
-#endif
-                            value = *p;
-                        }
-                    }
+                    int64_t value = -1;
+                    if ((size_t)l < values.size())
+                        value = values[l];
                     outf.width(9);
                     if (value == -1)
                         outf<<'-';
@@ -1599,32 +1941,20 @@ extern "C" void jl_write_coverage_data(void)
     std::ostringstream stm;
     stm << jl_getpid();
     std::string outf = "." + stm.str() + ".cov";
-    write_log_data(coverageData, outf.c_str());
+    write_log_data(coverageData, outf.c_str(), coverage_once);
 }
 
 // Memory allocation log (malloc_log)
 
 static logdata_t mallocData;
 
-static void mallocVisitLine(std::string filename, int line)
+static void mallocVisitLine(logblock_t *block, std::string filename, int line)
 {
-    if (filename == "" || filename == "none" || filename == "no file") {
+    Value *v = logBlockSlot(block, filename, line);
+    if (v == NULL) {
         jl_gc_sync_total_bytes();
         return;
     }
-    logdata_t::iterator it = mallocData.find(filename);
-    if (it == mallocData.end()) {
-        mallocData[filename] = std::vector<GlobalVariable*>(0);
-    }
-    std::vector<GlobalVariable*> &vec = mallocData[filename];
-    if (vec.size() <= (size_t)line)
-        vec.resize(line+1, NULL);
-    if (vec[line] == NULL) {
-        vec[line] = addComdat(new GlobalVariable(*jl_Module, T_int64, false,
-                                                 GlobalVariable::InternalLinkage,
-                                                 ConstantInt::get(T_int64,0), "bytecnt"));
-    }
-    GlobalVariable *v = prepare_global(vec[line]);
     builder.CreateStore(builder.CreateAdd(builder.CreateLoad(v, true),
                                           builder.CreateCall(prepare_call(diff_gc_total_bytes_func)
 #ifdef LLVM37
@@ -1640,25 +1970,19 @@ extern "C" JL_DLLEXPORT void jl_clear_malloc_data(void)
 {
     logdata_t::iterator it = mallocData.begin();
     for (; it != mallocData.end(); it++) {
-        std::vector<GlobalVariable*> &bytes = (*it).second;
-        std::vector<GlobalVariable*>::iterator itb;
-        for (itb = bytes.begin(); itb != bytes.end(); itb++) {
-            if (*itb) {
-#ifdef USE_MCJIT
-                int *p = (int*)(intptr_t)jl_ExecutionEngine->getGlobalValueAddress((*itb)->getName());
-#else
-                int *p = (int*)jl_ExecutionEngine->getPointerToGlobal(*itb);
-#endif
-                *p = 0;
-            }
-        }
+        logblock_t *block = *it;
+        if (block->lines.empty())
+            continue;
+        int64_t *counts = logBlockCounts(block);
+        if (counts != NULL)
+            memset(counts, 0, block->lines.size() * sizeof(int64_t));
     }
     jl_gc_sync_total_bytes();
 }
 
 extern "C" void jl_write_malloc_log(void)
 {
-    write_log_data(mallocData, ".mem");
+    write_log_data(mallocData, ".mem", false);
 }
 
 // --- code gen for intrinsic functions ---
@@ -1685,6 +2009,13 @@ static void cg_bdw(jl_binding_t *b, jl_codectx_t *ctx)
     }
 }
 
+// code reading a binding of a module whose lazy __init__ is still pending
+// has to go through global_binding_pointer, which emits the call to run it
+static bool binding_init_pending(jl_binding_t *b)
+{
+    return b->owner != NULL && b->owner->init_pending;
+}
+
 // try to statically evaluate, NULL if not possible
 extern "C"
 jl_value_t *jl_static_eval(jl_value_t *ex, void *ctx_, jl_module_t *mod,
@@ -1737,7 +2068,7 @@ jl_value_t *jl_static_eval(jl_value_t *ex, void *ctx_, jl_module_t *mod,
         s = (jl_sym_t*)jl_globalref_name(ex);
         if (s && jl_is_symbol(s)) {
             jl_binding_t *b = jl_get_binding(jl_globalref_mod(ex), s);
-            if (b && b->constp) {
+            if (b && b->constp && !binding_init_pending(b)) {
                 if (b->deprecated) cg_bdw(b, ctx);
                 return b->value;
             }
@@ -1755,7 +2086,7 @@ jl_value_t *jl_static_eval(jl_value_t *ex, void *ctx_, jl_module_t *mod,
                     s = (jl_sym_t*)jl_static_eval(jl_exprarg(e,2),ctx,mod,sp,ast,sparams,allow_alloc);
                     if (m && jl_is_module(m) && s && jl_is_symbol(s)) {
                         jl_binding_t *b = jl_get_binding(m, s);
-                        if (b && b->constp) {
+                        if (b && b->constp && !binding_init_pending(b)) {
                             if (b->deprecated) cg_bdw(b, ctx);
                             return b->value;
                         }
@@ -1900,6 +2231,32 @@ static bool expr_is_symbol(jl_value_t *e)
     return (jl_is_symbol(e) || jl_is_symbolnode(e) || jl_is_topnode(e) || jl_is_globalref(e));
 }
 
+// whether `ex` is a call to the builtin `tuple`
+static bool is_tuple_call(jl_value_t *ex, jl_codectx_t *ctx)
+{
+    if (!jl_is_expr(ex) || ((jl_expr_t*)ex)->head != call_sym)
+        return false;
+    jl_value_t *f = jl_exprarg(ex, 0);
+    if (!expr_is_symbol(f) || !is_constant(f, ctx, false))
+        return false;
+    jl_value_t *fv = jl_interpret_toplevel_expr_in(ctx->module, f, NULL, 0);
+    return jl_is_function(fv) && ((jl_function_t*)fv)->fptr == &jl_f_tuple;
+}
+
+// _apply(call, f::Function, tuple(...), ..., x): everything spliced before
+// the last argument is an explicit tuple call, so a varargs tuple passed as
+// `x` can be forwarded from the argument array
+static bool is_prefixed_apply(jl_value_t **args, size_t nargs, jl_codectx_t *ctx)
+{
+    if (nargs < 4 || expr_type(args[2], ctx) != (jl_value_t*)jl_function_type)
+        return false;
+    for (size_t i = 3; i < nargs; i++) {
+        if (!is_tuple_call(args[i], ctx))
+            return false;
+    }
+    return true;
+}
+
 // a very simple, conservative escape analysis that is sufficient for
 // eliding allocation of varargs tuples.
 // "esc" means "in escaping context"
@@ -1936,7 +2293,9 @@ static void simple_escape_analysis(jl_value_t *expr, bool esc, jl_codectx_t *ctx
                              expr_type(jl_exprarg(e,2),ctx) == (jl_value_t*)jl_long_type) ||
                             ff->fptr == jl_f_nfields ||
                             (ff->fptr == jl_f_apply && alen==4 &&
-                             expr_type(jl_exprarg(e,2),ctx) == (jl_value_t*)jl_function_type)) {
+                             expr_type(jl_exprarg(e,2),ctx) == (jl_value_t*)jl_function_type) ||
+                            (ff->fptr == jl_f_apply &&
+                             is_prefixed_apply((jl_value_t**)jl_array_data(e->args), alen-1, ctx))) {
                             esc = false;
                         }
                     }
@@ -1979,6 +2338,163 @@ static void simple_escape_analysis(jl_value_t *expr, bool esc, jl_codectx_t *ctx
     }
 }
 
+// --- scalar replacement ---
+
+// A local `x = new(T, args...)` whose only uses are getfield(x, i) with a
+// constant i, all before the next label, does not need the object: each
+// getfield(x, i) is emitted as the i-th argument of the `new` instead. The
+// arguments must be constants or variables assigned before x and never
+// again, so they still hold the same values at every use of x.
+
+static int scalar_field_index(jl_datatype_t *dt, jl_value_t *k)
+{
+    if (jl_is_long(k)) {
+        ssize_t i = jl_unbox_long(k) - 1;
+        return (i >= 0 && (size_t)i < jl_datatype_nfields(dt)) ? (int)i : -1;
+    }
+    if (jl_is_quotenode(k) && jl_is_symbol(jl_fieldref(k,0)))
+        return jl_field_index(dt, (jl_sym_t*)jl_fieldref(k,0), 0);
+    return -1;
+}
+
+static bool is_getfield_call(jl_value_t *ex, jl_codectx_t *ctx)
+{
+    if (!jl_is_expr(ex) || ((jl_expr_t*)ex)->head != call_sym ||
+        jl_array_dim0(((jl_expr_t*)ex)->args) != 3)
+        return false;
+    jl_value_t *f = static_eval(jl_exprarg(ex,0), ctx, true);
+    return f != NULL && jl_is_function(f) && ((jl_function_t*)f)->fptr == &jl_f_get_field;
+}
+
+// does `ex` only use `v` as getfield(v, i) with a constant field i of dt
+// (or not at all if dt is NULL)?
+static bool only_getfield_uses(jl_value_t *ex, jl_sym_t *v, jl_datatype_t *dt,
+                               jl_codectx_t *ctx)
+{
+    if (jl_is_symbolnode(ex))
+        ex = (jl_value_t*)jl_symbolnode_sym(ex);
+    if (jl_is_symbol(ex))
+        return ex != (jl_value_t*)v;
+    if (!jl_is_expr(ex))
+        return true;
+    jl_expr_t *e = (jl_expr_t*)ex;
+    if (e->head == line_sym)
+        return true;
+    if (dt != NULL && is_getfield_call(ex, ctx)) {
+        jl_value_t *x = jl_exprarg(e,1);
+        if (jl_is_symbolnode(x))
+            x = (jl_value_t*)jl_symbolnode_sym(x);
+        if (x == (jl_value_t*)v)
+            return scalar_field_index(dt, jl_exprarg(e,2)) >= 0;
+    }
+    size_t i, n = jl_array_dim0(e->args);
+    for (i = 0; i < n; i++) {
+        if (!only_getfield_uses(jl_exprarg(e,i), v, dt, ctx))
+            return false;
+    }
+    return true;
+}
+
+static bool assigned_before(jl_array_t *stmts, size_t n, jl_value_t *v)
+{
+    for (size_t i = 0; i < n; i++) {
+        jl_value_t *st = jl_cellref(stmts, i);
+        if (jl_is_expr(st) && ((jl_expr_t*)st)->head == assign_sym) {
+            jl_value_t *l = jl_exprarg(st,0);
+            if (jl_is_symbolnode(l))
+                l = (jl_value_t*)jl_symbolnode_sym(l);
+            if (l == v || (jl_is_gensym(l) && jl_is_gensym(v) &&
+                           ((jl_gensym_t*)l)->id == ((jl_gensym_t*)v)->id))
+                return true;
+        }
+    }
+    return false;
+}
+
+// does `a`, an argument of the `new` in stmts[i], keep its value after it?
+static bool is_unchanging_arg(jl_value_t *a, jl_array_t *stmts, size_t i, jl_codectx_t *ctx)
+{
+    if (jl_is_symbolnode(a))
+        a = (jl_value_t*)jl_symbolnode_sym(a);
+    if (jl_is_gensym(a))
+        return assigned_before(stmts, i, a);
+    if (jl_is_symbol(a)) {
+        if (ctx->vars.find((jl_sym_t*)a) == ctx->vars.end())
+            return false; // global
+        jl_varinfo_t &vi = ctx->vars[(jl_sym_t*)a];
+        if (vi.isCaptured || vi.isVolatile)
+            return false;
+        if (vi.isArgument)
+            return !vi.isAssigned;
+        return vi.isSA && !vi.usedUndef && assigned_before(stmts, i, a);
+    }
+    return !jl_is_expr(a) && !jl_is_topnode(a) && !jl_is_globalref(a) &&
+        !jl_is_lambda_info(a);
+}
+
+static void find_scalar_replaceable(jl_array_t *stmts, jl_codectx_t *ctx)
+{
+    size_t i, j, k, n = jl_array_len(stmts);
+    for (i = 0; i < n; i++) {
+        jl_value_t *st = jl_cellref(stmts, i);
+        if (!jl_is_expr(st) || ((jl_expr_t*)st)->head != assign_sym)
+            continue;
+        jl_value_t *l = jl_exprarg(st,0);
+        jl_value_t *r = jl_exprarg(st,1);
+        if (jl_is_symbolnode(l))
+            l = (jl_value_t*)jl_symbolnode_sym(l);
+        if (!jl_is_symbol(l) || !jl_is_expr(r) || ((jl_expr_t*)r)->head != new_sym)
+            continue;
+        jl_sym_t *s = (jl_sym_t*)l;
+        if (s == ctx->vaName || ctx->vars.find(s) == ctx->vars.end())
+            continue;
+        jl_varinfo_t &vi = ctx->vars[s];
+        if (!vi.isSA || vi.isArgument || vi.isCaptured || vi.isVolatile || vi.usedUndef)
+            continue;
+        jl_expr_t *ne = (jl_expr_t*)r;
+        jl_value_t *ty = static_eval(jl_exprarg(ne,0), ctx, true);
+        if (ty == NULL || !jl_is_datatype(ty) || !jl_is_leaf_type(ty) || jl_isbits(ty))
+            continue;
+        jl_datatype_t *dt = (jl_datatype_t*)ty;
+        size_t nf = jl_datatype_nfields(dt);
+        if (nf == 0 || jl_array_dim0(ne->args) != nf+1)
+            continue;
+        bool ok = true;
+        for (k = 0; k < nf && ok; k++) {
+            jl_value_t *a = jl_exprarg(ne,k+1);
+            ok = is_unchanging_arg(a, stmts, i, ctx) &&
+                jl_subtype(expr_type(a, ctx), jl_field_type(dt, k), 0);
+        }
+        for (j = 0; j < i && ok; j++)
+            ok = only_getfield_uses(jl_cellref(stmts, j), s, NULL, ctx);
+        bool inblock = true;
+        for (j = i+1; j < n && ok; j++) {
+            jl_value_t *st2 = jl_cellref(stmts, j);
+            if (jl_is_labelnode(st2))
+                inblock = false;
+            ok = only_getfield_uses(st2, s, inblock ? dt : NULL, ctx);
+        }
+        if (ok)
+            vi.newexpr = ne;
+    }
+}
+
+// the argument of the `new` that getfield(x, k) reads, if x is scalar replaced
+static jl_value_t *scalar_replaced_field(jl_value_t *x, jl_value_t *k, jl_codectx_t *ctx)
+{
+    if (jl_is_symbolnode(x))
+        x = (jl_value_t*)jl_symbolnode_sym(x);
+    if (!jl_is_symbol(x) || ctx->vars.find((jl_sym_t*)x) == ctx->vars.end())
+        return NULL;
+    jl_expr_t *ne = ctx->vars[(jl_sym_t*)x].newexpr;
+    if (ne == NULL)
+        return NULL;
+    jl_datatype_t *dt = (jl_datatype_t*)static_eval(jl_exprarg(ne,0), ctx, true);
+    int idx = scalar_field_index(dt, k);
+    assert(idx >= 0);
+    return jl_exprarg(ne, idx+1);
+}
+
 // --- gc root utils ---
 
 // ---- Get Element Pointer (GEP) instructions within the GC frame ----
@@ -2079,6 +2595,109 @@ static bool might_need_root(jl_value_t *ex)
             !jl_is_globalref(ex));
 }
 
+// GenSyms are assigned once, so GenSyms whose live ranges do not overlap
+// can share the gc frame slot that roots them. A live range runs from the
+// assignment to the last use in statement order, extended to the end of
+// every loop it enters from outside. Colors are picked by linear scan, and
+// each color gets its slot the first time a GenSym of that color is rooted.
+static void gensym_uses(jl_value_t *ex, size_t i, std::vector<ssize_t> &last)
+{
+    if (jl_is_gensym(ex)) {
+        ssize_t id = ((jl_gensym_t*)ex)->id;
+        if (id >= 0 && (size_t)id < last.size() && last[id] < (ssize_t)i)
+            last[id] = i;
+    }
+    else if (jl_is_expr(ex)) {
+        jl_array_t *args = ((jl_expr_t*)ex)->args;
+        size_t j, n = jl_array_len(args);
+        for (j = 0; j < n; j++)
+            gensym_uses(jl_cellref(args, j), i, last);
+    }
+}
+
+static void assign_gensym_colors(jl_array_t *stmts, size_t n_gensyms, jl_codectx_t *ctx)
+{
+    jl_value_t *gensym_types = jl_lam_gensyms(ctx->ast);
+    size_t i, j, n = jl_array_len(stmts);
+    std::vector<ssize_t> first(n_gensyms, -1), last(n_gensyms, -1);
+    std::map<ptrint_t, size_t> labels;
+    std::vector<std::pair<size_t, ptrint_t> > gotos;
+    std::vector<size_t> order; // the rooted GenSyms, in order of assignment
+    for (i = 0; i < n; i++) {
+        jl_value_t *st = jl_cellref(stmts, i);
+        if (jl_is_labelnode(st)) {
+            labels[jl_labelnode_label(st)] = i;
+        }
+        else if (jl_is_gotonode(st)) {
+            gotos.push_back(std::make_pair(i, jl_gotonode_label(st)));
+        }
+        else if (jl_is_expr(st) && ((jl_expr_t*)st)->head == goto_ifnot_sym) {
+            gotos.push_back(std::make_pair(i, (ptrint_t)jl_unbox_long(jl_exprarg(st, 1))));
+        }
+        else if (jl_is_expr(st) && ((jl_expr_t*)st)->head == assign_sym &&
+                 jl_is_gensym(jl_exprarg(st, 0))) {
+            ssize_t id = ((jl_gensym_t*)jl_exprarg(st, 0))->id;
+            if (id >= 0 && (size_t)id < n_gensyms && first[id] < 0) {
+                jl_value_t *declType = (jl_is_array(gensym_types) ?
+                                        jl_cellref(gensym_types, id) : (jl_value_t*)jl_any_type);
+                // only GenSyms that get a gc root need a color
+                if (!store_unboxed_p(declType) && !is_stable_expr(jl_exprarg(st, 1), ctx)) {
+                    first[id] = i;
+                    order.push_back(id);
+                }
+            }
+        }
+        gensym_uses(st, i, last);
+    }
+    std::vector<std::pair<size_t, size_t> > loops; // (label, backward goto)
+    for (j = 0; j < gotos.size(); j++) {
+        std::map<ptrint_t, size_t>::iterator l = labels.find(gotos[j].second);
+        if (l != labels.end() && l->second <= gotos[j].first)
+            loops.push_back(std::make_pair(l->second, gotos[j].first));
+    }
+    for (j = 0; j < order.size(); j++) {
+        size_t id = order[j];
+        bool changed = true;
+        while (changed) {
+            changed = false;
+            for (size_t k = 0; k < loops.size(); k++) {
+                ssize_t h = loops[k].first, g = loops[k].second;
+                if (first[id] < h && h <= last[id] && last[id] < g) {
+                    last[id] = g;
+                    changed = true;
+                }
+            }
+        }
+    }
+    std::vector<ssize_t> color_end; // the end of the live range holding each color
+    ctx->gensym_color.assign(n_gensyms, -1);
+    for (j = 0; j < order.size(); j++) {
+        size_t id = order[j], c;
+        for (c = 0; c < color_end.size(); c++) {
+            if (color_end[c] < first[id])
+                break;
+        }
+        if (c == color_end.size())
+            color_end.push_back(last[id]);
+        else
+            color_end[c] = last[id];
+        ctx->gensym_color[id] = c;
+    }
+    ctx->gensym_slots.assign(color_end.size(), -1);
+}
+
+// the gc frame slot rooting GenSym idx
+static int gensym_root_slot(ssize_t idx, jl_codectx_t *ctx)
+{
+    int c = (size_t)idx < ctx->gensym_color.size() ? ctx->gensym_color[idx] : -1;
+    if (c < 0)
+        return ctx->gc.argSpaceSize++;
+    int &slot = ctx->gensym_slots[c];
+    if (slot < 0)
+        slot = ctx->gc.argSpaceSize++;
+    return slot;
+}
+
 static jl_cgval_t emit_boxed_rooted(jl_value_t *e, jl_codectx_t *ctx) // TODO: make this return a Value*
 {
     jl_cgval_t v = emit_expr(e, ctx);
@@ -2595,6 +3214,38 @@ static bool emit_known_call(jl_cgval_t *ret, jl_value_t *ff,
         return true;
     }
 
+    else if (f->fptr == &jl_f_apply && ctx->vaStack && symbol_eq(args[nargs], ctx->vaName) &&
+             is_prefixed_apply(args, nargs, ctx)) {
+        // turn Core._apply(f, tuple(a, b), Tuple) ==> f(a, b, Tuple...) without
+        // allocating either tuple, if Tuple is the vaStack allocation
+        Value *theF = boxed(emit_expr(args[2], ctx), ctx);
+        int argStart = ctx->gc.argDepth;
+        make_gcroot(theF, ctx);
+        int leadStart = ctx->gc.argDepth;
+        size_t nlead = 0;
+        for (size_t i = 3; i < nargs; i++) {
+            jl_array_t *targs = ((jl_expr_t*)args[i])->args;
+            for (size_t j = 1; j < jl_array_dim0(targs); j++) {
+                jl_value_t *a = jl_cellref(targs, j);
+                make_gcroot(boxed(emit_expr(a, ctx), ctx, expr_type(a, ctx)), ctx);
+                nlead++;
+            }
+        }
+        Value *lead = nlead > 0 ? emit_temp_slot(leadStart, ctx) :
+            (Value*)Constant::getNullValue(T_ppjlvalue);
+        Value *nva = emit_n_varargs(ctx);
+#ifdef _P64
+        nva = builder.CreateTrunc(nva, T_int32);
+#endif
+        Value *rest = builder.CreateGEP(ctx->argArray, ConstantInt::get(T_size, ctx->nReqArgs));
+        Value *callargs[5] = { theF, lead, ConstantInt::get(T_int32, nlead), rest, nva };
+        Value *r = builder.CreateCall(prepare_call(jlapply2va_func), ArrayRef<Value*>(&callargs[0], 5));
+        ctx->gc.argDepth = argStart;
+        *ret = mark_julia_type(r, true, expr_type(expr, ctx));
+        JL_GC_POP();
+        return true;
+    }
+
     else if (f->fptr == &jl_f_tuple) {
         if (nargs == 0) {
             *ret = ghostValue(jl_typeof(jl_emptytuple));
@@ -2758,7 +3409,7 @@ static bool emit_known_call(jl_cgval_t *ret, jl_value_t *ff,
                             data_owner->addIncoming(own_ptr, ownedBB);
                         }
                         typed_store(emit_arrayptr(ary,args[1],ctx), idx, v,
-                                    ety, ctx, tbaa_user, data_owner);
+                                    ety, ctx, tbaa_user, data_owner, 0, true);
                     }
                     *ret = ary;
                     JL_GC_POP();
@@ -2769,6 +3420,12 @@ static bool emit_known_call(jl_cgval_t *ret, jl_value_t *ff,
     }
 
     else if (f->fptr == &jl_f_get_field && nargs==2) {
+        jl_value_t *fld = scalar_replaced_field(args[1], args[2], ctx);
+        if (fld != NULL) {
+            *ret = emit_expr(fld, ctx);
+            JL_GC_POP();
+            return true;
+        }
         if (jl_is_quotenode(args[2]) && jl_is_symbol(jl_fieldref(args[2],0))) {
             *ret = emit_getfield(args[1],
                                  (jl_sym_t*)jl_fieldref(args[2],0), ctx);
@@ -2943,6 +3600,65 @@ static bool emit_known_call(jl_cgval_t *ret, jl_value_t *ff,
             }
         }
     }
+    else if (f->fptr == &jl_f_kwcall && nargs >= 4 && jl_is_long(args[2]) &&
+             ctx->linfo->inferred) {
+        // kwcall(call, n, k1, v1, ..., kn, vn, f, container, pargs...) with f a
+        // known generic function: store the keywords into the container here
+        // and call the matching kwsorter method directly, skipping the checks
+        // and the method lookup jl_f_kwcall does on every call
+        size_t nkeys = jl_unbox_long(args[2]);
+        size_t fidx = 3 + 2*nkeys;
+        jl_function_t *kf = NULL;
+        if (fidx < nargs)
+            kf = (jl_function_t*)static_eval(args[fidx], ctx, true);
+        jl_function_t *sorter = NULL;
+        if (kf != NULL && jl_is_gf(kf))
+            sorter = ((jl_methtable_t*)kf->env)->kwsorter;
+        if (sorter != NULL && jl_is_gf(sorter) &&
+            expr_type(args[fidx+1], ctx) == (jl_value_t*)jl_array_any_type) {
+            rt1 = (jl_value_t*)call_arg_types(&args[fidx+1], nargs - fidx, ctx);
+            jl_function_t *sm = NULL;
+            if (rt1 != NULL) {
+                rt2 = (jl_value_t*)jl_apply_tuple_type((jl_svec_t*)rt1);
+                sm = jl_get_specialization(sorter, (jl_tupletype_t*)rt2, (void*)ctx->cyclectx);
+            }
+            // without a match, leave it to jl_f_kwcall to report the
+            // MethodError against f rather than the sorter
+            if (sm != NULL) {
+                assert(sm->linfo->functionObjects.functionObject != NULL);
+                int argStart = ctx->gc.argDepth;
+                Value **kvs = (Value**)alloca(2*nkeys*sizeof(Value*));
+                for (size_t i = 0; i < 2*nkeys; i++) {
+                    jl_cgval_t kv = emit_expr(args[3+i], ctx);
+                    kvs[i] = boxed(kv, ctx, expr_type(args[3+i], ctx));
+                    make_gcroot(kvs[i], ctx);
+                }
+                // the container and the positional arguments are the
+                // arguments of the sorter, and must be adjacent roots
+                int sorterArgs = ctx->gc.argDepth;
+                Value *container = boxed(emit_expr(args[fidx+1], ctx), ctx);
+                make_gcroot(container, ctx);
+                for (size_t i = fidx+2; i <= nargs; i++) {
+                    jl_cgval_t anArg = emit_expr(args[i], ctx, true, true);
+                    make_gcroot(boxed(anArg, ctx, expr_type(args[i], ctx)), ctx);
+                }
+                Value *data = builder.CreateBitCast(emit_arrayptr(container), T_ppjlvalue);
+                for (size_t i = 0; i < 2*nkeys; i++) {
+                    Value *slot = builder.CreateGEP(data, ConstantInt::get(T_size, i));
+                    emit_write_barrier(ctx, container, kvs[i], slot);
+                    builder.CreateStore(kvs[i], slot);
+                }
+                jl_add_linfo_root(ctx->linfo, (jl_value_t*)sm);
+                Value *r = emit_jlcall((Value*)sm->linfo->functionObjects.functionObject,
+                                       literal_pointer_val((jl_value_t*)sm),
+                                       sorterArgs, nargs - fidx, ctx);
+                ctx->gc.argDepth = argStart;
+                *ret = mark_julia_type(r, true, expr_type(expr, ctx));
+                JL_GC_POP();
+                return true;
+            }
+        }
+    }
     // TODO: other known builtins
     JL_GC_POP();
     return false;
@@ -2981,6 +3697,133 @@ static Value *emit_jlcall(Value *theFptr, Value *theF, jl_value_t **args,
     return emit_jlcall(theFptr, theF, argStart, nargs, ctx);
 }
 
+// the inline caches are carved out of blocks that are never freed, like the
+// code that uses them, instead of being allocated one at a time. the caches
+// of a function that is emitted only to be shown and never runs (see
+// jl_get_llvmf) go back to a free list at the end of emit_function.
+#define CALLSITE_CACHE_BLOCK 256
+static jl_callsite_cache_t *callsite_cache_block = NULL;
+static size_t callsite_cache_left = 0;
+static std::vector<jl_callsite_cache_t*> callsite_cache_free;
+
+static jl_callsite_cache_t *alloc_callsite_cache(jl_codectx_t *ctx)
+{
+    jl_callsite_cache_t *cache;
+    if (!callsite_cache_free.empty()) {
+        cache = callsite_cache_free.back();
+        callsite_cache_free.pop_back();
+        memset(cache, 0, sizeof(jl_callsite_cache_t));
+    }
+    else {
+        if (callsite_cache_left == 0) {
+            callsite_cache_block = (jl_callsite_cache_t*)calloc(CALLSITE_CACHE_BLOCK,
+                                                                sizeof(jl_callsite_cache_t));
+            callsite_cache_left = CALLSITE_CACHE_BLOCK;
+        }
+        cache = callsite_cache_block++;
+        callsite_cache_left--;
+    }
+    ctx->callsite_caches.push_back(cache);
+    return cache;
+}
+
+// like emit_jlcall to jl_apply_generic, but through an inline cache owned by
+// this call site. the cache is a static pointer, so it cannot be imaged.
+static Value *emit_jlcall_cached(Value *theF, int argStart, size_t nargs,
+                                 jl_codectx_t *ctx)
+{
+    Value *myargs;
+    if (nargs > 0)
+        myargs = emit_temp_slot(argStart, ctx);
+    else
+        myargs = Constant::getNullValue(T_ppjlvalue);
+    jl_callsite_cache_t *cache = alloc_callsite_cache(ctx);
+    Value *vcache = literal_static_pointer_val(cache, T_pint8);
+#ifdef LLVM37
+    Value *result = builder.CreateCall(prepare_call(jlapplycached_func), {theF, myargs,
+                                        ConstantInt::get(T_int32,nargs), vcache});
+#else
+    Value *result = builder.CreateCall4(prepare_call(jlapplycached_func), theF, myargs,
+                                        ConstantInt::get(T_int32,nargs), vcache);
+#endif
+    ctx->gc.argDepth = argStart; // clear the args from the gcstack
+    return result;
+}
+
+static Value *emit_jlcall_cached(Value *theF, jl_value_t **args, size_t nargs,
+                                 jl_codectx_t *ctx)
+{
+    int argStart = ctx->gc.argDepth;
+    for(size_t i=0; i < nargs; i++) {
+        jl_cgval_t anArg = emit_expr(args[i], ctx, true, true);
+        make_gcroot(boxed(anArg, ctx, expr_type(args[i],ctx)), ctx);
+    }
+    return emit_jlcall_cached(theF, argStart, nargs, ctx);
+}
+
+// a dynamic call of f that the type feedback saw made with the argument
+// types sig most of the time: while the arguments have those types and no
+// method has been defined since, it calls the method they dispatch to
+// directly, otherwise it goes through jl_apply_generic. returns NULL if the
+// call can't be made this way.
+static Value *emit_jlcall_feedback(jl_function_t *f, Value *theF, jl_value_t **args,
+                                   size_t nargs, jl_codectx_t *ctx)
+{
+    uint32_t count, ncalls;
+    jl_tupletype_t *sig = jl_feedback_dominant_sig(ctx->linfo, f, nargs, &count, &ncalls);
+    if (sig == NULL)
+        return NULL;
+    for(size_t i=0; i < nargs; i++) {
+        if (!jl_subtype(jl_tparam(sig, i), expr_type(args[i], ctx), 0))
+            return NULL;
+    }
+    jl_function_t *sf = jl_get_specialization(f, sig, (void*)ctx->cyclectx);
+    if (sf == NULL)
+        return NULL;
+    jl_add_linfo_root(ctx->linfo, (jl_value_t*)sf);
+    size_t epoch = *jl_dispatch_epoch_ptr();
+
+    int argStart = ctx->gc.argDepth;
+    Value *guard = builder.CreateICmpEQ(
+        builder.CreateLoad(literal_static_pointer_val((void*)jl_dispatch_epoch_ptr(), T_psize), true),
+        ConstantInt::get(T_size, epoch));
+    for(size_t i=0; i < nargs; i++) {
+        jl_value_t *ty = expr_type(args[i], ctx);
+        Value *arg = boxed(emit_expr(args[i], ctx, true, true), ctx, ty);
+        make_gcroot(arg, ctx);
+        if (ty != jl_tparam(sig, i)) {
+            guard = builder.CreateAnd(guard, builder.CreateICmpEQ(
+                emit_typeof(arg), literal_pointer_val(jl_tparam(sig, i))));
+        }
+    }
+    BasicBlock *directBB = BasicBlock::Create(getGlobalContext(), "direct", ctx->f);
+    BasicBlock *genericBB = BasicBlock::Create(getGlobalContext(), "generic");
+    BasicBlock *mergeBB = BasicBlock::Create(getGlobalContext(), "mergedirect");
+    builder.CreateCondBr(guard, directBB, genericBB,
+                         mbuilder->createBranchWeights(count, ncalls - count + 1));
+
+    builder.SetInsertPoint(directBB);
+    Value *r1 = emit_jlcall((Value*)sf->linfo->functionObjects.functionObject,
+                            literal_pointer_val((jl_value_t*)sf), argStart, nargs, ctx);
+    directBB = builder.GetInsertBlock();
+    builder.CreateBr(mergeBB);
+
+    ctx->f->getBasicBlockList().push_back(genericBB);
+    builder.SetInsertPoint(genericBB);
+    Value *r2 = nargs <= JL_CALLSITE_MAXARGS ?
+        emit_jlcall_cached(theF, argStart, nargs, ctx) :
+        emit_jlcall(jlapplygeneric_func, theF, argStart, nargs, ctx);
+    genericBB = builder.GetInsertBlock();
+    builder.CreateBr(mergeBB);
+
+    ctx->f->getBasicBlockList().push_back(mergeBB);
+    builder.SetInsertPoint(mergeBB);
+    PHINode *ph = builder.CreatePHI(T_pjlvalue, 2);
+    ph->addIncoming(r1, directBB);
+    ph->addIncoming(r2, genericBB);
+    return ph;
+}
+
 static jl_cgval_t emit_call_function_object(jl_function_t *f, Value *theF, Value *theFptr,
                                         bool specialized,
                                         jl_value_t **args, size_t nargs,
@@ -3057,6 +3900,15 @@ static jl_cgval_t emit_call_function_object(jl_function_t *f, Value *theF, Value
         call->setAttributes(cf->getAttributes());
         return sret ? mark_julia_slot(result, jlretty) : mark_julia_type(call, retboxed, jlretty);
     }
+    if (theFptr == jlapplygeneric_func && f != NULL && jl_type_feedback) {
+        Value *r = emit_jlcall_feedback(f, theF, &args[1], nargs, ctx);
+        if (r != NULL)
+            return mark_julia_type(r, true, jl_any_type);
+    }
+    if (theFptr == jlapplygeneric_func && f != NULL && !imaging_mode &&
+        nargs <= JL_CALLSITE_MAXARGS) {
+        return mark_julia_type(emit_jlcall_cached(theF, &args[1], nargs, ctx), true, jl_any_type);
+    }
     return mark_julia_type(emit_jlcall(theFptr, theF, &args[1], nargs, ctx), true, jl_any_type); // (typ will be patched up by caller)
 }
 
@@ -3292,6 +4144,12 @@ static Value *global_binding_pointer(jl_module_t *m, jl_sym_t *s,
             return julia_binding_gv(builder.CreateBitCast(p, T_ppjlvalue));
         }
         if (b->deprecated) cg_bdw(b, ctx);
+        if (binding_init_pending(b)) {
+            // the lazy __init__ of the owner runs when this code reads the
+            // binding, not now (see jl_module_defer_initializer)
+            builder.CreateCall(prepare_call(jlrunpendinginit_func),
+                               literal_pointer_val((jl_value_t*)b->owner));
+        }
     }
     if (pbnd) *pbnd = b;
     return julia_binding_gv(b);
@@ -3405,7 +4263,7 @@ static void emit_assignment(jl_value_t *l, jl_value_t *r, jl_codectx_t *ctx)
             Value *rval = boxed(emit_expr(r, ctx, true), ctx);
             if (!is_stable_expr(r, ctx)) {
                 // add a gc root for this GenSym node
-                Value *bp = emit_local_slot(ctx->gc.argSpaceSize++, ctx);
+                Value *bp = emit_local_slot(gensym_root_slot(idx, ctx), ctx);
                 builder.CreateStore(rval, bp);
             }
             slot = mark_julia_type(rval, true, declType);
@@ -3448,6 +4306,8 @@ static void emit_assignment(jl_value_t *l, jl_value_t *r, jl_codectx_t *ctx)
 
     // it's a local variable or closure variable
     jl_varinfo_t &vi = ctx->vars[s];
+    if (vi.newexpr != NULL)
+        return; // scalar replaced, see find_scalar_replaceable
     if (!vi.memloc && !vi.hasGCRoot && vi.used
             && !vi.isArgument && !is_stable_expr(r, ctx)) {
         Instruction *newroot = cast<Instruction>(emit_local_slot(ctx->gc.argSpaceSize++, ctx));
@@ -3648,7 +4508,7 @@ static jl_cgval_t emit_expr(jl_value_t *expr, jl_codectx_t *ctx, bool isboxed, b
         }
         else if (jl_is_int64(expr)) {
             uint64_t val = jl_unbox_uint64(expr);
-            if ((uint64_t)(val+512) < 1024) {
+            if ((uint64_t)(val+NBOX_INT64_C/2) < NBOX_INT64_C) {
                 // this can be gotten from the box cache
                 needroot = false;
                 expr = jl_box_int64(val);
@@ -3685,7 +4545,12 @@ static jl_cgval_t emit_expr(jl_value_t *expr, jl_codectx_t *ctx, bool isboxed, b
         }
         else {
             Value *isfalse = emit_condition(cond, "if", ctx);
-            builder.CreateCondBr(isfalse, ifnot, ifso);
+            uint32_t taken, nottaken;
+            if (jl_feedback_branch(ctx->linfo, labelname, &taken, &nottaken))
+                builder.CreateCondBr(isfalse, ifnot, ifso,
+                                     mbuilder->createBranchWeights(taken + 1, nottaken + 1));
+            else
+                builder.CreateCondBr(isfalse, ifnot, ifso);
         }
         builder.SetInsertPoint(ifso);
     }
@@ -3929,6 +4794,21 @@ static jl_cgval_t emit_expr(jl_value_t *expr, jl_codectx_t *ctx, bool isboxed, b
 extern "C" jl_svec_t *jl_svec_tvars_to_symbols(jl_svec_t *t);
 
 // gc frame emission
+// load from the safepoint page, which faults while a collection waits for
+// this thread (see gc.c). the loops poll on their back-edges too, which
+// LoopSafepoint adds once the loop vectorizer is done with them
+static void emit_gc_safepoint(jl_codectx_t *ctx)
+{
+#ifdef JULIA_ENABLE_THREADING
+    Value *page = tbaa_decorate(tbaa_const,
+                                builder.CreateLoad(prepare_global(jlsafepoint_page_var)));
+    // keeps the stores to the gc frame ahead of the load, for a collection
+    // started from the fault (the volatile load alone only orders volatiles)
+    builder.CreateFence(SequentiallyConsistent, SingleThread);
+    builder.CreateLoad(page, true);
+#endif
+}
+
 static void allocate_gc_frame(size_t n_roots, BasicBlock *b0, jl_codectx_t *ctx)
 {
     // allocate a placeholder gc frame
@@ -4119,6 +4999,10 @@ static Function *gen_cfun_wrapper(jl_function_t *ff, jl_value_t *jlrettype, jl_t
     ctx.linfo = lam;
     ctx.sret = false;
     allocate_gc_frame(0, b0, &ctx);
+#ifdef JULIA_ENABLE_THREADING
+    // the caller may be in a gc safe region, e.g. a callback of uv_run
+    Value *gc_state = builder.CreateCall(prepare_call(gcunsafeenter_func));
+#endif
 
     // Save the Function object reference
     int len = (list ? list->len : 0) + 1;
@@ -4285,6 +5169,9 @@ static Function *gen_cfun_wrapper(jl_function_t *ff, jl_value_t *jlrettype, jl_t
         sret = true;
     }
 
+#ifdef JULIA_ENABLE_THREADING
+    builder.CreateCall(prepare_call(gcstaterestore_func), gc_state);
+#endif
     if (sret)
         builder.CreateRetVoid();
     else
@@ -4515,6 +5402,7 @@ static void emit_function(jl_lambda_info_t *lam, jl_llvm_functions_t *declaratio
     // determine which vars need to be volatile
     jl_array_t *stmts = jl_lam_body(ast)->args;
     mark_volatile_vars(stmts, ctx.vars);
+    find_scalar_replaceable(stmts, &ctx);
 
     // step 4. determine function signature
     jl_value_t *jlrettype = jl_ast_rettype(lam, (jl_value_t*)ast);
@@ -4620,6 +5508,17 @@ static void emit_function(jl_lambda_info_t *lam, jl_llvm_functions_t *declaratio
 
 #ifdef JL_DEBUG_BUILD
     f->addFnAttr(Attribute::StackProtectReq);
+#endif
+    if (!imaging_mode && jl_options.opt_level == 0) {
+        if (fwrap)
+            mark_cheap_to_optimize(fwrap);
+        if (!has_backward_branch(stmts))
+            mark_cheap_to_optimize(f);
+    }
+#ifndef USE_ORCJIT
+    // keeps @noinline functions out of line in inline_batch_calls
+    if (has_meta(stmts, jl_symbol("noinline")))
+        f->addFnAttr(Attribute::NoInline);
 #endif
     ctx.f = f;
 
@@ -4957,6 +5856,7 @@ static void emit_function(jl_lambda_info_t *lam, jl_llvm_functions_t *declaratio
     // create SAvalue locations for GenSym objects
     ctx.gensym_assigned.assign(n_gensyms, false);
     ctx.gensym_SAvalues.assign(n_gensyms, jl_cgval_t());
+    assign_gensym_colors(stmts, n_gensyms, &ctx);
 
     // fetch env out of function object if we need it
     if (hasCapt) {
@@ -4977,6 +5877,7 @@ static void emit_function(jl_lambda_info_t *lam, jl_llvm_functions_t *declaratio
 
     // step 8. set up GC frame
     allocate_gc_frame(n_roots, b0, &ctx);
+    emit_gc_safepoint(&ctx);
 
     // get pointers for locals stored in the gc frame array (argTemp)
     int varnum = 0;
@@ -5199,6 +6100,27 @@ static void emit_function(jl_lambda_info_t *lam, jl_llvm_functions_t *declaratio
     bool prevlabel = false;
     lno = -1;
     int prevlno = -1;
+    logblock_t *coverage = NULL, *malloclog = NULL;
+    if (do_coverage || do_malloc_log) {
+        // a line visits one counter, so there are at most as many as there
+        // are line nodes
+        size_t nlines = 0;
+        for(i=0; i < stmtslen; i++) {
+            jl_value_t *stmt = jl_cellref(stmts,i);
+            if (jl_is_linenode(stmt) ||
+                (jl_is_expr(stmt) && ((jl_expr_t*)stmt)->head == line_sym))
+                nlines++;
+        }
+        if (nlines > 0) {
+            if (do_coverage)
+                coverage = newLogBlock(coverageData, nlines, "lcnt");
+            if (do_malloc_log)
+                malloclog = newLogBlock(mallocData, nlines, "bytecnt");
+        }
+        else {
+            do_coverage = do_malloc_log = false;
+        }
+    }
     for(i=0; i < stmtslen; i++) {
         jl_value_t *stmt = jl_cellref(stmts,i);
         if (jl_is_linenode(stmt) ||
@@ -5270,7 +6192,7 @@ static void emit_function(jl_lambda_info_t *lam, jl_llvm_functions_t *declaratio
                 builder.SetCurrentDebugLocation(loc);
             }
             if (do_coverage)
-                coverageVisitLine(filename, lno);
+                coverageVisitLine(coverage, filename, lno);
         }
         if (jl_is_labelnode(stmt)) {
             if (prevlabel) continue;
@@ -5285,7 +6207,7 @@ static void emit_function(jl_lambda_info_t *lam, jl_llvm_functions_t *declaratio
                 (jl_is_expr(stmt) && ((jl_expr_t*)stmt)->head == goto_ifnot_sym) ||
                 jl_is_gotonode(stmt)) {
                 if (prevlno != -1)
-                    mallocVisitLine(filename, prevlno);
+                    mallocVisitLine(malloclog, filename, prevlno);
                 prevlno = lno;
             }
         }
@@ -5313,7 +6235,7 @@ static void emit_function(jl_lambda_info_t *lam, jl_llvm_functions_t *declaratio
                 retval = NULL;
             }
             if (do_malloc_log && lno != -1)
-                mallocVisitLine(filename, lno);
+                mallocVisitLine(malloclog, filename, lno);
             if (ctx.sret)
                 builder.CreateStore(retval, &*ctx.f->arg_begin());
             if (type_is_ghost(retty) || ctx.sret)
@@ -5332,6 +6254,10 @@ static void emit_function(jl_lambda_info_t *lam, jl_llvm_functions_t *declaratio
     }
 
     builder.SetCurrentDebugLocation(noDbg);
+    if (coverage)
+        logBlockDone(coverage);
+    if (malloclog)
+        logBlockDone(malloclog);
 
     // sometimes we have dangling labels after the end
     if (builder.GetInsertBlock()->getTerminator() == NULL) {
@@ -5375,6 +6301,12 @@ static void emit_function(jl_lambda_info_t *lam, jl_llvm_functions_t *declaratio
         ctx.dbuilder->finalize();
     }
 
+    // without declarations the function is only emitted to be shown
+    if (declarations == NULL) {
+        callsite_cache_free.insert(callsite_cache_free.end(),
+                                   ctx.callsite_caches.begin(), ctx.callsite_caches.end());
+    }
+
     JL_GC_POP();
 
     return;
@@ -5411,7 +6343,7 @@ static Function *jlcall_func_to_llvm(const std::string &cname, void *addr, Modul
     return f;
 }
 
-extern "C" void jl_fptr_to_llvm(void *fptr, jl_lambda_info_t *lam, int specsig)
+extern "C" void jl_fptr_to_llvm(void *fptr, jl_lambda_info_t *lam, int specsig, jl_value_t *rettype)
 {
     if (imaging_mode) {
         if (!specsig) {
@@ -5424,7 +6356,7 @@ extern "C" void jl_fptr_to_llvm(void *fptr, jl_lambda_info_t *lam, int specsig)
         funcName = "julia_" + funcName;
         if (specsig) { // assumes !va
             std::vector<Type*> fsig(0);
-            jl_value_t *jlrettype = jl_ast_rettype(lam, (jl_value_t*)lam->ast);
+            jl_value_t *jlrettype = rettype ? rettype : jl_ast_rettype(lam, (jl_value_t*)lam->ast);
             bool retboxed;
             Type *rt;
             if (jlrettype == (jl_value_t*)jl_void_type) {
@@ -5643,6 +6575,13 @@ static void init_julia_llvm_env(Module *m)
                            true, GlobalVariable::ExternalLinkage,
                            NULL, "jl_RTLD_DEFAULT_handle");
     add_named_global(jlRTLD_DEFAULT_var, (void*)&jl_RTLD_DEFAULT_handle);
+#ifdef JULIA_ENABLE_THREADING
+    jlsafepoint_page_var =
+        new GlobalVariable(*m, T_psize,
+                           true, GlobalVariable::ExternalLinkage,
+                           NULL, "jl_gc_safepoint_page");
+    add_named_global(jlsafepoint_page_var, (void*)&jl_gc_safepoint_page);
+#endif
 #ifdef _OS_WINDOWS_
     jlexe_var =
         new GlobalVariable(*m, T_pint8,
@@ -5677,7 +6616,8 @@ static void init_julia_llvm_env(Module *m)
     // For threading, we emit a call to the getter function.
     // In non-imaging mode, (i.e. the code will not be saved to disk), we
     // use the address of the actual getter function directly
-    // (`jl_tls_states_cb` returned by `jl_get_ptls_states_getter()`)
+    // (`jl_tls_states_cb` returned by `jl_get_ptls_states_getter()`, or with
+    // CODEGEN_TLS, `jl_get_ptls_states` reading the initial-exec TLS directly)
     // In imaging mode, we emit the function address as a load of a static
     // variable to be filled (in `dump.c`) at initialization time of the sysimg.
     // This way we can by pass the extra indirection in `jl_get_ptls_states`
@@ -5841,6 +6781,27 @@ static void init_julia_llvm_env(Module *m)
                          "jl_get_binding_or_error", m);
     add_named_global(jlgetbindingorerror_func, (void*)&jl_get_binding_or_error);
 
+    jlrunpendinginit_func =
+        Function::Create(FunctionType::get(T_void, args_1ptr, false),
+                         Function::ExternalLinkage,
+                         "jl_module_run_pending_initializer", m);
+    add_named_global(jlrunpendinginit_func, (void*)&jl_module_run_pending_initializer);
+
+#ifdef JULIA_ENABLE_THREADING
+    gcunsafeenter_func =
+        Function::Create(FunctionType::get(T_int8, false),
+                         Function::ExternalLinkage,
+                         "jl_gc_unsafe_enter", m);
+    add_named_global(gcunsafeenter_func, (void*)&jl_gc_unsafe_enter);
+    std::vector<Type*> args_int8(0);
+    args_int8.push_back(T_int8);
+    gcstaterestore_func =
+        Function::Create(FunctionType::get(T_void, args_int8, false),
+                         Function::ExternalLinkage,
+                         "jl_gc_state_restore", m);
+    add_named_global(gcstaterestore_func, (void*)&jl_gc_state_restore);
+#endif
+
     jlpref_func = Function::Create(FunctionType::get(T_pjlvalue, two_pvalue_llvmt, false),
                             Function::ExternalLinkage,
                             "jl_pointerref", m);
@@ -5877,6 +6838,16 @@ static void init_julia_llvm_env(Module *m)
     jlgetfield_func = builtin_func_map[jl_f_get_field];
     jlapplygeneric_func = jlcall_func_to_llvm("jl_apply_generic", (void*)&jl_apply_generic, m);
 
+    std::vector<Type*> cachedargs(0);
+    cachedargs.push_back(T_pjlvalue);
+    cachedargs.push_back(T_ppjlvalue);
+    cachedargs.push_back(T_int32);
+    cachedargs.push_back(T_pint8);
+    jlapplycached_func = Function::Create(FunctionType::get(T_pjlvalue, cachedargs, false),
+                                          Function::ExternalLinkage,
+                                          "jl_apply_generic_cached", m);
+    add_named_global(jlapplycached_func, (void*)&jl_apply_generic_cached);
+
     jltypeassert_func = Function::Create(FunctionType::get(T_void, two_pvalue_llvmt, false),
                                         Function::ExternalLinkage,
                                         "jl_typeassert", m);
@@ -5887,6 +6858,11 @@ static void init_julia_llvm_env(Module *m)
                                     "jl_gc_queue_root", m);
     add_named_global(queuerootfun, (void*)&jl_gc_queue_root);
 
+    queueslotfun = Function::Create(FunctionType::get(T_void, args_2ptrs, false),
+                                    Function::ExternalLinkage,
+                                    "jl_gc_queue_slot", m);
+    add_named_global(queueslotfun, (void*)&jl_gc_queue_slot);
+
     std::vector<Type *> exp_args(0);
     exp_args.push_back(T_int1);
     expect_func = Intrinsic::getDeclaration(m, Intrinsic::expect, exp_args);
@@ -6083,6 +7059,18 @@ static void init_julia_llvm_env(Module *m)
                          "jl_get_nth_field_checked", m);
     add_named_global(jlgetnthfieldchecked_func, (void*)*jl_get_nth_field_checked);
 
+    std::vector<Type *> apply2va_args(0);
+    apply2va_args.push_back(T_pjlvalue);
+    apply2va_args.push_back(T_ppjlvalue);
+    apply2va_args.push_back(T_int32);
+    apply2va_args.push_back(T_ppjlvalue);
+    apply2va_args.push_back(T_int32);
+    jlapply2va_func =
+        Function::Create(FunctionType::get(T_pjlvalue, apply2va_args, false),
+                         Function::ExternalLinkage,
+                         "jl_apply_2va", m);
+    add_named_global(jlapply2va_func, (void*)&jl_apply_2va);
+
     diff_gc_total_bytes_func =
         Function::Create(FunctionType::get(T_int64, false),
                          Function::ExternalLinkage,
@@ -6112,8 +7100,12 @@ static void init_julia_llvm_env(Module *m)
     // set up optimization passes
 #ifdef LLVM38
     FPM = new legacy::FunctionPassManager(m);
+    FPMCheap = new legacy::FunctionPassManager(m);
 #else
     FPM = new FunctionPassManager(m);
+#ifdef LLVM37
+    FPMCheap = new FunctionPassManager(m);
+#endif
 #endif
 
 #ifdef LLVM37
@@ -6131,6 +7123,10 @@ static void init_julia_llvm_env(Module *m)
 #endif
     addOptimizationPasses(FPM);
     FPM->doInitialization();
+#ifdef LLVM37
+    addOptimizationPasses(FPMCheap, true);
+    FPMCheap->doInitialization();
+#endif
 }
 
 // Helper to figure out what features to set for the LLVM target
@@ -6138,7 +7134,8 @@ static void init_julia_llvm_env(Module *m)
 // using the API provided by LLVM
 static inline SmallVector<std::string,10> getTargetFeatures() {
   StringMap<bool> HostFeatures;
-  if( !strcmp(jl_options.cpu_target,"native") )
+  std::string target = jl_cpu_target_base();
+  if (target == "native")
   {
     // On earlier versions of LLVM this is empty
     llvm::sys::getHostCPUFeatures(HostFeatures);
@@ -6157,7 +7154,7 @@ static inline SmallVector<std::string,10> getTargetFeatures() {
 #endif
 
   // Figure out if we know the cpu_target
-  std::string cpu = strcmp(jl_options.cpu_target,"native") ? jl_options.cpu_target : sys::getHostCPUName();
+  std::string cpu = target != "native" ? target : sys::getHostCPUName();
   if (cpu.empty() || cpu == "generic") {
     jl_printf(JL_STDERR, "WARNING: unable to determine host cpu name.\n");
 #ifdef _CPU_ARM_
@@ -6177,6 +7174,25 @@ static inline SmallVector<std::string,10> getTargetFeatures() {
   return attr;
 }
 
+// can code compiled for `cpu` run on the host? (see jl_gen_sysimg_clones)
+extern "C" int jl_host_supports_cpu(const char *cpu)
+{
+#ifdef LLVM37
+    std::string features;
+    if (!jl_host_cpu_features(features))
+        return 0;
+    std::string triple = jl_TargetMachine->getTargetTriple().str();
+    const Target &T = jl_TargetMachine->getTarget();
+    std::unique_ptr<MCSubtargetInfo> need(T.createMCSubtargetInfo(triple, cpu, ""));
+    std::unique_ptr<MCSubtargetInfo> host(T.createMCSubtargetInfo(triple, sys::getHostCPUName(), features));
+    if (!need || !host)
+        return 0;
+    return (need->getFeatureBits() & ~host->getFeatureBits()).none();
+#else
+    return 0;
+#endif
+}
+
 extern "C" void jl_init_debuginfo(void);
 
 extern "C" void jl_init_codegen(void)
@@ -6196,6 +7212,14 @@ extern "C" void jl_init_codegen(void)
 #else
     imaging_mode = jl_generating_output();
 #endif
+    const char *covmode = getenv(COVERAGE_MODE_NAME);
+    coverage_once = covmode != NULL && !strcmp(covmode, "once");
+    const char *feedback = getenv(TYPE_FEEDBACK_NAME);
+    // the interpreter records the feedback without locking, so it is only
+    // gathered with one thread
+    jl_type_feedback = feedback != NULL && strtol(feedback, NULL, 10) != 0 &&
+        jl_options.compile_enabled == JL_OPTIONS_COMPILE_TIERED && !imaging_mode &&
+        jl_n_threads == 1;
     jl_init_debuginfo();
 
 #ifndef LLVM34
@@ -6303,7 +7327,9 @@ extern "C" void jl_init_codegen(void)
     TheTriple.setEnvironment(Triple::ELF);
 #endif
 #endif
-    std::string TheCPU = strcmp(jl_options.cpu_target,"native") ? jl_options.cpu_target : sys::getHostCPUName();
+    std::string TheCPU = jl_cpu_target_base();
+    if (TheCPU == "native")
+        TheCPU = sys::getHostCPUName();
     SmallVector<std::string, 10>  targetFeatures = getTargetFeatures( );
     jl_TargetMachine = eb.selectTarget(
             TheTriple,
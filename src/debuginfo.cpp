@@ -173,6 +173,34 @@ static void create_PRUNTIME_FUNCTION(uint8_t *Code, size_t Size, StringRef fnnam
 }
 #endif
 
+#ifdef _OS_LINUX_
+extern "C" char *jl_demangle(const char *name);
+
+// Append a line for a function to /tmp/perf-<pid>.map, which is how perf
+// names the code of a process that isn't backed by a file
+static FILE *perf_map_file = NULL;
+static void jl_perf_map_write(uint64_t Addr, uint64_t Size, StringRef sName)
+{
+    if (!jl_using_perf_jitevents)
+        return;
+    if (perf_map_file == NULL) {
+        char fname[64];
+        snprintf(fname, sizeof(fname), "/tmp/perf-%d.map", (int)getpid());
+        perf_map_file = fopen(fname, "w");
+        if (perf_map_file == NULL) {
+            jl_printf(JL_STDERR, "WARNING: could not open %s for writing\n", fname);
+            jl_using_perf_jitevents = 0;
+            return;
+        }
+    }
+    char *name = jl_demangle(sName.str().c_str());
+    fprintf(perf_map_file, "%" PRIx64 " %" PRIx64 " %s\n", Addr, Size, name);
+    // perf may read the map while we run, or after we crash
+    fflush(perf_map_file);
+    free(name);
+}
+#endif
+
 struct revcomp {
     bool operator() (const size_t& lhs, const size_t& rhs) const
     { return lhs>rhs; }
@@ -309,6 +337,9 @@ public:
 #endif // defined(_OS_WINDOWS_)
 
 #ifdef LLVM37
+        // all functions of an object share one copy of its load information;
+        // the DWARF context is only built from it when a lookup needs it
+        const llvm::LoadedObjectInfo *SharedL = NULL;
         auto symbols = object::computeSymbolSizes(obj);
         for(const auto &sym_size : symbols) {
             const object::SymbolRef &sym_iter = sym_size.first;
@@ -345,7 +376,12 @@ public:
                    (uint8_t*)(intptr_t)Addr, (size_t)Size, sName,
                    (uint8_t*)(intptr_t)SectionAddr, (size_t)SectionSize, UnwindData);
 #endif
-            ObjectInfo tmp = {&debugObj, (size_t)Size, L.clone().release()};
+#ifdef _OS_LINUX_
+            jl_perf_map_write(Addr, Size, sym_iter.getName().get());
+#endif
+            if (SharedL == NULL)
+                SharedL = L.clone().release();
+            ObjectInfo tmp = {&debugObj, (size_t)Size, SharedL};
             objectmap[Addr] = tmp;
         }
 
@@ -415,6 +451,11 @@ public:
             create_PRUNTIME_FUNCTION(
                    (uint8_t*)(intptr_t)Addr, (size_t)Size, sName,
                    (uint8_t*)(intptr_t)SectionAddr, (size_t)SectionSize, UnwindData);
+#endif
+#ifdef _OS_LINUX_
+            StringRef symName;
+            sym_iter.getName(symName);
+            jl_perf_map_write(Addr, Size, symName);
 #endif
             const object::ObjectFile *objfile =
 #ifdef LLVM36
@@ -91,6 +91,8 @@ JL_DLLEXPORT void* jl_dlopen(const char *filename, unsigned flags)
 
 JL_DLLEXPORT int jl_dlclose(void *handle)
 {
+    if (handle)
+        jl_dlsym_cache_forget(handle);
 #ifdef _OS_WINDOWS_
     if (!handle) return -1;
     return FreeLibrary((HMODULE) handle);
@@ -101,6 +103,76 @@ JL_DLLEXPORT int jl_dlclose(void *handle)
 #endif
 }
 
+// the names libraries were found by, so that loading a library again takes
+// a single dlopen instead of probing every directory of DL_LOAD_PATH with
+// every extension. names that weren't found aren't remembered: the library
+// can be installed, or its directory created, between two lookups. the
+// entries are made for one value of DL_LOAD_PATH and ignored once it changes.
+typedef struct _dlcache_entry_t {
+    struct _dlcache_entry_t *next;
+    uint64_t loadpath;  // dl_load_path_key of DL_LOAD_PATH
+    char *path;         // what dlopen found the library by
+    char modname[];
+} dlcache_entry_t;
+
+#define DLCACHE_SIZE 64
+static dlcache_entry_t *dlcache[DLCACHE_SIZE];
+JL_DEFINE_MUTEX(dlcache)
+
+static uint64_t dl_load_path_key(jl_array_t *DL_LOAD_PATH)
+{
+    if (DL_LOAD_PATH == NULL)
+        return 0;
+    size_t j, n = jl_array_len(DL_LOAD_PATH);
+    uint64_t h = int64hash(n + 1);
+    for (j = 0; j < n; j++) {
+        jl_value_t *s = jl_cell_data(DL_LOAD_PATH)[j];
+        h = memhash_seed(jl_string_data(s), jl_string_len(s), (uint32_t)h) ^ (h >> 32);
+    }
+    return h;
+}
+
+static dlcache_entry_t **dlcache_slot(const char *modname)
+{
+    dlcache_entry_t **pe = &dlcache[memhash(modname, strlen(modname)) % DLCACHE_SIZE];
+    while (*pe != NULL && strcmp((*pe)->modname, modname) != 0)
+        pe = &(*pe)->next;
+    return pe;
+}
+
+// returns 1 if the cache knows modname, with in *path what to dlopen
+static int dlcache_lookup(const char *modname, uint64_t loadpath, char *path)
+{
+    int known = 0;
+    JL_LOCK(dlcache);
+    dlcache_entry_t *e = *dlcache_slot(modname);
+    if (e != NULL && e->loadpath == loadpath) {
+        known = 1;
+        snprintf(path, PATHBUF, "%s", e->path);
+    }
+    JL_UNLOCK(dlcache);
+    return known;
+}
+
+static void dlcache_store(const char *modname, uint64_t loadpath, const char *path)
+{
+    JL_LOCK(dlcache);
+    dlcache_entry_t **pe = dlcache_slot(modname);
+    dlcache_entry_t *e = *pe;
+    if (e == NULL) {
+        size_t len = strlen(modname);
+        e = (dlcache_entry_t*)malloc(sizeof(dlcache_entry_t) + len + 1);
+        memcpy(e->modname, modname, len + 1);
+        e->next = NULL;
+        e->path = NULL;
+        *pe = e;
+    }
+    free(e->path);
+    e->path = strdup(path);
+    e->loadpath = loadpath;
+    JL_UNLOCK(dlcache);
+}
+
 static void *jl_load_dynamic_library_(const char *modname, unsigned flags, int throw_err)
 {
     char *ext;
@@ -108,6 +180,10 @@ static void *jl_load_dynamic_library_(const char *modname, unsigned flags, int t
     int i;
     uv_stat_t stbuf;
     void *handle;
+    // whether the outcome of the search goes into dlcache; whether a library
+    // is already loaded is not a property of its name
+    int cacheable = !(flags & JL_RTLD_NOLOAD);
+    uint64_t loadpath = 0;
 
 /*
     this branch returns handle of libjulia
@@ -132,6 +208,7 @@ static void *jl_load_dynamic_library_(const char *modname, unsigned flags, int t
 #else
     else if (modname[0] == '/') {
 #endif
+        cacheable = 0;
         handle = jl_dlopen(modname, flags);
         if (handle)
             goto done;
@@ -143,8 +220,20 @@ static void *jl_load_dynamic_library_(const char *modname, unsigned flags, int t
     this branch permutes all base paths in DL_LOAD_PATH with all extensions
     note: skip when !jl_base_module to avoid UndefVarError(:DL_LOAD_PATH)
 */
-    else if (jl_base_module != NULL) {
-        jl_array_t *DL_LOAD_PATH = (jl_array_t*)jl_get_global(jl_base_module, jl_symbol("DL_LOAD_PATH"));
+    else {
+        jl_array_t *DL_LOAD_PATH = NULL;
+        // relative paths depend on the working directory
+        if (strchr(modname, '/') != NULL || strchr(modname, PATHSEPSTRING[0]) != NULL)
+            cacheable = 0;
+        if (jl_base_module != NULL)
+            DL_LOAD_PATH = (jl_array_t*)jl_get_global(jl_base_module, jl_symbol("DL_LOAD_PATH"));
+        loadpath = dl_load_path_key(DL_LOAD_PATH);
+        if (cacheable && dlcache_lookup(modname, loadpath, path)) {
+            handle = jl_dlopen(path, flags);
+            if (handle)
+                return handle;
+            // the file is gone, search again
+        }
         if (DL_LOAD_PATH != NULL) {
             size_t j;
             for (j = 0; j < jl_array_len(DL_LOAD_PATH); j++) {
@@ -162,7 +251,7 @@ static void *jl_load_dynamic_library_(const char *modname, unsigned flags, int t
                         snprintf(path, PATHBUF, "%s" PATHSEPSTRING "%s%s", dl_path, modname, ext);
                     handle = jl_dlopen(path, flags);
                     if (handle)
-                        goto done;
+                        goto found;
                     // bail out and show the error if file actually exists
                     if (jl_stat(path, (char*)&stbuf) == 0)
                         goto notfound;
@@ -179,7 +268,7 @@ static void *jl_load_dynamic_library_(const char *modname, unsigned flags, int t
         snprintf(path, PATHBUF, "%s%s", modname, ext);
         handle = jl_dlopen(path, flags);
         if (handle)
-            goto done;
+            goto found;
     }
 
 #if defined(__linux__) || defined(__FreeBSD__)
@@ -188,8 +277,10 @@ static void *jl_load_dynamic_library_(const char *modname, unsigned flags, int t
         const char *soname = jl_lookup_soname(modname, strlen(modname));
         if (soname) {
             handle = jl_dlopen(soname, flags);
-            if (handle)
-                goto done;
+            if (handle) {
+                snprintf(path, PATHBUF, "%s", soname);
+                goto found;
+            }
         }
     }
 #endif
@@ -199,6 +290,9 @@ notfound:
         jl_dlerror("could not load library \"%s\"\n%s", modname);
     return NULL;
 
+found:
+    if (cacheable)
+        dlcache_store(modname, loadpath, path);
 done:
     return handle;
 }
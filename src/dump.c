@@ -13,6 +13,9 @@
 
 #ifndef _OS_WINDOWS_
 #include <dlfcn.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #endif
 
 #ifndef _COMPILER_MICROSOFT_
@@ -84,6 +87,12 @@ static const jl_fptr_t id_to_fptrs[] = {
 // pointers to non-AST-ish objects in a compressed tree
 static jl_array_t *tree_literal_values=NULL;    // (only used in MODE_AST)
 static jl_module_t *tree_enclosing_module=NULL; // (only used in MODE_AST)
+// symbols of the tree being compressed, each one is written out in full only
+// the first time and as AstSymRef_tag plus its index after that. the
+// serializer maps them to their index + 1, the deserializer lists them
+static htable_t *tree_symbol_table=NULL;       // (only used in MODE_AST)
+static size_t tree_nsymbols=0;
+static arraylist_t *tree_symbol_list=NULL;     // (only used in MODE_AST)
 
 static const ptrint_t LongSymbol_tag   = 23;
 static const ptrint_t LongSvec_tag     = 24;
@@ -96,6 +105,7 @@ static const ptrint_t Array1d_tag      = 30;
 static const ptrint_t Singleton_tag    = 31;
 static const ptrint_t CommonSym_tag    = 32;
 static const ptrint_t NearbyGlobal_tag = 33;  // a GlobalRef pointing to tree_enclosing_module
+static const ptrint_t AstSymRef_tag    = 34;  // a symbol seen earlier in the same tree
 static const ptrint_t Null_tag         = 253;
 static const ptrint_t ShortBackRef_tag = 254;
 static const ptrint_t BackRef_tag      = 255;
@@ -128,6 +138,13 @@ static jl_value_t *jl_idtable_type=NULL;
 // queue of types to cache
 static jl_array_t *datatype_list=NULL; // (only used in MODE_SYSTEM_IMAGE)
 
+// the system image or cache file being restored, when it stays mapped (and
+// writable) for the lifetime of the process so that arrays can reference
+// its data. mapped_nshared counts the arrays that do.
+static char *mapped_buf=NULL;
+static size_t mapped_buflen=0;
+static size_t mapped_nshared=0;
+
 #define write_uint8(s, n) ios_putc((n), (s))
 #define read_uint8(s) ((uint8_t)ios_getc(s))
 #define write_int8(s, n) write_uint8(s, n)
@@ -220,6 +237,65 @@ JL_DLLEXPORT int jl_running_on_valgrind(void)
     return RUNNING_ON_VALGRIND;
 }
 
+#ifdef HAVE_CPUID
+// is the first of the comma separated targets `name`?
+static int jl_cpu_target_is(const char *targets, const char *name)
+{
+    size_t len = strcspn(targets, ",");
+    return len == strlen(name) && strncmp(targets, name, len) == 0;
+}
+#endif
+
+// was the system image built on a host with the same cpuid? (for the
+// "native" targets)
+static int jl_sysimg_cpuid_matches(void)
+{
+#ifdef HAVE_CPUID
+    uint32_t info[4];
+    jl_cpuid((int32_t*)info, 1);
+    uint64_t *saved_cpuid = (uint64_t*)jl_dlsym_e(jl_sysimg_handle, "jl_sysimg_cpu_cpuid");
+    return saved_cpuid != NULL &&
+        *saved_cpuid == (((uint64_t)info[2])|(((uint64_t)info[3])<<32));
+#else
+    return 0;
+#endif
+}
+
+// use the functions compiled for the last of the extra cpu targets of the
+// system image that the host supports (see jl_gen_sysimg_clones)
+static void jl_select_sysimg_clone(const char *targets)
+{
+    char cpu[128], name[64];
+    int n = 0, best = 0;
+    const char *p = targets;
+    while (*p) {
+        size_t len = strcspn(p, ",");
+        if (len > 0) {
+            n++;
+            if (len < sizeof(cpu)) {
+                memcpy(cpu, p, len);
+                cpu[len] = '\0';
+                // valgrind does not support all the instructions of the host
+                if (strcmp(cpu, "native") == 0 ?
+                    !RUNNING_ON_VALGRIND && jl_sysimg_cpuid_matches() :
+                    jl_host_supports_cpu(cpu))
+                    best = n;
+            }
+        }
+        p += len;
+        if (*p == ',')
+            p++;
+    }
+    if (best > 0) {
+        snprintf(name, sizeof(name), "jl_sysimg_fvars_%d", best);
+        void **fvars = (void**)jl_dlsym_e(jl_sysimg_handle, name);
+        if (fvars != NULL)
+            sysimg_fvars = fvars;
+    }
+}
+
+static void jl_restore_system_image_buffer(char *buf, size_t len, int keep);
+
 static int jl_load_sysimg_so(void)
 {
 #ifndef _OS_WINDOWS_
@@ -248,20 +324,20 @@ static int jl_load_sysimg_so(void)
 #ifdef HAVE_CPUID
         uint32_t info[4];
         jl_cpuid((int32_t*)info, 1);
-        if (strcmp(cpu_target, "native") == 0) {
-            if (!RUNNING_ON_VALGRIND) {
-                uint64_t saved_cpuid = *(uint64_t*)jl_dlsym(jl_sysimg_handle, "jl_sysimg_cpu_cpuid");
-                if (saved_cpuid != (((uint64_t)info[2])|(((uint64_t)info[3])<<32)))
-                    jl_error("Target architecture mismatch. Please delete or regenerate sys.{so,dll,dylib}.");
-            }
+        if (jl_cpu_target_is(cpu_target, "native")) {
+            if (!RUNNING_ON_VALGRIND && !jl_sysimg_cpuid_matches())
+                jl_error("Target architecture mismatch. Please delete or regenerate sys.{so,dll,dylib}.");
         }
-        else if (strcmp(cpu_target,"core2") == 0) {
+        else if (jl_cpu_target_is(cpu_target, "core2")) {
             int HasSSSE3 = (info[2] & 1<<9);
             if (!HasSSSE3)
                 jl_error("The current host does not support SSSE3, but the system image was compiled for Core2.\n"
                          "Please delete or regenerate sys.{so,dll,dylib}.");
         }
 #endif
+        const char *clones = (const char*)jl_dlsym_e(jl_sysimg_handle, "jl_sysimg_clone_targets");
+        if (clones != NULL)
+            jl_select_sysimg_clone(clones);
 
 #ifdef _OS_WINDOWS_
         jl_sysimage_base = (intptr_t)jl_sysimg_handle;
@@ -277,7 +353,8 @@ static int jl_load_sysimg_so(void)
     const char *sysimg_data = (const char*)jl_dlsym_e(jl_sysimg_handle, "jl_system_image_data");
     if (sysimg_data) {
         size_t len = *(size_t*)jl_dlsym(jl_sysimg_handle, "jl_system_image_size");
-        jl_restore_system_image_data(sysimg_data, len);
+        // the image data is writable and stays loaded with the library
+        jl_restore_system_image_buffer((char*)sysimg_data, len, 1);
         return 0;
     }
     return -1;
@@ -330,16 +407,16 @@ static void jl_serialize_gv_syms(ios_t *s, jl_sym_t *v)
 {
     // since symbols are static, they might not have had a
     // reference anywhere in the code image other than here
-    void *bp = ptrhash_get(&backref_table, v);
-    if (bp == HT_NOTFOUND) {
-        int32_t gv = jl_get_llvm_gv((jl_value_t*)v);
-        if (gv != 0) {
-            jl_serialize_value(s, v);
-            write_int32(s, gv);
+    for (; v != NULL; v = v->right) {
+        void *bp = ptrhash_get(&backref_table, v);
+        if (bp == HT_NOTFOUND) {
+            int32_t gv = jl_get_llvm_gv((jl_value_t*)v);
+            if (gv != 0) {
+                jl_serialize_value(s, v);
+                write_int32(s, gv);
+            }
         }
     }
-    if (v->left) jl_serialize_gv_syms(s, v->left);
-    if (v->right) jl_serialize_gv_syms(s, v->right);
 }
 
 static void jl_serialize_gv_others(ios_t *s)
@@ -361,7 +438,7 @@ static void jl_serialize_gv_others(ios_t *s)
             }
         }
     }
-    for (i = -512; i < 512; i++) {
+    for (i = -NBOX_INT64_C/2; i < NBOX_INT64_C/2; i++) {
         jl_value_t *v64 = jl_box_int64(i);
         void *bp64 = ptrhash_get(&backref_table, v64);
         if (bp64 == HT_NOTFOUND) {
@@ -389,14 +466,19 @@ struct delayed_fptrs_t {
     jl_lambda_info_t *li;
     int32_t func;
     int32_t cfunc;
+    jl_value_t *rettype; // return type of the specsig cfunc, saved with the image
 } *delayed_fptrs = NULL;
 static size_t delayed_fptrs_n = 0;
 static size_t delayed_fptrs_max = 0;
 
-static void jl_delayed_fptrs(jl_lambda_info_t *li, int32_t func, int32_t cfunc)
+static void jl_delayed_fptrs(jl_lambda_info_t *li, int32_t func, int32_t cfunc,
+                             jl_value_t *rettype)
 {
     // can't restore the fptrs until after the system image is fully restored,
-    // since it will try to decompress the function AST to determine the argument types
+    // since it will try to decompress the function AST to determine the argument types.
+    // there is nothing to restore without native code (and after startup)
+    if (sysimg_fvars == NULL)
+        return;
     if (cfunc || func) {
         if (delayed_fptrs_max < delayed_fptrs_n + 1) {
             if (delayed_fptrs_max == 0)
@@ -409,6 +491,7 @@ static void jl_delayed_fptrs(jl_lambda_info_t *li, int32_t func, int32_t cfunc)
         delayed_fptrs[delayed_fptrs_n].li = li;
         delayed_fptrs[delayed_fptrs_n].func = func;
         delayed_fptrs[delayed_fptrs_n].cfunc = cfunc;
+        delayed_fptrs[delayed_fptrs_n].rettype = rettype;
         delayed_fptrs_n++;
     }
 }
@@ -427,11 +510,11 @@ static void jl_update_all_fptrs(void)
         jl_lambda_info_t *li = delayed_fptrs[i].li;
         int32_t func = delayed_fptrs[i].func-1;
         if (func >= 0) {
-            jl_fptr_to_llvm(fvars[func], li, 0);
+            jl_fptr_to_llvm(fvars[func], li, 0, NULL);
         }
         int32_t cfunc = delayed_fptrs[i].cfunc-1;
         if (cfunc >= 0) {
-            jl_fptr_to_llvm(fvars[cfunc], li, 1);
+            jl_fptr_to_llvm(fvars[cfunc], li, 1, delayed_fptrs[i].rettype);
         }
     }
     delayed_fptrs_n = 0;
@@ -616,6 +699,84 @@ static int is_ast_node(jl_value_t *v)
         jl_is_labelnode(v) || jl_is_linenode(v) || jl_is_globalref(v);
 }
 
+// boxed integers written with SmallInt64_tag or Int32_tag. they have no
+// identity and are as short as a backref, so they never go in the backref
+// table (which holds millions of objects for a system image)
+static int is_int_literal(jl_value_t *v)
+{
+    if (jl_typeis(v, jl_int64_type)) {
+        int64_t n = *(int64_t*)jl_data_ptr(v);
+        return n >= S32_MIN && n <= S32_MAX;
+    }
+    return jl_typeis(v, jl_int32_type);
+}
+
+// compressed ASTs written so far to the image or cache file being saved,
+// by content hash. methods whose inferred code compresses to the same bytes
+// share one array, which is then written (and restored) only once
+static htable_t ast_dedup_table;
+static int ast_dedup_active = 0;
+
+static jl_value_t *jl_dedup_ast(jl_value_t *ast)
+{
+    if (!ast_dedup_active || ast == NULL || !jl_typeis(ast, jl_array_uint8_type))
+        return ast;
+    jl_array_t *a = (jl_array_t*)ast;
+    size_t len = jl_array_len(a);
+    void *key = (void*)(uptrint_t)memhash((const char*)jl_array_data(a), len);
+    void **bp = ptrhash_bp(&ast_dedup_table, key);
+    if (*bp == HT_NOTFOUND) {
+        *bp = a;
+        return ast;
+    }
+    jl_array_t *other = (jl_array_t*)*bp;
+    if (other != a && jl_array_len(other) == len &&
+        memcmp(jl_array_data(other), jl_array_data(a), len) == 0)
+        return (jl_value_t*)other;
+    return ast;
+}
+
+static void jl_dedup_ast_begin(void)
+{
+    htable_new(&ast_dedup_table, 0);
+    ast_dedup_active = 1;
+}
+
+static void jl_dedup_ast_end(void)
+{
+    ast_dedup_active = 0;
+    htable_free(&ast_dedup_table);
+}
+
+// drop from a t-func cache (triples of argument types, tree or return type,
+// and whether it was inferred in a cycle) the entries inferred in a cycle,
+// which are redone when they are looked up, and the entries for the same
+// argument types object as an earlier one. done in place, so the copies of
+// the lambda info sharing the cache keep sharing it (inference checks its
+// index of the cache against it, see tfunc_lookup)
+static void jl_compact_tfunc(jl_array_t *tf)
+{
+    size_t i, n = 0, l = jl_array_len(tf);
+    htable_t seen;
+    htable_new(&seen, l/3);
+    for(i=0; i + 2 < l; i += 3) {
+        jl_value_t *sig = jl_cellref(tf, i);
+        if (jl_cellref(tf, i+2) == jl_true || sig == NULL ||
+            ptrhash_has(&seen, sig))
+            continue;
+        ptrhash_put(&seen, sig, sig);
+        if (n != i) {
+            jl_cellset(tf, n, sig);
+            jl_cellset(tf, n+1, jl_cellref(tf, i+1));
+            jl_cellset(tf, n+2, jl_cellref(tf, i+2));
+        }
+        n += 3;
+    }
+    htable_free(&seen);
+    if (n < l)
+        jl_array_del_end(tf, l - n);
+}
+
 static int literal_val_id(jl_value_t *v)
 {
     for(int i=0; i < jl_array_len(tree_literal_values); i++) {
@@ -654,8 +815,27 @@ static void jl_serialize_value_(ios_t *s, jl_value_t *v)
             write_uint16(s, literal_val_id(v));
             return;
         }
+        if (jl_is_symbol(v) && tree_symbol_table != NULL) {
+            void **bp = ptrhash_bp(tree_symbol_table, v);
+            if (*bp != HT_NOTFOUND) {
+                size_t idx = (char*)*bp - (char*)HT_NOTFOUND - 1;
+                writetag(s, (jl_value_t*)AstSymRef_tag);
+                if (idx < 255) {
+                    write_uint8(s, idx);
+                }
+                else {
+                    write_uint8(s, 255);
+                    write_uint16(s, idx);
+                }
+                return;
+            }
+            // written in full below, every one of them gets an index
+            size_t idx = tree_nsymbols++;
+            if (idx < 65536)
+                *bp = (char*)HT_NOTFOUND + idx + 1;
+        }
     }
-    else {
+    else if (!is_int_literal(v)) {
         bp = ptrhash_bp(&backref_table, v);
         if (*bp != HT_NOTFOUND) {
             uintptr_t pos = (char*)*bp - (char*)HT_NOTFOUND - 1;
@@ -743,6 +923,10 @@ static void jl_serialize_value_(ios_t *s, jl_value_t *v)
         if (!ar->ptrarray) {
             size_t tot = jl_array_len(ar) * ar->elsize;
             ios_write(s, (char*)jl_array_data(ar), tot);
+            // keep byte arrays NUL-terminated in images and cache files,
+            // so they can be restored in place
+            if (mode != MODE_AST && ar->elsize == 1)
+                write_uint8(s, 0);
         }
         else {
             for(i=0; i < jl_array_len(ar); i++) {
@@ -804,6 +988,11 @@ static void jl_serialize_value_(ios_t *s, jl_value_t *v)
     else if (jl_is_lambda_info(v)) {
         writetag(s, jl_lambda_info_type);
         jl_lambda_info_t *li = (jl_lambda_info_t*)v;
+        jl_value_t *ast = jl_dedup_ast(li->ast);
+        if (ast != li->ast) {
+            li->ast = ast;
+            jl_gc_wb(li, ast);
+        }
         jl_serialize_value(s, li->ast);
         jl_serialize_value(s, (jl_value_t*)li->sparams);
         // don't save cached type info for code in the Core module, because
@@ -817,6 +1006,7 @@ static void jl_serialize_value_(ios_t *s, jl_value_t *v)
             // types for abstract argument types. these ASTs are generally
             // not needed (e.g. they don't get inlined).
             if (tf && jl_typeis(tf, jl_array_any_type)) {
+                jl_compact_tfunc(tf);
                 size_t i, l = jl_array_len(tf);
                 for(i=0; i < l; i += 3) {
                     if (!jl_is_leaf_type(jl_cellref(tf,i))) {
@@ -824,6 +1014,10 @@ static void jl_serialize_value_(ios_t *s, jl_value_t *v)
                         if (ast && jl_is_array(ast) && jl_array_len(ast) > 500)
                             jl_cellset(tf, i+1, jl_ast_rettype(li, (jl_value_t*)ast));
                     }
+                    jl_value_t *ast = jl_cellref(tf,i+1);
+                    jl_value_t *shared = jl_dedup_ast(ast);
+                    if (shared != ast)
+                        jl_cellset(tf, i+1, shared);
                 }
             }
             jl_serialize_value(s, (jl_value_t*)li->tfunc);
@@ -843,6 +1037,10 @@ static void jl_serialize_value_(ios_t *s, jl_value_t *v)
         // save functionObject pointers
         write_int32(s, li->functionID);
         write_int32(s, li->specFunctionID);
+        // and the return type of the specsig function, so that restoring
+        // it doesn't need to look into the compressed AST
+        if (mode == MODE_SYSTEM_IMAGE && li->specFunctionID != 0)
+            jl_serialize_value(s, jl_ast_rettype(li, li->ast));
     }
     else if (jl_typeis(v, jl_module_type)) {
         jl_serialize_module(s, (jl_module_t*)v);
@@ -1004,23 +1202,50 @@ static void jl_serialize_mod_list(ios_t *s)
 }
 
 // "magic" string and version header of .ji file
-static const int JI_FORMAT_VERSION = 2;
+static const int JI_FORMAT_VERSION = 7;
 static const char JI_MAGIC[] = "\373jli\r\n\032\n"; // based on PNG signature
 static const uint16_t BOM = 0xFEFF; // byte-order marker
+
+// the header has a fixed size: magic, format version, byte-order marker,
+// pointer size, and a build id hashing the platform and the exact julia
+// build, so it can be checked with a single read and compare
+#define JI_HEADER_SIZE (sizeof(JI_MAGIC)-1 + 2 + 2 + 1 + 8)
+
+static uint64_t jl_build_id(void)
+{
+    static uint64_t id = 0;
+    if (id == 0) {
+        const char *parts[] = { jl_symbol_name(jl_get_OS_NAME()),
+                                jl_symbol_name(jl_get_ARCH()),
+                                JULIA_VERSION_STRING,
+                                jl_git_branch(), jl_git_commit() };
+        uint64_t h = 0;
+        for (size_t i = 0; i < sizeof(parts)/sizeof(parts[0]); i++)
+            h = memhash_seed(parts[i], strlen(parts[i])+1, (uint32_t)(h ^ (h >> 32))) + h;
+        id = h ? h : 1;
+    }
+    return id;
+}
+
+static void jl_header_bytes(char *buf)
+{
+    ios_t s;
+    ios_mem(&s, JI_HEADER_SIZE);
+    ios_write(&s, JI_MAGIC, strlen(JI_MAGIC));
+    write_uint16(&s, JI_FORMAT_VERSION);
+    ios_write(&s, (char *) &BOM, 2);
+    write_uint8(&s, sizeof(void*));
+    write_uint64(&s, jl_build_id());
+    assert(s.size == JI_HEADER_SIZE);
+    memcpy(buf, s.buf, JI_HEADER_SIZE);
+    ios_close(&s);
+}
+
 static void jl_serialize_header(ios_t *s)
 {
-    ios_write(s, JI_MAGIC, strlen(JI_MAGIC));
-    write_uint16(s, JI_FORMAT_VERSION);
-    ios_write(s, (char *) &BOM, 2);
-    write_uint8(s, sizeof(void*));
-    const char *OS_NAME = jl_symbol_name(jl_get_OS_NAME());
-    const char *ARCH = jl_symbol_name(jl_get_ARCH());
-    ios_write(s, OS_NAME, strlen(OS_NAME)+1);
-    ios_write(s, ARCH, strlen(ARCH)+1);
-    ios_write(s, JULIA_VERSION_STRING, strlen(JULIA_VERSION_STRING)+1);
-    const char *branch = jl_git_branch(), *commit = jl_git_commit();
-    ios_write(s, branch, strlen(branch)+1);
-    ios_write(s, commit, strlen(commit)+1);
+    char header[JI_HEADER_SIZE];
+    jl_header_bytes(header);
+    ios_write(s, header, JI_HEADER_SIZE);
 }
 
 // serialize the global _require_dependencies array of pathnames that
@@ -1110,6 +1335,7 @@ static jl_value_t *jl_deserialize_datatype(ios_t *s, int pos, jl_value_t **loc)
     backref_list.items[pos] = dt;
     dt->size = size;
     dt->struct_decl = NULL;
+    dt->fieldindex = NULL;
     dt->instance = NULL;
     dt->ditype = NULL;
     dt->abstract = flags&1;
@@ -1152,6 +1378,7 @@ static jl_value_t *jl_deserialize_datatype(ios_t *s, int pos, jl_value_t **loc)
             dt->alignment = MAX_ALIGN;
         dt->types = jl_emptysvec;
     }
+    dt->bitsequal = dt->pointerfree && !dt->haspadding && !dt->mutabl;
     dt->parameters = (jl_svec_t*)jl_deserialize_value(s, (jl_value_t**)&dt->parameters);
     jl_gc_wb(dt, dt->parameters);
     dt->name = (jl_typename_t*)jl_deserialize_value(s, (jl_value_t**)&dt->name);
@@ -1215,6 +1442,13 @@ static jl_value_t *jl_deserialize_value(ios_t *s, jl_value_t **loc)
     else if (vtag == (jl_value_t*)LiteralVal_tag) {
         return jl_cellref(tree_literal_values, read_uint16(s));
     }
+    else if (vtag == (jl_value_t*)AstSymRef_tag) {
+        size_t idx = read_uint8(s);
+        if (idx == 255)
+            idx = read_uint16(s);
+        assert(tree_symbol_list != NULL && idx < tree_symbol_list->len);
+        return (jl_value_t*)tree_symbol_list->items[idx];
+    }
     jl_value_t *v = jl_deserialize_value_(s, vtag, loc);
     return v;
 }
@@ -1258,6 +1492,8 @@ static jl_value_t *jl_deserialize_value_(ios_t *s, jl_value_t *vtag, jl_value_t
         if (len >= 256) free(name);
         if (usetable)
             arraylist_push(&backref_list, sym);
+        else if (mode == MODE_AST && tree_symbol_list != NULL)
+            arraylist_push(tree_symbol_list, sym);
         return sym;
     }
     else if (vtag == (jl_value_t*)jl_array_type ||
@@ -1282,6 +1518,24 @@ static jl_value_t *jl_deserialize_value_(ios_t *s, jl_value_t *vtag, jl_value_t
         size_t *dims = (size_t*)alloca(ndims*sizeof(size_t));
         for(i=0; i < ndims; i++)
             dims[i] = jl_unbox_long(jl_deserialize_value(s, NULL));
+        if (mapped_buf != NULL && s->buf == mapped_buf && ndims == 1 && isunboxed &&
+            elsize == 1 && dims[0] >= MAPPED_SHARE_NBYTES) {
+            // reference the data in the mapping. the array doesn't own it
+            // (how == 0) and copies it out if it is ever resized. this is
+            // mostly compressed ASTs, which are only paged in if they are used
+            jl_array_t *a = jl_ptr_to_array_1d((jl_value_t*)jl_array_uint8_type,
+                                               NULL, dims[0], 0);
+            a->isshared = 0;
+            if (usetable)
+                backref_list.items[pos] = a;
+            jl_value_t *aty = jl_deserialize_value(s, &jl_astaggedvalue(a)->type);
+            jl_set_typeof(a, aty);
+            assert(s->bpos + dims[0] < (off_t)mapped_buflen);
+            a->data = s->buf + s->bpos;
+            ios_skip(s, dims[0] + 1);
+            mapped_nshared++;
+            return (jl_value_t*)a;
+        }
         jl_array_t *a = jl_new_array_for_deserialization((jl_value_t*)NULL, ndims, dims, isunboxed, elsize);
         if (usetable)
             backref_list.items[pos] = a;
@@ -1290,6 +1544,8 @@ static jl_value_t *jl_deserialize_value_(ios_t *s, jl_value_t *vtag, jl_value_t
         if (!a->ptrarray) {
             size_t tot = jl_array_len(a) * a->elsize;
             ios_read(s, (char*)jl_array_data(a), tot);
+            if (mode != MODE_AST && a->elsize == 1)
+                ios_skip(s, 1);
         }
         else {
             jl_value_t** data = (jl_value_t**)jl_array_data(a);
@@ -1389,12 +1645,16 @@ static jl_value_t *jl_deserialize_value_(ios_t *s, jl_value_t *vtag, jl_value_t
         jl_gc_wb(li, li->def);
         li->capt = jl_deserialize_value(s, &li->capt);
         if (li->capt) jl_gc_wb(li, li->capt);
+        // hashes by address, inference rebuilds it
+        li->tfunc_index = jl_nothing;
         li->fptr = &jl_trampoline;
         li->functionObjects.functionObject = NULL;
         li->functionObjects.cFunctionList = NULL;
         li->functionObjects.specFunctionObject = NULL;
         li->inInference = 0;
         li->inCompile = 0;
+        li->ninterp = 0;
+        li->feedback = NULL;
         li->unspecialized = (jl_function_t*)jl_deserialize_value(s, (jl_value_t**)&li->unspecialized);
         if (li->unspecialized) jl_gc_wb(li, li->unspecialized);
         li->functionID = 0;
@@ -1402,7 +1662,10 @@ static jl_value_t *jl_deserialize_value_(ios_t *s, jl_value_t *vtag, jl_value_t
         int32_t cfunc_llvm, func_llvm;
         func_llvm = read_int32(s);
         cfunc_llvm = read_int32(s);
-        jl_delayed_fptrs(li, func_llvm, cfunc_llvm);
+        jl_value_t *rettype = NULL;
+        if (mode == MODE_SYSTEM_IMAGE && cfunc_llvm != 0)
+            rettype = jl_deserialize_value(s, NULL);
+        jl_delayed_fptrs(li, func_llvm, cfunc_llvm, rettype);
         return (jl_value_t*)li;
     }
     else if (vtag == (jl_value_t*)jl_module_type) {
@@ -1461,19 +1724,16 @@ static jl_value_t *jl_deserialize_value_(ios_t *s, jl_value_t *vtag, jl_value_t
         m->istopmod = read_uint8(s);
         m->std_imports = read_uint8(s);
         m->uuid = read_uint64(s);
+        // owners and usings were filled in directly above
+        jl_invalidate_binding_caches();
         return (jl_value_t*)m;
     }
     else if (vtag == (jl_value_t*)SmallInt64_tag) {
-        jl_value_t *v = jl_box_int64(read_int32(s));
-        if (usetable)
-            arraylist_push(&backref_list, v);
-        return v;
+        // not in the backref table, see is_int_literal
+        return jl_box_int64(read_int32(s));
     }
     else if (vtag == (jl_value_t*)Int32_tag) {
-        jl_value_t *v = jl_box_int32(read_int32(s));
-        if (usetable)
-            arraylist_push(&backref_list, v);
-        return v;
+        return jl_box_int32(read_int32(s));
     }
     else if (vtag == (jl_value_t*)NearbyGlobal_tag) {
         assert(tree_enclosing_module != NULL);
@@ -1647,27 +1907,12 @@ static int jl_deserialize_verify_mod_list(ios_t *s)
     }
 }
 
-static int readstr_verify(ios_t *s, const char *str)
-{
-    size_t len = strlen(str);
-    for (size_t i=0; i < len; ++i)
-        if ((char) read_uint8(s) != str[i])
-            return 0;
-    return 1;
-}
-
 JL_DLLEXPORT int jl_deserialize_verify_header(ios_t *s)
 {
-    uint16_t bom;
-    return (readstr_verify(s, JI_MAGIC) &&
-            read_uint16(s) == JI_FORMAT_VERSION &&
-            ios_read(s, (char *) &bom, 2) == 2 && bom == BOM &&
-            read_uint8(s) == sizeof(void*) &&
-            readstr_verify(s, jl_symbol_name(jl_get_OS_NAME())) && !read_uint8(s) &&
-            readstr_verify(s, jl_symbol_name(jl_get_ARCH())) && !read_uint8(s) &&
-            readstr_verify(s, JULIA_VERSION_STRING) && !read_uint8(s) &&
-            readstr_verify(s, jl_git_branch()) && !read_uint8(s) &&
-            readstr_verify(s, jl_git_commit()) && !read_uint8(s));
+    char expected[JI_HEADER_SIZE], header[JI_HEADER_SIZE];
+    jl_header_bytes(expected);
+    return (ios_read(s, header, JI_HEADER_SIZE) == JI_HEADER_SIZE &&
+            memcmp(header, expected, JI_HEADER_SIZE) == 0);
 }
 
 jl_array_t *jl_module_init_order;
@@ -1759,6 +2004,19 @@ void jl_init_restored_modules(jl_array_t *init_order)
     }
 }
 
+// incremental images only: the system image's native code reads bindings
+// directly, so its modules must always be initialized eagerly
+static void jl_defer_restored_modules(jl_array_t *init_order)
+{
+    if (!init_order)
+        return;
+    int i;
+    for(i=0; i < jl_array_len(init_order); i++) {
+        jl_value_t *mod = jl_cellref(init_order, i);
+        jl_module_defer_initializer((jl_module_t*)mod);
+    }
+}
+
 
 // --- entry points ---
 
@@ -1785,6 +2043,7 @@ void jl_save_system_image_to_stream(ios_t *f)
     }
 
     jl_idtable_type = jl_base_module ? jl_get_global(jl_base_module, jl_symbol("ObjectIdDict")) : NULL;
+    jl_dedup_ast_begin();
 
     jl_serialize_value(f, jl_main_module);
     jl_serialize_value(f, jl_top_module);
@@ -1802,6 +2061,7 @@ void jl_save_system_image_to_stream(ios_t *f)
     write_int32(f, jl_get_gs_ctr());
     jl_finalize_serializer(f); // done with f
 
+    jl_dedup_ast_end();
     htable_reset(&backref_table, 0);
     arraylist_free(&reinit_list);
 
@@ -1893,6 +2153,7 @@ void jl_restore_system_image_from_stream(ios_t *f)
     int uid_ctr = read_int32(f);
     int gs_ctr = read_int32(f);
     jl_module_init_order = jl_finalize_deserializer(f); // done with f
+    jl_startup_trace("jl_restore_system_image (read)");
 
     // cache builtin parametric types
     for(int i=0; i < jl_array_len(datatype_list); i++) {
@@ -1900,6 +2161,7 @@ void jl_restore_system_image_from_stream(ios_t *f)
         jl_cache_type_((jl_datatype_t*)v);
     }
     datatype_list = NULL;
+    jl_startup_trace("jl_restore_system_image (types)");
 
     jl_get_builtin_hooks();
     if (jl_base_module) {
@@ -1914,9 +2176,12 @@ void jl_restore_system_image_from_stream(ios_t *f)
     //jl_printf(JL_STDERR, "backref_list.len = %d\n", backref_list.len);
     arraylist_free(&backref_list);
 
-    jl_gc_enable(en);
     mode = last_mode;
+    // before the gc is back on: the rettypes in delayed_fptrs are only
+    // referenced from there
     jl_update_all_fptrs();
+    jl_startup_trace("jl_update_all_fptrs");
+    jl_gc_enable(en);
     JL_UNLOCK(dump);
     JL_SIGATOMIC_END();
 }
@@ -1935,6 +2200,23 @@ JL_DLLEXPORT void jl_restore_system_image(const char *fname)
         }
     }
     else {
+#ifndef _OS_WINDOWS_
+        // map the file copy-on-write instead of reading it. the mapping is
+        // never released: the arrays restored in place point into it
+        int fd = open(fname, O_RDONLY);
+        struct stat st;
+        if (fd != -1 && fstat(fd, &st) == 0 && st.st_size > 0) {
+            void *buf = mmap(NULL, st.st_size, PROT_READ | PROT_WRITE,
+                             MAP_PRIVATE, fd, 0);
+            close(fd);
+            if (buf == MAP_FAILED)
+                jl_errorf("could not map system image file \"%s\"", fname);
+            jl_restore_system_image_buffer((char*)buf, st.st_size, 1);
+            return;
+        }
+        if (fd != -1)
+            close(fd);
+#endif
         ios_t f;
         if (ios_file(&f, fname, 1, 0, 0, 0) == NULL)
             jl_errorf("system image file \"%s\" not found", fname);
@@ -1945,16 +2227,29 @@ JL_DLLEXPORT void jl_restore_system_image(const char *fname)
     }
 }
 
-JL_DLLEXPORT void jl_restore_system_image_data(const char *buf, size_t len)
+// with keep set, buf must stay valid and writable for the rest of the
+// process: large byte arrays are restored in place instead of copied
+static void jl_restore_system_image_buffer(char *buf, size_t len, int keep)
 {
     ios_t f;
     JL_SIGATOMIC_BEGIN();
-    ios_static_buffer(&f, (char*)buf, len);
+    ios_static_buffer(&f, buf, len);
+    if (keep) {
+        mapped_buf = buf;
+        mapped_buflen = len;
+    }
     jl_restore_system_image_from_stream(&f);
+    mapped_buf = NULL;
+    mapped_buflen = 0;
     ios_close(&f);
     JL_SIGATOMIC_END();
 }
 
+JL_DLLEXPORT void jl_restore_system_image_data(const char *buf, size_t len)
+{
+    jl_restore_system_image_buffer((char*)buf, len, 0);
+}
+
 JL_DLLEXPORT jl_value_t *jl_ast_rettype(jl_lambda_info_t *li, jl_value_t *ast)
 {
     if (jl_is_expr(ast))
@@ -1969,6 +2264,10 @@ JL_DLLEXPORT jl_value_t *jl_ast_rettype(jl_lambda_info_t *li, jl_value_t *ast)
         jl_gc_wb(li->module, li->module->constant_table);
     }
     tree_literal_values = li->module->constant_table;
+    arraylist_t symbols;
+    arraylist_new(&symbols, 0);
+    arraylist_t *last_tsl = tree_symbol_list;
+    tree_symbol_list = &symbols;
     ios_t src;
     jl_array_t *bytes = (jl_array_t*)ast;
     ios_mem(&src, 0);
@@ -1977,6 +2276,8 @@ JL_DLLEXPORT jl_value_t *jl_ast_rettype(jl_lambda_info_t *li, jl_value_t *ast)
     int en = jl_gc_enable(0);
     jl_value_t *rt = jl_deserialize_value(&src, NULL);
     jl_gc_enable(en);
+    tree_symbol_list = last_tsl;
+    arraylist_free(&symbols);
     tree_literal_values = NULL;
     mode = last_mode;
     JL_UNLOCK(dump);
@@ -1994,6 +2295,12 @@ JL_DLLEXPORT jl_value_t *jl_compress_ast(jl_lambda_info_t *li, jl_value_t *ast)
     ios_mem(&dest, 0);
     jl_array_t *last_tlv = tree_literal_values;
     jl_module_t *last_tem = tree_enclosing_module;
+    htable_t symbols;
+    htable_new(&symbols, 0);
+    htable_t *last_tst = tree_symbol_table;
+    size_t last_nsym = tree_nsymbols;
+    tree_symbol_table = &symbols;
+    tree_nsymbols = 0;
     int en = jl_gc_enable(0);
 
     if (li->module->constant_table == NULL) {
@@ -2017,6 +2324,9 @@ JL_DLLEXPORT jl_value_t *jl_compress_ast(jl_lambda_info_t *li, jl_value_t *ast)
     }
     tree_literal_values = last_tlv;
     tree_enclosing_module = last_tem;
+    tree_symbol_table = last_tst;
+    tree_nsymbols = last_nsym;
+    htable_free(&symbols);
     jl_gc_enable(en);
     mode = last_mode;
     JL_UNLOCK(dump);
@@ -2038,10 +2348,16 @@ JL_DLLEXPORT jl_value_t *jl_uncompress_ast(jl_lambda_info_t *li, jl_value_t *dat
     ios_mem(&src, 0);
     ios_setbuf(&src, (char*)bytes->data, jl_array_len(bytes), 0);
     src.size = jl_array_len(bytes);
+    arraylist_t symbols;
+    arraylist_new(&symbols, 0);
+    arraylist_t *last_tsl = tree_symbol_list;
+    tree_symbol_list = &symbols;
     int en = jl_gc_enable(0);
     (void)jl_deserialize_value(&src, NULL); // skip ret type
     jl_value_t *v = jl_deserialize_value(&src, NULL);
     jl_gc_enable(en);
+    tree_symbol_list = last_tsl;
+    arraylist_free(&symbols);
     tree_literal_values = NULL;
     tree_enclosing_module = NULL;
     mode = last_mode;
@@ -2074,6 +2390,7 @@ JL_DLLEXPORT int jl_save_incremental(const char *fname, jl_array_t *worklist)
     int en = jl_gc_enable(0);
     DUMP_MODES last_mode = mode;
     mode = MODE_MODULE;
+    jl_dedup_ast_begin();
     jl_serialize_value(&f, worklist);
     jl_finalize_serializer(&f); // done with MODE_MODULE
     reinit_list.len = 0;
@@ -2082,6 +2399,7 @@ JL_DLLEXPORT int jl_save_incremental(const char *fname, jl_array_t *worklist)
     jl_serialize_lambdas_from_mod(&f, jl_main_module);
     jl_serialize_value(&f, NULL); // signal end of lambdas
     jl_finalize_serializer(&f); // done with f
+    jl_dedup_ast_end();
 
     mode = last_mode;
     jl_gc_enable(en);
@@ -2206,7 +2524,48 @@ static void jl_recache_types(void)
     }
 }
 
-static jl_array_t *_jl_restore_incremental(ios_t *f)
+// resort the internal method tables of everything that was deserialized,
+// they are keyed by the type uids that were just reassigned
+static void jl_reinsert_methtables(void)
+{
+    size_t i;
+    for (i = 0; i < methtable_list.len; i++) {
+        jl_methtable_t *mt = (jl_methtable_t*)methtable_list.items[i];
+        jl_array_t *cache_targ = mt->cache_targ;
+        jl_array_t *cache_arg1 = mt->cache_arg1;
+        mt->cache_targ = (jl_array_t*)jl_nothing;
+        mt->cache_arg1 = (jl_array_t*)jl_nothing;
+        // keyed by uids, which were just reassigned
+        mt->cache_exact = (jl_array_t*)jl_nothing;
+        mt->cache_matches = (jl_array_t*)jl_nothing;
+        if (cache_targ != (void*)jl_nothing) {
+            size_t j, l = jl_array_len(cache_targ);
+            for (j = 0; j < l; j++) {
+                jl_methlist_t *ml = (jl_methlist_t*)jl_cellref(cache_targ, j);
+                while (ml != NULL && ml != (void*)jl_nothing) {
+                    assert(!ml->isstaged);
+                    jl_method_cache_insert(mt, ml->sig, ml->func);
+                    ml = ml->next;
+                }
+            }
+        }
+        if (cache_arg1 != (void*)jl_nothing) {
+            size_t j, l = jl_array_len(cache_arg1);
+            for (j = 0; j < l; j++) {
+                jl_methlist_t *ml = (jl_methlist_t*)jl_cellref(cache_arg1, j);
+                while (ml != NULL && ml != (void*)jl_nothing) {
+                    assert(!ml->isstaged);
+                    jl_method_cache_insert(mt, ml->sig, ml->func);
+                    ml = ml->next;
+                }
+            }
+        }
+    }
+}
+
+// with nshared set, the buffer of f is a mapping of the file that may be
+// kept for arrays pointing into it, and their count is stored in *nshared
+static jl_array_t *_jl_restore_incremental(ios_t *f, size_t *nshared)
 {
     if (ios_eof(f)) {
         ios_close(f);
@@ -2229,11 +2588,18 @@ static jl_array_t *_jl_restore_incremental(ios_t *f)
     int en = jl_gc_enable(0);
     DUMP_MODES last_mode = mode;
     mode = MODE_MODULE;
+    if (nshared) {
+        mapped_buf = f->buf;
+        mapped_buflen = f->size;
+        mapped_nshared = 0;
+    }
     jl_array_t *restored = NULL;
     jl_array_t *init_order = NULL;
     restored = (jl_array_t*)jl_deserialize_value(f, (jl_value_t**)&restored);
 
+    uint64_t t_recache = jl_startup_tracing ? jl_hrtime() : 0;
     jl_recache_types();
+    jl_startup_trace_since("jl_recache_types", "", t_recache);
     jl_finalize_deserializer(f); // done with MODE_MODULE
 
     // at this point, the AST is fully reconstructed, but still completely disconnected
@@ -2241,39 +2607,14 @@ static jl_array_t *_jl_restore_incremental(ios_t *f)
     mode = MODE_MODULE_POSTWORK;
     jl_deserialize_lambdas_from_mod(f); // hook up methods of external generic functions
     init_order = jl_finalize_deserializer(f); // done with f
-
-    // Resort the internal method tables
-    size_t i;
-    for (i = 0; i < methtable_list.len; i++) {
-        jl_methtable_t *mt = (jl_methtable_t*)methtable_list.items[i];
-        jl_array_t *cache_targ = mt->cache_targ;
-        jl_array_t *cache_arg1 = mt->cache_arg1;
-        mt->cache_targ = (jl_array_t*)jl_nothing;
-        mt->cache_arg1 = (jl_array_t*)jl_nothing;
-        if (cache_targ != (void*)jl_nothing) {
-            size_t j, l = jl_array_len(cache_targ);
-            for (j = 0; j < l; j++) {
-                jl_methlist_t *ml = (jl_methlist_t*)jl_cellref(cache_targ, j);
-                while (ml != NULL && ml != (void*)jl_nothing) {
-                    assert(!ml->isstaged);
-                    jl_method_cache_insert(mt, ml->sig, ml->func);
-                    ml = ml->next;
-                }
-            }
-        }
-        if (cache_arg1 != (void*)jl_nothing) {
-            size_t j, l = jl_array_len(cache_arg1);
-            for (j = 0; j < l; j++) {
-                jl_methlist_t *ml = (jl_methlist_t*)jl_cellref(cache_arg1, j);
-                while (ml != NULL && ml != (void*)jl_nothing) {
-                    assert(!ml->isstaged);
-                    jl_method_cache_insert(mt, ml->sig, ml->func);
-                    ml = ml->next;
-                }
-            }
-        }
+    if (nshared) {
+        *nshared = mapped_nshared;
+        mapped_buf = NULL;
+        mapped_buflen = 0;
     }
 
+    jl_reinsert_methtables();
+
     mode = last_mode;
     jl_gc_enable(en);
     arraylist_free(&flagref_list);
@@ -2284,7 +2625,10 @@ static jl_array_t *_jl_restore_incremental(ios_t *f)
     JL_SIGATOMIC_END();
 
     JL_GC_PUSH2(&init_order,&restored);
-    jl_init_restored_modules(init_order);
+    if (jl_lazy_module_init)
+        jl_defer_restored_modules(init_order);
+    else
+        jl_init_restored_modules(init_order);
     JL_GC_POP();
 
     return restored;
@@ -2296,22 +2640,160 @@ JL_DLLEXPORT jl_value_t *jl_restore_incremental_from_buf(const char *buf,
     ios_t f;
     jl_array_t *modules;
     ios_static_buffer(&f, (char*)buf, sz);
-    modules = _jl_restore_incremental(&f);
+    modules = _jl_restore_incremental(&f, NULL);
     return modules ? (jl_value_t*) modules : jl_nothing;
 }
 
-JL_DLLEXPORT jl_value_t *jl_restore_incremental(const char *fname)
+#ifndef _OS_WINDOWS_
+// start reading a mapped cache file ahead of its decoding. the decoding of
+// cache files is not parallel: the state of the deserializer is global, and
+// so are the symbol table, type cache and method tables it fills in, so the
+// files are decoded one at a time under the dump lock. only the reads
+// overlap: the header verification of a file loads the modules it depends
+// on first, while the kernel reads it in
+static void readahead_cache_file(char *buf, size_t sz)
+{
+    madvise(buf, sz, MADV_WILLNEED);
+}
+#endif
+
+static jl_value_t *jl_restore_incremental_(const char *fname)
 {
     ios_t f;
     jl_array_t *modules;
+#ifndef _OS_WINDOWS_
+    // map the file copy-on-write instead of reading it, so that the method
+    // bodies stay in the file until they are needed. the mapping is kept if
+    // any arrays point into it
+    int fd = open(fname, O_RDONLY);
+    struct stat st;
+    if (fd != -1 && fstat(fd, &st) == 0 && st.st_size > 0) {
+        char *buf = (char*)mmap(NULL, st.st_size, PROT_READ | PROT_WRITE,
+                                MAP_PRIVATE, fd, 0);
+        close(fd);
+        if (buf != MAP_FAILED) {
+            readahead_cache_file(buf, st.st_size);
+            volatile size_t nshared = 0;
+            ios_static_buffer(&f, buf, st.st_size);
+            JL_TRY {
+                modules = _jl_restore_incremental(&f, (size_t*)&nshared);
+            }
+            JL_CATCH {
+                // thrown by the decoding (which may have shared arrays
+                // already) or by the __init__ functions of the modules
+                if (mapped_buf == buf) {
+                    nshared = mapped_nshared;
+                    mapped_buf = NULL;
+                    mapped_buflen = 0;
+                }
+                if (nshared == 0)
+                    munmap(buf, st.st_size);
+                jl_rethrow();
+            }
+            if (nshared == 0)
+                munmap(buf, st.st_size);
+            return modules ? (jl_value_t*) modules : jl_nothing;
+        }
+    }
+    else if (fd != -1) {
+        close(fd);
+    }
+#endif
     if (ios_file(&f, fname, 1, 0, 0, 0) == NULL) {
         jl_printf(JL_STDERR, "Cache file \"%s\" not found\n", fname);
         return jl_nothing;
     }
-    modules = _jl_restore_incremental(&f);
+    modules = _jl_restore_incremental(&f, NULL);
     return modules ? (jl_value_t*) modules : jl_nothing;
 }
 
+JL_DLLEXPORT jl_value_t *jl_restore_incremental(const char *fname)
+{
+    uint64_t t0 = jl_startup_tracing ? jl_hrtime() : 0;
+    jl_value_t *modules = jl_restore_incremental_(fname);
+    jl_startup_trace_since("cache file", fname, t0);
+    return modules;
+}
+
+// --- data serialization ---
+
+// serialize v to s like a cache file with an empty worklist: modules and
+// the types defined in them are written by reference (module path and
+// name), so the data can be read back by any process that has loaded the
+// same modules. each call is a separate session, with its own backref table
+JL_DLLEXPORT void jl_serialize_data(ios_t *s, jl_value_t *v)
+{
+    JL_SIGATOMIC_BEGIN();
+    JL_LOCK(dump); // Might GC
+    int en = jl_gc_enable(0);
+    jl_array_t *last_worklist = serializer_worklist;
+    serializer_worklist = jl_alloc_cell_1d(0);
+    arraylist_new(&reinit_list, 0);
+    htable_new(&backref_table, 0);
+    ptrhash_put(&backref_table, jl_main_module, (char*)HT_NOTFOUND + 1);
+    backref_table_numel = 1;
+    jl_idtable_type = jl_base_module ? jl_get_global(jl_base_module, jl_symbol("ObjectIdDict")) : NULL;
+
+    DUMP_MODES last_mode = mode;
+    mode = MODE_MODULE;
+    int err = 0;
+    JL_TRY {
+        jl_serialize_value(s, v);
+        jl_finalize_serializer(s);
+    }
+    JL_CATCH {
+        // e.g. a Task in v
+        err = 1;
+    }
+    mode = last_mode;
+
+    htable_reset(&backref_table, 0);
+    arraylist_free(&reinit_list);
+    serializer_worklist = last_worklist;
+    jl_gc_enable(en);
+    JL_UNLOCK(dump);
+    JL_SIGATOMIC_END();
+    if (err)
+        jl_rethrow();
+}
+
+// read back a value written by jl_serialize_data
+JL_DLLEXPORT jl_value_t *jl_deserialize_data(ios_t *s)
+{
+    JL_SIGATOMIC_BEGIN();
+    JL_LOCK(dump); // Might GC
+    arraylist_new(&backref_list, 0);
+    arraylist_push(&backref_list, jl_main_module);
+    arraylist_new(&flagref_list, 0);
+    arraylist_new(&methtable_list, 0);
+
+    int en = jl_gc_enable(0);
+    DUMP_MODES last_mode = mode;
+    mode = MODE_MODULE;
+    jl_value_t *v = NULL;
+    int err = 0;
+    JL_TRY {
+        v = jl_deserialize_value(s, &v);
+        jl_recache_types();
+        jl_finalize_deserializer(s);
+        jl_reinsert_methtables();
+    }
+    JL_CATCH {
+        err = 1;
+    }
+    mode = last_mode;
+
+    arraylist_free(&flagref_list);
+    arraylist_free(&methtable_list);
+    arraylist_free(&backref_list);
+    jl_gc_enable(en);
+    JL_UNLOCK(dump);
+    JL_SIGATOMIC_END();
+    if (err)
+        jl_rethrow();
+    return v;
+}
+
 // --- init ---
 
 void jl_init_serializer(void)
@@ -2329,6 +2811,7 @@ void jl_init_serializer(void)
                      (void*)Int32_tag, (void*)Array1d_tag, (void*)Singleton_tag,
                      jl_module_type, jl_tvar_type, jl_lambda_info_type,
                      (void*)CommonSym_tag, (void*)NearbyGlobal_tag, jl_globalref_type,
+                     (void*)AstSymRef_tag,
                      // everything above here represents a class of object rather only than a literal
 
                      jl_emptysvec, jl_emptytuple, jl_false, jl_true, jl_nothing, jl_any_type,
@@ -159,7 +159,7 @@ static value_t fl_set_top_level_value(value_t *args, u_int32_t nargs)
     argcount("set-top-level-value!", nargs, 2);
     symbol_t *sym = tosymbol(args[0], "set-top-level-value!");
     if (!isconstant(sym))
-        sym->binding = args[1];
+        fl_set_binding(sym, args[1]);
     return args[1];
 }
 
@@ -174,7 +174,7 @@ static void global_env_list(symbol_t *root, value_t *pv)
     }
 }
 
-extern symbol_t *symtab;
+extern FL_THREAD_LOCAL symbol_t *symtab;
 
 value_t fl_global_env(value_t *args, u_int32_t nargs)
 {
@@ -187,7 +187,7 @@ value_t fl_global_env(value_t *args, u_int32_t nargs)
     return lst;
 }
 
-extern value_t QUOTE;
+extern FL_THREAD_LOCAL value_t QUOTE;
 
 static value_t fl_constantp(value_t *args, u_int32_t nargs)
 {
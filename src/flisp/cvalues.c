@@ -4,28 +4,28 @@
 #define NWORDS(sz) (((sz)+3)>>2)
 #endif
 
-static int ALIGN2, ALIGN4, ALIGN8, ALIGNPTR;
-
-value_t int8sym, uint8sym, int16sym, uint16sym, int32sym, uint32sym;
-value_t int64sym, uint64sym;
-value_t ptrdiffsym, sizesym, bytesym, wcharsym;
-value_t floatsym, doublesym;
-value_t gftypesym, stringtypesym, wcstringtypesym;
-value_t emptystringsym;
-
-value_t arraysym, cfunctionsym, voidsym, pointersym;
-
-static htable_t TypeTable;
-static htable_t reverse_dlsym_lookup_table;
-static fltype_t *int8type, *uint8type;
-static fltype_t *int16type, *uint16type;
-static fltype_t *int32type, *uint32type;
-static fltype_t *int64type, *uint64type;
-static fltype_t *ptrdifftype, *sizetype;
-static fltype_t *floattype, *doubletype;
-       fltype_t *bytetype, *wchartype;
-       fltype_t *stringtype, *wcstringtype;
-       fltype_t *builtintype;
+static FL_THREAD_LOCAL int ALIGN2, ALIGN4, ALIGN8, ALIGNPTR;
+
+FL_THREAD_LOCAL value_t int8sym, uint8sym, int16sym, uint16sym, int32sym, uint32sym;
+FL_THREAD_LOCAL value_t int64sym, uint64sym;
+FL_THREAD_LOCAL value_t ptrdiffsym, sizesym, bytesym, wcharsym;
+FL_THREAD_LOCAL value_t floatsym, doublesym;
+FL_THREAD_LOCAL value_t gftypesym, stringtypesym, wcstringtypesym;
+FL_THREAD_LOCAL value_t emptystringsym;
+
+FL_THREAD_LOCAL value_t arraysym, cfunctionsym, voidsym, pointersym;
+
+static FL_THREAD_LOCAL htable_t TypeTable;
+static FL_THREAD_LOCAL htable_t reverse_dlsym_lookup_table;
+static FL_THREAD_LOCAL fltype_t *int8type, *uint8type;
+static FL_THREAD_LOCAL fltype_t *int16type, *uint16type;
+static FL_THREAD_LOCAL fltype_t *int32type, *uint32type;
+static FL_THREAD_LOCAL fltype_t *int64type, *uint64type;
+static FL_THREAD_LOCAL fltype_t *ptrdifftype, *sizetype;
+static FL_THREAD_LOCAL fltype_t *floattype, *doubletype;
+FL_THREAD_LOCAL fltype_t *bytetype, *wchartype;
+FL_THREAD_LOCAL fltype_t *stringtype, *wcstringtype;
+FL_THREAD_LOCAL fltype_t *builtintype;
 
 static void cvalue_init(fltype_t *type, value_t v, void *dest);
 
@@ -37,11 +37,11 @@ value_t cvalue_typeof(value_t *args, u_int32_t nargs);
 // trigger unconditional GC after this many bytes are allocated
 #define ALLOC_LIMIT_TRIGGER 67108864
 
-static size_t malloc_pressure = 0;
+static FL_THREAD_LOCAL size_t malloc_pressure = 0;
 
-static cvalue_t **Finalizers = NULL;
-static size_t nfinalizers=0;
-static size_t maxfinalizers=0;
+static FL_THREAD_LOCAL cvalue_t **Finalizers = NULL;
+static FL_THREAD_LOCAL size_t nfinalizers=0;
+static FL_THREAD_LOCAL size_t maxfinalizers=0;
 
 void add_finalizer(cvalue_t *cv)
 {
@@ -493,7 +493,7 @@ size_t ctype_sizeof(value_t type, int *palign)
     return 0;
 }
 
-extern fltype_t *iostreamtype;
+extern FL_THREAD_LOCAL fltype_t *iostreamtype;
 
 // get pointer and size for any plain-old-data value
 void to_sized_ptr(value_t v, char *fname, char **pdata, size_t *psz)
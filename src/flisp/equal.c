@@ -241,7 +241,7 @@ static value_t cyc_compare(value_t a, value_t b, htable_t *table, int eq)
     return bounded_compare(a, b, 1, eq);
 }
 
-static htable_t equal_eq_hashtable;
+static FL_THREAD_LOCAL htable_t equal_eq_hashtable;
 void comparehash_init(void)
 {
     htable_new(&equal_eq_hashtable, 512);
@@ -45,6 +45,7 @@
 
 #include "platform.h"
 #include "libsupport.h"
+#include "arraylist.h"
 #include "flisp.h"
 #include "opcodes.h"
 
@@ -90,33 +91,33 @@ static short builtin_arg_counts[] =
       ANYARGS, -1, ANYARGS, -1, 2,  2, 2, 2,
       ANYARGS, 2, 3 };
 
-static uint32_t N_STACK;
-static value_t *Stack;
-static uint32_t SP = 0;
-static uint32_t curr_frame = 0;
+static FL_THREAD_LOCAL uint32_t N_STACK;
+static FL_THREAD_LOCAL value_t *Stack;
+static FL_THREAD_LOCAL uint32_t SP = 0;
+static FL_THREAD_LOCAL uint32_t curr_frame = 0;
 #define PUSH(v) (Stack[SP++] = (v))
 #define POP()   (Stack[--SP])
 #define POPN(n) (SP-=(n))
 
 #define N_GC_HANDLES 8192
-static value_t *GCHandleStack[N_GC_HANDLES];
-static uint32_t N_GCHND = 0;
+static FL_THREAD_LOCAL value_t *GCHandleStack[N_GC_HANDLES];
+static FL_THREAD_LOCAL uint32_t N_GCHND = 0;
 
-value_t FL_NIL, FL_T, FL_F, FL_EOF, QUOTE;
-value_t IOError, ParseError, TypeError, ArgError, UnboundError, OutOfMemoryError;
-value_t DivideError, BoundsError, Error, KeyError, EnumerationError;
-value_t printwidthsym, printreadablysym, printprettysym, printlengthsym;
-value_t printlevelsym, builtins_table_sym;
+FL_THREAD_LOCAL value_t FL_NIL, FL_T, FL_F, FL_EOF, QUOTE;
+FL_THREAD_LOCAL value_t IOError, ParseError, TypeError, ArgError, UnboundError, OutOfMemoryError;
+FL_THREAD_LOCAL value_t DivideError, BoundsError, Error, KeyError, EnumerationError;
+FL_THREAD_LOCAL value_t printwidthsym, printreadablysym, printprettysym, printlengthsym;
+FL_THREAD_LOCAL value_t printlevelsym, builtins_table_sym;
 
-static value_t NIL, LAMBDA, IF, TRYCATCH;
-static value_t BACKQUOTE, COMMA, COMMAAT, COMMADOT, FUNCTION;
+static FL_THREAD_LOCAL value_t NIL, LAMBDA, IF, TRYCATCH;
+static FL_THREAD_LOCAL value_t BACKQUOTE, COMMA, COMMAAT, COMMADOT, FUNCTION;
 
-static value_t pairsym, symbolsym, fixnumsym, vectorsym, builtinsym, vu8sym;
-static value_t definesym, defmacrosym, forsym, setqsym;
-static value_t tsym, Tsym, fsym, Fsym, booleansym, nullsym, evalsym, fnsym;
+static FL_THREAD_LOCAL value_t pairsym, symbolsym, fixnumsym, vectorsym, builtinsym, vu8sym;
+static FL_THREAD_LOCAL value_t definesym, defmacrosym, forsym, setqsym;
+static FL_THREAD_LOCAL value_t tsym, Tsym, fsym, Fsym, booleansym, nullsym, evalsym, fnsym;
 // for reading characters
-static value_t nulsym, alarmsym, backspacesym, tabsym, linefeedsym, newlinesym;
-static value_t vtabsym, pagesym, returnsym, escsym, spacesym, deletesym;
+static FL_THREAD_LOCAL value_t nulsym, alarmsym, backspacesym, tabsym, linefeedsym, newlinesym;
+static FL_THREAD_LOCAL value_t vtabsym, pagesym, returnsym, escsym, spacesym, deletesym;
 
 static value_t apply_cl(uint32_t nargs);
 static value_t *alloc_words(int n);
@@ -129,7 +130,7 @@ typedef struct _fl_readstate_t {
     struct _fl_readstate_t *prev;
 } fl_readstate_t;
 
-static fl_readstate_t *readstate = NULL;
+static FL_THREAD_LOCAL fl_readstate_t *readstate = NULL;
 
 static void free_readstate(fl_readstate_t *rs)
 {
@@ -137,19 +138,19 @@ static void free_readstate(fl_readstate_t *rs)
     htable_free(&rs->gensyms);
 }
 
-static unsigned char *fromspace;
-static unsigned char *tospace;
-static unsigned char *curheap;
-static unsigned char *lim;
-static uint32_t heapsize;//bytes
-static uint32_t *consflags;
+static FL_THREAD_LOCAL unsigned char *fromspace;
+static FL_THREAD_LOCAL unsigned char *tospace;
+static FL_THREAD_LOCAL unsigned char *curheap;
+static FL_THREAD_LOCAL unsigned char *lim;
+static FL_THREAD_LOCAL uint32_t heapsize;//bytes
+static FL_THREAD_LOCAL uint32_t *consflags;
 
 // error utilities ------------------------------------------------------------
 
 // saved execution state for an unwind target
-fl_exception_context_t *fl_ctx = NULL;
-uint32_t fl_throwing_frame=0;  // active frame when exception was thrown
-value_t fl_lasterror;
+FL_THREAD_LOCAL fl_exception_context_t *fl_ctx = NULL;
+FL_THREAD_LOCAL uint32_t fl_throwing_frame=0;  // active frame when exception was thrown
+FL_THREAD_LOCAL value_t fl_lasterror;
 
 #define FL_TRY \
   fl_exception_context_t _ctx; int l__tr, l__ca; \
@@ -253,7 +254,15 @@ SAFECAST_OP(string,char*,    cvalue_data)
 
 // symbol table ---------------------------------------------------------------
 
-symbol_t *symtab = NULL;
+FL_THREAD_LOCAL symbol_t *symtab = NULL;
+// symbols whose binding has ever been set; these are the global roots
+static FL_THREAD_LOCAL arraylist_t bound_syms;
+
+void fl_track_bound_symbol(symbol_t *sym)
+{
+    sym->flags |= 0x4;
+    arraylist_push(&bound_syms, sym);
+}
 
 int fl_is_keyword_name(const char *str, size_t len)
 {
@@ -281,6 +290,7 @@ static symbol_t *mk_symbol(const char *str)
     }
     sym->type = NULL;
     sym->dlcache = NULL;
+    sym->extcache = NULL;
     sym->hash = memhash32(str, len)^0xAAAAAAAA;
     strcpy(&sym->name[0], str);
     return sym;
@@ -310,23 +320,30 @@ value_t symbol(char *str)
     return tagptr(*pnode, TAG_SYM);
 }
 
+// shared by all threads, since gensyms become julia symbols and must not
+// collide between interpreter instances
 static uint32_t _gensym_ctr=0;
+#ifdef JULIA_ENABLE_THREADING
+#define next_gensym_id() __sync_fetch_and_add(&_gensym_ctr, 1)
+#else
+#define next_gensym_id() (_gensym_ctr++)
+#endif
 // two static buffers for gensym printing so there can be two
 // gensym names available at a time, mostly for compare()
-static char gsname[2][16];
-static int gsnameno=0;
+static FL_THREAD_LOCAL char gsname[2][16];
+static FL_THREAD_LOCAL int gsnameno=0;
 value_t fl_gensym(value_t *args, uint32_t nargs)
 {
 #ifdef MEMDEBUG2
     gsnameno = 1-gsnameno;
-    char *n = uint2str(gsname[gsnameno]+1, sizeof(gsname[0])-1, _gensym_ctr++, 10);
+    char *n = uint2str(gsname[gsnameno]+1, sizeof(gsname[0])-1, next_gensym_id(), 10);
     *(--n) = 'g';
     return tagptr(mk_symbol(n), TAG_SYM);
 #else
     argcount("gensym", nargs, 0);
     (void)args;
     gensym_t *gs = (gensym_t*)alloc_words(sizeof(gensym_t)/sizeof(void*));
-    gs->id = _gensym_ctr++;
+    gs->id = next_gensym_id();
     gs->binding = UNBOUND;
     gs->isconst = 0;
     gs->type = NULL;
@@ -362,8 +379,8 @@ char *symbol_name(value_t v)
 // conses ---------------------------------------------------------------------
 
 #ifdef MEMDEBUG2
-static void *tochain=NULL;
-static long long n_allocd=0;
+static FL_THREAD_LOCAL void *tochain=NULL;
+static FL_THREAD_LOCAL long long n_allocd=0;
 #define GC_INTERVAL 100000
 #endif
 
@@ -436,7 +453,7 @@ static value_t *alloc_words(int n)
 #define unmark_cons(c) bitvector_set(consflags, cons_index(c), 0)
 #endif
 
-static value_t the_empty_vector;
+static FL_THREAD_LOCAL value_t the_empty_vector;
 
 value_t alloc_vector(size_t n, int init)
 {
@@ -586,17 +603,17 @@ value_t relocate_lispvalue(value_t v)
     return relocate(v);
 }
 
-static void trace_globals(symbol_t *root)
+static void trace_globals(void)
 {
-    while (root != NULL) {
-        if (root->binding != UNBOUND)
-            root->binding = relocate(root->binding);
-        trace_globals(root->left);
-        root = root->right;
+    size_t i;
+    for (i=0; i < bound_syms.len; i++) {
+        symbol_t *sym = (symbol_t*)bound_syms.items[i];
+        if (sym->binding != UNBOUND)
+            sym->binding = relocate(sym->binding);
     }
 }
 
-static value_t memory_exception_value;
+static FL_THREAD_LOCAL value_t memory_exception_value;
 
 void gc(int mustgrow)
 {
@@ -608,7 +625,7 @@ void gc(int mustgrow)
     tochain = NULL;
     n_allocd = -100000000000LL;
 #else
-    static int grew = 0;
+    static FL_THREAD_LOCAL int grew = 0;
     size_t hsz = grew ? heapsize*2 : heapsize;
 #ifdef MEMDEBUG
     tospace = LLT_ALLOC(hsz);
@@ -634,7 +651,7 @@ void gc(int mustgrow)
     }
     for (i=0; i < N_GCHND; i++)
         *GCHandleStack[i] = relocate(*GCHandleStack[i]);
-    trace_globals(symtab);
+    trace_globals();
     relocate_typetable();
     rs = readstate;
     while (rs) {
@@ -1089,10 +1106,10 @@ static value_t apply_cl(uint32_t nargs)
 #endif
     uint32_t i;
     symbol_t *sym;
-    static cons_t *c;
-    static value_t *pv;
-    static int64_t accum;
-    static value_t func, v, e;
+    static FL_THREAD_LOCAL cons_t *c;
+    static FL_THREAD_LOCAL value_t *pv;
+    static FL_THREAD_LOCAL int64_t accum;
+    static FL_THREAD_LOCAL value_t func, v, e;
 
  apply_cl_top:
     func = Stack[SP-nargs-1];
@@ -1747,7 +1764,7 @@ static value_t apply_cl(uint32_t nargs)
             sym = (symbol_t*)ptr(v);
             v = Stack[SP-1];
             if (!isconstant(sym))
-                sym->binding = v;
+                fl_set_binding(sym, v);
             NEXT_OP;
 
         OP(OP_LOADA)
@@ -2342,6 +2359,7 @@ static void lisp_init(size_t initial_heapsize)
     libsupport_init();
 
     heapsize = initial_heapsize;
+    arraylist_new(&bound_syms, 0);
 
     fromspace = (unsigned char*)LLT_ALLOC(heapsize);
 #ifdef MEMDEBUG
@@ -2448,7 +2466,7 @@ void fl_init(size_t initial_heapsize)
     fl_init_julia_extensions();
 }
 
-extern fltype_t *iostreamtype;
+extern FL_THREAD_LOCAL fltype_t *iostreamtype;
 
 int fl_load_system_image_str(char *str, size_t len)
 {
@@ -2484,7 +2502,7 @@ int fl_load_system_image(value_t sys_image_iostream)
                     sym = tosymbol(car_(e), "bootstrap");
                     e = cdr_(e);
                     (void)tocons(e, "bootstrap");
-                    sym->binding = car_(e);
+                    fl_set_binding(sym, car_(e));
                     e = cdr_(e);
                 }
                 break;
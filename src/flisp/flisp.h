@@ -11,6 +11,25 @@
 //#define MEMDEBUG
 //#define MEMDEBUG2
 
+// with threads, all interpreter state is per thread so that each thread
+// can run its own independent instance (see jl_init_frontend).
+// the state is only referenced from within libjulia, so it uses the
+// local-dynamic model instead of the global-dynamic one the build sets: a
+// function finds the base of the thread's block once and reaches every
+// variable at a fixed offset from it, instead of calling __tls_get_addr at
+// each access
+#ifdef JULIA_ENABLE_THREADING
+#  if defined(_COMPILER_MICROSOFT_)
+#    define FL_THREAD_LOCAL __declspec(thread)
+#  elif defined(_OS_LINUX_) || defined(_OS_FREEBSD_)
+#    define FL_THREAD_LOCAL __thread __attribute__((tls_model("local-dynamic")))
+#  else
+#    define FL_THREAD_LOCAL __thread
+#  endif
+#else
+#  define FL_THREAD_LOCAL
+#endif
+
 typedef uptrint_t value_t;
 typedef int_t fixnum_t;
 #if NBITS==64
@@ -35,6 +54,7 @@ typedef struct _symbol_t {
     struct _fltype_t *type;
     uint32_t hash;
     void *dlcache;     // dlsym address
+    void *extcache;    // for use by the embedding program
     // below fields are private
     struct _symbol_t *left;
     struct _symbol_t *right;
@@ -105,12 +125,23 @@ typedef struct {
 #define fn_env(f) (((value_t*)ptr(f))[2])
 #define fn_name(f) (((value_t*)ptr(f))[3])
 
-#define set(s, v)  (((symbol_t*)ptr(s))->binding = (v))
+#define set(s, v)  fl_set_binding((symbol_t*)ptr(s), (v))
 #define setc(s, v) do { ((symbol_t*)ptr(s))->flags |= 1; \
-                        ((symbol_t*)ptr(s))->binding = (v); } while (0)
+                        fl_set_binding((symbol_t*)ptr(s), (v)); } while (0)
 #define isconstant(s) ((s)->flags&0x1)
 #define iskeyword(s) ((s)->flags&0x2)
+#define isbound_tracked(s) ((s)->flags&0x4)
 #define symbol_value(s) (((symbol_t*)ptr(s))->binding)
+
+// the collector only traces the bindings of symbols that have ever been
+// bound, not the whole symbol table, so global bindings must be set here
+void fl_track_bound_symbol(symbol_t *sym);
+static inline void fl_set_binding(symbol_t *sym, value_t v)
+{
+    if (!isbound_tracked(sym))
+        fl_track_bound_symbol(sym);
+    sym->binding = v;
+}
 #ifdef MEMDEBUG2
 #define ismanaged(v) (!issymbol(v) && !isfixnum(v) && ((v)>(N_OPCODES<<3)) && !iscbuiltin(v))
 #else
@@ -136,7 +167,7 @@ void fl_free_gc_handles(uint32_t n);
 
 #define N_BUILTINS ((int)N_OPCODES)
 
-extern value_t FL_NIL, FL_T, FL_F, FL_EOF;
+extern FL_THREAD_LOCAL value_t FL_NIL, FL_T, FL_F, FL_EOF;
 
 #define FL_UNSPECIFIED FL_T
 
@@ -147,7 +178,7 @@ value_t fl_toplevel_eval(value_t expr);
 value_t fl_apply(value_t f, value_t l);
 value_t fl_applyn(uint32_t n, value_t f, ...);
 
-extern value_t printprettysym, printreadablysym, printwidthsym;
+extern FL_THREAD_LOCAL value_t printprettysym, printreadablysym, printwidthsym;
 
 /* object model manipulation */
 value_t fl_cons(value_t a, value_t b);
@@ -180,9 +211,9 @@ typedef struct _ectx_t {
     struct _ectx_t *prev;
 } fl_exception_context_t;
 
-extern fl_exception_context_t *fl_ctx;
-extern uint32_t fl_throwing_frame;
-extern value_t fl_lasterror;
+extern FL_THREAD_LOCAL fl_exception_context_t *fl_ctx;
+extern FL_THREAD_LOCAL uint32_t fl_throwing_frame;
+extern FL_THREAD_LOCAL value_t fl_lasterror;
 
 #define FL_TRY_EXTERN                                                   \
   fl_exception_context_t _ctx; int l__tr, l__ca;                        \
@@ -211,8 +242,8 @@ void bounds_error(char *fname, value_t arr, value_t ind) __attribute__ ((__noret
 void fl_savestate(fl_exception_context_t *_ctx);
 void fl_restorestate(fl_exception_context_t *_ctx);
 
-extern value_t ArgError, IOError, KeyError, OutOfMemoryError, EnumerationError;
-extern value_t UnboundError;
+extern FL_THREAD_LOCAL value_t ArgError, IOError, KeyError, OutOfMemoryError, EnumerationError;
+extern FL_THREAD_LOCAL value_t UnboundError;
 
 static inline void argcount(char *fname, uint32_t nargs, uint32_t c)
 {
@@ -319,16 +350,16 @@ typedef float    fl_float_t;
 
 typedef value_t (*builtin_t)(value_t*, uint32_t);
 
-extern value_t QUOTE;
-extern value_t int8sym, uint8sym, int16sym, uint16sym, int32sym, uint32sym;
-extern value_t int64sym, uint64sym;
-extern value_t ptrdiffsym, sizesym, bytesym, wcharsym;
-extern value_t arraysym, cfunctionsym, voidsym, pointersym;
-extern value_t stringtypesym, wcstringtypesym, emptystringsym;
-extern value_t floatsym, doublesym;
-extern fltype_t *bytetype, *wchartype;
-extern fltype_t *stringtype, *wcstringtype;
-extern fltype_t *builtintype;
+extern FL_THREAD_LOCAL value_t QUOTE;
+extern FL_THREAD_LOCAL value_t int8sym, uint8sym, int16sym, uint16sym, int32sym, uint32sym;
+extern FL_THREAD_LOCAL value_t int64sym, uint64sym;
+extern FL_THREAD_LOCAL value_t ptrdiffsym, sizesym, bytesym, wcharsym;
+extern FL_THREAD_LOCAL value_t arraysym, cfunctionsym, voidsym, pointersym;
+extern FL_THREAD_LOCAL value_t stringtypesym, wcstringtypesym, emptystringsym;
+extern FL_THREAD_LOCAL value_t floatsym, doublesym;
+extern FL_THREAD_LOCAL fltype_t *bytetype, *wchartype;
+extern FL_THREAD_LOCAL fltype_t *stringtype, *wcstringtype;
+extern FL_THREAD_LOCAL fltype_t *builtintype;
 
 value_t cvalue(fltype_t *type, size_t sz);
 void add_finalizer(cvalue_t *cv);
@@ -11,9 +11,9 @@
 extern "C" {
 #endif
 
-static value_t iostreamsym, rdsym, wrsym, apsym, crsym, truncsym;
-static value_t instrsym, outstrsym;
-fltype_t *iostreamtype;
+static FL_THREAD_LOCAL value_t iostreamsym, rdsym, wrsym, apsym, crsym, truncsym;
+static FL_THREAD_LOCAL value_t instrsym, outstrsym;
+FL_THREAD_LOCAL fltype_t *iostreamtype;
 
 void print_iostream(value_t v, ios_t *f)
 {
@@ -157,8 +157,8 @@ value_t fl_julia_identifier_start_char(value_t *args, u_int32_t nargs)
 // return NFC-normalized UTF8-encoded version of s
 static char *normalize(char *s)
 {
-    static size_t buflen = 0;
-    static void *buf = NULL; // persistent buffer (avoid repeated malloc/free)
+    static FL_THREAD_LOCAL size_t buflen = 0;
+    static FL_THREAD_LOCAL void *buf = NULL; // persistent buffer (avoid repeated malloc/free)
     // options equivalent to utf8proc_NFC:
     const int options = UTF8PROC_NULLTERM|UTF8PROC_STABLE|UTF8PROC_COMPOSE;
     ssize_t result;
@@ -209,8 +209,62 @@ value_t fl_accum_julia_symbol(value_t *args, u_int32_t nargs)
     return symbol(normalize(str.buf));
 }
 
+// the lexer's bulk scanners below work on the stream buffer directly rather
+// than reading one character at a time. they only stop at ASCII bytes, which
+// never occur inside a multibyte UTF-8 sequence.
+
+// skip to the end of the line, leaving the newline to be read
+value_t fl_skip_to_eol(value_t *args, u_int32_t nargs)
+{
+    argcount("skip-to-eol", nargs, 1);
+    ios_t *s = fl_toiostream(args[0], "skip-to-eol");
+    while (1) {
+        size_t avail = ios_readprep(s, 1);
+        if (avail == 0)
+            return FL_EOF;
+        char *start = s->buf + s->bpos;
+        char *nl = (char*)memchr(start, '\n', avail);
+        if (nl != NULL) {
+            s->bpos += nl - start;
+            return mk_wchar('\n');
+        }
+        s->bpos += avail;
+    }
+}
+
+// copy the characters of a string literal that need no special handling,
+// i.e. up to the next `"`, `\`, `$` or `\r`, from a port to a buffer
+value_t fl_copy_string_chars(value_t *args, u_int32_t nargs)
+{
+    argcount("copy-string-chars", nargs, 2);
+    ios_t *from = fl_toiostream(args[0], "copy-string-chars");
+    ios_t *to = fl_toiostream(args[1], "copy-string-chars");
+    size_t total = 0;
+    while (1) {
+        size_t avail = ios_readprep(from, 1);
+        if (avail == 0)
+            break;
+        char *start = from->buf + from->bpos;
+        char *p = start, *end = start + avail;
+        while (p < end && *p != '"' && *p != '\\' && *p != '$' && *p != '\r') {
+            if (*p == '\n')
+                from->lineno++;
+            p++;
+        }
+        size_t n = p - start;
+        ios_write(to, start, n);
+        from->bpos += n;
+        total += n;
+        if (p < end)
+            break;
+    }
+    return size_wrap(total);
+}
+
 static builtinspec_t julia_flisp_func_info[] = {
     { "skip-ws", fl_skipws },
+    { "skip-to-eol", fl_skip_to_eol },
+    { "copy-string-chars", fl_copy_string_chars },
     { "accum-julia-symbol", fl_accum_julia_symbol },
     { "identifier-char?", fl_julia_identifier_char },
     { "identifier-start-char?", fl_julia_identifier_start_char },
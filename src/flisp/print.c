@@ -1,15 +1,15 @@
 extern void *memrchr(const void *s, int c, size_t n);
 
-static htable_t printconses;
-static u_int32_t printlabel;
-static int print_pretty;
-static int print_princ;
-static fixnum_t print_length;
-static fixnum_t print_level;
-static fixnum_t P_LEVEL;
-static int SCR_WIDTH = 80;
-
-static int HPOS=0, VPOS;
+static FL_THREAD_LOCAL htable_t printconses;
+static FL_THREAD_LOCAL u_int32_t printlabel;
+static FL_THREAD_LOCAL int print_pretty;
+static FL_THREAD_LOCAL int print_princ;
+static FL_THREAD_LOCAL fixnum_t print_length;
+static FL_THREAD_LOCAL fixnum_t print_level;
+static FL_THREAD_LOCAL fixnum_t P_LEVEL;
+static FL_THREAD_LOCAL int SCR_WIDTH = 80;
+
+static FL_THREAD_LOCAL int HPOS=0, VPOS;
 static void outc(char c, ios_t *f)
 {
     ios_putc(c, f);
@@ -645,9 +645,9 @@ static void cvalue_printdata(ios_t *f, void *data, size_t len, value_t type,
         // at this point, so int64 is big enough to capture everything.
         numerictype_t nt = sym_to_numtype(type);
         if (nt == N_NUMTYPES) {
-            static size_t (*jl_static_print)(ios_t*, void*) = 0;
-            static int init = 0;
-            static value_t jl_sym = 0;
+            static FL_THREAD_LOCAL size_t (*jl_static_print)(ios_t*, void*) = 0;
+            static FL_THREAD_LOCAL int init = 0;
+            static FL_THREAD_LOCAL value_t jl_sym = 0;
             if (init == 0) {
                 init = 1;
 #if defined(RTLD_SELF)
@@ -120,9 +120,9 @@ static int read_numtok(char *tok, value_t *pval, int base)
     return result;
 }
 
-static u_int32_t toktype = TOK_NONE;
-static value_t tokval;
-static char buf[256];
+static FL_THREAD_LOCAL u_int32_t toktype = TOK_NONE;
+static FL_THREAD_LOCAL value_t tokval;
+static FL_THREAD_LOCAL char buf[256];
 
 static char nextchar(void)
 {
@@ -12,8 +12,8 @@
 extern "C" {
 #endif
 
-static value_t tablesym;
-static fltype_t *tabletype;
+static FL_THREAD_LOCAL value_t tablesym;
+static FL_THREAD_LOCAL fltype_t *tabletype;
 
 void print_htable(value_t v, ios_t *f)
 {
@@ -22,6 +22,9 @@
 #include "julia.h"
 #include "julia_internal.h"
 #include "threading.h"
+#ifdef JULIA_ENABLE_THREADING
+#include "ia_misc.h"
+#endif
 #ifndef _OS_WINDOWS_
 #include <sys/mman.h>
 #ifdef _OS_DARWIN_
@@ -35,6 +38,10 @@ extern "C" {
 
 JL_DEFINE_MUTEX(pagealloc)
 JL_DEFINE_MUTEX(finalizers)
+JL_DEFINE_MUTEX(lazysweep)
+#ifdef JULIA_ENABLE_THREADING
+JL_DEFINE_MUTEX(bigmark)
+#endif
 
 // manipulating mark bits
 
@@ -42,6 +49,15 @@ JL_DEFINE_MUTEX(finalizers)
 #define GC_MARKED 1 // reachable and old
 #define GC_QUEUED 2 // if it is reachable it will be marked as old
 #define GC_MARKED_NOESC (GC_MARKED | GC_QUEUED) // reachable and young
+// or'ed into the bits returned by gc_setmark_* during a parallel mark
+// if the object was already marked (possibly by another thread)
+#define GC_ALREADY_MARKED 4
+
+// parallel marking: the threads of the world thread group share the mark phase.
+// not available with the options that make marking keep global state.
+#if defined(JULIA_ENABLE_THREADING) && !defined(GC_VERIFY) && !defined(OBJPROFILE)
+#define GC_PARALLEL_MARK
+#endif
 
 // This struct must be kept in sync with the Julia type of the same name in base/util.jl
 typedef struct {
@@ -62,6 +78,47 @@ typedef struct {
 
 static GC_Num gc_num = {0,0,0,0,0,0,0,0,0,0,0,0,0};
 
+// Collection statistics, always kept up to date (see jl_gc_stats)
+// This struct must be kept in sync with the Julia type of the same name in base/util.jl
+#define GC_PAUSE_HIST_SIZE 24
+typedef struct {
+    uint64_t    last_mark_time;     // in ns, for the last collection
+    uint64_t    last_sweep_time;
+    uint64_t    last_finalize_time;
+    uint64_t    total_mark_time;
+    uint64_t    total_sweep_time;
+    uint64_t    total_finalize_time;
+    uint64_t    max_pause;
+    int64_t     promoted;           // bytes promoted by the quick collections
+    uint64_t    freed_pages;
+    // pause_hist[0] counts the pauses under 1us, pause_hist[i] the ones in
+    // [2^(i-1), 2^i) us, and the last one also the longer ones
+    uint64_t    pause_hist[GC_PAUSE_HIST_SIZE];
+} GC_Stats;
+
+static GC_Stats gc_stats;
+
+// the pauses of the last GC_PAUSE_LOG_SIZE collections, in ns (see jl_gc_pause_log)
+#define GC_PAUSE_LOG_SIZE 4096
+static uint64_t gc_pause_log[GC_PAUSE_LOG_SIZE];
+static uint64_t gc_pause_log_n;     // pauses logged so far
+
+// Statistics of a thread heap (see jl_gc_heap_stats)
+// This struct must be kept in sync with the Julia type of the same name in base/util.jl
+typedef struct {
+    uint64_t    allocd;             // bytes allocated by the thread
+    uint64_t    poolalloc;          // number of pool allocations
+    uint64_t    bigalloc;           // number of big allocations
+    uint64_t    malloc;             // number of malloc'd array buffers
+    uint64_t    pages;              // pool pages owned by the heap
+    uint64_t    nbig;               // big objects in the list of the heap (not the old ones)
+    uint64_t    big_bytes;
+    uint64_t    nmalloc_arrays;     // arrays with a malloc'd buffer owned by the heap
+    uint64_t    remset_len;         // objects in the remembered set
+    uint64_t    rem_bindings_len;   // bindings in the remembered set
+    uint64_t    remset_ptrs;        // lower bound of the pointers in the remembered objects
+} GC_Heap_Stats;
+
 #define collect_interval gc_num.collect
 #define n_pause         gc_num.pause
 #define n_full_sweep    gc_num.full_sweep
@@ -72,6 +129,22 @@ static GC_Num gc_num = {0,0,0,0,0,0,0,0,0,0,0,0,0};
 #define allocd_bytes_since_sweep gc_num.since_sweep
 static size_t last_long_collect_interval;
 
+// the allocation counters of a thread, so that allocating touches nothing
+// shared. allocd counts up to 0 from -GC_ALLOC_QUOTA: then the thread adds
+// it to allocd_bytes and checks whether it is time to collect (see
+// gc_heap_num_flush). the counts move to gc_num at each collection, and
+// jl_gc_num adds up the ones that haven't yet
+#define GC_ALLOC_QUOTA (256*1024)
+typedef struct {
+    int64_t     allocd;
+    int64_t     freed;
+    uint64_t    malloc;
+    uint64_t    realloc;
+    uint64_t    poolalloc;
+    uint64_t    bigalloc;
+    uint64_t    freecall;
+} gc_heap_num_t;
+
 typedef struct _buff_t {
     union {
         uintptr_t header;
@@ -124,14 +197,19 @@ typedef struct _bigval_t {
 typedef struct _mallocarray_t {
     jl_array_t *a;
     struct _mallocarray_t *next;
+    jl_free_func_t freefunc; // frees foreign data instead of free, if not NULL
+    void *freearg;
 } mallocarray_t;
 
 typedef struct _pool_t {
     gcval_t *freelist;   // root of list of free objects
     gcval_t *newpages;   // root of list of chunks of free objects
+    struct _gcpage_t *lazy_pages; // pages left to be swept by the allocator
+    struct _gcpage_t *volatile remote_pages; // pages swept by the mutators of any thread
     uint16_t end_offset; // stored to avoid computing it at each allocation
     uint16_t osize;      // size of objects in this pool
     uint16_t nfree;      // number of free objects in page pointed into by free_list
+    uint64_t nalloc;     // number of objects allocated from this pool
 } pool_t;
 
 // layout for small (<2k) objects
@@ -143,10 +221,13 @@ typedef struct _pool_t {
 // pool page metadata
 typedef struct _gcpage_t {
     struct {
-        uint16_t pool_n : 8; // index (into norm_pool) of pool that owns this page
-        uint16_t allocd : 1; // true if an allocation happened in this page since last sweep
-        uint16_t gc_bits : 2; // this is a bitwise | of all gc_bits in this page
+        uint8_t pool_n; // index (into norm_pool) of pool that owns this page
+        uint8_t allocd : 1; // true if an allocation happened in this page since last sweep
     };
+    // this is a bitwise | of all gc_bits in this page
+    // (a whole byte so that it can be updated atomically by parallel marking)
+    uint8_t gc_bits;
+    uint8_t lazy; // true if this page is waiting in the lazy_pages list of its pool
     uint16_t nfree; // number of free objects in this page.
                     // invalid if pool that owns this page is allocating objects from this page.
     uint16_t osize; // size of each object in this page
@@ -155,6 +236,9 @@ typedef struct _gcpage_t {
     uint16_t thread_n;        // index (into jl_thread_heap) of heap that owns this page
     char *data;
     uint8_t *ages;
+    struct _gcpage_t *lazy_next;
+    struct _gcpage_t *remote_next;
+    uint64_t freed_at; // when this free page was freed, 0 once it is given back to the OS
 } gcpage_t;
 
 #define PAGE_PFL_BEG(p) ((gcval_t**)((p->data) + (p)->fl_begin_offset))
@@ -192,13 +276,35 @@ static int regions_lb[REGION_COUNT] = {0};
 // an upper bound of the last non-free page
 static int regions_ub[REGION_COUNT] = {REGION_PG_COUNT/32-1};
 
+// free pages are only given back to the OS once they stayed free for
+// gc_decommit_delay, so that the pages freed and allocated again in steady
+// state don't cost a syscall and page faults each time
+static uint64_t gc_decommit_delay = DEFAULT_GC_DECOMMIT_DELAY*1000000; // in ns
+static arraylist_t dirty_pages; // free pages still committed
+static uint64_t gc_sweep_time; // start of the current sweep
+static int gc_huge_pages = DEFAULT_GC_HUGE_PAGES;
+
+// Stack of objects left to mark.
+// The owning thread pushes and pops at `sp`; during a parallel mark the other
+// threads steal from `bottom` while holding `lock`.
+typedef struct {
+    jl_value_t **items;
+    size_t bottom;
+    size_t sp;
+    size_t size;
+    volatile uint64_t lock;
+} gc_mark_stack_t;
+
 // Variables that become fields of a thread-local struct in the thread-safe version.
 typedef struct _jl_thread_heap_t {
     // variable for tracking preserved values.
     arraylist_t preserved_values;
 
-    // variable for tracking weak references
+    // variables for tracking weak references: the ones whose referent may
+    // be young, and the old ones that point to old objects
     arraylist_t weak_refs;
+    arraylist_t weak_refs_old;
+    size_t weak_refs_relisted;
 
     // variables for tracking malloc'd arrays
     mallocarray_t *mallocarrays;
@@ -215,6 +321,26 @@ typedef struct _jl_thread_heap_t {
     arraylist_t *remset;
     arraylist_t *last_remset;
 
+    // variables for marking
+    gc_mark_stack_t mark_stack;
+    int64_t par_scanned_bytes; // scanned_bytes counted by this thread in a parallel mark
+    int64_t par_perm_scanned_bytes; // same for perm_scanned_bytes
+
+    // empty pages kept in the pools of this heap by the last sweep
+    int kept_pages;
+
+    // bytes left to allocate before the next sample of the allocation profiler
+    int64_t alloc_countdown;
+
+    // allocation counters, see gc_heap_num_t
+    gc_heap_num_t num;
+
+    // allocations not counted by the pools (see jl_gc_heap_stats)
+    uint64_t big_allocd;
+    uint64_t nbigalloc;
+    uint64_t malloc_allocd;
+    uint64_t nmalloc;
+
     // variables for allocating objects from pools
 #ifdef _P64
 #define N_POOLS 41
@@ -253,7 +379,7 @@ typedef struct {
 #ifdef JULIA_ENABLE_THREADING
 #define jl_thread_heap (jl_get_ptls_states()->heap)
 #define FOR_EACH_HEAP()                                                 \
-    for (jl_each_heap_index_t __current_heap_idx = {jl_n_threads, NULL}; \
+    for (jl_each_heap_index_t __current_heap_idx = {jl_n_threads + jl_n_foreign_threads, NULL}; \
          --current_heap_index >= 0 &&                                   \
              ((current_heap = jl_all_heaps[current_heap_index]), 1);)
 #define FOR_HEAP(t_n) _FOR_SINGLE_HEAP(jl_all_heaps[t_n])
@@ -270,6 +396,8 @@ static jl_thread_heap_t *const jl_thread_heap = &_jl_thread_heap;
 #define HEAP(x) (current_heap->x)
 #define preserved_values HEAP(preserved_values)
 #define weak_refs HEAP(weak_refs)
+#define weak_refs_old HEAP(weak_refs_old)
+#define weak_refs_relisted HEAP(weak_refs_relisted)
 #define big_objects HEAP(big_objects)
 #define mallocarrays HEAP(mallocarrays)
 #define mafreelist HEAP(mafreelist)
@@ -279,6 +407,74 @@ static jl_thread_heap_t *const jl_thread_heap = &_jl_thread_heap;
 #define rem_bindings HEAP(rem_bindings)
 #define pools HEAP(norm_pools)
 
+// a collection has been started, that the thread has to join by calling
+// jl_gc_collect at its next safepoint
+#ifdef JULIA_ENABLE_THREADING
+#define gc_requested() (__unlikely(jl_gc_running))
+#else
+#define gc_requested() 0
+#endif
+
+// add the bytes allocated by heap to allocd_bytes, returns whether that
+// makes it time to collect
+static NOINLINE int gc_heap_num_flush(jl_thread_heap_t *heap)
+{
+    int64_t n = heap->num.allocd + GC_ALLOC_QUOTA;
+    heap->num.allocd = -GC_ALLOC_QUOTA;
+    return JL_ATOMIC_FETCH_AND_ADD(allocd_bytes, n) + n >= 0 || gc_requested();
+}
+
+// move the counts of all the heaps to gc_num, at a collection
+static void gc_heap_nums_collect(void)
+{
+    FOR_EACH_HEAP () {
+        gc_heap_num_t *hn = &HEAP(num);
+        allocd_bytes += hn->allocd + GC_ALLOC_QUOTA;
+        freed_bytes += hn->freed;
+        gc_num.malloc += hn->malloc;
+        gc_num.realloc += hn->realloc;
+        gc_num.poolalloc += hn->poolalloc;
+        gc_num.bigalloc += hn->bigalloc;
+        gc_num.freecall += hn->freecall;
+        memset(hn, 0, sizeof(gc_heap_num_t));
+        hn->allocd = -GC_ALLOC_QUOTA;
+    }
+}
+
+// the heap of the calling thread, NULL if it isn't a Julia thread; those
+// count their mallocs in allocd_bytes and freed_bytes directly
+static inline jl_thread_heap_t *gc_counting_heap(void)
+{
+#ifdef JULIA_ENABLE_THREADING
+    if (jl_thread_heap == NULL)
+        return NULL;
+#endif
+    return jl_thread_heap;
+}
+
+enum { GC_COUNT_MALLOC, GC_COUNT_REALLOC, GC_COUNT_FREE };
+
+// count a malloc, realloc or free of the calling thread
+static inline void gc_count_malloc(int64_t allocd, int64_t freed, int kind)
+{
+    jl_thread_heap_t *heap = gc_counting_heap();
+    if (heap == NULL) {
+        if (allocd)
+            JL_ATOMIC_FETCH_AND_ADD(allocd_bytes, allocd);
+        if (freed)
+            JL_ATOMIC_FETCH_AND_ADD(freed_bytes, freed);
+        return;
+    }
+    heap->num.allocd += allocd;
+    heap->num.freed += freed;
+    if (kind == GC_COUNT_MALLOC)
+        heap->num.malloc++;
+    else if (kind == GC_COUNT_REALLOC)
+        heap->num.realloc++;
+    else
+        heap->num.freecall++;
+}
+
 // List of marked big objects.  Not per-thread.  Accessed only by master thread.
 static bigval_t *big_objects_marked = NULL;
 
@@ -287,13 +483,38 @@ static arraylist_t finalizer_list;
 static arraylist_t finalizer_list_marked;
 static arraylist_t to_finalize;
 
+// incremental marking: with a pause budget, the mark is cut into slices that
+// stop when the budget is used up and resume at the next allocation points.
+// objects left on the mark stack are already marked, jl_gc_queue_root &
+// gc_queue_binding catch the stores into marked objects between slices and
+// the next slice marks the remset again before resuming.
 static int check_timeout = 0;
-#define should_timeout() 0
+static uint64_t gc_pause_budget = DEFAULT_GC_PAUSE_BUDGET*1000; // in ns, 0 = no limit
+static uint64_t mark_deadline;
+static int timeout_countdown;
+#define TIMEOUT_CHECK_INTERVAL 256 // objects scanned between deadline checks
+#define should_timeout() (check_timeout && mark_deadline_passed())
+
+static int mark_deadline_passed(void)
+{
+    if (--timeout_countdown > 0)
+        return 0;
+    timeout_countdown = TIMEOUT_CHECK_INTERVAL;
+    return jl_hrtime() >= mark_deadline;
+}
 
 #define gc_bits(o) (((gcval_t*)(o))->gc_bits)
 #define gc_marked(o)  (((gcval_t*)(o))->gc_bits & GC_MARKED)
 #define _gc_setmark(o, mark_mode) (((gcval_t*)(o))->gc_bits = mark_mode)
 
+#ifdef GC_PARALLEL_MARK
+static int gc_parallel_mark = DEFAULT_GC_PARALLEL_MARK;
+// set by the master thread while the other threads are marking too
+static volatile int gc_par_marking = 0;
+#else
+#define gc_par_marking 0
+#endif
+
 static gcpage_t *page_metadata(void *data);
 static void pre_mark(void);
 static void post_mark(arraylist_t *list, int dryrun);
@@ -315,18 +536,398 @@ NOINLINE static uintptr_t gc_get_stack_ptr(void)
 
 int jl_in_gc; // referenced from switchto task.c
 static int jl_gc_finalizers_inhibited; // don't run finalizers during codegen #11956
+// the master thread collects from the SIGSEGV handler of a safepoint, leave
+// the finalizers to a collection that runs outside of it
+static int gc_in_signal_safepoint = 0;
+// when set, the collections leave the finalizers to run in to_finalize and
+// signal this handle instead (see jl_gc_defer_finalizers)
+static uv_async_t *finalizer_notify = NULL;
 
 // malloc wrappers, aligned allocation
 
-#if defined(_P64) || defined(__APPLE__)
-#define malloc_a16(sz) malloc(sz)
-#define realloc_a16(p, sz, oldsz) realloc((p), (sz))
-#define free_a16(p) free(p)
+// the blocks are aligned to a cache line so that vector loads of the array
+// data don't straddle two lines. the blocks of at least GC_MAP_MIN_NBYTES are
+// mmap'd instead, the size of a block tells how it was allocated so callers
+// must pass the exact size it was allocated with
+#define GC_HUGE_PAGE_SZ ((size_t)2*1024*1024)
+#define gc_block_is_mapped(sz) ((sz) >= GC_MAP_MIN_NBYTES)
+
+#if defined(MADV_DONTFORK) && !defined(_OS_WINDOWS_)
+// the mapped blocks, as (start, size) pairs, for jl_gc_set_dontfork. they
+// are few since each is at least GC_MAP_MIN_NBYTES
+static arraylist_t gc_mapped_blocks;
+JL_DEFINE_MUTEX(mappedblocks)
+
+static void gc_mapped_add(void *p, size_t sz)
+{
+    JL_LOCK(mappedblocks);
+    if (gc_mapped_blocks.items == NULL)
+        arraylist_new(&gc_mapped_blocks, 0);
+    arraylist_push(&gc_mapped_blocks, p);
+    arraylist_push(&gc_mapped_blocks, (void*)sz);
+    JL_UNLOCK(mappedblocks);
+}
+
+static void gc_mapped_remove(void *p)
+{
+    JL_LOCK(mappedblocks);
+    size_t i, n = gc_mapped_blocks.len;
+    for (i = 0; i < n; i += 2) {
+        if (gc_mapped_blocks.items[i] == p) {
+            gc_mapped_blocks.items[i] = gc_mapped_blocks.items[n - 2];
+            gc_mapped_blocks.items[i + 1] = gc_mapped_blocks.items[n - 1];
+            gc_mapped_blocks.len = n - 2;
+            break;
+        }
+    }
+    JL_UNLOCK(mappedblocks);
+}
+#else
+#define gc_mapped_add(p, sz) ((void)0)
+#define gc_mapped_remove(p) ((void)0)
+#endif
+
+static void *gc_map_alloc(size_t sz)
+{
+#ifdef _OS_WINDOWS_
+    return VirtualAlloc(NULL, sz, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+#else
+    sz = LLT_ALIGN(sz, jl_page_size);
+    size_t mapsz = sz + GC_HUGE_PAGE_SZ;
+    if (mapsz < sz)
+        return NULL;
+    char *mem = (char*)mmap(0, mapsz, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (mem == MAP_FAILED)
+        return NULL;
+    // trim the mapping to start on a huge page boundary, the kernel only
+    // backs the aligned huge pages of a range with huge pages
+    char *b = (char*)LLT_ALIGN((uintptr_t)mem, GC_HUGE_PAGE_SZ);
+    if (b != mem)
+        munmap(mem, b - mem);
+    if (b + sz != mem + mapsz)
+        munmap(b + sz, mem + mapsz - (b + sz));
+#ifdef MADV_HUGEPAGE
+    if (gc_huge_pages)
+        madvise(b, sz, MADV_HUGEPAGE);
+#endif
+    gc_mapped_add(b, sz);
+    return b;
+#endif
+}
+
+static void gc_map_free(void *p, size_t sz)
+{
+#ifdef _OS_WINDOWS_
+    (void)sz;
+    VirtualFree(p, 0, MEM_RELEASE);
 #else
-#define malloc_a16(sz) jl_malloc_aligned(sz, 16)
-#define realloc_a16(p, sz, oldsz) jl_realloc_aligned(p, sz, oldsz, 16)
-#define free_a16(p) jl_free_aligned(p)
+    gc_mapped_remove(p);
+    munmap(p, LLT_ALIGN(sz, jl_page_size));
+#endif
+}
+
+static void *gc_block_malloc(size_t sz)
+{
+    if (gc_block_is_mapped(sz))
+        return gc_map_alloc(sz);
+    return jl_malloc_aligned(sz, ARRAY_MALLOC_ALIGN);
+}
+
+static void gc_block_free(void *p, size_t sz)
+{
+    if (gc_block_is_mapped(sz))
+        gc_map_free(p, sz);
+    else
+        jl_free_aligned(p);
+}
+
+static void *gc_block_realloc(void *p, size_t sz, size_t oldsz)
+{
+    if (!gc_block_is_mapped(sz) && !gc_block_is_mapped(oldsz))
+        return jl_realloc_aligned(p, sz, oldsz, ARRAY_MALLOC_ALIGN);
+#if defined(_OS_LINUX_) && defined(MREMAP_MAYMOVE)
+    if (gc_block_is_mapped(sz) && gc_block_is_mapped(oldsz)) {
+        // the mapping grows in place when the address space after it is
+        // free, otherwise the kernel moves its pages without copying them
+        void *b = mremap(p, LLT_ALIGN(oldsz, jl_page_size),
+                         LLT_ALIGN(sz, jl_page_size), MREMAP_MAYMOVE);
+        if (b == MAP_FAILED)
+            return NULL;
+        gc_mapped_remove(p);
+        gc_mapped_add(b, LLT_ALIGN(sz, jl_page_size));
+        return b;
+    }
+#endif
+    void *b = gc_block_malloc(sz);
+    if (b != NULL) {
+        memcpy(b, p, oldsz > sz ? sz : oldsz);
+        gc_block_free(p, oldsz);
+    }
+    return b;
+}
+
+// cache of freed big blocks
+
+// the blocks between GC_CACHE_MIN and GC_CACHE_MAX bytes are allocated with
+// the size of their class, 4 classes per power of 2, and freed to a list
+// per class. blocks of other sizes go straight to malloc and free.
+#define GC_CACHE_MIN_LG2 16
+#define GC_CACHE_MAX_LG2 26
+#define GC_CACHE_MIN ((size_t)1 << GC_CACHE_MIN_LG2)
+#define GC_CACHE_MAX ((size_t)1 << GC_CACHE_MAX_LG2)
+#define GC_CACHE_NCLASSES ((GC_CACHE_MAX_LG2 - GC_CACHE_MIN_LG2)*4 + 1)
+
+typedef struct _gc_cached_t {
+    struct _gc_cached_t *next;
+    uint64_t freed_at;
+} gc_cached_t;
+
+JL_DEFINE_MUTEX(bigcache)
+static gc_cached_t *gc_cache[GC_CACHE_NCLASSES]; // most recently freed first
+static size_t gc_cache_bytes;
+static size_t gc_cache_max = DEFAULT_GC_BIG_CACHE;
+
+// the class of sz, rounded up or down. sz is between GC_CACHE_MIN and GC_CACHE_MAX
+static int gc_cache_class(size_t sz, int up)
+{
+    int k = 0;
+    for (size_t s = sz; s > 1; s >>= 1)
+        k++;
+    int c = (k - GC_CACHE_MIN_LG2)*4 + (int)(sz >> (k - 2)) - 4;
+    if (up && (sz & (((size_t)1 << (k - 2)) - 1)))
+        c++;
+    return c;
+}
+
+static size_t gc_cache_class_size(int c)
+{
+    return (size_t)(4 + c%4) << (c/4 + GC_CACHE_MIN_LG2 - 2);
+}
+
+// the size of the block allocated for sz bytes
+static size_t gc_cache_size(size_t sz)
+{
+#ifndef MEMDEBUG
+    if (sz >= GC_CACHE_MIN && sz <= GC_CACHE_MAX)
+        return gc_cache_class_size(gc_cache_class(sz, 1));
+#endif
+    return sz;
+}
+
+// allocate a block of at least *sz bytes, *sz is set to its actual size
+static void *gc_cache_malloc(size_t *sz)
+{
+    *sz = gc_cache_size(*sz);
+#ifndef MEMDEBUG
+    if (*sz >= GC_CACHE_MIN && *sz <= GC_CACHE_MAX) {
+        int c = gc_cache_class(*sz, 0);
+        if (gc_cache[c] != NULL) {
+            JL_LOCK(bigcache);
+            gc_cached_t *b = gc_cache[c];
+            if (b != NULL) {
+                gc_cache[c] = b->next;
+                gc_cache_bytes -= *sz;
+            }
+            JL_UNLOCK(bigcache);
+            if (b != NULL)
+                return b;
+        }
+    }
 #endif
+    return gc_block_malloc(*sz);
+}
+
+// free a block of sz bytes allocated with gc_cache_malloc, sz must be the
+// actual size of the block. only called during the sweep
+static void gc_cache_free(void *p, size_t sz)
+{
+#ifndef MEMDEBUG
+    if (sz >= GC_CACHE_MIN && sz <= GC_CACHE_MAX) {
+        int c = gc_cache_class(sz, 0);
+        size_t csz = gc_cache_class_size(c);
+        if (gc_cache_bytes + csz <= gc_cache_max) {
+            gc_cached_t *b = (gc_cached_t*)p;
+            JL_LOCK(bigcache);
+            b->freed_at = gc_sweep_time;
+            b->next = gc_cache[c];
+            gc_cache[c] = b;
+            gc_cache_bytes += csz;
+            JL_UNLOCK(bigcache);
+            return;
+        }
+    }
+#endif
+    gc_block_free(p, sz);
+}
+
+// free the blocks cached for more than gc_decommit_delay
+static void gc_cache_trim(uint64_t now)
+{
+    JL_LOCK(bigcache);
+    for (int c = 0; c < GC_CACHE_NCLASSES; c++) {
+        gc_cached_t **pb = &gc_cache[c];
+        while (*pb != NULL && now - (*pb)->freed_at < gc_decommit_delay)
+            pb = &(*pb)->next;
+        gc_cached_t *b = *pb;
+        *pb = NULL;
+        while (b != NULL) {
+            gc_cached_t *nxt = b->next;
+            gc_block_free(b, gc_cache_class_size(c));
+            gc_cache_bytes -= gc_cache_class_size(c);
+            b = nxt;
+        }
+    }
+    JL_UNLOCK(bigcache);
+}
+
+// sampling allocation profiler
+
+// every alloc_prof_interval bytes allocated by a thread, the size and type of
+// the object being allocated are recorded with a backtrace. the backtraces
+// are stored one after the other, each followed by a 0, like the ones of the
+// sampling profiler. the type of an object is set by the caller of the
+// allocator, so it is only read at the next collection (or when the samples
+// are fetched). until then `type` holds the object, NULL for the buffers.
+typedef struct {
+    jl_value_t *type;
+    size_t size;
+} gc_alloc_sample_t;
+
+JL_DEFINE_MUTEX(allocprof)
+static ptrint_t *alloc_prof_bt = NULL;
+static size_t alloc_prof_bt_max = 0;
+static size_t alloc_prof_bt_len = 0;
+static gc_alloc_sample_t *alloc_prof_samples = NULL;
+static size_t alloc_prof_nsamples = 0;
+static size_t alloc_prof_maxsamples = 0;
+static size_t alloc_prof_nresolved = 0; // samples whose type is known
+static int64_t alloc_prof_interval = 0;
+static volatile int alloc_prof_running = 0;
+
+static void alloc_prof_resolve(void)
+{
+    JL_LOCK(allocprof);
+    for (size_t i = alloc_prof_nresolved; i < alloc_prof_nsamples; i++) {
+        jl_value_t *v = alloc_prof_samples[i].type;
+        if (v != NULL)
+            alloc_prof_samples[i].type = (jl_value_t*)jl_typeof(v);
+    }
+    alloc_prof_nresolved = alloc_prof_nsamples;
+    JL_UNLOCK(allocprof);
+}
+
+static NOINLINE void gc_alloc_sample(jl_value_t *v, size_t sz)
+{
+    FOR_CURRENT_HEAP ()
+        HEAP(alloc_countdown) = alloc_prof_running ? alloc_prof_interval : INT64_MAX;
+    if (!alloc_prof_running)
+        return;
+    JL_LOCK(allocprof);
+    if (alloc_prof_nsamples == alloc_prof_maxsamples) {
+        size_t n = alloc_prof_maxsamples ? alloc_prof_maxsamples*2 : 1024;
+        gc_alloc_sample_t *s = (gc_alloc_sample_t*)realloc(alloc_prof_samples,
+                                                           n*sizeof(gc_alloc_sample_t));
+        if (s != NULL) {
+            alloc_prof_samples = s;
+            alloc_prof_maxsamples = n;
+        }
+    }
+    // keep room for the 0 and at least one frame
+    if (alloc_prof_nsamples < alloc_prof_maxsamples &&
+        alloc_prof_bt_len + 2 <= alloc_prof_bt_max) {
+        alloc_prof_bt_len += rec_backtrace(alloc_prof_bt + alloc_prof_bt_len,
+                                           alloc_prof_bt_max - alloc_prof_bt_len - 1);
+        alloc_prof_bt[alloc_prof_bt_len++] = 0;
+        alloc_prof_samples[alloc_prof_nsamples].type = v;
+        alloc_prof_samples[alloc_prof_nsamples].size = sz;
+        alloc_prof_nsamples++;
+    }
+    JL_UNLOCK(allocprof);
+}
+
+// count the allocation of v (NULL for a buffer) of sz bytes for the profiler
+static inline void gc_alloc_count(jl_value_t *v, size_t sz)
+{
+    FOR_CURRENT_HEAP () {
+        if (__unlikely((HEAP(alloc_countdown) -= sz) < 0))
+            gc_alloc_sample(v, sz);
+    }
+}
+
+JL_DLLEXPORT int jl_alloc_profile_init(size_t maxsize, uint64_t interval)
+{
+    JL_LOCK(allocprof);
+    free(alloc_prof_bt);
+    alloc_prof_bt = (ptrint_t*)calloc(maxsize, sizeof(ptrint_t));
+    alloc_prof_bt_max = alloc_prof_bt == NULL ? 0 : maxsize;
+    alloc_prof_bt_len = 0;
+    alloc_prof_nsamples = alloc_prof_nresolved = 0;
+    alloc_prof_interval = interval > INT64_MAX ? INT64_MAX : (interval == 0 ? 1 : interval);
+    JL_UNLOCK(allocprof);
+    if (alloc_prof_bt == NULL && maxsize > 0)
+        return -1;
+    return 0;
+}
+
+JL_DLLEXPORT void jl_alloc_profile_start(void)
+{
+    alloc_prof_running = 1;
+    FOR_EACH_HEAP ()
+        HEAP(alloc_countdown) = alloc_prof_interval;
+}
+
+JL_DLLEXPORT void jl_alloc_profile_stop(void)
+{
+    alloc_prof_running = 0;
+    FOR_EACH_HEAP ()
+        HEAP(alloc_countdown) = INT64_MAX;
+}
+
+JL_DLLEXPORT int jl_alloc_profile_is_running(void)
+{
+    return alloc_prof_running;
+}
+
+JL_DLLEXPORT uint64_t jl_alloc_profile_interval(void)
+{
+    return alloc_prof_interval;
+}
+
+JL_DLLEXPORT uint8_t *jl_alloc_profile_get_data(void)
+{
+    return (uint8_t*)alloc_prof_bt;
+}
+
+JL_DLLEXPORT size_t jl_alloc_profile_len_data(void)
+{
+    return alloc_prof_bt_len;
+}
+
+JL_DLLEXPORT size_t jl_alloc_profile_maxlen_data(void)
+{
+    return alloc_prof_bt_max;
+}
+
+// the (type, size) pairs of the samples, in the order of the backtraces.
+// should not be called while other threads are allocating
+JL_DLLEXPORT uint8_t *jl_alloc_profile_get_samples(void)
+{
+    alloc_prof_resolve();
+    return (uint8_t*)alloc_prof_samples;
+}
+
+JL_DLLEXPORT size_t jl_alloc_profile_len_samples(void)
+{
+    return alloc_prof_nsamples;
+}
+
+JL_DLLEXPORT void jl_alloc_profile_clear_data(void)
+{
+    JL_LOCK(allocprof);
+    alloc_prof_bt_len = 0;
+    alloc_prof_nsamples = alloc_prof_nresolved = 0;
+    JL_UNLOCK(allocprof);
+}
 
 static void schedule_finalization(void *o, void *f)
 {
@@ -408,7 +1009,7 @@ void jl_gc_inhibit_finalizers(int state)
 {
     // NOTE: currently only called with the codegen lock held, but might need
     // more synchronization in the future
-    if (jl_gc_finalizers_inhibited && !state && !jl_in_gc) {
+    if (jl_gc_finalizers_inhibited && !state && !jl_in_gc && finalizer_notify == NULL) {
         jl_in_gc = 1;
         run_finalizers();
         jl_in_gc = 0;
@@ -428,6 +1029,35 @@ static void schedule_all_finalizers(arraylist_t* flist)
     flist->len = 0;
 }
 
+// hand the finalizers found by the collections to the code waiting on
+// notify, which runs them with jl_gc_run_pending_finalizers, instead of
+// running them at the end of the collection. NULL runs them in the collection
+// again.
+JL_DLLEXPORT void jl_gc_defer_finalizers(uv_async_t *notify)
+{
+    finalizer_notify = notify;
+}
+
+// run at most n of the finalizers left by the collections, returns the number
+// of finalizers still waiting
+JL_DLLEXPORT size_t jl_gc_run_pending_finalizers(size_t n)
+{
+    size_t len = to_finalize.len;
+    if (len == 0)
+        return 0;
+    size_t batch = n*2 < len ? n*2 : len;
+    arraylist_t copied_list;
+    arraylist_new(&copied_list, 0);
+    arraylist_push(&copied_list, NULL); // GC frame size to be filled later
+    arraylist_push(&copied_list, NULL); // pgcstack to be filled later
+    for (size_t i = len - batch; i < len; i++)
+        arraylist_push(&copied_list, to_finalize.items[i]);
+    to_finalize.len -= batch;
+    jl_gc_run_finalizers_in_list(&copied_list);
+    arraylist_free(&copied_list);
+    return to_finalize.len/2;
+}
+
 void jl_gc_run_all_finalizers(void)
 {
     schedule_all_finalizers(&finalizer_list);
@@ -478,6 +1108,30 @@ static region_t *find_region(void *ptr, int maybe)
     return NULL;
 }
 
+// keep the managed heap out of fork()ed children, so that spawning a
+// process does not copy page tables for it. only for use around a fork that
+// is immediately followed by exec (see jl_spawn). this covers the GC page
+// regions and the mapped blocks (big objects and array buffers of at least
+// GC_MAP_MIN_NBYTES). smaller big objects and array buffers come from
+// malloc and share their pages with memory the child may need, so they
+// are still copied.
+void jl_gc_set_dontfork(int dontfork)
+{
+#if defined(MADV_DONTFORK) && !defined(_OS_WINDOWS_)
+    int advice = dontfork ? MADV_DONTFORK : MADV_DOFORK;
+    for (int i = 0; i < REGION_COUNT && regions[i]; i++)
+        madvise(&regions[i]->pages[0][0], sizeof(regions[i]->pages), advice);
+    JL_LOCK(mappedblocks);
+    for (size_t i = 0; i < gc_mapped_blocks.len; i += 2) {
+        madvise(gc_mapped_blocks.items[i],
+                LLT_ALIGN((size_t)gc_mapped_blocks.items[i + 1], jl_page_size), advice);
+    }
+    JL_UNLOCK(mappedblocks);
+#else
+    (void)dontfork;
+#endif
+}
+
 static gcpage_t *page_metadata(void *data)
 {
     region_t *r = find_region(data, 0);
@@ -497,6 +1151,8 @@ static uint8_t *page_age(gcpage_t *pg)
 static int64_t last_gc_total_bytes = 0;
 
 static int gc_inc_steps = 1;
+// the allocation interval between two mark slices
+#define inc_collect_interval (default_collect_interval/8)
 #ifdef _P64
 #define default_collect_interval (5600*1024*sizeof(void*))
 static size_t max_collect_interval = 1250000000UL;
@@ -505,6 +1161,11 @@ static size_t max_collect_interval = 1250000000UL;
 static size_t max_collect_interval =  500000000UL;
 #endif
 
+// soft limit of the heap size in bytes (0 = none): once the heap reaches it
+// the collections are full ones, and the collection interval is shortened so
+// that the heap doesn't grow past it before the next one
+static uint64_t gc_heap_limit = 0;
+
 // global variables for GC stats
 
 #define NS_TO_S(t) ((double)(t/1000)/(1000*1000))
@@ -575,6 +1236,26 @@ static int64_t perm_scanned_bytes; // old bytes scanned while marking
 static int prev_sweep_mask = GC_MARKED;
 static size_t scanned_bytes_goal;
 
+static inline void gc_count_scanned(int old, int64_t sz)
+{
+#ifdef GC_PARALLEL_MARK
+    if (gc_par_marking) {
+        // merged into scanned_bytes & perm_scanned_bytes at the end of the mark
+        FOR_CURRENT_HEAP () {
+            if (old)
+                HEAP(par_perm_scanned_bytes) += sz;
+            else
+                HEAP(par_scanned_bytes) += sz;
+        }
+        return;
+    }
+#endif
+    if (old)
+        perm_scanned_bytes += sz;
+    else
+        scanned_bytes += sz;
+}
+
 #ifdef OBJPROFILE
 static void *BUFFTY = (void*)0xdeadb00f;
 #endif
@@ -620,6 +1301,11 @@ static inline int gc_setmark_big(void *o, int mark_mode)
 #endif
     assert(find_region(o,1) == NULL);
     bigval_t* hdr = bigval_header(o);
+#ifdef GC_PARALLEL_MARK
+    // the big object lists are shared by all the marking threads
+    if (gc_par_marking)
+        JL_LOCK(bigmark);
+#endif
     int bits = gc_bits(o);
     if (bits == GC_QUEUED || bits == GC_MARKED)
         mark_mode = GC_MARKED;
@@ -635,19 +1321,50 @@ static inline int gc_setmark_big(void *o, int mark_mode)
         big_objects_marked = hdr;
     }
     if (!(bits & GC_MARKED)) {
-        if (mark_mode == GC_MARKED)
-            perm_scanned_bytes += hdr->sz&~3;
-        else
-            scanned_bytes += hdr->sz&~3;
+        gc_count_scanned(mark_mode == GC_MARKED, hdr->sz&~3);
 #ifdef OBJPROFILE
         objprofile_count(jl_typeof(o), mark_mode == GC_MARKED, hdr->sz&~3);
 #endif
     }
     _gc_setmark(o, mark_mode);
+#ifdef GC_PARALLEL_MARK
+    if (gc_par_marking) {
+        JL_UNLOCK(bigmark);
+        if (bits & GC_MARKED)
+            mark_mode |= GC_ALREADY_MARKED;
+    }
+#endif
     verify_val(jl_valueof(o));
     return mark_mode;
 }
 
+#ifdef GC_PARALLEL_MARK
+// same as the end of gc_setmark_pool, with the bits of o updated atomically
+// since other threads can be marking the same object
+static inline int gc_par_setmark_pool(void *o, gcpage_t *page, int mark_mode)
+{
+    volatile uintptr_t *header = &((gcval_t*)o)->header;
+    int bits;
+    while (1) {
+        gcval_t prev, next;
+        prev.header = next.header = *header;
+        bits = prev.gc_bits;
+        if (bits == GC_QUEUED || bits == GC_MARKED)
+            mark_mode = GC_MARKED;
+        next.gc_bits = mark_mode;
+        if (bits == mark_mode ||
+            JL_ATOMIC_COMPARE_AND_SWAP(*header, prev.header, next.header))
+            break;
+    }
+    if (!(bits & GC_MARKED))
+        gc_count_scanned(mark_mode == GC_MARKED, page->osize);
+    if ((page->gc_bits & mark_mode) != mark_mode)
+        JL_ATOMIC_FETCH_AND_OR(page->gc_bits, mark_mode);
+    verify_val(jl_valueof(o));
+    return (bits & GC_MARKED) ? (mark_mode | GC_ALREADY_MARKED) : mark_mode;
+}
+#endif
+
 static inline int gc_setmark_pool(void *o, int mark_mode)
 {
 #ifdef GC_VERIFY
@@ -657,15 +1374,16 @@ static inline int gc_setmark_pool(void *o, int mark_mode)
     }
 #endif
     gcpage_t* page = page_metadata(o);
+#ifdef GC_PARALLEL_MARK
+    if (gc_par_marking)
+        return gc_par_setmark_pool(o, page, mark_mode);
+#endif
     int bits = gc_bits(o);
     if (bits == GC_QUEUED || bits == GC_MARKED) {
         mark_mode = GC_MARKED;
     }
     if (!(bits & GC_MARKED)) {
-        if (mark_mode == GC_MARKED)
-            perm_scanned_bytes += page->osize;
-        else
-            scanned_bytes += page->osize;
+        gc_count_scanned(mark_mode == GC_MARKED, page->osize);
 #ifdef OBJPROFILE
         objprofile_count(jl_typeof(o), mark_mode == GC_MARKED, page->osize);
 #endif
@@ -741,6 +1459,12 @@ static NOINLINE void *malloc_page(void)
 #ifdef _OS_WINDOWS_
             VirtualAlloc(region->freemap, REGION_PG_COUNT/8, MEM_COMMIT, PAGE_READWRITE);
             VirtualAlloc(region->meta, REGION_PG_COUNT*sizeof(gcpage_t), MEM_COMMIT, PAGE_READWRITE);
+#endif
+#if !defined(_OS_WINDOWS_) && defined(MADV_HUGEPAGE)
+            // the pages freed inside a huge page split it when they are
+            // given back, which the decommit delay makes rare
+            if (gc_huge_pages)
+                madvise(region->pages, sizeof(region->pages), MADV_HUGEPAGE);
 #endif
             memset(region->freemap, 0xff, REGION_PG_COUNT/8);
             regions[region_i] = region;
@@ -784,21 +1508,18 @@ static NOINLINE void *malloc_page(void)
     return ptr;
 }
 
-static void free_page(void *p)
+#if !defined(_OS_WINDOWS_)
+#ifdef MADV_FREE
+#define GC_MADV_DECOMMIT MADV_FREE
+#else
+#define GC_MADV_DECOMMIT MADV_DONTNEED
+#endif
+#endif
+
+// tell the OS we don't need the free page pg_idx of region right now
+static void decommit_page(region_t *region, int pg_idx)
 {
-    int pg_idx = -1;
-    int i;
-    for(i = 0; i < REGION_COUNT && regions[i] != NULL; i++) {
-        pg_idx = PAGE_INDEX(regions[i], (char*)p+GC_PAGE_OFFSET);
-        if (pg_idx >= 0 && pg_idx < REGION_PG_COUNT) break;
-    }
-    assert(i < REGION_COUNT && regions[i] != NULL);
-    region_t *region = regions[i];
-    uint32_t msk = (uint32_t)(1 << (pg_idx % 32));
-    assert(!(region->freemap[pg_idx/32] & msk));
-    region->freemap[pg_idx/32] ^= msk;
-    free(region->meta[pg_idx].ages);
-    // tell the OS we don't need these pages right now
+    void *p = region->pages[pg_idx];
     size_t decommit_size = GC_PAGE_SZ;
     if (GC_PAGE_SZ < jl_page_size) {
         // ensure so we don't release more memory than intended
@@ -806,35 +1527,82 @@ static void free_page(void *p)
         decommit_size = jl_page_size;
         p = (void*)((uintptr_t)&region->pages[pg_idx][0] & ~(jl_page_size - 1)); // round down to the nearest page
         pg_idx = PAGE_INDEX(region, (char*)p+GC_PAGE_OFFSET);
-        if (pg_idx + n_pages > REGION_PG_COUNT) goto no_decommit;
+        if (pg_idx + n_pages > REGION_PG_COUNT) return;
         for (; n_pages--; pg_idx++) {
-            msk = (uint32_t)(1 << ((pg_idx % 32)));
-            if (!(region->freemap[pg_idx/32] & msk)) goto no_decommit;
+            uint32_t msk = (uint32_t)(1 << ((pg_idx % 32)));
+            if (!(region->freemap[pg_idx/32] & msk)) return;
         }
     }
 #ifdef _OS_WINDOWS_
     VirtualFree(p, decommit_size, MEM_DECOMMIT);
 #else
-    madvise(p, decommit_size, MADV_DONTNEED);
+    madvise(p, decommit_size, GC_MADV_DECOMMIT);
 #endif
-no_decommit:
-    if (regions_lb[i] > pg_idx/32) regions_lb[i] = pg_idx/32;
-    current_pg_count--;
 }
 
-#define should_collect() (__unlikely(allocd_bytes>0))
-
-static inline int maybe_collect(void)
+static void free_page(void *p)
 {
-    if (should_collect() || gc_debug_check_other()) {
-        jl_gc_collect(0);
-        return 1;
+    int pg_idx = -1;
+    int i;
+    for(i = 0; i < REGION_COUNT && regions[i] != NULL; i++) {
+        pg_idx = PAGE_INDEX(regions[i], (char*)p+GC_PAGE_OFFSET);
+        if (pg_idx >= 0 && pg_idx < REGION_PG_COUNT) break;
     }
-    return 0;
-}
-
-
-// preserved values
+    assert(i < REGION_COUNT && regions[i] != NULL);
+    region_t *region = regions[i];
+    uint32_t msk = (uint32_t)(1 << (pg_idx % 32));
+    assert(!(region->freemap[pg_idx/32] & msk));
+    region->freemap[pg_idx/32] ^= msk;
+    free(region->meta[pg_idx].ages);
+    if (gc_decommit_delay) {
+        region->meta[pg_idx].freed_at = gc_sweep_time;
+        arraylist_push(&dirty_pages, region->pages[pg_idx]);
+    }
+    else {
+        decommit_page(region, pg_idx);
+    }
+    if (regions_lb[i] > pg_idx/32) regions_lb[i] = pg_idx/32;
+    current_pg_count--;
+}
+
+// give back to the OS the pages that stayed free for gc_decommit_delay
+static void decommit_free_pages(uint64_t now)
+{
+    size_t n = 0;
+    for (size_t i = 0; i < dirty_pages.len; i++) {
+        char *p = (char*)dirty_pages.items[i];
+        region_t *region = find_region(p, 0);
+        int pg_idx = PAGE_INDEX(region, p + GC_PAGE_OFFSET);
+        gcpage_t *pg = &region->meta[pg_idx];
+        // skip the pages in use again and the duplicates of the ones given back
+        if (!(region->freemap[pg_idx/32] & (uint32_t)(1 << (pg_idx % 32))) ||
+            pg->freed_at == 0)
+            continue;
+        if (now - pg->freed_at < gc_decommit_delay) {
+            dirty_pages.items[n++] = p;
+            continue;
+        }
+        decommit_page(region, pg_idx);
+        pg->freed_at = 0;
+    }
+    dirty_pages.len = n;
+}
+
+#define should_collect() (__unlikely(allocd_bytes>0) || gc_requested())
+
+static inline int maybe_collect(void)
+{
+    jl_thread_heap_t *heap = gc_counting_heap();
+    if ((heap != NULL && __unlikely(heap->num.allocd >= 0) && gc_heap_num_flush(heap)) ||
+        should_collect() || gc_debug_check_other()) {
+        jl_gc_collect(0);
+        return 1;
+    }
+    return 0;
+}
+
+
+// preserved values
 
 JL_DLLEXPORT int jl_gc_n_preserved_values(void)
 {
@@ -870,30 +1638,71 @@ JL_DLLEXPORT jl_weakref_t *jl_gc_new_weakref(jl_value_t *value)
     return wr;
 }
 
-static void sweep_weak_refs(void)
+// An old weak reference to an old object (or to nothing) can't change in a
+// quick collection, so it moves from weak_refs to weak_refs_old, which only
+// the full collections sweep, and the quick collection right after one: a
+// full sweep leaves the live old objects queued, and a referent that
+// nothing reaches anymore is freed by the next sweep. When one is given a
+// young referent it enters the remset, and goes back to weak_refs when the
+// remset is marked. It is then listed twice, the full collections drop the
+// copies.
+static int weakref_is_old(jl_weakref_t *wr)
 {
-    FOR_EACH_HEAP () {
-        size_t n=0, ndel=0, l=weak_refs.len;
-        jl_weakref_t *wr;
-        void **lst = weak_refs.items;
-        void *tmp;
-#define SWAP_wr(a,b) (tmp=a,a=b,b=tmp,1)
-        if (l == 0)
+    return gc_bits(jl_astaggedvalue(wr)) == GC_MARKED &&
+        ((jl_value_t*)wr->value == jl_nothing ||
+         gc_bits(jl_astaggedvalue(wr->value)) == GC_MARKED);
+}
+
+// drop the dead weak references of list and clear the dead referents. the
+// ones that became old move to old, if given
+static void sweep_weak_ref_list(arraylist_t *list, arraylist_t *old)
+{
+    size_t n, nlive = 0, l = list->len;
+    void **lst = list->items;
+    for (n = 0; n < l; n++) {
+        jl_weakref_t *wr = (jl_weakref_t*)lst[n];
+        if (!gc_marked(jl_astaggedvalue(wr)))
             continue;
-        do {
-            wr = (jl_weakref_t*)lst[n];
-            if (gc_marked(jl_astaggedvalue(wr))) {
-                // weakref itself is alive
-                if (!gc_marked(jl_astaggedvalue(wr->value)))
-                    wr->value = (jl_value_t*)jl_nothing;
-                n++;
-            }
-            else {
-                ndel++;
-            }
-        } while ((n < l-ndel) && SWAP_wr(lst[n],lst[n+ndel]));
+        if (!gc_marked(jl_astaggedvalue(wr->value)))
+            wr->value = (jl_value_t*)jl_nothing;
+        if (old != NULL && weakref_is_old(wr))
+            arraylist_push(old, wr);
+        else
+            lst[nlive++] = wr;
+    }
+    list->len = nlive;
+}
+
+static int weakref_cmp(const void *a, const void *b)
+{
+    uintptr_t pa = *(const uintptr_t*)a, pb = *(const uintptr_t*)b;
+    return pa < pb ? -1 : pa > pb;
+}
+
+static void weak_ref_list_unique(arraylist_t *list)
+{
+    if (list->len < 2)
+        return;
+    qsort(list->items, list->len, sizeof(void*), weakref_cmp);
+    size_t n, nuniq = 1;
+    for (n = 1; n < list->len; n++) {
+        if (list->items[n] != list->items[nuniq-1])
+            list->items[nuniq++] = list->items[n];
+    }
+    list->len = nuniq;
+}
 
-        weak_refs.len -= ndel;
+static void sweep_weak_refs(int sweep_mask)
+{
+    FOR_EACH_HEAP () {
+        // prev_sweep_mask is still the one of the last collection
+        if (sweep_mask == GC_MARKED || prev_sweep_mask == GC_MARKED)
+            sweep_weak_ref_list(&weak_refs_old, NULL);
+        sweep_weak_ref_list(&weak_refs, &weak_refs_old);
+        if (sweep_mask == GC_MARKED && weak_refs_relisted > 0) {
+            weak_ref_list_unique(&weak_refs_old);
+            weak_refs_relisted = 0;
+        }
     }
 }
 
@@ -906,11 +1715,9 @@ static NOINLINE void *alloc_big(size_t sz)
     size_t allocsz = LLT_ALIGN(sz + offs, 16);
     if (allocsz < sz)  // overflow in adding offs, size was "negative"
         jl_throw(jl_memory_exception);
-    bigval_t *v = (bigval_t*)malloc_a16(allocsz);
+    bigval_t *v = (bigval_t*)gc_cache_malloc(&allocsz);
     if (v == NULL)
         jl_throw(jl_memory_exception);
-    JL_ATOMIC_FETCH_AND_ADD(allocd_bytes,allocsz);
-    gc_num.bigalloc++;
 #ifdef MEMDEBUG
     memset(v, 0xee, allocsz);
 #endif
@@ -918,6 +1725,10 @@ static NOINLINE void *alloc_big(size_t sz)
     v->flags = 0;
     v->age = 0;
     FOR_CURRENT_HEAP () {
+        HEAP(num).allocd += allocsz;
+        HEAP(num).bigalloc++;
+        HEAP(big_allocd) += allocsz;
+        HEAP(nbigalloc)++;
         v->next = big_objects;
         v->prev = &big_objects;
         if (v->next)
@@ -966,7 +1777,7 @@ static bigval_t** sweep_big_list(int sweep_mask, bigval_t** pv)
 #ifdef MEMDEBUG
             memset(v, 0xbb, v->sz&~3);
 #endif
-            free_a16(v);
+            gc_cache_free(v, v->sz&~3);
             big_freed++;
         }
         big_total++;
@@ -997,6 +1808,17 @@ static void sweep_big(int sweep_mask)
 // tracking Arrays with malloc'd storage
 
 void jl_gc_track_malloced_array(jl_array_t *a)
+{
+    jl_gc_track_foreign_array(a, NULL, NULL);
+}
+
+// the entries of the arrays with a freefunc, for jl_gc_release_foreign_array
+static htable_t foreign_arrays; // array -> mallocarray_t*
+JL_DEFINE_MUTEX(foreign_arrays)
+
+// like jl_gc_track_malloced_array for data that freefunc(data, arg) frees.
+// it is called during the sweep, so it must not call into julia
+void jl_gc_track_foreign_array(jl_array_t *a, jl_free_func_t freefunc, void *arg)
 {
     FOR_CURRENT_HEAP () {
         mallocarray_t *ma;
@@ -1008,32 +1830,97 @@ void jl_gc_track_malloced_array(jl_array_t *a)
             mafreelist = ma->next;
         }
         ma->a = a;
+        ma->freefunc = freefunc;
+        ma->freearg = arg;
         ma->next = mallocarrays;
         mallocarrays = ma;
+        if (freefunc != NULL) {
+            JL_LOCK(foreign_arrays);
+            ptrhash_put(&foreign_arrays, a, ma);
+            JL_UNLOCK(foreign_arrays);
+        }
+    }
+}
+
+// whether freefunc frees the data of a
+int jl_gc_is_foreign_array(jl_array_t *a)
+{
+    JL_LOCK(foreign_arrays);
+    int foreign = ptrhash_get(&foreign_arrays, a) != HT_NOTFOUND;
+    JL_UNLOCK(foreign_arrays);
+    return foreign;
+}
+
+// the data of a foreign array can't be realloc'd. once it is copied into a
+// buffer of the gc, the original goes back to its owner here, and the array
+// frees its new buffer like any malloc'd one
+void jl_gc_release_foreign_array(jl_array_t *a, void *data)
+{
+    JL_LOCK(foreign_arrays);
+    mallocarray_t *ma = (mallocarray_t*)ptrhash_get(&foreign_arrays, a);
+    assert(ma != HT_NOTFOUND);
+    ptrhash_remove(&foreign_arrays, a);
+    jl_free_func_t freefunc = ma->freefunc;
+    ma->freefunc = NULL;
+    JL_UNLOCK(foreign_arrays);
+    freefunc(data, ma->freearg);
+}
+
+// lambda infos with type feedback, which is only gathered with one thread
+// (see feedback_of in interpreter.c)
+static arraylist_t feedback_lambdas;
+
+void jl_gc_track_feedback(jl_lambda_info_t *li)
+{
+    arraylist_push(&feedback_lambdas, li);
+}
+
+static void sweep_feedback(void)
+{
+    size_t i, j = 0;
+    for (i = 0; i < feedback_lambdas.len; i++) {
+        jl_lambda_info_t *li = (jl_lambda_info_t*)feedback_lambdas.items[i];
+        if (gc_marked(jl_astaggedvalue(li)))
+            feedback_lambdas.items[j++] = li;
+        else
+            jl_free_feedback(li);
     }
+    feedback_lambdas.len = j;
 }
 
 void jl_gc_count_allocd(size_t sz)
 {
-    allocd_bytes += sz;
+    FOR_CURRENT_HEAP ()
+        HEAP(num).allocd += sz;
 }
 
+// the size the data of a was allocated with, by jl_new_array or
+// array_resize_buffer, including the hidden 0 terminator of byte arrays
 static size_t array_nbytes(jl_array_t *a)
 {
     size_t sz = 0;
     if (jl_array_ndims(a)==1)
-        sz = a->elsize * a->maxsize + (a->elsize == 1 ? 1 : 0);
+        sz = a->elsize * a->maxsize;
     else
         sz = a->elsize * jl_array_len(a);
+    if (a->elsize == 1)
+        sz++;
     return sz;
 }
 
-static void jl_gc_free_array(jl_array_t *a)
+static void jl_gc_free_array(mallocarray_t *ma)
 {
+    jl_array_t *a = ma->a;
     if (a->how == 2) {
         char *d = (char*)a->data - a->offset*a->elsize;
-        if (a->isaligned)
-            free_a16(d);
+        if (ma->freefunc != NULL) {
+            JL_LOCK(foreign_arrays);
+            ptrhash_remove(&foreign_arrays, a);
+            JL_UNLOCK(foreign_arrays);
+            ma->freefunc(d, ma->freearg);
+        }
+        else if (a->isaligned)
+            gc_cache_free(d, gc_cache_size(LLT_ALIGN(array_nbytes(a), 16)));
         else
             free(d);
         freed_bytes += array_nbytes(a);
@@ -1057,7 +1944,7 @@ static void sweep_malloced_arrays(void)
             else {
                 *pma = nxt;
                 assert(ma->a->how == 2);
-                jl_gc_free_array(ma->a);
+                jl_gc_free_array(ma);
                 ma->next = mafreelist;
                 mafreelist = ma;
                 mallocd_array_freed++;
@@ -1072,6 +1959,7 @@ static void sweep_malloced_arrays(void)
 static inline gcval_t *reset_page(pool_t *p, gcpage_t *pg, gcval_t *fl)
 {
     pg->gc_bits = 0;
+    pg->lazy = 0;
     pg->nfree = (GC_PAGE_SZ - GC_PAGE_OFFSET) / p->osize;
     FOR_HEAP (pg->thread_n)
         pg->pool_n = p - pools;
@@ -1099,21 +1987,56 @@ static NOINLINE void add_page(pool_t *p)
     p->newpages = fl;
 }
 
-static inline void *__pool_alloc(pool_t* p, int osize, int end_offset)
+static void sweep_lazy_pages(pool_t *p);
+
+// bump allocate v from the empty pages of p
+static inline gcval_t *pool_bump_alloc(pool_t *p, gcval_t *v, int osize, int end_offset)
+{
+    gcval_t *end = (gcval_t*)&(GC_PAGE_DATA(v)[end_offset]);
+    if (__likely(v != end)) {
+        p->newpages = (gcval_t*)((char*)v + osize);
+    }
+    else {
+        // like the freelist case, but only update the page metadata when it is full
+        gcpage_t* pg = page_metadata(v);
+        assert(pg->osize == p->osize);
+        pg->nfree = 0;
+        pg->allocd = 1;
+        p->newpages = v->next;
+    }
+    v->flags = 0;
+    return v;
+}
+
+static inline void *__pool_alloc(jl_thread_heap_t *heap, pool_t* p, int osize,
+                                 int end_offset)
 {
 #ifdef MEMDEBUG
     assert(0 && "Should not be using pools in MEMDEBUG mode");
 #endif
-    gcval_t *v, *end;
-    // FIXME - need JL_ATOMIC_FETCH_AND_ADD here
-    if (__unlikely((allocd_bytes += osize) >= 0) || gc_debug_check_pool()) {
-        //allocd_bytes -= osize;
+    gcval_t *v;
+    // the thread-local count is the only thing touched on the fast path
+    if (__unlikely((heap->num.allocd += osize) >= 0 || gc_requested())) {
+        if (gc_heap_num_flush(heap))
+            jl_gc_collect(0);
+    }
+    else if (gc_debug_check_pool()) {
         jl_gc_collect(0);
-        //allocd_bytes += osize;
     }
-    gc_num.poolalloc++;
-    // first try to use the freelist
+    heap->num.poolalloc++;
+    p->nalloc++;
+    // first use the empty pages kept by the sweep: objects allocated together
+    // stay next to each other and the young ones that die together free
+    // whole pages again
+    v = p->newpages;
+    if (v)
+        return pool_bump_alloc(p, v, osize, end_offset);
+    // then fill the holes of the freelist
     v = p->freelist;
+    if (__unlikely(!v && (p->lazy_pages || p->remote_pages))) {
+        sweep_lazy_pages(p);
+        v = p->freelist;
+    }
     if (v) {
         gcval_t* next = v->next;
         v->flags = 0;
@@ -1131,39 +2054,21 @@ static inline void *__pool_alloc(pool_t* p, int osize, int end_offset)
         }
         return v;
     }
-    // if the freelist is empty we reuse empty but not freed pages
-    v = p->newpages;
-    if (__unlikely(!v)) {
-        add_page(p);
-        v = p->newpages;
-    }
-    end = (gcval_t*)&(GC_PAGE_DATA(v)[end_offset]);
-    if (__likely(v != end)) {
-        p->newpages = (gcval_t*)((char*)v + osize);
-    }
-    else {
-        // like the freelist case, but only update the page metadata when it is full
-        gcpage_t* pg = page_metadata(v);
-        assert(pg->osize == p->osize);
-        pg->nfree = 0;
-        pg->allocd = 1;
-        p->newpages = v->next;
-    }
-    v->flags = 0;
-    return v;
+    add_page(p);
+    return pool_bump_alloc(p, p->newpages, osize, end_offset);
 }
 
 // use this variant when osize is statically known
 // and is definitely in sizeclasses
 // GC_POOL_END_OFS uses an integer division
-static inline void *_pool_alloc(pool_t *p, int osize)
+static inline void *_pool_alloc(jl_thread_heap_t *heap, pool_t *p, int osize)
 {
-    return __pool_alloc(p, osize, GC_POOL_END_OFS(osize));
+    return __pool_alloc(heap, p, osize, GC_POOL_END_OFS(osize));
 }
 
-static inline void *pool_alloc(pool_t *p)
+static inline void *pool_alloc(jl_thread_heap_t *heap, pool_t *p)
 {
-    return __pool_alloc(p, p->osize, p->end_offset);
+    return __pool_alloc(heap, p, p->osize, p->end_offset);
 }
 
 // pools are 16376 bytes large (GC_POOL_SZ - GC_PAGE_OFFSET)
@@ -1227,6 +2132,110 @@ static int freed_pages = 0;
 static int lazy_freed_pages = 0;
 static int page_done = 0;
 static gcval_t** sweep_page(pool_t* p, gcpage_t* pg, gcval_t **pfl,int,int);
+
+// lazy sweeping: on a quick sweep, a page where all the marked objects are
+// old keeps the same gc bits once swept, so building its freelist is left to
+// the allocator (see sweep_lazy_pages). the next sweep takes care of the pages
+// that are still waiting by then. jl_gc_queue_root & gc_queue_binding change
+// the bits of old objects and sweep their page first.
+static int gc_lazy_sweep = DEFAULT_GC_LAZY_SWEEP;
+static int lazy_sweep_pending = 0; // some pages are waiting to be swept
+
+// returns 1 if the caller has to sweep pg, which is taken off the lazy lists
+static int lazy_sweep_claim(gcpage_t *pg)
+{
+    JL_LOCK(lazysweep);
+    int claimed = pg->lazy;
+    pg->lazy = 0;
+    JL_UNLOCK(lazysweep);
+    return claimed;
+}
+
+// the pages swept by sweep_lazy_page_of go back to the pool they belong to
+// through a lock-free stack, and their free objects are picked up by its
+// allocator
+static void push_remote_page(pool_t *p, gcpage_t *pg)
+{
+    gcpage_t *head;
+    do {
+        head = p->remote_pages;
+        pg->remote_next = head;
+    } while (!JL_ATOMIC_COMPARE_AND_SWAP(p->remote_pages, head, pg));
+}
+
+// put the free objects of the pages pushed by push_remote_page in the freelist
+static void take_remote_pages(pool_t *p)
+{
+    gcpage_t *pg;
+    do {
+        pg = p->remote_pages;
+    } while (!JL_ATOMIC_COMPARE_AND_SWAP(p->remote_pages, pg, NULL));
+    if (pg == NULL)
+        return;
+    // chain the freelists stored in the pages
+    gcval_t **pfl = &p->freelist;
+    p->nfree = pg->nfree;
+    for (; pg != NULL; pg = pg->remote_next) {
+        *pfl = (gcval_t*)PAGE_PFL_BEG(pg);
+        pfl = PAGE_PFL_END(pg);
+    }
+    *pfl = NULL;
+}
+
+// sweep the pages left for the allocator until p has a freelist again
+static NOINLINE void sweep_lazy_pages(pool_t *p)
+{
+    if (p->remote_pages != NULL) {
+        take_remote_pages(p);
+        if (p->freelist != NULL)
+            return;
+    }
+    while (p->lazy_pages != NULL && p->freelist == NULL) {
+        gcpage_t *pg = p->lazy_pages;
+        p->lazy_pages = pg->lazy_next;
+        if (!lazy_sweep_claim(pg))
+            continue;
+        gcval_t **pfl = sweep_page(p, pg, &p->freelist, GC_MARKED_NOESC, pg->osize);
+        *pfl = NULL;
+        if (p->freelist)
+            p->nfree = pg->nfree;
+    }
+}
+
+// a new mark changes the bits the waiting pages would be swept with, so they
+// are left to the next sweep
+static void cancel_lazy_sweep(void)
+{
+    if (!lazy_sweep_pending)
+        return;
+    FOR_EACH_HEAP () {
+        for (int i = 0; i < N_POOLS; i++) {
+            pools[i].lazy_pages = NULL;
+            pools[i].remote_pages = NULL;
+        }
+    }
+    lazy_sweep_pending = 0;
+}
+
+// sweep the page of o if it is waiting to be swept, before o's bits change
+static NOINLINE void sweep_lazy_page_of(void *o)
+{
+    region_t *r = find_region(o, 1);
+    if (r == NULL || !gc_marked(o))
+        return;
+    gcpage_t *pg = &r->meta[PAGE_INDEX(r, (char*)o)];
+    if (!pg->lazy || !lazy_sweep_claim(pg))
+        return;
+    pool_t *p;
+    FOR_HEAP (pg->thread_n)
+        p = &pools[pg->pool_n];
+    // the page can belong to another thread, so it is handed back to its
+    // pool instead of being added to a freelist here
+    gcval_t *fl;
+    sweep_page(p, pg, &fl, GC_MARKED_NOESC, pg->osize);
+    if (pg->fl_begin_offset != (uint16_t)-1)
+        push_remote_page(p, pg);
+}
 static void sweep_pool_region(gcval_t ***pfl, int region_i, int sweep_mask)
 {
     region_t* region = regions[region_i];
@@ -1247,6 +2256,15 @@ static void sweep_pool_region(gcval_t ***pfl, int region_i, int sweep_mask)
                     FOR_HEAP (t_n)
                         p = &pools[p_n];
                     int osize = pg->osize;
+                    pg->lazy = 0;
+                    if (gc_lazy_sweep && sweep_mask == GC_MARKED_NOESC &&
+                        pg->gc_bits == GC_MARKED && pg->allocd) {
+                        pg->lazy = 1;
+                        pg->lazy_next = p->lazy_pages;
+                        p->lazy_pages = pg;
+                        lazy_sweep_pending = 1;
+                        continue;
+                    }
                     pfl[t_n * N_POOLS + p_n] = sweep_page(p, pg, pfl[t_n * N_POOLS + p_n], sweep_mask, osize);
                 }
             }
@@ -1346,15 +2364,18 @@ static gcval_t** sweep_page(pool_t* p, gcpage_t* pg, gcval_t **pfl, int sweep_ma
     // the eager one uses less memory.
     pg_total++;
     if (freedall) {
-        // FIXME - need to do accounting on a per-thread basis
         // on quick sweeps, keep a few pages empty but allocated for performance
-        if (sweep_mask == GC_MARKED_NOESC && lazy_freed_pages <= default_collect_interval/GC_PAGE_SZ) {
+        int *kept_pages;
+        FOR_HEAP (pg->thread_n)
+            kept_pages = &HEAP(kept_pages);
+        if (sweep_mask == GC_MARKED_NOESC && *kept_pages <= default_collect_interval/GC_PAGE_SZ) {
             gcval_t *begin = reset_page(p, pg, 0);
             gcval_t** pend = (gcval_t**)((char*)begin + ((int)pg->nfree - 1)*osize);
             gcval_t* npg = p->newpages;
             *pend = npg;
             p->newpages = begin;
             begin->next = (gcval_t*)0;
+            (*kept_pages)++;
             lazy_freed_pages++;
             pfl = prev_pfl;
         }
@@ -1381,7 +2402,8 @@ static gcval_t** sweep_page(pool_t* p, gcpage_t* pg, gcval_t **pfl, int sweep_ma
 
     skipped_pages += pg_skpd;
     total_pages += pg_total;
-    freed_bytes += (nfree - old_nfree)*osize;
+    // the allocators of any thread sweep the lazy pages
+    JL_ATOMIC_FETCH_AND_ADD(freed_bytes, (int64_t)(nfree - old_nfree)*osize);
     return pfl;
 }
 
@@ -1392,7 +2414,10 @@ static void gc_sweep_once(int sweep_mask)
     mallocd_array_total = 0;
     mallocd_array_freed = 0;
 #endif
+    gc_sweep_time = jl_hrtime();
+    gc_cache_trim(gc_sweep_time);
     sweep_malloced_arrays();
+    sweep_feedback();
 #ifdef GC_TIME
     jl_printf(JL_STDOUT, "GC sweep arrays %.2f (freed %d/%d)\n", (jl_clock_now() - t0)*1000, mallocd_array_freed, mallocd_array_total);
     t0 = jl_clock_now();
@@ -1417,9 +2442,11 @@ static int gc_sweep_inc(int sweep_mask)
     freed_pages = 0;
     lazy_freed_pages = 0;
     page_done = 0;
+    lazy_sweep_pending = 0;
+    gc_sweep_time = jl_hrtime();
     int finished = 1;
 
-    gcval_t ***pfl = (gcval_t ***) alloca(jl_n_threads * N_POOLS * sizeof(gcval_t**));
+    gcval_t ***pfl = (gcval_t ***) alloca((jl_n_threads + jl_n_foreign_threads) * N_POOLS * sizeof(gcval_t**));
 
     // update metadata of pages that were pointed to by freelist or newpages from a pool
     // i.e. pages being the current allocation target
@@ -1442,13 +2469,20 @@ static int gc_sweep_inc(int sweep_mask)
                 pg->allocd = 1;
             }
             p->newpages = NULL;
+            // the pages that haven't been swept since the last sweep are
+            // swept again from scratch
+            p->lazy_pages = NULL;
+            p->remote_pages = NULL;
         }
+        HEAP(kept_pages) = 0;
     }
 
     for (int i = 0; i < REGION_COUNT; i++) {
         if (regions[i])
             /*finished &= */sweep_pool_region(pfl, i, sweep_mask);
     }
+    decommit_free_pages(gc_sweep_time);
+    gc_stats.freed_pages += freed_pages;
 
 
     // null out terminal pointers of free lists and cache back pg->nfree in the pool_t
@@ -1472,28 +2506,73 @@ static int gc_sweep_inc(int sweep_mask)
 
 // mark phase
 
-static jl_value_t **mark_stack = NULL;
-static jl_value_t **mark_stack_base = NULL;
-static size_t mark_stack_size = 0;
-static size_t mark_sp = 0;
-
+// number of objects on the mark stack of the current thread
+#define mark_sp (jl_thread_heap->mark_stack.sp - jl_thread_heap->mark_stack.bottom)
 
-static void grow_mark_stack(void)
+static void grow_mark_stack(gc_mark_stack_t *s)
 {
-    size_t newsz = mark_stack_size>0 ? mark_stack_size*2 : 32000;
-    size_t offset = mark_stack - mark_stack_base;
-    mark_stack_base = (jl_value_t**)realloc(mark_stack_base, newsz*sizeof(void*));
-    if (mark_stack_base == NULL) {
+    size_t newsz = s->size>0 ? s->size*2 : 32000;
+    s->items = (jl_value_t**)realloc(s->items, newsz*sizeof(void*));
+    if (s->items == NULL) {
         jl_printf(JL_STDERR, "Couldn't grow mark stack to : %" PRIuPTR "\n",
                   (uintptr_t)newsz);
         exit(1);
     }
-    mark_stack = mark_stack_base + offset;
-    mark_stack_size = newsz;
+    s->size = newsz;
 }
 
 static int max_msp = 0;
 
+#if defined(__GNUC__)
+#define gc_prefetch(p) __builtin_prefetch(p)
+#else
+#define gc_prefetch(p) ((void)(p))
+#endif
+
+#ifdef GC_PARALLEL_MARK
+#define gc_mark_stack_lock(s) do {                                      \
+        if (gc_par_marking) {                                           \
+            while (JL_ATOMIC_TEST_AND_SET((s)->lock))                   \
+                cpu_pause();                                            \
+        }                                                               \
+    } while (0)
+#define gc_mark_stack_unlock(s) do {                                    \
+        if (gc_par_marking)                                             \
+            JL_ATOMIC_RELEASE((s)->lock);                               \
+    } while (0)
+#else
+#define gc_mark_stack_lock(s) do {} while (0)
+#define gc_mark_stack_unlock(s) do {} while (0)
+#endif
+
+static void gc_mark_stack_push(jl_value_t *v)
+{
+    FOR_CURRENT_HEAP () {
+        gc_mark_stack_t *s = &HEAP(mark_stack);
+        gc_mark_stack_lock(s);
+        if (s->sp >= s->size) grow_mark_stack(s);
+        s->items[s->sp++] = v;
+        gc_mark_stack_unlock(s);
+        max_msp = max_msp > s->sp ? max_msp : s->sp;
+    }
+}
+
+// returns NULL if the stack is empty
+static inline jl_value_t *gc_mark_stack_pop(gc_mark_stack_t *s)
+{
+    jl_value_t *v = NULL;
+    gc_mark_stack_lock(s);
+    if (s->sp > s->bottom) {
+        v = s->items[--s->sp];
+        if (s->sp == s->bottom)
+            s->sp = s->bottom = 0;
+        else // the next object to be scanned
+            gc_prefetch(jl_astaggedvalue(s->items[s->sp - 1]));
+    }
+    gc_mark_stack_unlock(s);
+    return v;
+}
+
 static void reset_remset(void)
 {
     FOR_EACH_HEAP () {
@@ -1519,6 +2598,8 @@ JL_DLLEXPORT void jl_gc_queue_root(jl_value_t *ptr)
         // should be safe here since GC is not allowed to run here and we only
         // write GC_QUEUED to the GC bits outside GC. This could cause
         // duplicated objects in the remset but that shouldn't be a problem.
+        if (__unlikely(lazy_sweep_pending))
+            sweep_lazy_page_of(o);
         gc_bits(o) = GC_QUEUED;
         arraylist_push(remset, ptr);
         remset_nptr++; // conservative
@@ -1533,16 +2614,121 @@ void gc_queue_binding(jl_binding_t *bnd)
         // Will fail for multithreading. See `jl_gc_queue_root`
         assert(gc_bits(buf) != GC_QUEUED);
 #endif
+        if (__unlikely(lazy_sweep_pending))
+            sweep_lazy_page_of(buf);
         gc_bits(buf) = GC_QUEUED;
         arraylist_push(&rem_bindings, bnd);
     }
 }
 
-static int push_root(jl_value_t *v, int d, int);
+// card marking: big old arrays of pointers are not put in the remset as a
+// whole when one of their elements is written, instead the write barrier
+// dirties the card (GC_CARD_LEN consecutive slots) holding the element and
+// only the dirty cards are scanned by the next mark. cards are numbered from
+// the start of the buffer so that changing the offset keeps them valid, a new
+// buffer makes every card dirty. code moving elements inside a buffer has to
+// call jl_gc_array_moved.
+#define GC_CARD_LG2 7
+#define GC_CARD_LEN (1 << GC_CARD_LG2)
+#define GC_CARD_MIN_LEN (64*GC_CARD_LEN)
+
+typedef struct {
+    jl_array_t *a;
+    jl_value_t **buf; // the buffer the cards were made for
+    size_t ncards;
+    uint8_t *dirty; // one byte per card, set if it may point to young objects
+    int queued; // in card_arrays
+} gc_cards_t;
+
+JL_DEFINE_MUTEX(cards)
+static htable_t array_cards; // array -> gc_cards_t*
+static arraylist_t card_arrays; // gc_cards_t* with dirty cards
+
+static inline int gc_use_cards(jl_array_t *a)
+{
+#ifdef GC_VERIFY
+    // the verifier expects every old object with young references in the remset
+    return 0;
+#else
+    // only vectors: the cards are sized from maxsize, which is the number of
+    // columns of the arrays with more dimensions
+    return a->ptrarray && a->how != 3 && jl_array_ndims(a) == 1 &&
+        jl_array_len(a) >= GC_CARD_MIN_LEN;
+#endif
+}
+
+// the cards of a, NULL if it has none and !create. called with the cards lock
+static gc_cards_t *gc_array_cards(jl_array_t *a, int create)
+{
+    jl_value_t **buf = (jl_value_t**)a->data - a->offset;
+    size_t ncards = (a->maxsize + GC_CARD_LEN - 1) >> GC_CARD_LG2;
+    gc_cards_t *c = (gc_cards_t*)ptrhash_get(&array_cards, a);
+    if (c == HT_NOTFOUND) {
+        if (!create)
+            return NULL;
+        c = (gc_cards_t*)malloc(sizeof(gc_cards_t));
+        c->a = a;
+        c->buf = NULL;
+        c->ncards = 0;
+        c->dirty = NULL;
+        c->queued = 0;
+        ptrhash_put(&array_cards, a, c);
+    }
+    if (c->buf != buf || c->ncards != ncards) {
+        // the elements are not where the cards say they are anymore
+        c->buf = buf;
+        c->ncards = ncards;
+        c->dirty = (uint8_t*)realloc(c->dirty, ncards);
+        memset(c->dirty, 1, ncards);
+        if (!c->queued) {
+            c->queued = 1;
+            arraylist_push(&card_arrays, c);
+        }
+    }
+    return c;
+}
+
+JL_DLLEXPORT void jl_gc_queue_slot(jl_value_t *parent, void *slot)
+{
+    jl_gc_queue_slots(parent, slot, 1);
+}
+
+// like jl_gc_queue_slot for the n consecutive slots from slot on
+JL_DLLEXPORT void jl_gc_queue_slots(jl_value_t *parent, void *slot, size_t n)
+{
+    jl_array_t *a = (jl_array_t*)parent;
+    if (gc_bits(jl_astaggedvalue(parent)) == GC_MARKED && jl_is_array(parent) &&
+        gc_use_cards(a) && n > 0) {
+        jl_value_t **buf = (jl_value_t**)a->data - a->offset;
+        size_t i = (jl_value_t**)slot - buf;
+        if ((jl_value_t**)slot >= buf && i + n <= a->maxsize) {
+            JL_LOCK(cards);
+            gc_cards_t *c = gc_array_cards(a, 1);
+            size_t c0 = i >> GC_CARD_LG2, c1 = (i + n - 1) >> GC_CARD_LG2;
+            memset(&c->dirty[c0], 1, c1 - c0 + 1);
+            if (!c->queued) {
+                c->queued = 1;
+                arraylist_push(&card_arrays, c);
+            }
+            JL_UNLOCK(cards);
+            return;
+        }
+    }
+    jl_gc_queue_root(parent);
+}
+
+JL_DLLEXPORT void jl_gc_array_moved(jl_array_t *a)
+{
+    // the elements will be scanned again as a whole
+    if (a->ptrarray)
+        jl_gc_wb_back(a);
+}
+
+static int gc_mark_obj(jl_value_t *v, int bits);
 #ifdef JL_DEBUG_BUILD
 static void *volatile gc_findval; // for usage from gdb, for finding the gc-root for a value
 #endif
-static inline int gc_push_root(void *v, int d) // v isa jl_value_t*
+static inline int gc_push_root(void *v) // v isa jl_value_t*
 {
 #ifdef JL_DEBUG_BUILD
     if (v == gc_findval)
@@ -1553,7 +2739,7 @@ static inline int gc_push_root(void *v, int d) // v isa jl_value_t*
     verify_val(v);
     int bits = gc_bits(o);
     if (!gc_marked(o)) {
-        return push_root((jl_value_t*)v, d, bits);
+        return gc_mark_obj((jl_value_t*)v, bits);
     }
     return bits;
 }
@@ -1573,7 +2759,7 @@ void jl_gc_setmark(jl_value_t *v) // TODO rename this as it is misleading now
     //    perm_scanned_bytes = s;
 }
 
-NOINLINE static int gc_mark_module(jl_module_t *m, int d)
+NOINLINE static int gc_mark_module(jl_module_t *m)
 {
     size_t i;
     int refyoung = 0;
@@ -1589,10 +2775,10 @@ NOINLINE static int gc_mark_module(jl_module_t *m, int d)
             if (b->value != NULL) {
                 verify_parent2("module", m, &b->value, "binding(%s)",
                                jl_symbol_name(b->name));
-                refyoung |= gc_push_root(b->value, d);
+                refyoung |= gc_push_root(b->value);
             }
             if (b->globalref != NULL)
-                refyoung |= gc_push_root(b->globalref, d);
+                refyoung |= gc_push_root(b->globalref);
         }
     }
     // this is only necessary because bindings for "using" modules
@@ -1600,21 +2786,21 @@ NOINLINE static int gc_mark_module(jl_module_t *m, int d)
     // after "using" it but before accessing it, this array might
     // contain the only reference.
     for(i=0; i < m->usings.len; i++) {
-        refyoung |= gc_push_root(m->usings.items[i], d);
+        refyoung |= gc_push_root(m->usings.items[i]);
     }
     if (m->constant_table) {
         verify_parent1("module", m, &m->constant_table, "constant_table");
-        refyoung |= gc_push_root(m->constant_table, d);
+        refyoung |= gc_push_root(m->constant_table);
     }
 
     if (m->parent) {
-        refyoung |= gc_push_root(m->parent, d);
+        refyoung |= gc_push_root(m->parent);
     }
 
     return refyoung;
 }
 
-static void gc_mark_stack(jl_value_t* ta, jl_gcframe_t *s, ptrint_t offset, int d)
+static void gc_mark_stack(jl_value_t* ta, jl_gcframe_t *s, ptrint_t offset)
 {
     while (s != NULL) {
         s = (jl_gcframe_t*)((char*)s + offset);
@@ -1624,14 +2810,14 @@ static void gc_mark_stack(jl_value_t* ta, jl_gcframe_t *s, ptrint_t offset, int
             for(size_t i=0; i < nr; i++) {
                 jl_value_t **ptr = (jl_value_t**)((char*)rts[i] + offset);
                 if (*ptr != NULL)
-                    gc_push_root(*ptr, d);
+                    gc_push_root(*ptr);
             }
         }
         else {
             for(size_t i=0; i < nr; i++) {
                 if (rts[i] != NULL) {
                     verify_parent2("task", ta, &rts[i], "stack(%d)", (int)i);
-                    gc_push_root(rts[i], d);
+                    gc_push_root(rts[i]);
                 }
             }
         }
@@ -1639,19 +2825,17 @@ static void gc_mark_stack(jl_value_t* ta, jl_gcframe_t *s, ptrint_t offset, int
     }
 }
 
-static void gc_mark_task_stack(jl_task_t *ta, int d)
+static void gc_mark_task_stack(jl_task_t *ta)
 {
     int stkbuf = (ta->stkbuf != (void*)(intptr_t)-1 && ta->stkbuf != NULL);
     int16_t tid = ta->tid;
     jl_tls_states_t *ptls = jl_all_task_states[tid].ptls;
-    if (stkbuf) {
-#ifndef COPY_STACKS
-        if (ta != ptls->root_task) // stkbuf isn't owned by julia for the root task
-#endif
+#ifdef COPY_STACKS
+    if (stkbuf)
         gc_setmark_buf(ta->stkbuf, gc_bits(jl_astaggedvalue(ta)));
-    }
+#endif
     if (ta == ptls->current_task) {
-        gc_mark_stack((jl_value_t*)ta, ptls->pgcstack, 0, d);
+        gc_mark_stack((jl_value_t*)ta, ptls->pgcstack, 0);
     }
     else if (stkbuf) {
         ptrint_t offset;
@@ -1660,21 +2844,21 @@ static void gc_mark_task_stack(jl_task_t *ta, int d)
 #else
         offset = 0;
 #endif
-        gc_mark_stack((jl_value_t*)ta, ta->gcstack, offset, d);
+        gc_mark_stack((jl_value_t*)ta, ta->gcstack, offset);
     }
 }
 
-NOINLINE static void gc_mark_task(jl_task_t *ta, int d)
+NOINLINE static void gc_mark_task(jl_task_t *ta)
 {
-    if (ta->parent) gc_push_root(ta->parent, d);
-    gc_push_root(ta->tls, d);
-    gc_push_root(ta->consumers, d);
-    gc_push_root(ta->donenotify, d);
-    gc_push_root(ta->exception, d);
-    if (ta->backtrace) gc_push_root(ta->backtrace, d);
-    if (ta->start)  gc_push_root(ta->start, d);
-    if (ta->result) gc_push_root(ta->result, d);
-    gc_mark_task_stack(ta, d);
+    if (ta->parent) gc_push_root(ta->parent);
+    gc_push_root(ta->tls);
+    gc_push_root(ta->consumers);
+    gc_push_root(ta->donenotify);
+    gc_push_root(ta->exception);
+    if (ta->backtrace) gc_push_root(ta->backtrace);
+    if (ta->start)  gc_push_root(ta->start);
+    if (ta->result) gc_push_root(ta->result);
+    gc_mark_task_stack(ta);
 }
 
 
@@ -1684,128 +2868,72 @@ static jl_value_t *lookforme = NULL;
 JL_DLLEXPORT void jl_gc_lookfor(jl_value_t *v) { lookforme = v; }
 */
 
-#define MAX_MARK_DEPTH 400
-// mark v and recurse on its children (or store them on the mark stack when recursion depth becomes too high)
-// it does so assuming the gc bits of v are "bits" and returns the new bits of v
-// if v becomes GC_MARKED (old) and some of its children are GC_MARKED_NOESC (young), v is added to the remset
-static int push_root(jl_value_t *v, int d, int bits)
+#ifdef GC_PARALLEL_MARK
+// clears GC_ALREADY_MARKED in *bits and returns 1 if another thread marked the
+// object since we found it unmarked (pbits), in which case that thread scans it
+static inline int gc_mark_lost(int pbits, int *bits)
+{
+    if (__likely(!(*bits & GC_ALREADY_MARKED)))
+        return 0;
+    *bits &= ~GC_ALREADY_MARKED;
+    return !(pbits & GC_MARKED);
+}
+#else
+#define gc_mark_lost(pbits, bits) ((void)(pbits), 0)
+#endif
+
+// mark v assuming its gc bits are "bits" and queue it on the mark stack if it
+// has children, returns the new bits of v.
+// the children are marked later by gc_scan_obj, so that the depth of the C
+// stack does not depend on the shape of the heap
+static int gc_mark_obj(jl_value_t *v, int bits)
 {
     assert(v != NULL);
     jl_value_t *vt = (jl_value_t*)gc_typeof(v);
-    int refyoung = 0, nptr = 0;
+    int pbits = bits;
+    int scan = 1;
 
     if (vt == (jl_value_t*)jl_weakref_type) {
         bits = gc_setmark(v, sizeof(jl_weakref_t), GC_MARKED_NOESC);
-        goto ret;
+        scan = 0;
     }
-    if ((jl_is_datatype(vt) && ((jl_datatype_t*)vt)->pointerfree)) {
+    else if ((jl_is_datatype(vt) && ((jl_datatype_t*)vt)->pointerfree)) {
         int sz = jl_datatype_size(vt);
         bits = gc_setmark(v, sz, GC_MARKED_NOESC);
-        goto ret;
-    }
-#define MARK(v, s) do {                         \
-            s;                                  \
-            if (d >= MAX_MARK_DEPTH)            \
-                goto queue_the_root;            \
-            if (should_timeout())               \
-                goto queue_the_root;            \
-    } while (0)
-
-    d++;
-
+        scan = 0;
+    }
     // some values have special representations
-    if (vt == (jl_value_t*)jl_simplevector_type) {
+    else if (vt == (jl_value_t*)jl_simplevector_type) {
         size_t l = jl_svec_len(v);
-        MARK(v, bits = gc_setmark(v, l * sizeof(void*) +
-                                  sizeof(jl_svec_t), GC_MARKED_NOESC));
-        jl_value_t **data = jl_svec_data(v);
-        nptr += l;
-        for(size_t i=0; i < l; i++) {
-            jl_value_t *elt = data[i];
-            if (elt != NULL) {
-                verify_parent2("svec", v, &data[i], "elem(%d)", (int)i);
-                refyoung |= gc_push_root(elt, d);
-            }
-        }
+        bits = gc_setmark(v, l * sizeof(void*) + sizeof(jl_svec_t), GC_MARKED_NOESC);
     }
     else if (((jl_datatype_t*)(vt))->name == jl_array_typename) {
         jl_array_t *a = (jl_array_t*)v;
         jl_taggedvalue_t *o = jl_astaggedvalue(v);
         int todo = !(bits & GC_MARKED);
-        if (a->pooled)
 #ifdef MEMDEBUG
-#define _gc_setmark_pool gc_setmark_big
+        bits = gc_setmark_big(o, GC_MARKED_NOESC);
 #else
-#define _gc_setmark_pool gc_setmark_pool
-#endif
-            MARK(a,
-                 bits = _gc_setmark_pool(o, GC_MARKED_NOESC);
-                 if (a->how == 2 && todo) {
-                     objprofile_count(MATY, gc_bits(o) == GC_MARKED, array_nbytes(a));
-                     if (gc_bits(o) == GC_MARKED)
-                         perm_scanned_bytes += array_nbytes(a);
-                     else
-                         scanned_bytes += array_nbytes(a);
-                 });
+        if (a->pooled)
+            bits = gc_setmark_pool(o, GC_MARKED_NOESC);
         else
-            MARK(a,
-                 bits = gc_setmark_big(o, GC_MARKED_NOESC);
-                 if (a->how == 2 && todo) {
-                     objprofile_count(MATY, gc_bits(o) == GC_MARKED, array_nbytes(a));
-                     if (gc_bits(o) == GC_MARKED)
-                         perm_scanned_bytes += array_nbytes(a);
-                     else
-                         scanned_bytes += array_nbytes(a);
-                 });
-        if (a->how == 3) {
-            jl_value_t *owner = jl_array_data_owner(a);
-            refyoung |= gc_push_root(owner, d);
-            goto ret;
-        }
-        else if (a->how == 1) {
-#ifdef GC_VERIFY
-            void* val_buf = gc_val_buf((char*)a->data - a->offset*a->elsize);
-            verify_parent1("array", v, &val_buf, "buffer ('loc' addr is meaningless)");
+            bits = gc_setmark_big(o, GC_MARKED_NOESC);
 #endif
-            gc_setmark_buf((char*)a->data - a->offset*a->elsize, gc_bits(o));
-        }
-        if (a->ptrarray && a->data!=NULL) {
-            size_t l = jl_array_len(a);
-            if (l > 100000 && d > MAX_MARK_DEPTH-10) {
-                // don't mark long arrays at high depth, to try to avoid
-                // copying the whole array into the mark queue
-                goto queue_the_root;
-            }
-            else {
-                nptr += l;
-                void *data = a->data;
-                for(size_t i=0; i < l; i++) {
-                    jl_value_t *elt = ((jl_value_t**)data)[i];
-                    if (elt != NULL) {
-                        verify_parent2("array", v, &((jl_value_t**)data)[i], "elem(%d)", (int)i);
-                        refyoung |= gc_push_root(elt, d);
-                    }
-                    // try to split large array marking (incremental mark TODO)
-                    // if (should_timeout() && l > 1000) goto queue_the_root;
-                }
-            }
+        if (a->how == 2 && todo && !(bits & GC_ALREADY_MARKED)) {
+            objprofile_count(MATY, gc_bits(o) == GC_MARKED, array_nbytes(a));
+            gc_count_scanned(gc_bits(o) == GC_MARKED, array_nbytes(a));
         }
+        scan = a->how == 1 || a->how == 3 || (a->ptrarray && a->data != NULL);
     }
     else if (vt == (jl_value_t*)jl_module_type) {
-        // should increase nptr here
-        MARK(v, bits = gc_setmark(v, sizeof(jl_module_t), GC_MARKED_NOESC));
-        refyoung |= gc_mark_module((jl_module_t*)v, d);
+        bits = gc_setmark(v, sizeof(jl_module_t), GC_MARKED_NOESC);
     }
     else if (vt == (jl_value_t*)jl_task_type) {
-        // ditto nptr
-        MARK(v, bits = gc_setmark(v, sizeof(jl_task_t), GC_MARKED_NOESC));
-        gc_mark_task((jl_task_t*)v, d);
-        // tasks should always be remarked since we do not trigger the write barrier
-        // for stores to stack slots
-        refyoung = GC_MARKED_NOESC;
+        bits = gc_setmark(v, sizeof(jl_task_t), GC_MARKED_NOESC);
     }
     else if (vt == (jl_value_t*)jl_symbol_type) {
         //gc_setmark_other(v, GC_MARKED); // symbols have their own allocator and are never freed
+        return bits;
     }
     // this check should not be needed but it helps catching corruptions early
     else if (gc_typeof(vt) == (jl_value_t*)jl_datatype_type) {
@@ -1819,64 +2947,207 @@ static int push_root(jl_value_t *v, int d, int bits)
         } else {
             dtsz = jl_datatype_size(dt);
         }
-        MARK(v, bits = gc_setmark(v, dtsz, GC_MARKED_NOESC));
-        int nf = (int)jl_datatype_nfields(dt);
-        // TODO check if there is a perf improvement for objects with a lot of fields
-        // int fdsz = sizeof(void*)*nf;
-        // void** children = alloca(fdsz);
-        // int ci = 0;
-        for(int i=0; i < nf; i++) {
-            if (jl_field_isptr(dt, i)) {
-                nptr++;
-                jl_value_t **slot = (jl_value_t**)((char*)v +
-                                                   jl_field_offset(dt, i));
-                jl_value_t *fld = *slot;
-                if (fld) {
-                    verify_parent2("object", v, slot, "field(%d)", i);
-                    //children[ci++] = fld;
-                    refyoung |= gc_push_root(fld, d);
-                }
-            }
-        }
-        //while(ci)
-        //  refyoung |= gc_push_root(children[--ci], d);
+        bits = gc_setmark(v, dtsz, GC_MARKED_NOESC);
     }
     else {
         jl_printf(JL_STDOUT, "GC error (probable corruption) :\n");
         jl_(vt);
         abort();
     }
+    if (gc_mark_lost(pbits, &bits) || !scan)
+        return bits;
+    gc_mark_stack_push(v);
+    return bits;
+}
 
- ret:
-#ifdef GC_VERIFY
-    if (verifying) return bits;
-#endif
-    if ((bits == GC_MARKED) && (refyoung == GC_MARKED_NOESC)) {
+// mark the children of v, which is already marked with "bits"
+// if v is GC_MARKED (old) and some of its children are GC_MARKED_NOESC (young), v is added to the remset
+// mark the objects the dirty cards point to. only the cards still pointing to
+// young objects stay dirty
+static void gc_mark_cards(void)
+{
+    size_t nptr = 0;
+    JL_LOCK(cards);
+    size_t n = 0;
+    for (size_t i = 0; i < card_arrays.len; i++) {
+        gc_cards_t *c = (gc_cards_t*)card_arrays.items[i];
+        jl_array_t *a = c->a;
+        gc_array_cards(a, 0);
+        size_t beg = a->offset, end = a->offset + jl_array_len(a);
+        int young = 0;
+        for (size_t k = 0; k < c->ncards; k++) {
+            if (!c->dirty[k])
+                continue;
+            int cardyoung = 0;
+            size_t lo = k << GC_CARD_LG2, hi = lo + GC_CARD_LEN;
+            if (lo < beg) lo = beg;
+            if (hi > end) hi = end;
+            for (size_t j = lo; j < hi; j++) {
+                jl_value_t *elt = c->buf[j];
+                if (elt != NULL && gc_push_root(elt) == GC_MARKED_NOESC)
+                    cardyoung = 1;
+            }
+            if (hi > lo)
+                nptr += hi - lo;
+            c->dirty[k] = cardyoung;
+            young |= cardyoung;
+        }
+        if (young)
+            card_arrays.items[n++] = c;
+        else
+            c->queued = 0;
+    }
+    card_arrays.len = n;
+    JL_UNLOCK(cards);
+    FOR_CURRENT_HEAP ()
+        remset_nptr += nptr;
+}
+
+// marks the elements of an old array using cards, rebuilding them
+static void gc_scan_cards(jl_array_t *a)
+{
+    size_t l = jl_array_len(a);
+    jl_value_t **data = (jl_value_t**)a->data;
+    size_t first = a->offset;
+    size_t nptr = 0;
+    JL_LOCK(cards);
+    gc_cards_t *c = gc_array_cards(a, 0);
+    if (c != NULL)
+        memset(c->dirty, 0, c->ncards);
+    for (size_t i = 0; i < l; i++) {
+        jl_value_t *elt = data[i];
+        if (elt != NULL && gc_push_root(elt) == GC_MARKED_NOESC) {
+            if (c == NULL) {
+                c = gc_array_cards(a, 1);
+                memset(c->dirty, 0, c->ncards);
+            }
+            if (!c->dirty[(first + i) >> GC_CARD_LG2]) {
+                c->dirty[(first + i) >> GC_CARD_LG2] = 1;
+                nptr += GC_CARD_LEN;
+            }
+        }
+    }
+    if (nptr && !c->queued) {
+        c->queued = 1;
+        arraylist_push(&card_arrays, c);
+    }
+    JL_UNLOCK(cards);
+    FOR_CURRENT_HEAP ()
+        remset_nptr += nptr;
+}
+
+// after a full sweep there are no old objects left
+static void gc_reset_cards(void)
+{
+    for (size_t i = 0; i < array_cards.size; i += 2) {
+        gc_cards_t *c = (gc_cards_t*)array_cards.table[i+1];
+        if (c != HT_NOTFOUND) {
+            free(c->dirty);
+            free(c);
+        }
+    }
+    htable_reset(&array_cards, 32);
+    card_arrays.len = 0;
+}
+
+static void gc_scan_obj(jl_value_t *v, int bits)
+{
+    jl_value_t *vt = (jl_value_t*)gc_typeof(v);
+    int refyoung = 0, nptr = 0;
+
+    if (vt == (jl_value_t*)jl_simplevector_type) {
+        size_t l = jl_svec_len(v);
+        jl_value_t **data = jl_svec_data(v);
+        nptr += l;
+        for(size_t i=0; i < l; i++) {
+            jl_value_t *elt = data[i];
+            if (elt != NULL) {
+                verify_parent2("svec", v, &data[i], "elem(%d)", (int)i);
+                refyoung |= gc_push_root(elt);
+            }
+        }
+    }
+    else if (((jl_datatype_t*)(vt))->name == jl_array_typename) {
+        jl_array_t *a = (jl_array_t*)v;
+        if (a->how == 3) {
+            jl_value_t *owner = jl_array_data_owner(a);
+            refyoung |= gc_push_root(owner);
+            goto ret;
+        }
+        else if (a->how == 1) {
+#ifdef GC_VERIFY
+            void* val_buf = gc_val_buf((char*)a->data - a->offset*a->elsize);
+            verify_parent1("array", v, &val_buf, "buffer ('loc' addr is meaningless)");
+#endif
+            gc_setmark_buf((char*)a->data - a->offset*a->elsize, gc_bits(jl_astaggedvalue(v)));
+        }
+        if (bits == GC_MARKED && gc_use_cards(a)) {
+            // the young elements are remembered by the cards
+            gc_scan_cards(a);
+        }
+        else if (a->ptrarray && a->data!=NULL) {
+            size_t l = jl_array_len(a);
+            nptr += l;
+            void *data = a->data;
+            for(size_t i=0; i < l; i++) {
+                jl_value_t *elt = ((jl_value_t**)data)[i];
+                if (elt != NULL) {
+                    verify_parent2("array", v, &((jl_value_t**)data)[i], "elem(%d)", (int)i);
+                    refyoung |= gc_push_root(elt);
+                }
+            }
+        }
+    }
+    else if (vt == (jl_value_t*)jl_module_type) {
+        // should increase nptr here
+        refyoung |= gc_mark_module((jl_module_t*)v);
+    }
+    else if (vt == (jl_value_t*)jl_task_type) {
+        // ditto nptr
+        gc_mark_task((jl_task_t*)v);
+        // tasks should always be remarked since we do not trigger the write barrier
+        // for stores to stack slots
+        refyoung = GC_MARKED_NOESC;
+    }
+    else {
+        jl_datatype_t *dt = (jl_datatype_t*)vt;
+        int nf = (int)jl_datatype_nfields(dt);
+        for(int i=0; i < nf; i++) {
+            if (jl_field_isptr(dt, i)) {
+                nptr++;
+                jl_value_t **slot = (jl_value_t**)((char*)v +
+                                                   jl_field_offset(dt, i));
+                jl_value_t *fld = *slot;
+                if (fld) {
+                    verify_parent2("object", v, slot, "field(%d)", i);
+                    refyoung |= gc_push_root(fld);
+                }
+            }
+        }
+    }
+
+ ret:
+#ifdef GC_VERIFY
+    if (verifying) return;
+#endif
+    if ((bits == GC_MARKED) && (refyoung == GC_MARKED_NOESC)) {
         FOR_CURRENT_HEAP () {
             remset_nptr += nptr;
             // v is an old object referencing young objects
             arraylist_push(remset, v);
         }
     }
-    return bits;
-
-#undef MARK
-
- queue_the_root:
-    if (mark_sp >= mark_stack_size) grow_mark_stack();
-    mark_stack[mark_sp++] = (jl_value_t*)v;
-    max_msp = max_msp > mark_sp ? max_msp : mark_sp;
-    return bits;
 }
 
 static void visit_mark_stack_inc(int mark_mode)
 {
-    while(mark_sp > 0 && !should_timeout()) {
-        jl_value_t* v = mark_stack[--mark_sp];
-        assert(gc_bits(jl_astaggedvalue(v)) == GC_QUEUED ||
-               gc_bits(jl_astaggedvalue(v)) == GC_MARKED ||
-               gc_bits(jl_astaggedvalue(v)) == GC_MARKED_NOESC);
-        push_root(v, 0, gc_bits(jl_astaggedvalue(v)));
+    FOR_CURRENT_HEAP () {
+        jl_value_t *v;
+        while(!should_timeout() && (v = gc_mark_stack_pop(&HEAP(mark_stack))) != NULL) {
+            assert(gc_bits(jl_astaggedvalue(v)) == GC_MARKED ||
+                   gc_bits(jl_astaggedvalue(v)) == GC_MARKED_NOESC);
+            gc_scan_obj(v, gc_bits(jl_astaggedvalue(v)));
+        }
     }
 }
 
@@ -1901,52 +3172,136 @@ extern jl_array_t *jl_module_init_order;
 static int inc_count = 0;
 static int quick_count = 0;
 
-// mark the initial root set
-static void pre_mark(void)
+// mark the roots belonging to thread tid
+static void pre_mark_thread(int16_t tid)
 {
-    // modules
-    gc_push_root(jl_main_module, 0);
-    gc_push_root(jl_current_module, 0);
-    if (jl_old_base_module) gc_push_root(jl_old_base_module, 0);
-    gc_push_root(jl_internal_main_module, 0);
+    jl_tls_states_t *ptls = jl_all_task_states[tid].ptls;
+    gc_push_root(ptls->current_task);
+    // the running task has no write barrier on its stack: rescan it in
+    // every slice after the first one
+    if (inc_count > 1)
+        gc_mark_task(ptls->current_task);
+    gc_push_root(ptls->root_task);
+    gc_push_root(ptls->exception_in_transit);
+    gc_push_root(ptls->task_arg_in_transit);
+
+    // the threads of the embedding program don't take part in threaded work
+    if (!ti_is_foreign(tid)) {
+        // work spawned by this thread that no thread has started yet
+        ti_workqueue_t *q = &ti_workqueues[tid];
+        for (size_t i = q->bottom; i < q->top; i++)
+            gc_push_root(q->items[i].fun);
+#ifdef JULIA_ENABLE_THREADING
+        // result of this thread not reduced yet
+        if (ti_results[tid].value != NULL) gc_push_root(ti_results[tid].value);
+        if (ti_results[tid].exception != NULL) gc_push_root(ti_results[tid].exception);
+#endif
+    }
 
-    size_t i;
-    for(i=0; i < jl_n_threads; i++) {
-        jl_tls_states_t *ptls = jl_all_task_states[i].ptls;
-        gc_push_root(ptls->current_task, 0);
-        gc_push_root(ptls->root_task, 0);
-        gc_push_root(ptls->exception_in_transit, 0);
-        gc_push_root(ptls->task_arg_in_transit, 0);
+    // stuff randomly preserved
+    FOR_HEAP (tid) {
+        for(size_t i=0; i < preserved_values.len; i++) {
+            gc_push_root((jl_value_t*)preserved_values.items[i]);
+        }
     }
+}
+
+static void gc_mark_queued_value(jl_value_t *v)
+{
+    gc_push_root(v);
+}
+
+// mark the roots shared by all threads
+static void pre_mark_global(void)
+{
+    // modules
+    gc_push_root(jl_main_module);
+    gc_push_root(jl_current_module);
+    if (jl_old_base_module) gc_push_root(jl_old_base_module);
+    gc_push_root(jl_internal_main_module);
 
     // invisible builtin values
-    if (jl_an_empty_cell) gc_push_root(jl_an_empty_cell, 0);
+    if (jl_an_empty_cell) gc_push_root(jl_an_empty_cell);
+    if (ti_spawn_exception != NULL) gc_push_root(ti_spawn_exception);
     if (jl_module_init_order != NULL)
-        gc_push_root(jl_module_init_order, 0);
+        gc_push_root(jl_module_init_order);
+    if (jl_type_memo != NULL)
+        gc_push_root(jl_type_memo);
+    if (jl_cfunction_cache_roots != NULL)
+        gc_push_root(jl_cfunction_cache_roots);
 
-    // stuff randomly preserved
-    FOR_EACH_HEAP () {
-        for(i=0; i < preserved_values.len; i++) {
-            gc_push_root((jl_value_t*)preserved_values.items[i], 0);
-        }
-    }
+    // values waiting in the queues between threads
+    jl_gc_queued_values(gc_mark_queued_value);
+    jl_gc_profile_roots(gc_mark_queued_value);
 
+    size_t i;
     // objects currently being finalized
     for(i=0; i < to_finalize.len; i++) {
-        gc_push_root(to_finalize.items[i], 0);
+        gc_push_root(to_finalize.items[i]);
     }
 
     jl_mark_box_caches();
-    gc_push_root(jl_unprotect_stack_func, 0);
-    gc_push_root(jl_bottom_func, 0);
-    gc_push_root(jl_typetype_type, 0);
+    gc_push_root(jl_unprotect_stack_func);
+    gc_push_root(jl_bottom_func);
+    gc_push_root(jl_typetype_type);
 
     // constants
-    gc_push_root(jl_emptysvec, 0);
-    gc_push_root(jl_emptytuple, 0);
-    gc_push_root(jl_typeof(jl_emptytuple), 0);
-    gc_push_root(jl_true, 0);
-    gc_push_root(jl_false, 0);
+    gc_push_root(jl_emptysvec);
+    gc_push_root(jl_emptytuple);
+    gc_push_root(jl_typeof(jl_emptytuple));
+    gc_push_root(jl_true);
+    gc_push_root(jl_false);
+
+    // types recorded by the allocation profiler
+    for (i = 0; i < alloc_prof_nresolved; i++) {
+        if (alloc_prof_samples[i].type != NULL)
+            gc_push_root(alloc_prof_samples[i].type);
+    }
+}
+
+// mark the initial root set
+static void pre_mark(void)
+{
+    pre_mark_global();
+    for(int16_t i=0; i < jl_n_threads + jl_n_foreign_threads; i++)
+        pre_mark_thread(i);
+}
+
+// mark every object in the remset of heap (their bits are already GC_MARKED)
+static void gc_mark_remset(jl_thread_heap_t *heap)
+{
+    _FOR_SINGLE_HEAP (heap) {
+        for (int i = 0; i < last_remset->len; i++) {
+            jl_value_t *item = (jl_value_t*)last_remset->items[i];
+            // an old weak reference given a young referent
+            if (jl_typeis(item, jl_weakref_type) &&
+                gc_bits(jl_astaggedvalue(((jl_weakref_t*)item)->value)) != GC_MARKED) {
+                arraylist_push(&weak_refs, item);
+                weak_refs_relisted++;
+            }
+            gc_mark_obj(item, GC_MARKED);
+        }
+    }
+}
+
+// mark every object in a remembered binding of heap, and only keep the
+// bindings that still point to young objects
+static void gc_mark_rem_bindings(jl_thread_heap_t *heap)
+{
+    _FOR_SINGLE_HEAP (heap) {
+        int n_bnd_refyoung = 0;
+        for (int i = 0; i < rem_bindings.len; i++) {
+            jl_binding_t *ptr = (jl_binding_t*)rem_bindings.items[i];
+            // A null pointer can happen here when the binding is cleaned up
+            // as an exception is thrown after it was already queued (#10221)
+            if (!ptr->value) continue;
+            if (gc_push_root(ptr->value) == GC_MARKED_NOESC) {
+                rem_bindings.items[n_bnd_refyoung] = ptr;
+                n_bnd_refyoung++;
+            }
+        }
+        rem_bindings.len = n_bnd_refyoung;
+    }
 }
 
 static int n_finalized;
@@ -1961,7 +3316,9 @@ static void post_mark(arraylist_t *list, int dryrun)
         jl_value_t *v = (jl_value_t*)list->items[i];
         jl_value_t *fin = (jl_value_t*)list->items[i+1];
         int isfreed = !gc_marked(jl_astaggedvalue(v));
-        gc_push_root(fin, 0);
+        // mark everything reachable from fin before looking at the next entries
+        gc_push_root(fin);
+        visit_mark_stack(GC_MARKED_NOESC);
         int isold = list == &finalizer_list && gc_bits(jl_astaggedvalue(v)) == GC_MARKED && gc_bits(jl_astaggedvalue(fin)) == GC_MARKED;
         if (!dryrun && (isfreed || isold)) {
             // remove from this list
@@ -1980,7 +3337,8 @@ static void post_mark(arraylist_t *list, int dryrun)
                     ((void (*)(void*))p)(jl_data_ptr(v));
                 continue;
             }
-            gc_push_root(v, 0);
+            gc_push_root(v);
+            visit_mark_stack(GC_MARKED_NOESC);
             if (!dryrun) schedule_finalization(v, fin);
             n_finalized++;
         }
@@ -1992,6 +3350,317 @@ static void post_mark(arraylist_t *list, int dryrun)
     visit_mark_stack(GC_MARKED_NOESC);
 }
 
+#ifdef GC_PARALLEL_MARK
+// parallel mark
+// Each thread of the world thread group marks the roots it owns (the remset
+// and remembered bindings of its heap, its task state and preserved values),
+// the master thread also marks the global roots, and a thread that runs out
+// of work steals objects from the bottom of the mark stack of another thread.
+// The mark is over when all the threads are out of work.
+// The other threads join either from jl_gc_collect, when the collection
+// happens in a threaded region, or by being forked with TI_THREADWORK_GC_MARK.
+
+enum {
+    GC_PAR_IDLE,
+    GC_PAR_RUN,  // the other threads take part in the mark
+    GC_PAR_SKIP  // the master thread marks alone
+};
+static volatile int gc_par_state = GC_PAR_IDLE;
+static int gc_par_nthreads;
+static volatile int gc_par_nidle; // threads out of work
+static volatile int gc_par_ndone; // non-master threads that are done with this collection
+static ti_threadwork_t gc_mark_work = {TI_THREADWORK_GC_MARK, NULL, NULL, NULL, NULL};
+
+#define GC_STEAL_MAX 64
+// move some objects from the mark stack of another thread to our own one
+static int gc_mark_steal(int16_t tid)
+{
+    jl_value_t *stolen[GC_STEAL_MAX];
+    size_t n = 0;
+    for (int i = 1; i < gc_par_nthreads && n == 0; i++) {
+        gc_mark_stack_t *s = &jl_all_heaps[(tid + i) % gc_par_nthreads]->mark_stack;
+        if (*(volatile size_t*)&s->sp <= *(volatile size_t*)&s->bottom)
+            continue;
+        gc_mark_stack_lock(s);
+        if (s->sp > s->bottom) {
+            // take half of them, the oldest ones
+            n = (s->sp - s->bottom + 1)/2;
+            if (n > GC_STEAL_MAX)
+                n = GC_STEAL_MAX;
+            memcpy(stolen, &s->items[s->bottom], n*sizeof(void*));
+            s->bottom += n;
+            if (s->sp == s->bottom)
+                s->sp = s->bottom = 0;
+        }
+        gc_mark_stack_unlock(s);
+    }
+    for (size_t i = 0; i < n; i++)
+        gc_mark_stack_push(stolen[i]);
+    return n > 0;
+}
+
+static int gc_mark_work_available(void)
+{
+    for (int i = 0; i < gc_par_nthreads; i++) {
+        gc_mark_stack_t *s = &jl_all_heaps[i]->mark_stack;
+        if (*(volatile size_t*)&s->sp > *(volatile size_t*)&s->bottom)
+            return 1;
+    }
+    return 0;
+}
+
+static void gc_mark_parallel_thread(int16_t tid)
+{
+    gc_mark_remset(jl_all_heaps[tid]);
+    gc_mark_rem_bindings(jl_all_heaps[tid]);
+    if (tid == 0)
+        gc_mark_cards();
+    pre_mark_thread(tid);
+    if (tid == 0)
+        pre_mark_global();
+    while (1) {
+        visit_mark_stack(GC_MARKED_NOESC);
+        if (gc_mark_steal(tid))
+            continue;
+        // only threads with work push objects, so if all the threads are
+        // out of work, the mark is over
+        JL_ATOMIC_FETCH_AND_ADD(gc_par_nidle, 1);
+        while (gc_par_nidle < gc_par_nthreads && !gc_mark_work_available())
+            cpu_pause();
+        if (gc_par_nidle == gc_par_nthreads)
+            break;
+        JL_ATOMIC_FETCH_AND_ADD(gc_par_nidle, -1);
+    }
+}
+
+// tell the other threads what to do and wait for them to be done with it
+static void gc_par_run(int state, int fork)
+{
+    ti_threadwork_t *work = &gc_mark_work;
+    gc_par_ndone = 0;
+    cpu_sfence();
+    gc_par_state = state;
+    if (fork)
+        ti_threadgroup_fork(tgworld, ti_tid, (void**)&work);
+    if (state == GC_PAR_RUN)
+        gc_mark_parallel_thread(ti_tid);
+    while (gc_par_ndone < gc_par_nthreads - 1)
+        cpu_pause();
+    gc_par_state = GC_PAR_IDLE;
+    if (fork)
+        ti_threadgroup_join(tgworld, ti_tid);
+}
+
+// called by the master thread in place of the mark
+static void gc_mark_parallel_skip(void)
+{
+    // in a threaded region, the other threads are waiting in jl_gc_collect
+    if (tgworld != NULL && tgworld->forked) {
+        gc_par_nthreads = jl_n_threads;
+        gc_par_run(GC_PAR_SKIP, 0);
+    }
+}
+
+// run steps 1-3 of the mark on all the threads.
+// returns 0 if the caller has to do them instead.
+static int gc_mark_parallel(void)
+{
+    // the heaps of foreign threads have no thread of the group to mark them
+    if (!gc_parallel_mark || jl_n_threads < 2 || tgworld == NULL || check_timeout ||
+        jl_n_foreign_threads > 0) {
+        gc_mark_parallel_skip();
+        return 0;
+    }
+    gc_par_nthreads = jl_n_threads;
+    gc_par_nidle = 0;
+    gc_par_marking = 1;
+    gc_par_run(GC_PAR_RUN, !tgworld->forked);
+    gc_par_marking = 0;
+    FOR_EACH_HEAP () {
+        scanned_bytes += HEAP(par_scanned_bytes);
+        perm_scanned_bytes += HEAP(par_perm_scanned_bytes);
+        HEAP(par_scanned_bytes) = 0;
+        HEAP(par_perm_scanned_bytes) = 0;
+    }
+    return 1;
+}
+#endif
+
+#ifdef JULIA_ENABLE_THREADING
+// 0, or the kind of the collection that is running: the threads of the group
+// join a GC_RUNNING_GROUP one at the barrier, the threads of the embedding
+// program don't take part in either kind and wait for them to finish
+volatile int jl_gc_running = 0;
+#define GC_RUNNING_GROUP 1
+#define GC_RUNNING_FOREIGN 2
+static int16_t gc_collector_tid = -1;
+
+// run by the non-master threads during a collection
+void jl_gc_mark_helper(void)
+{
+#ifdef GC_PARALLEL_MARK
+    int state;
+    while ((state = gc_par_state) == GC_PAR_IDLE)
+        cpu_pause();
+    cpu_lfence();
+    if (state == GC_PAR_RUN)
+        gc_mark_parallel_thread(ti_tid);
+    JL_ATOMIC_FETCH_AND_ADD(gc_par_ndone, 1);
+#endif
+}
+#endif
+
+// join the collection another thread of the region is waiting to run, from
+// a loop that waits on the other threads
+JL_DLLEXPORT void jl_gc_safepoint(void)
+{
+#ifdef JULIA_ENABLE_THREADING
+    if (jl_gc_running)
+        jl_gc_collect(0);
+#endif
+}
+
+#ifdef JULIA_ENABLE_THREADING
+// stay out of the way of a collection this thread takes no part in
+static void gc_wait_for_collection(void)
+{
+    jl_tls_states_t *ptls = jl_get_ptls_states();
+    int8_t state = ptls->gc_state;
+    ptls->gc_state = JL_GC_STATE_WAITING;
+    JL_ATOMIC_FENCE();
+    while (jl_gc_running)
+        cpu_pause();
+    cpu_lfence();
+    ptls->gc_state = state;
+}
+
+// wait for the threads the barrier doesn't stop: the threads of the
+// embedding program, and the threads of the group when one of those
+// collects. they stop at their next safepoint unless they are in a safe
+// region already
+static void gc_wait_for_mutators(int16_t gc_tid, int foreign)
+{
+    int n = jl_n_threads + jl_n_foreign_threads;
+    for (int i = foreign ? 0 : jl_n_threads; i < n; i++) {
+        jl_tls_states_t *ptls = jl_all_task_states[i].ptls;
+        if (i == gc_tid || ptls == NULL)
+            continue;
+        while (ptls->gc_state == JL_GC_STATE_UNSAFE)
+            cpu_pause();
+    }
+    cpu_lfence();
+}
+#endif
+
+JL_DLLEXPORT int8_t jl_gc_safe_enter(void)
+{
+#ifdef JULIA_ENABLE_THREADING
+    jl_tls_states_t *ptls = jl_get_ptls_states();
+    int8_t state = ptls->gc_state;
+    // our stores to the heap are seen by a collector that sees the state
+    cpu_sfence();
+    ptls->gc_state = JL_GC_STATE_SAFE;
+    return state;
+#else
+    return JL_GC_STATE_UNSAFE;
+#endif
+}
+
+// a safepoint too: a collection that started while we were in the safe
+// region doesn't know about us, so wait for it (or join it) first
+JL_DLLEXPORT int8_t jl_gc_unsafe_enter(void)
+{
+#ifdef JULIA_ENABLE_THREADING
+    jl_tls_states_t *ptls = jl_get_ptls_states();
+    int8_t state = ptls->gc_state;
+    ptls->gc_state = JL_GC_STATE_UNSAFE;
+    // the collector sets jl_gc_running before it reads the states
+    JL_ATOMIC_FENCE();
+    jl_gc_safepoint();
+    return state;
+#else
+    return JL_GC_STATE_UNSAFE;
+#endif
+}
+
+JL_DLLEXPORT void jl_gc_state_restore(int8_t state)
+{
+#ifdef JULIA_ENABLE_THREADING
+    if (state == JL_GC_STATE_UNSAFE)
+        (void)jl_gc_unsafe_enter();
+    else
+        (void)jl_gc_safe_enter();
+#else
+    (void)state;
+#endif
+}
+
+#ifdef JULIA_ENABLE_THREADING
+// compiled code loads from this page at function entries and on loop
+// back-edges (added after vectorization, see llvm-safepoint.cpp). a
+// collection makes it unreadable until every thread has stopped, and the
+// fault brings a thread busy in code that does not allocate into the
+// collection (see segv_handler in signals-unix.c)
+volatile size_t *jl_gc_safepoint_page;
+static size_t gc_safepoint_word;
+static int gc_signal_safepoints = DEFAULT_GC_SIGNAL_SAFEPOINTS;
+
+static void gc_safepoint_init(void)
+{
+    jl_gc_safepoint_page = &gc_safepoint_word;
+#if !defined(_OS_WINDOWS_) && !defined(_OS_DARWIN_)
+    char *cp = getenv(GC_SIGNAL_SAFEPOINTS_NAME);
+    if (cp)
+        gc_signal_safepoints = strtol(cp, NULL, 10) != 0;
+    if (gc_signal_safepoints) {
+        void *p = mmap(NULL, jl_page_size, PROT_READ,
+                       MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (p != MAP_FAILED)
+            jl_gc_safepoint_page = (volatile size_t*)p;
+        else
+            gc_signal_safepoints = 0;
+    }
+#else
+    // the exception handlers there don't know about the page yet, the polls
+    // read a word that never faults
+    gc_signal_safepoints = 0;
+#endif
+}
+
+static void gc_safepoint_arm(int armed)
+{
+#if !defined(_OS_WINDOWS_) && !defined(_OS_DARWIN_)
+    if (gc_signal_safepoints)
+        mprotect((void*)jl_gc_safepoint_page, jl_page_size,
+                 armed ? PROT_NONE : PROT_READ);
+#endif
+}
+
+int jl_gc_is_safepoint_addr(void *addr)
+{
+    return gc_signal_safepoints && (char*)addr >= (char*)jl_gc_safepoint_page &&
+        (char*)addr < (char*)jl_gc_safepoint_page + jl_page_size;
+}
+
+// called from the SIGSEGV handler, on the signal stack, by a thread that
+// loaded from the armed page. the load runs again once this returns, which
+// is after the page is readable again
+void jl_gc_signal_safepoint(void)
+{
+    int16_t tid = ti_tid;
+    if (ti_is_foreign(tid)) {
+        // not part of the group, the collector waits until we are here
+        gc_wait_for_collection();
+        return;
+    }
+    if (tid == 0)
+        gc_in_signal_safepoint = 1;
+    jl_gc_safepoint();
+    if (tid == 0)
+        gc_in_signal_safepoint = 0;
+}
+#endif
+
 // collector entry point and control
 
 static int is_gc_enabled = 1;
@@ -2003,9 +3672,131 @@ JL_DLLEXPORT int jl_gc_enable(int on)
 }
 JL_DLLEXPORT int jl_gc_is_enabled(void) { return is_gc_enabled; }
 
-JL_DLLEXPORT int64_t jl_gc_total_bytes(void) { return total_allocd_bytes + allocd_bytes + collect_interval; }
+// set the soft limit of the heap size in bytes (0 = none), returns the
+// previous limit
+JL_DLLEXPORT uint64_t jl_gc_set_heap_limit(uint64_t bytes)
+{
+    uint64_t prev = gc_heap_limit;
+    gc_heap_limit = bytes;
+    return prev;
+}
+
+// set the mark pause budget in microseconds (0 turns off incremental
+// marking), returns the previous budget
+JL_DLLEXPORT uint64_t jl_gc_set_pause_budget(uint64_t us)
+{
+    uint64_t prev = gc_pause_budget/1000;
+    gc_pause_budget = us*1000;
+    return prev;
+}
+
+// turn on or off lazy sweeping of pool pages, returns the previous setting
+JL_DLLEXPORT int jl_gc_enable_lazy_sweep(int on)
+{
+    int prev = gc_lazy_sweep;
+    gc_lazy_sweep = (on != 0);
+    return prev;
+}
+
+// turn on or off the parallel mark (only available in threaded builds),
+// returns the previous setting
+JL_DLLEXPORT int jl_gc_enable_parallel_mark(int on)
+{
+#ifdef GC_PARALLEL_MARK
+    int prev = gc_parallel_mark;
+    gc_parallel_mark = (on != 0);
+    return prev;
+#else
+    return 0;
+#endif
+}
+
+// the counts of the heaps that haven't moved to gc_num yet, only exact when
+// the threads aren't allocating
+static void gc_add_heap_nums(GC_Num *num)
+{
+    FOR_EACH_HEAP () {
+        if (current_heap == NULL) // thread not started yet
+            continue;
+        gc_heap_num_t *hn = &HEAP(num);
+        num->allocd += hn->allocd + GC_ALLOC_QUOTA;
+        num->freed += hn->freed;
+        num->malloc += hn->malloc;
+        num->realloc += hn->realloc;
+        num->poolalloc += hn->poolalloc;
+        num->bigalloc += hn->bigalloc;
+        num->freecall += hn->freecall;
+    }
+}
+
+JL_DLLEXPORT int64_t jl_gc_total_bytes(void)
+{
+    GC_Num num = gc_num;
+    gc_add_heap_nums(&num);
+    return num.total_allocd + num.allocd + num.collect;
+}
 JL_DLLEXPORT uint64_t jl_gc_total_hrtime(void) { return total_gc_time; }
-JL_DLLEXPORT GC_Num jl_gc_num(void) { return gc_num; }
+JL_DLLEXPORT GC_Num jl_gc_num(void)
+{
+    GC_Num num = gc_num;
+    gc_add_heap_nums(&num);
+    return num;
+}
+JL_DLLEXPORT void jl_gc_stats(GC_Stats *stats) { *stats = gc_stats; }
+
+// copies the last (at most n) pauses into pauses, the oldest first, and
+// returns how many it copied
+JL_DLLEXPORT size_t jl_gc_pause_log(uint64_t *pauses, size_t n)
+{
+    uint64_t nlog = gc_pause_log_n;
+    if (n > GC_PAUSE_LOG_SIZE)
+        n = GC_PAUSE_LOG_SIZE;
+    if (n > nlog)
+        n = nlog;
+    for (size_t i = 0; i < n; i++)
+        pauses[i] = gc_pause_log[(nlog - n + i) % GC_PAUSE_LOG_SIZE];
+    return n;
+}
+
+// the statistics of the heap of thread tid, returns -1 if there is no such thread.
+// the counts are only exact when the thread isn't allocating
+JL_DLLEXPORT int jl_gc_heap_stats(int tid, GC_Heap_Stats *stats)
+{
+    if (tid < 0 || tid >= jl_n_threads + jl_n_foreign_threads)
+        return -1;
+    memset(stats, 0, sizeof(GC_Heap_Stats));
+    FOR_HEAP (tid) {
+        for (int i = 0; i < N_POOLS; i++) {
+            stats->allocd += pools[i].nalloc*pools[i].osize;
+            stats->poolalloc += pools[i].nalloc;
+        }
+        stats->allocd += HEAP(big_allocd) + HEAP(malloc_allocd);
+        stats->bigalloc = HEAP(nbigalloc);
+        stats->malloc = HEAP(nmalloc);
+        for (bigval_t *v = big_objects; v != NULL; v = v->next) {
+            stats->nbig++;
+            stats->big_bytes += v->sz&~3;
+        }
+        for (mallocarray_t *ma = mallocarrays; ma != NULL; ma = ma->next)
+            stats->nmalloc_arrays++;
+        stats->remset_len = remset->len;
+        stats->rem_bindings_len = rem_bindings.len;
+        stats->remset_ptrs = remset_nptr;
+    }
+    JL_LOCK(pagealloc);
+    for (int i = 0; i < REGION_COUNT && regions[i]; i++) {
+        region_t *region = regions[i];
+        for (int pg_i = 0; pg_i <= regions_ub[i]; pg_i++) {
+            uint32_t line = region->freemap[pg_i];
+            for (int j = 0; j < 32; j++) {
+                if (!((line >> j) & 1) && region->meta[pg_i*32 + j].thread_n == tid)
+                    stats->pages++;
+            }
+        }
+    }
+    JL_UNLOCK(pagealloc);
+    return 0;
+}
 
 JL_DLLEXPORT int64_t jl_gc_diff_total_bytes(void)
 {
@@ -2069,22 +3860,75 @@ static int sweep_mask = GC_MARKED;
 JL_DLLEXPORT void jl_gc_collect(int full)
 {
     if (!is_gc_enabled) return;
+#ifdef JULIA_ENABLE_THREADING
+    // the other threads can't allocate while a collection runs, only the
+    // finalizers it runs can come back here
+    if (jl_in_gc && (!jl_gc_running || gc_collector_tid == ti_tid)) return;
+#else
     if (jl_in_gc) return;
+#endif
     char *stack_hi = (char*)gc_get_stack_ptr();
     gc_debug_print();
     JL_SIGATOMIC_BEGIN();
 
 #ifdef JULIA_ENABLE_THREADING
-    ti_threadgroup_barrier(tgworld, ti_tid);
-    if (ti_tid != 0) {
+#if PROFILE_JL_THREADING
+    uint64_t tgc = rdtsc();
+#endif
+    // a thread of the embedding program collects alone, the group and the
+    // other threads of the program wait for its collection to finish
+    int16_t gc_tid = ti_tid;
+    int foreign = ti_is_foreign(gc_tid);
+    // threads waiting for spawned work see this and join the collection (or
+    // wait for it), threads running compiled code fault on their next
+    // safepoint poll
+    for (;;) {
+        int running = jl_gc_running;
+        if (running == 0) {
+            if (JL_ATOMIC_COMPARE_AND_SWAP(jl_gc_running, 0,
+                                           foreign ? GC_RUNNING_FOREIGN : GC_RUNNING_GROUP))
+                break;
+        }
+        else if (running == GC_RUNNING_GROUP && !foreign) {
+            break;
+        }
+        else {
+            gc_wait_for_collection();
+            JL_SIGATOMIC_END();
+            return;
+        }
+    }
+    jl_gc_wake_queues();
+    int armed = foreign || jl_n_foreign_threads > 0 ||
+        (jl_n_threads > 1 && tgworld != NULL && tgworld->forked);
+    if (armed)
+        gc_safepoint_arm(1);
+    if (!foreign)
+        ti_threadgroup_barrier(tgworld, gc_tid);
+    if (gc_tid != 0 && !foreign) {
+        jl_gc_mark_helper();
         JL_SIGATOMIC_END();
         ti_threadgroup_barrier(tgworld, ti_tid);
+#if PROFILE_JL_THREADING
+        if (ti_profile)
+            ti_profile[ti_tid].gc_ticks += rdtsc() - tgc;
+#endif
         return;
     }
+    gc_wait_for_mutators(gc_tid, foreign);
+    // every thread is stopped now, so the finalizers are free to run
+    // compiled code
+    if (armed)
+        gc_safepoint_arm(0);
+    gc_collector_tid = gc_tid;
 #endif
 
     jl_in_gc = 1;
     uint64_t t0 = jl_hrtime();
+    // every thread is stopped, take their counts
+    gc_heap_nums_collect();
+    if (alloc_prof_nresolved < alloc_prof_nsamples)
+        alloc_prof_resolve();
     int recollect = 0;
 #if defined(GC_TIME)
     int wb_activations = mark_sp - saved_mark_sp;
@@ -2094,12 +3938,20 @@ JL_DLLEXPORT void jl_gc_collect(int full)
 
         inc_count++;
         quick_count++;
+        if (inc_count == 1)
+            cancel_lazy_sweep();
 
         scanned_bytes_goal = inc_count*(live_bytes/gc_inc_steps + mark_sp*sizeof(void*));
         scanned_bytes_goal = scanned_bytes_goal < MIN_SCAN_BYTES ? MIN_SCAN_BYTES : scanned_bytes_goal;
-        if (gc_inc_steps > 1)
+        if (gc_pause_budget && !full) {
             check_timeout = 1;
-        assert(mark_sp == 0);
+            mark_deadline = t0 + gc_pause_budget;
+            timeout_countdown = TIMEOUT_CHECK_INTERVAL;
+        }
+        else {
+            check_timeout = 0;
+        }
+        assert(mark_sp == 0 || inc_count > 1);
 
         // 1. mark every object in the remset
         reset_remset();
@@ -2114,38 +3966,39 @@ JL_DLLEXPORT void jl_gc_collect(int full)
                 void *ptr = rem_bindings.items[i];
                 gc_bits(gc_val_buf(ptr)) = GC_MARKED;
             }
-
-            for (int i = 0; i < last_remset->len; i++) {
-                jl_value_t *item = (jl_value_t*)last_remset->items[i];
-                push_root(item, 0, GC_MARKED);
-            }
         }
 
-        // 2. mark every object in a remembered binding
-        FOR_EACH_HEAP () {
-            int n_bnd_refyoung = 0;
-            for (int i = 0; i < rem_bindings.len; i++) {
-                jl_binding_t *ptr = (jl_binding_t*)rem_bindings.items[i];
-                // A null pointer can happen here when the binding is cleaned up
-                // as an exception is thrown after it was already queued (#10221)
-                if (!ptr->value) continue;
-                if (gc_push_root(ptr->value, 0) == GC_MARKED_NOESC) {
-                    rem_bindings.items[n_bnd_refyoung] = ptr;
-                    n_bnd_refyoung++;
-                }
-            }
-            rem_bindings.len = n_bnd_refyoung;
-        }
+#ifdef GC_PARALLEL_MARK
+        // steps 1-3 can be split across the threads
+        if (!gc_mark_parallel())
+#endif
+        {
+            FOR_EACH_HEAP ()
+                gc_mark_remset(current_heap);
+            gc_mark_cards();
 
-        // 3. walk roots
-        pre_mark();
-        visit_mark_stack(GC_MARKED_NOESC);
+            // 2. mark every object in a remembered binding
+            FOR_EACH_HEAP ()
+                gc_mark_rem_bindings(current_heap);
 
-        allocd_bytes_since_sweep += allocd_bytes + (int64_t)collect_interval;
+            // 3. walk roots
+            pre_mark();
+            if (check_timeout)
+                visit_mark_stack_inc(GC_MARKED_NOESC);
+            else
+                visit_mark_stack(GC_MARKED_NOESC);
+        }
+
+        allocd_bytes_since_sweep += allocd_bytes + (int64_t)(inc_count > 1 ? inc_collect_interval : collect_interval);
+        check_timeout = 0;
+        if (mark_sp != 0) {
+            // out of budget: resume marking soon
+            allocd_bytes = -(int64_t)inc_collect_interval;
+        }
 
-#if defined(GC_TIME) || defined(GC_FINAL_STATS)
         uint64_t mark_pause = jl_hrtime() - t0;
-#endif
+        gc_stats.last_mark_time = mark_pause;
+        gc_stats.total_mark_time += mark_pause;
 #ifdef GC_TIME
         FOR_EACH_HEAP () {
             jl_printf(JL_STDOUT, "GC mark pause %.2f ms | scanned %ld kB = %ld + %ld | stack %d -> %d (wb %d) | remset %d %d\n", NS2MS(mark_pause), (scanned_bytes + perm_scanned_bytes)/1024, scanned_bytes/1024, perm_scanned_bytes/1024, saved_mark_sp, mark_sp, wb_activations, last_remset->len, remset_nptr);
@@ -2156,32 +4009,29 @@ JL_DLLEXPORT void jl_gc_collect(int full)
         total_mark_time += mark_pause;
 #endif
     }
+#ifdef GC_PARALLEL_MARK
+    else {
+        gc_mark_parallel_skip();
+    }
+#endif
     #ifdef GC_TIME
     int64_t bonus = -1, SAVE = -1, SAVE2 = -1, SAVE3 = -1, pct = -1;
     #endif
     int64_t estimate_freed = -1;
 
-#if defined(GC_TIME) || defined(GC_FINAL_STATS)
     uint64_t post_time = 0, finalize_time = 0;
-#endif
     if (mark_sp == 0 || sweeping) {
-#if defined(GC_TIME) || defined(GC_FINAL_STATS)
         uint64_t sweep_t0 = jl_hrtime();
-#endif
         int64_t actual_allocd = allocd_bytes_since_sweep;
         if (!sweeping) {
             // marking is over
-#if defined(GC_TIME) || defined(GC_FINAL_STATS)
             post_time = jl_hrtime();
-#endif
             // 4. check for objects to finalize
             post_mark(&finalizer_list, 0);
             if (prev_sweep_mask == GC_MARKED) {
                 post_mark(&finalizer_list_marked, 0);
             }
-#if defined(GC_TIME) || defined(GC_FINAL_STATS)
             post_time = jl_hrtime() - post_time;
-#endif
             estimate_freed = live_bytes - scanned_bytes - perm_scanned_bytes + actual_allocd;
 
             gc_verify();
@@ -2195,15 +4045,18 @@ JL_DLLEXPORT void jl_gc_collect(int full)
             reset_obj_profile();
 #endif
             total_allocd_bytes += allocd_bytes_since_sweep;
-            if (prev_sweep_mask == GC_MARKED_NOESC)
+            if (prev_sweep_mask == GC_MARKED_NOESC) {
                 promoted_bytes += perm_scanned_bytes - last_perm_scanned_bytes;
+                gc_stats.promoted += perm_scanned_bytes - last_perm_scanned_bytes;
+            }
             // 5. next collection decision
             int not_freed_enough = estimate_freed < (7*(actual_allocd/10));
             int nptr = 0;
             FOR_EACH_HEAP ()
                 nptr += remset_nptr;
             int large_frontier = nptr*sizeof(void*) >= default_collect_interval; // many pointers in the intergen frontier => "quick" mark is not quick
-            if ((full || large_frontier || ((not_freed_enough || promoted_bytes >= collect_interval) && (promoted_bytes >= default_collect_interval || prev_sweep_mask == GC_MARKED))) && n_pause > 1) {
+            int over_limit = gc_heap_limit && live_bytes + actual_allocd >= (int64_t)gc_heap_limit;
+            if ((full || large_frontier || over_limit || ((not_freed_enough || promoted_bytes >= collect_interval) && (promoted_bytes >= default_collect_interval || prev_sweep_mask == GC_MARKED))) && n_pause > 1) {
                 if (prev_sweep_mask != GC_MARKED || full) {
                     if (full) recollect = 1; // TODO enable this?
                 }
@@ -2233,7 +4086,7 @@ JL_DLLEXPORT void jl_gc_collect(int full)
                 perm_scanned_bytes = 0;
             scanned_bytes = 0;
             // 5. start sweeping
-            sweep_weak_refs();
+            sweep_weak_refs(sweep_mask);
             gc_sweep_once(sweep_mask);
             sweeping = 1;
             gc_scrub(stack_hi);
@@ -2258,6 +4111,8 @@ JL_DLLEXPORT void jl_gc_collect(int full)
                     n_full_sweep++;
                 }
             }
+            if (sweep_mask != GC_MARKED_NOESC)
+                gc_reset_cards();
 
             sweeping = 0;
 #ifdef GC_TIME
@@ -2268,26 +4123,34 @@ JL_DLLEXPORT void jl_gc_collect(int full)
             prev_sweep_mask = sweep_mask;
 
 
-            allocd_bytes = -(int64_t)collect_interval;
             inc_count = 0;
             live_bytes += -freed_bytes + allocd_bytes_since_sweep;
+            if (gc_heap_limit) {
+                int64_t room = (int64_t)gc_heap_limit - live_bytes;
+                int64_t min_interval = default_collect_interval/8;
+                if (room < (int64_t)collect_interval)
+                    collect_interval = room < min_interval ? min_interval : room;
+            }
+            allocd_bytes = -(int64_t)collect_interval;
             allocd_bytes_since_sweep = 0;
             jl_gc_total_freed_bytes += freed_bytes;
             freed_bytes = 0;
 
-#if defined(GC_FINAL_STATS) || defined(GC_TIME)
             finalize_time = jl_hrtime();
-#endif
-            if (!jl_gc_finalizers_inhibited) {
+            if (finalizer_notify != NULL) {
+                if (to_finalize.len > 0)
+                    uv_async_send(finalizer_notify);
+            }
+            else if (!jl_gc_finalizers_inhibited && !gc_in_signal_safepoint) {
                 run_finalizers();
             }
-#if defined(GC_FINAL_STATS) || defined(GC_TIME)
             finalize_time = jl_hrtime() - finalize_time;
-#endif
         }
-#if defined(GC_FINAL_STATS) || defined(GC_TIME)
         uint64_t sweep_pause = jl_hrtime() - sweep_t0;
-#endif
+        gc_stats.last_sweep_time = sweep_pause - finalize_time - post_time;
+        gc_stats.last_finalize_time = finalize_time + post_time;
+        gc_stats.total_sweep_time += gc_stats.last_sweep_time;
+        gc_stats.total_finalize_time += gc_stats.last_finalize_time;
 #ifdef GC_FINAL_STATS
         total_sweep_time += sweep_pause - finalize_time - post_time;
         total_fin_time += finalize_time + post_time;
@@ -2299,13 +4162,25 @@ JL_DLLEXPORT void jl_gc_collect(int full)
     n_pause++;
     uint64_t pause = jl_hrtime() - t0;
     total_gc_time += pause;
+    gc_stats.max_pause = gc_stats.max_pause < pause ? pause : gc_stats.max_pause;
+    int bucket = 0;
+    for (uint64_t us = pause/1000; us > 0 && bucket < GC_PAUSE_HIST_SIZE - 1; us >>= 1)
+        bucket++;
+    gc_stats.pause_hist[bucket]++;
+    gc_pause_log[gc_pause_log_n++ % GC_PAUSE_LOG_SIZE] = pause;
 #ifdef GC_FINAL_STATS
     max_pause = max_pause < pause ? pause : max_pause;
 #endif
     jl_in_gc = 0;
 
 #ifdef JULIA_ENABLE_THREADING
-    ti_threadgroup_barrier(tgworld, ti_tid);
+    jl_gc_running = 0;
+    if (!foreign)
+        ti_threadgroup_barrier(tgworld, gc_tid);
+#if PROFILE_JL_THREADING
+    if (ti_profile && !foreign)
+        ti_profile[gc_tid].gc_ticks += rdtsc() - tgc;
+#endif
 #endif
 
     JL_SIGATOMIC_END();
@@ -2341,11 +4216,12 @@ void *allocb(size_t sz)
     }
     else {
         FOR_CURRENT_HEAP ()
-            b = (buff_t*)pool_alloc(&pools[szclass(allocsz)]);
+            b = (buff_t*)pool_alloc(current_heap, &pools[szclass(allocsz)]);
         b->header = 0x4EADE800;
         b->pooled = 1;
     }
 #endif
+    gc_alloc_count(NULL, allocsz);
     return &b->data[0];
 }
 
@@ -2364,7 +4240,7 @@ void *reallocb(void *b, size_t sz)
         if (allocsz < sz)  // overflow in adding offs, size was "negative"
             jl_throw(jl_memory_exception);
         bigval_t *bv = bigval_header(buff);
-        bv = (bigval_t*)realloc_a16(bv, allocsz, bv->sz&~3);
+        bv = (bigval_t*)gc_block_realloc(bv, allocsz, bv->sz&~3);
         if (bv == NULL)
             jl_throw(jl_memory_exception);
         return &bv->data[0];
@@ -2377,15 +4253,20 @@ JL_DLLEXPORT jl_value_t *jl_gc_allocobj(size_t sz)
     size_t allocsz = sz + sizeof_jl_taggedvalue_t;
     if (allocsz < sz) // overflow in adding offs, size was "negative"
         jl_throw(jl_memory_exception);
+    jl_value_t *v;
 #ifdef MEMDEBUG
-    return jl_valueof(alloc_big(allocsz));
-#endif
+    v = jl_valueof(alloc_big(allocsz));
+#else
     if (allocsz <= GC_MAX_SZCLASS + sizeof(buff_t)) {
-        FOR_CURRENT_HEAP () {
-            return jl_valueof(pool_alloc(&pools[szclass(allocsz)]));
-        }
+        FOR_CURRENT_HEAP ()
+            v = jl_valueof(pool_alloc(current_heap, &pools[szclass(allocsz)]));
     }
-    return jl_valueof(alloc_big(allocsz));
+    else {
+        v = jl_valueof(alloc_big(allocsz));
+    }
+#endif
+    gc_alloc_count(v, allocsz);
+    return v;
 }
 
 JL_DLLEXPORT jl_value_t *jl_gc_alloc_0w(void)
@@ -2396,8 +4277,9 @@ JL_DLLEXPORT jl_value_t *jl_gc_alloc_0w(void)
     tag = alloc_big(sz);
 #else
     FOR_CURRENT_HEAP ()
-        tag = _pool_alloc(&pools[szclass(sz)], sz);
+        tag = _pool_alloc(current_heap, &pools[szclass(sz)], sz);
 #endif
+    gc_alloc_count(jl_valueof(tag), sz);
     return jl_valueof(tag);
 }
 
@@ -2409,8 +4291,9 @@ JL_DLLEXPORT jl_value_t *jl_gc_alloc_1w(void)
     tag = alloc_big(sz);
 #else
     FOR_CURRENT_HEAP ()
-        tag = _pool_alloc(&pools[szclass(sz)], sz);
+        tag = _pool_alloc(current_heap, &pools[szclass(sz)], sz);
 #endif
+    gc_alloc_count(jl_valueof(tag), sz);
     return jl_valueof(tag);
 }
 
@@ -2422,8 +4305,9 @@ JL_DLLEXPORT jl_value_t *jl_gc_alloc_2w(void)
     tag = alloc_big(sz);
 #else
     FOR_CURRENT_HEAP ()
-        tag = _pool_alloc(&pools[szclass(sz)], sz);
+        tag = _pool_alloc(current_heap, &pools[szclass(sz)], sz);
 #endif
+    gc_alloc_count(jl_valueof(tag), sz);
     return jl_valueof(tag);
 }
 
@@ -2435,8 +4319,9 @@ JL_DLLEXPORT jl_value_t *jl_gc_alloc_3w(void)
     tag = alloc_big(sz);
 #else
     FOR_CURRENT_HEAP ()
-        tag = _pool_alloc(&pools[szclass(sz)], sz);
+        tag = _pool_alloc(current_heap, &pools[szclass(sz)], sz);
 #endif
+    gc_alloc_count(jl_valueof(tag), sz);
     return jl_valueof(tag);
 }
 
@@ -2487,10 +4372,15 @@ jl_thread_heap_t *jl_mk_thread_heap(void)
             p[i].osize = szc[i];
             p[i].freelist = NULL;
             p[i].newpages = NULL;
+            p[i].lazy_pages = NULL;
+            p[i].remote_pages = NULL;
+            p[i].nalloc = 0;
             p[i].end_offset = GC_POOL_END_OFS(szc[i]);
         }
         arraylist_new(&preserved_values, 0);
         arraylist_new(&weak_refs, 0);
+        arraylist_new(&weak_refs_old, 0);
+        weak_refs_relisted = 0;
         mallocarrays = NULL;
         mafreelist = NULL;
         big_objects = NULL;
@@ -2499,18 +4389,87 @@ jl_thread_heap_t *jl_mk_thread_heap(void)
         last_remset = &HEAP(_remset)[1];
         arraylist_new(remset, 0);
         arraylist_new(last_remset, 0);
+        memset(&HEAP(mark_stack), 0, sizeof(gc_mark_stack_t));
+        HEAP(par_scanned_bytes) = 0;
+        HEAP(par_perm_scanned_bytes) = 0;
+        HEAP(kept_pages) = 0;
+        HEAP(alloc_countdown) = alloc_prof_running ? alloc_prof_interval : INT64_MAX;
+        memset(&HEAP(num), 0, sizeof(gc_heap_num_t));
+        HEAP(num).allocd = -GC_ALLOC_QUOTA;
+        HEAP(big_allocd) = 0;
+        HEAP(nbigalloc) = 0;
+        HEAP(malloc_allocd) = 0;
+        HEAP(nmalloc) = 0;
     }
     return jl_thread_heap;
 }
 
+// the memory limit of the cgroup the process runs in, 0 if there is none
+static uint64_t gc_cgroup_memory_limit(void)
+{
+#ifdef _OS_LINUX_
+    const char *limit_files[] = {
+        "/sys/fs/cgroup/memory.max", // cgroup v2
+        "/sys/fs/cgroup/memory/memory.limit_in_bytes" // cgroup v1
+    };
+    for (int i = 0; i < sizeof(limit_files)/sizeof(limit_files[0]); i++) {
+        FILE *f = fopen(limit_files[i], "r");
+        if (f == NULL)
+            continue;
+        unsigned long long limit;
+        // "max" in v2 and a huge number in v1 mean no limit
+        int n = fscanf(f, "%llu", &limit);
+        fclose(f);
+        if (n == 1 && limit < uv_get_total_memory())
+            return limit;
+    }
+#endif
+    return 0;
+}
+
 // System-wide initializations
 void jl_gc_init(void)
 {
     gc_debug_init();
 
+#ifdef GC_PARALLEL_MARK
+    char *cp = getenv(GC_PARALLEL_MARK_NAME);
+    if (cp)
+        gc_parallel_mark = strtol(cp, NULL, 10) != 0;
+#endif
+    char *lazy = getenv(GC_LAZY_SWEEP_NAME);
+    if (lazy)
+        gc_lazy_sweep = strtol(lazy, NULL, 10) != 0;
+    char *budget = getenv(GC_PAUSE_BUDGET_NAME);
+    if (budget)
+        gc_pause_budget = strtoull(budget, NULL, 10)*1000;
+    char *delay = getenv(GC_DECOMMIT_DELAY_NAME);
+    if (delay)
+        gc_decommit_delay = strtoull(delay, NULL, 10)*1000000;
+    char *cache = getenv(GC_BIG_CACHE_NAME);
+    if (cache)
+        gc_cache_max = strtoull(cache, NULL, 10);
+    char *huge = getenv(GC_HUGE_PAGES_NAME);
+    if (huge)
+        gc_huge_pages = strtol(huge, NULL, 10) != 0;
+    char *limit = getenv(GC_HEAP_LIMIT_NAME);
+    if (limit)
+        gc_heap_limit = strtoull(limit, NULL, 10);
+    else
+        gc_heap_limit = gc_cgroup_memory_limit()/100*DEFAULT_GC_CGROUP_HEAP_PCT;
+
+#ifdef JULIA_ENABLE_THREADING
+    gc_safepoint_init();
+#endif
+
     arraylist_new(&finalizer_list, 0);
+    arraylist_new(&dirty_pages, 0);
     arraylist_new(&finalizer_list_marked, 0);
     arraylist_new(&to_finalize, 0);
+    arraylist_new(&feedback_lambdas, 0);
+    htable_new(&array_cards, 0);
+    htable_new(&foreign_arrays, 0);
+    arraylist_new(&card_arrays, 0);
 
     collect_interval = default_collect_interval;
     last_long_collect_interval = default_collect_interval;
@@ -2647,8 +4606,7 @@ static void big_obj_stats(void)
 JL_DLLEXPORT void *jl_gc_counted_malloc(size_t sz)
 {
     maybe_collect();
-    allocd_bytes += sz;
-    gc_num.malloc++;
+    gc_count_malloc(sz, 0, GC_COUNT_MALLOC);
     void *b = malloc(sz);
     if (b == NULL)
         jl_throw(jl_memory_exception);
@@ -2658,8 +4616,7 @@ JL_DLLEXPORT void *jl_gc_counted_malloc(size_t sz)
 JL_DLLEXPORT void *jl_gc_counted_calloc(size_t nm, size_t sz)
 {
     maybe_collect();
-    allocd_bytes += nm*sz;
-    gc_num.malloc++;
+    gc_count_malloc(nm*sz, 0, GC_COUNT_MALLOC);
     void *b = calloc(nm, sz);
     if (b == NULL)
         jl_throw(jl_memory_exception);
@@ -2669,8 +4626,7 @@ JL_DLLEXPORT void *jl_gc_counted_calloc(size_t nm, size_t sz)
 JL_DLLEXPORT void jl_gc_counted_free(void *p, size_t sz)
 {
     free(p);
-    freed_bytes += sz;
-    gc_num.freecall++;
+    gc_count_malloc(0, sz, GC_COUNT_FREE);
 }
 
 JL_DLLEXPORT void *jl_gc_counted_realloc_with_old_size(void *p, size_t old,
@@ -2679,10 +4635,9 @@ JL_DLLEXPORT void *jl_gc_counted_realloc_with_old_size(void *p, size_t old,
     maybe_collect();
 
     if (sz < old)
-       freed_bytes += (old - sz);
+        gc_count_malloc(0, old - sz, GC_COUNT_REALLOC);
     else
-       allocd_bytes += (sz - old);
-    gc_num.realloc++;
+        gc_count_malloc(sz - old, 0, GC_COUNT_REALLOC);
     void *b = realloc(p, sz);
     if (b == NULL)
         jl_throw(jl_memory_exception);
@@ -2727,11 +4682,16 @@ JL_DLLEXPORT void *jl_gc_managed_malloc(size_t sz)
     size_t allocsz = LLT_ALIGN(sz, 16);
     if (allocsz < sz)  // overflow in adding offs, size was "negative"
         jl_throw(jl_memory_exception);
-    allocd_bytes += allocsz;
-    gc_num.malloc++;
-    void *b = malloc_a16(allocsz);
+    void *b = gc_cache_malloc(&allocsz);
     if (b == NULL)
         jl_throw(jl_memory_exception);
+    FOR_CURRENT_HEAP () {
+        HEAP(num).allocd += allocsz;
+        HEAP(num).malloc++;
+        HEAP(malloc_allocd) += allocsz;
+        HEAP(nmalloc)++;
+    }
+    gc_alloc_count(NULL, allocsz);
     return b;
 }
 
@@ -2743,20 +4703,24 @@ JL_DLLEXPORT void *jl_gc_managed_realloc(void *d, size_t sz, size_t oldsz,
     size_t allocsz = LLT_ALIGN(sz, 16);
     if (allocsz < sz)  // overflow in adding offs, size was "negative"
         jl_throw(jl_memory_exception);
+    // the buffer may end up in the cache when it's freed
+    allocsz = gc_cache_size(allocsz);
+    if (isaligned)
+        oldsz = gc_cache_size(LLT_ALIGN(oldsz, 16));
 
     if (gc_bits(jl_astaggedvalue(owner)) == GC_MARKED) {
         perm_scanned_bytes += allocsz - oldsz;
         live_bytes += allocsz - oldsz;
+        gc_count_malloc(0, 0, GC_COUNT_REALLOC);
     }
     else if (allocsz < oldsz)
-        freed_bytes += (oldsz - allocsz);
+        gc_count_malloc(0, oldsz - allocsz, GC_COUNT_REALLOC);
     else
-        allocd_bytes += (allocsz - oldsz);
-    gc_num.realloc++;
+        gc_count_malloc(allocsz - oldsz, 0, GC_COUNT_REALLOC);
 
     void *b;
     if (isaligned)
-        b = realloc_a16(d, allocsz, oldsz);
+        b = gc_block_realloc(d, allocsz, oldsz);
     else
         b = realloc(d, allocsz);
     if (b == NULL)
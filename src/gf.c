@@ -51,14 +51,318 @@ static jl_methtable_t *new_method_table(jl_sym_t *name, jl_module_t *module)
     mt->cache = (jl_methlist_t*)jl_nothing;
     mt->cache_arg1 = (jl_array_t*)jl_nothing;
     mt->cache_targ = (jl_array_t*)jl_nothing;
+    mt->cache_exact = (jl_array_t*)jl_nothing;
+    mt->cache_matches = (jl_array_t*)jl_nothing;
     mt->max_args = 0;
     mt->kwsorter = NULL;
-#ifdef JL_GF_PROFILE
-    mt->ncalls = 0;
-#endif
     return mt;
 }
 
+// --- dispatch profiler ---
+
+/*
+  While running, the generic function calls that go through the runtime
+  (jl_apply_generic and the call site caches; not inlined or specialized
+  calls) are counted per method table, together with the misses of the
+  method caches, the time spent resolving those misses (which includes
+  inference and compilation), the specializations cached and the time
+  spent inferring them.
+*/
+typedef struct {
+    uint64_t ncalls;
+    uint64_t nmisses;
+    uint64_t miss_time;  // ns
+    uint64_t nspecializations;
+    uint64_t infer_time; // ns
+} jl_dispatch_stats_t;
+
+// the holders of this lock don't allocate: the threads waiting for it don't
+// take part in collections
+JL_DEFINE_MUTEX(dispatchprof);
+int jl_dispatch_profile_running = 0;
+static int dispatch_profile_inited = 0;
+static htable_t dispatch_profile_index; // mt -> 1 + index into the stats
+static jl_dispatch_stats_t *dispatch_profile_stats = NULL;
+static jl_value_t **dispatch_profile_mts = NULL; // rooted by jl_gc_profile_roots
+static size_t dispatch_profile_len = 0;
+static size_t dispatch_profile_maxlen = 0;
+
+// index of the stats of mt, creating them if needed, or -1 if not running
+static ssize_t dispatch_profile_idx(jl_methtable_t *mt)
+{
+    if (!jl_dispatch_profile_running)
+        return -1;
+    JL_LOCK(dispatchprof);
+    void **bp = ptrhash_bp(&dispatch_profile_index, mt);
+    if (*bp == HT_NOTFOUND) {
+        if (dispatch_profile_len == dispatch_profile_maxlen) {
+            size_t newlen = dispatch_profile_maxlen < 64 ? 64 : 2*dispatch_profile_maxlen;
+            dispatch_profile_stats = (jl_dispatch_stats_t*)realloc(dispatch_profile_stats,
+                                                                   newlen*sizeof(jl_dispatch_stats_t));
+            dispatch_profile_mts = (jl_value_t**)realloc(dispatch_profile_mts,
+                                                         newlen*sizeof(jl_value_t*));
+            dispatch_profile_maxlen = newlen;
+        }
+        memset(&dispatch_profile_stats[dispatch_profile_len], 0, sizeof(jl_dispatch_stats_t));
+        dispatch_profile_mts[dispatch_profile_len] = (jl_value_t*)mt;
+        *bp = (void*)(uintptr_t)(dispatch_profile_len + 1);
+        dispatch_profile_len++;
+    }
+    ssize_t idx = (ssize_t)(uintptr_t)*bp - 1;
+    JL_UNLOCK(dispatchprof);
+    return idx;
+}
+
+// the stats for idx, or NULL if they were cleared in the meantime
+static jl_dispatch_stats_t *dispatch_profile_stats_at(ssize_t idx)
+{
+    if (idx < 0 || (size_t)idx >= dispatch_profile_len)
+        return NULL;
+    return &dispatch_profile_stats[idx];
+}
+
+static inline void dispatch_profile_call(jl_methtable_t *mt)
+{
+    if (__unlikely(jl_dispatch_profile_running)) {
+        jl_dispatch_stats_t *st = dispatch_profile_stats_at(dispatch_profile_idx(mt));
+        if (st) st->ncalls++;
+    }
+}
+
+JL_DLLEXPORT void jl_dispatch_profile_start(void)
+{
+    if (!dispatch_profile_inited) {
+        htable_new(&dispatch_profile_index, 0);
+        dispatch_profile_inited = 1;
+    }
+    jl_dispatch_profile_running = 1;
+}
+
+JL_DLLEXPORT void jl_dispatch_profile_stop(void)
+{
+    jl_dispatch_profile_running = 0;
+}
+
+JL_DLLEXPORT int jl_dispatch_profile_is_running(void)
+{
+    return jl_dispatch_profile_running;
+}
+
+JL_DLLEXPORT void jl_dispatch_profile_clear(void)
+{
+    if (!dispatch_profile_inited)
+        return;
+    JL_LOCK(dispatchprof);
+    htable_reset(&dispatch_profile_index, 0);
+    dispatch_profile_len = 0;
+    JL_UNLOCK(dispatchprof);
+}
+
+// the method tables profiled, in the order of jl_dispatch_profile_get_data
+JL_DLLEXPORT jl_array_t *jl_dispatch_profile_tables(void)
+{
+    // allocated ahead of the lock, the tables added in the meantime are left
+    // out (the callers only read the stats of the tables returned)
+    size_t n = dispatch_profile_len;
+    jl_array_t *a = jl_alloc_cell_1d(n);
+    JL_LOCK(dispatchprof);
+    if (dispatch_profile_len < n)
+        n = dispatch_profile_len;
+    memcpy(jl_array_data(a), dispatch_profile_mts, n*sizeof(jl_value_t*));
+    JL_UNLOCK(dispatchprof);
+    jl_array_del_end(a, jl_array_len(a) - n);
+    return a;
+}
+
+JL_DLLEXPORT uint8_t *jl_dispatch_profile_get_data(void)
+{
+    return (uint8_t*)dispatch_profile_stats;
+}
+
+JL_DLLEXPORT size_t jl_dispatch_profile_len_data(void)
+{
+    return dispatch_profile_len;
+}
+
+// --- compile time profiler ---
+
+/*
+  While running, the time spent compiling each lambda is recorded, split
+  into inference, codegen (emit_function), LLVM optimization and machine
+  code emission. Each phase is timed exclusive of the phases nested in it,
+  like the inference and codegen of a callee while emitting its caller, so
+  the times of all lambdas add up to the total time spent compiling. With
+  a log stream set, every timed phase is also written there as a line of
+  JSON.
+*/
+typedef struct {
+    uint64_t time[JL_COMPILE_NPHASES]; // ns
+} jl_compile_stats_t;
+
+static const char *const compile_phase_names[JL_COMPILE_NPHASES] = {
+    "inference", "codegen", "llvm_opt", "emit"
+};
+
+int jl_compile_timing_on = 0;
+static int compile_profile_running = 0;
+static JL_STREAM *compile_log_stream = NULL;
+static uint64_t compile_timed_total = 0; // ns spent in all phases timed so far
+static int compile_profile_inited = 0;
+static htable_t compile_profile_index; // li -> 1 + index into the stats
+static jl_compile_stats_t *compile_profile_stats = NULL;
+static jl_value_t **compile_profile_lambdas = NULL; // rooted by jl_gc_profile_roots
+static size_t compile_profile_len = 0;
+static size_t compile_profile_maxlen = 0;
+
+static void compile_profile_add(jl_lambda_info_t *li, int phase, uint64_t dt)
+{
+    void **bp = ptrhash_bp(&compile_profile_index, li);
+    if (*bp == HT_NOTFOUND) {
+        if (compile_profile_len == compile_profile_maxlen) {
+            size_t newlen = compile_profile_maxlen < 64 ? 64 : 2*compile_profile_maxlen;
+            compile_profile_stats = (jl_compile_stats_t*)realloc(compile_profile_stats,
+                                                                 newlen*sizeof(jl_compile_stats_t));
+            compile_profile_lambdas = (jl_value_t**)realloc(compile_profile_lambdas,
+                                                            newlen*sizeof(jl_value_t*));
+            compile_profile_maxlen = newlen;
+        }
+        memset(&compile_profile_stats[compile_profile_len], 0, sizeof(jl_compile_stats_t));
+        compile_profile_lambdas[compile_profile_len] = (jl_value_t*)li;
+        *bp = (void*)(uintptr_t)(compile_profile_len + 1);
+        compile_profile_len++;
+    }
+    compile_profile_stats[(uintptr_t)*bp - 1].time[phase] += dt;
+}
+
+// the JSON line of a timed phase, written to the log stream by the caller
+static void compile_log(ios_t *s, jl_lambda_info_t *li, int phase, uint64_t dt)
+{
+    ios_t buf;
+    ios_mem(&buf, 0);
+    jl_static_show((JL_STREAM*)&buf, (jl_value_t*)li);
+    size_t i, n = buf.size;
+    ios_printf(s, "{\"lambda\": \"");
+    for (i = 0; i < n; i++) {
+        unsigned char c = buf.buf[i];
+        if (c == '"' || c == '\\')
+            ios_printf(s, "\\%c", c);
+        else if (c < 0x20)
+            ios_printf(s, "\\u%04x", c);
+        else
+            ios_putc(c, s);
+    }
+    ios_printf(s, "\", \"phase\": \"%s\", \"ns\": %" PRIu64 "}\n",
+               compile_phase_names[phase], dt);
+    ios_close(&buf);
+}
+
+void jl_compile_timer_start(jl_compile_timer_t *t)
+{
+    t->t0 = jl_compile_timing_on ? jl_hrtime() : 0;
+    t->nested0 = compile_timed_total;
+}
+
+void jl_compile_timer_stop(jl_compile_timer_t *t, jl_lambda_info_t *li, int phase)
+{
+    if (t->t0 == 0 || !jl_compile_timing_on)
+        return;
+    uint64_t dt = jl_hrtime() - t->t0 - (compile_timed_total - t->nested0);
+    compile_timed_total += dt;
+    if (li == NULL)
+        return;
+    // the line is built ahead of the lock, only the C storage of the
+    // profile and the stream are touched under it
+    ios_t line;
+    int logging = compile_log_stream != NULL;
+    if (logging) {
+        ios_mem(&line, 0);
+        compile_log(&line, li, phase, dt);
+    }
+    JL_LOCK(dispatchprof);
+    if (compile_profile_running)
+        compile_profile_add(li, phase, dt);
+    if (logging && compile_log_stream != NULL)
+        jl_printf(compile_log_stream, "%.*s", (int)line.size, line.buf);
+    JL_UNLOCK(dispatchprof);
+    if (logging)
+        ios_close(&line);
+}
+
+JL_DLLEXPORT void jl_compile_profile_start(void)
+{
+    if (!compile_profile_inited) {
+        htable_new(&compile_profile_index, 0);
+        compile_profile_inited = 1;
+    }
+    compile_profile_running = 1;
+    jl_compile_timing_on = 1;
+}
+
+JL_DLLEXPORT void jl_compile_profile_stop(void)
+{
+    compile_profile_running = 0;
+    jl_compile_timing_on = compile_log_stream != NULL;
+}
+
+JL_DLLEXPORT int jl_compile_profile_is_running(void)
+{
+    return compile_profile_running;
+}
+
+JL_DLLEXPORT void jl_compile_profile_clear(void)
+{
+    if (!compile_profile_inited)
+        return;
+    JL_LOCK(dispatchprof);
+    htable_reset(&compile_profile_index, 0);
+    compile_profile_len = 0;
+    JL_UNLOCK(dispatchprof);
+}
+
+// the lambdas profiled, in the order of jl_compile_profile_get_data
+JL_DLLEXPORT jl_array_t *jl_compile_profile_lambdas_list(void)
+{
+    // same as jl_dispatch_profile_tables
+    size_t n = compile_profile_len;
+    jl_array_t *a = jl_alloc_cell_1d(n);
+    JL_LOCK(dispatchprof);
+    if (compile_profile_len < n)
+        n = compile_profile_len;
+    memcpy(jl_array_data(a), compile_profile_lambdas, n*sizeof(jl_value_t*));
+    JL_UNLOCK(dispatchprof);
+    jl_array_del_end(a, jl_array_len(a) - n);
+    return a;
+}
+
+JL_DLLEXPORT uint8_t *jl_compile_profile_get_data(void)
+{
+    return (uint8_t*)compile_profile_stats;
+}
+
+JL_DLLEXPORT size_t jl_compile_profile_len_data(void)
+{
+    return compile_profile_len;
+}
+
+// write the timed phases to s as JSON lines, or stop if s is NULL
+JL_DLLEXPORT void jl_compile_log(void *s)
+{
+    JL_LOCK(dispatchprof);
+    compile_log_stream = (JL_STREAM*)s;
+    jl_compile_timing_on = compile_profile_running || s != NULL;
+    JL_UNLOCK(dispatchprof);
+}
+
+// mark the values held by the profilers
+void jl_gc_profile_roots(void (*f)(jl_value_t*))
+{
+    size_t i;
+    for (i = 0; i < dispatch_profile_len; i++)
+        f(dispatch_profile_mts[i]);
+    for (i = 0; i < compile_profile_len; i++)
+        f(compile_profile_lambdas[i]);
+}
+
 static int cache_match_by_type(jl_value_t **types, size_t n, jl_tupletype_t *sig, int va)
 {
     if (!va && n > jl_datatype_nfields(sig))
@@ -203,6 +507,185 @@ static jl_methlist_t **mtcache_hash_bp(jl_array_t **pa, jl_value_t *ty,
     return NULL;
 }
 
+/*
+  On top of the method caches described below, calls whose argument types
+  all have uids are remembered in an open-addressed table keyed by the full
+  argument signature (cache_exact), so a hit costs one hash probe no matter
+  how many entries the other caches hold. Arguments that are themselves
+  data types are keyed by value, since Type{T} signatures dispatch on them.
+  The table only records answers found in the other caches. A new
+  definition flushes it; a new cache entry only removes the entries it
+  could now answer differently, leaving a tombstone (jl_nothing) that
+  lookups probe past.
+*/
+#define MTCACHE_EXACT_MAXARGS 32
+#define MTCACHE_EXACT_PROBE   8
+#define MTCACHE_EXACT_MAXSIZE 4096
+
+static inline uptrint_t mtcache_exact_mix(uptrint_t h, jl_value_t *key, int isvalue)
+{
+    return inthash(h ^ (((uptrint_t)((jl_datatype_t*)key)->uid << 1) | isvalue));
+}
+
+// compute the hash and value-mask of an argument list, returning 0 if it
+// cannot be cached in cache_exact
+static int mtcache_exact_key(jl_value_t **args, size_t n, uptrint_t *ph, uptrint_t *pmask)
+{
+    if (n > MTCACHE_EXACT_MAXARGS)
+        return 0;
+    uptrint_t h = n, mask = 0;
+    size_t i;
+    for(i=0; i < n; i++) {
+        jl_value_t *a = args[i];
+        jl_value_t *ty = (jl_value_t*)jl_typeof(a);
+        int isvalue = 0;
+        if (ty == (jl_value_t*)jl_datatype_type) {
+            ty = a;
+            isvalue = 1;
+            mask |= (uptrint_t)1 << i;
+        }
+        else if (jl_is_type(a) || jl_is_typevar(a)) {
+            return 0;
+        }
+        if (((jl_datatype_t*)ty)->uid == 0)
+            return 0;
+        h = mtcache_exact_mix(h, ty, isvalue);
+    }
+    *ph = h;
+    *pmask = mask;
+    return 1;
+}
+
+// entries are svecs of the form (func, mask, key_1, ..., key_n)
+static uptrint_t mtcache_exact_entry_hash(jl_svec_t *e)
+{
+    size_t i, n = jl_svec_len(e) - 2;
+    uptrint_t mask = jl_unbox_long(jl_svecref(e, 1));
+    uptrint_t h = n;
+    for(i=0; i < n; i++)
+        h = mtcache_exact_mix(h, jl_svecref(e, i+2), (mask >> i) & 1);
+    return h;
+}
+
+static inline int mtcache_exact_match(jl_svec_t *e, jl_value_t **args, size_t n, uptrint_t mask)
+{
+    if (jl_svec_len(e) != n+2 || (uptrint_t)jl_unbox_long(jl_svecref(e, 1)) != mask)
+        return 0;
+    jl_value_t **keys = jl_svec_data(e) + 2;
+    size_t i;
+    for(i=0; i < n; i++) {
+        jl_value_t *k = ((mask >> i) & 1) ? args[i] : (jl_value_t*)jl_typeof(args[i]);
+        if (keys[i] != k)
+            return 0;
+    }
+    return 1;
+}
+
+static jl_function_t *mtcache_exact_lookup(jl_array_t *a, jl_value_t **args, size_t n,
+                                           uptrint_t h, uptrint_t mask)
+{
+    size_t sz = jl_array_len(a), i;
+    jl_svec_t **d = (jl_svec_t**)jl_array_data(a);
+    for(i=0; i < MTCACHE_EXACT_PROBE; i++) {
+        jl_svec_t *e = d[(h+i) & (sz-1)];
+        if (e == NULL)
+            break;
+        if (e != (void*)jl_nothing && mtcache_exact_match(e, args, n, mask))
+            return (jl_function_t*)jl_svecref(e, 0);
+    }
+    return NULL;
+}
+
+// place e in a, returning 0 if no slot within the probe distance is free
+static int mtcache_exact_place(jl_array_t *a, jl_svec_t *e, uptrint_t h)
+{
+    size_t sz = jl_array_len(a), i;
+    for(i=0; i < MTCACHE_EXACT_PROBE; i++) {
+        size_t idx = (h+i) & (sz-1);
+        jl_value_t *old = jl_cellref(a, idx);
+        if (old == NULL || old == jl_nothing) {
+            jl_cellset(a, idx, e);
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static void mtcache_exact_insert(jl_methtable_t *mt, jl_value_t **args, size_t n,
+                                 uptrint_t h, uptrint_t mask, jl_function_t *f)
+{
+    jl_svec_t *e = jl_alloc_svec(n+2);
+    JL_GC_PUSH1(&e);
+    jl_svecset(e, 0, f);
+    jl_svecset(e, 1, jl_box_long(mask));
+    size_t i;
+    for(i=0; i < n; i++)
+        jl_svecset(e, i+2, ((mask >> i) & 1) ? args[i] : (jl_value_t*)jl_typeof(args[i]));
+    if (mt->cache_exact == (void*)jl_nothing) {
+        mt->cache_exact = jl_alloc_cell_1d(16);
+        jl_gc_wb(mt, mt->cache_exact);
+    }
+    while (!mtcache_exact_place(mt->cache_exact, e, h)) {
+        jl_array_t *old = mt->cache_exact;
+        size_t sz = jl_array_len(old);
+        if (sz >= MTCACHE_EXACT_MAXSIZE) {
+            // full; evict whatever occupies the home slot
+            jl_cellset(old, h & (sz-1), e);
+            break;
+        }
+        jl_array_t *na = jl_alloc_cell_1d(sz*2);
+        for(i=0; i < sz; i++) {
+            jl_svec_t *oe = (jl_svec_t*)jl_cellref(old, i);
+            if (oe != NULL && oe != (void*)jl_nothing)
+                (void)mtcache_exact_place(na, oe, mtcache_exact_entry_hash(oe));
+        }
+        mt->cache_exact = na;
+        jl_gc_wb(mt, na);
+    }
+    JL_GC_POP();
+}
+
+static void mtcache_exact_flush(jl_methtable_t *mt)
+{
+    jl_array_t *a = mt->cache_exact;
+    if (a != (void*)jl_nothing)
+        memset(jl_array_data(a), 0, jl_array_len(a)*sizeof(void*));
+}
+
+// whether the call recorded in e matches sig, the same way the lookup in
+// the other caches matches its arguments
+static int mtcache_exact_entry_covered(jl_svec_t *e, jl_tupletype_t *sig)
+{
+    size_t n = jl_svec_len(e) - 2, np = jl_nparams(sig), i;
+    int va = jl_is_va_tuple(sig);
+    if (va ? n < np-1 : n != np)
+        return 0;
+    uptrint_t mask = jl_unbox_long(jl_svecref(e, 1));
+    for(i=0; i < n; i++) {
+        jl_value_t *p = jl_tparam(sig, i < np ? i : np-1);
+        if (jl_is_vararg_type(p))
+            p = jl_tparam0(p);
+        if (!jl_subtype(jl_svecref(e, i+2), p, (mask >> i) & 1))
+            return 0;
+    }
+    return 1;
+}
+
+// drop the entries that a new cache entry for sig may answer differently
+static void mtcache_exact_invalidate(jl_methtable_t *mt, jl_tupletype_t *sig)
+{
+    jl_array_t *a = mt->cache_exact;
+    if (a == (void*)jl_nothing)
+        return;
+    size_t sz = jl_array_len(a), i;
+    jl_value_t **d = (jl_value_t**)jl_array_data(a);
+    for(i=0; i < sz; i++) {
+        if (d[i] != NULL && d[i] != jl_nothing &&
+            mtcache_exact_entry_covered((jl_svec_t*)d[i], sig))
+            d[i] = jl_nothing;
+    }
+}
+
 /*
   Method caches are divided into three parts: one for signatures where
   the first argument is a singleton kind (Type{Foo}), one indexed by the
@@ -243,9 +726,8 @@ static jl_function_t *jl_method_table_assoc_exact_by_type(jl_methtable_t *mt, jl
     return jl_bottom_func;
 }
 
-static jl_function_t *jl_method_table_assoc_exact(jl_methtable_t *mt, jl_value_t **args, size_t n)
+static jl_function_t *jl_method_table_assoc_exact_(jl_methtable_t *mt, jl_value_t **args, size_t n)
 {
-    // NOTE: This function is a huge performance hot spot!!
     jl_methlist_t *ml = (jl_methlist_t*)jl_nothing;
     if (n > 0) {
         jl_value_t *a0 = args[0];
@@ -298,6 +780,24 @@ static jl_function_t *jl_method_table_assoc_exact(jl_methtable_t *mt, jl_value_t
     return jl_bottom_func;
 }
 
+static jl_function_t *jl_method_table_assoc_exact(jl_methtable_t *mt, jl_value_t **args, size_t n)
+{
+    // NOTE: This function is a huge performance hot spot!!
+    uptrint_t h, mask;
+    int exact = mtcache_exact_key(args, n, &h, &mask);
+    if (exact && mt->cache_exact != (void*)jl_nothing) {
+        jl_function_t *f = mtcache_exact_lookup(mt->cache_exact, args, n, h, mask);
+        if (f != NULL)
+            return f;
+    }
+    jl_function_t *f = jl_method_table_assoc_exact_(mt, args, n);
+    // guard entries (jl_bottom_func) are not remembered, so that a miss
+    // always falls through to the full lookup
+    if (exact && f != jl_bottom_func)
+        mtcache_exact_insert(mt, args, n, h, mask, f);
+    return f;
+}
+
 // return a new lambda-info that has some extra static parameters merged in.
 jl_lambda_info_t *jl_add_static_parameters(jl_lambda_info_t *l, jl_svec_t *sp, jl_tupletype_t *types)
 {
@@ -307,6 +807,7 @@ jl_lambda_info_t *jl_add_static_parameters(jl_lambda_info_t *l, jl_svec_t *sp, j
     jl_lambda_info_t *nli = jl_copy_lambda_info(l);
     nli->sparams = sp; // no gc_wb needed
     nli->tfunc = jl_nothing;
+    nli->tfunc_index = jl_nothing;
     nli->capt = NULL;
     nli->specializations = NULL;
     nli->unspecialized = NULL;
@@ -379,6 +880,7 @@ jl_function_t *jl_method_cache_insert(jl_methtable_t *mt, jl_tupletype_t *type,
 {
     jl_methlist_t **pml = &mt->cache;
     jl_value_t* cache_array = NULL;
+    mtcache_exact_invalidate(mt, type);
     if (jl_datatype_nfields(type) > 0) {
         jl_value_t *t0 = jl_tparam0(type);
         uptrint_t uid=0;
@@ -422,7 +924,7 @@ jl_function_t *jl_method_cache_insert(jl_methtable_t *mt, jl_tupletype_t *type,
 int jl_in_inference = 0;
 void jl_type_infer(jl_lambda_info_t *li, jl_tupletype_t *argtypes, jl_lambda_info_t *def)
 {
-    JL_LOCK(codegen);
+    JL_LOCK_SAFEPOINT(codegen);
     int last_ii = jl_in_inference;
     jl_in_inference = 1;
     if (jl_typeinf_func != NULL) {
@@ -442,7 +944,10 @@ void jl_type_infer(jl_lambda_info_t *li, jl_tupletype_t *argtypes, jl_lambda_inf
         jl_printf(JL_STDERR, "\n");
 #endif
 #ifdef ENABLE_INFERENCE
+        jl_compile_timer_t timer;
+        jl_compile_timer_start(&timer);
         jl_value_t *newast = jl_apply(jl_typeinf_func, fargs, 4);
+        jl_compile_timer_stop(&timer, li, JL_COMPILE_INFER);
         li->ast = jl_fieldref(newast, 0);
         jl_gc_wb(li, li->ast);
         li->inferred = 1;
@@ -488,7 +993,7 @@ static jl_function_t *cache_method(jl_methtable_t *mt, jl_tupletype_t *type,
                                    jl_function_t *method, jl_tupletype_t *decl,
                                    jl_svec_t *sparams, int8_t isstaged)
 {
-    JL_LOCK(codegen);
+    JL_LOCK_SAFEPOINT(codegen);
     size_t i;
     int need_guard_entries = 0;
     jl_value_t *temp=NULL;
@@ -861,7 +1366,15 @@ static jl_function_t *cache_method(jl_methtable_t *mt, jl_tupletype_t *type,
         }
         method->linfo->specializations = spe;
         jl_gc_wb(method->linfo, method->linfo->specializations);
+        uint64_t t0 = jl_dispatch_profile_running ? jl_hrtime() : 0;
         jl_type_infer(newmeth->linfo, type, method->linfo);
+        if (t0) {
+            jl_dispatch_stats_t *st = dispatch_profile_stats_at(dispatch_profile_idx(mt));
+            if (st) {
+                st->nspecializations++;
+                st->infer_time += jl_hrtime() - t0;
+            }
+        }
     }
     JL_GC_POP();
     JL_UNLOCK(codegen);
@@ -1097,6 +1610,47 @@ static int sigs_eq(jl_value_t *a, jl_value_t *b, int useenv)
     return jl_subtype(a, b, 0) && jl_subtype(b, a, 0);
 }
 
+// whether two argument types can be seen to have no values in common
+// without computing their intersection. data types share a subtype only
+// if one of their names is an ancestor of the other.
+static int param_types_disjoint(jl_value_t *a, jl_value_t *b)
+{
+    if (a == b || !jl_is_datatype(a) || !jl_is_datatype(b) ||
+        jl_is_vararg_type(a) || jl_is_vararg_type(b))
+        return 0;
+    jl_typename_t *an = ((jl_datatype_t*)a)->name, *bn = ((jl_datatype_t*)b)->name;
+    jl_datatype_t *t;
+    for(t = (jl_datatype_t*)a; ; t = t->super) {
+        if (t->name == bn)
+            return 0;
+        if (t == jl_any_type)
+            break;
+    }
+    for(t = (jl_datatype_t*)b; ; t = t->super) {
+        if (t->name == an)
+            return 0;
+        if (t == jl_any_type)
+            break;
+    }
+    return 1;
+}
+
+// a cheap, conservative test that two signatures don't intersect, used to
+// skip the expensive comparisons against unrelated methods when inserting
+static int sigs_disjoint(jl_tupletype_t *a, jl_tupletype_t *b)
+{
+    size_t al = jl_nparams(a), bl = jl_nparams(b);
+    int ava = jl_is_va_tuple(a), bva = jl_is_va_tuple(b);
+    if (!ava && !bva && al != bl)
+        return 1;
+    size_t i, n = al < bl ? al : bl;
+    for(i=0; i < n; i++) {
+        if (param_types_disjoint(jl_tparam(a,i), jl_tparam(b,i)))
+            return 1;
+    }
+    return 0;
+}
+
 JL_DLLEXPORT int jl_args_morespecific(jl_value_t *a, jl_value_t *b)
 {
     int msp = jl_type_morespecific(a,b);
@@ -1163,6 +1717,7 @@ static void check_ambiguous(jl_methlist_t *ml, jl_tupletype_t *type,
     if ((tl==sl ||
          (tl==sl+1 && jl_is_va_tuple(type)) ||
          (tl+1==sl && jl_is_va_tuple(sig))) &&
+        !sigs_disjoint(type, sig) &&
         !jl_args_morespecific((jl_value_t*)sig, (jl_value_t*)type)) {
         jl_value_t *isect = jl_type_intersection((jl_value_t*)type,
                                                  (jl_value_t*)sig);
@@ -1180,8 +1735,10 @@ static void check_ambiguous(jl_methlist_t *ml, jl_tupletype_t *type,
         jl_methlist_t *l = ml;
         char *n;
         JL_STREAM *s;
+        int isect_tuple = jl_is_tuple_type(isect);
         while (l != (void*)jl_nothing) {
-            if (sigs_eq(isect, (jl_value_t*)l->sig, 0))
+            if ((!isect_tuple || !sigs_disjoint((jl_tupletype_t*)isect, l->sig)) &&
+                sigs_eq(isect, (jl_value_t*)l->sig, 0))
                 goto done_chk_amb;  // ok, intersection is covered
             l = l->next;
         }
@@ -1213,6 +1770,16 @@ static int has_unions(jl_tupletype_t *type)
     return 0;
 }
 
+// bumped whenever a method may have been dropped from a method cache or
+// shadowed by a new definition, which invalidates all call site caches
+static volatile size_t dispatch_epoch = 1;
+
+// for the generated code that depends on no method being defined
+volatile size_t *jl_dispatch_epoch_ptr(void)
+{
+    return &dispatch_epoch;
+}
+
 static
 jl_methlist_t *jl_method_list_insert(jl_methlist_t **pml, jl_tupletype_t *type,
                                      jl_function_t *method, jl_svec_t *tvars,
@@ -1224,6 +1791,7 @@ jl_methlist_t *jl_method_list_insert(jl_methlist_t **pml, jl_tupletype_t *type,
     l = *pml;
     while (l != (void*)jl_nothing) {
         if (((l->tvars==jl_emptysvec) == (tvars==jl_emptysvec)) &&
+            !sigs_disjoint(type, l->sig) &&
             sigs_eq((jl_value_t*)type, (jl_value_t*)l->sig, 1)) {
             // method overwritten
             if (check_amb && l->func->linfo && method->linfo &&
@@ -1242,6 +1810,7 @@ jl_methlist_t *jl_method_list_insert(jl_methlist_t **pml, jl_tupletype_t *type,
                 jl_printf(s, ".\n");
             }
             JL_SIGATOMIC_BEGIN();
+            dispatch_epoch++;
             l->sig = type;
             jl_gc_wb(l, l->sig);
             l->tvars = tvars;
@@ -1330,7 +1899,8 @@ static void remove_conflicting(jl_methlist_t **pl, jl_value_t *type)
 {
     jl_methlist_t *l = *pl;
     while (l != (void*)jl_nothing) {
-        if (jl_type_intersection(type, (jl_value_t*)l->sig) !=
+        if (!sigs_disjoint((jl_tupletype_t*)type, l->sig) &&
+            jl_type_intersection(type, (jl_value_t*)l->sig) !=
             (jl_value_t*)jl_bottom_type) {
             *pl = l->next;
         }
@@ -1350,6 +1920,8 @@ static void update_max_args(jl_methtable_t *mt, jl_tupletype_t *type)
         mt->max_args = na;
 }
 
+size_t jl_method_table_generation = 0; // bumped whenever any method is added
+
 jl_methlist_t *jl_method_table_insert(jl_methtable_t *mt, jl_tupletype_t *type,
                                       jl_function_t *method, jl_svec_t *tvars,
                                       int8_t isstaged)
@@ -1357,10 +1929,14 @@ jl_methlist_t *jl_method_table_insert(jl_methtable_t *mt, jl_tupletype_t *type,
     if (jl_svec_len(tvars) == 1)
         tvars = (jl_svec_t*)jl_svecref(tvars,0);
     JL_SIGATOMIC_BEGIN();
+    jl_method_table_generation++;
     jl_methlist_t *ml = jl_method_list_insert(&mt->defs,type,method,tvars,1,isstaged,(jl_value_t*)mt);
     // invalidate cached methods that overlap this definition
     remove_conflicting(&mt->cache, (jl_value_t*)type);
     jl_gc_wb(mt, mt->cache);
+    mtcache_exact_flush(mt);
+    mt->cache_matches = (jl_array_t*)jl_nothing;
+    dispatch_epoch++;
     if (mt->cache_arg1 != (void*)jl_nothing) {
         for(int i=0; i < jl_array_len(mt->cache_arg1); i++) {
             jl_methlist_t **pl = &((jl_methlist_t**)jl_array_data(mt->cache_arg1))[i];
@@ -1824,6 +2400,11 @@ static void _compile_all_enq(jl_value_t *v, htable_t *h, jl_array_t *found, jl_f
     }
 }
 
+// inference and codegen run serially here, since inference runs julia code
+// and codegen emits into the one shared module under the codegen lock.
+// the function passes for what is compiled here are deferred: with
+// JULIA_IMAGE_THREADS > 1, jl_dump_objfile splits the module and each
+// thread optimizes and emits one partition in its own LLVMContext.
 void jl_compile_all(void)
 {
     htable_t h;
@@ -1833,6 +2414,7 @@ void jl_compile_all(void)
     // and (generic-function, method) pairs that may be optimized (and need to be compiled)
     jl_array_t *m = jl_alloc_cell_1d(0);
     JL_GC_PUSH1(&m);
+    jl_defer_function_passes(1);
     while (1) {
         _compile_all_enq((jl_value_t*)jl_bottom_func, &h, m, 0); // not a gf, but appears in the mtable
         _compile_all_enq((jl_value_t*)jl_main_module, &h, m, 0);
@@ -1843,6 +2425,7 @@ void jl_compile_all(void)
         htable_reset(&h, h.size);
         jl_array_del_end(m, changes);
     }
+    jl_defer_function_passes(0);
     JL_GC_POP();
     htable_free(&h);
 }
@@ -1877,9 +2460,7 @@ JL_CALLABLE(jl_apply_generic)
 {
     assert(jl_is_gf(F));
     jl_methtable_t *mt = jl_gf_mtable(F);
-#ifdef JL_GF_PROFILE
-    mt->ncalls++;
-#endif
+    dispatch_profile_call(mt);
 #ifdef JL_TRACE
     int traceen = trace_en; //&& ((char*)&mt < jl_stack_hi-6000000);
     if (traceen)
@@ -1923,7 +2504,15 @@ JL_CALLABLE(jl_apply_generic)
     // if running inference overwrites this particular method, it becomes
     // unreachable from the method table, so root mfunc.
     JL_GC_PUSH2(&tt, &mfunc);
+    uint64_t t0 = jl_dispatch_profile_running ? jl_hrtime() : 0;
     mfunc = jl_mt_assoc_by_type(mt, tt, 1, 0);
+    if (t0) {
+        jl_dispatch_stats_t *st = dispatch_profile_stats_at(dispatch_profile_idx(mt));
+        if (st) {
+            st->nmisses++;
+            st->miss_time += jl_hrtime() - t0;
+        }
+    }
 
     if (mfunc == jl_bottom_func) {
 #ifdef JL_TRACE
@@ -1944,6 +2533,92 @@ JL_CALLABLE(jl_apply_generic)
     return verify_type(res);
 }
 
+/*
+  Inline caches for dynamic call sites. Generated code for a call to a
+  generic function that could not be resolved at compile time passes its
+  own jl_callsite_cache_t, which remembers the last few argument signatures
+  seen there and the methods they dispatched to, so repeated calls skip the
+  method table. Signatures are keyed by type uid, so a freed type can never
+  alias a new one, and entries are only valid for the dispatch_epoch they
+  were filled in.
+  Threads share the caches, and the epoch of an entry is its seqlock: a
+  writer claims the entry by swapping its epoch to CALLSITE_BUSY (which
+  no dispatch_epoch reaches), fills it in, and publishes it by storing
+  the epoch last, with release. A reader loads the epoch with acquire,
+  and checks after reading the entry that the epoch didn't change.
+*/
+
+#define CALLSITE_BUSY ((size_t)-1)
+
+static inline int callsite_keys(jl_value_t **args, uint32_t nargs, uint64_t *keys)
+{
+    uint32_t i;
+    for(i=0; i < nargs; i++) {
+        jl_datatype_t *ty = (jl_datatype_t*)jl_typeof(args[i]);
+        uint64_t isvalue = 0;
+        // Type{T} signatures dispatch on the value of type arguments
+        if (ty == jl_datatype_type) {
+            ty = (jl_datatype_t*)args[i];
+            isvalue = 1;
+        }
+        if (ty->uid == 0)
+            return 0;
+        keys[i] = ((uint64_t)ty->uid << 1) | isvalue;
+    }
+    return 1;
+}
+
+JL_DLLEXPORT jl_value_t *jl_apply_generic_cached(jl_value_t *F, jl_value_t **args, uint32_t nargs,
+                                                 jl_callsite_cache_t *cache)
+{
+    uint64_t keys[JL_CALLSITE_MAXARGS];
+    assert(nargs <= JL_CALLSITE_MAXARGS);
+    if (!callsite_keys(args, nargs, keys))
+        return jl_apply_generic(F, args, nargs);
+    size_t epoch = dispatch_epoch;
+    int i;
+    for(i=0; i < JL_CALLSITE_WAYS; i++) {
+        jl_callsite_entry_t *e = &cache->entries[i];
+        if (JL_ATOMIC_LOAD_ACQUIRE(e->epoch) != epoch)
+            continue;
+        jl_function_t *mfunc = e->func;
+        int match = memcmp(e->keys, keys, nargs*sizeof(uint64_t)) == 0;
+        JL_ATOMIC_FENCE_ACQUIRE();
+        if (match && e->epoch == epoch) {
+            if (mfunc->linfo != NULL &&
+                (mfunc->linfo->inInference || mfunc->linfo->inCompile))
+                break;
+            dispatch_profile_call(jl_gf_mtable(F));
+            return verify_type(jl_apply(mfunc, args, nargs));
+        }
+    }
+    // only remember methods already in the method cache, which keeps them
+    // rooted until the epoch changes; everything else (including the
+    // inference and error cases) is left to jl_apply_generic
+    jl_methtable_t *mt = jl_gf_mtable(F);
+    jl_function_t *mfunc = jl_method_table_assoc_exact(mt, args, nargs);
+    if (mfunc == jl_bottom_func ||
+        (mfunc->linfo != NULL && (mfunc->linfo->inInference || mfunc->linfo->inCompile)))
+        return jl_apply_generic(F, args, nargs);
+    for(i=0; i < (int)nargs; i++) {
+        // other kinds of type values all share the key of their kind
+        if ((jl_is_type(args[i]) && !jl_is_datatype(args[i])) || jl_is_typevar(args[i]))
+            return jl_apply_generic(F, args, nargs);
+    }
+    uint32_t next = cache->next;
+    cache->next = (next + 1) % JL_CALLSITE_WAYS;
+    jl_callsite_entry_t *e = &cache->entries[next];
+    size_t old = e->epoch;
+    // another thread filling the same entry keeps it
+    if (old != CALLSITE_BUSY && JL_ATOMIC_COMPARE_AND_SWAP(e->epoch, old, CALLSITE_BUSY)) {
+        e->func = mfunc;
+        memcpy(e->keys, keys, nargs*sizeof(uint64_t));
+        JL_ATOMIC_STORE_RELEASE(e->epoch, epoch);
+    }
+    dispatch_profile_call(mt);
+    return verify_type(jl_apply(mfunc, args, nargs));
+}
+
 JL_DLLEXPORT jl_value_t *jl_gf_invoke_lookup(jl_function_t *gf,
                                              jl_datatype_t *types)
 {
@@ -2242,6 +2917,16 @@ static jl_value_t *ml_matches(jl_methlist_t *ml, jl_value_t *type,
     return (jl_value_t*)t;
 }
 
+/*
+  Inference asks the same questions of a method table many times, so the
+  answers are remembered in a small direct-mapped table (cache_matches)
+  keyed by the query type and limit. Queries containing type variables
+  are not cached, since their results depend on the variables' identity.
+  The table is dropped whenever a method is added.
+  Callers must not modify the returned array.
+*/
+#define MTCACHE_MATCHES_SIZE 64
+
 // return a cell array of svecs, each describing a method match:
 // {svec(t, spvals, li, cenv), ...}
 // t is the intersection of the type argument and the method signature,
@@ -2258,7 +2943,29 @@ jl_value_t *jl_matching_methods(jl_function_t *gf, jl_value_t *type, int lim)
         return (jl_value_t*)jl_an_empty_cell;
     }
     jl_methtable_t *mt = jl_gf_mtable(gf);
-    return ml_matches(mt->defs, type, jl_gf_name(gf), lim);
+    if (jl_has_typevars(type))
+        return ml_matches(mt->defs, type, jl_gf_name(gf), lim);
+    size_t idx = (size_t)inthash(jl_object_id(type) ^ (uptrint_t)(uint32_t)lim) &
+        (MTCACHE_MATCHES_SIZE-1);
+    if (mt->cache_matches != (void*)jl_nothing) {
+        jl_svec_t *e = (jl_svec_t*)jl_cellref(mt->cache_matches, idx);
+        if (e != NULL && jl_unbox_long(jl_svecref(e, 1)) == lim) {
+            jl_value_t *et = jl_svecref(e, 0);
+            if (et == type || jl_types_equal(et, type))
+                return jl_svecref(e, 2);
+        }
+    }
+    jl_value_t *matches = ml_matches(mt->defs, type, jl_gf_name(gf), lim);
+    jl_value_t *boxedlim = NULL;
+    JL_GC_PUSH2(&matches, &boxedlim);
+    if (mt->cache_matches == (void*)jl_nothing) {
+        mt->cache_matches = jl_alloc_cell_1d(MTCACHE_MATCHES_SIZE);
+        jl_gc_wb(mt, mt->cache_matches);
+    }
+    boxedlim = jl_box_long(lim);
+    jl_cellset(mt->cache_matches, idx, jl_svec(3, type, boxedlim, matches));
+    JL_GC_POP();
+    return matches;
 }
 
 #ifdef __cplusplus
@@ -44,6 +44,10 @@ extern BOOL (WINAPI *hSymRefreshModuleList)(HANDLE);
 #include <unistd.h>
 #endif
 
+#ifdef _OS_LINUX_
+#include <sys/syscall.h>
+#endif
+
 static const char system_image_path[256] = "\0" JL_SYSTEM_IMAGE_PATH;
 
 jl_options_t jl_options = { 0,    // quiet
@@ -399,6 +403,36 @@ void init_stdio(void)
     jl_flush_cstdio();
 }
 
+#ifndef _OS_WINDOWS_
+JL_DLLEXPORT int jl_can_fork(void)
+{
+    // the other threads don't exist in the child. of the runtime's own
+    // helper threads, jl_init_forked_child only starts the signal listener
+    // again: the mach exception and profiler listeners hold ports that
+    // can't be carried over
+#ifdef _OS_DARWIN_
+    return 0;
+#else
+    return jl_n_threads == 1 && jl_n_foreign_threads == 0;
+#endif
+}
+
+JL_DLLEXPORT void jl_init_forked_child(void)
+{
+#ifdef _OS_LINUX_
+    jl_all_task_states[0].kernel_tid = syscall(SYS_gettid);
+#endif
+    // SIGINT, SIGTERM, SIGQUIT and the profiler signals are blocked in all
+    // threads and only taken by the listener thread, which fork doesn't copy
+    restore_signals();
+    if (jl_uv_loop_fork(jl_io_loop) != 0)
+        jl_errorf("could not set up the event loop after fork: %s", strerror(errno));
+    // the handles of the parent's stdio are left alone (jl_uv_loop_fork
+    // dropped their watchers): the parent keeps using their descriptors
+    init_stdio();
+}
+#endif
+
 #ifdef JL_USE_INTEL_JITEVENTS
 char jl_using_intel_jitevents; // Non-zero if running under Intel VTune Amplifier
 #endif
@@ -407,6 +441,10 @@ char jl_using_intel_jitevents; // Non-zero if running under Intel VTune Amplifie
 char jl_using_oprofile_jitevents = 0; // Non-zero if running under OProfile
 #endif
 
+#ifdef _OS_LINUX_
+char jl_using_perf_jitevents = 0; // Non-zero if writing a perf map of the JIT code
+#endif
+
 int isabspath(const char *in)
 {
 #ifdef _OS_WINDOWS_
@@ -523,19 +561,60 @@ static void jl_resolve_sysimg_location(JL_IMAGE_SEARCH rel)
         jl_options.load = abspath(jl_options.load);
 }
 
+int jl_startup_tracing = 0;
+int jl_lazy_module_init = 0;
+static uint64_t startup_t0 = 0;
+static uint64_t startup_last = 0;
+
+void jl_startup_trace(const char *phase)
+{
+    if (!jl_startup_tracing)
+        return;
+    uint64_t t = jl_hrtime();
+    jl_safe_printf("startup: %-32s %9.3f ms %11.3f ms total\n", phase,
+                   (t - startup_last) / 1e6, (t - startup_t0) / 1e6);
+    startup_last = t;
+}
+
+void jl_startup_trace_since(const char *what, const char *name, uint64_t t0)
+{
+    if (!jl_startup_tracing)
+        return;
+    uint64_t t = jl_hrtime();
+    jl_safe_printf("startup:   %s %-*s %9.3f ms %11.3f ms total\n", what,
+                   (int)(30 - strlen(what)), name, (t - t0) / 1e6,
+                   (t - startup_t0) / 1e6);
+}
+
+static void jl_init_startup_trace(void)
+{
+    const char *trace = getenv(STARTUP_TRACE_NAME);
+    if (trace && *trace && strcmp(trace, "0") != 0) {
+        jl_startup_tracing = 1;
+        startup_t0 = startup_last = jl_hrtime();
+    }
+    const char *lazy = getenv(LAZY_MODULE_INIT_NAME);
+    if (lazy && *lazy && strcmp(lazy, "0") != 0)
+        jl_lazy_module_init = 1;
+}
+
 void _julia_init(JL_IMAGE_SEARCH rel)
 {
 #ifdef JULIA_ENABLE_THREADING
     // Make sure we finalize the tls callback before starting any threads.
     jl_get_ptls_states_getter();
 #endif
+    jl_init_hrtime();
+    jl_init_startup_trace();
     libsupport_init();
     jl_io_loop = uv_default_loop(); // this loop will internal events (spawning process etc.),
                                     // best to call this first, since it also initializes libuv
     restore_signals();
     jl_resolve_sysimg_location(rel);
+    jl_startup_trace("libuv and libsupport");
     // loads sysimg if available, and conditionally sets jl_options.cpu_target
     jl_preload_sysimg_so(jl_options.image_file);
+    jl_startup_trace("jl_preload_sysimg_so");
     if (jl_options.cpu_target == NULL)
         jl_options.cpu_target = "native";
 
@@ -586,6 +665,13 @@ void _julia_init(JL_IMAGE_SEARCH rel)
     }
 #endif
 
+#if defined(_OS_LINUX_)
+    const char *perf_map = getenv("ENABLE_PERF_MAP");
+    if (perf_map && atoi(perf_map)) {
+        jl_using_perf_jitevents = 1;
+    }
+#endif
+
 
 #if defined(__linux__)
     int ncores = jl_cpu_cores();
@@ -610,13 +696,16 @@ void _julia_init(JL_IMAGE_SEARCH rel)
 
     init_stdio();
     // libuv stdio cleanup depends on jl_init_tasks() because JL_TRY is used in jl_atexit_hook()
+    jl_startup_trace("runtime (gc, types, tasks, stdio)");
 
     jl_init_codegen();
+    jl_startup_trace("jl_init_codegen");
 
     jl_start_threads();
 
     jl_an_empty_cell = (jl_value_t*)jl_alloc_cell_1d(0);
     jl_init_serializer();
+    jl_startup_trace("threads and serializer");
 
     if (!jl_options.image_file) {
         jl_core_module = jl_new_module(jl_symbol("Core"));
@@ -637,6 +726,7 @@ void _julia_init(JL_IMAGE_SEARCH rel)
         jl_get_builtin_hooks();
         jl_boot_file_loaded = 1;
         jl_init_box_caches();
+        jl_startup_trace("boot.jl");
     }
 
     if (jl_options.image_file) {
@@ -649,7 +739,9 @@ void _julia_init(JL_IMAGE_SEARCH rel)
             jl_printf(JL_STDERR, "\n");
             jl_exit(1);
         }
+        jl_startup_trace("jl_restore_system_image (rest)");
     }
+    jl_init_type_memo();
 
     // set module field of primitive types
     int i;
@@ -685,12 +777,15 @@ void _julia_init(JL_IMAGE_SEARCH rel)
         jl_array_t *temp = jl_module_init_order;
         JL_GC_PUSH1(&temp);
         jl_module_init_order = NULL;
+        jl_startup_trace("type memo, imports, signals");
         jl_init_restored_modules(temp);
         JL_GC_POP();
+        jl_startup_trace("module initializers");
     }
 
     if (jl_options.handle_signals == JL_OPTIONS_HANDLE_SIGNALS_ON)
         jl_install_sigint_handler();
+    jl_startup_trace("julia_init done");
 }
 
 extern int asprintf(char **str, const char *fmt, ...);
@@ -828,6 +923,7 @@ void jl_get_builtin_hooks(void)
     jl_utf8_string_type = (jl_datatype_t*)core("UTF8String");
     jl_symbolnode_type = (jl_datatype_t*)core("SymbolNode");
     jl_weakref_type = (jl_datatype_t*)core("WeakRef");
+    jl_vecelement_typename = ((jl_datatype_t*)core("VecElement"))->name;
 
     jl_array_uint8_type = jl_apply_type((jl_value_t*)jl_array_type,
                                         jl_svec2(jl_uint8_type, jl_box_long(1)));
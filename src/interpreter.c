@@ -3,6 +3,7 @@
 #include <stdlib.h>
 #include <setjmp.h>
 #include <assert.h>
+#include <string.h>
 #ifdef _OS_WINDOWS_
 #include <malloc.h>
 #endif
@@ -15,11 +16,166 @@ extern "C" {
 #endif
 
 static jl_value_t *eval(jl_value_t *e, jl_value_t **locals, size_t nl, size_t ngensym);
+typedef struct _label_table_t label_table_t;
 static jl_value_t *eval_body(jl_array_t *stmts, jl_value_t **locals, size_t nl, size_t ngensym,
-                             int start, int toplevel);
+                             label_table_t *labels, int start, int toplevel);
 jl_value_t *jl_eval_module_expr(jl_expr_t *ex);
 int jl_is_toplevel_only_expr(jl_value_t *e);
 
+// type feedback --------------------------------------------------------------
+
+int jl_type_feedback = 0;
+
+// the method whose calls and branches the interpreter is recording, or NULL.
+// the feedback is only gathered with one thread (see jl_init_codegen)
+static jl_lambda_info_t *feedback_linfo = NULL;
+
+// the feedback of li, if it is still to be compiled. it is kept after that
+// so that code_llvm emits li the way it was compiled, and the sweep frees
+// it with li (see jl_gc_track_feedback)
+static jl_feedback_t *feedback_of(jl_lambda_info_t *li)
+{
+    if (li->functionObjects.functionObject != NULL)
+        return NULL;
+    if (li->feedback == NULL) {
+        li->feedback = (jl_feedback_t*)calloc(1, sizeof(jl_feedback_t));
+        jl_gc_track_feedback(li);
+    }
+    return li->feedback;
+}
+
+static void feedback_call(jl_lambda_info_t *li, jl_function_t *f, jl_value_t **args, size_t nargs)
+{
+    jl_feedback_t *fb = feedback_of(li);
+    if (fb == NULL)
+        return;
+    size_t i, j, c;
+    for(c=0; c < fb->ncalls; c++) {
+        if (fb->calls[c].f == f && fb->calls[c].nargs == nargs)
+            break;
+    }
+    if (c == fb->ncalls) {
+        if (fb->ncalls == fb->maxcalls) {
+            fb->maxcalls = fb->maxcalls < 8 ? 8 : 2*fb->maxcalls;
+            fb->calls = (jl_call_feedback_t*)realloc(fb->calls, fb->maxcalls*sizeof(jl_call_feedback_t));
+        }
+        memset(&fb->calls[c], 0, sizeof(jl_call_feedback_t));
+        fb->calls[c].f = f;
+        fb->calls[c].nargs = nargs;
+        fb->ncalls++;
+    }
+    fb->calls[c].ncalls++;
+    for(i=0; i < nargs; i++) {
+        // a type argument can dispatch on its value, which a guard on
+        // its type doesn't cover
+        if (jl_is_type(args[i]) || jl_is_typevar(args[i]))
+            return;
+    }
+    for(j=0; j < JL_FEEDBACK_SIGS && fb->calls[c].sigs[j] != NULL; j++) {
+        jl_tupletype_t *sig = fb->calls[c].sigs[j];
+        for(i=0; i < nargs; i++) {
+            if (jl_typeof(args[i]) != jl_tparam(sig, i))
+                break;
+        }
+        if (i == nargs) {
+            fb->calls[c].counts[j]++;
+            return;
+        }
+    }
+    if (j == JL_FEEDBACK_SIGS)
+        return;
+    jl_value_t **types;
+    JL_GC_PUSHARGS(types, nargs);
+    for(i=0; i < nargs; i++)
+        types[i] = jl_typeof(args[i]);
+    jl_tupletype_t *sig = jl_apply_tuple_type_v(types, nargs);
+    JL_GC_POP();
+    // making the type may have run code that grew the table, or filled the slot
+    if (fb->calls[c].sigs[j] == NULL) {
+        fb->calls[c].sigs[j] = sig;
+        fb->calls[c].counts[j] = 1;
+    }
+}
+
+static void feedback_branch(jl_lambda_info_t *li, int label, int taken)
+{
+    jl_feedback_t *fb = feedback_of(li);
+    if (fb == NULL)
+        return;
+    size_t b;
+    for(b=0; b < fb->nbranches; b++) {
+        if (fb->branches[b].label == label)
+            break;
+    }
+    if (b == fb->nbranches) {
+        if (fb->nbranches == fb->maxbranches) {
+            fb->maxbranches = fb->maxbranches < 8 ? 8 : 2*fb->maxbranches;
+            fb->branches = (jl_branch_feedback_t*)realloc(fb->branches, fb->maxbranches*sizeof(jl_branch_feedback_t));
+        }
+        fb->branches[b].label = label;
+        fb->branches[b].taken = fb->branches[b].nottaken = 0;
+        fb->nbranches++;
+    }
+    if (taken)
+        fb->branches[b].taken++;
+    else
+        fb->branches[b].nottaken++;
+}
+
+// the signature of the calls of f by li, if one was seen often enough to
+// be worth calling its method directly
+jl_tupletype_t *jl_feedback_dominant_sig(jl_lambda_info_t *li, jl_function_t *f, size_t nargs,
+                                         uint32_t *count, uint32_t *ncalls)
+{
+    jl_feedback_t *fb = li->feedback;
+    if (fb == NULL)
+        return NULL;
+    for(size_t c=0; c < fb->ncalls; c++) {
+        jl_call_feedback_t *cf = &fb->calls[c];
+        if (cf->f != f || cf->nargs != nargs)
+            continue;
+        for(size_t j=0; j < JL_FEEDBACK_SIGS && cf->sigs[j] != NULL; j++) {
+            if ((uint64_t)cf->counts[j]*100 >= (uint64_t)cf->ncalls*TYPE_FEEDBACK_DOMINANT) {
+                *count = cf->counts[j];
+                *ncalls = cf->ncalls;
+                return cf->sigs[j];
+            }
+        }
+        return NULL;
+    }
+    return NULL;
+}
+
+// the times li took and didn't take the branch to label
+int jl_feedback_branch(jl_lambda_info_t *li, int label, uint32_t *taken, uint32_t *nottaken)
+{
+    jl_feedback_t *fb = li->feedback;
+    if (fb == NULL)
+        return 0;
+    for(size_t b=0; b < fb->nbranches; b++) {
+        if (fb->branches[b].label == label) {
+            *taken = fb->branches[b].taken;
+            *nottaken = fb->branches[b].nottaken;
+            return 1;
+        }
+    }
+    return 0;
+}
+
+// called by the sweep, it must not call into julia
+void jl_free_feedback(jl_lambda_info_t *li)
+{
+    jl_feedback_t *fb = li->feedback;
+    if (fb != NULL) {
+        li->feedback = NULL;
+        free(fb->calls);
+        free(fb->branches);
+        free(fb);
+    }
+}
+
+// ----------------------------------------------------------------------------
+
 jl_value_t *jl_interpret_toplevel_expr(jl_value_t *e)
 {
     return eval(e, NULL, 0, 0);
@@ -33,15 +189,22 @@ JL_DLLEXPORT jl_value_t *jl_interpret_toplevel_expr_in(jl_module_t *m,
     jl_value_t *v=NULL;
     jl_module_t *last_m = jl_current_module;
     jl_module_t *task_last_m = jl_current_task->current_module;
+    // the callers are inference and codegen, whose reads must not run the
+    // pending __init__ of a module
+    jl_tls_states_t *ptls = jl_get_ptls_states();
+    int8_t last_static_eval = ptls->in_static_eval;
     JL_TRY {
         jl_current_task->current_module = jl_current_module = m;
+        ptls->in_static_eval = 1;
         v = eval(e, locals, nl, 0);
     }
     JL_CATCH {
+        ptls->in_static_eval = last_static_eval;
         jl_current_module = last_m;
         jl_current_task->current_module = task_last_m;
         jl_rethrow();
     }
+    ptls->in_static_eval = last_static_eval;
     jl_current_module = last_m;
     jl_current_task->current_module = task_last_m;
     assert(v);
@@ -62,6 +225,8 @@ static jl_value_t *do_call(jl_function_t *f, jl_value_t **args, size_t nargs,
     for(; i < nargs; i++) {
         argv[i+1] = eval(args[i], locals, nl, ngensym);
     }
+    if (feedback_linfo != NULL && f->fptr == jl_apply_generic)
+        feedback_call(feedback_linfo, f, &argv[1], nargs);
     jl_value_t *result = jl_apply(f, &argv[1], nargs);
     JL_GC_POP();
     return result;
@@ -69,7 +234,7 @@ static jl_value_t *do_call(jl_function_t *f, jl_value_t **args, size_t nargs,
 
 jl_value_t *jl_eval_global_var(jl_module_t *m, jl_sym_t *e)
 {
-    jl_value_t *v = jl_get_global(m, e);
+    jl_value_t *v = jl_get_global_init(m, e);
     if (v == NULL)
         jl_undefined_var_error(e);
     return v;
@@ -78,6 +243,7 @@ jl_value_t *jl_eval_global_var(jl_module_t *m, jl_sym_t *e)
 void jl_check_static_parameter_conflicts(jl_lambda_info_t *li, jl_svec_t *t, jl_sym_t *fname);
 
 int jl_has_intrinsics(jl_expr_t *ast, jl_expr_t *e, jl_module_t *m);
+int jl_eval_with_compiler_p(jl_expr_t *ast, jl_expr_t *expr, int compileloops, jl_module_t *m);
 
 extern int jl_boot_file_loaded;
 extern int inside_typedef;
@@ -106,6 +272,47 @@ static void check_can_assign_type(jl_binding_t *b)
                   jl_symbol_name(b->name));
 }
 
+// jump targets are resolved into a table indexed by label number, instead of
+// searching the statements for the label at every jump. the table is built at
+// the first jump of a body, so bodies that run straight through never scan
+// for labels. it is a GC array rooted by the frame that runs the body, since
+// an exception can leave eval_body at any statement
+struct _label_table_t {
+    jl_array_t *stmts;
+    jl_array_t *table;
+};
+
+static size_t label_table_len(jl_array_t *stmts)
+{
+    size_t j, n = 0;
+    for(j=0; j < jl_array_len(stmts); j++) {
+        jl_value_t *l = jl_cellref(stmts,j);
+        if (jl_is_labelnode(l) && jl_labelnode_label(l) >= (ssize_t)n)
+            n = jl_labelnode_label(l)+1;
+    }
+    return n;
+}
+
+static void resolve_labels(jl_array_t *stmts, size_t *labels)
+{
+    size_t j;
+    for(j=0; j < jl_array_len(stmts); j++) {
+        jl_value_t *l = jl_cellref(stmts,j);
+        if (jl_is_labelnode(l))
+            labels[jl_labelnode_label(l)] = j;
+    }
+}
+
+static size_t label_target(label_table_t *labels, ssize_t label)
+{
+    if (labels->table == NULL) {
+        size_t n = label_table_len(labels->stmts)+1;
+        labels->table = jl_alloc_array_1d(jl_array_uint8_type, n*sizeof(size_t));
+        resolve_labels(labels->stmts, (size_t*)jl_array_data(labels->table));
+    }
+    return ((size_t*)jl_array_data(labels->table))[label];
+}
+
 static jl_value_t *eval(jl_value_t *e, jl_value_t **locals, size_t nl, size_t ngensym)
 {
     if (jl_is_symbol(e)) {
@@ -118,7 +325,7 @@ static jl_value_t *eval(jl_value_t *e, jl_value_t **locals, size_t nl, size_t ng
             }
         }
         if (i >= nl) {
-            v = jl_get_global(jl_current_module, (jl_sym_t*)e);
+            v = jl_get_global_init(jl_current_module, (jl_sym_t*)e);
         }
         if (v == NULL) {
             jl_undefined_var_error((jl_sym_t*)e);
@@ -262,7 +469,11 @@ static jl_value_t *eval(jl_value_t *e, jl_value_t **locals, size_t nl, size_t ng
         return (jl_value_t*)jl_nothing;
     }
     else if (ex->head == body_sym) {
-        return eval_body(ex->args, locals, nl, ngensym, 0, 0);
+        label_table_t labels = {ex->args, NULL};
+        JL_GC_PUSH1(&labels.table);
+        jl_value_t *r = eval_body(ex->args, locals, nl, ngensym, &labels, 0, 0);
+        JL_GC_POP();
+        return r;
     }
     else if (ex->head == exc_sym) {
         return jl_exception_in_transit;
@@ -504,18 +715,6 @@ static jl_value_t *eval(jl_value_t *e, jl_value_t **locals, size_t nl, size_t ng
     return (jl_value_t*)jl_nothing;
 }
 
-static int label_idx(long ltgt, jl_array_t *stmts)
-{
-    size_t j;
-    for(j=0; j < stmts->nrows; j++) {
-        jl_value_t *l = jl_cellref(stmts,j);
-        if (jl_is_labelnode(l) && jl_labelnode_label(l)==ltgt)
-            break;
-    }
-    assert(j < stmts->nrows);
-    return j;
-}
-
 jl_value_t *jl_toplevel_eval_body(jl_array_t *stmts)
 {
     ssize_t ngensym = 0;
@@ -529,14 +728,20 @@ jl_value_t *jl_toplevel_eval_body(jl_array_t *stmts)
     if (ngensym > 0) {
         JL_GC_PUSHARGS(locals, ngensym);
     }
-    jl_value_t *ret = eval_body(stmts, locals, 0, ngensym, 0, 1);
+    jl_value_t *ret;
+    {
+        label_table_t labels = {stmts, NULL};
+        JL_GC_PUSH1(&labels.table);
+        ret = eval_body(stmts, locals, 0, ngensym, &labels, 0, 1);
+        JL_GC_POP();
+    }
     if (ngensym > 0)
         JL_GC_POP();
     return ret;
 }
 
 static jl_value_t *eval_body(jl_array_t *stmts, jl_value_t **locals, size_t nl, size_t ngensym,
-                             int start, int toplevel)
+                             label_table_t *labels, int start, int toplevel)
 {
     jl_handler_t __eh;
     size_t i=start, ns = jl_array_len(stmts);
@@ -546,15 +751,18 @@ static jl_value_t *eval_body(jl_array_t *stmts, jl_value_t **locals, size_t nl,
             jl_error("`body` expression must terminate in `return`. Use `block` instead.");
         jl_value_t *stmt = jl_cellref(stmts,i);
         if (jl_is_gotonode(stmt)) {
-            i = label_idx(jl_gotonode_label(stmt), stmts);
+            i = label_target(labels, jl_gotonode_label(stmt));
             continue;
         }
         if (jl_is_expr(stmt)) {
             jl_sym_t *head = ((jl_expr_t*)stmt)->head;
             if (head == goto_ifnot_sym) {
                 jl_value_t *cond = eval(jl_exprarg(stmt,0), locals, nl, ngensym);
+                // the labels of a toplevel thunk are not those of the method
+                if (feedback_linfo != NULL && !toplevel && (cond == jl_false || cond == jl_true))
+                    feedback_branch(feedback_linfo, jl_unbox_long(jl_exprarg(stmt, 1)), cond == jl_false);
                 if (cond == jl_false) {
-                    i = label_idx(jl_unbox_long(jl_exprarg(stmt, 1)), stmts);
+                    i = label_target(labels, jl_unbox_long(jl_exprarg(stmt, 1)));
                     continue;
                 }
                 else if (cond != jl_true) {
@@ -570,16 +778,18 @@ static jl_value_t *eval_body(jl_array_t *stmts, jl_value_t **locals, size_t nl,
                     return eval(ex, locals, nl, ngensym);
             }
             else if (head == enter_sym) {
-                jl_enter_handler(&__eh);
-                if (!jl_setjmp(__eh.eh_ctx,1)) {
-                    return eval_body(stmts, locals, nl, ngensym, i+1, toplevel);
+                jl_eh_push_state(&__eh);
+                // no need to save the signal mask (a syscall): signal
+                // handlers unblock their signal before throwing
+                if (!jl_setjmp(__eh.eh_ctx,0)) {
+                    return eval_body(stmts, locals, nl, ngensym, labels, i+1, toplevel);
                 }
                 else {
 #ifdef _OS_WINDOWS_
                     if (jl_exception_in_transit == jl_stackovf_exception)
                         _resetstkoflw();
 #endif
-                    i = label_idx(jl_unbox_long(jl_exprarg(stmt,0)), stmts);
+                    i = label_target(labels, jl_unbox_long(jl_exprarg(stmt,0)));
                     continue;
                 }
             }
@@ -606,10 +816,9 @@ static jl_value_t *eval_body(jl_array_t *stmts, jl_value_t **locals, size_t nl,
     return NULL;
 }
 
-jl_value_t *jl_interpret_toplevel_thunk_with(jl_lambda_info_t *lam,
-                                             jl_value_t **loc, size_t nl)
+static jl_value_t *interpret_lambda(jl_expr_t *ast, jl_value_t **loc, size_t nl,
+                                   int toplevel)
 {
-    jl_expr_t *ast = (jl_expr_t*)lam->ast;
     jl_array_t *stmts = jl_lam_body(ast)->args;
     size_t nargs = jl_array_len(jl_lam_args(ast));
     jl_array_t *l = jl_lam_vinfo(ast);
@@ -629,7 +838,84 @@ jl_value_t *jl_interpret_toplevel_thunk_with(jl_lambda_info_t *lam,
         locals[i*2]   = loc[(i-llength)*2];
         locals[i*2+1] = loc[(i-llength)*2+1];
     }
-    r = eval_body(stmts, locals, nl, ngensym, 0, 1);
+    {
+        label_table_t labels = {stmts, NULL};
+        JL_GC_PUSH1(&labels.table);
+        r = eval_body(stmts, locals, nl, ngensym, &labels, 0, toplevel);
+        JL_GC_POP();
+    }
+    JL_GC_POP();
+    return r;
+}
+
+jl_value_t *jl_interpret_toplevel_thunk_with(jl_lambda_info_t *lam,
+                                             jl_value_t **loc, size_t nl)
+{
+    // the calls of toplevel code (an eval in a method, say) aren't those
+    // of the method being recorded
+    jl_lambda_info_t *last_feedback = feedback_linfo;
+    jl_value_t *r = NULL;
+    feedback_linfo = NULL;
+    JL_TRY {
+        r = interpret_lambda((jl_expr_t*)lam->ast, loc, nl, 1);
+    }
+    JL_CATCH {
+        feedback_linfo = last_feedback;
+        jl_rethrow();
+    }
+    feedback_linfo = last_feedback;
+    return r;
+}
+
+// run a call to a method that has not been compiled yet, using the
+// original (uninferred) body of its definition. returns NULL if the body
+// needs the compiler, in which case the caller should compile it instead.
+jl_value_t *jl_interpret_call(jl_function_t *f, jl_value_t **args, uint32_t nargs)
+{
+    jl_lambda_info_t *li = f->linfo;
+    // closure environments and static parameters are only available to
+    // compiled code
+    if (f->env != (jl_value_t*)jl_emptysvec || jl_svec_len(li->sparams) > 0)
+        return NULL;
+    jl_lambda_info_t *def = li->def;
+    jl_value_t *ast = def->ast;
+    jl_value_t **locals;
+    JL_GC_PUSHARGS(locals, 2*nargs+1);
+    if (!jl_is_expr(ast))
+        ast = jl_uncompress_ast(def, ast);
+    locals[2*nargs] = ast;
+    jl_array_t *formals = jl_lam_args((jl_expr_t*)ast);
+    size_t i, nreq = jl_array_len(formals);
+    if (nreq != nargs || (nreq > 0 && jl_is_rest_arg(jl_cellref(formals, nreq-1))) ||
+        jl_lam_vars_captured((jl_expr_t*)ast) ||
+        jl_eval_with_compiler_p((jl_expr_t*)ast, jl_lam_body((jl_expr_t*)ast), 1, def->module)) {
+        JL_GC_POP();
+        return NULL;
+    }
+    for(i=0; i < nargs; i++) {
+        jl_value_t *v = jl_cellref(formals, i);
+        locals[i*2] = jl_is_gensym(v) ? v : (jl_value_t*)jl_decl_var(v);
+        locals[i*2+1] = args[i];
+    }
+    jl_module_t *last_m = jl_current_module;
+    int last_lineno = jl_lineno;
+    jl_lambda_info_t *last_feedback = feedback_linfo;
+    jl_value_t *r = NULL;
+    jl_current_module = def->module;
+    if (jl_type_feedback)
+        feedback_linfo = li;
+    JL_TRY {
+        r = interpret_lambda((jl_expr_t*)ast, locals, nargs, 0);
+    }
+    JL_CATCH {
+        jl_current_module = last_m;
+        jl_lineno = last_lineno;
+        feedback_linfo = last_feedback;
+        jl_rethrow();
+    }
+    jl_current_module = last_m;
+    jl_lineno = last_lineno;
+    feedback_linfo = last_feedback;
     JL_GC_POP();
     return r;
 }
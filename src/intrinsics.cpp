@@ -18,7 +18,12 @@ static void jl_init_intrinsic_functions_codegen(Module *m)
     std::vector<Type *> args3(0); \
     args3.push_back(T_pjlvalue); \
     args3.push_back(T_pjlvalue); \
-    args3.push_back(T_pjlvalue);
+    args3.push_back(T_pjlvalue); \
+    std::vector<Type *> args4(0); \
+    args4.push_back(T_pjlvalue); \
+    args4.push_back(T_pjlvalue); \
+    args4.push_back(T_pjlvalue); \
+    args4.push_back(T_pjlvalue);
 
 #define ADD_I(name, nargs) do { \
         Function *func = Function::Create(FunctionType::get(T_pjlvalue, args##nargs, false), \
@@ -238,6 +243,8 @@ static Constant *julia_const_to_llvm(jl_value_t *e, bool nested=false)
         Type *t = julia_struct_to_llvm(jt, NULL);
         if (type_is_ghost(t))
             return UndefValue::get(NoopType);
+        if (jl_is_vecelement_type(jt))
+            return fields[0];
         if (t->isVectorTy())
             return ConstantVector::get(ArrayRef<Constant*>(fields,llvm_nf));
         if (t->isStructTy()) {
@@ -828,6 +835,200 @@ static jl_cgval_t emit_pointerset(jl_value_t *e, jl_value_t *x, jl_value_t *i, j
     return mark_julia_type(thePtr, false, aty);
 }
 
+// --- atomic pointer access ---
+
+// the ordering a literal Symbol names, false if it isn't one or if the
+// access can't have it
+static bool atomic_order_arg(jl_value_t *arg, bool isload, bool isstore,
+                             AtomicOrdering *order, jl_codectx_t *ctx)
+{
+    jl_value_t *o = static_eval(arg, ctx, true, true);
+    if (o == NULL || !jl_is_symbol(o))
+        return false;
+    const char *name = jl_symbol_name((jl_sym_t*)o);
+    if (!strcmp(name, "sequentially_consistent"))
+        *order = SequentiallyConsistent;
+    else if (!strcmp(name, "monotonic"))
+        *order = Monotonic;
+    else if (!strcmp(name, "acquire") && !isstore)
+        *order = Acquire;
+    else if (!strcmp(name, "release") && !isload)
+        *order = Release;
+    else if (!strcmp(name, "acquire_release") && !isload && !isstore)
+        *order = AcquireRelease;
+    else
+        return false;
+    return true;
+}
+
+// the element type of a pointer the atomic intrinsics can access inline,
+// NULL to leave the access (and its errors) to the runtime
+static jl_value_t *atomic_pointer_eltype(jl_value_t *e, jl_codectx_t *ctx)
+{
+    jl_value_t *aty = expr_type(e, ctx);
+    if (!jl_is_cpointer_type(aty))
+        return NULL;
+    jl_value_t *ety = jl_tparam0(aty);
+    if (!jl_is_leaf_type(ety) || !jl_is_bitstype(ety))
+        return NULL;
+    size_t nb = jl_datatype_size(ety);
+    if (nb != 1 && nb != 2 && nb != 4 && nb != 8)
+        return NULL;
+    return ety;
+}
+
+// atomic instructions operate on integers, convert to and from their type
+static Value *atomic_to_int(Value *v, Type *ity)
+{
+    Type *t = v->getType();
+    if (t->isPointerTy())
+        return builder.CreatePtrToInt(v, ity);
+    if (t == T_int1)
+        return builder.CreateZExt(v, ity);
+    if (t != ity)
+        return builder.CreateBitCast(v, ity);
+    return v;
+}
+
+static Value *atomic_from_int(Value *v, Type *elty)
+{
+    if (elty->isPointerTy())
+        return builder.CreateIntToPtr(v, elty);
+    if (elty == T_int1)
+        return builder.CreateTrunc(v, T_int1);
+    if (elty != v->getType())
+        return builder.CreateBitCast(v, elty);
+    return v;
+}
+
+static jl_cgval_t emit_runtime_atomic(intrinsic f, jl_value_t **args, size_t nargs,
+                                      jl_codectx_t *ctx)
+{
+    int ldepth = ctx->gc.argDepth;
+    Value *argvals[4];
+    for (size_t i = 0; i < nargs; i++)
+        argvals[i] = emit_boxed_rooted(args[i + 1], ctx).V;
+    Value *r = builder.CreateCall(prepare_call(runtime_func[f]),
+                                  ArrayRef<Value*>(&argvals[0], nargs));
+    ctx->gc.argDepth = ldepth;
+    if (f == atomic_pointerset)
+        return mark_julia_type(r, true, expr_type(args[1], ctx));
+    jl_value_t *aty = expr_type(args[1], ctx);
+    jl_value_t *ety = jl_is_cpointer_type(aty) ? jl_tparam0(aty) : (jl_value_t*)jl_any_type;
+    if (jl_is_typevar(ety))
+        ety = (jl_value_t*)jl_any_type;
+    return mark_julia_type(r, true, ety);
+}
+
+// a value operand of an inline atomic access, known to be of the element type
+static Value *emit_atomic_operand(jl_value_t *x, jl_value_t *ety, Type *ity,
+                                  jl_codectx_t *ctx)
+{
+    Type *elty = julia_type_to_llvm(ety);
+    return atomic_to_int(emit_unbox(elty, emit_unboxed(x, ctx), ety), ity);
+}
+
+static jl_cgval_t emit_atomic_intrinsic(intrinsic f, jl_value_t **args, size_t nargs,
+                                        jl_codectx_t *ctx)
+{
+    jl_value_t *ety = atomic_pointer_eltype(args[1], ctx);
+    AtomicOrdering order;
+    bool isload = f == atomic_pointerref;
+    bool isstore = f == atomic_pointerset;
+    if (ety == NULL || !atomic_order_arg(args[nargs], isload, isstore, &order, ctx))
+        return emit_runtime_atomic(f, args, nargs, ctx);
+    // every value operand is of the element type
+    for (size_t i = 2; i < nargs; i++) {
+        if (f == atomic_pointerrmw && i == 2)
+            continue;
+        if (!jl_subtype(expr_type(args[i], ctx), ety, 0))
+            return emit_runtime_atomic(f, args, nargs, ctx);
+    }
+    Type *elty = julia_type_to_llvm(ety);
+    AtomicRMWInst::BinOp rmwop = AtomicRMWInst::Xchg;
+    if (f == atomic_pointerrmw) {
+        jl_value_t *op = static_eval(args[2], ctx, true, true);
+        if (op == NULL || !jl_is_symbol(op))
+            return emit_runtime_atomic(f, args, nargs, ctx);
+        const char *name = jl_symbol_name((jl_sym_t*)op);
+        // the same operations as the runtime version allows. Float16 is an
+        // LLVM integer too, but no integer operation on its bits is right
+        bool isbits = elty->isIntegerTy() &&
+            !jl_subtype(ety, (jl_value_t*)jl_floatingpoint_type, 0);
+        bool isint = isbits && elty != T_int1;
+        bool issigned = jl_subtype(ety, (jl_value_t*)jl_signed_type, 0);
+        if (!strcmp(name, "xchg"))
+            rmwop = AtomicRMWInst::Xchg;
+        else if (!strcmp(name, "and") && isbits)
+            rmwop = AtomicRMWInst::And;
+        else if (!strcmp(name, "or") && isbits)
+            rmwop = AtomicRMWInst::Or;
+        else if (!strcmp(name, "xor") && isbits)
+            rmwop = AtomicRMWInst::Xor;
+        else if (!strcmp(name, "nand") && isint)
+            rmwop = AtomicRMWInst::Nand;
+        else if (!strcmp(name, "add") && isint)
+            rmwop = AtomicRMWInst::Add;
+        else if (!strcmp(name, "sub") && isint)
+            rmwop = AtomicRMWInst::Sub;
+        else if (!strcmp(name, "max") && isint)
+            rmwop = issigned ? AtomicRMWInst::Max : AtomicRMWInst::UMax;
+        else if (!strcmp(name, "min") && isint)
+            rmwop = issigned ? AtomicRMWInst::Min : AtomicRMWInst::UMin;
+        else
+            return emit_runtime_atomic(f, args, nargs, ctx);
+    }
+
+    size_t nb = jl_datatype_size(ety);
+    Type *ity = IntegerType::get(jl_LLVMContext, 8*nb);
+    Value *p = auto_unbox(args[1], ctx);
+    if (nb > 1) {
+        // as in the runtime version: the atomic instructions are only
+        // defined on addresses aligned to the size of the value
+        Value *misalign = builder.CreateAnd(builder.CreatePtrToInt(p, T_size),
+                                            ConstantInt::get(T_size, nb - 1));
+        error_unless(builder.CreateICmpEQ(misalign, ConstantInt::get(T_size, 0)),
+                     std::string(JL_I::jl_intrinsic_name((int)f)) +
+                     ": pointer not aligned to the size of its element", ctx);
+    }
+    Value *thePtr = builder.CreatePointerCast(p, PointerType::get(ity, 0));
+    Value *ret;
+    switch (f) {
+    case atomic_pointerref: {
+        LoadInst *load = builder.CreateAlignedLoad(thePtr, nb);
+        load->setAtomic(order);
+        ret = load;
+        break;
+    }
+    case atomic_pointerset: {
+        Value *x = emit_atomic_operand(args[2], ety, ity, ctx);
+        StoreInst *store = builder.CreateAlignedStore(x, thePtr, nb);
+        store->setAtomic(order);
+        return mark_julia_type(p, false, expr_type(args[1], ctx));
+    }
+    case atomic_pointerrmw: {
+        Value *x = emit_atomic_operand(args[3], ety, ity, ctx);
+        ret = builder.CreateAtomicRMW(rmwop, thePtr, x, order);
+        break;
+    }
+    default: {
+        assert(f == atomic_pointercas);
+        Value *cmp = emit_atomic_operand(args[2], ety, ity, ctx);
+        Value *x = emit_atomic_operand(args[3], ety, ity, ctx);
+#ifdef LLVM35
+        AtomicOrdering failorder = order == AcquireRelease ? Acquire :
+            order == Release ? Monotonic : order;
+        ret = builder.CreateExtractValue(
+            builder.CreateAtomicCmpXchg(thePtr, cmp, x, order, failorder), 0);
+#else
+        ret = builder.CreateAtomicCmpXchg(thePtr, cmp, x, order);
+#endif
+        break;
+    }
+    }
+    return mark_julia_type(atomic_from_int(ret, elty), false, ety);
+}
+
 static Value *emit_checked_srem_int(Value *x, Value *den, jl_codectx_t *ctx)
 {
     Type *t = den->getType();
@@ -936,6 +1137,11 @@ static jl_cgval_t emit_intrinsic(intrinsic f, jl_value_t **args, size_t nargs,
         return emit_pointerref(args[1], args[2], ctx);
     case pointerset:
         return emit_pointerset(args[1], args[2], args[3], ctx);
+    case atomic_pointerref:
+    case atomic_pointerset:
+    case atomic_pointerrmw:
+    case atomic_pointercas:
+        return emit_atomic_intrinsic(f, args, nargs, ctx);
     case box:
         return generic_box(args[1], args[2], ctx);
     case unbox:
@@ -106,6 +106,11 @@
     ALIAS(llvmcall, llvmcall) \
     /* object access */ \
     ADD_I(arraylen, 1) \
+    /*  atomic pointer access */ \
+    ADD_I(atomic_pointerref, 2) \
+    ADD_I(atomic_pointerset, 3) \
+    ADD_I(atomic_pointerrmw, 4) \
+    ADD_I(atomic_pointercas, 4) \
     /*  hidden intrinsics */ \
     ADD_HIDDEN(fptoui_auto, 1) \
     ADD_HIDDEN(fptosi_auto, 1)
@@ -145,6 +150,7 @@ static unsigned intrinsic_nargs[num_intrinsics];
 typedef jl_value_t *(*intrinsic_call_1_arg)(jl_value_t*);
 typedef jl_value_t *(*intrinsic_call_2_arg)(jl_value_t*, jl_value_t*);
 typedef jl_value_t *(*intrinsic_call_3_arg)(jl_value_t*, jl_value_t*, jl_value_t*);
+typedef jl_value_t *(*intrinsic_call_4_arg)(jl_value_t*, jl_value_t*, jl_value_t*, jl_value_t*);
 #define jl_is_intrinsic(v)       jl_typeis(v,jl_intrinsic_type)
 
 #ifdef __cplusplus
@@ -168,6 +174,8 @@ JL_CALLABLE(jl_f_intrinsic_call)
             return ((intrinsic_call_2_arg)runtime_fp[f])(args[1], args[2]);
         case 3:
             return ((intrinsic_call_3_arg)runtime_fp[f])(args[1], args[2], args[3]);
+        case 4:
+            return ((intrinsic_call_4_arg)runtime_fp[f])(args[1], args[2], args[3], args[4]);
         default:
             assert(0 && "unexpected number of arguments to an intrinsic function");
     }
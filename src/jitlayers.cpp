@@ -1,9 +1,15 @@
 // This file is part of Julia.
 // Parts of this file are copied from LLVM, under the UIUC license.
 
+// with cheap set, only add the cleanup passes, for code that emit_function
+// marked as not worth the full pipeline. TM defaults to jl_TargetMachine;
+// the partitions of a system image pass their own, since a TargetMachine
+// can't be shared between threads
 template <class T>
-static void addOptimizationPasses(T *PM)
+static void addOptimizationPasses(T *PM, bool cheap = false, TargetMachine *TM = NULL)
 {
+    if (!TM)
+        TM = jl_TargetMachine;
 #ifdef __has_feature
 #   if __has_feature(address_sanitizer)
 #   if defined(LLVM37) && !defined(LLVM38)
@@ -17,9 +23,9 @@ static void addOptimizationPasses(T *PM)
 #   endif
 #endif
 #ifdef LLVM37
-    PM->add(createTargetTransformInfoWrapperPass(jl_TargetMachine->getTargetIRAnalysis()));
+    PM->add(createTargetTransformInfoWrapperPass(TM->getTargetIRAnalysis()));
 #else
-    jl_TargetMachine->addAnalysisPasses(*PM);
+    TM->addAnalysisPasses(*PM);
 #endif
 #ifdef LLVM38
     PM->add(createTypeBasedAAWrapperPass());
@@ -36,6 +42,15 @@ static void addOptimizationPasses(T *PM)
     // list of passes from vmkit
     PM->add(createCFGSimplificationPass()); // Clean up disgusting code
     PM->add(createPromoteMemoryToRegisterPass());// Kill useless allocas
+    if (cheap) {
+        PM->add(createSROAPass());
+#ifndef INSTCOMBINE_BUG
+        PM->add(createInstructionCombiningPass());
+#endif
+        PM->add(createEarlyCSEPass());
+        PM->add(createAggressiveDCEPass());
+        return;
+    }
 
 #ifndef INSTCOMBINE_BUG
     PM->add(createInstructionCombiningPass()); // Cleanup for scalarrepl.
@@ -79,6 +94,7 @@ static void addOptimizationPasses(T *PM)
 #endif
 #if !defined(LLVM35) && !defined(INSTCOMBINE_BUG)
     PM->add(createLoopVectorizePass());        // Vectorize loops
+    PM->add(createSimdLoopReportPass());       // Report on the vectorization of @simd loops
 #endif
     //FPM->add(createLoopStrengthReducePass());   // (jwb added)
 
@@ -110,9 +126,13 @@ static void addOptimizationPasses(T *PM)
 #endif
 #if defined(LLVM35)
     PM->add(createLoopVectorizePass());         // Vectorize loops
+    PM->add(createSimdLoopReportPass());        // Report on the vectorization of @simd loops
     PM->add(createInstructionCombiningPass());  // Clean up after loop vectorizer
 #endif
     //FPM->add(createCFGSimplificationPass());     // Merge & remove BBs
+#ifdef JULIA_ENABLE_THREADING
+    PM->add(createLoopSafepointPass());         // Poll for collections on the back-edges, after vectorization
+#endif
 }
 
 #ifdef USE_ORCJIT
@@ -243,6 +263,105 @@ public:
 #if defined(_OS_DARWIN_) && defined(LLVM37) && defined(LLVM_SHLIB)
 #define CUSTOM_MEMORY_MANAGER 1
 extern RTDyldMemoryManager* createRTDyldMemoryManagerOSX();
+#else
+// Packs the sections of many small modules into a few large mappings,
+// instead of mapping fresh pages for every section as SectionMemoryManager
+// does. Code and read-only data are only writable until finalizeMemory
+// makes them executable or read-only, and a finalized page is never made
+// writable again: the next module starts on the following page of the pool.
+class JuliaMemoryManager : public RTDyldMemoryManager
+{
+    struct Pool {
+        sys::MemoryBlock block; // current mapping
+        uintptr_t cur;          // next free byte of block
+        uintptr_t unsealed;     // start of the pages of block not finalized yet
+        std::vector<sys::MemoryBlock> pending; // earlier blocks not finalized yet
+        Pool() : cur(0), unsealed(0) {}
+    };
+    Pool CodePool, ROPool, RWPool;
+    sys::MemoryBlock Near; // keep the mappings close for pc-relative relocations
+    static const size_t PoolSize = 8 * 1024 * 1024;
+
+    static uintptr_t pageAlign(uintptr_t p)
+    {
+        uintptr_t page = sys::Process::getPageSize();
+        return (p + page - 1) & ~(page - 1);
+    }
+
+    uint8_t *allocate(Pool &P, uintptr_t Size, unsigned Alignment)
+    {
+        if (Alignment == 0)
+            Alignment = 16;
+        uintptr_t start = (P.cur + Alignment - 1) & ~(uintptr_t)(Alignment - 1);
+        if (P.block.base() == NULL ||
+            start + Size > (uintptr_t)P.block.base() + P.block.size()) {
+            if (P.cur > P.unsealed)
+                P.pending.push_back(sys::MemoryBlock((void*)P.unsealed, P.cur - P.unsealed));
+            std::error_code ec;
+            sys::MemoryBlock B = sys::Memory::allocateMappedMemory(
+                std::max((size_t)PoolSize, (size_t)(Size + Alignment)), &Near,
+                sys::Memory::MF_READ | sys::Memory::MF_WRITE, ec);
+            if (ec)
+                return NULL;
+            Near = P.block = B;
+            P.cur = P.unsealed = (uintptr_t)B.base();
+            start = (P.cur + Alignment - 1) & ~(uintptr_t)(Alignment - 1);
+        }
+        P.cur = start + Size;
+        return (uint8_t*)start;
+    }
+
+    std::error_code seal(Pool &P, unsigned Flags)
+    {
+        std::error_code ec;
+        if (P.cur > P.unsealed)
+            P.pending.push_back(sys::MemoryBlock((void*)P.unsealed, P.cur - P.unsealed));
+        for (size_t i = 0; i < P.pending.size(); i++) {
+            sys::MemoryBlock B(P.pending[i].base(), pageAlign(P.pending[i].size()));
+            ec = sys::Memory::protectMappedMemory(B, Flags);
+            if (ec)
+                break;
+            if (Flags & sys::Memory::MF_EXEC)
+                sys::Memory::InvalidateInstructionCache(B.base(), B.size());
+        }
+        P.pending.clear();
+        if (P.block.base() != NULL) {
+            uintptr_t end = (uintptr_t)P.block.base() + P.block.size();
+            P.cur = P.unsealed = std::min(pageAlign(P.cur), end);
+        }
+        return ec;
+    }
+
+public:
+    JuliaMemoryManager() {}
+
+    uint8_t *allocateCodeSection(uintptr_t Size, unsigned Alignment,
+                                 unsigned SectionID, StringRef SectionName) override
+    {
+        return allocate(CodePool, Size, Alignment);
+    }
+
+    uint8_t *allocateDataSection(uintptr_t Size, unsigned Alignment,
+                                 unsigned SectionID, StringRef SectionName,
+                                 bool isReadOnly) override
+    {
+        return allocate(isReadOnly ? ROPool : RWPool, Size, Alignment);
+    }
+
+    bool finalizeMemory(std::string *ErrMsg) override
+    {
+        std::error_code ec = seal(CodePool, sys::Memory::MF_READ | sys::Memory::MF_EXEC);
+        if (!ec)
+            ec = seal(ROPool, sys::Memory::MF_READ);
+        RWPool.pending.clear(); // writable data is never protected
+        if (ec) {
+            if (ErrMsg)
+                *ErrMsg = ec.message();
+            return true;
+        }
+        return false;
+    }
+};
 #endif
 
 class JuliaOJIT {
@@ -261,26 +380,33 @@ public:
 #ifdef CUSTOM_MEMORY_MANAGER
             createRTDyldMemoryManagerOSX()
 #else
-            new SectionMemoryManager
+            new JuliaMemoryManager
 #endif
             ) {
 #ifdef JL_DEBUG_BUILD
             PM.add(createVerifierPass());
+            CheapPM.add(createVerifierPass());
 #endif
             // In imaging mode, we run the pass manager on creation
             // to make sure it ends up optimized in the shadow module
             if (!imaging_mode) {
                 addOptimizationPasses(&PM);
+                addOptimizationPasses(&CheapPM, true);
 #ifdef JL_DEBUG_BUILD
                 PM.add(createVerifierPass());
+                CheapPM.add(createVerifierPass());
 #endif
             }
-            if (TM.addPassesToEmitMC(PM, Ctx, ObjStream))
+            if (TM.addPassesToEmitMC(PM, Ctx, ObjStream) ||
+                TM.addPassesToEmitMC(CheapPM, Ctx, ObjStream))
                 llvm_unreachable("Target does not support MC emission.");
 
             CompileLayer = std::unique_ptr<CompileLayerT>{new CompileLayerT(ObjectLayer,
                 [&](Module &M) {
-                    PM.run(M);
+                    if (isCheapModule(M))
+                        CheapPM.run(M);
+                    else
+                        PM.run(M);
                     std::unique_ptr<MemoryBuffer> ObjBuffer(
                         new ObjectMemoryBuffer(std::move(ObjBufferSV)));
                     ErrorOr<std::unique_ptr<object::ObjectFile>> Obj =
@@ -304,6 +430,15 @@ public:
                 report_fatal_error("FATAL: unable to dlopen self\n" + *ErrorStr);
         }
 
+    // a module only gets the short pipeline if all of its functions asked for it
+    static bool isCheapModule(Module &M) {
+        for (Function &F : M) {
+            if (!F.isDeclaration() && !F.hasFnAttribute("julia-cheap-opt"))
+                return false;
+        }
+        return true;
+    }
+
     std::string mangle(const std::string &Name) {
         std::string MangledName;
         {
@@ -390,6 +525,7 @@ private:
     SmallVector<char, 4096> ObjBufferSV;
     raw_svector_ostream ObjStream;
     legacy::PassManager PM;
+    legacy::PassManager CheapPM;
     MCContext *Ctx;
     RTDyldMemoryManager *MemMgr;
     ObjLayerT ObjectLayer;
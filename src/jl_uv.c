@@ -17,6 +17,17 @@
 #include <unistd.h>
 #include <sys/socket.h>
 #endif
+#ifdef _OS_LINUX_
+#include <sys/sendfile.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#endif
+#if defined(_OS_DARWIN_) || defined(_OS_FREEBSD_)
+#include <sys/event.h>
+#endif
+#ifndef _OS_WINDOWS_
+#include <fcntl.h>
+#endif
 
 #include "julia.h"
 #include "julia_internal.h"
@@ -62,7 +73,10 @@ static void jl_uv_call_close_callback(void *val)
         cb = jl_get_global(jl_base_relative_to(((jl_datatype_t*)jl_typeof(val))->name->module), jl_symbol("_uv_hook_close"));
     }
     assert(cb && jl_is_function(cb));
+    // called from uv_run, in a gc safe region
+    int8_t gc_state = jl_gc_unsafe_enter();
     jl_apply((jl_function_t*)cb, (jl_value_t**)&val, 1);
+    jl_gc_state_restore(gc_state);
 }
 
 JL_DLLEXPORT void jl_uv_closeHandle(uv_handle_t *handle)
@@ -109,29 +123,35 @@ JL_DLLEXPORT void jl_uv_req_set_data(uv_req_t *req, void *data) { req->data = da
 JL_DLLEXPORT void *jl_uv_handle_data(uv_handle_t *handle) { return handle->data; }
 JL_DLLEXPORT void *jl_uv_write_handle(uv_write_t *req) { return req->handle; }
 
+// the thread waiting in the event loop holds off no collection: the
+// callbacks that run julia code leave the gc safe region while they do
+// (see jl_uv_call_close_callback and the cfunction wrappers)
+static int jl_uv_run(uv_loop_t *loop, uv_run_mode mode)
+{
+    loop->stop_flag = 0;
+    int8_t gc_state = jl_gc_safe_enter();
+    int r = uv_run(loop, mode);
+    jl_gc_state_restore(gc_state);
+    return r;
+}
+
 JL_DLLEXPORT int jl_run_once(uv_loop_t *loop)
 {
-    if (loop) {
-        loop->stop_flag = 0;
-        return uv_run(loop,UV_RUN_ONCE);
-    }
+    if (loop)
+        return jl_uv_run(loop, UV_RUN_ONCE);
     else return 0;
 }
 
 JL_DLLEXPORT void jl_run_event_loop(uv_loop_t *loop)
 {
-    if (loop) {
-        loop->stop_flag = 0;
-        uv_run(loop,UV_RUN_DEFAULT);
-    }
+    if (loop)
+        jl_uv_run(loop, UV_RUN_DEFAULT);
 }
 
 JL_DLLEXPORT int jl_process_events(uv_loop_t *loop)
 {
-    if (loop) {
-        loop->stop_flag = 0;
-        return uv_run(loop,UV_RUN_NOWAIT);
-    }
+    if (loop)
+        return jl_uv_run(loop, UV_RUN_NOWAIT);
     else return 0;
 }
 
@@ -209,6 +229,33 @@ JL_DLLEXPORT void jl_uv_disassociate_julia_struct(uv_handle_t *handle)
     handle->data = NULL;
 }
 
+#ifndef _OS_WINDOWS_
+// copy a NULL-terminated string vector (and its strings) into malloc'd
+// memory, which unlike the GC heap stays mapped in a forked child
+static char **jl_spawn_copy_strv(char **v)
+{
+    if (v == NULL)
+        return NULL;
+    size_t n = 0, i;
+    while (v[n] != NULL)
+        n++;
+    char **copy = (char**)malloc((n+1)*sizeof(char*));
+    for (i = 0; i < n; i++)
+        copy[i] = strdup(v[i]);
+    copy[n] = NULL;
+    return copy;
+}
+
+static void jl_spawn_free_strv(char **v)
+{
+    if (v == NULL)
+        return;
+    for (size_t i = 0; v[i] != NULL; i++)
+        free(v[i]);
+    free(v);
+}
+#endif
+
 JL_DLLEXPORT int jl_spawn(char *name, char **argv, uv_loop_t *loop,
                           uv_process_t *proc, jl_value_t *julia_struct,
                           uv_handle_type stdin_type, uv_pipe_t *stdin_pipe,
@@ -219,6 +266,15 @@ JL_DLLEXPORT int jl_spawn(char *name, char **argv, uv_loop_t *loop,
     uv_process_options_t opts;
     uv_stdio_container_t stdio[3];
     int error;
+#ifndef _OS_WINDOWS_
+    // uv_spawn forks, and the cost of fork grows with the size of the
+    // parent's mappings. the child only execs, so the GC heap is left out of
+    // it; everything the child reads before exec is copied off that heap.
+    name = strdup(name);
+    argv = jl_spawn_copy_strv(argv);
+    env = jl_spawn_copy_strv(env);
+    cwd = cwd ? strdup(cwd) : NULL;
+#endif
     opts.file = name;
     opts.env = env;
 #ifdef _OS_WINDOWS_
@@ -237,7 +293,17 @@ JL_DLLEXPORT int jl_spawn(char *name, char **argv, uv_loop_t *loop,
     stdio[2].type = stderr_type;
     stdio[2].data.stream = (uv_stream_t*)(stderr_pipe);
     opts.exit_cb = cb;
+#ifndef _OS_WINDOWS_
+    jl_gc_set_dontfork(1);
+#endif
     error = uv_spawn(loop,proc,&opts);
+#ifndef _OS_WINDOWS_
+    jl_gc_set_dontfork(0);
+    free(name);
+    jl_spawn_free_strv(argv);
+    jl_spawn_free_strv(env);
+    free(cwd);
+#endif
     return error;
 }
 
@@ -257,6 +323,131 @@ JL_DLLEXPORT uv_loop_t *jl_global_event_loop(void)
     return jl_io_loop;
 }
 
+#ifndef _OS_WINDOWS_
+// libuv has no way to carry a loop over a fork(): the child shares the
+// polling backend and the wakeup descriptors of the loop with its parent
+// (and, for the fork server, with all its siblings), so that events and
+// wakeups meant for one process are taken by another. jl_uv_loop_fork gives
+// them back to the child. the queues are a next and a prev pointer in every
+// libuv version.
+
+// the fields of the unix loop used below, checked against libuv 0.11 and 1.x
+#if !defined(UV_VERSION_MAJOR) || UV_VERSION_MAJOR > 1 || \
+    (UV_VERSION_MAJOR == 0 && UV_VERSION_MINOR < 11)
+#error "check jl_uv_loop_fork against the layout of this libuv version"
+#endif
+
+static int fd_replace(int fd, int newfd)
+{
+    // keep the number of the descriptor, which libuv indexes watchers by
+    if (newfd < 0 || dup2(newfd, fd) < 0)
+        return -1;
+    close(newfd);
+    return fcntl(fd, F_SETFD, FD_CLOEXEC);
+}
+
+static int pipe_replace(int fds[2])
+{
+    int p[2];
+    if (pipe(p) < 0)
+        return -1;
+    fcntl(p[0], F_SETFL, O_NONBLOCK);
+    fcntl(p[1], F_SETFL, O_NONBLOCK);
+    if (fd_replace(fds[0], p[0]) < 0 || fd_replace(fds[1], p[1]) < 0)
+        return -1;
+    return 0;
+}
+
+JL_DLLEXPORT int jl_uv_loop_fork(uv_loop_t *loop)
+{
+#if defined(_OS_LINUX_)
+    int backend = epoll_create1(EPOLL_CLOEXEC);
+#elif defined(_OS_DARWIN_) || defined(_OS_FREEBSD_)
+    // kqueues aren't inherited at all
+    int backend = kqueue();
+    if (backend >= 0)
+        fcntl(backend, F_SETFD, FD_CLOEXEC);
+#else
+    int backend = -1;
+#endif
+    if (backend < 0)
+        return -1;
+    if (loop->backend_fd >= 0)
+        close(loop->backend_fd);
+    loop->backend_fd = backend;
+
+    if (loop->async_io_watcher.fd >= 0) {
+        if (loop->async_wfd == -1) {
+#ifdef _OS_LINUX_
+            // an eventfd, both ends in one
+            if (fd_replace(loop->async_io_watcher.fd, eventfd(0, EFD_NONBLOCK)) < 0)
+                return -1;
+#endif
+        }
+        else {
+            int fds[2] = {loop->async_io_watcher.fd, loop->async_wfd};
+            if (pipe_replace(fds) < 0)
+                return -1;
+        }
+    }
+    if (loop->signal_pipefd[0] >= 0 && pipe_replace(loop->signal_pipefd) < 0)
+        return -1;
+
+    // the watchers are in the old backend only: queue them to be added to
+    // the new one by the next poll
+    void **head = (void**)&loop->watcher_queue;
+    for (unsigned int i = 0; i < loop->nwatchers; i++) {
+        uv__io_t *w = loop->watchers[i];
+        if (w == NULL || w->pevents == 0)
+            continue;
+        void **q = (void**)&w->watcher_queue;
+        if (i <= 2) {
+            // the stdio of the child isn't the server's: drop the watchers
+            // of the server's handles, as uv__io_stop does, before the
+            // descriptors are reused for the child's own
+            if (q[0] != (void*)q) {
+                ((void**)q[1])[0] = q[0];
+                ((void**)q[0])[1] = q[1];
+                q[0] = q[1] = q;
+            }
+            w->pevents = w->events = 0;
+            loop->watchers[i] = NULL;
+            loop->nfds--;
+            continue;
+        }
+        if (q[0] != (void*)q)
+            continue;
+        w->events = 0;
+        q[0] = head;
+        q[1] = head[1];
+        ((void**)q[1])[0] = q;
+        head[1] = q;
+    }
+    return 0;
+}
+#endif
+
+// Each worker thread gets a private loop that it alone initializes handles
+// on and drives (with jl_run_once / jl_process_events), so I/O done from C
+// on a worker thread never touches the global loop. Thread 1 keeps using the
+// global loop. Julia callbacks must not be attached to handles on these
+// loops, since the scheduler they notify is not thread-safe.
+JL_DLLEXPORT uv_loop_t *jl_thread_event_loop(void)
+{
+    jl_tls_states_t *ptls = jl_get_ptls_states();
+    if (ptls->tid == 0)
+        return jl_io_loop;
+    if (ptls->event_loop == NULL) {
+        uv_loop_t *loop = (uv_loop_t*)malloc(sizeof(uv_loop_t));
+        if (uv_loop_init(loop) != 0) {
+            free(loop);
+            return NULL;
+        }
+        ptls->event_loop = loop;
+    }
+    return ptls->event_loop;
+}
+
 JL_DLLEXPORT int jl_fs_unlink(char *path)
 {
     uv_fs_t req;
@@ -330,6 +521,18 @@ JL_DLLEXPORT int jl_fs_read(int handle, char *data, size_t len)
     return ret;
 }
 
+JL_DLLEXPORT int jl_fs_pread(int handle, char *data, size_t len,
+                             int64_t offset)
+{
+    uv_fs_t req;
+    uv_buf_t buf[1];
+    buf[0].base = data;
+    buf[0].len = len;
+    int ret = uv_fs_read(jl_io_loop, &req, handle, buf, 1, offset, NULL);
+    uv_fs_req_cleanup(&req);
+    return ret;
+}
+
 JL_DLLEXPORT int jl_fs_read_byte(int handle)
 {
     uv_fs_t req;
@@ -364,6 +567,52 @@ JL_DLLEXPORT int jl_uv_write(uv_stream_t *stream, const char *data, size_t n,
     return err;
 }
 
+// Copy up to len bytes of the file src_fd, starting at in_offset, straight
+// into the socket behind stream with sendfile(2), without blocking. Returns
+// the number of bytes sent, which is 0 while earlier writes are still queued
+// on the stream or the socket buffer is full, or a negative error code.
+JL_DLLEXPORT int64_t jl_uv_sendfile(uv_stream_t *stream, int src_fd,
+                                    int64_t in_offset, size_t len)
+{
+#ifdef _OS_LINUX_
+    if (stream->write_queue_size > 0)
+        return 0;
+    uv_os_fd_t fd;
+    int err = uv_fileno((uv_handle_t*)stream, &fd);
+    if (err)
+        return err;
+    off_t off = in_offset;
+    ssize_t r;
+    do {
+        r = sendfile(fd, src_fd, &off, len);
+    } while (r < 0 && errno == EINTR);
+    if (r < 0)
+        return (errno == EAGAIN || errno == EWOULDBLOCK) ? 0 : -errno;
+    return r;
+#else
+    return UV_ENOSYS;
+#endif
+}
+
+// like jl_uv_write, for nbufs buffers written in a single request
+JL_DLLEXPORT int jl_uv_writev(uv_stream_t *stream, const char **data, const size_t *len,
+                              unsigned int nbufs, uv_write_t *uvw, void *writecb)
+{
+    uv_buf_t stackbufs[16];
+    uv_buf_t *bufs = nbufs <= 16 ? stackbufs : (uv_buf_t*)malloc(nbufs*sizeof(uv_buf_t));
+    for (unsigned int i = 0; i < nbufs; i++) {
+        bufs[i].base = (char*)data[i];
+        bufs[i].len = len[i];
+    }
+    JL_SIGATOMIC_BEGIN();
+    // uv_write copies the buffer descriptors, only the data must stay alive
+    int err = uv_write(uvw,stream,bufs,nbufs,(uv_write_cb)writecb);
+    JL_SIGATOMIC_END();
+    if (bufs != stackbufs)
+        free(bufs);
+    return err;
+}
+
 JL_DLLEXPORT void jl_uv_writecb(uv_write_t *req, int status)
 {
     free(req);
@@ -423,26 +672,23 @@ static void jl_write(uv_stream_t *stream, const char *str, size_t n)
     }
 }
 
-extern int vasprintf(char **str, const char *fmt, va_list ap);
-
 JL_DLLEXPORT int jl_vprintf(uv_stream_t *s, const char *format, va_list args)
 {
-    char *str=NULL;
     int c;
-    va_list al;
-#if defined(_OS_WINDOWS_) && !defined(_COMPILER_MINGW_)
-    al = args;
-#else
-    va_copy(al, args);
-#endif
-
-    c = vasprintf(&str, format, al);
-
-    if (c >= 0) {
-        jl_write(s, str, c);
-        free(str);
+    if (s != (void*)STDOUT_FILENO && s != (void*)STDERR_FILENO &&
+        s->type > UV_HANDLE_TYPE_MAX) {
+        // ios_t streams format straight into their own buffer
+        return ios_vprintf((ios_t*)s, format, args);
     }
-    va_end(al);
+    // format into a stack buffer, which only spills to the heap for long output
+    char stackbuf[512];
+    ios_t dest;
+    ios_mem(&dest, 0);
+    ios_setbuf(&dest, stackbuf, sizeof(stackbuf), 0);
+    c = ios_vprintf(&dest, format, args);
+    if (c >= 0 && dest.size > 0)
+        jl_write(s, dest.buf, dest.size);
+    ios_close(&dest);
     return c;
 }
 
@@ -613,6 +859,148 @@ JL_DLLEXPORT int jl_udp_send6(uv_udp_t *handle, uint16_t port, void *host,
     return uv_udp_send(req, handle, buf, 1, (struct sockaddr*)&addr, cb);
 }
 
+// batched datagram I/O: these bypass the libuv request queue and talk to the
+// (non-blocking) socket directly, moving up to JL_UDP_BATCH datagrams per
+// system call with recvmmsg/sendmmsg where the platform has them.
+#define JL_UDP_BATCH 64
+
+JL_DLLEXPORT size_t jl_sizeof_sockaddr_storage(void)
+{
+    return sizeof(struct sockaddr_storage);
+}
+
+// Receive up to n already-queued datagrams without blocking. Datagram i is
+// stored at buf + i*msgsize, with its length in lens[i] and its source in
+// addrs[i]. Returns the number of datagrams received (0 if none were
+// waiting) or a negative error code.
+JL_DLLEXPORT int jl_udp_recvmmsg(uv_udp_t *handle, char *buf, size_t msgsize,
+                                 size_t *lens, struct sockaddr_storage *addrs,
+                                 unsigned int n)
+{
+#ifndef _OS_WINDOWS_
+    uv_os_fd_t fd;
+    int err = uv_fileno((uv_handle_t*)handle, &fd);
+    if (err)
+        return err;
+    unsigned int nrecv = 0;
+    while (nrecv < n) {
+#ifdef _OS_LINUX_
+        struct mmsghdr msgs[JL_UDP_BATCH];
+        struct iovec iov[JL_UDP_BATCH];
+        unsigned int i, batch = n - nrecv < JL_UDP_BATCH ? n - nrecv : JL_UDP_BATCH;
+        memset(msgs, 0, batch * sizeof(struct mmsghdr));
+        for (i = 0; i < batch; i++) {
+            iov[i].iov_base = buf + (nrecv + i) * msgsize;
+            iov[i].iov_len = msgsize;
+            msgs[i].msg_hdr.msg_iov = &iov[i];
+            msgs[i].msg_hdr.msg_iovlen = 1;
+            msgs[i].msg_hdr.msg_name = &addrs[nrecv + i];
+            msgs[i].msg_hdr.msg_namelen = sizeof(struct sockaddr_storage);
+        }
+        int r;
+        do {
+            r = recvmmsg(fd, msgs, batch, MSG_DONTWAIT, NULL);
+        } while (r < 0 && errno == EINTR);
+        if (r < 0)
+            break;
+        for (i = 0; i < (unsigned int)r; i++)
+            lens[nrecv + i] = msgs[i].msg_len;
+        nrecv += r;
+        if ((unsigned int)r < batch)
+            return nrecv;
+#else
+        socklen_t alen = sizeof(struct sockaddr_storage);
+        ssize_t r;
+        do {
+            r = recvfrom(fd, buf + nrecv * msgsize, msgsize, MSG_DONTWAIT,
+                         (struct sockaddr*)&addrs[nrecv], &alen);
+        } while (r < 0 && errno == EINTR);
+        if (r < 0)
+            break;
+        lens[nrecv++] = r;
+#endif
+    }
+    if (nrecv == n || errno == EAGAIN || errno == EWOULDBLOCK)
+        return nrecv;
+    return nrecv > 0 ? (int)nrecv : -errno;
+#else
+    return UV_ENOSYS;
+#endif
+}
+
+// Send n datagrams to one destination without blocking. Returns the number
+// that were handed to the kernel, which is less than n if the socket buffer
+// filled up, or a negative error code if the first one could not be sent.
+JL_DLLEXPORT int jl_udp_sendmmsg(uv_udp_t *handle, uint16_t port, void *host,
+                                 int ipv6, char **data, size_t *lens,
+                                 unsigned int n)
+{
+    struct sockaddr_storage addr;
+    socklen_t alen;
+    memset(&addr, 0, sizeof(struct sockaddr_storage));
+    if (ipv6) {
+        struct sockaddr_in6 *addr6 = (struct sockaddr_in6*)&addr;
+        addr6->sin6_port = port;
+        memcpy(&addr6->sin6_addr, host, 16);
+        addr6->sin6_family = AF_INET6;
+        alen = sizeof(struct sockaddr_in6);
+    }
+    else {
+        struct sockaddr_in *addr4 = (struct sockaddr_in*)&addr;
+        addr4->sin_port = port;
+        memcpy(&addr4->sin_addr.s_addr, host, 4);
+        addr4->sin_family = AF_INET;
+        alen = sizeof(struct sockaddr_in);
+    }
+    unsigned int nsent = 0;
+#ifdef _OS_LINUX_
+    uv_os_fd_t fd;
+    int err = uv_fileno((uv_handle_t*)handle, &fd);
+    if (err)
+        return err;
+    while (nsent < n) {
+        struct mmsghdr msgs[JL_UDP_BATCH];
+        struct iovec iov[JL_UDP_BATCH];
+        unsigned int i, batch = n - nsent < JL_UDP_BATCH ? n - nsent : JL_UDP_BATCH;
+        memset(msgs, 0, batch * sizeof(struct mmsghdr));
+        for (i = 0; i < batch; i++) {
+            iov[i].iov_base = data[nsent + i];
+            iov[i].iov_len = lens[nsent + i];
+            msgs[i].msg_hdr.msg_iov = &iov[i];
+            msgs[i].msg_hdr.msg_iovlen = 1;
+            msgs[i].msg_hdr.msg_name = &addr;
+            msgs[i].msg_hdr.msg_namelen = alen;
+        }
+        int r;
+        do {
+            r = sendmmsg(fd, msgs, batch, MSG_DONTWAIT);
+        } while (r < 0 && errno == EINTR);
+        if (r < 0) {
+            if (nsent == 0 && errno != EAGAIN && errno != EWOULDBLOCK)
+                return -errno;
+            break;
+        }
+        nsent += r;
+        if ((unsigned int)r < batch)
+            break;
+    }
+#else
+    (void)alen;
+    for (; nsent < n; nsent++) {
+        uv_buf_t buf[1];
+        buf[0].base = data[nsent];
+        buf[0].len = lens[nsent];
+        int r = uv_udp_try_send(handle, buf, 1, (struct sockaddr*)&addr);
+        if (r < 0) {
+            if (nsent == 0 && r != UV_EAGAIN)
+                return r;
+            break;
+        }
+    }
+#endif
+    return nsent;
+}
+
 JL_DLLEXPORT int jl_uv_sizeof_interface_address(void)
 {
     return sizeof(uv_interface_address_t);
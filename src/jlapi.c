@@ -12,6 +12,8 @@
 #include <string.h>
 #include <assert.h>
 #include "julia.h"
+#include "julia_internal.h"
+#include "threading.h"
 
 #ifdef __cplusplus
 extern "C" {
@@ -25,6 +27,88 @@ JL_DLLEXPORT char * __cdecl dirname(char *);
 
 JL_DLLEXPORT int jl_is_initialized(void) { return jl_main_module!=NULL; }
 
+int16_t jl_init_foreign_thread(void);
+
+// julia code runs on one thread of the embedding program at a time: the
+// calls below hold this lock, which the thread holding it takes again when
+// the julia code calls back into them. the threads of the runtime, the one
+// that called jl_init among them, don't take it and run side by side with
+// the thread holding it; every collection stops all of them.
+static uv_mutex_t embed_lock;
+static uv_once_t embed_lock_once = UV_ONCE_INIT;
+static uint64_t volatile embed_owner = 0;
+static int32_t embed_depth = 0;
+
+static void embed_lock_init(void)
+{
+    uv_mutex_init(&embed_lock);
+}
+
+static int embed_lock_needed(void)
+{
+#ifdef JULIA_ENABLE_THREADING
+    jl_tls_states_t *ptls = jl_get_ptls_states();
+    return ptls->heap == NULL || ti_is_foreign(ptls->tid);
+#else
+    // there is only one set of thread states
+    return 1;
+#endif
+}
+
+// returns 0 if the calling thread can't run julia code
+static int embed_lock_enter(void)
+{
+    if (!embed_lock_needed())
+        return 1;
+    if (embed_owner == uv_thread_self()) {
+        embed_depth++;
+        return 1;
+    }
+    uv_once(&embed_lock_once, embed_lock_init);
+    // the holder may be collecting, which waits for the registered threads
+    // until they are in a gc safe region
+    int8_t gc_state = jl_gc_safe_enter();
+    uv_mutex_lock(&embed_lock);
+    embed_owner = uv_thread_self();
+    embed_depth = 1;
+#ifdef JULIA_ENABLE_THREADING
+    // first call from a thread the runtime didn't start
+    if (jl_get_ptls_states()->heap == NULL && jl_init_foreign_thread() < 0) {
+        embed_owner = 0;
+        embed_depth = 0;
+        uv_mutex_unlock(&embed_lock);
+        return 0;
+    }
+#endif
+    // registered threads are in julia from now on, until they enter a gc
+    // safe region themselves
+    jl_gc_state_restore(gc_state);
+    return 1;
+}
+
+static void embed_lock_exit(void)
+{
+    if (!embed_lock_needed())
+        return;
+    if (--embed_depth == 0) {
+        embed_owner = 0;
+        uv_mutex_unlock(&embed_lock);
+    }
+}
+
+// register the calling thread with the runtime, giving it thread states, a
+// heap and a root task of its own. done by the first call into julia from
+// the thread otherwise; returns the id of the thread, or -1 if the
+// JULIA_MAX_FOREIGN_THREADS slots are all in use
+JL_DLLEXPORT int16_t jl_adopt_thread(void)
+{
+    if (!embed_lock_enter())
+        return -1;
+    int16_t tid = jl_get_ptls_states()->tid;
+    embed_lock_exit();
+    return tid;
+}
+
 // First argument is the usr/lib directory where libjulia is, or NULL to guess.
 // if that doesn't work, try the full path to the "lib" directory that
 // contains lib/julia/sys.ji
@@ -51,6 +135,8 @@ JL_DLLEXPORT void jl_init(const char *julia_home_dir)
 JL_DLLEXPORT void *jl_eval_string(const char *str)
 {
     jl_value_t *r;
+    if (!embed_lock_enter())
+        return NULL;
     JL_TRY {
         jl_value_t *ast = jl_parse_input_line(str, strlen(str));
         JL_GC_PUSH1(&ast);
@@ -62,6 +148,7 @@ JL_DLLEXPORT void *jl_eval_string(const char *str)
         //jl_show(jl_stderr_obj(), jl_exception_in_transit);
         r = NULL;
     }
+    embed_lock_exit();
     return r;
 }
 
@@ -114,6 +201,8 @@ JL_DLLEXPORT jl_value_t *jl_call(jl_function_t *f, jl_value_t **args,
                                  int32_t nargs)
 {
     jl_value_t *v;
+    if (!embed_lock_enter())
+        return NULL;
     JL_TRY {
         jl_value_t **argv;
         JL_GC_PUSHARGS(argv, nargs+1);
@@ -127,12 +216,15 @@ JL_DLLEXPORT jl_value_t *jl_call(jl_function_t *f, jl_value_t **args,
     JL_CATCH {
         v = NULL;
     }
+    embed_lock_exit();
     return v;
 }
 
 JL_DLLEXPORT jl_value_t *jl_call0(jl_function_t *f)
 {
     jl_value_t *v;
+    if (!embed_lock_enter())
+        return NULL;
     JL_TRY {
         JL_GC_PUSH1(&f);
         v = jl_apply(f, NULL, 0);
@@ -142,12 +234,15 @@ JL_DLLEXPORT jl_value_t *jl_call0(jl_function_t *f)
     JL_CATCH {
         v = NULL;
     }
+    embed_lock_exit();
     return v;
 }
 
 JL_DLLEXPORT jl_value_t *jl_call1(jl_function_t *f, jl_value_t *a)
 {
     jl_value_t *v;
+    if (!embed_lock_enter())
+        return NULL;
     JL_TRY {
         JL_GC_PUSH2(&f,&a);
         v = jl_apply(f, &a, 1);
@@ -157,12 +252,15 @@ JL_DLLEXPORT jl_value_t *jl_call1(jl_function_t *f, jl_value_t *a)
     JL_CATCH {
         v = NULL;
     }
+    embed_lock_exit();
     return v;
 }
 
 JL_DLLEXPORT jl_value_t *jl_call2(jl_function_t *f, jl_value_t *a, jl_value_t *b)
 {
     jl_value_t *v;
+    if (!embed_lock_enter())
+        return NULL;
     JL_TRY {
         JL_GC_PUSH3(&f,&a,&b);
         jl_value_t *args[2] = {a,b};
@@ -173,6 +271,7 @@ JL_DLLEXPORT jl_value_t *jl_call2(jl_function_t *f, jl_value_t *a, jl_value_t *b
     JL_CATCH {
         v = NULL;
     }
+    embed_lock_exit();
     return v;
 }
 
@@ -180,6 +279,8 @@ JL_DLLEXPORT jl_value_t *jl_call3(jl_function_t *f, jl_value_t *a,
                                   jl_value_t *b, jl_value_t *c)
 {
     jl_value_t *v;
+    if (!embed_lock_enter())
+        return NULL;
     JL_TRY {
         JL_GC_PUSH4(&f,&a,&b,&c);
         jl_value_t *args[3] = {a,b,c};
@@ -190,9 +291,72 @@ JL_DLLEXPORT jl_value_t *jl_call3(jl_function_t *f, jl_value_t *a,
     JL_CATCH {
         v = NULL;
     }
+    embed_lock_exit();
     return v;
 }
 
+// a call of f with the same number of arguments that is made many times: the
+// arguments are stored in place in the context, which roots them (and f)
+// during the call, and the methods found for them are remembered between
+// calls. a context must not be used by two threads at once, nor be invoked
+// again by the code it runs.
+struct _jl_call_ctx_t {
+    jl_callsite_cache_t cache;
+    int32_t nargs;
+    // gc frame of f and the arguments, linked in by jl_call_ctx_invoke
+    size_t nroots;
+    jl_gcframe_t *prev;
+    jl_function_t *f;
+    jl_value_t *args[];
+};
+
+// f has to stay reachable from julia (e.g. through a global) while the
+// context is in use
+JL_DLLEXPORT jl_call_ctx_t *jl_call_ctx_new(jl_function_t *f, int32_t nargs)
+{
+    if (nargs < 0)
+        return NULL;
+    jl_call_ctx_t *c = (jl_call_ctx_t*)calloc(1, sizeof(jl_call_ctx_t) + nargs*sizeof(jl_value_t*));
+    if (c == NULL)
+        return NULL;
+    c->nargs = nargs;
+    c->nroots = ((size_t)nargs + 1) << 1;
+    c->f = f;
+    return c;
+}
+
+JL_DLLEXPORT jl_value_t **jl_call_ctx_args(jl_call_ctx_t *c)
+{
+    return c->args;
+}
+
+JL_DLLEXPORT jl_value_t *jl_call_ctx_invoke(jl_call_ctx_t *c)
+{
+    jl_value_t *v;
+    if (!embed_lock_enter())
+        return NULL;
+    JL_TRY {
+        c->prev = jl_pgcstack;
+        jl_pgcstack = (jl_gcframe_t*)&c->nroots;
+        if (c->f->fptr == jl_apply_generic && c->nargs <= JL_CALLSITE_MAXARGS)
+            v = jl_apply_generic_cached((jl_value_t*)c->f, c->args, c->nargs, &c->cache);
+        else
+            v = jl_apply(c->f, c->args, c->nargs);
+        JL_GC_POP();
+        jl_exception_clear();
+    }
+    JL_CATCH {
+        v = NULL;
+    }
+    embed_lock_exit();
+    return v;
+}
+
+JL_DLLEXPORT void jl_call_ctx_free(jl_call_ctx_t *c)
+{
+    free(c);
+}
+
 JL_DLLEXPORT void jl_yield(void)
 {
     static jl_function_t *yieldfunc = NULL;
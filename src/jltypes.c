@@ -1086,6 +1086,103 @@ static jl_value_t *jl_type_intersect(jl_value_t *a, jl_value_t *b,
     return result;
 }
 
+// --- memoized type relations ---
+
+/*
+  jl_subtype and jl_type_intersection are called with the same pairs of
+  types over and over by inference and method lookup. Results for tuple
+  and union types, the expensive cases, are remembered in a direct-mapped
+  table per relation. The table is a GC root, so a key cannot be freed and
+  its address reused while it is cached. Types that mention type variables
+  are never memoized, since the relations depend on their bound flags.
+  The threads share the table, an entry is read and written under the
+  typecache lock so that its three slots are seen together.
+*/
+#define TYPE_MEMO_SIZE 1024 // entries per relation, a power of 2
+#define MEMO_SUBTYPE   0
+#define MEMO_INTERSECT 1
+
+JL_DEFINE_MUTEX_EXT(typecache);
+
+jl_array_t *jl_type_memo = NULL;
+
+void jl_init_type_memo(void)
+{
+    jl_type_memo = jl_alloc_cell_1d(2*TYPE_MEMO_SIZE*3);
+}
+
+// clear the memo after a type definition changes an existing type
+void jl_clear_type_memo(void)
+{
+    if (jl_type_memo != NULL) {
+        JL_LOCK(typecache);
+        memset(jl_array_data(jl_type_memo), 0, jl_array_len(jl_type_memo)*sizeof(void*));
+        JL_UNLOCK(typecache);
+    }
+}
+
+static int type_memo_eligible(jl_value_t *v)
+{
+    jl_svec_t *t;
+    if (jl_is_typevar(v) || jl_is_typector(v))
+        return 0;
+    if (jl_is_uniontype(v))
+        t = ((jl_uniontype_t*)v)->types;
+    else if (jl_is_datatype(v))
+        t = ((jl_datatype_t*)v)->parameters;
+    else
+        return 1;
+    size_t i, l = jl_svec_len(t);
+    for(i=0; i < l; i++) {
+        jl_value_t *elt = jl_svecref(t, i);
+        if (elt != v && !type_memo_eligible(elt))
+            return 0;
+    }
+    return 1;
+}
+
+static int type_memo_worthwhile(jl_value_t *a, jl_value_t *b)
+{
+    if (jl_type_memo == NULL)
+        return 0;
+    if (!(jl_is_tuple_type(a) || jl_is_uniontype(a) ||
+          jl_is_tuple_type(b) || jl_is_uniontype(b)))
+        return 0;
+    return type_memo_eligible(a) && type_memo_eligible(b);
+}
+
+static jl_value_t **type_memo_slot(int rel, jl_value_t *a, jl_value_t *b)
+{
+    uptrint_t h = inthash((uptrint_t)a ^ inthash((uptrint_t)b));
+    size_t i = rel*TYPE_MEMO_SIZE + (h & (TYPE_MEMO_SIZE-1));
+    return (jl_value_t**)jl_array_data(jl_type_memo) + 3*i;
+}
+
+static jl_value_t *type_memo_lookup(int rel, jl_value_t *a, jl_value_t *b)
+{
+    jl_value_t **e = type_memo_slot(rel, a, b);
+    jl_value_t *r = NULL;
+    JL_LOCK(typecache);
+    if (e[0] == a && e[1] == b)
+        r = e[2];
+    JL_UNLOCK(typecache);
+    return r;
+}
+
+// doesn't allocate, so it is safe wherever the relations are
+static void type_memo_store(int rel, jl_value_t *a, jl_value_t *b, jl_value_t *r)
+{
+    jl_value_t **e = type_memo_slot(rel, a, b);
+    JL_LOCK(typecache);
+    e[0] = a;
+    e[1] = b;
+    e[2] = r;
+    jl_gc_wb(jl_type_memo, a);
+    jl_gc_wb(jl_type_memo, b);
+    jl_gc_wb(jl_type_memo, r);
+    JL_UNLOCK(typecache);
+}
+
 JL_DLLEXPORT jl_value_t *jl_type_intersection(jl_value_t *a, jl_value_t *b)
 {
     jl_svec_t *env = jl_emptysvec;
@@ -1428,6 +1525,12 @@ static int solve_tvar_constraints(cenv_t *env, cenv_t *soln, jl_value_t **tvs, i
 jl_value_t *jl_type_intersection_matching(jl_value_t *a, jl_value_t *b,
                                           jl_svec_t **penv, jl_svec_t *tvars)
 {
+    int memo = tvars == jl_emptysvec && type_memo_worthwhile(a, b);
+    if (memo) {
+        jl_value_t *ti = type_memo_lookup(MEMO_INTERSECT, a, b);
+        if (ti != NULL)
+            return ti;
+    }
     jl_value_t **rts;
     JL_GC_PUSHARGS(rts, 2 + 2*MAX_CENV_SIZE);
     cenv_t eqc; eqc.n = 0; eqc.data = &rts[2];
@@ -1450,6 +1553,8 @@ jl_value_t *jl_type_intersection_matching(jl_value_t *a, jl_value_t *b,
     }
     if (*pti == (jl_value_t*)jl_bottom_type ||
         !(env.n > 0 || eqc.n > 0 || tvars != jl_emptysvec)) {
+        if (memo && env.n == 0 && eqc.n == 0)
+            type_memo_store(MEMO_INTERSECT, a, b, *pti);
         JL_GC_POP();
         return *pti;
     }
@@ -1822,8 +1927,8 @@ static int contains_unions(jl_value_t *type)
     return 0;
 }
 
-// this function determines whether a type is simple enough to form
-// a total order based on UIDs and object_id.
+// this function determines whether a type is simple enough to be
+// compared (and hashed) by UIDs and object_id.
 static int is_typekey_ordered(jl_value_t **key, size_t n)
 {
     size_t i;
@@ -1839,14 +1944,27 @@ static int is_typekey_ordered(jl_value_t **key, size_t n)
     return 1;
 }
 
-// ordered comparison of types
-static int typekey_compare(jl_datatype_t *tt, jl_value_t **key, size_t n)
+static uptrint_t typekey_id(jl_value_t *k)
 {
+    if (jl_is_datatype(k) && ((jl_datatype_t*)k)->uid)
+        return ((jl_datatype_t*)k)->uid;
+    return jl_object_id(k);
+}
+
+static uptrint_t typekey_hash(jl_value_t **key, size_t n)
+{
+    uptrint_t h = n;
     size_t j;
-    if (tt == NULL) return -1;  // place NULLs at end to allow padding for fast growing
-    size_t tnp = jl_nparams(tt);
-    if (n < tnp) return -1;
-    if (n > tnp) return 1;
+    for(j=0; j < n; j++)
+        h = inthash(h ^ typekey_id(key[j]));
+    return h;
+}
+
+// comparison of types with ordered keys
+static int typekey_same(jl_datatype_t *tt, jl_value_t **key, size_t n)
+{
+    size_t j;
+    if (n != jl_nparams(tt)) return 0;
     for(j=0; j < n; j++) {
         jl_value_t *kj = key[j], *tj = jl_svecref(tt->parameters,j);
         if (tj != kj) {
@@ -1854,13 +1972,11 @@ static int typekey_compare(jl_datatype_t *tt, jl_value_t **key, size_t n)
             int dtk = jl_is_datatype(kj);
             if (!dtt && !dtk && jl_egal(tj, kj))
                 continue;
-            uptrint_t tid = (dtt && ((jl_datatype_t*)tj)->uid ? ((jl_datatype_t*)tj)->uid : jl_object_id(tj));
-            uptrint_t kid = (dtk && ((jl_datatype_t*)kj)->uid ? ((jl_datatype_t*)kj)->uid : jl_object_id(kj));
-            if (kid != tid)
-                return kid < tid ? -1 : 1;
+            if (typekey_id(tj) != typekey_id(kj))
+                return 0;
         }
     }
-    return 0;
+    return 1;
 }
 
 static int typekey_eq(jl_datatype_t *tt, jl_value_t **key, size_t n)
@@ -1876,11 +1992,14 @@ static int typekey_eq(jl_datatype_t *tt, jl_value_t **key, size_t n)
     return 1;
 }
 
-JL_DEFINE_MUTEX_EXT(typecache);
+// types with ordered keys are kept in tn->cache, an open-addressed hash
+// table whose entries lie within TYPECACHE_PROBE slots of their home slot.
+#define TYPECACHE_PROBE 32
 
-// look up a type in a cache by binary or linear search.
+// look up a type in a cache by hashing or linear search.
 // if found, returns the index of the found item. if not found, returns
-// ~n, where n is the index where the type should be inserted.
+// ~n, where n is the index where the type should be inserted, or ~len
+// if the hash table has to grow first.
 static ssize_t lookup_type_idx(jl_typename_t *tn, jl_value_t **key, size_t n, int ordered)
 {
     if (n==0) return -1;
@@ -1888,19 +2007,16 @@ static ssize_t lookup_type_idx(jl_typename_t *tn, jl_value_t **key, size_t n, in
         jl_svec_t *cache = tn->cache;
         jl_value_t **data = jl_svec_data(cache);
         size_t cl = jl_svec_len(cache);
-        ssize_t lo = -1;
-        ssize_t hi = cl;
-        while (lo < hi-1) {
-            ssize_t m = ((size_t)(lo+hi))>>1;
-            jl_datatype_t *tt = (jl_datatype_t*)data[m];
-            int cmp = typekey_compare(tt, key, n);
-            if (cmp == 0) return m;
-            if (cmp < 0)
-                hi = m;
-            else
-                lo = m;
+        if (cl == 0) return ~(ssize_t)0;
+        uptrint_t h = typekey_hash(key, n);
+        size_t i;
+        for(i=0; i < TYPECACHE_PROBE && i < cl; i++) {
+            size_t idx = (h+i) & (cl-1);
+            jl_datatype_t *tt = (jl_datatype_t*)data[idx];
+            if (tt == NULL) return ~(ssize_t)idx;
+            if (typekey_same(tt, key, n)) return idx;
         }
-        return ~hi;
+        return ~(ssize_t)cl;
     }
     else {
         jl_svec_t *cache = tn->linearcache;
@@ -1962,41 +2078,63 @@ static int is_cacheable(jl_datatype_t *type)
     return 1;
 }
 
+static void cache_rehash_type(jl_typename_t *tn, size_t newsz)
+{
+    jl_svec_t *cache = tn->cache;
+    jl_svec_t *nc;
+    size_t i, j, n = jl_svec_len(cache);
+ retry:
+    nc = jl_alloc_svec(newsz);
+    for(i=0; i < n; i++) {
+        jl_datatype_t *tt = (jl_datatype_t*)jl_svecref(cache, i);
+        if (tt == NULL) continue;
+        uptrint_t h = typekey_hash(jl_svec_data(tt->parameters), jl_nparams(tt));
+        for(j=0; j < TYPECACHE_PROBE && j < newsz; j++) {
+            size_t idx = (h+j) & (newsz-1);
+            if (jl_svecref(nc, idx) == NULL) {
+                jl_svecset(nc, idx, tt);
+                break;
+            }
+        }
+        if (j == TYPECACHE_PROBE || j == newsz) {
+            newsz *= 2;
+            goto retry;
+        }
+    }
+    tn->cache = nc;
+    jl_gc_wb(tn, nc);
+}
+
 static void cache_insert_type(jl_value_t *type, ssize_t insert_at, int ordered)
 {
     assert(jl_is_datatype(type));
     // assign uid if it hasn't been done already
     if (!jl_is_abstracttype(type) && ((jl_datatype_t*)type)->uid==0)
         ((jl_datatype_t*)type)->uid = jl_assign_type_uid();
+    jl_typename_t *tn = ((jl_datatype_t*)type)->name;
     jl_svec_t *cache;
-    if (ordered)
-        cache = ((jl_datatype_t*)type)->name->cache;
-    else
-        cache = ((jl_datatype_t*)type)->name->linearcache;
+    if (ordered) {
+        while ((size_t)insert_at == jl_svec_len(tn->cache)) {
+            size_t n = jl_svec_len(tn->cache);
+            cache_rehash_type(tn, n < 8 ? 8 : n*2);
+            jl_datatype_t *dt = (jl_datatype_t*)type;
+            insert_at = ~lookup_type_idx(tn, jl_svec_data(dt->parameters), jl_nparams(dt), 1);
+        }
+        jl_svecset(tn->cache, insert_at, type);
+        return;
+    }
+    cache = tn->linearcache;
     assert(jl_is_svec(cache));
     size_t n = jl_svec_len(cache);
     if (n==0 || jl_svecref(cache,n-1) != NULL) {
         jl_svec_t *nc = jl_alloc_svec(n < 8 ? 8 : (n*3)>>1);
         memcpy(jl_svec_data(nc), jl_svec_data(cache), sizeof(void*) * n);
-        if (ordered)
-            ((jl_datatype_t*)type)->name->cache = nc;
-        else
-            ((jl_datatype_t*)type)->name->linearcache = nc;
-        jl_gc_wb(((jl_datatype_t*)type)->name, nc);
+        tn->linearcache = nc;
+        jl_gc_wb(tn, nc);
         cache = nc;
-        n = jl_svec_len(nc);
-    }
-    jl_value_t **p = jl_svec_data(cache);
-    size_t i = insert_at;
-    jl_value_t *temp = p[i], *temp2;
-    jl_svecset(cache, insert_at, (jl_value_t*)type);
-    assert(i < n-1 || temp == NULL);
-    while (temp != NULL && i < n-1) {
-        i++;
-        temp2 = p[i];
-        p[i] = temp;
-        temp = temp2;
     }
+    // the linear cache is filled in order, so insert_at is its first NULL
+    jl_svecset(cache, insert_at, type);
 }
 
 jl_value_t *jl_cache_type_(jl_datatype_t *type)
@@ -2099,6 +2237,7 @@ static jl_value_t *inst_datatype(jl_datatype_t *dt, jl_svec_t *p, jl_value_t **i
     ndt->instance = NULL;
     ndt->uid = 0;
     ndt->struct_decl = NULL;
+    ndt->fieldindex = NULL;
     ndt->ditype = NULL;
     ndt->size = 0;
     ndt->alignment = 1;
@@ -2124,6 +2263,7 @@ static jl_value_t *inst_datatype(jl_datatype_t *dt, jl_svec_t *p, jl_value_t **i
                 ndt->size = dt->size;
                 ndt->alignment = dt->alignment;
                 ndt->pointerfree = dt->pointerfree;
+                ndt->bitsequal = dt->bitsequal;
             }
             else {
                 jl_compute_field_offsets(ndt);
@@ -2136,9 +2276,12 @@ static jl_value_t *inst_datatype(jl_datatype_t *dt, jl_svec_t *p, jl_value_t **i
         else {
             ndt->size = 0;
             ndt->pointerfree = 0;
+            ndt->bitsequal = 0;
         }
-        if (tn == jl_array_typename)
+        if (tn == jl_array_typename) {
             ndt->pointerfree = 0;
+            ndt->bitsequal = 0;
+        }
     }
     if (istuple)
         ndt->ninitialized = ntp;
@@ -2585,6 +2728,14 @@ static int jl_subtype_le(jl_value_t *a, jl_value_t *b, int ta, int invariant)
 
 JL_DLLEXPORT int jl_subtype(jl_value_t *a, jl_value_t *b, int ta)
 {
+    if (!ta && type_memo_worthwhile(a, b)) {
+        jl_value_t *r = type_memo_lookup(MEMO_SUBTYPE, a, b);
+        if (r != NULL)
+            return r == jl_true;
+        int sub = jl_subtype_le(a, b, 0, 0);
+        type_memo_store(MEMO_SUBTYPE, a, b, sub ? jl_true : jl_false);
+        return sub;
+    }
     return jl_subtype_le(a, b, ta, 0);
 }
 
@@ -3214,6 +3365,7 @@ void jl_init_types(void)
     jl_datatype_type->instance = NULL;
     jl_datatype_type->uid = jl_assign_type_uid();
     jl_datatype_type->struct_decl = NULL;
+    jl_datatype_type->fieldindex = NULL;
     jl_datatype_type->ditype = NULL;
     jl_datatype_type->abstract = 0;
     jl_datatype_type->pointerfree = 0;
@@ -3236,6 +3388,7 @@ void jl_init_types(void)
     jl_typename_type->uid = jl_assign_type_uid();
     jl_typename_type->instance = NULL;
     jl_typename_type->struct_decl = NULL;
+    jl_typename_type->fieldindex = NULL;
     jl_typename_type->ditype = NULL;
     jl_typename_type->abstract = 0;
     jl_typename_type->pointerfree = 0;
@@ -3251,6 +3404,7 @@ void jl_init_types(void)
     jl_sym_type->instance = NULL;
     jl_sym_type->uid = jl_assign_type_uid();
     jl_sym_type->struct_decl = NULL;
+    jl_sym_type->fieldindex = NULL;
     jl_sym_type->ditype = NULL;
     jl_sym_type->size = 0;
     jl_sym_type->abstract = 0;
@@ -3267,6 +3421,7 @@ void jl_init_types(void)
     jl_simplevector_type->uid = jl_assign_type_uid();
     jl_simplevector_type->instance = NULL;
     jl_simplevector_type->struct_decl = NULL;
+    jl_simplevector_type->fieldindex = NULL;
     jl_simplevector_type->ditype = NULL;
     jl_simplevector_type->abstract = 0;
     jl_simplevector_type->pointerfree = 0;
@@ -3354,15 +3509,19 @@ void jl_init_types(void)
 
     jl_methtable_type =
         jl_new_datatype(jl_symbol("MethodTable"), jl_any_type, jl_emptysvec,
-                        jl_svec(8, jl_symbol("name"), jl_symbol("defs"),
+                        jl_svec(10, jl_symbol("name"), jl_symbol("defs"),
                                 jl_symbol("cache"), jl_symbol("cache_arg1"),
-                                jl_symbol("cache_targ"), jl_symbol("max_args"),
-                                jl_symbol("kwsorter"), jl_symbol("module")),
-                        jl_svec(8, jl_sym_type, jl_any_type,
+                                jl_symbol("cache_targ"), jl_symbol("cache_exact"),
+                                jl_symbol("cache_matches"),
+                                jl_symbol("max_args"), jl_symbol("kwsorter"),
+                                jl_symbol("module")),
+                        jl_svec(10, jl_sym_type, jl_any_type,
                                 jl_any_type, jl_any_type,
-                                jl_any_type, jl_long_type,
-                                jl_any_type, jl_any_type),
-                        0, 1, 6);
+                                jl_any_type, jl_any_type,
+                                jl_any_type,
+                                jl_long_type, jl_any_type,
+                                jl_any_type),
+                        0, 1, 8);
 
     tv = jl_svec2(tvar("T"), tvar("N"));
     jl_abstractarray_type =
@@ -3451,7 +3610,7 @@ void jl_init_types(void)
     jl_lambda_info_type =
         jl_new_datatype(jl_symbol("LambdaStaticData"),
                         jl_any_type, jl_emptysvec,
-                        jl_svec(15, jl_symbol("ast"), jl_symbol("sparams"),
+                        jl_svec(16, jl_symbol("ast"), jl_symbol("sparams"),
                                 jl_symbol("tfunc"), jl_symbol("name"),
                                 jl_symbol("roots"),
                                 /* jl_symbol("specTypes"),
@@ -3459,16 +3618,16 @@ void jl_init_types(void)
                                    jl_symbol("specializations")*/
                                 jl_symbol(""), jl_symbol(""), jl_symbol(""),
                                 jl_symbol("module"), jl_symbol("def"),
-                                jl_symbol("capt"),
+                                jl_symbol("capt"), jl_symbol("tfunc_index"),
                                 jl_symbol("file"), jl_symbol("line"),
                                 jl_symbol("inferred"),
                                 jl_symbol("pure")),
-                        jl_svec(15, jl_any_type, jl_simplevector_type,
+                        jl_svec(16, jl_any_type, jl_simplevector_type,
                                 jl_any_type, jl_sym_type,
                                 jl_any_type, jl_any_type,
                                 jl_any_type, jl_array_any_type,
                                 jl_module_type, jl_any_type,
-                                jl_any_type,
+                                jl_any_type, jl_any_type,
                                 jl_sym_type, jl_int32_type,
                                 jl_bool_type, jl_bool_type),
                         0, 1, 4);
@@ -165,18 +165,9 @@
 
 ;; --- lexer ---
 
-(define special-char?
-  (let ((chrs (string->list "()[]{},;\"`@")))
-    (lambda (c) (memv c chrs))))
+(define (special-char? c) (and (char? c) (string.find "()[]{},;\"`@" c)))
 (define (newline? c) (eqv? c #\newline))
 
-(define (skip-to-eol port)
-  (let ((c (peek-char port)))
-    (cond ((eof-object? c)    c)
-          ((eqv? c #\newline) c)
-          (else               (read-char port)
-                              (skip-to-eol port)))))
-
 (define (read-operator port c)
   (if (and (eqv? c #\*) (eqv? (peek-char port) #\*))
       (error "use \"^\" instead of \"**\""))
@@ -1844,6 +1835,7 @@
 
       (else
        (write-char (not-eof-3 c) b)
+       (copy-string-chars p b)
        (loop (read-char p) b e 0)))))
 
 (define (not-eof-1 c)
@@ -68,6 +68,7 @@ extern "C" {
 // set (in Make.user)
 
 JL_DLLEXPORT int16_t jl_threadid(void);
+JL_DLLEXPORT int16_t jl_threadregionid(void);
 JL_DLLEXPORT void *jl_threadgroup(void);
 JL_DLLEXPORT void jl_cpu_pause(void);
 JL_DLLEXPORT void jl_threading_profile(void);
@@ -75,21 +76,47 @@ JL_DLLEXPORT void jl_threading_profile(void);
 #if defined(__GNUC__)
 #  define JL_ATOMIC_FETCH_AND_ADD(a,b)                                    \
        __sync_fetch_and_add(&(a), (b))
+#  define JL_ATOMIC_FETCH_AND_OR(a,b)                                     \
+       __sync_fetch_and_or(&(a), (b))
 #  define JL_ATOMIC_COMPARE_AND_SWAP(a,b,c)                               \
        __sync_bool_compare_and_swap(&(a), (b), (c))
 #  define JL_ATOMIC_TEST_AND_SET(a)                                       \
        __sync_lock_test_and_set(&(a), 1)
 #  define JL_ATOMIC_RELEASE(a)                                            \
        __sync_lock_release(&(a))
+#  define JL_ATOMIC_FENCE()                                               \
+       __sync_synchronize()
+#  define JL_ATOMIC_STORE_RELEASE(a,b)                                    \
+       __atomic_store_n(&(a), (b), __ATOMIC_RELEASE)
+#  define JL_ATOMIC_LOAD_ACQUIRE(a)                                       \
+       __atomic_load_n(&(a), __ATOMIC_ACQUIRE)
+// keeps the loads before it ahead of the loads and stores after it
+#  define JL_ATOMIC_FENCE_ACQUIRE()                                       \
+       __atomic_thread_fence(__ATOMIC_ACQUIRE)
+// orders memory accesses against a signal handler on the same thread only
+#  define JL_SIGNAL_FENCE()                                               \
+       __asm__ volatile("" ::: "memory")
 #elif defined(_OS_WINDOWS_)
 #  define JL_ATOMIC_FETCH_AND_ADD(a,b)                                    \
        _InterlockedExchangeAdd((volatile LONG *)&(a), (b))
+#  define JL_ATOMIC_FETCH_AND_OR(a,b)                                     \
+       _InterlockedOr8((volatile char *)&(a), (b))
 #  define JL_ATOMIC_COMPARE_AND_SWAP(a,b,c)                               \
        _InterlockedCompareExchange64((volatile LONG64 *)&(a), (c), (b))
 #  define JL_ATOMIC_TEST_AND_SET(a)                                       \
        _InterlockedExchange64(&(a), 1)
 #  define JL_ATOMIC_RELEASE(a)                                            \
        _InterlockedExchange64(&(a), 0)
+#  define JL_ATOMIC_FENCE()                                               \
+       MemoryBarrier()
+#  define JL_ATOMIC_STORE_RELEASE(a,b)                                    \
+       _InterlockedExchange64((volatile LONG64 *)&(a), (LONG64)(b))
+#  define JL_ATOMIC_LOAD_ACQUIRE(a)                                       \
+       _InterlockedCompareExchange64((volatile LONG64 *)&(a), 0, 0)
+#  define JL_ATOMIC_FENCE_ACQUIRE()                                       \
+       MemoryBarrier()
+#  define JL_SIGNAL_FENCE()                                               \
+       _ReadWriteBarrier()
 #else
 #  error "No atomic operations supported."
 #endif
@@ -104,7 +131,7 @@ JL_DLLEXPORT void jl_threading_profile(void);
     extern uint64_t volatile m ## _mutex;                                 \
     extern int32_t m ## _lock_count;
 
-#define JL_LOCK(m) do {                                                 \
+#define JL_LOCK_WAIT(m, wait) do {                                      \
         if (m ## _mutex == uv_thread_self()) {                          \
             ++m ## _lock_count;                                         \
         }                                                               \
@@ -116,11 +143,17 @@ JL_DLLEXPORT void jl_threading_profile(void);
                     m ## _lock_count = 1;                               \
                     break;                                              \
                 }                                                       \
+                wait;                                                   \
                 jl_cpu_pause();                                         \
             }                                                           \
         }                                                               \
     } while (0)
 
+#define JL_LOCK(m) JL_LOCK_WAIT(m, (void)0)
+// for locks whose owner can allocate: the thread takes part in the
+// collections that happen while it waits, since they need all the threads
+#define JL_LOCK_SAFEPOINT(m) JL_LOCK_WAIT(m, jl_gc_safepoint())
+
 #define JL_UNLOCK(m) do {                                               \
         if (m ## _mutex == uv_thread_self()) {                          \
             --m ## _lock_count;                                         \
@@ -133,6 +166,7 @@ JL_DLLEXPORT void jl_threading_profile(void);
 #define JL_DEFINE_MUTEX(m)
 #define JL_DEFINE_MUTEX_EXT(m)
 #define JL_LOCK(m) do {} while (0)
+#define JL_LOCK_SAFEPOINT(m) do {} while (0)
 #define JL_UNLOCK(m) do {} while (0)
 #endif
 
@@ -172,8 +206,8 @@ static inline void jl_set_typeof(void *v, void *t)
 
 typedef struct _jl_sym_t {
     JL_DATA_TYPE
-    struct _jl_sym_t *left;
-    struct _jl_sym_t *right;
+    struct _jl_sym_t *left;  // next symbol in the same symbol table bucket
+    struct _jl_sym_t *right; // next older symbol (see jl_get_root_symbol)
     uptrint_t hash;    // precomputed hash value
     // JL_ATTRIBUTE_ALIGN_PTRSIZE(char name[]);
 } jl_sym_t;
@@ -266,6 +300,7 @@ typedef struct _jl_lambda_info_t {
     struct _jl_module_t *module;
     struct _jl_lambda_info_t *def;  // original this is specialized from, for consolidating codegen roots
     jl_value_t *capt;  // captured var info
+    jl_value_t *tfunc_index;  // index of tfunc kept by inference (not saved)
     jl_sym_t *file;
     int32_t line;
     int8_t inferred;
@@ -276,6 +311,10 @@ typedef struct _jl_lambda_info_t {
     // used to avoid infinite recursion
     uint8_t inInference : 1;
     uint8_t inCompile : 1;
+    // calls run in the interpreter before compiling, with --compile=tiered
+    uint16_t ninterp;
+    // what those calls saw, with JULIA_TYPE_FEEDBACK (see jl_feedback_t)
+    struct _jl_feedback_t *feedback;
     jl_fptr_t fptr;             // jlcall entry point
 
     // On the old JIT, handles to all Functions generated for this linfo
@@ -311,8 +350,8 @@ typedef struct {
     // a type alias, for example, might make a type constructor that is
     // not the original.
     jl_value_t *primary;
-    jl_svec_t *cache;        // sorted array
-    jl_svec_t *linearcache;  // unsorted array
+    jl_svec_t *cache;        // hash table of types with ordered keys
+    jl_svec_t *linearcache;  // unsorted array of the rest
     ptrint_t uid;
 } jl_typename_t;
 
@@ -353,12 +392,15 @@ typedef struct _jl_datatype_t {
     int32_t ninitialized;
     // hidden fields:
     uint32_t nfields;
-    uint32_t alignment : 29;  // strictest alignment over all fields
+    uint32_t alignment : 28;  // strictest alignment over all fields
     uint32_t haspadding : 1;  // has internal undefined bytes
+    uint32_t bitsequal : 1;  // immutable and pointer-free with no padding, so
+                             // instances are egal iff all their bytes are
     uint32_t fielddesc_type : 2; // 0 -> 8, 1 -> 16, 2 -> 32
     uint32_t uid;
     void *struct_decl;  //llvm::Value*
     void *ditype; // llvm::MDNode* to be used as llvm::DIType(ditype)
+    void *fieldindex; // field name -> index hash table, see jl_field_index
     // Last field needs to be pointer size aligned
     // union {
     //     jl_fielddesc8_t field8[];
@@ -398,10 +440,13 @@ typedef struct _jl_module_t {
     struct _jl_module_t *parent;
     htable_t bindings;
     arraylist_t usings;  // modules with all bindings potentially imported
+    htable_t resolved;  // cached jl_get_binding results, see module.c
+    size_t resolved_age;
     jl_array_t *constant_table;
     jl_function_t *call_func;  // cached lookup of `call` within this module
     uint8_t istopmod;
     uint8_t std_imports;  // only for temporarily deprecating `importall Base.Operators`
+    uint8_t init_pending;  // __init__ deferred until a binding is first accessed, 2 while it runs
     uint64_t uuid;
 } jl_module_t;
 
@@ -428,12 +473,11 @@ typedef struct _jl_methtable_t {
     jl_methlist_t *cache;
     jl_array_t *cache_arg1;
     jl_array_t *cache_targ;
+    jl_array_t *cache_exact; // hash table of full leaf signatures
+    jl_array_t *cache_matches; // results of jl_matching_methods
     ptrint_t max_args;  // max # of non-vararg arguments in a signature
     jl_function_t *kwsorter;  // keyword argument sorter function
     jl_module_t *module; // used for incremental serialization to locate original binding
-#ifdef JL_GF_PROFILE
-    int ncalls;
-#endif
 } jl_methtable_t;
 
 typedef struct {
@@ -477,6 +521,7 @@ extern JL_DLLEXPORT jl_datatype_t *jl_densearray_type;
 extern JL_DLLEXPORT jl_datatype_t *jl_array_type;
 extern JL_DLLEXPORT jl_typename_t *jl_array_typename;
 extern JL_DLLEXPORT jl_datatype_t *jl_weakref_type;
+extern JL_DLLEXPORT jl_typename_t *jl_vecelement_typename;
 extern JL_DLLEXPORT jl_datatype_t *jl_ascii_string_type;
 extern JL_DLLEXPORT jl_datatype_t *jl_utf8_string_type;
 extern JL_DLLEXPORT jl_datatype_t *jl_errorexception_type;
@@ -620,11 +665,29 @@ typedef struct _jl_gcframe_t {
 
 JL_DLLEXPORT int jl_gc_enable(int on);
 JL_DLLEXPORT int jl_gc_is_enabled(void);
+JL_DLLEXPORT int jl_gc_enable_parallel_mark(int on);
+JL_DLLEXPORT int jl_gc_enable_lazy_sweep(int on);
+JL_DLLEXPORT uint64_t jl_gc_set_pause_budget(uint64_t us);
+JL_DLLEXPORT uint64_t jl_gc_set_heap_limit(uint64_t bytes);
 JL_DLLEXPORT int64_t jl_gc_total_bytes(void);
 JL_DLLEXPORT uint64_t jl_gc_total_hrtime(void);
 JL_DLLEXPORT int64_t jl_gc_diff_total_bytes(void);
 
 JL_DLLEXPORT void jl_gc_collect(int);
+JL_DLLEXPORT void jl_gc_safepoint(void);
+// a thread in a gc safe region doesn't touch julia objects, so collections
+// started by the other threads don't wait for it. a thread that blocks
+// outside of julia (or waits for another one that calls into julia) while
+// the runtime has more threads brackets the wait with these:
+//     int8_t state = jl_gc_safe_enter();
+//     ... no julia objects here ...
+//     jl_gc_state_restore(state);
+#define JL_GC_STATE_UNSAFE 0 // running julia code, the default
+#define JL_GC_STATE_WAITING 1 // stopped for a collection
+#define JL_GC_STATE_SAFE 2 // not touching julia objects
+JL_DLLEXPORT int8_t jl_gc_safe_enter(void);
+JL_DLLEXPORT int8_t jl_gc_unsafe_enter(void);
+JL_DLLEXPORT void jl_gc_state_restore(int8_t state);
 JL_DLLEXPORT void jl_gc_preserve(jl_value_t *v);
 JL_DLLEXPORT void jl_gc_unpreserve(void);
 JL_DLLEXPORT int jl_gc_n_preserved_values(void);
@@ -642,6 +705,8 @@ JL_DLLEXPORT void jl_clear_malloc_data(void);
 
 // GC write barriers
 JL_DLLEXPORT void jl_gc_queue_root(jl_value_t *root); // root isa jl_value_t*
+JL_DLLEXPORT void jl_gc_queue_slot(jl_value_t *parent, void *slot);
+JL_DLLEXPORT void jl_gc_queue_slots(jl_value_t *parent, void *slot, size_t n);
 
 STATIC_INLINE void jl_gc_wb(void *parent, void *ptr)
 {
@@ -659,6 +724,18 @@ STATIC_INLINE void jl_gc_wb_back(void *ptr) // ptr isa jl_value_t*
     }
 }
 
+// like jl_gc_wb for a store to the pointer slot of parent, so that only
+// the part of a big array around slot has to be scanned again
+STATIC_INLINE void jl_gc_wb_slot(void *parent, void *slot, void *ptr)
+{
+    if (__unlikely((jl_astaggedvalue(parent)->gc_bits & 1) == 1 &&
+                   (jl_astaggedvalue(ptr)->gc_bits & 1) == 0))
+        jl_gc_queue_slot((jl_value_t*)parent, slot);
+}
+
+// to be called after moving the elements of a inside its buffer
+JL_DLLEXPORT void jl_gc_array_moved(jl_array_t *a);
+
 JL_DLLEXPORT void *jl_gc_managed_malloc(size_t sz);
 JL_DLLEXPORT void *jl_gc_managed_realloc(void *d, size_t sz, size_t oldsz,
                                          int isaligned, jl_value_t* owner);
@@ -917,6 +994,12 @@ STATIC_INLINE int jl_is_cpointer_type(jl_value_t *t)
             ((jl_datatype_t*)(t))->name == jl_pointer_type->name);
 }
 
+STATIC_INLINE int jl_is_vecelement_type(jl_value_t *t)
+{
+    return (jl_is_datatype(t) &&
+            ((jl_datatype_t*)(t))->name == jl_vecelement_typename);
+}
+
 STATIC_INLINE int jl_is_abstract_ref_type(jl_value_t *t)
 {
     return (jl_is_datatype(t) &&
@@ -1099,6 +1182,10 @@ JL_DLLEXPORT jl_array_t *jl_ptr_to_array_1d(jl_value_t *atype, void *data,
                                             size_t nel, int own_buffer);
 JL_DLLEXPORT jl_array_t *jl_ptr_to_array(jl_value_t *atype, void *data,
                                          jl_value_t *dims, int own_buffer);
+typedef void (*jl_free_func_t)(void *data, void *arg);
+JL_DLLEXPORT jl_array_t *jl_ptr_to_array_1d_free(jl_value_t *atype, void *data,
+                                                 size_t nel, jl_free_func_t freefunc,
+                                                 void *arg);
 
 JL_DLLEXPORT jl_array_t *jl_alloc_array_1d(jl_value_t *atype, size_t nr);
 JL_DLLEXPORT jl_array_t *jl_alloc_array_2d(jl_value_t *atype, size_t nr,
@@ -1109,10 +1196,14 @@ JL_DLLEXPORT jl_array_t *jl_pchar_to_array(const char *str, size_t len);
 JL_DLLEXPORT jl_value_t *jl_pchar_to_string(const char *str, size_t len);
 JL_DLLEXPORT jl_value_t *jl_cstr_to_string(const char *str);
 JL_DLLEXPORT jl_value_t *jl_array_to_string(jl_array_t *a);
+JL_DLLEXPORT jl_value_t *jl_ptr_to_string(char *str, size_t len,
+                                          jl_free_func_t freefunc, void *arg);
 JL_DLLEXPORT jl_array_t *jl_alloc_cell_1d(size_t n);
 JL_DLLEXPORT jl_value_t *jl_arrayref(jl_array_t *a, size_t i);  // 0-indexed
 JL_DLLEXPORT void jl_arrayset(jl_array_t *a, jl_value_t *v, size_t i);  // 0-indexed
 JL_DLLEXPORT void jl_arrayunset(jl_array_t *a, size_t i);  // 0-indexed
+JL_DLLEXPORT void jl_array_ptr_copy(jl_array_t *dest, jl_value_t **dest_p,
+                                    jl_array_t *src, jl_value_t **src_p, size_t n);
 JL_DLLEXPORT void jl_array_grow_end(jl_array_t *a, size_t inc);
 JL_DLLEXPORT void jl_array_del_end(jl_array_t *a, size_t dec);
 JL_DLLEXPORT void jl_array_grow_beg(jl_array_t *a, size_t inc);
@@ -1253,6 +1344,8 @@ JL_DLLEXPORT int jl_save_incremental(const char *fname, jl_array_t* worklist);
 JL_DLLEXPORT jl_value_t *jl_restore_incremental(const char *fname);
 JL_DLLEXPORT jl_value_t *jl_restore_incremental_from_buf(const char *buf,
                                                          size_t sz);
+JL_DLLEXPORT void jl_serialize_data(ios_t *s, jl_value_t *v);
+JL_DLLEXPORT jl_value_t *jl_deserialize_data(ios_t *s);
 
 // front end interface
 JL_DLLEXPORT jl_value_t *jl_parse_input_line(const char *str, size_t len);
@@ -1358,6 +1451,26 @@ JL_DLLEXPORT jl_value_t *jl_call1(jl_function_t *f, jl_value_t *a);
 JL_DLLEXPORT jl_value_t *jl_call2(jl_function_t *f, jl_value_t *a, jl_value_t *b);
 JL_DLLEXPORT jl_value_t *jl_call3(jl_function_t *f, jl_value_t *a,
                                   jl_value_t *b, jl_value_t *c);
+// calling from threads of the embedding program, and repeated calls
+JL_DLLEXPORT int16_t jl_adopt_thread(void);
+typedef struct _jl_call_ctx_t jl_call_ctx_t;
+JL_DLLEXPORT jl_call_ctx_t *jl_call_ctx_new(jl_function_t *f, int32_t nargs);
+JL_DLLEXPORT jl_value_t **jl_call_ctx_args(jl_call_ctx_t *c);
+JL_DLLEXPORT jl_value_t *jl_call_ctx_invoke(jl_call_ctx_t *c);
+JL_DLLEXPORT void jl_call_ctx_free(jl_call_ctx_t *c);
+
+// bounded multi-producer multi-consumer queue, for handing values between
+// threads (see queue.c)
+typedef struct _jl_queue_t jl_queue_t;
+JL_DLLEXPORT jl_queue_t *jl_queue_new(size_t capacity);
+JL_DLLEXPORT void jl_queue_free(jl_queue_t *q);
+JL_DLLEXPORT size_t jl_queue_capacity(jl_queue_t *q);
+JL_DLLEXPORT size_t jl_queue_length(jl_queue_t *q);
+JL_DLLEXPORT int jl_queue_trypush(jl_queue_t *q, jl_value_t *v);
+JL_DLLEXPORT jl_value_t *jl_queue_trypop(jl_queue_t *q);
+JL_DLLEXPORT jl_value_t *jl_queue_trypop_default(jl_queue_t *q, jl_value_t *dflt);
+JL_DLLEXPORT void jl_queue_push(jl_queue_t *q, jl_value_t *v);
+JL_DLLEXPORT jl_value_t *jl_queue_pop(jl_queue_t *q);
 
 // interfacing with Task runtime
 JL_DLLEXPORT void jl_yield(void);
@@ -1435,16 +1548,27 @@ typedef struct _jl_tls_states_t {
     char *stack_hi;
     jl_jmp_buf *volatile jmp_target;
     jl_jmp_buf base_ctx; // base context of stack
+    // finished task whose stack is given back once we are off it
+    jl_task_t *finished_task;
     int8_t in_jl_;
     int16_t tid;
     size_t bt_size;
     ptrint_t bt_data[JL_MAX_BT_SIZE + 1];
+    // this thread's own libuv loop, created on first use (see jl_thread_event_loop)
+    uv_loop_t *event_loop;
+    // whether a collection has to wait for this thread, see jl_gc_safe_enter
+    volatile int8_t gc_state;
+    // evaluating for inference or codegen: the reads don't run a pending
+    // __init__ (see jl_interpret_toplevel_expr_in)
+    int8_t in_static_eval;
 } jl_tls_states_t;
 
 typedef struct {
     jl_tls_states_t *ptls;
     uv_thread_t system_id;
     void *signal_stack;
+    // the kernel's id for the thread on Linux, for perf_event_open
+    int kernel_tid;
 } jl_thread_task_state_t;
 
 #define jl_current_task (jl_get_ptls_states()->current_task)
@@ -1467,6 +1591,18 @@ typedef jl_tls_states_t *(*jl_get_ptls_states_func)(void);
 JL_DLLEXPORT void jl_set_ptls_states_getter(jl_get_ptls_states_func f);
 #endif
 
+// make eh the innermost handler. eh is filled in before it is published, so
+// a signal arriving in between sees a consistent chain either way, and this
+// needs no JL_SIGATOMIC section on the path of every try.
+STATIC_INLINE void jl_eh_push_state(jl_handler_t *eh)
+{
+    jl_task_t *ct = jl_current_task;
+    eh->prev = ct->eh;
+    eh->gcstack = jl_pgcstack;
+    JL_SIGNAL_FENCE();
+    ct->eh = eh;
+}
+
 STATIC_INLINE void jl_eh_restore_state(jl_handler_t *eh)
 {
     JL_SIGATOMIC_BEGIN();
@@ -1505,7 +1641,7 @@ void jl_longjmp(jmp_buf _Buf,int _Value);
 
 #define JL_TRY                                                    \
     int i__tr, i__ca; jl_handler_t __eh;                          \
-    jl_enter_handler(&__eh);                                      \
+    jl_eh_push_state(&__eh);                                      \
     if (!jl_setjmp(__eh.eh_ctx,0))                                \
         for (i__tr=1; i__tr; i__tr=0, jl_eh_restore_state(&__eh))
 
@@ -1534,6 +1670,15 @@ JL_DLLEXPORT int jl_run_once(uv_loop_t *loop);
 JL_DLLEXPORT int jl_process_events(uv_loop_t *loop);
 
 JL_DLLEXPORT uv_loop_t *jl_global_event_loop(void);
+JL_DLLEXPORT uv_loop_t *jl_thread_event_loop(void);
+#ifndef _OS_WINDOWS_
+// in the child of a fork(): give it its own polling backend and wakeups
+JL_DLLEXPORT int jl_uv_loop_fork(uv_loop_t *loop);
+// whether the runtime can be forked (it has only one thread), and setting up
+// the child: its loop, and stdio from its descriptors 0, 1 and 2
+JL_DLLEXPORT int jl_can_fork(void);
+JL_DLLEXPORT void jl_init_forked_child(void);
+#endif
 
 JL_DLLEXPORT void jl_close_uv(uv_handle_t *handle);
 
@@ -1640,6 +1785,7 @@ JL_DLLEXPORT int jl_generating_output(void);
 #define JL_OPTIONS_COMPILE_OFF 0
 #define JL_OPTIONS_COMPILE_ON  1
 #define JL_OPTIONS_COMPILE_ALL 2
+#define JL_OPTIONS_COMPILE_TIERED 3
 
 #define JL_OPTIONS_COLOR_ON 1
 #define JL_OPTIONS_COLOR_OFF 2
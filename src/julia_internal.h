@@ -10,6 +10,12 @@
 extern "C" {
 #endif
 
+#if defined(JULIA_ENABLE_THREADING) && defined(CODEGEN_TLS)
+extern JL_DLLEXPORT __thread jl_tls_states_t jl_tls_states
+    __attribute__((tls_model("initial-exec")));
+#define jl_get_ptls_states() (&jl_tls_states)
+#endif
+
 extern size_t jl_page_size;
 #define jl_stack_lo (jl_get_ptls_states()->stack_lo)
 #define jl_stack_hi (jl_get_ptls_states()->stack_hi)
@@ -18,6 +24,14 @@ extern jl_function_t *jl_typeinf_func;
 extern unsigned sig_stack_size;
 #endif
 #define jl_in_jl_ jl_get_ptls_states()->in_jl_
+#ifdef JULIA_ENABLE_THREADING
+// polled by compiled code, unreadable while a collection waits (see gc.c)
+extern volatile size_t *jl_gc_safepoint_page;
+#endif
+// the collector's side of the queues (see queue.c)
+void jl_gc_wake_queues(void);
+void jl_gc_queued_values(void (*f)(jl_value_t*));
+void jl_gc_profile_roots(void (*f)(jl_value_t*));
 
 JL_DLLEXPORT extern int jl_lineno;
 JL_DLLEXPORT extern const char *jl_filename;
@@ -56,6 +70,11 @@ void jl_gc_inhibit_finalizers(int state);
 void jl_gc_setmark(jl_value_t *v);
 void jl_gc_sync_total_bytes(void);
 void jl_gc_track_malloced_array(jl_array_t *a);
+void jl_gc_track_feedback(jl_lambda_info_t *li);
+void jl_gc_track_foreign_array(jl_array_t *a, jl_free_func_t freefunc, void *arg);
+int jl_gc_is_foreign_array(jl_array_t *a);
+void jl_gc_release_foreign_array(jl_array_t *a, void *data);
+void jl_gc_set_dontfork(int dontfork);
 void jl_gc_count_allocd(size_t sz);
 void jl_gc_run_all_finalizers(void);
 void *allocb(size_t sz);
@@ -105,9 +124,55 @@ JL_DLLEXPORT void jl_typeassert(jl_value_t *x, jl_value_t *t);
 
 JL_CALLABLE(jl_trampoline);
 JL_CALLABLE(jl_apply_generic);
+
+// inline cache of a dynamic call site, see jl_apply_generic_cached
+#define JL_CALLSITE_WAYS 4
+#define JL_CALLSITE_MAXARGS 4
+typedef struct {
+    size_t epoch;
+    jl_function_t *func;
+    uint64_t keys[JL_CALLSITE_MAXARGS];
+} jl_callsite_entry_t;
+typedef struct {
+    uint32_t next; // entry to evict on the next miss
+    jl_callsite_entry_t entries[JL_CALLSITE_WAYS];
+} jl_callsite_cache_t;
+JL_DLLEXPORT jl_value_t *jl_apply_generic_cached(jl_value_t *F, jl_value_t **args, uint32_t nargs,
+                                                 jl_callsite_cache_t *cache);
+
+// type and branch feedback of a method, gathered while it runs in the
+// interpreter tier and used when it gets compiled (see TYPE_FEEDBACK_NAME)
+#define JL_FEEDBACK_SIGS 4
+typedef struct {
+    jl_function_t *f; // only compared, it is not rooted by the feedback
+    uint32_t nargs;
+    uint32_t ncalls;  // including the calls with a signature not kept
+    // the first signatures seen, kept alive by the tuple type cache
+    jl_tupletype_t *sigs[JL_FEEDBACK_SIGS];
+    uint32_t counts[JL_FEEDBACK_SIGS];
+} jl_call_feedback_t;
+typedef struct {
+    int32_t label; // the target of the goto_ifnot
+    uint32_t taken;
+    uint32_t nottaken;
+} jl_branch_feedback_t;
+typedef struct _jl_feedback_t {
+    uint32_t ncalls, maxcalls;
+    jl_call_feedback_t *calls;
+    uint32_t nbranches, maxbranches;
+    jl_branch_feedback_t *branches;
+} jl_feedback_t;
+extern int jl_type_feedback;
+jl_tupletype_t *jl_feedback_dominant_sig(jl_lambda_info_t *li, jl_function_t *f, size_t nargs,
+                                         uint32_t *count, uint32_t *ncalls);
+int jl_feedback_branch(jl_lambda_info_t *li, int label, uint32_t *taken, uint32_t *nottaken);
+void jl_free_feedback(jl_lambda_info_t *li);
+volatile size_t *jl_dispatch_epoch_ptr(void);
 JL_CALLABLE(jl_unprotect_stack);
 JL_CALLABLE(jl_f_no_function);
 JL_CALLABLE(jl_f_tuple);
+JL_DLLEXPORT jl_value_t *jl_apply_2va(jl_function_t *f, jl_value_t **lead, uint32_t nlead,
+                                      jl_value_t **rest, uint32_t nrest);
 JL_CALLABLE(jl_f_intrinsic_call);
 extern jl_function_t *jl_unprotect_stack_func;
 extern jl_function_t *jl_bottom_func;
@@ -152,6 +217,11 @@ jl_methlist_t *jl_method_table_insert(jl_methtable_t *mt, jl_tupletype_t *type,
 int jl_is_type(jl_value_t *v);
 jl_value_t *jl_type_intersection_matching(jl_value_t *a, jl_value_t *b,
                                           jl_svec_t **penv, jl_svec_t *tvars);
+extern jl_array_t *jl_type_memo;
+extern size_t jl_method_table_generation;
+extern jl_array_t *jl_cfunction_cache_roots;
+void jl_init_type_memo(void);
+void jl_clear_type_memo(void);
 jl_typector_t *jl_new_type_ctor(jl_svec_t *params, jl_value_t *body);
 jl_value_t *jl_apply_type_(jl_value_t *tc, jl_value_t **params, size_t n);
 jl_value_t *jl_instantiate_type_with(jl_value_t *t, jl_value_t **env, size_t n);
@@ -167,6 +237,7 @@ void jl_add_method(jl_function_t *gf, jl_tupletype_t *types, jl_function_t *meth
 jl_function_t *jl_module_call_func(jl_module_t *m);
 int jl_is_submodule(jl_module_t *child, jl_module_t *parent);
 int jl_start_parsing_file(const char *fname);
+void jl_start_parsing_string(const char *text, size_t len, const char *fname);
 void jl_stop_parsing(void);
 jl_value_t *jl_parse_next(void);
 jl_lambda_info_t *jl_wrap_expr(jl_value_t *expr);
@@ -174,6 +245,23 @@ void jl_compile_linfo(jl_lambda_info_t *li, void *cyclectx);
 jl_value_t *jl_eval_global_var(jl_module_t *m, jl_sym_t *e);
 jl_value_t *jl_parse_eval_all(const char *fname, size_t len);
 jl_value_t *jl_interpret_toplevel_thunk(jl_lambda_info_t *lam);
+jl_value_t *jl_interpret_call(jl_function_t *f, jl_value_t **args, uint32_t nargs);
+
+// compile time profiler phases, see gf.c
+enum {
+    JL_COMPILE_INFER = 0,
+    JL_COMPILE_CODEGEN,
+    JL_COMPILE_LLVM_OPT,
+    JL_COMPILE_EMIT,
+    JL_COMPILE_NPHASES
+};
+typedef struct {
+    uint64_t t0;
+    uint64_t nested0;
+} jl_compile_timer_t;
+extern int jl_compile_timing_on;
+void jl_compile_timer_start(jl_compile_timer_t *t);
+void jl_compile_timer_stop(jl_compile_timer_t *t, jl_lambda_info_t *li, int phase);
 jl_value_t *jl_interpret_toplevel_thunk_with(jl_lambda_info_t *lam,
                                              jl_value_t **loc, size_t nl);
 jl_value_t *jl_interpret_toplevel_expr(jl_value_t *e);
@@ -207,6 +295,7 @@ void jl_add_constructors(jl_datatype_t *t);
 
 jl_value_t *jl_nth_slot_type(jl_tupletype_t *sig, size_t i);
 void jl_compute_field_offsets(jl_datatype_t *st);
+unsigned jl_special_vector_alignment(size_t nfields, jl_value_t *t);
 jl_array_t *jl_new_array_for_deserialization(jl_value_t *atype, uint32_t ndims, size_t *dims,
                                              int isunboxed, int elsz);
 JL_DLLEXPORT jl_value_t *jl_new_box(jl_value_t *v);
@@ -219,6 +308,9 @@ extern char jl_using_intel_jitevents;
 #ifdef JL_USE_OPROFILE_JITEVENTS
 extern char jl_using_oprofile_jitevents;
 #endif
+#ifdef _OS_LINUX_
+extern char jl_using_perf_jitevents;
+#endif
 extern size_t jl_arr_xtralloc_limit;
 
 void jl_init_types(void);
@@ -233,6 +325,12 @@ void jl_init_root_task(void *stack, size_t ssize);
 void jl_init_serializer(void);
 void jl_gc_init(void);
 void jl_init_restored_modules(jl_array_t *init_order);
+void jl_invalidate_binding_caches(void);
+// lazy __init__ (see LAZY_MODULE_INIT_NAME)
+extern int jl_lazy_module_init;
+void jl_module_defer_initializer(jl_module_t *m);
+JL_DLLEXPORT void jl_module_run_pending_initializer(jl_module_t *m);
+jl_value_t *jl_get_global_init(jl_module_t *m, jl_sym_t *var);
 
 void _julia_init(JL_IMAGE_SEARCH rel);
 #ifdef COPY_STACKS
@@ -250,6 +348,7 @@ jl_get_ptls_states_func jl_get_ptls_states_getter(void);
 
 void jl_dump_bitcode(char *fname, const char *sysimg_data, size_t sysimg_len);
 void jl_dump_objfile(char *fname, int jit_model, const char *sysimg_data, size_t sysimg_len);
+void jl_defer_function_passes(int on);
 int32_t jl_get_llvm_gv(jl_value_t *p);
 void jl_idtable_rehash(jl_array_t **pa, size_t newsz);
 
@@ -257,7 +356,9 @@ jl_lambda_info_t *jl_add_static_parameters(jl_lambda_info_t *l, jl_svec_t *sp, j
 jl_function_t *jl_get_specialization(jl_function_t *f, jl_tupletype_t *types, void *cyclectx);
 jl_function_t *jl_module_get_initializer(jl_module_t *m);
 void jl_generate_fptr(jl_function_t *f);
-void jl_fptr_to_llvm(void *fptr, jl_lambda_info_t *lam, int specsig);
+// rettype is the return type of a specsig function, or NULL to get it from lam->ast
+void jl_fptr_to_llvm(void *fptr, jl_lambda_info_t *lam, int specsig, jl_value_t *rettype);
+int jl_host_supports_cpu(const char *cpu);
 jl_tupletype_t *arg_type_tuple(jl_value_t **args, size_t nargs);
 
 jl_value_t* skip_meta(jl_array_t *body);
@@ -276,6 +377,12 @@ typedef unw_context_t *bt_context_t;
 #endif
 #define jl_bt_data (jl_get_ptls_states()->bt_data)
 #define jl_bt_size (jl_get_ptls_states()->bt_size)
+// frames recorded per backtrace (see BT_MAX_DEPTH_NAME)
+extern size_t jl_bt_max_depth;
+STATIC_INLINE size_t jl_bt_depth(size_t room)
+{
+    return room < jl_bt_max_depth ? room : jl_bt_max_depth;
+}
 JL_DLLEXPORT size_t rec_backtrace(ptrint_t *data, size_t maxsize);
 JL_DLLEXPORT size_t rec_backtrace_ctx(ptrint_t *data, size_t maxsize, bt_context_t ctx);
 #ifdef LIBOSXUNWIND
@@ -309,6 +416,13 @@ static inline char *jl_copy_str(char **to, const char *from)
 // Returns time in nanosec
 JL_DLLEXPORT uint64_t jl_hrtime(void);
 
+// startup tracing (see STARTUP_TRACE_NAME)
+extern int jl_startup_tracing;
+// print the time since the previous phase
+void jl_startup_trace(const char *phase);
+// print the time since t0, for something that is not a phase of its own
+void jl_startup_trace_since(const char *what, const char *name, uint64_t t0);
+
 // libuv stuff:
 JL_DLLEXPORT extern void *jl_dl_handle;
 JL_DLLEXPORT extern void *jl_RTLD_DEFAULT_handle;
@@ -321,6 +435,8 @@ extern void *jl_winsock_handle;
 #endif
 
 void *jl_get_library(const char *f_lib);
+void *jl_dlsym_cached(void *handle, const char *f_name, int throw_err);
+void jl_dlsym_cache_forget(void *handle);
 JL_DLLEXPORT void *jl_load_and_lookup(const char *f_lib, const char *f_name,
                                    void **hnd);
 const char *jl_dlfind_win32(const char *name);
@@ -328,10 +444,13 @@ const char *jl_dlfind_win32(const char *name);
 
 // libuv wrappers:
 JL_DLLEXPORT int jl_fs_rename(const char *src_path, const char *dst_path);
+JL_DLLEXPORT int jl_fs_write(int handle, const char *data, size_t len,
+                             int64_t offset);
 
 #if defined(_CPU_X86_) || defined(_CPU_X86_64_)
 #define HAVE_CPUID
 #endif
+void jl_init_hrtime(void);
 
 #ifdef SEGV_EXCEPTION
 extern JL_DLLEXPORT jl_value_t *jl_segv_exception;
@@ -343,6 +462,12 @@ const char* jl_intrinsic_name(int f);
 JL_DLLEXPORT jl_value_t *jl_reinterpret(jl_value_t *ty, jl_value_t *v);
 JL_DLLEXPORT jl_value_t *jl_pointerref(jl_value_t *p, jl_value_t *i);
 JL_DLLEXPORT jl_value_t *jl_pointerset(jl_value_t *p, jl_value_t *x, jl_value_t *i);
+JL_DLLEXPORT jl_value_t *jl_atomic_pointerref(jl_value_t *p, jl_value_t *order);
+JL_DLLEXPORT jl_value_t *jl_atomic_pointerset(jl_value_t *p, jl_value_t *x, jl_value_t *order);
+JL_DLLEXPORT jl_value_t *jl_atomic_pointerrmw(jl_value_t *p, jl_value_t *op, jl_value_t *x,
+                                              jl_value_t *order);
+JL_DLLEXPORT jl_value_t *jl_atomic_pointercas(jl_value_t *p, jl_value_t *cmp, jl_value_t *x,
+                                              jl_value_t *order);
 
 JL_DLLEXPORT jl_value_t *jl_neg_int(jl_value_t *a);
 JL_DLLEXPORT jl_value_t *jl_add_int(jl_value_t *a, jl_value_t *b);
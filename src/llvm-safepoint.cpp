@@ -0,0 +1,73 @@
+// This file is a part of Julia. License is MIT: http://julialang.org/license
+
+#define DEBUG_TYPE "loop_safepoint"
+#undef DEBUG
+
+// This file defines one entry point:
+//     createLoopSafepointPass: construct the LLVM pass that makes the
+//         back-edge of each loop poll the safepoint page of gc.c.
+//
+// codegen polls at function entries only. A volatile load in the body of a
+// loop keeps the loop vectorizer from touching it, so the polls of the loops
+// are added by this pass, which runs at the end of the pipeline: a
+// vectorized loop then polls once per vector iteration, and a loop that
+// neither calls nor allocates still lets a collection of the other threads
+// in.
+
+#include "llvm-version.h"
+#include "support/dtypes.h"
+#include <llvm/Analysis/LoopPass.h>
+#include <llvm/IR/Instructions.h>
+#include <llvm/IR/LLVMContext.h>
+#include <llvm/IR/Module.h>
+#include <llvm/Support/Debug.h>
+
+namespace llvm {
+
+struct LoopSafepoint: public LoopPass {
+    static char ID;
+    LoopSafepoint() : LoopPass(ID) {}
+
+    /*override*/ void getAnalysisUsage(AnalysisUsage &AU) const
+    {
+        AU.setPreservesCFG();
+    }
+
+private:
+    /*override*/ bool runOnLoop(Loop *, LPPassManager &LPM);
+};
+
+bool LoopSafepoint::runOnLoop(Loop *L, LPPassManager &LPM)
+{
+    BasicBlock *latch = L->getLoopLatch();
+    if (!latch)
+        return false;
+    // declared in the modules whose functions poll at their entry
+    GlobalVariable *page_var = latch->getParent()->getParent()->getNamedGlobal("jl_gc_safepoint_page");
+    if (!page_var)
+        return false;
+    DEBUG(dbgs() << "LSP: polling in the latch of " << L->getHeader()->getName() << "\n");
+    Instruction *term = latch->getTerminator();
+    // the page doesn't move once the runtime is up, load its address ahead
+    // of the loop where there is a place for it
+    BasicBlock *preheader = L->getLoopPreheader();
+    Value *page = new LoadInst(page_var, "safepoint_page",
+                               preheader ? preheader->getTerminator() : term);
+    // same as the poll of emit_gc_safepoint: the stores to the gc frame
+    // stay ahead of the load that faults
+    new FenceInst(latch->getContext(), SequentiallyConsistent, SingleThread, term);
+    new LoadInst(page, "", true, term);
+    return true;
+}
+
+char LoopSafepoint::ID = 0;
+
+static RegisterPass<LoopSafepoint> X("LoopSafepoint", "LoopSafepoint Pass",
+                                     true /* Only looks at CFG */,
+                                     false /* Analysis Pass */);
+
+JL_DLLEXPORT Pass* createLoopSafepointPass() {
+    return new LoopSafepoint();
+}
+
+} // namespace llvm
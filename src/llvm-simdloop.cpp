@@ -3,18 +3,23 @@
 #define DEBUG_TYPE "lower_simd_loop"
 #undef DEBUG
 
-// This file defines two entry points:
+// This file defines three entry points:
 //     global function annotateSimdLoop: mark a loop as a SIMD loop.
 //     createLowerSimdLoopPass: construct LLVM for lowering a marked loop later.
+//     createSimdLoopReportPass: construct LLVM pass that reports, after the
+//         loop vectorizer ran, whether each lowered loop was vectorized.
 
 #include "llvm-version.h"
 #include "support/dtypes.h"
 #include <llvm/Analysis/LoopPass.h>
 #include <llvm/IR/Instructions.h>
+#include <llvm/IR/IntrinsicInst.h>
 #include <llvm/IR/LLVMContext.h>
 #include <llvm/IR/Metadata.h>
 #include <llvm/Support/Debug.h>
+#include <llvm/Support/raw_ostream.h>
 #include <cstdio>
+#include <string>
 
 namespace llvm {
 
@@ -22,6 +27,9 @@ namespace llvm {
 static unsigned simd_loop_mdkind = 0;
 static MDNode* simd_loop_md = NULL;
 
+// whether SIMDLoopReport prints its report, see jl_simdloop_report
+static bool simd_report = false;
+
 /// Mark loop as a SIMD loop.  Return false if loop cannot be marked.
 /// incr should be the basic block that increments the loop counter.
 bool annotateSimdLoop(BasicBlock* incr)
@@ -71,21 +79,37 @@ private:
     /// If present, the annotation is an MDNode attached to an instruction in the loop's latch.
     bool hasSIMDLoopMetadata( Loop *L) const;
 
-    /// If Phi is part of a reduction cycle of FAdd or FMul, mark the ops as permitting reassociation/commuting.
-    void enableUnsafeAlgebraIfReduction(PHINode* Phi, Loop* L) const;
+    /// If Phi is part of a reduction cycle of FAdd/FSub or FMul, mark the ops as permitting
+    /// reassociation/commuting. Return false if Phi is not such a reduction.
+    bool enableUnsafeAlgebraIfReduction(PHINode* Phi, Loop* L) const;
+
+    /// Describe what is known to keep the loop vectorizer from vectorizing L.
+    std::string findBlockers(Loop *L) const;
 };
 
 bool LowerSIMDLoop::hasSIMDLoopMetadata(Loop *L) const
 {
     // Note: If a loop has 0 or multiple latch blocks, it's probably not a simd_loop anyway.
-    if (BasicBlock* latch = L->getLoopLatch())
+    if (BasicBlock* latch = L->getLoopLatch()) {
+        // metadata kinds are numbered per context, and the partitions of a
+        // system image are optimized in contexts of their own
+        unsigned kind = simd_loop_mdkind;
+        LLVMContext &ctx = latch->getContext();
+        if (&ctx != &getGlobalContext())
+            kind = ctx.getMDKindID("simd_loop");
         for (BasicBlock::iterator II = latch->begin(), EE = latch->end(); II!=EE; ++II)
-            if (II->getMetadata(simd_loop_mdkind))
+            if (II->getMetadata(kind))
                 return true;
+    }
     return false;
 }
 
-void LowerSIMDLoop::enableUnsafeAlgebraIfReduction(PHINode* Phi, Loop* L) const
+static bool isAddLike(unsigned opcode)
+{
+    return opcode==Instruction::FAdd || opcode==Instruction::FSub;
+}
+
+bool LowerSIMDLoop::enableUnsafeAlgebraIfReduction(PHINode* Phi, Loop* L) const
 {
     typedef SmallVector<Instruction*, 8> chainVector;
     chainVector chain;
@@ -94,6 +118,9 @@ void LowerSIMDLoop::enableUnsafeAlgebraIfReduction(PHINode* Phi, Loop* L) const
     for (Instruction *I = Phi; ; I=J) {
         J = NULL;
         // Find the user of instruction I that is within loop L.
+        // A conditional update, select(c, op(I, x), I), gives I two users:
+        // the op then continues the chain, through the select.
+        SelectInst *Sel = NULL;
 #ifdef LLVM35
         for (User *UI : I->users()) { /*}*/
             Instruction *U = cast<Instruction>(UI);
@@ -102,42 +129,94 @@ void LowerSIMDLoop::enableUnsafeAlgebraIfReduction(PHINode* Phi, Loop* L) const
             Instruction *U = cast<Instruction>(*UI);
 #endif
             if (L->contains(U)) {
+                SelectInst *S = dyn_cast<SelectInst>(U);
+                if (S && !Sel && S->getCondition()!=I &&
+                    (S->getTrueValue()==I || S->getFalseValue()==I)) {
+                    Sel = S;
+                    continue;
+                }
                 if (J) {
                     DEBUG(dbgs() << "LSL: not a reduction var because op has two internal uses: " << *I << "\n");
-                    return;
+                    return false;
                 }
                 J = U;
             }
         }
+        if (Sel) {
+            Value *Other = Sel->getTrueValue()==I ? Sel->getFalseValue() : Sel->getTrueValue();
+            if (!J) {
+                J = Sel;        // the select is the only user
+            }
+            else if (J!=Other || !J->hasOneUse()) {
+                DEBUG(dbgs() << "LSL: not a reduction var because of select " << *Sel << "\n");
+                return false;
+            }
+        }
         if (!J) {
             DEBUG(dbgs() << "LSL: chain prematurely terminated at " << *I << "\n");
-            return;
+            return false;
         }
         if (J==Phi) {
             // Found the entire chain.
             break;
         }
+        if (isa<SelectInst>(J)) {
+            I = J;
+            continue;
+        }
         if (opcode) {
             // Check that arithmetic op matches prior arithmetic ops in the chain.
-            if (J->getOpcode()!=opcode) {
+            if (J->getOpcode()!=opcode && !(isAddLike(J->getOpcode()) && isAddLike(opcode))) {
                 DEBUG(dbgs() << "LSL: chain broke at " << *J << " because of wrong opcode\n");
-                return;
+                return false;
             }
         }
         else {
             // First arithmetic op in the chain.
             opcode = J->getOpcode();
-            if (opcode!=Instruction::FAdd && opcode!=Instruction::FMul) {
+            if (!isAddLike(opcode) && opcode!=Instruction::FMul) {
                 DEBUG(dbgs() << "LSL: first arithmetic op in chain is uninteresting" << *J << "\n");
-                return;
+                return false;
             }
         }
+        if (J->getOpcode()==Instruction::FSub && J->getOperand(0)!=I) {
+            DEBUG(dbgs() << "LSL: chain broke at " << *J << " because the reduction var is subtracted\n");
+            return false;
+        }
         chain.push_back(J);
+        if (Sel && J!=Sel) {
+            // continue from the select that picks the updated value
+            J = Sel;
+        }
     }
     for (chainVector::const_iterator K=chain.begin(); K!=chain.end(); ++K) {
         DEBUG(dbgs() << "LSL: marking " << **K << "\n");
         (*K)->setHasUnsafeAlgebra(true);
     }
+    return true;
+}
+
+std::string LowerSIMDLoop::findBlockers(Loop *L) const
+{
+    std::string blockers;
+    raw_string_ostream os(blockers);
+    if (!L->getSubLoops().empty())
+        os << "it is not an innermost loop; ";
+    if (!L->getExitingBlock())
+        os << "it has more than one exit; ";
+    for (Loop::block_iterator BBI = L->block_begin(), E=L->block_end(); BBI!=E; ++BBI) {
+        for (BasicBlock::iterator I = (*BBI)->begin(), EE = (*BBI)->end(); I!=EE; ++I) {
+            CallInst *call = dyn_cast<CallInst>(&*I);
+            if (!call || isa<IntrinsicInst>(call))
+                continue;
+            Function *callee = call->getCalledFunction();
+            os << "it calls " << (callee ? callee->getName() : StringRef("a function pointer")) << "; ";
+        }
+    }
+    os.flush();
+    if (blockers.size() >= 2)
+        blockers.resize(blockers.size() - 2);
+    return blockers;
 }
 
 bool LowerSIMDLoop::runOnLoop(Loop *L, LPPassManager &LPM)
@@ -149,18 +228,42 @@ bool LowerSIMDLoop::runOnLoop(Loop *L, LPPassManager &LPM)
         return false;
 
     DEBUG(dbgs() << "LSL: simd_loop found\n");
+
+    // Mark floating-point reductions as okay to reassociate/commute.
+    std::string blockers = findBlockers(L);
+    BasicBlock* Lh = L->getHeader();
+    DEBUG(dbgs() << "LSL: loop header: " << *Lh << "\n");
+    for (BasicBlock::iterator I = Lh->begin(), E = Lh->end(); I!=E; ++I) {
+        if (PHINode *Phi = dyn_cast<PHINode>(I)) {
+            if (!enableUnsafeAlgebraIfReduction(Phi,L) && Phi->getType()->isFloatingPointTy()) {
+                if (!blockers.empty())
+                    blockers += "; ";
+                blockers += "a floating point variable ";
+                if (Phi->hasName())
+                    blockers += Phi->getName().str() + " ";
+                blockers += "is not a recognized reduction";
+            }
+        }
+    }
+
 #ifdef LLVM34
-    MDNode* n = L->getLoopID();
-    if (!n) {
-        // Loop does not have a LoopID yet, so give it one.
+    // Give the loop a LoopID, with a julia.simdloop entry for SIMDLoopReport
 #ifdef LLVM36
-        n = MDNode::get(getGlobalContext(), ArrayRef<Metadata*>(NULL));
+    typedef Metadata MDOp;
 #else
-        n = MDNode::get(getGlobalContext(), ArrayRef<Value*>(NULL));
+    typedef Value MDOp;
 #endif
-        n->replaceOperandWith(0,n);
-        L->setLoopID(n);
-    }
+    SmallVector<MDOp*, 4> ops;
+    ops.push_back(NULL);
+    if (MDNode* old = L->getLoopID())
+        for (unsigned i = 1; i < old->getNumOperands(); i++)
+            ops.push_back(old->getOperand(i));
+    MDOp* entry[] = { MDString::get(getGlobalContext(), "julia.simdloop"),
+                      MDString::get(getGlobalContext(), blockers) };
+    ops.push_back(MDNode::get(getGlobalContext(), ArrayRef<MDOp*>(entry)));
+    MDNode* n = MDNode::get(getGlobalContext(), ArrayRef<MDOp*>(ops));
+    n->replaceOperandWith(0,n);
+    L->setLoopID(n);
 #else
     MDNode* n = MDNode::get(getGlobalContext(), ArrayRef<Value*>());
     L->getLoopLatch()->getTerminator()->setMetadata("llvm.loop.parallel", n);
@@ -178,13 +281,6 @@ bool LowerSIMDLoop::runOnLoop(Loop *L, LPPassManager &LPM)
                 I->setMetadata("llvm.mem.parallel_loop_access", m);
     assert(L->isAnnotatedParallel());
 
-    // Mark floating-point reductions as okay to reassociate/commute.
-    BasicBlock* Lh = L->getHeader();
-    DEBUG(dbgs() << "LSL: loop header: " << *Lh << "\n");
-    for (BasicBlock::iterator I = Lh->begin(), E = Lh->end(); I!=E; ++I)
-        if (PHINode *Phi = dyn_cast<PHINode>(I))
-            enableUnsafeAlgebraIfReduction(Phi,L);
-
     return true;
 }
 
@@ -198,4 +294,85 @@ JL_DLLEXPORT Pass* createLowerSimdLoopPass() {
     return new LowerSIMDLoop();
 }
 
+/// Pass that reports whether the loops lowered by LowerSIMDLoop were vectorized,
+/// and what kept the others from being vectorized. It runs after the loop
+/// vectorizer, and prints nothing unless enabled by jl_simdloop_report.
+struct SIMDLoopReport: public LoopPass {
+    static char ID;
+    SIMDLoopReport() : LoopPass(ID) {}
+
+    /*override*/ void getAnalysisUsage(AnalysisUsage &AU) const
+    {
+        AU.setPreservesAll();
+    }
+
+private:
+    /*override*/ bool runOnLoop(Loop *, LPPassManager &LPM);
+};
+
+bool SIMDLoopReport::runOnLoop(Loop *L, LPPassManager &LPM)
+{
+    if (!simd_report)
+        return false;
+#ifdef LLVM34
+    MDNode* id = L->getLoopID();
+    if (!id)
+        return false;
+    bool simd = false, vectorized = false;
+    StringRef blockers;
+    for (unsigned i = 1; i < id->getNumOperands(); i++) {
+        MDNode* op = dyn_cast<MDNode>(id->getOperand(i));
+        if (!op || op->getNumOperands() == 0)
+            continue;
+        MDString* key = dyn_cast<MDString>(op->getOperand(0));
+        if (!key)
+            continue;
+        if (key->getString() == "julia.simdloop") {
+            simd = true;
+            if (op->getNumOperands() > 1)
+                if (MDString* b = dyn_cast<MDString>(op->getOperand(1)))
+                    blockers = b->getString();
+        }
+        else if (key->getString() == "llvm.loop.vectorize.width" ||
+                 key->getString() == "llvm.vectorizer.width") {
+            // set by the loop vectorizer on the loops it transformed
+            vectorized = true;
+        }
+    }
+    if (!simd)
+        return false;
+    BasicBlock* Lh = L->getHeader();
+    raw_ostream &os = errs();
+    os << "@simd loop in " << Lh->getParent()->getName();
+    if (unsigned line = Lh->getTerminator()->getDebugLoc().getLine())
+        os << " at line " << line;
+    if (vectorized) {
+        os << " was vectorized\n";
+    }
+    else {
+        os << " was not vectorized";
+        if (!blockers.empty())
+            os << ": " << blockers;
+        os << "\n";
+    }
+#endif
+    return false;
+}
+
+char SIMDLoopReport::ID = 0;
+
+static RegisterPass<SIMDLoopReport> Y("SIMDLoopReport", "SIMDLoopReport Pass",
+                                      true /* Only looks at CFG */,
+                                      true /* Analysis Pass */);
+
+JL_DLLEXPORT Pass* createSimdLoopReportPass() {
+    return new SIMDLoopReport();
+}
+
 } // namespace llvm
+
+// enable or disable the report of SIMDLoopReport on stderr
+extern "C" JL_DLLEXPORT void jl_simdloop_report(int on)
+{
+    llvm::simd_report = on != 0;
+}
@@ -29,9 +29,12 @@ JL_DLLEXPORT jl_module_t *jl_new_module(jl_sym_t *name)
     m->call_func = NULL;
     m->istopmod = 0;
     m->std_imports = 0;
+    m->init_pending = 0;
     m->uuid = uv_now(uv_default_loop());
     htable_new(&m->bindings, 0);
     arraylist_new(&m->usings, 0);
+    htable_new(&m->resolved, 0);
+    m->resolved_age = 0;
     if (jl_core_module) {
         jl_module_using(m, jl_core_module);
     }
@@ -65,6 +68,22 @@ JL_DLLEXPORT uint8_t jl_istopmod(jl_module_t *mod)
     return mod->istopmod;
 }
 
+// jl_get_binding results are cached per module in m->resolved, mapping a
+// symbol to the binding it finally resolves to (possibly in another module).
+// anything that can change where a name resolves (using, import, or a
+// binding's owner being set) bumps binding_cache_age, which lazily empties
+// every module's cache on its next lookup. failed lookups are never cached,
+// since a later definition or import can make them succeed.
+// the caches are read and written under the binding_cache lock; the lookup
+// itself runs outside of it, since it can import and run julia code.
+static volatile size_t binding_cache_age = 1;
+JL_DEFINE_MUTEX(binding_cache)
+
+void jl_invalidate_binding_caches(void)
+{
+    JL_ATOMIC_FETCH_AND_ADD(binding_cache_age, 1);
+}
+
 static jl_binding_t *new_binding(jl_sym_t *name)
 {
     assert(jl_is_symbol(name));
@@ -89,12 +108,14 @@ JL_DLLEXPORT jl_binding_t *jl_get_binding_wr(jl_module_t *m, jl_sym_t *var)
     if (*bp != HT_NOTFOUND) {
         if ((*bp)->owner == NULL) {
             (*bp)->owner = m;
+            jl_invalidate_binding_caches();
             return *bp;
         }
         else if ((*bp)->owner != m) {
             // TODO: change this to an error soon
             jl_printf(JL_STDERR,
                       "WARNING: imported binding for %s overwritten in module %s\n", jl_symbol_name(var), jl_symbol_name(m->name));
+            jl_invalidate_binding_caches();
         }
         else {
             return *bp;
@@ -164,7 +185,10 @@ JL_DLLEXPORT jl_binding_t *jl_get_binding_for_method_def(jl_module_t *m,
             }
             return b2;
         }
-        b->owner = m;
+        if (b->owner == NULL) {
+            b->owner = m;
+            jl_invalidate_binding_caches();
+        }
         return b;
     }
 
@@ -237,14 +261,33 @@ static jl_binding_t *jl_get_binding_(jl_module_t *m, jl_sym_t *var, modstack_t *
 
 JL_DLLEXPORT jl_binding_t *jl_get_binding(jl_module_t *m, jl_sym_t *var)
 {
-    return jl_get_binding_(m, var, NULL);
+    JL_LOCK(binding_cache);
+    size_t age = binding_cache_age;
+    if (m->resolved_age != age) {
+        htable_reset(&m->resolved, 0);
+        m->resolved_age = age;
+    }
+    jl_binding_t *b = (jl_binding_t*)ptrhash_get(&m->resolved, var);
+    JL_UNLOCK(binding_cache);
+    if (b != HT_NOTFOUND)
+        return b;
+    b = jl_get_binding_(m, var, NULL);
+    if (b != NULL) {
+        // don't cache if something invalidated the caches in the meantime,
+        // possibly the lookup itself by importing
+        JL_LOCK(binding_cache);
+        if (m->resolved_age == age && binding_cache_age == age)
+            ptrhash_put(&m->resolved, var, b);
+        JL_UNLOCK(binding_cache);
+    }
+    return b;
 }
 
 void jl_binding_deprecation_warning(jl_binding_t *b);
 
 JL_DLLEXPORT jl_binding_t *jl_get_binding_or_error(jl_module_t *m, jl_sym_t *var)
 {
-    jl_binding_t *b = jl_get_binding_(m, var, NULL);
+    jl_binding_t *b = jl_get_binding(m, var);
     if (b == NULL)
         jl_undefined_var_error(var);
     if (b->deprecated)
@@ -333,6 +376,7 @@ static void module_import_(jl_module_t *to, jl_module_t *from, jl_sym_t *s,
             else {
                 bto->owner = b->owner;
                 bto->imported = (explici!=0);
+                jl_invalidate_binding_caches();
             }
         }
         else {
@@ -402,6 +446,7 @@ JL_DLLEXPORT void jl_module_using(jl_module_t *to, jl_module_t *from)
     }
 
     arraylist_push(&to->usings, from);
+    jl_invalidate_binding_caches();
 }
 
 JL_DLLEXPORT void jl_module_export(jl_module_t *from, jl_sym_t *s)
@@ -453,6 +498,21 @@ JL_DLLEXPORT jl_value_t *jl_get_global(jl_module_t *m, jl_sym_t *var)
     return b->value;
 }
 
+// jl_get_global for a read by running code (the interpreter and getfield),
+// which is a safe point to run the pending __init__ of the binding's owner.
+// lookups from codegen and inference must not run it, so jl_get_global
+// doesn't, and neither do the reads of jl_interpret_toplevel_expr_in
+jl_value_t *jl_get_global_init(jl_module_t *m, jl_sym_t *var)
+{
+    jl_binding_t *b = jl_get_binding(m, var);
+    if (b == NULL) return NULL;
+    if (b->owner != NULL && b->owner->init_pending &&
+        !jl_get_ptls_states()->in_static_eval)
+        jl_module_run_pending_initializer(b->owner);
+    if (b->deprecated) jl_binding_deprecation_warning(b);
+    return b->value;
+}
+
 JL_DLLEXPORT void jl_set_global(jl_module_t *m, jl_sym_t *var, jl_value_t *val)
 {
     jl_binding_t *bp = jl_get_binding_wr(m, var);
@@ -622,8 +682,10 @@ JL_DLLEXPORT void jl_module_run_initializer(jl_module_t *m)
     jl_function_t *f = jl_module_get_initializer(m);
     if (f == NULL)
         return;
+    uint64_t t0 = jl_startup_tracing ? jl_hrtime() : 0;
     JL_TRY {
         jl_apply(f, NULL, 0);
+        jl_startup_trace_since("__init__", jl_symbol_name(m->name), t0);
     }
     JL_CATCH {
         if (jl_initerror_type == NULL) {
@@ -636,6 +698,43 @@ JL_DLLEXPORT void jl_module_run_initializer(jl_module_t *m)
     }
 }
 
+// lazy init mode (see LAZY_MODULE_INIT_NAME): instead of running __init__
+// now, mark the module so that the first read of one of its bindings by
+// running code runs it: jl_get_global_init for the interpreter and
+// getfield, and a call emitted by global_binding_pointer in code compiled
+// while the mark is set.
+void jl_module_defer_initializer(jl_module_t *m)
+{
+    if (jl_module_get_initializer(m) == NULL)
+        return;
+    m->init_pending = 1;
+}
+
+// the first thread to get here runs the initializer, the others wait for it
+// to finish. its own reads land here again meanwhile, and see 2
+JL_DEFINE_MUTEX(module_init)
+JL_DLLEXPORT void jl_module_run_pending_initializer(jl_module_t *m)
+{
+    if (!m->init_pending)
+        return;
+    // __init__ allocates
+    JL_LOCK_SAFEPOINT(module_init);
+    if (m->init_pending == 1) {
+        m->init_pending = 2;
+        JL_TRY {
+            jl_module_run_initializer(m);
+        }
+        JL_CATCH {
+            m->init_pending = 0;
+            JL_UNLOCK(module_init);
+            jl_rethrow();
+        }
+        JL_ATOMIC_FENCE();
+        m->init_pending = 0;
+    }
+    JL_UNLOCK(module_init);
+}
+
 jl_function_t *jl_module_call_func(jl_module_t *m)
 {
     if (m->call_func == NULL) {
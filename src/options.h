@@ -12,9 +12,25 @@
 // object layout options ------------------------------------------------------
 
 // how much space we're willing to waste if an array outgrows its
-// original object
+// original object. bigger data is malloc'd, cache-line aligned
 #define ARRAY_INLINE_NBYTES (2048*sizeof(void*))
 
+// alignment of malloc'd array data
+#define ARRAY_MALLOC_ALIGN 64
+
+// arrays growing at the end double their capacity until it reaches this many
+// bytes, then grow it by half
+#define ARRAY_GROW_SLOW_NBYTES (16*1024*1024)
+
+// byte arrays of at least this many bytes restored from the system image or
+// a cache file point into the (copy-on-write mapped) file data instead of
+// being copied
+#define MAPPED_SHARE_NBYTES 256
+
+// with this set to a directory, the parsed forms of the files loaded are
+// cached there (see jl_load_cached)
+#define AST_CACHE_DIR_NAME "JULIA_AST_CACHE"
+
 // codegen options ------------------------------------------------------------
 
 // (Experimental) Use MCJIT ELF, even where it's not the native format
@@ -23,8 +39,92 @@
 // with KEEP_BODIES, we keep LLVM function bodies around for later debugging
 // #define KEEP_BODIES
 
+// with --compile=tiered, a method without loops is run in the interpreter
+// this many times before it gets compiled
+#define TIERED_COMPILE_CALLS 8
+
+// with this set to 1 along with --compile=tiered, the interpreter records the
+// argument types of the generic function calls and the branches taken of the
+// methods it runs, and codegen uses them when it compiles the methods: a call
+// made with one signature at least TYPE_FEEDBACK_DOMINANT percent of the time
+// gets a guarded direct call to the method of that signature, and the
+// branches get weights. it has no effect with JULIA_NUM_THREADS above 1
+#define TYPE_FEEDBACK_NAME "JULIA_TYPE_FEEDBACK"
+#define TYPE_FEEDBACK_DOMINANT 90
+
+// code with loops is compiled instead of interpreted when it is estimated
+// to run more than this many statements. a loop runs its statements once
+// per iteration, and has INTERP_LOOP_TRIPS iterations unless it goes over a
+// range of literal integers (`for i = 1:3`); the trips of nested loops
+// multiply
+#define INTERP_MAX_STMTS 2000
+#define INTERP_LOOP_TRIPS 1000
+
 // GC options -----------------------------------------------------------------
 
+// lazy sweeping: let the allocator sweep the pool pages that only
+// contain old objects instead of doing it in the collection pause
+#define GC_LAZY_SWEEP_NAME              "JULIA_GC_LAZY_SWEEP"
+#define DEFAULT_GC_LAZY_SWEEP           0
+
+// incremental marking: the mark pause budget in microseconds, marking is
+// split across several collections when it takes longer (0 = no limit)
+#define GC_PAUSE_BUDGET_NAME            "JULIA_GC_PAUSE_BUDGET"
+#define DEFAULT_GC_PAUSE_BUDGET         0
+
+// free pool pages are given back to the OS once they stayed free for this
+// many milliseconds (0 = as soon as they are freed)
+#define GC_DECOMMIT_DELAY_NAME          "JULIA_GC_DECOMMIT_DELAY"
+#define DEFAULT_GC_DECOMMIT_DELAY       1000
+
+// in threaded builds, stop the threads of a region for a collection by making
+// the page compiled code polls unreadable (0 to only stop them at allocations)
+#define GC_SIGNAL_SAFEPOINTS_NAME       "JULIA_GC_SIGNAL_SAFEPOINTS"
+#define DEFAULT_GC_SIGNAL_SAFEPOINTS    1
+// a thread stopped at a safepoint takes part in the collection on its signal
+// stack, which must have room for marking
+#define GC_SAFEPOINT_STACK_SIZE         (1 << 20)
+
+// back the pool regions with transparent huge pages where available
+#define GC_HUGE_PAGES_NAME              "JULIA_GC_HUGE_PAGES"
+#define DEFAULT_GC_HUGE_PAGES           0
+
+// blocks of at least this many bytes, for array data or big objects, are
+// mapped directly instead of malloc'd. they start on a huge page boundary
+// and are backed by huge pages too when JULIA_GC_HUGE_PAGES is set
+#define GC_MAP_MIN_NBYTES               (4*1024*1024)
+
+// soft limit of the heap size in bytes, collections get full and more
+// frequent when the heap gets close to it. without it, the limit is this
+// percentage of the memory limit of the cgroup of the process, if any
+#define GC_HEAP_LIMIT_NAME              "JULIA_GC_HEAP_LIMIT"
+#define DEFAULT_GC_CGROUP_HEAP_PCT      75
+
+// at most this many bytes of freed big objects and array buffers are kept
+// around to be reused by allocations of the same size class. like the free
+// pages, they are freed once unused for the decommit delay
+#define GC_BIG_CACHE_NAME               "JULIA_GC_BIG_CACHE"
+#define DEFAULT_GC_BIG_CACHE            (256*1024*1024)
+
+// field lookup ---------------------------------------------------------------
+
+// types with at least this many fields get a hash table from field name to
+// index (built on the first lookup by name) instead of a linear search
+#define FIELD_INDEX_MIN_FIELDS          16
+
+// box caches -----------------------------------------------------------------
+
+// boxes of the Int64 values in [-NBOX_INT64_C/2, NBOX_INT64_C/2) and of the
+// UInt64 values in [0, NBOX_INT64_C) are preallocated, so that boxing them
+// (e.g. loop indices in type-unstable code) doesn't allocate. the boxes are
+// referenced from generated code, so changing it requires rebuilding the
+// system image
+#define NBOX_INT64_C                    8192
+
+// the same for the Float64 values that are integers in
+// [-NBOX_FLOAT64_C/2, NBOX_FLOAT64_C/2), but not -0.0
+#define NBOX_FLOAT64_C                  256
+
 // debugging options
 
 // with MEMDEBUG, every object is allocated explicitly with malloc, and
@@ -63,6 +163,40 @@
 // OBJPROFILE counts objects by type
 //#define OBJPROFILE
 
+// with this set (to anything but 0), the time spent in each phase of
+// startup and in each module __init__ is printed to stderr
+#define STARTUP_TRACE_NAME              "JULIA_STARTUP_TRACE"
+
+// with this set to "once", --code-coverage only records that a line ran
+// (a 1 in the .cov files) instead of counting its executions, which takes a
+// store instead of a load and an add
+#define COVERAGE_MODE_NAME              "JULIA_COVERAGE_MODE"
+
+// jl_hrtime reads the TSC on x86 cpus where its rate is invariant, after
+// measuring that rate against the OS clock for this long (in ns), with
+// paired readings of both clocks that each take the best of HRTIME_SAMPLES
+// tries. the rate is measured again every HRTIME_RECHECK_NS, and the clock
+// is slewed by up to HRTIME_MAX_SLEW of its rate to meet the OS clock.
+// setting the variable to 0 keeps it on the OS clock
+#define HRTIME_TSC_NAME                 "JULIA_HRTIME_TSC"
+#define HRTIME_CALIBRATION_NS           100000000
+#define HRTIME_SAMPLES                  5
+#define HRTIME_RECHECK_NS               1e9
+#define HRTIME_MAX_SLEW                 1e-3
+
+// with this set (to anything but 0), the __init__ of modules loaded from
+// precompile files runs when running code first reads one of their
+// bindings, instead of at load time. lookups made by inference and codegen
+// don't count. modules never touched are never initialized.
+#define LAZY_MODULE_INIT_NAME           "JULIA_LAZY_INIT"
+
+// backtraces -------------------------------------------------------------------
+
+// at most this many frames are recorded for the backtrace of a thrown
+// exception and for each profile sample. by default all of them are, up to
+// JL_MAX_BT_SIZE, which makes throwing out of deep recursion expensive
+#define BT_MAX_DEPTH_NAME               "JULIA_BT_MAX_DEPTH"
+
 
 // method dispatch profiling --------------------------------------------------
 
@@ -77,33 +211,86 @@
 // sites). this generally prints too much output to be useful.
 //#define JL_TRACE
 
-// count generic (not inlined or specialized) calls to each function. recorded
-// in the `ncalls` field of jl_methtable_t.
-//#define JL_GF_PROFILE
-
 
 // task options ---------------------------------------------------------------
 
 // select an implementation of stack switching.
-// currently only COPY_STACKS is recommended.
-#ifndef COPY_STACKS
+// COPY_STACKS runs every task on the thread's stack, saving and restoring the
+// live part of it on each switch. with POOLED_STACKS each task gets its own
+// stack, with a guard page below it, and a switch is just a longjmp.
+// COPY_STACKS is the default; JULIA_POOLED_STACKS=1 in Make.user selects
+// POOLED_STACKS, which CI also builds and tests.
+//#define POOLED_STACKS
+
+#if !defined(COPY_STACKS) && !defined(POOLED_STACKS)
 #define COPY_STACKS
 #endif
 
+#if defined(COPY_STACKS) && defined(POOLED_STACKS)
+#error "COPY_STACKS and POOLED_STACKS are mutually exclusive"
+#endif
+
+// POOLED_STACKS: size of a task stack when none is given, and how many
+// stacks of that size are kept for reuse once their task is done
+#define DEFAULT_TASK_STACK_SIZE  (1024*1024)
+#define TASK_STACK_POOL_SIZE     64
+
 // threading options ----------------------------------------------------------
 
 // controls for when threads sleep
 #define THREAD_SLEEP_THRESHOLD_NAME     "JULIA_THREAD_SLEEP_THRESHOLD"
 #define DEFAULT_THREAD_SLEEP_THRESHOLD  1e9    // cycles (1e9==1sec@1GHz)
+// "adaptive" (the default): a thread spins for about as long as its recent
+// waits for a fork took, and sleeps right away when those were longer than
+// the threshold; "fixed": it always spins up to the threshold
+#define THREAD_SLEEP_POLICY_NAME        "JULIA_THREAD_SLEEP_POLICY"
+#define THREAD_SPIN_MIN                 1e5    // cycles the adaptive policy spins at least
+
+// fork/join tree: how many threads each thread releases and waits for
+#define THREAD_FANOUT_NAME              "JULIA_THREAD_FANOUT"
+#define DEFAULT_THREAD_FANOUT           4
 
 // defaults for # threads
 #define NUM_THREADS_NAME                "JULIA_NUM_THREADS"
 #define DEFAULT_NUM_THREADS             4
 
+// slots kept for threads of an embedding program that call into julia
+// (see jl_adopt_thread)
+#define MAX_FOREIGN_THREADS_NAME        "JULIA_MAX_FOREIGN_THREADS"
+#define DEFAULT_MAX_FOREIGN_THREADS     16
+
+// number of partitions (and threads) used to emit the system image object;
+// they also optimize the functions jl_compile_all adds (see jl_defer_function_passes)
+#define IMAGE_THREADS_NAME              "JULIA_IMAGE_THREADS"
+#define DEFAULT_IMAGE_THREADS           1
+
 // affinitization behavior
 #define MACHINE_EXCLUSIVE_NAME          "JULIA_EXCLUSIVE"
 #define DEFAULT_MACHINE_EXCLUSIVE       0
 
+// where to pin the threads: "compact" (fill a socket, SMT siblings next to
+// each other, before the next one), "spread" (as many threads on each socket,
+// on distinct cores first), or a list of cpus like "0,2,8-11". without it,
+// JULIA_EXCLUSIVE=1 pins thread i to cpu i
+#define THREAD_AFFINITY_NAME            "JULIA_THREAD_AFFINITY"
+
+// whether the threads share the mark phase of the garbage collector
+#define GC_PARALLEL_MARK_NAME           "JULIA_GC_PARALLEL_MARK"
+#define DEFAULT_GC_PARALLEL_MARK        0
+
+// with JL_CODEGEN_TLS defined (JULIA_CODEGEN_TLS=1 in Make.user), keep the
+// thread-local state in an initial-exec TLS variable of libjulia, so the
+// runtime and the getter used by generated code read it directly instead of
+// calling through the function pointer installed by
+// `jl_set_ptls_states_getter`. This is opt-in: the state holds the
+// backtrace buffer (bt_data, 640kB on 64-bit), which then has to fit in the
+// static TLS block of every thread, and a libjulia loaded with dlopen
+// usually can't get that much.
+#if defined(JULIA_ENABLE_THREADING) && defined(JL_CODEGEN_TLS) && \
+    defined(__linux__) && (defined(__x86_64__) || defined(__i386__) || defined(__aarch64__))
+#  define CODEGEN_TLS
+#endif
+
 // sanitizer defaults ---------------------------------------------------------
 
 // Automatically enable MEMDEBUG and KEEP_BODIES for the sanitizers
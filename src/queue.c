@@ -0,0 +1,282 @@
+// This file is a part of Julia. License is MIT: http://julialang.org/license
+
+/*
+  bounded multi-producer multi-consumer queue of julia values
+  . the cells carry sequence numbers, a producer or consumer claims one by
+    advancing the queue's position with a compare-and-swap and publishes it
+    by advancing the cell's sequence number (Vyukov's bounded queue)
+  . the values queued are roots of the collector, every queue is registered
+  . threads that wait for room or for a value spin, then park on the queue
+*/
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "julia.h"
+#include "julia_internal.h"
+#include "options.h"
+#ifdef JULIA_ENABLE_THREADING
+#include "threading.h"
+#include "ia_misc.h"
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct {
+    volatile size_t seq;
+    jl_value_t *volatile value;
+} jl_queue_cell_t;
+
+struct _jl_queue_t {
+    jl_queue_cell_t *cells;
+    size_t mask;
+    size_t index;               // in the registry
+
+    // the positions the producers and consumers claim, on cache lines of
+    // their own
+    uint8_t pad0[64];
+    volatile size_t push_pos;
+    uint8_t pad1[64 - sizeof(size_t)];
+    volatile size_t pop_pos;
+    uint8_t pad2[64 - sizeof(size_t)];
+
+    // bumped to wake the threads parked on it
+    volatile int epoch;
+    volatile int nparked;
+};
+
+static arraylist_t queues;
+JL_DEFINE_MUTEX(queues)
+
+#if defined(JULIA_ENABLE_THREADING)
+#define queue_fence() cpu_mfence()
+#else
+#define queue_fence() JL_ATOMIC_FENCE()
+#endif
+
+JL_DLLEXPORT jl_queue_t *jl_queue_new(size_t capacity)
+{
+    if (capacity < 2)
+        capacity = 2;
+    size_t n = 2;
+    while (n < capacity) {
+        n <<= 1;
+        if (n == 0)
+            jl_error("queue capacity too large");
+    }
+    jl_queue_t *q = (jl_queue_t*)malloc(sizeof(jl_queue_t));
+    if (q == NULL)
+        jl_throw(jl_memory_exception);
+    memset(q, 0, sizeof(jl_queue_t));
+    q->cells = (jl_queue_cell_t*)malloc(n * sizeof(jl_queue_cell_t));
+    if (q->cells == NULL) {
+        free(q);
+        jl_throw(jl_memory_exception);
+    }
+    for (size_t i = 0; i < n; i++) {
+        q->cells[i].seq = i;
+        q->cells[i].value = NULL;
+    }
+    q->mask = n - 1;
+    JL_LOCK_SAFEPOINT(queues);
+    if (queues.items == NULL)
+        arraylist_new(&queues, 0);
+    q->index = queues.len;
+    arraylist_push(&queues, q);
+    JL_UNLOCK(queues);
+    return q;
+}
+
+// the values still queued are dropped
+JL_DLLEXPORT void jl_queue_free(jl_queue_t *q)
+{
+    JL_LOCK_SAFEPOINT(queues);
+    jl_queue_t *last = (jl_queue_t*)arraylist_pop(&queues);
+    if (last != q) {
+        queues.items[q->index] = last;
+        last->index = q->index;
+    }
+    JL_UNLOCK(queues);
+    free(q->cells);
+    free(q);
+}
+
+JL_DLLEXPORT size_t jl_queue_capacity(jl_queue_t *q)
+{
+    return q->mask + 1;
+}
+
+// a snapshot, other threads may be pushing and popping
+JL_DLLEXPORT size_t jl_queue_length(jl_queue_t *q)
+{
+    size_t pop = q->pop_pos;
+    size_t push = q->push_pos;
+    return push > pop ? push - pop : 0;
+}
+
+static void queue_wake(jl_queue_t *q)
+{
+    queue_fence();
+    if (q->nparked > 0) {
+        JL_ATOMIC_FETCH_AND_ADD(q->epoch, 1);
+#ifdef JULIA_ENABLE_THREADING
+        ti_threadgroup_unpark(tgworld, &q->epoch);
+#endif
+    }
+}
+
+JL_DLLEXPORT int jl_queue_trypush(jl_queue_t *q, jl_value_t *v)
+{
+    assert(v != NULL);
+    jl_queue_cell_t *cell;
+    size_t pos = q->push_pos;
+    for (;;) {
+        cell = &q->cells[pos & q->mask];
+        size_t seq = cell->seq;
+        intptr_t dif = (intptr_t)seq - (intptr_t)pos;
+        if (dif == 0) {
+            if (JL_ATOMIC_COMPARE_AND_SWAP(q->push_pos, pos, pos + 1))
+                break;
+            pos = q->push_pos;
+        }
+        else if (dif < 0) {
+            return 0;   // full
+        }
+        else {
+            pos = q->push_pos;
+        }
+    }
+    cell->value = v;
+    queue_fence();
+    cell->seq = pos + 1;
+    queue_wake(q);
+    return 1;
+}
+
+// NULL if the queue is empty
+JL_DLLEXPORT jl_value_t *jl_queue_trypop(jl_queue_t *q)
+{
+    jl_queue_cell_t *cell;
+    size_t pos = q->pop_pos;
+    for (;;) {
+        cell = &q->cells[pos & q->mask];
+        size_t seq = cell->seq;
+        intptr_t dif = (intptr_t)seq - (intptr_t)(pos + 1);
+        if (dif == 0) {
+            if (JL_ATOMIC_COMPARE_AND_SWAP(q->pop_pos, pos, pos + 1))
+                break;
+            pos = q->pop_pos;
+        }
+        else if (dif < 0) {
+            return NULL;    // empty
+        }
+        else {
+            pos = q->pop_pos;
+        }
+    }
+    jl_value_t *v = cell->value;
+    cell->value = NULL;
+    queue_fence();
+    cell->seq = pos + q->mask + 1;
+    queue_wake(q);
+    return v;
+}
+
+JL_DLLEXPORT jl_value_t *jl_queue_trypop_default(jl_queue_t *q, jl_value_t *dflt)
+{
+    jl_value_t *v = jl_queue_trypop(q);
+    return v == NULL ? dflt : v;
+}
+
+// wait for a push of v (or a pop into *popped, if v is NULL) to succeed:
+// spin for a while, then park on the queue. the threads of a region take
+// part in the collections meanwhile. returns 1 if it made the push or pop
+#ifdef JULIA_ENABLE_THREADING
+static int queue_wait(jl_queue_t *q, jl_value_t *v, jl_value_t **popped, uint64_t *spin_start)
+{
+    jl_gc_safepoint();
+    if (tgworld == NULL || tgworld->sleep_threshold == 0 ||
+        rdtsc() - *spin_start < THREAD_SPIN_MIN) {
+        cpu_pause();
+        return 0;
+    }
+    JL_ATOMIC_FETCH_AND_ADD(q->nparked, 1);
+    int epoch = q->epoch;
+    queue_fence();
+    // a push or pop made before nparked went up did not bump the epoch, so
+    // try again before parking or it could never wake us
+    int done = v != NULL ? jl_queue_trypush(q, v) : (*popped = jl_queue_trypop(q)) != NULL;
+    // a collection that starts now bumps the epoch of the queues with
+    // parked threads, which stops the park
+    if (!done && !jl_gc_running)
+        ti_threadgroup_park(tgworld, &q->epoch, epoch);
+    JL_ATOMIC_FETCH_AND_ADD(q->nparked, -1);
+    *spin_start = rdtsc();
+    return done;
+}
+#endif
+
+JL_DLLEXPORT void jl_queue_push(jl_queue_t *q, jl_value_t *v)
+{
+#ifdef JULIA_ENABLE_THREADING
+    uint64_t spin_start = rdtsc();
+    while (!jl_queue_trypush(q, v)) {
+        if (queue_wait(q, v, NULL, &spin_start))
+            break;
+    }
+#else
+    if (!jl_queue_trypush(q, v))
+        jl_error("push: queue is full and no thread can empty it");
+#endif
+}
+
+JL_DLLEXPORT jl_value_t *jl_queue_pop(jl_queue_t *q)
+{
+    jl_value_t *v;
+#ifdef JULIA_ENABLE_THREADING
+    uint64_t spin_start = rdtsc();
+    while ((v = jl_queue_trypop(q)) == NULL) {
+        if (queue_wait(q, NULL, &v, &spin_start))
+            break;
+    }
+#else
+    if ((v = jl_queue_trypop(q)) == NULL)
+        jl_error("pop: queue is empty and no thread can fill it");
+#endif
+    return v;
+}
+
+// run by the collector once it has set jl_gc_running
+void jl_gc_wake_queues(void)
+{
+    JL_LOCK(queues);
+    for (size_t i = 0; i < queues.len; i++) {
+        jl_queue_t *q = (jl_queue_t*)queues.items[i];
+        if (q->nparked > 0) {
+            JL_ATOMIC_FETCH_AND_ADD(q->epoch, 1);
+#ifdef JULIA_ENABLE_THREADING
+            ti_threadgroup_unpark(tgworld, &q->epoch);
+#endif
+        }
+    }
+    JL_UNLOCK(queues);
+}
+
+// the values queued, for the collector to mark with all the threads stopped
+void jl_gc_queued_values(void (*f)(jl_value_t*))
+{
+    for (size_t i = 0; i < queues.len; i++) {
+        jl_queue_t *q = (jl_queue_t*)queues.items[i];
+        for (size_t j = 0; j <= q->mask; j++) {
+            jl_value_t *v = q->cells[j].value;
+            if (v != NULL)
+                f(v);
+        }
+    }
+}
+
+#ifdef __cplusplus
+}
+#endif
@@ -118,13 +118,52 @@ void *jl_get_library(const char *f_lib)
     return hnd;
 }
 
+// process-wide cache of resolved (library handle, symbol name) pairs, shared
+// by every ccall site so each symbol only goes through dlsym once
+static std::map<std::pair<void*, std::string>, void*> symMap;
+JL_DEFINE_MUTEX(symcache)
+
+extern "C"
+void *jl_dlsym_cached(void *handle, const char *f_name, int throw_err)
+{
+    std::pair<void*, std::string> key(handle, f_name);
+    void *ptr = NULL;
+    JL_LOCK(symcache);
+    std::map<std::pair<void*, std::string>, void*>::iterator it = symMap.find(key);
+    if (it != symMap.end())
+        ptr = it->second;
+    JL_UNLOCK(symcache);
+    if (ptr != NULL)
+        return ptr;
+    ptr = throw_err ? jl_dlsym(handle, f_name) : jl_dlsym_e(handle, f_name);
+    if (ptr != NULL) {
+        JL_LOCK(symcache);
+        symMap[key] = ptr;
+        JL_UNLOCK(symcache);
+    }
+    return ptr;
+}
+
+// drop the symbols of a library that is being closed, whose handle may be
+// given to another library afterwards
+extern "C"
+void jl_dlsym_cache_forget(void *handle)
+{
+    JL_LOCK(symcache);
+    std::map<std::pair<void*, std::string>, void*>::iterator it =
+        symMap.lower_bound(std::make_pair(handle, std::string()));
+    while (it != symMap.end() && it->first.first == handle)
+        symMap.erase(it++);
+    JL_UNLOCK(symcache);
+}
+
 extern "C" JL_DLLEXPORT
 void *jl_load_and_lookup(const char *f_lib, const char *f_name, void **hnd)
 {
     void *handle = *hnd;
     if (!handle)
         *hnd = handle = jl_get_library(f_lib);
-    return jl_dlsym(handle, f_name);
+    return jl_dlsym_cached(handle, f_name, 1);
 }
 
 // miscellany
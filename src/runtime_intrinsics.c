@@ -71,6 +71,245 @@ JL_DLLEXPORT jl_value_t *jl_pointerset(jl_value_t *p, jl_value_t *x, jl_value_t
     return p;
 }
 
+// run time versions of the atomic pointer intrinsics. the element type is an
+// isbits type of 1, 2, 4 or 8 bytes, accessed as the unsigned integer of
+// that size, and the memory order a Symbol named after the LLVM ordering
+#if defined(__GNUC__)
+static int atomic_order(const char *fname, jl_value_t *order, int isload, int isstore)
+{
+    if (!jl_is_symbol(order))
+        jl_type_error(fname, (jl_value_t*)jl_sym_type, order);
+    const char *o = jl_symbol_name((jl_sym_t*)order);
+    if (!strcmp(o, "sequentially_consistent"))
+        return __ATOMIC_SEQ_CST;
+    if (!strcmp(o, "monotonic"))
+        return __ATOMIC_RELAXED;
+    if (!strcmp(o, "acquire") && !isstore)
+        return __ATOMIC_ACQUIRE;
+    if (!strcmp(o, "release") && !isload)
+        return __ATOMIC_RELEASE;
+    if (!strcmp(o, "acquire_release") && !isload && !isstore)
+        return __ATOMIC_ACQ_REL;
+    jl_errorf("%s: invalid atomic ordering %s", fname, o);
+    return 0;
+}
+
+// the strongest ordering a failed compare-and-swap may have
+static int atomic_failure_order(int order)
+{
+    if (order == __ATOMIC_ACQ_REL)
+        return __ATOMIC_ACQUIRE;
+    if (order == __ATOMIC_RELEASE)
+        return __ATOMIC_RELAXED;
+    return order;
+}
+
+static char *atomic_pointer(const char *fname, jl_value_t *p, jl_datatype_t **pety)
+{
+    if (!jl_is_cpointer(p))
+        jl_type_error(fname, (jl_value_t*)jl_pointer_type, p);
+    jl_value_t *ety = jl_tparam0(jl_typeof(p));
+    if (!jl_is_datatype(ety) || !jl_isbits(ety))
+        jl_errorf("%s: invalid pointer type", fname);
+    size_t nb = jl_datatype_size(ety);
+    if (nb != 1 && nb != 2 && nb != 4 && nb != 8)
+        jl_errorf("%s: no atomic operations on %d-byte values", fname, (int)nb);
+    char *pp = (char*)jl_unbox_voidpointer(p);
+    if ((uintptr_t)pp % nb != 0)
+        jl_errorf("%s: pointer not aligned to the size of its element", fname);
+    *pety = (jl_datatype_t*)ety;
+    return pp;
+}
+
+static uint64_t atomic_value_bits(const char *fname, jl_datatype_t *ety, jl_value_t *x)
+{
+    if (jl_typeof(x) != (jl_value_t*)ety)
+        jl_errorf("%s: type mismatch in assign", fname);
+    uint64_t bits = 0;
+    memcpy(&bits, jl_data_ptr(x), jl_datatype_size(ety));
+    return bits;
+}
+
+static jl_value_t *atomic_box_bits(jl_datatype_t *ety, uint64_t bits)
+{
+    if (ety == jl_bool_type)
+        return bits & 1 ? jl_true : jl_false;
+    return jl_new_bits((jl_value_t*)ety, &bits);
+}
+
+static uint64_t atomic_load_bits(char *pp, size_t nb, int order)
+{
+    switch (nb) {
+    case 1: return __atomic_load_n((uint8_t*)pp, order);
+    case 2: return __atomic_load_n((uint16_t*)pp, order);
+    case 4: return __atomic_load_n((uint32_t*)pp, order);
+    default: return __atomic_load_n((uint64_t*)pp, order);
+    }
+}
+
+static void atomic_store_bits(char *pp, size_t nb, uint64_t bits, int order)
+{
+    switch (nb) {
+    case 1: __atomic_store_n((uint8_t*)pp, (uint8_t)bits, order); break;
+    case 2: __atomic_store_n((uint16_t*)pp, (uint16_t)bits, order); break;
+    case 4: __atomic_store_n((uint32_t*)pp, (uint32_t)bits, order); break;
+    default: __atomic_store_n((uint64_t*)pp, bits, order); break;
+    }
+}
+
+// on failure, *expected is set to the value found
+static int atomic_cas_bits(char *pp, size_t nb, uint64_t *expected, uint64_t bits, int order)
+{
+    int fail = atomic_failure_order(order);
+    int ok;
+    switch (nb) {
+    case 1: {
+        uint8_t e = (uint8_t)*expected;
+        ok = __atomic_compare_exchange_n((uint8_t*)pp, &e, (uint8_t)bits, 0, order, fail);
+        *expected = e;
+        break;
+    }
+    case 2: {
+        uint16_t e = (uint16_t)*expected;
+        ok = __atomic_compare_exchange_n((uint16_t*)pp, &e, (uint16_t)bits, 0, order, fail);
+        *expected = e;
+        break;
+    }
+    case 4: {
+        uint32_t e = (uint32_t)*expected;
+        ok = __atomic_compare_exchange_n((uint32_t*)pp, &e, (uint32_t)bits, 0, order, fail);
+        *expected = e;
+        break;
+    }
+    default:
+        ok = __atomic_compare_exchange_n((uint64_t*)pp, expected, bits, 0, order, fail);
+        break;
+    }
+    return ok;
+}
+
+static int64_t atomic_sext_bits(uint64_t bits, size_t nb)
+{
+    int shift = 64 - 8*nb;
+    return (int64_t)(bits << shift) >> shift;
+}
+
+static uint64_t atomic_zext_bits(uint64_t bits, size_t nb)
+{
+    return nb == 8 ? bits : bits & (((uint64_t)1 << 8*nb) - 1);
+}
+
+JL_DLLEXPORT jl_value_t *jl_atomic_pointerref(jl_value_t *p, jl_value_t *order)
+{
+    jl_datatype_t *ety;
+    char *pp = atomic_pointer("atomic_pointerref", p, &ety);
+    int o = atomic_order("atomic_pointerref", order, 1, 0);
+    return atomic_box_bits(ety, atomic_load_bits(pp, jl_datatype_size(ety), o));
+}
+
+JL_DLLEXPORT jl_value_t *jl_atomic_pointerset(jl_value_t *p, jl_value_t *x, jl_value_t *order)
+{
+    jl_datatype_t *ety;
+    char *pp = atomic_pointer("atomic_pointerset", p, &ety);
+    int o = atomic_order("atomic_pointerset", order, 0, 1);
+    uint64_t bits = atomic_value_bits("atomic_pointerset", ety, x);
+    atomic_store_bits(pp, jl_datatype_size(ety), bits, o);
+    return p;
+}
+
+// returns the value found at p, which is replaced by x if it equals cmp
+JL_DLLEXPORT jl_value_t *jl_atomic_pointercas(jl_value_t *p, jl_value_t *cmp, jl_value_t *x,
+                                              jl_value_t *order)
+{
+    jl_datatype_t *ety;
+    char *pp = atomic_pointer("atomic_pointercas", p, &ety);
+    int o = atomic_order("atomic_pointercas", order, 0, 0);
+    uint64_t expected = atomic_value_bits("atomic_pointercas", ety, cmp);
+    uint64_t bits = atomic_value_bits("atomic_pointercas", ety, x);
+    atomic_cas_bits(pp, jl_datatype_size(ety), &expected, bits, o);
+    return atomic_box_bits(ety, expected);
+}
+
+// returns the value found at p, which is replaced by `op(old, x)`
+JL_DLLEXPORT jl_value_t *jl_atomic_pointerrmw(jl_value_t *p, jl_value_t *op, jl_value_t *x,
+                                              jl_value_t *order)
+{
+    jl_datatype_t *ety;
+    char *pp = atomic_pointer("atomic_pointerrmw", p, &ety);
+    int o = atomic_order("atomic_pointerrmw", order, 0, 0);
+    JL_TYPECHK(atomic_pointerrmw, symbol, op);
+    const char *opname = jl_symbol_name((jl_sym_t*)op);
+    size_t nb = jl_datatype_size(ety);
+    uint64_t v = atomic_value_bits("atomic_pointerrmw", ety, x);
+    int isbool = ety == jl_bool_type;
+    // the bitstypes codegen represents as LLVM integers
+    int isint = !isbool && jl_is_bitstype(ety) && !jl_is_cpointer_type((jl_value_t*)ety) &&
+        !jl_subtype((jl_value_t*)ety, (jl_value_t*)jl_floatingpoint_type, 0);
+    int issigned = isint && jl_subtype((jl_value_t*)ety, (jl_value_t*)jl_signed_type, 0);
+    int k;
+    if (!strcmp(opname, "xchg"))
+        k = 0;
+    else if (!strcmp(opname, "and") && (isint || isbool))
+        k = 1;
+    else if (!strcmp(opname, "or") && (isint || isbool))
+        k = 2;
+    else if (!strcmp(opname, "xor") && (isint || isbool))
+        k = 3;
+    else if (!strcmp(opname, "nand") && isint)
+        k = 4;
+    else if (!strcmp(opname, "add") && isint)
+        k = 5;
+    else if (!strcmp(opname, "sub") && isint)
+        k = 6;
+    else if (!strcmp(opname, "max") && isint)
+        k = 7;
+    else if (!strcmp(opname, "min") && isint)
+        k = 8;
+    else
+        jl_errorf("atomic_pointerrmw: invalid operation %s on %s", opname,
+                  jl_symbol_name(ety->name->name));
+    uint64_t old = atomic_load_bits(pp, nb, __ATOMIC_RELAXED);
+    uint64_t new;
+    do {
+        switch (k) {
+        case 0: new = v; break;
+        case 1: new = old & v; break;
+        case 2: new = old | v; break;
+        case 3: new = old ^ v; break;
+        case 4: new = ~(old & v); break;
+        case 5: new = old + v; break;
+        case 6: new = old - v; break;
+        default: {
+            int less = issigned ? atomic_sext_bits(old, nb) < atomic_sext_bits(v, nb) :
+                atomic_zext_bits(old, nb) < atomic_zext_bits(v, nb);
+            new = (k == 7) == less ? v : old;
+            break;
+        }
+        }
+    } while (!atomic_cas_bits(pp, nb, &old, new, o));
+    return atomic_box_bits(ety, old);
+}
+#else
+JL_DLLEXPORT jl_value_t *jl_atomic_pointerref(jl_value_t *p, jl_value_t *order)
+{
+    jl_error("atomic_pointerref: not supported by this compiler");
+}
+JL_DLLEXPORT jl_value_t *jl_atomic_pointerset(jl_value_t *p, jl_value_t *x, jl_value_t *order)
+{
+    jl_error("atomic_pointerset: not supported by this compiler");
+}
+JL_DLLEXPORT jl_value_t *jl_atomic_pointercas(jl_value_t *p, jl_value_t *cmp, jl_value_t *x,
+                                              jl_value_t *order)
+{
+    jl_error("atomic_pointercas: not supported by this compiler");
+}
+JL_DLLEXPORT jl_value_t *jl_atomic_pointerrmw(jl_value_t *p, jl_value_t *op, jl_value_t *x,
+                                              jl_value_t *order)
+{
+    jl_error("atomic_pointerrmw: not supported by this compiler");
+}
+#endif
+
 
 static inline unsigned int next_power_of_two(unsigned int val) {
   /* this function taken from libuv src/unix/core.c */
@@ -94,6 +333,15 @@ static inline char usignbitbyte(void *a, unsigned bytes) {
     return 0;
 }
 
+#ifdef __SIZEOF_INT128__
+// 128-bit operations use the compiler's native type instead of APInt
+typedef __int128 int128_t;
+typedef unsigned __int128 uint128_t;
+#define ctype_128(x) x
+#else
+#define ctype_128(x)
+#endif
+
 static inline unsigned select_by_size(unsigned sz)
 {
     /* choose the right sized function specialization */
@@ -230,12 +478,14 @@ un_iintrinsic_ctype(OP, name, 8, u##int##8_t) \
 un_iintrinsic_ctype(OP, name, 16, u##int##16_t) \
 un_iintrinsic_ctype(OP, name, 32, u##int##32_t) \
 un_iintrinsic_ctype(OP, name, 64, u##int##64_t) \
+ctype_128(un_iintrinsic_ctype(OP, name, 128, u##int##128_t)) \
 static select_intrinsic_1_t name##_list = { \
     LLVMOP, \
     jl_##name##8, \
     jl_##name##16, \
     jl_##name##32, \
     jl_##name##64, \
+    ctype_128(jl_##name##128) \
 }; \
 un_iintrinsic(name, u)
 #define un_iintrinsic_slow(LLVMOP, name, u) \
@@ -256,12 +506,14 @@ uu_iintrinsic_ctype(OP, name, 8, u##int##8_t) \
 uu_iintrinsic_ctype(OP, name, 16, u##int##16_t) \
 uu_iintrinsic_ctype(OP, name, 32, u##int##32_t) \
 uu_iintrinsic_ctype(OP, name, 64, u##int##64_t) \
+ctype_128(uu_iintrinsic_ctype(OP, name, 128, u##int##128_t)) \
 static select_intrinsic_u1_t name##_list = { \
     LLVMOP, \
     jl_##name##8, \
     jl_##name##16, \
     jl_##name##32, \
     jl_##name##64, \
+    ctype_128(jl_##name##128) \
 }; \
 uu_iintrinsic(name, u)
 #define uu_iintrinsic_slow(LLVMOP, name, u) \
@@ -270,6 +522,33 @@ static select_intrinsic_u1_t name##_list = { \
 }; \
 uu_iintrinsic(name, u)
 
+// bit counts
+// OP##_64(a, nbits) counts in a uint64_t and OP##_128 in a uint128_t.
+// a size that was rounded up to a c-type would count its padding bits too,
+// so only whole c-type sizes are counted here and the rest go to LLVMOP
+#define uu_iintrinsic_count_ctype(LLVMOP, OP, name, nbits, wide) \
+static inline unsigned jl_##name##nbits(unsigned runtime_nbits, void *pa) \
+{ \
+    if (runtime_nbits != nbits) \
+        return LLVMOP(runtime_nbits, (integerPart*)pa); \
+    return OP##_##wide(*(uint##nbits##_t*)pa, nbits); \
+}
+#define uu_iintrinsic_count(LLVMOP, OP, name, u) \
+uu_iintrinsic_count_ctype(LLVMOP, OP, name, 8, 64) \
+uu_iintrinsic_count_ctype(LLVMOP, OP, name, 16, 64) \
+uu_iintrinsic_count_ctype(LLVMOP, OP, name, 32, 64) \
+uu_iintrinsic_count_ctype(LLVMOP, OP, name, 64, 64) \
+ctype_128(uu_iintrinsic_count_ctype(LLVMOP, OP, name, 128, 128)) \
+static select_intrinsic_u1_t name##_list = { \
+    LLVMOP, \
+    jl_##name##8, \
+    jl_##name##16, \
+    jl_##name##32, \
+    jl_##name##64, \
+    ctype_128(jl_##name##128) \
+}; \
+uu_iintrinsic(name, u)
+
 static inline jl_value_t *jl_iintrinsic_1(jl_value_t *ty, jl_value_t *a, const char *name, char (*getsign)(void*, unsigned),
         jl_value_t* (*lambda1)(jl_value_t*, void*, unsigned, unsigned, void*), void *list)
 {
@@ -415,12 +694,14 @@ bi_intrinsic_ctype(OP, name, 8, u##int##8_t) \
 bi_intrinsic_ctype(OP, name, 16, u##int##16_t) \
 bi_intrinsic_ctype(OP, name, 32, u##int##32_t) \
 bi_intrinsic_ctype(OP, name, 64, u##int##64_t) \
+ctype_128(bi_intrinsic_ctype(OP, name, 128, u##int##128_t)) \
 static select_intrinsic_2_t name##_list = { \
     LLVMOP, \
     jl_##name##8, \
     jl_##name##16, \
     jl_##name##32, \
     jl_##name##64, \
+    ctype_128(jl_##name##128) \
 }; \
 bi_iintrinsic(name, u, cvtb)
 #define bi_iintrinsic_fast(LLVMOP, OP, name, u) \
@@ -438,12 +719,14 @@ bool_intrinsic_ctype(OP, name, 8, u##int##8_t) \
 bool_intrinsic_ctype(OP, name, 16, u##int##16_t) \
 bool_intrinsic_ctype(OP, name, 32, u##int##32_t) \
 bool_intrinsic_ctype(OP, name, 64, u##int##64_t) \
+ctype_128(bool_intrinsic_ctype(OP, name, 128, u##int##128_t)) \
 static select_intrinsic_cmp_t name##_list = { \
     LLVMOP, \
     jl_##name##8, \
     jl_##name##16, \
     jl_##name##32, \
     jl_##name##64, \
+    ctype_128(jl_##name##128) \
 }; \
 cmp_iintrinsic(name, u)
 
@@ -459,12 +742,14 @@ checked_intrinsic_ctype(CHECK_OP, OP, name, 8, u##int##8_t) \
 checked_intrinsic_ctype(CHECK_OP, OP, name, 16, u##int##16_t) \
 checked_intrinsic_ctype(CHECK_OP, OP, name, 32, u##int##32_t) \
 checked_intrinsic_ctype(CHECK_OP, OP, name, 64, u##int##64_t) \
+ctype_128(checked_intrinsic_ctype(CHECK_OP, OP, name, 128, u##int##128_t)) \
 static select_intrinsic_checked_t name##_list = { \
     LLVMOP, \
     jl_##name##8, \
     jl_##name##16, \
     jl_##name##32, \
     jl_##name##64, \
+    ctype_128(jl_##name##128) \
 }; \
 checked_iintrinsic(name, u)
 #define checked_iintrinsic_slow(LLVMOP, name, u) \
@@ -736,15 +1021,37 @@ bi_iintrinsic_cnvtb_fast(LLVMAShr, ashr_op, ashr_int, u, 1)
 //#define bswap_op(a) __builtin_bswap(a)
 //un_iintrinsic_fast(LLVMByteSwap, bswap_op, bswap_int, u)
 un_iintrinsic_slow(LLVMByteSwap, bswap_int, u)
-//#define ctpop_op(a) __builtin_ctpop(a)
-//uu_iintrinsic_fast(LLVMCountPopulation, ctpop_op, ctpop_int, u)
-uu_iintrinsic_slow(LLVMCountPopulation, ctpop_int, u)
-//#define ctlz_op(a) __builtin_ctlz(a)
-//uu_iintrinsic_fast(LLVMCountLeadingZeros, ctlz_op, ctlz_int, u)
-uu_iintrinsic_slow(LLVMCountLeadingZeros, ctlz_int, u)
-//#define cttz_op(a) __builtin_cttz(a)
-//uu_iintrinsic_fast(LLVMCountTrailingZeros, cttz_op, cttz_int, u)
-uu_iintrinsic_slow(LLVMCountTrailingZeros, cttz_int, u)
+static inline unsigned ctpop_op_64(uint64_t a, unsigned nbits)
+{
+    return __builtin_popcountll(a);
+}
+static inline unsigned ctlz_op_64(uint64_t a, unsigned nbits)
+{
+    return a == 0 ? nbits : __builtin_clzll(a) - (64 - nbits);
+}
+static inline unsigned cttz_op_64(uint64_t a, unsigned nbits)
+{
+    return a == 0 ? nbits : __builtin_ctzll(a);
+}
+#ifdef __SIZEOF_INT128__
+static inline unsigned ctpop_op_128(uint128_t a, unsigned nbits)
+{
+    return ctpop_op_64((uint64_t)a, 64) + ctpop_op_64((uint64_t)(a >> 64), 64);
+}
+static inline unsigned ctlz_op_128(uint128_t a, unsigned nbits)
+{
+    uint64_t hi = (uint64_t)(a >> 64);
+    return hi ? ctlz_op_64(hi, 64) : 64 + ctlz_op_64((uint64_t)a, 64);
+}
+static inline unsigned cttz_op_128(uint128_t a, unsigned nbits)
+{
+    uint64_t lo = (uint64_t)a;
+    return lo ? cttz_op_64(lo, 64) : 64 + cttz_op_64((uint64_t)(a >> 64), 64);
+}
+#endif
+uu_iintrinsic_count(LLVMCountPopulation, ctpop_op, ctpop_int, u)
+uu_iintrinsic_count(LLVMCountLeadingZeros, ctlz_op, ctlz_int, u)
+uu_iintrinsic_count(LLVMCountTrailingZeros, cttz_op, cttz_int, u)
 #define not_op(a) ~a
 un_iintrinsic_fast(LLVMFlipAllBits, not_op, not_int, u)
 
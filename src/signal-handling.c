@@ -19,6 +19,38 @@ static volatile size_t bt_size_cur = 0;
 static volatile u_int64_t nsecprof = 0;
 static volatile int running = 0;
 static const    u_int64_t GIGA = 1000000000ULL;
+// Ring-buffer mode: bt_data_prof is used as a circular buffer that a
+// concurrent reader drains, so the timer keeps running with bounded memory.
+// The sampling thread is the only producer and advances bt_ring_head once a
+// whole 0-terminated sample is written; the reader owns bt_ring_tail.
+// Both are running totals, reduced modulo bt_size_max on access.
+static volatile int bt_ring = 0;
+static volatile size_t bt_ring_head = 0;
+static volatile size_t bt_ring_tail = 0;
+static volatile size_t bt_ring_dropped = 0;
+static ptrint_t bt_ring_scratch[JL_MAX_BT_SIZE + 1];
+// The thread and task each sample of bt_data_prof was taken on, in the order
+// of the samples. There is room for a sample per 4 entries of bt_data_prof;
+// the buffer counts as full when either runs out. Ring mode doesn't tag.
+typedef struct {
+    ptrint_t task; // the running jl_task_t, only meaningful as an identity
+    uint64_t count; // value of the thread's perf counter, if sampling on one
+    int16_t tid;
+} jl_profile_sample_t;
+static jl_profile_sample_t *bt_samples_prof = NULL;
+static volatile size_t bt_samples_max = 0;
+static volatile size_t bt_samples_cur = 0;
+// Hardware counter sampling (Linux): rather than on a timer, each thread is
+// sampled every perf_period_prof occurrences of perf_event_prof on it
+// (a JL_PROFILE_PERF_* value), or -1 to use the timer
+enum {
+    JL_PROFILE_PERF_CYCLES = 0,
+    JL_PROFILE_PERF_INSTRUCTIONS,
+    JL_PROFILE_PERF_CACHE_MISSES,
+    JL_PROFILE_PERF_BRANCH_MISSES
+};
+static volatile int perf_event_prof = -1;
+static volatile u_int64_t perf_period_prof = 0;
 // Timers to take samples at intervals
 JL_DLLEXPORT void jl_profile_stop_timer(void);
 JL_DLLEXPORT int jl_profile_start_timer(void);
@@ -40,6 +72,42 @@ JL_DLLEXPORT void jl_sigint_action(void)
 
 static void jl_critical_error(int sig, bt_context_t context, ptrint_t *bt_data, size_t *bt_size);
 
+// append the n entries of bt_ring_scratch as one sample, or drop the sample
+// if the reader has fallen behind; only called from the sampling thread
+static void jl_profile_ring_push(size_t n)
+{
+    size_t head = bt_ring_head;
+    bt_ring_scratch[n++] = 0;
+    if (n > bt_size_max - (head - bt_ring_tail)) {
+        bt_ring_dropped++;
+        return;
+    }
+    size_t pos = head % bt_size_max;
+    size_t first = bt_size_max - pos;
+    if (first > n)
+        first = n;
+    memcpy((ptrint_t*)bt_data_prof + pos, bt_ring_scratch, first*sizeof(ptrint_t));
+    memcpy((ptrint_t*)bt_data_prof, bt_ring_scratch + first, (n - first)*sizeof(ptrint_t));
+    // publish the sample only after its entries are visible
+    JL_ATOMIC_FENCE();
+    bt_ring_head = head + n;
+}
+
+static int jl_profile_is_full(void)
+{
+    return bt_size_cur >= bt_size_max - 1 || bt_samples_cur >= bt_samples_max;
+}
+
+// record thread `tid` as the source of the sample just appended to
+// bt_data_prof; the thread must be suspended
+static void jl_profile_tag_sample(int tid, uint64_t count)
+{
+    jl_profile_sample_t *s = &bt_samples_prof[bt_samples_cur++];
+    s->tid = tid;
+    s->count = count;
+    s->task = (ptrint_t)jl_all_task_states[tid].ptls->current_task;
+}
+
 #if defined(_WIN32)
 #include "signals-win.c"
 #else
@@ -73,10 +141,162 @@ JL_DLLEXPORT int jl_profile_init(size_t maxsize, u_int64_t delay_nsec)
     bt_data_prof = (ptrint_t*) calloc(maxsize, sizeof(ptrint_t));
     if (bt_data_prof == NULL && maxsize > 0)
         return -1;
+    bt_samples_max = maxsize / 4 + 1;
+    if (bt_samples_prof != NULL)
+        free(bt_samples_prof);
+    bt_samples_prof = (jl_profile_sample_t*) calloc(bt_samples_max, sizeof(jl_profile_sample_t));
+    if (bt_samples_prof == NULL) {
+        bt_samples_max = 0;
+        return -1;
+    }
     bt_size_cur = 0;
+    bt_samples_cur = 0;
+    bt_ring = 0;
+    perf_event_prof = -1;
+    bt_ring_head = bt_ring_tail = bt_ring_dropped = 0;
+    return 0;
+}
+
+JL_DLLEXPORT int jl_profile_init_ring(size_t maxsize, u_int64_t delay_nsec)
+{
+    // a sample must always fit, so that a drained ring can accept the next one
+    if (maxsize < JL_MAX_BT_SIZE + 1)
+        maxsize = JL_MAX_BT_SIZE + 1;
+    if (jl_profile_init(maxsize, delay_nsec) != 0)
+        return -1;
+    bt_ring = 1;
     return 0;
 }
 
+// Sample each thread every `period` occurrences of the hardware `event` (a
+// JL_PROFILE_PERF_* value) instead of on the timer. Returns -1 if the buffer
+// can't be allocated and -2 if the counter isn't available.
+JL_DLLEXPORT int jl_profile_init_perf(size_t maxsize, int event, u_int64_t period)
+{
+#ifdef HAVE_PERF_EVENTS
+    if (period == 0)
+        return -2;
+    int fd = jl_perf_open(event, period, 0);
+    if (fd < 0)
+        return -2;
+    close(fd);
+    if (jl_profile_init(maxsize, nsecprof) != 0)
+        return -1;
+    perf_period_prof = period;
+    perf_event_prof = event;
+    return 0;
+#else
+    (void)maxsize; (void)event; (void)period;
+    return -2;
+#endif
+}
+
+JL_DLLEXPORT int jl_profile_perf_event(void)
+{
+    return perf_event_prof;
+}
+
+JL_DLLEXPORT int jl_profile_is_ring(void)
+{
+    return bt_ring;
+}
+
+// Pass the pending samples of the ring buffer to `cb` and release them.
+// The data has the same layout as jl_profile_get_data, but may be split in
+// two chunks where it wraps around, so a sample can straddle two calls.
+// Returns the number of entries consumed. Only one reader may drain at a time.
+JL_DLLEXPORT size_t jl_profile_ring_drain(void (*cb)(const ptrint_t*, size_t, void*),
+                                          void *arg)
+{
+    if (!bt_ring)
+        return 0;
+    size_t tail = bt_ring_tail;
+    size_t n = bt_ring_head - tail;
+    JL_ATOMIC_FENCE();
+    if (n == 0)
+        return 0;
+    size_t pos = tail % bt_size_max;
+    size_t first = bt_size_max - pos;
+    if (first > n)
+        first = n;
+    cb((const ptrint_t*)bt_data_prof + pos, first, arg);
+    if (n > first)
+        cb((const ptrint_t*)bt_data_prof, n - first, arg);
+    JL_ATOMIC_FENCE();
+    bt_ring_tail = tail + n;
+    return n;
+}
+
+typedef struct {
+    ptrint_t *dst;
+    size_t len;
+} jl_ring_copy_t;
+
+static void jl_profile_ring_copy_cb(const ptrint_t *data, size_t n, void *arg)
+{
+    jl_ring_copy_t *c = (jl_ring_copy_t*)arg;
+    memcpy(c->dst + c->len, data, n*sizeof(ptrint_t));
+    c->len += n;
+}
+
+// Copy as many whole pending samples as fit in dst[0:maxlen) and release them.
+// Returns the number of entries copied.
+JL_DLLEXPORT size_t jl_profile_ring_read(ptrint_t *dst, size_t maxlen)
+{
+    if (!bt_ring)
+        return 0;
+    size_t tail = bt_ring_tail;
+    size_t n = bt_ring_head - tail;
+    JL_ATOMIC_FENCE();
+    if (n > maxlen) {
+        // only hand out complete samples: back up to the last terminator
+        while (maxlen > 0 && bt_data_prof[(tail + maxlen - 1) % bt_size_max] != 0)
+            maxlen--;
+        n = maxlen;
+    }
+    for (size_t i = 0; i < n; i++)
+        dst[i] = bt_data_prof[(tail + i) % bt_size_max];
+    JL_ATOMIC_FENCE();
+    bt_ring_tail = tail + n;
+    return n;
+}
+
+typedef struct {
+    int fd;
+    int err;
+} jl_ring_fd_t;
+
+static void jl_profile_ring_fd_cb(const ptrint_t *data, size_t n, void *arg)
+{
+    jl_ring_fd_t *w = (jl_ring_fd_t*)arg;
+    const char *p = (const char*)data;
+    size_t len = n*sizeof(ptrint_t);
+    while (len > 0 && w->err == 0) {
+        int nb = jl_fs_write(w->fd, p, len, -1);
+        if (nb < 0)
+            w->err = nb;
+        else {
+            p += nb;
+            len -= nb;
+        }
+    }
+}
+
+// Drain the pending samples to file descriptor `fd` as raw native-endian
+// instruction pointers. Returns the number of entries drained, or a negative
+// error code if writing failed (the samples are released either way).
+JL_DLLEXPORT int64_t jl_profile_ring_write_fd(int fd)
+{
+    jl_ring_fd_t w = {fd, 0};
+    size_t n = jl_profile_ring_drain(jl_profile_ring_fd_cb, &w);
+    return w.err ? w.err : (int64_t)n;
+}
+
+JL_DLLEXPORT size_t jl_profile_ring_dropped(void)
+{
+    return bt_ring_dropped;
+}
+
 JL_DLLEXPORT u_int8_t *jl_profile_get_data(void)
 {
     return (u_int8_t*) bt_data_prof;
@@ -84,9 +304,33 @@ JL_DLLEXPORT u_int8_t *jl_profile_get_data(void)
 
 JL_DLLEXPORT size_t jl_profile_len_data(void)
 {
+    if (bt_ring)
+        return bt_ring_head - bt_ring_tail;
     return bt_size_cur;
 }
 
+// the number of tagged samples, with jl_profile_sample_thread and
+// jl_profile_sample_task giving the thread and task of the i-th one
+JL_DLLEXPORT size_t jl_profile_len_samples(void)
+{
+    return bt_ring ? 0 : bt_samples_cur;
+}
+
+JL_DLLEXPORT int16_t jl_profile_sample_thread(size_t i)
+{
+    return i < bt_samples_cur ? bt_samples_prof[i].tid : -1;
+}
+
+JL_DLLEXPORT ptrint_t jl_profile_sample_task(size_t i)
+{
+    return i < bt_samples_cur ? bt_samples_prof[i].task : 0;
+}
+
+JL_DLLEXPORT uint64_t jl_profile_sample_count(size_t i)
+{
+    return i < bt_samples_cur ? bt_samples_prof[i].count : 0;
+}
+
 JL_DLLEXPORT size_t jl_profile_maxlen_data(void)
 {
     return bt_size_max;
@@ -100,6 +344,9 @@ JL_DLLEXPORT u_int64_t jl_profile_delay_nsec(void)
 JL_DLLEXPORT void jl_profile_clear_data(void)
 {
     bt_size_cur = 0;
+    bt_samples_cur = 0;
+    bt_ring_tail = bt_ring_head;
+    bt_ring_dropped = 0;
 }
 
 JL_DLLEXPORT int jl_profile_is_running(void)
@@ -283,7 +283,7 @@ void *mach_profile_listener(void *arg)
         // (so that thread zero gets notified last)
         for (i = jl_n_threads; i-- > 0; ) {
             // if there is no space left, break early
-            if (bt_size_cur >= bt_size_max - 1)
+            if (!bt_ring && jl_profile_is_full())
                 break;
 
             unw_context_t *uc;
@@ -307,12 +307,20 @@ void *mach_profile_listener(void *arg)
             forceDwarf = 0;
             unw_getcontext(&profiler_uc); // will resume from this point if the next lines segfault at any point
 
+            // in ring mode the backtrace goes to the scratch buffer first, so a
+            // faulting unwind never leaves a partial sample in the ring
             if (forceDwarf == 0) {
                 // Save the backtrace
-                bt_size_cur += rec_backtrace_ctx((ptrint_t*)bt_data_prof + bt_size_cur, bt_size_max - bt_size_cur - 1, uc);
+                if (bt_ring)
+                    jl_profile_ring_push(rec_backtrace_ctx(bt_ring_scratch, jl_bt_max_depth, uc));
+                else
+                    bt_size_cur += rec_backtrace_ctx((ptrint_t*)bt_data_prof + bt_size_cur, jl_bt_depth(bt_size_max - bt_size_cur - 1), uc);
             }
             else if (forceDwarf == 1) {
-                bt_size_cur += rec_backtrace_ctx_dwarf((ptrint_t*)bt_data_prof + bt_size_cur, bt_size_max - bt_size_cur - 1, uc);
+                if (bt_ring)
+                    jl_profile_ring_push(rec_backtrace_ctx_dwarf(bt_ring_scratch, jl_bt_max_depth, uc));
+                else
+                    bt_size_cur += rec_backtrace_ctx_dwarf((ptrint_t*)bt_data_prof + bt_size_cur, jl_bt_depth(bt_size_max - bt_size_cur - 1), uc);
             }
             else if (forceDwarf == -1) {
                 jl_safe_printf("WARNING: profiler attempt to access an invalid memory location\n");
@@ -320,11 +328,17 @@ void *mach_profile_listener(void *arg)
 
             forceDwarf = -2;
 #else
-            bt_size_cur += rec_backtrace_ctx((ptrint_t*)bt_data_prof + bt_size_cur, bt_size_max - bt_size_cur - 1, uc);
+            if (bt_ring)
+                jl_profile_ring_push(rec_backtrace_ctx(bt_ring_scratch, jl_bt_max_depth, uc));
+            else
+                bt_size_cur += rec_backtrace_ctx((ptrint_t*)bt_data_prof + bt_size_cur, jl_bt_depth(bt_size_max - bt_size_cur - 1), uc);
 #endif
 
             // Mark the end of this block with 0
-            bt_data_prof[bt_size_cur++] = 0;
+            if (!bt_ring) {
+                bt_data_prof[bt_size_cur++] = 0;
+                jl_profile_tag_sample(i, 0);
+            }
 
             // We're done! Resume the thread.
             jl_thread_resume(i, 0);
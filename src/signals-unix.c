@@ -26,10 +26,28 @@
 #define HAVE_TIMER
 #endif
 
+#if defined(HAVE_SIGTIMEDWAIT) && defined(_OS_LINUX_)
+// the profiler can sample on the overflow of hardware counters
+#define HAVE_PERF_EVENTS
+#include <fcntl.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+// overflows are delivered to the signal listener as this signal
+#define JL_PERF_SIGNAL SIGRTMIN
+#endif
+
+#if defined(JULIA_ENABLE_THREADING) && !defined(HAVE_MACH)
+// a thread stopped at a safepoint takes part in the collection on this stack
+#define SIG_STACK_SIZE (SIGSTKSZ < GC_SAFEPOINT_STACK_SIZE ? GC_SAFEPOINT_STACK_SIZE : SIGSTKSZ)
+#else
+#define SIG_STACK_SIZE SIGSTKSZ
+#endif
+
 #if defined(JL_USE_INTEL_JITEVENTS)
-unsigned sig_stack_size = SIGSTKSZ;
+unsigned sig_stack_size = SIG_STACK_SIZE;
 #else
-#define sig_stack_size SIGSTKSZ
+#define sig_stack_size SIG_STACK_SIZE
 #endif
 
 static pthread_t signals_thread;
@@ -75,6 +93,13 @@ static void segv_handler(int sig, siginfo_t *info, void *context)
     sigset_t sset;
     assert(sig == SIGSEGV);
 
+#ifdef JULIA_ENABLE_THREADING
+    if (jl_gc_is_safepoint_addr(info->si_addr)) {
+        // a collection is waiting, the load runs again when it's done
+        jl_gc_signal_safepoint();
+        return;
+    }
+#endif
     if (jl_in_jl_ || is_addr_on_stack(jl_get_ptls_states(), info->si_addr)) { // stack overflow, or restarting jl_
         sigemptyset(&sset);
         sigaddset(&sset, SIGSEGV);
@@ -117,6 +142,103 @@ static pthread_mutex_t in_signal_lock;
 static pthread_cond_t exit_signal_cond;
 static pthread_cond_t signal_caught_cond;
 
+#ifdef HAVE_PERF_EVENTS
+static int *perf_fds = NULL;    // the counter of each thread, while running
+static int perf_nfds = 0;
+static int perf_listener_tid = 0;
+
+// open a counter of `event` for kernel thread `ktid` (0 for the calling one)
+// that overflows every `period` events; it starts disabled
+static int jl_perf_open(int event, uint64_t period, int ktid)
+{
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = PERF_TYPE_HARDWARE;
+    switch (event) {
+    case JL_PROFILE_PERF_CYCLES:        attr.config = PERF_COUNT_HW_CPU_CYCLES; break;
+    case JL_PROFILE_PERF_INSTRUCTIONS:  attr.config = PERF_COUNT_HW_INSTRUCTIONS; break;
+    case JL_PROFILE_PERF_CACHE_MISSES:  attr.config = PERF_COUNT_HW_CACHE_MISSES; break;
+    case JL_PROFILE_PERF_BRANCH_MISSES: attr.config = PERF_COUNT_HW_BRANCH_MISSES; break;
+    default: return -1;
+    }
+    attr.sample_period = period;
+    attr.wakeup_events = 1;
+    attr.disabled = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    return syscall(__NR_perf_event_open, &attr, ktid, -1, -1, 0);
+}
+
+// read the current value of the counter of thread `tid`
+static uint64_t jl_perf_read(int tid)
+{
+    uint64_t count = 0;
+    if (tid < perf_nfds && perf_fds[tid] >= 0 &&
+        read(perf_fds[tid], &count, sizeof(count)) != sizeof(count))
+        count = 0;
+    return count;
+}
+
+// let the counter of thread `tid` signal its next overflow
+static void jl_perf_rearm(int tid)
+{
+    if (tid < perf_nfds && perf_fds[tid] >= 0)
+        ioctl(perf_fds[tid], PERF_EVENT_IOC_REFRESH, 1);
+}
+
+static int jl_perf_thread_of(int fd)
+{
+    for (int i = 0; i < perf_nfds; i++) {
+        if (perf_fds[i] == fd)
+            return i;
+    }
+    return -1;
+}
+
+static void jl_perf_stop(void)
+{
+    for (int i = 0; i < perf_nfds; i++) {
+        if (perf_fds[i] >= 0) {
+            ioctl(perf_fds[i], PERF_EVENT_IOC_DISABLE, 0);
+            close(perf_fds[i]);
+        }
+    }
+    free(perf_fds);
+    perf_fds = NULL;
+    perf_nfds = 0;
+}
+
+// open a counter on every thread, with its overflows signaled to the listener
+static int jl_perf_start(void)
+{
+    jl_perf_stop();
+    perf_fds = (int*)malloc(jl_n_threads * sizeof(int));
+    if (perf_fds == NULL)
+        return -1;
+    perf_nfds = jl_n_threads;
+    for (int i = 0; i < perf_nfds; i++)
+        perf_fds[i] = -1;
+    for (int i = 0; i < perf_nfds; i++) {
+        int fd = jl_perf_open(perf_event_prof, perf_period_prof,
+                              jl_all_task_states[i].kernel_tid);
+        if (fd < 0)
+            return -1;
+        perf_fds[i] = fd;
+        struct f_owner_ex owner;
+        owner.type = F_OWNER_TID;
+        owner.pid = perf_listener_tid;
+        if (fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_ASYNC) == -1 ||
+            fcntl(fd, F_SETSIG, JL_PERF_SIGNAL) == -1 ||
+            fcntl(fd, F_SETOWN_EX, &owner) == -1)
+            return -1;
+        ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+        ioctl(fd, PERF_EVENT_IOC_REFRESH, 1);
+    }
+    return 0;
+}
+#endif
+
 static void jl_thread_suspend_and_get_state(int tid, unw_context_t **ctx, int sig)
 {
     pthread_mutex_lock(&in_signal_lock);
@@ -328,17 +450,22 @@ static void *signal_listener(void *arg)
     sigset_t sset;
     unw_context_t *signal_context;
     int sig, critical, profile;
-    int i;
+    int i, sample_tid;
     jl_sigsetset(&sset);
 #ifdef HAVE_SIGTIMEDWAIT
     siginfo_t info;
     sigaddset(&sset, SIGUSR2);
+#ifdef HAVE_PERF_EVENTS
+    sigaddset(&sset, JL_PERF_SIGNAL);
+    perf_listener_tid = syscall(SYS_gettid);
+#endif
     sigprocmask(SIG_SETMASK, &sset, 0);
 #endif
     while (1) {
         profile = 0;
+        sample_tid = -1; // sample only this thread, if not -1
 #ifdef HAVE_SIGTIMEDWAIT
-        if (running) {
+        if (running && perf_event_prof < 0) {
             sig = sigtimedwait(&sset, &info, &timeoutprof);
         }
         else {
@@ -358,8 +485,25 @@ static void *signal_listener(void *arg)
         else if (sig == SIGUSR2) {
             // notification to toggle profiler
             running = !running;
+#ifdef HAVE_PERF_EVENTS
+            if (perf_event_prof >= 0) {
+                if (!running)
+                    jl_perf_stop();
+                else if (jl_perf_start() != 0)
+                    jl_safe_printf("WARNING: could not start the performance counters of the profiler\n");
+            }
+#endif
             continue;
         }
+#ifdef HAVE_PERF_EVENTS
+        else if (sig == JL_PERF_SIGNAL) {
+            // a thread's counter overflowed; late ones may come after a stop
+            sample_tid = jl_perf_thread_of(info.si_fd);
+            if (!running || sample_tid < 0)
+                continue;
+            profile = 1;
+        }
+#endif
 #else
         sigwait(&sset, &sig);
 #ifndef HAVE_MACH
@@ -385,6 +529,8 @@ static void *signal_listener(void *arg)
         // sample each thread, round-robin style in reverse order
         // (so that thread zero gets notified last)
         for (i = jl_n_threads; i-- > 0; ) {
+            if (sample_tid >= 0 && i != sample_tid)
+                continue;
             // notify thread to stop
             jl_thread_suspend_and_get_state(i, &signal_context, sig);
 
@@ -399,14 +545,23 @@ static void *signal_listener(void *arg)
 
             // do backtrace for profiler
             if (profile && running) {
-                if (bt_size_cur < bt_size_max - 1) {
+                if (bt_ring) {
+                    jl_profile_ring_push(rec_backtrace_ctx(bt_ring_scratch,
+                            jl_bt_max_depth, signal_context));
+                }
+                else if (!jl_profile_is_full()) {
                     // Get backtrace data
                     bt_size_cur += rec_backtrace_ctx((ptrint_t*)bt_data_prof + bt_size_cur,
-                            bt_size_max - bt_size_cur - 1, signal_context);
+                            jl_bt_depth(bt_size_max - bt_size_cur - 1), signal_context);
                     // Mark the end of this block with 0
                     bt_data_prof[bt_size_cur++] = 0;
+#ifdef HAVE_PERF_EVENTS
+                    jl_profile_tag_sample(i, jl_perf_read(i));
+#else
+                    jl_profile_tag_sample(i, 0);
+#endif
                 }
-                if (bt_size_cur >= bt_size_max - 1) {
+                if (!bt_ring && jl_profile_is_full()) {
                     // Buffer full: Delete the timer
                     jl_profile_stop_timer();
                 }
@@ -414,6 +569,10 @@ static void *signal_listener(void *arg)
 
             // notify thread to resume
             jl_thread_resume(i, sig);
+#ifdef HAVE_PERF_EVENTS
+            if (sample_tid >= 0)
+                jl_perf_rearm(i);
+#endif
         }
 
         // this part is async with the running of the rest of the program
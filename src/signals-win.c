@@ -278,35 +278,49 @@ static DWORD WINAPI profile_bt( LPVOID lparam )
         return 0;
     }
     while (1) {
-        if (running && bt_size_cur < bt_size_max) {
+        if (running && (bt_ring || !jl_profile_is_full())) {
             DWORD timeout = nsecprof/GIGA;
             timeout = min(max(timeout,tc.wPeriodMin*2),tc.wPeriodMax/2);
             Sleep(timeout);
-            if ((DWORD)-1 == SuspendThread(hMainThread)) {
-                fputs("failed to suspend main thread. aborting profiling.",stderr);
-                break;
-            }
-            CONTEXT ctxThread;
-            memset(&ctxThread,0,sizeof(CONTEXT));
-            ctxThread.ContextFlags = CONTEXT_CONTROL | CONTEXT_INTEGER;
-            if (!GetThreadContext(hMainThread, &ctxThread)) {
-                fputs("failed to get context from main thread. aborting profiling.",stderr);
-                break;
-            }
-            // Get backtrace data
-            bt_size_cur += rec_backtrace_ctx((ptrint_t*)bt_data_prof+bt_size_cur, bt_size_max-bt_size_cur-1, &ctxThread);
-            // Mark the end of this block with 0
-            bt_data_prof[bt_size_cur] = 0;
-            bt_size_cur++;
-            if ((DWORD)-1 == ResumeThread(hMainThread)) {
-                fputs("failed to resume main thread! aborting.",stderr);
-                abort();
+            // sample each thread, in reverse order like the other platforms
+            int i;
+            for (i = jl_n_threads; i-- > 0; ) {
+                if (!bt_ring && jl_profile_is_full())
+                    break;
+                HANDLE hThread = jl_all_task_states[i].system_id;
+                if ((DWORD)-1 == SuspendThread(hThread)) {
+                    fputs("failed to suspend thread. aborting profiling.",stderr);
+                    goto done;
+                }
+                CONTEXT ctxThread;
+                memset(&ctxThread,0,sizeof(CONTEXT));
+                ctxThread.ContextFlags = CONTEXT_CONTROL | CONTEXT_INTEGER;
+                if (!GetThreadContext(hThread, &ctxThread)) {
+                    fputs("failed to get context from thread. aborting profiling.",stderr);
+                    goto done;
+                }
+                if (bt_ring) {
+                    jl_profile_ring_push(rec_backtrace_ctx(bt_ring_scratch, jl_bt_max_depth, &ctxThread));
+                }
+                else {
+                    // Get backtrace data
+                    bt_size_cur += rec_backtrace_ctx((ptrint_t*)bt_data_prof+bt_size_cur, jl_bt_depth(bt_size_max-bt_size_cur-1), &ctxThread);
+                    // Mark the end of this block with 0
+                    bt_data_prof[bt_size_cur] = 0;
+                    bt_size_cur++;
+                    jl_profile_tag_sample(i, 0);
+                }
+                if ((DWORD)-1 == ResumeThread(hThread)) {
+                    fputs("failed to resume thread! aborting.",stderr);
+                    abort();
+                }
             }
         }
         else {
             SuspendThread(GetCurrentThread());
         }
     }
+done:
     hBtThread = 0;
     return 0;
 }
@@ -62,6 +62,8 @@ u_int32_t bitvector_get(u_int32_t *b, u_int64_t n)
 
 #if defined(__INTEL_COMPILER) && !defined(__clang__)
 #define count_bits(b) _popcnt32(b)
+#elif defined(__GNUC__)
+#define count_bits(b) ((u_int32_t)__builtin_popcount(b))
 #else
 STATIC_INLINE u_int32_t count_bits(u_int32_t b)
 {
@@ -85,15 +87,17 @@ STATIC_INLINE u_int32_t count_bits(u_int32_t b)
 
 static int ntz(uint32_t x)
 {
-    int n;
-
     if (x == 0) return 32;
-    n = 1;
+#if defined(__GNUC__)
+    return __builtin_ctz(x);
+#else
+    int n = 1;
     if ((x & 0x0000FFFF) == 0) {n = n +16; x = x >>16;}
     if ((x & 0x000000FF) == 0) {n = n + 8; x = x >> 8;}
     if ((x & 0x0000000F) == 0) {n = n + 4; x = x >> 4;}
     if ((x & 0x00000003) == 0) {n = n + 2; x = x >> 2;}
     return n - (x & 1);
+#endif
 }
 
 // given a bitvector of n bits, starting at bit n0 find the next
@@ -197,6 +201,49 @@ u_int32_t bitvector_any1(u_int32_t *b, u_int64_t offs, u_int64_t nbits)
     return 0;
 }
 
+// set or clear nbits bits starting at bit offs
+void bitvector_fill(u_int32_t *b, u_int64_t offs, u_int64_t nbits, u_int32_t c)
+{
+    if (nbits == 0) return;
+    u_int64_t end = offs+nbits;
+    size_t i = offs>>5, last = (end-1)>>5;
+    u_int32_t head = ONES32<<(offs&31);
+    u_int32_t tail = (end&31) ? lomask(end&31) : ONES32;
+    if (i == last) {
+        head &= tail;
+        b[i] = c ? (b[i] | head) : (b[i] & ~head);
+        return;
+    }
+    b[i] = c ? (b[i] | head) : (b[i] & ~head);
+    if (last > i+1)
+        memset(&b[i+1], c ? 0xff : 0, (last-i-1)*sizeof(u_int32_t));
+    b[last] = c ? (b[last] | tail) : (b[last] & ~tail);
+}
+
+// dest = a op b over nwords whole words; dest may alias a or b. each case
+// is a plain element-wise loop so the compiler can vectorize it.
+void bitvector_combine(u_int32_t *dest, const u_int32_t *a, const u_int32_t *b,
+                       size_t nwords, int op)
+{
+    size_t i;
+    switch (op) {
+    case BITVECTOR_AND:
+        for (i = 0; i < nwords; i++) dest[i] = a[i] & b[i];
+        break;
+    case BITVECTOR_OR:
+        for (i = 0; i < nwords; i++) dest[i] = a[i] | b[i];
+        break;
+    case BITVECTOR_XOR:
+        for (i = 0; i < nwords; i++) dest[i] = a[i] ^ b[i];
+        break;
+    case BITVECTOR_ANDNOT:
+        for (i = 0; i < nwords; i++) dest[i] = a[i] & ~b[i];
+        break;
+    default:
+        assert(0 && "bitvector_combine: unknown op");
+    }
+}
+
 #ifdef __cplusplus
 }
 #endif
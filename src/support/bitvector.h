@@ -21,6 +21,13 @@ JL_DLLEXPORT
 u_int64_t bitvector_count(u_int32_t *b, u_int64_t offs, u_int64_t nbits);
 JL_DLLEXPORT
 u_int32_t bitvector_any1(u_int32_t *b, u_int64_t offs, u_int64_t nbits);
+JL_DLLEXPORT
+void bitvector_fill(u_int32_t *b, u_int64_t offs, u_int64_t nbits, u_int32_t c);
+
+enum { BITVECTOR_AND, BITVECTOR_OR, BITVECTOR_XOR, BITVECTOR_ANDNOT };
+JL_DLLEXPORT
+void bitvector_combine(u_int32_t *dest, const u_int32_t *a, const u_int32_t *b,
+                       size_t nwords, int op);
 
 #ifdef __cplusplus
 }
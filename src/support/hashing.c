@@ -4,6 +4,7 @@
   Hashing
 */
 #include <stdlib.h>
+#include <string.h>
 #include "dtypes.h"
 #include "utils.h"
 #include "hashing.h"
@@ -65,6 +66,111 @@ u_int32_t int64to32hash(u_int64_t key)
 
 #define _MHASH_SEED_ 0xcafe8881
 
+#if defined(_P64) && (defined(__SIZEOF_INT128__) || defined(_COMPILER_MICROSOFT_))
+/*
+  wyhash (final version 4, public domain, by Wang Yi): a 64x64->128 bit
+  multiply mixes 16 bytes at a time, and keys of up to 16 bytes take no loop
+  at all. long keys are read 48 bytes per round in three independent lanes.
+*/
+#ifdef _COMPILER_MICROSOFT_
+#include <intrin.h>
+#endif
+
+static const uint64_t wyp[4] = { 0x2d358dccaa6c78a5ull, 0x8bb84b93962eacc9ull,
+                                 0x4b33a62ed433d4a3ull, 0x4d5a2da51de1aa47ull };
+
+STATIC_INLINE void wymum(uint64_t *a, uint64_t *b)
+{
+#ifdef _COMPILER_MICROSOFT_
+    *a = _umul128(*a, *b, b);
+#else
+    __uint128_t r = *a;
+    r *= *b;
+    *a = (uint64_t)r;
+    *b = (uint64_t)(r >> 64);
+#endif
+}
+
+STATIC_INLINE uint64_t wymix(uint64_t a, uint64_t b)
+{
+    wymum(&a, &b);
+    return a ^ b;
+}
+
+STATIC_INLINE uint64_t wyr8(const uint8_t *p)
+{
+    uint64_t v;
+    memcpy(&v, p, 8);
+    return v;
+}
+
+STATIC_INLINE uint64_t wyr4(const uint8_t *p)
+{
+    uint32_t v;
+    memcpy(&v, p, 4);
+    return v;
+}
+
+STATIC_INLINE uint64_t wyr3(const uint8_t *p, size_t k)
+{
+    return (((uint64_t)p[0]) << 16) | (((uint64_t)p[k >> 1]) << 8) | p[k - 1];
+}
+
+static uint64_t wyhash(const void *key, size_t len, uint64_t seed)
+{
+    const uint8_t *p = (const uint8_t*)key;
+    uint64_t a, b;
+    seed ^= wymix(seed ^ wyp[0], wyp[1]);
+    if (len <= 16) {
+        if (len >= 4) {
+            a = (wyr4(p) << 32) | wyr4(p + ((len >> 3) << 2));
+            b = (wyr4(p + len - 4) << 32) | wyr4(p + len - 4 - ((len >> 3) << 2));
+        }
+        else if (len > 0) {
+            a = wyr3(p, len);
+            b = 0;
+        }
+        else {
+            a = b = 0;
+        }
+    }
+    else {
+        size_t i = len;
+        if (i > 48) {
+            uint64_t see1 = seed, see2 = seed;
+            do {
+                seed = wymix(wyr8(p) ^ wyp[1], wyr8(p + 8) ^ seed);
+                see1 = wymix(wyr8(p + 16) ^ wyp[2], wyr8(p + 24) ^ see1);
+                see2 = wymix(wyr8(p + 32) ^ wyp[3], wyr8(p + 40) ^ see2);
+                p += 48;
+                i -= 48;
+            } while (i > 48);
+            seed ^= see1 ^ see2;
+        }
+        while (i > 16) {
+            seed = wymix(wyr8(p) ^ wyp[1], wyr8(p + 8) ^ seed);
+            i -= 16;
+            p += 16;
+        }
+        a = wyr8(p + i - 16);
+        b = wyr8(p + i - 8);
+    }
+    a ^= wyp[1];
+    b ^= seed;
+    wymum(&a, &b);
+    return wymix(a ^ wyp[0] ^ len, b ^ wyp[1]);
+}
+
+uint64_t memhash(const char *buf, size_t n)
+{
+    return wyhash(buf, n, _MHASH_SEED_);
+}
+
+uint64_t memhash_seed(const char *buf, size_t n, uint32_t seed)
+{
+    return wyhash(buf, n, seed);
+}
+#else
 uint64_t memhash(const char *buf, size_t n)
 {
     uint64_t out[2];
@@ -90,6 +196,7 @@ uint64_t memhash_seed(const char *buf, size_t n, uint32_t seed)
 #endif
     return out[1];
 }
+#endif
 
 uint32_t memhash32(const char *buf, size_t n)
 {
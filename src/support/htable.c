@@ -29,12 +29,13 @@ htable_t *htable_new(htable_t *h, size_t size)
         size *= 2;  // 2 pointers per key/value pair
         size *= 2;  // aim for 50% occupancy
         h->size = size;
-        h->table = (void**)LLT_ALLOC(size*sizeof(void*));
+        h->table = (void**)LLT_ALLOC(htable_alloc_size(size));
     }
     if (h->table == NULL) return NULL;
     size_t i;
     for(i=0; i < size; i++)
         h->table[i] = HT_NOTFOUND;
+    memset(htable_meta(h), 0, size/2);
     return h;
 }
 
@@ -49,14 +50,15 @@ void htable_reset(htable_t *h, size_t sz)
 {
     sz = nextipow2(sz);
     if (h->size > sz*4 && h->size > HT_N_INLINE) {
-        size_t newsz = sz*4;
-        void **newtab = (void**)LLT_REALLOC(h->table, newsz*sizeof(void*));
+        size_t newsz = sz*4 < HT_N_INLINE ? HT_N_INLINE : sz*4;
+        void **newtab = (void**)LLT_REALLOC(h->table, htable_alloc_size(newsz));
         h->size = newsz;
         h->table = newtab;
     }
     size_t i, hsz=h->size;
     for(i=0; i < hsz; i++)
         h->table[i] = HT_NOTFOUND;
+    memset(htable_meta(h), 0, hsz/2);
 }
 
 #ifdef __cplusplus
@@ -9,15 +9,21 @@
 extern "C" {
 #endif
 
+// table holds size/2 key/value pairs, followed by a byte per pair: 0 if the
+// pair was never used, else a fingerprint of the hash of its key (with the
+// high bit set), which the lookups scan a group of pairs at a time
 typedef struct {
     size_t size;
     void **table;
-    void *_space[HT_N_INLINE];
+    void *_space[HT_N_INLINE + (HT_N_INLINE/2 + sizeof(void*) - 1)/sizeof(void*)];
 } htable_t;
 
 // define this to be an invalid key/value
 #define HT_NOTFOUND ((void*)1)
 
+#define htable_meta(h) ((uint8_t*)&(h)->table[(h)->size])
+#define htable_alloc_size(size) ((size)*sizeof(void*) + (size)/2)
+
 // initialize and free
 htable_t *htable_new(htable_t *h, size_t size);
 void htable_free(htable_t *h);
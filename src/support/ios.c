@@ -22,6 +22,7 @@
 #include <sys/time.h>
 #include <sys/select.h>
 #include <sys/stat.h>
+#include <sys/mman.h>
 #include <fcntl.h>
 #endif
 
@@ -162,6 +163,17 @@ int _os_write_all(long fd, const void *buf, size_t n, size_t *nwritten)
 
 /* internal utility functions */
 
+// release the file mapping behind an ios_mmap stream
+static void _buf_unmap(ios_t *s)
+{
+#if !defined(_OS_WINDOWS_)
+    if (s->mapped) {
+        munmap(s->buf, s->maxsize);
+        s->mapped = 0;
+    }
+#endif
+}
+
 static char *_buf_realloc(ios_t *s, size_t sz)
 {
     char *temp;
@@ -192,6 +204,7 @@ static char *_buf_realloc(ios_t *s, size_t sz)
         s->ownbuf = 1;
         if (s->size > 0)
             memcpy(temp, s->buf, s->size);
+        _buf_unmap(s);
     }
 
     s->buf = temp;
@@ -213,6 +226,10 @@ static size_t _write_grow(ios_t *s, const char *data, size_t n)
         if (s->bpos + n > s->maxsize) {
             /* TODO: here you might want to add a mechanism for limiting
                the growth of the stream. */
+            // memory streams stay one buffer, grown by doubling: large
+            // reallocs move pages (mremap) instead of copying them, and the
+            // buffer is handed to jl_takebuf_array as it is. a list of chunks
+            // would still need one copy (and both copies live) to join them.
             newsize = s->maxsize ? s->maxsize * 2 : 8;
             while (s->bpos + n > newsize)
                 newsize *= 2;
@@ -641,6 +658,7 @@ void ios_close(ios_t *s)
     if (s->buf!=NULL && s->ownbuf && s->buf!=&s->local[0]) {
         LLT_FREE(s->buf);
     }
+    _buf_unmap(s);
     s->buf = NULL;
     s->size = s->maxsize = s->bpos = 0;
 }
@@ -671,18 +689,27 @@ char *ios_takebuf(ios_t *s, size_t *psize)
 
     ios_flush(s);
 
-    if (s->buf == &s->local[0]) {
+    if (s->buf == &s->local[0] || s->mapped) {
         buf = (char*)LLT_ALLOC(s->size+1);
         if (buf == NULL)
             return NULL;
         if (s->size)
             memcpy(buf, s->buf, s->size);
+        _buf_unmap(s);
     }
     else {
-        if (s->buf == NULL)
+        if (s->buf == NULL) {
             buf = (char*)LLT_ALLOC(s->size+1);
-        else
+        }
+        else {
             buf = s->buf;
+            // don't hand over the slack of the doubling growth with the data
+            if (s->ownbuf && s->maxsize - s->size > s->maxsize/4) {
+                char *temp = (char*)LLT_REALLOC(buf, s->size+1);
+                if (temp != NULL)
+                    buf = temp;
+            }
+        }
     }
     buf[s->size] = '\0';
 
@@ -711,6 +738,7 @@ int ios_setbuf(ios_t *s, char *buf, size_t size, int own)
     if (s->buf!=NULL && s->ownbuf && s->buf!=&s->local[0]) {
         LLT_FREE(s->buf);
     }
+    _buf_unmap(s);
     s->buf = buf;
     s->maxsize = size;
     s->ownbuf = own;
@@ -813,6 +841,34 @@ size_t ios_copyuntil(ios_t *to, ios_t *from, char delim)
     return total;
 }
 
+char *ios_readuntil_view(ios_t *s, char delim, size_t *plen)
+{
+    // memchr is the vectorized scan; by growing the read buffer until it
+    // holds the whole line, each byte is scanned once and never copied into
+    // an intermediate stream
+    size_t scanned = 0;
+    size_t avail = ios_readprep(s, LINE_CHUNK_SIZE);
+    char *pd;
+    while ((pd = (char*)memchr(s->buf+s->bpos+scanned, delim, avail-scanned)) == NULL) {
+        scanned = avail;
+        avail = ios_readprep(s, avail < LINE_CHUNK_SIZE ? LINE_CHUNK_SIZE : avail*2);
+        if (avail == scanned) {
+            // no delimiter before EOF: the rest of the stream is the line
+            s->_eof = 1;
+            if (avail == 0) {
+                *plen = 0;
+                return NULL;
+            }
+            break;
+        }
+    }
+    size_t n = pd ? pd - (s->buf+s->bpos) + 1 : avail;
+    char *line = s->buf + s->bpos;
+    s->bpos += n;
+    *plen = n;
+    return line;
+}
+
 static void _ios_init(ios_t *s)
 {
     // put all fields in a sane initial state
@@ -833,6 +889,7 @@ static void _ios_init(ios_t *s)
     s->readable = 1;
     s->writable = 1;
     s->rereadable = 0;
+    s->mapped = 0;
 }
 
 /* stream object initializers. we do no allocation. */
@@ -944,6 +1001,43 @@ ios_t *ios_static_buffer(ios_t *s, char *buf, size_t sz)
     return s;
 }
 
+// read-only stream over a whole file mapped into memory. it behaves like
+// ios_static_buffer, so reads, ios_readline and ios_copyuntil work directly
+// on the mapped pages with no read buffer in between. the descriptor stays
+// open (so the stream counts as open) until ios_close.
+ios_t *ios_mmap(ios_t *s, const char *fname)
+{
+#if defined(_OS_WINDOWS_)
+    return ios_file(s, fname, 1, 0, 0, 0);
+#else
+    int fd = open_cloexec(fname, O_RDONLY, 0);
+    struct stat st;
+    if (fd == -1 || fstat(fd, &st) != 0)
+        goto open_file_err;
+    ios_mem(s, 0);
+    if (st.st_size > 0) {
+        char *buf = (char*)mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (buf == (char*)MAP_FAILED)
+            goto open_file_err;
+#ifdef MADV_SEQUENTIAL
+        madvise(buf, st.st_size, MADV_SEQUENTIAL);
+#endif
+        ios_setbuf(s, buf, st.st_size, 0);
+        s->size = st.st_size;
+        s->mapped = 1;
+    }
+    ios_set_readonly(s);
+    s->fd = fd;
+    s->ownfd = 1;
+    return s;
+ open_file_err:
+    if (fd != -1)
+        close(fd);
+    s->fd = -1;
+    return NULL;
+#endif
+}
+
 ios_t *ios_fd(ios_t *s, long fd, int isfile, int own)
 {
     _ios_init(s);
@@ -1105,15 +1199,126 @@ void ios_purge(ios_t *s)
 
 char *ios_readline(ios_t *s)
 {
-    ios_t dest;
-    ios_mem(&dest, 0);
-    ios_copyuntil(&dest, s, '\n');
     size_t n;
-    return ios_takebuf(&dest, &n);
+    char *line = ios_readuntil_view(s, '\n', &n);
+    char *buf = (char*)LLT_ALLOC(n+1);
+    if (buf == NULL)
+        return NULL;
+    if (n)
+        memcpy(buf, line, n);
+    buf[n] = '\0';
+    return buf;
 }
 
 extern int vasprintf(char **strp, const char *fmt, va_list ap);
 
+// the fast formatter handles conversions with no flags or field width:
+// %% %c %s %.*s %p and d i u x with an optional l, ll or z length modifier.
+// returns the length of the specifier after the '%', or 0 if unsupported.
+static size_t _fmt_spec_len(const char *f)
+{
+    size_t n = 0;
+    if (f[0] == '%' || f[0] == 'c' || f[0] == 's' || f[0] == 'p')
+        return 1;
+    if (f[0] == '.' && f[1] == '*' && f[2] == 's')
+        return 3;
+    if (f[0] == 'z')
+        n = 1;
+    else if (f[0] == 'l')
+        n = f[1] == 'l' ? 2 : 1;
+    if (f[n] == 'd' || f[n] == 'i' || f[n] == 'u' || f[n] == 'x')
+        return n+1;
+    return 0;
+}
+
+static int _fmt_is_simple(const char *format)
+{
+    const char *p = format;
+    while ((p = strchr(p, '%')) != NULL) {
+        size_t n = _fmt_spec_len(p+1);
+        if (n == 0)
+            return 0;
+        p += n+1;
+    }
+    return 1;
+}
+
+// format straight into the stream with no temporary allocation; integers go
+// through uint2str. only for formats accepted by _fmt_is_simple.
+static int _ios_fast_vprintf(ios_t *s, const char *format, va_list *ap)
+{
+    char num[24];
+    size_t total = 0;
+    const char *p = format;
+    while (1) {
+        const char *pct = strchr(p, '%');
+        size_t lit = pct ? (size_t)(pct - p) : strlen(p);
+        if (lit > 0)
+            total += ios_write(s, p, lit);
+        if (pct == NULL)
+            break;
+        const char *f = pct+1;
+        size_t n = _fmt_spec_len(f);
+        char conv = f[n-1];
+        const char *str = num;
+        size_t len;
+        if (conv == '%') {
+            str = "%"; len = 1;
+        }
+        else if (conv == 'c') {
+            num[0] = (char)va_arg(*ap, int); len = 1;
+        }
+        else if (conv == 's') {
+            int prec = n == 3 ? va_arg(*ap, int) : -1;
+            str = va_arg(*ap, const char*);
+            if (str == NULL)
+                str = "(null)";
+            if (prec < 0) {
+                len = strlen(str);
+            }
+            else {
+                const char *end = (const char*)memchr(str, '\0', prec);
+                len = end ? (size_t)(end - str) : (size_t)prec;
+            }
+        }
+        else {
+            uint64_t u;
+            int neg = 0;
+            uint32_t base = (conv == 'x' || conv == 'p') ? 16 : 10;
+            if (conv == 'p') {
+                u = (uintptr_t)va_arg(*ap, void*);
+            }
+            else if (conv == 'd' || conv == 'i') {
+                int64_t v = f[0] == 'z' ? (int64_t)va_arg(*ap, ssize_t) :
+                    f[0] == 'l' ? (n == 3 ? (int64_t)va_arg(*ap, long long) :
+                                            (int64_t)va_arg(*ap, long)) :
+                    (int64_t)va_arg(*ap, int);
+                neg = v < 0;
+                u = neg ? -(uint64_t)v : (uint64_t)v;
+            }
+            else {
+                u = f[0] == 'z' ? (uint64_t)va_arg(*ap, size_t) :
+                    f[0] == 'l' ? (n == 3 ? (uint64_t)va_arg(*ap, unsigned long long) :
+                                            (uint64_t)va_arg(*ap, unsigned long)) :
+                    (uint64_t)va_arg(*ap, unsigned int);
+            }
+            char *digits = uint2str(num+3, sizeof(num)-3, u, base);
+            if (conv == 'p') {
+                *--digits = 'x';
+                *--digits = '0';
+            }
+            else if (neg) {
+                *--digits = '-';
+            }
+            str = digits;
+            len = strlen(digits);
+        }
+        total += ios_write(s, str, len);
+        p = f + n;
+    }
+    return (int)total;
+}
+
 int ios_vprintf(ios_t *s, const char *format, va_list args)
 {
     char *str=NULL;
@@ -1125,7 +1330,13 @@ int ios_vprintf(ios_t *s, const char *format, va_list args)
     va_copy(al, args);
 #endif /* _OS_WINDOWS_ */
 
-    if (s->state == bst_wr && s->bpos < s->maxsize && s->bm != bm_none) {
+    if (_fmt_is_simple(format)) {
+        c = _ios_fast_vprintf(s, format, &al);
+        va_end(al);
+        return c;
+    }
+    if (s->writable && (s->state == bst_wr || s->bm == bm_mem) &&
+        s->bpos < s->maxsize && s->bm != bm_none) {
         size_t avail = s->maxsize - s->bpos;
         char *start = s->buf + s->bpos;
         c = vsnprintf(start, avail, format, args);
@@ -1134,6 +1345,7 @@ int ios_vprintf(ios_t *s, const char *format, va_list args)
             return c;
         }
         if (c < avail) {
+            s->state = bst_wr;
             s->bpos += (size_t)c;
             _write_update_pos(s);
             // TODO: only works right if newline is at end
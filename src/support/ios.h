@@ -57,6 +57,9 @@ typedef struct {
     // again any number of times. usually only true for files and strings.
     unsigned char rereadable:1;
 
+    // buf is a read-only file mapping owned by the stream (see ios_mmap)
+    unsigned char mapped:1;
+
     // this enables "stenciled writes". you can alternately write and
     // seek without flushing in between. this performs read-before-write
     // to populate the buffer, so "rereadable" capability is required.
@@ -94,6 +97,10 @@ JL_DLLEXPORT void ios_set_readonly(ios_t *s);
 JL_DLLEXPORT size_t ios_copy(ios_t *to, ios_t *from, size_t nbytes);
 JL_DLLEXPORT size_t ios_copyall(ios_t *to, ios_t *from);
 JL_DLLEXPORT size_t ios_copyuntil(ios_t *to, ios_t *from, char delim);
+// consume up to and including the next delim (or to EOF) and return it as a
+// pointer into the stream's own buffer, valid until the next operation on s.
+// returns NULL with *plen == 0 at EOF.
+JL_DLLEXPORT char *ios_readuntil_view(ios_t *s, char delim, size_t *plen);
 // ensure at least n bytes are buffered if possible. returns # available.
 JL_DLLEXPORT size_t ios_readprep(ios_t *from, size_t n);
 
@@ -104,6 +111,7 @@ JL_DLLEXPORT ios_t *ios_mkstemp(ios_t *f, char *fname);
 JL_DLLEXPORT ios_t *ios_mem(ios_t *s, size_t initsize);
 ios_t *ios_str(ios_t *s, char *str);
 ios_t *ios_static_buffer(ios_t *s, char *buf, size_t sz);
+JL_DLLEXPORT ios_t *ios_mmap(ios_t *s, const char *fname);
 JL_DLLEXPORT ios_t *ios_fd(ios_t *s, long fd, int isfile, int own);
 // todo: ios_socket
 extern JL_DLLEXPORT ios_t *ios_stdin;
@@ -1,6 +1,8 @@
 #define _GNU_SOURCE
 #include "libsupport.h"
 #include <stdlib.h>
+#include <stdint.h>
+#include <float.h>
 #include <locale.h>
 
 #if defined(__APPLE__) || defined(__FreeBSD__)
@@ -292,6 +294,144 @@ JL_DLLEXPORT float jl_strtof_c(const char *nptr, char **endptr)
 
 #endif
 
+// Fast path for plain decimals (Clinger's algorithm): when the significand m
+// fits in the destination mantissa and 10^|e| is exactly representable, a
+// single correctly rounded multiply or divide gives the correctly rounded
+// result. Works on a buffer with a length, with no NUL terminator needed.
+// Anything else (more digits, large exponents, hex, inf/nan, leading spaces)
+// returns 0 so the caller can fall back to jl_strtod_c.
+
+typedef struct {
+  int neg;
+  uint64_t m;      // significant digits, at most 19 of them
+  int64_t e;       // decimal exponent applied to m
+  size_t nread;    // bytes consumed
+} decimal_t;
+
+static int parse_decimal(const char *s, size_t len, decimal_t *d)
+{
+  const char *p = s, *end = s + len;
+  int ndigits = 0, any = 0;
+  d->neg = 0;
+  d->m = 0;
+  d->e = 0;
+  if (p < end && (*p == '-' || *p == '+')) {
+    d->neg = (*p == '-');
+    p++;
+  }
+  for (; p < end && *p >= '0' && *p <= '9'; p++) {
+    any = 1;
+    if (d->m == 0 && *p == '0')
+      continue;
+    if (++ndigits > 19)
+      return 0;
+    d->m = d->m*10 + (*p - '0');
+  }
+  if (p < end && *p == '.') {
+    p++;
+    for (; p < end && *p >= '0' && *p <= '9'; p++) {
+      any = 1;
+      d->e--;
+      if (d->m == 0 && *p == '0')
+        continue;
+      if (++ndigits > 19)
+        return 0;
+      d->m = d->m*10 + (*p - '0');
+    }
+  }
+  if (!any)
+    return 0;
+  if (p < end && (*p == 'e' || *p == 'E')) {
+    const char *q = p+1;
+    int eneg = 0;
+    int64_t x = 0;
+    if (q < end && (*q == '-' || *q == '+')) {
+      eneg = (*q == '-');
+      q++;
+    }
+    if (q == end || *q < '0' || *q > '9')
+      return 0;
+    for (; q < end && *q >= '0' && *q <= '9'; q++) {
+      if (x > 100000)
+        return 0;
+      x = x*10 + (*q - '0');
+    }
+    d->e += eneg ? -x : x;
+    p = q;
+  }
+  d->nread = p - s;
+  return 1;
+}
+
+#if !defined(FLT_EVAL_METHOD) || FLT_EVAL_METHOD == 0
+static const double pow10_d[] = {
+  1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+  1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+JL_DLLEXPORT size_t jl_strtod_fast(const char *s, size_t len, double *out)
+{
+  decimal_t d;
+  if (!parse_decimal(s, len, &d))
+    return 0;
+  double v;
+  if (d.m == 0) {
+    v = 0.0;
+  }
+  else {
+    if (d.m > ((uint64_t)1 << 53))
+      return 0;
+    // move excess powers of ten into the significand while it stays exact
+    while (d.e > 22 && d.m <= ((uint64_t)1 << 53) / 10) {
+      d.m *= 10;
+      d.e--;
+    }
+    if (d.e > 22 || d.e < -22)
+      return 0;
+    v = (double)d.m;
+    v = d.e >= 0 ? v * pow10_d[d.e] : v / pow10_d[-d.e];
+  }
+  *out = d.neg ? -v : v;
+  return d.nread;
+}
+
+JL_DLLEXPORT size_t jl_strtof_fast(const char *s, size_t len, float *out)
+{
+  decimal_t d;
+  if (!parse_decimal(s, len, &d))
+    return 0;
+  float v;
+  if (d.m == 0) {
+    v = 0.0f;
+  }
+  else {
+    if (d.m > ((uint64_t)1 << 24))
+      return 0;
+    while (d.e > 10 && d.m <= ((uint64_t)1 << 24) / 10) {
+      d.m *= 10;
+      d.e--;
+    }
+    if (d.e > 10 || d.e < -10)
+      return 0;
+    v = (float)d.m;
+    v = d.e >= 0 ? v * (float)pow10_d[d.e] : v / (float)pow10_d[-d.e];
+  }
+  *out = d.neg ? -v : v;
+  return d.nread;
+}
+#else
+// excess precision in intermediate results would break the exactness argument
+JL_DLLEXPORT size_t jl_strtod_fast(const char *s, size_t len, double *out)
+{
+  return 0;
+}
+
+JL_DLLEXPORT size_t jl_strtof_fast(const char *s, size_t len, float *out)
+{
+  return 0;
+}
+#endif
+
 #ifdef __cplusplus
 }
 #endif
@@ -9,6 +9,10 @@ extern "C" {
 
 JL_DLLEXPORT double jl_strtod_c(const char *nptr, char **endptr);
 JL_DLLEXPORT float jl_strtof_c(const char *nptr, char **endptr);
+// parse a plain decimal from s[0:len) if it can be done exactly and quickly;
+// returns the number of bytes consumed, or 0 to fall back to jl_strtod_c
+JL_DLLEXPORT size_t jl_strtod_fast(const char *s, size_t len, double *out);
+JL_DLLEXPORT size_t jl_strtof_fast(const char *s, size_t len, float *out);
 
 #ifdef __cplusplus
 }
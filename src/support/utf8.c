@@ -57,6 +57,35 @@ static const char trailingBytesForUTF8[256] = {
     2,2,2,2,2,2,2,2,2,2,2,2,2,2,2,2, 3,3,3,3,3,3,3,3,4,4,4,4,5,5,5,5
 };
 
+/* word-at-a-time helpers: 8 bytes are tested with one load and mask, which
+   is what makes the ASCII runs below cheap */
+#define U8_HIGH_BITS 0x8080808080808080ULL
+
+static inline uint64_t u8_load64(const unsigned char *p)
+{
+    uint64_t w;
+    memcpy(&w, p, sizeof(w));
+    return w;
+}
+
+/* pointer to the first byte >= 0x80 in [p, pend), or pend */
+static inline const unsigned char *u8_skip_ascii(const unsigned char *p,
+                                                 const unsigned char *pend)
+{
+    while (pend - p >= 8 && !(u8_load64(p) & U8_HIGH_BITS))
+        p += 8;
+    while (p < pend && !(*p & 0x80))
+        p++;
+    return p;
+}
+
+/* number of bytes in the word that start a character (are not 10xxxxxx) */
+static inline size_t u8_count_starts64(uint64_t w)
+{
+    uint64_t cont = (w & ~(w << 1)) & U8_HIGH_BITS;
+    return 8 - (size_t)(((cont >> 7) * 0x0101010101010101ULL) >> 56);
+}
+
 /* returns length of next utf-8 sequence */
 size_t u8_seqlen(const char *s)
 {
@@ -211,6 +240,10 @@ size_t u8_offset(const char *s, size_t charnum)
 {
     size_t i=0;
 
+    while (charnum >= 8 && !(u8_load64((const unsigned char*)s+i) & U8_HIGH_BITS)) {
+        i += 8;
+        charnum -= 8;
+    }
     while (charnum > 0) {
         if (s[i++] & 0x80) {
             (void)(isutf(s[++i]) || isutf(s[++i]) || ++i);
@@ -224,6 +257,11 @@ size_t u8_offset(const char *s, size_t charnum)
 size_t u8_charnum(const char *s, size_t offset)
 {
     size_t charnum = 0;
+    while (offset >= 8) {
+        charnum += u8_count_starts64(u8_load64((const unsigned char*)s));
+        s += 8;
+        offset -= 8;
+    }
     if (offset) {
        do {
           // Simply not count continuation bytes
@@ -549,10 +587,9 @@ int u8_isvalid(const char *str, size_t len)
     pnt = (unsigned char *)str;
     pend = (unsigned char *)str + len;
     // First scan for non-ASCII characters as fast as possible
-    do {
-        if (*pnt++ & 0x80) goto chkutf8;
-    } while (pnt < pend);
-    return 1;
+    pnt = u8_skip_ascii(pnt, pend);
+    if (pnt == pend) return 1;
+    pnt++;
 
     // Check validity of UTF-8 sequences
 chkutf8:
@@ -587,11 +624,21 @@ chkutf8:
         pnt += 3;
     }
     // Find next non-ASCII characters as fast as possible
-    while (pnt < pend) {
-        if (*pnt++ & 0x80) goto chkutf8;
+    pnt = u8_skip_ascii(pnt, pend);
+    if (pnt < pend) {
+        pnt++;
+        goto chkutf8;
     }
     return 2;   // Valid UTF-8
 }
+
+void u8_isvalid_batch(const char **strs, const size_t *lens, size_t n,
+                      int *results)
+{
+    size_t i;
+    for (i = 0; i < n; i++)
+        results[i] = u8_isvalid(strs[i], lens[i]);
+}
 #ifdef __cplusplus
 }
 #endif
@@ -96,6 +96,9 @@ size_t u8_printf(const char *fmt, ...);
 
 /* determine whether a sequence of bytes is valid UTF-8. length is in bytes */
 JL_DLLEXPORT int u8_isvalid(const char *str, size_t length);
+/* u8_isvalid of each of n strings, into results */
+JL_DLLEXPORT void u8_isvalid_batch(const char **strs, const size_t *lens,
+                                   size_t n, int *results);
 
 #ifdef __cplusplus
 }
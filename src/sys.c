@@ -155,6 +155,70 @@ JL_DLLEXPORT int32_t jl_fstat(int fd, char *statbuf)
     return ret;
 }
 
+// batched asynchronous stat: every request goes to the libuv threadpool at
+// once, and cb(data) runs on the event loop after the last one finishes
+typedef struct {
+    size_t pending;
+    char *statbufs;
+    int32_t *results;
+    void *data;
+    void (*cb)(void*);
+    uv_fs_t reqs[1];
+} jl_fs_batch_t;
+
+static void jl_fs_batch_done(jl_fs_batch_t *batch)
+{
+    if (--batch->pending == 0) {
+        batch->cb(batch->data);
+        free(batch);
+    }
+}
+
+static void jl_fs_stat_batch_cb(uv_fs_t *req)
+{
+    jl_fs_batch_t *batch = (jl_fs_batch_t*)req->data;
+    size_t i = req - batch->reqs;
+    batch->results[i] = req->result;
+    if (req->result == 0)
+        memcpy(batch->statbufs + i*sizeof(uv_stat_t), req->ptr, sizeof(uv_stat_t));
+    uv_fs_req_cleanup(req);
+    jl_fs_batch_done(batch);
+}
+
+// stat (or lstat, if follow is 0) each of the n paths into statbufs, storing
+// the status of each in results. returns 1 if cb will be called once they
+// are all done, or 0 if nothing could be submitted and no callback follows.
+JL_DLLEXPORT int jl_fs_stat_batch(uv_loop_t *loop, const char **paths, size_t n,
+                                  int follow, char *statbufs, int32_t *results,
+                                  void *data, void (*cb)(void*))
+{
+    jl_fs_batch_t *batch = (jl_fs_batch_t*)malloc(sizeof(jl_fs_batch_t) +
+                                                  n*sizeof(uv_fs_t));
+    // the extra count keeps the batch alive until every request is submitted
+    batch->pending = n + 1;
+    batch->statbufs = statbufs;
+    batch->results = results;
+    batch->data = data;
+    batch->cb = cb;
+    size_t i;
+    for (i = 0; i < n; i++) {
+        uv_fs_t *req = &batch->reqs[i];
+        req->data = batch;
+        int err = follow ? uv_fs_stat(loop, req, paths[i], jl_fs_stat_batch_cb) :
+                           uv_fs_lstat(loop, req, paths[i], jl_fs_stat_batch_cb);
+        if (err) {
+            results[i] = err;
+            batch->pending--;
+        }
+    }
+    if (batch->pending == 1) {
+        free(batch);
+        return 0;
+    }
+    batch->pending--;
+    return 1;
+}
+
 JL_DLLEXPORT unsigned int jl_stat_dev(char *statbuf)
 {
     return ((uv_stat_t*)statbuf)->st_dev;
@@ -278,21 +342,11 @@ JL_DLLEXPORT jl_value_t *jl_readuntil(ios_t *s, uint8_t delim)
         s->bpos += n;
     }
     else {
-        a = jl_alloc_array_1d(jl_array_uint8_type, 80);
-        ios_t dest;
-        ios_mem(&dest, 0);
-        ios_setbuf(&dest, (char*)a->data, 80, 0);
-        size_t n = ios_copyuntil(&dest, s, delim);
-        if (dest.buf != a->data) {
-            a = jl_takebuf_array(&dest);
-        }
-        else {
-#ifdef STORE_ARRAY_LEN
-            a->length = n;
-#endif
-            a->nrows = n;
-            ((char*)a->data)[n] = '\0';
-        }
+        size_t n;
+        char *line = ios_readuntil_view(s, delim, &n);
+        a = jl_alloc_array_1d(jl_array_uint8_type, n);
+        if (n)
+            memcpy(jl_array_data(a), line, n);
     }
     return (jl_value_t*)a;
 }
@@ -386,12 +440,176 @@ JL_DLLEXPORT int jl_cpu_cores(void)
 }
 
 // -- high resolution timers --
+
+#ifdef HAVE_CPUID
+#include "ia_misc.h"
+
+// the TSC clock: the time at tsc_t0 ticks was tsc_ns0 ns of uv_hrtime, which
+// is a vDSO call on Linux but still a few tens of ns and a syscall elsewhere.
+// the rate is measured from the first reading of both clocks, once at the
+// end of the calibration and again every HRTIME_RECHECK_NS, when the offset
+// from the OS clock is also slewed away. tsc_seq is odd while they change
+#define HRTIME_OS          0
+#define HRTIME_CALIBRATING 1
+#define HRTIME_TSC         2
+static volatile int hrtime_source = HRTIME_OS;
+static volatile uint32_t tsc_seq;
+static volatile uint64_t tsc_t0, tsc_ns0;
+static volatile double tsc_ns_per_tick;
+static uint64_t tsc_ref_t, tsc_ref_ns;  // the first reading of both clocks
+static volatile uint64_t tsc_next_check;
+JL_DEFINE_MUTEX(hrtime)
+
+JL_DLLEXPORT void jl_cpuid(int32_t CPUInfo[4], int32_t InfoType);
+
+static int tsc_is_invariant(void)
+{
+    int32_t info[4];
+    jl_cpuid(info, 0x80000000);
+    if ((uint32_t)info[0] < 0x80000007)
+        return 0;
+    jl_cpuid(info, 0x80000007);
+    return (info[3] & (1 << 8)) != 0;
+}
+
+// read both clocks at the same time: of a few tries, the one with the fewest
+// ticks around the OS clock read, taken at their midpoint
+static void hrtime_sample(uint64_t *ns, uint64_t *t)
+{
+    uint64_t best = (uint64_t)-1;
+    int i;
+    for (i = 0; i < HRTIME_SAMPLES; i++) {
+        uint64_t t1 = rdtsc();
+        uint64_t n = uv_hrtime();
+        uint64_t t2 = rdtsc();
+        if (t2 >= t1 && t2 - t1 < best) {
+            best = t2 - t1;
+            *ns = n;
+            *t = t1 + (t2 - t1) / 2;
+        }
+    }
+    if (best == (uint64_t)-1) {
+        *ns = uv_hrtime();
+        *t = rdtsc();
+    }
+}
+
+static uint64_t tsc_time(uint64_t t)
+{
+    uint32_t seq;
+    uint64_t t0, ns0;
+    double scale;
+    do {
+        seq = tsc_seq;
+        cpu_lfence();
+        t0 = tsc_t0;
+        ns0 = tsc_ns0;
+        scale = tsc_ns_per_tick;
+        cpu_lfence();
+    } while ((seq & 1) || seq != tsc_seq);
+    // the TSC of another cpu than the one that set t0 can lag a little
+    int64_t dt = (int64_t)(t - t0);
+    if (dt < 0)
+        dt = 0;
+    return ns0 + (uint64_t)((double)dt * scale);
+}
+
+// with the hrtime lock held
+static void tsc_set(uint64_t t0, uint64_t ns0, double scale)
+{
+    tsc_seq++;
+    cpu_sfence();
+    tsc_t0 = t0;
+    tsc_ns0 = ns0;
+    tsc_ns_per_tick = scale;
+    cpu_sfence();
+    tsc_seq++;
+    tsc_next_check = t0 + (uint64_t)(HRTIME_RECHECK_NS / scale);
+}
+
+static uint64_t hrtime_calibrate(void)
+{
+    uint64_t ns, t;
+    hrtime_sample(&ns, &t);
+    if (ns - tsc_ref_ns < HRTIME_CALIBRATION_NS || t <= tsc_ref_t)
+        return ns;
+    // continue from this point at the measured rate, so that the time
+    // doesn't jump
+    tsc_set(t, ns, (double)(ns - tsc_ref_ns) / (double)(t - tsc_ref_t));
+    cpu_sfence();
+    hrtime_source = HRTIME_TSC;
+    return ns;
+}
+
+// measure the rate again over the longer baseline, and run the clock at it,
+// sped up or slowed down a little until it meets the OS clock again
+static void hrtime_recheck(void)
+{
+    uint64_t ns, t;
+    hrtime_sample(&ns, &t);
+    if (t <= tsc_ref_t || ns <= tsc_ref_ns)
+        return;
+    uint64_t now = tsc_time(t);
+    double scale = (double)(ns - tsc_ref_ns) / (double)(t - tsc_ref_t);
+    double slew = ((double)ns - (double)now) / HRTIME_RECHECK_NS;
+    if (slew > HRTIME_MAX_SLEW)
+        slew = HRTIME_MAX_SLEW;
+    else if (slew < -HRTIME_MAX_SLEW)
+        slew = -HRTIME_MAX_SLEW;
+    tsc_set(t, now, scale * (1 + slew));
+}
+#endif
+
+void jl_init_hrtime(void)
+{
+#ifdef HAVE_CPUID
+    const char *tsc = getenv(HRTIME_TSC_NAME);
+    if ((tsc && strcmp(tsc, "0") == 0) || !tsc_is_invariant())
+        return;
+    hrtime_sample(&tsc_ref_ns, &tsc_ref_t);
+    hrtime_source = HRTIME_CALIBRATING;
+#endif
+}
+
 // Returns time in nanosec
 JL_DLLEXPORT uint64_t jl_hrtime(void)
 {
+#ifdef HAVE_CPUID
+    int source = hrtime_source;
+    if (source == HRTIME_TSC) {
+        cpu_lfence();
+        uint64_t t = rdtsc();
+        if (__unlikely(t >= tsc_next_check)) {
+            JL_LOCK(hrtime);
+            if (t >= tsc_next_check)
+                hrtime_recheck();
+            JL_UNLOCK(hrtime);
+            t = rdtsc();
+        }
+        return tsc_time(t);
+    }
+    if (source == HRTIME_CALIBRATING) {
+        JL_LOCK(hrtime);
+        uint64_t ns = hrtime_source == HRTIME_CALIBRATING ? hrtime_calibrate() : 0;
+        JL_UNLOCK(hrtime);
+        if (ns != 0)
+            return ns;
+        return jl_hrtime();
+    }
+#endif
     return uv_hrtime();
 }
 
+// whether jl_hrtime reads the TSC
+JL_DLLEXPORT int jl_hrtime_is_tsc(void)
+{
+#ifdef HAVE_CPUID
+    return hrtime_source == HRTIME_TSC;
+#else
+    return 0;
+#endif
+}
+
 // -- iterating the environment --
 
 #ifdef __APPLE__
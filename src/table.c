@@ -1,14 +1,24 @@
 // This file is a part of Julia. License is MIT: http://julialang.org/license
 
-#define hash_size(h) (jl_array_len(h)/2)
-
 // compute empirical max-probe for a given size
 #define max_probe(size) ((size)<=1024 ? 16 : (size)>>6)
 
 #define keyhash(k)     jl_object_id(k)
 #define h2index(hv,sz) (index_t)(((hv) & ((sz)-1))*2)
 
-static void **jl_table_lookup_bp(jl_array_t **pa, void *key);
+// The table is an array of key/value pairs, probed linearly with robin hood
+// hashing: an insertion takes the slot of any entry it meets that is closer
+// to its home slot than the new key would be, and moves that entry on. This
+// keeps every probe sequence short even at high load, and a lookup can stop
+// at the first entry that is closer to its home than the key would be.
+// Deleted entries keep their slot, with the value cleared, until the next
+// rehash. Lookups step over them and insertions never reuse them, so they
+// never break that invariant.
+
+// distance of the entry at tab[index], whose key hashes to hv, from its home
+#define probe_dist(hv,index,alen) ((((index) - h2index(hv,(alen)/2)) & ((alen)-1))/2)
+
+static void **jl_table_insert_bp(jl_array_t **pa, void *key, uint_t hv);
 
 void jl_idtable_rehash(jl_array_t **pa, size_t newsz)
 {
@@ -22,7 +32,7 @@ void jl_idtable_rehash(jl_array_t **pa, size_t newsz)
     // it should be changed if this assumption no longer holds
     for(i=0; i < sz; i+=2) {
         if (ol[i+1] != NULL) {
-            (*jl_table_lookup_bp(pa, ol[i])) = ol[i+1];
+            (*jl_table_insert_bp(pa, ol[i], keyhash((jl_value_t*)ol[i]))) = ol[i+1];
             jl_gc_wb(*pa, ol[i+1]);
              // it is however necessary here because allocation
             // can (and will) occur in a recursive call inside table_lookup_bp
@@ -30,87 +40,115 @@ void jl_idtable_rehash(jl_array_t **pa, size_t newsz)
     }
 }
 
-static void **jl_table_lookup_bp(jl_array_t **pa, void *key)
+/* returns bp if key is in hash, otherwise NULL */
+static void **jl_table_peek_bp(jl_array_t *a, void *key)
 {
-    uint_t hv;
-    jl_array_t *a = *pa;
-    size_t orig, index, iter;
-    size_t newsz, sz = hash_size(a);
-    size_t maxprobe = max_probe(sz);
+    size_t alen = jl_array_len(a);
     void **tab = (void**)a->data;
-
-    hv = keyhash((jl_value_t*)key);
- retry_bp:
-    iter = 0;
-    index = h2index(hv,sz);
-    sz *= 2;
-    orig = index;
+    uint_t hv = keyhash((jl_value_t*)key);
+    size_t index = h2index(hv, alen/2);
+    size_t orig = index;
+    size_t iter = 0;
 
     do {
-        if (tab[index+1] == NULL) {
-            tab[index] = key;
-            jl_gc_wb(a, key);
-            return &tab[index+1];
+        void *k = tab[index];
+        if (k == NULL)
+            return NULL;
+        if (tab[index+1] != NULL) {
+            uint_t hk = keyhash((jl_value_t*)k);
+            if (hk == hv && jl_egal((jl_value_t*)key, (jl_value_t*)k))
+                return &tab[index+1];
+            // the key would have taken this slot had it been inserted
+            if (probe_dist(hk, index, alen) < iter)
+                return NULL;
         }
 
-        if (jl_egal((jl_value_t*)key, (jl_value_t*)tab[index]))
-            return &tab[index+1];
-
-        index = (index+2) & (sz-1);
+        index = (index+2) & (alen-1);
         iter++;
-        if (iter > maxprobe)
-            break;
     } while (index != orig);
 
-    /* table full */
-    /* quadruple size, rehash, retry the insert */
-    /* it's important to grow the table really fast; otherwise we waste */
-    /* lots of time rehashing all the keys over and over. */
-    sz = jl_array_len(a);
-    if (sz >= (1<<19) || (sz <= (1<<8)))
-        newsz = sz<<1;
-    else if (sz <= HT_N_INLINE)
-        newsz = HT_N_INLINE;
-    else
-        newsz = sz<<2;
-    jl_idtable_rehash(pa, newsz);
-
-    a = *pa;
-    tab = (void**)a->data;
-    sz = hash_size(a);
-    maxprobe = max_probe(sz);
-
-    goto retry_bp;
-
     return NULL;
 }
 
-/* returns bp if key is in hash, otherwise NULL */
-/* if return is non-NULL and *bp == NULL then key was deleted */
-static void **jl_table_peek_bp(jl_array_t *a, void *key)
+/* inserts key, which must not be in the hash, and returns its bp */
+static void **jl_table_insert_bp(jl_array_t **pa, void *key, uint_t hv)
 {
-    size_t sz = hash_size(a);
-    size_t maxprobe = max_probe(sz);
+    int purged = 0;
+ retry_bp: ;
+    jl_array_t *a = *pa;
     void **tab = (void**)a->data;
-    uint_t hv = keyhash((jl_value_t*)key);
-    size_t index = h2index(hv, sz);
-    sz *= 2;
-    size_t orig = index;
+    size_t alen = jl_array_len(a);
+    size_t maxprobe = max_probe(alen/2);
+    size_t index = h2index(hv, alen/2);
     size_t iter = 0;
 
-    do {
-        if (tab[index] == NULL)
-            return NULL;
-        if (jl_egal((jl_value_t*)key, (jl_value_t*)tab[index]))
-            return &tab[index+1];
-
-        index = (index+2) & (sz-1);
+    // the insertion moves entries up to the first empty slot
+    while (iter <= maxprobe && tab[(index + 2*iter) & (alen-1)] != NULL)
         iter++;
-        if (iter > maxprobe)
-            break;
-    } while (index != orig);
+    if (iter > maxprobe) {
+        /* table full */
+        /* if it is mostly deleted entries, just drop them; otherwise */
+        /* quadruple size, rehash, retry the insert */
+        /* it's important to grow the table really fast; otherwise we waste */
+        /* lots of time rehashing all the keys over and over. */
+        size_t i, live = 0, newsz, sz = alen;
+        for (i = 0; i < alen; i += 2)
+            live += (tab[i+1] != NULL);
+        if (!purged && live*4 <= alen/2)
+            newsz = sz;
+        else if (sz >= (1<<19) || (sz <= (1<<8)))
+            newsz = sz<<1;
+        else if (sz <= HT_N_INLINE)
+            newsz = HT_N_INLINE;
+        else
+            newsz = sz<<2;
+        purged = (newsz == sz);
+        jl_idtable_rehash(pa, newsz);
+        goto retry_bp;
+    }
 
-    return NULL;
+    // walk the probe sequence, handing the slot to whichever of the entry in
+    // hand and the resident entry is farther from home. nothing allocates
+    // here, so the entry in hand needs no rooting.
+    void *k = key, *v = NULL;
+    size_t dist = 0;
+    void **bp = NULL;
+    while (1) {
+        if (tab[index] == NULL) {
+            tab[index] = k;
+            tab[index+1] = v;
+            jl_gc_wb(a, k);
+            if (v != NULL)
+                jl_gc_wb(a, v);
+            return bp != NULL ? bp : &tab[index+1];
+        }
+        if (tab[index+1] != NULL) {
+            size_t d = probe_dist(keyhash((jl_value_t*)tab[index]), index, alen);
+            if (d < dist) {
+                void *rk = tab[index], *rv = tab[index+1];
+                tab[index] = k;
+                tab[index+1] = v;
+                jl_gc_wb(a, k);
+                if (v != NULL)
+                    jl_gc_wb(a, v);
+                if (bp == NULL)
+                    bp = &tab[index+1];
+                k = rk;
+                v = rv;
+                dist = d;
+            }
+        }
+        index = (index+2) & (alen-1);
+        dist++;
+    }
+}
+
+static void **jl_table_lookup_bp(jl_array_t **pa, void *key)
+{
+    void **bp = jl_table_peek_bp(*pa, key);
+    if (bp != NULL)
+        return bp;
+    return jl_table_insert_bp(pa, key, keyhash((jl_value_t*)key));
 }
 
 JL_DLLEXPORT
@@ -126,7 +164,7 @@ JL_DLLEXPORT
 jl_value_t *jl_eqtable_get(jl_array_t *h, void *key, jl_value_t *deflt)
 {
     void **bp = jl_table_peek_bp(h, key);
-    if (bp == NULL || *bp == NULL)
+    if (bp == NULL)
         return deflt;
     return (jl_value_t*)*bp;
 }
@@ -135,7 +173,7 @@ JL_DLLEXPORT
 jl_value_t *jl_eqtable_pop(jl_array_t *h, void *key, jl_value_t *deflt)
 {
     void **bp = jl_table_peek_bp(h, key);
-    if (bp == NULL || *bp == NULL)
+    if (bp == NULL)
         return deflt;
     jl_value_t *val = (jl_value_t*)*bp;
     *(bp-1) = jl_nothing; // clear the key
@@ -154,5 +192,5 @@ size_t jl_eqtable_nextind(jl_array_t *t, size_t i)
     return i;
 }
 
-#undef hash_size
 #undef max_probe
+#undef probe_dist
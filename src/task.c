@@ -140,6 +140,38 @@ extern size_t jl_page_size;
 jl_datatype_t *jl_task_type;
 #define jl_root_task (jl_get_ptls_states()->root_task)
 
+// Task statistics, always kept up to date (see jl_task_stats)
+// This struct must be kept in sync with the Julia type of the same name in base/task.jl
+typedef struct {
+    uint64_t    ntasks;         // tasks created
+    uint64_t    nswitches;      // switches to another task
+    uint64_t    saved_bytes;    // copied off the stack by the switches (COPY_STACKS)
+    uint64_t    restored_bytes; // copied back onto the stack
+    uint64_t    stack_allocs;   // task stacks mapped (POOLED_STACKS)
+    uint64_t    stack_reuses;   // task stacks taken from the pool instead
+} Task_Stats;
+
+static Task_Stats task_stats;
+
+// the threads count into the same counters
+#ifdef JULIA_ENABLE_THREADING
+#define TASK_STAT_ADD(field, n) JL_ATOMIC_FETCH_AND_ADD(task_stats.field, (uint64_t)(n))
+#define TASK_STAT_READ(field) JL_ATOMIC_FETCH_AND_ADD(task_stats.field, (uint64_t)0)
+#else
+#define TASK_STAT_ADD(field, n) (task_stats.field += (n))
+#define TASK_STAT_READ(field) (task_stats.field)
+#endif
+
+JL_DLLEXPORT void jl_task_stats(Task_Stats *stats)
+{
+    stats->ntasks = TASK_STAT_READ(ntasks);
+    stats->nswitches = TASK_STAT_READ(nswitches);
+    stats->saved_bytes = TASK_STAT_READ(saved_bytes);
+    stats->restored_bytes = TASK_STAT_READ(restored_bytes);
+    stats->stack_allocs = TASK_STAT_READ(stack_allocs);
+    stats->stack_reuses = TASK_STAT_READ(stack_reuses);
+}
+
 #ifdef COPY_STACKS
 #define jl_jmp_target (jl_get_ptls_states()->jmp_target)
 
@@ -168,6 +200,7 @@ static void NOINLINE save_stack(jl_task_t *t)
     }
     t->ssize = nb;
     memcpy(buf, (char*)&_x, nb);
+    TASK_STAT_ADD(saved_bytes, nb);
     // this task's stack could have been modified after
     // it was marked by an incremental collection
     // move the barrier back instead of walking it again here
@@ -187,6 +220,7 @@ void NOINLINE restore_stack(jl_task_t *t, jl_jmp_buf *where, char *p)
     jl_jmp_target = where;
     assert(t->stkbuf != NULL);
     memcpy(_x, t->stkbuf, t->ssize);
+    TASK_STAT_ADD(restored_bytes, t->ssize);
     jl_longjmp(*jl_jmp_target, 1);
 }
 #endif
@@ -231,11 +265,17 @@ static void throw_if_exception_set(jl_task_t *t)
 }
 
 static void record_backtrace(void);
+#ifndef COPY_STACKS
+static void release_finished_stack(void);
+#endif
 static void NOINLINE JL_NORETURN start_task(void)
 {
     // this runs the first time we switch to a task
     jl_task_t *t = jl_current_task;
     jl_value_t *res;
+#ifndef COPY_STACKS
+    release_finished_stack();
+#endif
     t->started = 1;
     if (t->exception != NULL && t->exception != jl_nothing) {
         record_backtrace();
@@ -296,9 +336,13 @@ static void ctx_switch(jl_task_t *t, jl_jmp_buf *where)
     //JL_SIGATOMIC_BEGIN();
     if (!jl_setjmp(jl_current_task->ctx, 0)) {
         jl_bt_size = 0;  // backtraces don't survive task switches, see e.g. issue #12485
-#ifdef COPY_STACKS
+        TASK_STAT_ADD(nswitches, 1);
         jl_task_t *lastt = jl_current_task;
+#ifdef COPY_STACKS
         save_stack(lastt);
+#else
+        if (lastt->state == done_sym || lastt->state == failed_sym)
+            jl_get_ptls_states()->finished_task = lastt;
 #endif
 
         // set up global state for new task
@@ -352,6 +396,9 @@ static void ctx_switch(jl_task_t *t, jl_jmp_buf *where)
         jl_longjmp(*where, 1);
 #endif
     }
+#ifndef COPY_STACKS
+    release_finished_stack();
+#endif
     //JL_SIGATOMIC_END();
 }
 
@@ -456,6 +503,77 @@ static void rebase_state(jl_jmp_buf *ctx, intptr_t local_sp, intptr_t new_sp)
 #error "COPY_STACKS must be defined on this platform."
 #endif
 }
+// task stacks are mapped with a guard page below them. stacks of the default
+// size go back to a pool when their task is done, so starting a task usually
+// just takes one off it
+static char *stack_pool[TASK_STACK_POOL_SIZE];
+static int stack_pool_n = 0;
+JL_DEFINE_MUTEX(stackpool)
+
+static char *alloc_stack(size_t ssize)
+{
+    size_t pagesz = jl_page_size;
+    char *stk = NULL;
+    if (ssize == DEFAULT_TASK_STACK_SIZE) {
+        JL_LOCK(stackpool);
+        if (stack_pool_n > 0)
+            stk = stack_pool[--stack_pool_n];
+        JL_UNLOCK(stackpool);
+        if (stk != NULL) {
+            TASK_STAT_ADD(stack_reuses, 1);
+            return stk;
+        }
+    }
+    stk = (char*)mmap(0, ssize + pagesz, PROT_READ | PROT_WRITE,
+                      MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (stk == MAP_FAILED)
+        jl_throw(jl_memory_exception);
+    TASK_STAT_ADD(stack_allocs, 1);
+    // add a guard page to detect stack overflow
+    if (mprotect(stk, pagesz, PROT_NONE) == -1) {
+        munmap(stk, ssize + pagesz);
+        jl_errorf("mprotect: %s", strerror(errno));
+    }
+    return stk;
+}
+
+static void free_stack(char *stk, size_t ssize)
+{
+    if (ssize == DEFAULT_TASK_STACK_SIZE) {
+        int pooled = 0;
+        JL_LOCK(stackpool);
+        if (stack_pool_n < TASK_STACK_POOL_SIZE) {
+            stack_pool[stack_pool_n++] = stk;
+            pooled = 1;
+        }
+        JL_UNLOCK(stackpool);
+        if (pooled)
+            return;
+    }
+    munmap(stk, ssize + jl_page_size);
+}
+
+static void release_task_stack(jl_task_t *t)
+{
+    if (t->stkbuf == NULL || t->stkbuf == (void*)(intptr_t)-1 ||
+        t == jl_all_task_states[t->tid].ptls->root_task)
+        return;
+    char *stk = (char*)t->stkbuf;
+    t->stkbuf = (void*)(intptr_t)-1;
+    free_stack(stk, t->ssize);
+}
+
+// called once we are running on another stack: nothing switches back to a
+// done task, so the stack of the one we left can be reused right away
+static void release_finished_stack(void)
+{
+    jl_task_t *t = jl_get_ptls_states()->finished_task;
+    if (t != NULL) {
+        jl_get_ptls_states()->finished_task = NULL;
+        release_task_stack(t);
+    }
+}
+
 static void init_task(jl_task_t *t, char* stack)
 {
     if (jl_setjmp(t->ctx, 0)) {
@@ -463,7 +581,7 @@ static void init_task(jl_task_t *t, char* stack)
     }
     // this runs when the task is created
     ptrint_t local_sp = (ptrint_t)&t;
-    ptrint_t new_sp = (ptrint_t)stack + t->ssize - _frame_offset;
+    ptrint_t new_sp = (ptrint_t)stack + jl_page_size + t->ssize - _frame_offset;
 #ifdef _P64
     // SP must be 16-byte aligned
     new_sp = new_sp&-16;
@@ -647,9 +765,16 @@ JL_DLLEXPORT size_t rec_backtrace_ctx(ptrint_t *data, size_t maxsize,
 // stacktrace using libunwind
 JL_DLLEXPORT size_t rec_backtrace(ptrint_t *data, size_t maxsize)
 {
+#if defined(_OS_LINUX_) && defined(_CPU_X86_64_)
+    // unw_backtrace steps through frames whose unwind info it has seen before
+    // with a cached plan, and only falls back to a full unw_step otherwise
+    int n = unw_backtrace((void**)data, maxsize > INT_MAX ? INT_MAX : (int)maxsize);
+    return n < 0 ? 0 : n;
+#else
     unw_context_t uc;
     unw_getcontext(&uc);
     return rec_backtrace_ctx(data, maxsize, &uc);
+#endif
 }
 JL_DLLEXPORT size_t rec_backtrace_ctx(ptrint_t *data, size_t maxsize,
                                       unw_context_t *uc)
@@ -692,9 +817,11 @@ size_t rec_backtrace_ctx_dwarf(ptrint_t *data, size_t maxsize, unw_context_t *uc
 #endif
 #endif
 
+size_t jl_bt_max_depth = JL_MAX_BT_SIZE;
+
 static void record_backtrace(void)
 {
-    jl_bt_size = rec_backtrace(jl_bt_data, JL_MAX_BT_SIZE);
+    jl_bt_size = rec_backtrace(jl_bt_data, jl_bt_max_depth);
 }
 
 static jl_value_t *array_ptr_void_type = NULL;
@@ -707,39 +834,112 @@ JL_DLLEXPORT jl_value_t *jl_backtrace_from_here(void)
         tp = jl_svec2(jl_voidpointer_type, jl_box_long(1));
         array_ptr_void_type = jl_apply_type((jl_value_t*)jl_array_type, tp);
     }
-    bt = jl_alloc_array_1d(array_ptr_void_type, JL_MAX_BT_SIZE);
-    size_t n = rec_backtrace((ptrint_t*)jl_array_data(bt), JL_MAX_BT_SIZE);
-    if (n < JL_MAX_BT_SIZE)
-        jl_array_del_end(bt, JL_MAX_BT_SIZE-n);
+    bt = jl_alloc_array_1d(array_ptr_void_type, jl_bt_max_depth);
+    size_t n = rec_backtrace((ptrint_t*)jl_array_data(bt), jl_bt_max_depth);
+    if (n < jl_bt_max_depth)
+        jl_array_del_end(bt, jl_bt_max_depth-n);
     JL_GC_POP();
     return (jl_value_t*)bt;
 }
 
-JL_DLLEXPORT jl_value_t *jl_lookup_code_address(void *ip, int skipC)
+// frame info already returned by jl_lookup_code_address, for each value of
+// skipC: ip -> 1 + index into code_addresses. JIT'd code is never freed, so a
+// frame that was found once stays valid. The entries are plain C, so that the
+// lock is never held while allocating; the symbols are never freed either.
+typedef struct {
+    jl_sym_t *func_name;
+    jl_sym_t *file_name;
+    jl_sym_t *inlinedat_file;
+    size_t line_num;
+    intptr_t inlinedat_line;
+    int fromC;
+} jl_code_address_t;
+
+static htable_t code_address_index[2];
+static jl_code_address_t *code_addresses = NULL;
+static size_t code_addresses_len = 0;
+static size_t code_addresses_maxlen = 0;
+JL_DEFINE_MUTEX(codeaddr)
+
+static void lookup_code_address(jl_code_address_t *ca, void *ip, int skipC)
 {
     char *func_name;
     size_t line_num;
     char *file_name;
     size_t inlinedat_line;
     char *inlinedat_file;
-    int fromC = frame_info_from_ip(&func_name, &file_name, &line_num,
+    ca->fromC = frame_info_from_ip(&func_name, &file_name, &line_num,
                                    &inlinedat_file, &inlinedat_line, (size_t)ip, skipC, 0);
-    jl_value_t *r = (jl_value_t*)jl_alloc_svec(7);
-    JL_GC_PUSH1(&r);
-    jl_svecset(r, 0, jl_symbol(func_name));
-    jl_svecset(r, 1, jl_symbol(file_name));
-    jl_svecset(r, 2, jl_box_long(line_num));
-    jl_svecset(r, 3, jl_symbol(inlinedat_file ? inlinedat_file : ""));
-    jl_svecset(r, 4, jl_box_long(inlinedat_file ? inlinedat_line : -1));
-    jl_svecset(r, 5, jl_box_bool(fromC));
-    jl_svecset(r, 6, jl_box_long((intptr_t)ip));
+    ca->func_name = jl_symbol(func_name);
+    ca->file_name = jl_symbol(file_name);
+    ca->line_num = line_num;
+    ca->inlinedat_file = jl_symbol(inlinedat_file ? inlinedat_file : "");
+    ca->inlinedat_line = inlinedat_file ? inlinedat_line : -1;
     free(func_name);
     free(file_name);
     free(inlinedat_file);
+}
+
+JL_DLLEXPORT jl_value_t *jl_lookup_code_address(void *ip, int skipC)
+{
+    jl_code_address_t ca;
+    int found = 0;
+    skipC = skipC != 0;
+    JL_LOCK(codeaddr);
+    if (code_addresses_maxlen == 0) {
+        htable_new(&code_address_index[0], 0);
+        htable_new(&code_address_index[1], 0);
+        code_addresses_maxlen = 64;
+        code_addresses = (jl_code_address_t*)malloc(code_addresses_maxlen*sizeof(jl_code_address_t));
+    }
+    void *idx = ptrhash_get(&code_address_index[skipC], ip);
+    if (idx != HT_NOTFOUND) {
+        ca = code_addresses[(size_t)(uintptr_t)idx - 1];
+        found = 1;
+    }
+    JL_UNLOCK(codeaddr);
+    // don't remember misses, the code may not have been registered yet
+    if (!found) {
+        lookup_code_address(&ca, ip, skipC);
+        if (ca.func_name != jl_symbol("???")) {
+            JL_LOCK(codeaddr);
+            void **bp = ptrhash_bp(&code_address_index[skipC], ip);
+            if (*bp == HT_NOTFOUND) {
+                if (code_addresses_len == code_addresses_maxlen) {
+                    code_addresses_maxlen *= 2;
+                    code_addresses = (jl_code_address_t*)realloc(code_addresses,
+                                                                 code_addresses_maxlen*sizeof(jl_code_address_t));
+                }
+                code_addresses[code_addresses_len++] = ca;
+                *bp = (void*)(uintptr_t)code_addresses_len;
+            }
+            JL_UNLOCK(codeaddr);
+        }
+    }
+    jl_value_t *r = (jl_value_t*)jl_alloc_svec(7);
+    JL_GC_PUSH1(&r);
+    jl_svecset(r, 0, ca.func_name);
+    jl_svecset(r, 1, ca.file_name);
+    jl_svecset(r, 2, jl_box_long(ca.line_num));
+    jl_svecset(r, 3, ca.inlinedat_file);
+    jl_svecset(r, 4, jl_box_long(ca.inlinedat_line));
+    jl_svecset(r, 5, jl_box_bool(ca.fromC));
+    jl_svecset(r, 6, jl_box_long((intptr_t)ip));
     JL_GC_POP();
     return r;
 }
 
+// look up the frame info of each of the n instruction pointers in ips
+JL_DLLEXPORT jl_value_t *jl_lookup_code_addresses(void **ips, size_t n, int skipC)
+{
+    jl_array_t *a = jl_alloc_cell_1d(n);
+    JL_GC_PUSH1(&a);
+    for (size_t i = 0; i < n; i++)
+        jl_cellset(a, i, jl_lookup_code_address(ips[i], skipC));
+    JL_GC_POP();
+    return (jl_value_t*)a;
+}
+
 JL_DLLEXPORT jl_value_t *jl_get_backtrace(void)
 {
     jl_svec_t *tp = NULL;
@@ -848,7 +1048,7 @@ JL_DLLEXPORT jl_task_t *jl_new_task(jl_function_t *start, size_t ssize)
     jl_set_typeof(t, jl_task_type);
 #ifndef COPY_STACKS
     if (ssize == 0) // unspecified -- pick some default size
-        ssize = 1*1024*1024; // 1M (for now)
+        ssize = DEFAULT_TASK_STACK_SIZE;
 #endif
     ssize = LLT_ALIGN(ssize, pagesz);
     t->ssize = ssize;
@@ -868,21 +1068,15 @@ JL_DLLEXPORT jl_task_t *jl_new_task(jl_function_t *start, size_t ssize)
     t->stkbuf = NULL;
     t->tid = 0;
     t->started = 0;
+    TASK_STAT_ADD(ntasks, 1);
 
 #ifdef COPY_STACKS
     t->bufsz = 0;
 #else
     JL_GC_PUSH1(&t);
 
-    char *stk = allocb(ssize+pagesz+(pagesz-1));
+    char *stk = alloc_stack(ssize);
     t->stkbuf = stk;
-    jl_gc_wb_buf(t, t->stkbuf);
-    stk = (char*)LLT_ALIGN((uptrint_t)stk, pagesz);
-    // add a guard page to detect stack overflow
-    if (mprotect(stk, pagesz-1, PROT_NONE) == -1)
-        jl_errorf("mprotect: %s", strerror(errno));
-    stk += pagesz;
-
     init_task(t, stk);
     JL_GC_POP();
     jl_gc_add_finalizer((jl_value_t*)t, jl_unprotect_stack_func);
@@ -894,11 +1088,8 @@ JL_DLLEXPORT jl_task_t *jl_new_task(jl_function_t *start, size_t ssize)
 JL_CALLABLE(jl_unprotect_stack)
 {
 #ifndef COPY_STACKS
-    jl_task_t *t = (jl_task_t*)args[0];
-    size_t pagesz = jl_page_size;
-    char *stk = (char*)LLT_ALIGN((uptrint_t)t->stkbuf, pagesz);
-    // unprotect stack so it can be reallocated for something else
-    mprotect(stk, pagesz - 1, PROT_READ|PROT_WRITE);
+    // give back the stack of a task that never finished
+    release_task_stack((jl_task_t*)args[0]);
 #endif
     return jl_nothing;
 }
@@ -914,6 +1105,17 @@ jl_function_t *jl_unprotect_stack_func;
 void jl_init_tasks(void)
 {
     _probe_arch();
+    char *depth = getenv(BT_MAX_DEPTH_NAME);
+    if (depth) {
+        size_t d = strtoull(depth, NULL, 10);
+        if (d > 0 && d < JL_MAX_BT_SIZE)
+            jl_bt_max_depth = d;
+    }
+#if !defined(_OS_WINDOWS_) && !defined(LIBOSXUNWIND)
+    // the profiler unwinds from a signal handler, where the default global
+    // cache would have to take a lock
+    unw_set_caching_policy(unw_local_addr_space, UNW_CACHE_PER_THREAD);
+#endif
     jl_task_type = jl_new_datatype(jl_symbol("Task"),
                                    jl_any_type,
                                    jl_emptysvec,
@@ -972,6 +1174,7 @@ void jl_init_root_task(void *stack, size_t ssize)
     jl_current_task->tid = ti_tid;
 
     jl_root_task = jl_current_task;
+    jl_get_ptls_states()->finished_task = NULL;
 
     jl_exception_in_transit = (jl_value_t*)jl_nothing;
     jl_task_arg_in_transit = (jl_value_t*)jl_nothing;
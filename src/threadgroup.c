@@ -8,6 +8,7 @@
 
 #include <stdlib.h>
 #include <string.h>
+#include <limits.h>
 
 #include "julia.h"
 #include "julia_internal.h"
@@ -20,6 +21,47 @@ extern "C" {
 #include "ia_misc.h"
 #include "threadgroup.h"
 
+#ifdef _OS_LINUX_
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+#endif
+
+// build the fork/join tree: the threads of a socket hang below its first
+// thread, `fanout` children per thread, and the first threads of the sockets
+// form a tree of their own rooted at thread 0, so that most of the traffic of
+// a fork or join stays within a socket
+static void ti_threadgroup_maketree(ti_threadgroup_t *tg)
+{
+    int i, n = tg->num_threads, f = tg->fanout;
+    int per_socket = tg->num_cores * tg->num_threads_per_core;
+    int16_t *parent = (int16_t*)malloc(n * sizeof(int16_t));
+    int16_t *next = (int16_t*)malloc(n * sizeof(int16_t));
+
+    tg->child_start = (int16_t*)jl_malloc_aligned((n + 1) * sizeof(int16_t), 64);
+    tg->children = (int16_t*)jl_malloc_aligned((n > 1 ? n - 1 : 1) * sizeof(int16_t), 64);
+    memset(tg->child_start, 0, (n + 1) * sizeof(int16_t));
+    for (i = 0;  i < n;  ++i) {
+        int socket = i / per_socket, local = i % per_socket;
+        if (local != 0)
+            parent[i] = socket * per_socket + (local - 1) / f;
+        else if (socket != 0)
+            parent[i] = ((socket - 1) / f) * per_socket;
+        else
+            parent[i] = -1;
+        if (parent[i] >= 0)
+            tg->child_start[parent[i] + 1]++;
+    }
+    for (i = 0;  i < n;  ++i) {
+        tg->child_start[i + 1] += tg->child_start[i];
+        next[i] = tg->child_start[i];
+    }
+    for (i = 1;  i < n;  ++i)
+        tg->children[next[parent[i]]++] = i;
+    free(next);
+    free(parent);
+}
+
 int ti_threadgroup_create(uint8_t num_sockets, uint8_t num_cores,
                           uint8_t num_threads_per_core,
                           ti_threadgroup_t **newtg)
@@ -45,8 +87,17 @@ int ti_threadgroup_create(uint8_t num_sockets, uint8_t num_cores,
     tg->group_sense = 0;
     tg->forked = 0;
 
+    tg->fanout = DEFAULT_THREAD_FANOUT;
+    cp = getenv(THREAD_FANOUT_NAME);
+    if (cp)
+        tg->fanout = strtol(cp, NULL, 10);
+    if (tg->fanout < 1)
+        tg->fanout = 1;
+    ti_threadgroup_maketree(tg);
+
     uv_mutex_init(&tg->alarm_lock);
     uv_cond_init(&tg->alarm);
+    tg->sleepers = 0;
 
     tg->sleep_threshold = DEFAULT_THREAD_SLEEP_THRESHOLD;
     cp = getenv(THREAD_SLEEP_THRESHOLD_NAME);
@@ -56,6 +107,10 @@ int ti_threadgroup_create(uint8_t num_sockets, uint8_t num_cores,
         else
             tg->sleep_threshold = (uint64_t)strtol(cp, NULL, 10);
     }
+    tg->adaptive_sleep = 1;
+    cp = getenv(THREAD_SLEEP_POLICY_NAME);
+    if (cp && !strncasecmp(cp, "fixed", 5))
+        tg->adaptive_sleep = 0;
 
     *newtg = tg;
     return 0;
@@ -72,28 +127,34 @@ int ti_threadgroup_addthread(ti_threadgroup_t *tg, int16_t ext_tid,
     if (tg->added_threads == tg->num_threads)
         return -3;
 
+    ti_thread_sense_t *ts;
+
     tg->tid_map[ext_tid] = tg->added_threads++;
     if (tgtid) *tgtid = tg->tid_map[ext_tid];
 
+    // allocated here rather than by the thread itself, since a fork can
+    // release a thread before it runs ti_threadgroup_initthread
+    ts = (ti_thread_sense_t*)jl_malloc_aligned(sizeof(ti_thread_sense_t), 64);
+    ts->sense = 1;
+    ts->go = 0;
+    ts->sleeping = 0;
+    ts->wait_avg = 0;
+    ts->spin_ticks = ts->sleep_ticks = ts->nsleeps = 0;
+    tg->thread_sense[tg->tid_map[ext_tid]] = ts;
+
     return 0;
 }
 
 
 int ti_threadgroup_initthread(ti_threadgroup_t *tg, int16_t ext_tid)
 {
-    ti_thread_sense_t *ts;
-
     if (ext_tid < 0 || ext_tid >= tg->num_threads)
         return -1;
-    if (tg->thread_sense[tg->tid_map[ext_tid]] != NULL)
+    if (tg->tid_map[ext_tid] == -1 || tg->thread_sense[tg->tid_map[ext_tid]] == NULL)
         return -2;
     if (tg->num_threads == 0)
         return -3;
 
-    ts = (ti_thread_sense_t*)jl_malloc_aligned(sizeof(ti_thread_sense_t), 64);
-    ts->sense = 1;
-    tg->thread_sense[tg->tid_map[ext_tid]] = ts;
-
     return 0;
 }
 
@@ -124,43 +185,151 @@ int ti_threadgroup_size(ti_threadgroup_t *tg, int16_t *tgsize)
 }
 
 
+#ifdef _OS_LINUX_
+// each thread sleeps on its own `go`, so that a release only wakes the
+// children it releases, and only those that are asleep
+static void ti_futex_wait(volatile int *addr, int val)
+{
+    syscall(SYS_futex, addr, FUTEX_WAIT_PRIVATE, val, NULL, NULL, 0);
+}
+static void ti_futex_wake(volatile int *addr)
+{
+    syscall(SYS_futex, addr, FUTEX_WAKE_PRIVATE, 1, NULL, NULL, 0);
+}
+#endif
+
+// sleep until thread ts is released
+static void ti_threadgroup_sleep(ti_threadgroup_t *tg, ti_thread_sense_t *ts)
+{
+#ifdef _OS_LINUX_
+    ts->sleeping = 1;
+    cpu_mfence();
+    int go = ts->go;
+    if (go != ts->sense) {
+        ti_futex_wait(&ts->go, go);
+        ts->nsleeps++;
+    }
+    ts->sleeping = 0;
+#else
+    uv_mutex_lock(&tg->alarm_lock);
+    tg->sleepers++;
+    cpu_mfence();
+    if (ts->go != ts->sense) {
+        uv_cond_wait(&tg->alarm, &tg->alarm_lock);
+        ts->nsleeps++;
+    }
+    tg->sleepers--;
+    uv_mutex_unlock(&tg->alarm_lock);
+#endif
+}
+
+// for waits other than the forks: sleep while *addr is val, the way the
+// threads sleep for a fork. may return early
+void ti_threadgroup_park(ti_threadgroup_t *tg, volatile int *addr, int val)
+{
+#ifdef _OS_LINUX_
+    syscall(SYS_futex, addr, FUTEX_WAIT_PRIVATE, val, NULL, NULL, 0);
+#else
+    uv_mutex_lock(&tg->alarm_lock);
+    tg->sleepers++;
+    cpu_mfence();
+    if (*addr == val)
+        uv_cond_wait(&tg->alarm, &tg->alarm_lock);
+    tg->sleepers--;
+    uv_mutex_unlock(&tg->alarm_lock);
+#endif
+}
+
+// wake the threads parked on addr, once *addr has changed
+void ti_threadgroup_unpark(ti_threadgroup_t *tg, volatile int *addr)
+{
+#ifdef _OS_LINUX_
+    syscall(SYS_futex, addr, FUTEX_WAKE_PRIVATE, INT_MAX, NULL, NULL, 0);
+#else
+    uv_mutex_lock(&tg->alarm_lock);
+    uv_cond_broadcast(&tg->alarm);
+    uv_mutex_unlock(&tg->alarm_lock);
+#endif
+}
+
+// how long thread ts spins before it sleeps
+static uint64_t ti_threadgroup_spin_limit(ti_threadgroup_t *tg, ti_thread_sense_t *ts)
+{
+    if (!tg->adaptive_sleep)
+        return tg->sleep_threshold;
+    // spinning through a wait like the recent ones (twice as long, to
+    // allow for some spread) is only worth it if those were short
+    uint64_t limit = 2 * ts->wait_avg;
+    if (limit > tg->sleep_threshold || limit < THREAD_SPIN_MIN)
+        return THREAD_SPIN_MIN;
+    return limit;
+}
+
+// pass the release of a fork on to the children of thread i
+static void ti_threadgroup_release(ti_threadgroup_t *tg, int16_t i)
+{
+    int c, sense = tg->thread_sense[i]->sense;
+
+    for (c = tg->child_start[i];  c < tg->child_start[i + 1];  ++c)
+        tg->thread_sense[tg->children[c]]->go = sense;
+
+    // if it's possible that threads are sleeping, wake them
+    if (tg->sleep_threshold) {
+        cpu_mfence();
+#ifdef _OS_LINUX_
+        for (c = tg->child_start[i];  c < tg->child_start[i + 1];  ++c) {
+            ti_thread_sense_t *cs = tg->thread_sense[tg->children[c]];
+            if (cs->sleeping)
+                ti_futex_wake(&cs->go);
+        }
+#else
+        if (tg->sleepers > 0) {
+            uv_mutex_lock(&tg->alarm_lock);
+            uv_cond_broadcast(&tg->alarm);
+            uv_mutex_unlock(&tg->alarm_lock);
+        }
+#endif
+    }
+}
+
+
 int ti_threadgroup_fork(ti_threadgroup_t *tg, int16_t ext_tid,
                         void **bcast_val)
 {
-    if (tg->tid_map[ext_tid] == 0) {
+    int16_t i = tg->tid_map[ext_tid];
+
+    if (i == 0) {
         tg->envelope = bcast_val ? *bcast_val : NULL;
         cpu_sfence();
         tg->forked = 1;
         tg->group_sense = tg->thread_sense[0]->sense;
-
-        // if it's possible that threads are sleeping, signal them
-        if (tg->sleep_threshold) {
-            uv_mutex_lock(&tg->alarm_lock);
-            uv_cond_broadcast(&tg->alarm);
-            uv_mutex_unlock(&tg->alarm_lock);
-        }
+        ti_threadgroup_release(tg, 0);
     }
     else {
-        // spin up to threshold cycles (count sheep), then sleep
+        // spin up to the limit (count sheep), then sleep
+        ti_thread_sense_t *ts = tg->thread_sense[i];
         uint64_t spin_cycles, spin_start = rdtsc();
-        while (tg->group_sense !=
-               tg->thread_sense[tg->tid_map[ext_tid]]->sense) {
+        uint64_t wait_start = spin_start, slept = 0;
+        uint64_t spin_limit = ti_threadgroup_spin_limit(tg, ts);
+        while (ts->go != ts->sense) {
             if (tg->sleep_threshold) {
                 spin_cycles = rdtsc() - spin_start;
-                if (spin_cycles >= tg->sleep_threshold) {
-                    uv_mutex_lock(&tg->alarm_lock);
-                    if (tg->group_sense !=
-                        tg->thread_sense[tg->tid_map[ext_tid]]->sense) {
-                        uv_cond_wait(&tg->alarm, &tg->alarm_lock);
-                    }
-                    uv_mutex_unlock(&tg->alarm_lock);
-                    spin_start = rdtsc();
+                if (spin_cycles >= spin_limit) {
+                    ti_threadgroup_sleep(tg, ts);
+                    uint64_t woke = rdtsc();
+                    slept += woke - (spin_start + spin_cycles);
+                    spin_start = woke;
                     continue;
                 }
             }
             cpu_pause();
         }
         cpu_lfence();
+        uint64_t waited = rdtsc() - wait_start;
+        ts->wait_avg = (ts->wait_avg + waited) / 2;
+        ts->sleep_ticks += slept;
+        ts->spin_ticks += waited - slept;
+        ti_threadgroup_release(tg, i);
         if (bcast_val)
             *bcast_val = tg->envelope;
     }
@@ -171,17 +340,18 @@ int ti_threadgroup_fork(ti_threadgroup_t *tg, int16_t ext_tid,
 
 int ti_threadgroup_join(ti_threadgroup_t *tg, int16_t ext_tid)
 {
-    int i;
+    int c;
+    int16_t i = tg->tid_map[ext_tid];
 
-    tg->thread_sense[tg->tid_map[ext_tid]]->sense
-        = !tg->thread_sense[tg->tid_map[ext_tid]]->sense;
-    if (tg->tid_map[ext_tid] == 0) {
-        for (i = 1;  i < tg->num_threads;  ++i) {
-            while (tg->thread_sense[i]->sense == tg->group_sense)
-                cpu_pause();
-        }
-        tg->forked = 0;
+    // wait for the subtree of this thread, then tell the parent
+    for (c = tg->child_start[i];  c < tg->child_start[i + 1];  ++c) {
+        ti_thread_sense_t *cs = tg->thread_sense[tg->children[c]];
+        while (cs->sense == tg->group_sense)
+            cpu_pause();
     }
+    tg->thread_sense[i]->sense = !tg->thread_sense[i]->sense;
+    if (i == 0)
+        tg->forked = 0;
 
     return 0;
 }
@@ -207,6 +377,8 @@ int ti_threadgroup_destroy(ti_threadgroup_t *tg)
     for (i = 0;  i < tg->num_threads;  i++)
         jl_free_aligned(tg->thread_sense[i]);
     jl_free_aligned(tg->thread_sense);
+    jl_free_aligned(tg->children);
+    jl_free_aligned(tg->child_start);
     jl_free_aligned(tg->tid_map);
     jl_free_aligned(tg);
 
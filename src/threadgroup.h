@@ -9,6 +9,16 @@
 // for the barrier
 typedef struct {
     volatile int sense;
+    volatile int go;            // set to `sense` by the parent to release this thread
+
+    // to let the thread sleep: set while it may be asleep, and the average
+    // of its recent waits for a fork, in cycles
+    volatile int sleeping;
+    uint64_t    wait_avg;
+
+    // cycles this thread spent waiting for the forks, spinning and asleep
+    uint64_t    spin_ticks, sleep_ticks;
+    uint64_t    nsleeps;
 
 } ti_thread_sense_t;
 
@@ -24,10 +34,23 @@ typedef struct {
     ti_thread_sense_t  **thread_sense;
     void                *envelope;
 
+    // fork/join tree: the children of thread i are
+    // children[child_start[i]] ... children[child_start[i+1]-1]
+    int16_t             *child_start, *children;
+    int                 fanout;
+
     // to let threads sleep
     uv_mutex_t  alarm_lock;
     uv_cond_t   alarm;
     uint64_t    sleep_threshold;
+    int         adaptive_sleep;
+    volatile int sleepers;
+
+    // next iteration of the dynamic or guided loop the group is running,
+    // on a cache line of its own
+    uint8_t             pad0[64];
+    volatile int64_t    loop_next;
+    uint8_t             pad1[64 - sizeof(int64_t)];
 } ti_threadgroup_t;
 
 
@@ -44,6 +67,8 @@ int  ti_threadgroup_fork(ti_threadgroup_t *tg, int16_t ext_tid,
                          void **bcast_val);
 int  ti_threadgroup_join(ti_threadgroup_t *tg, int16_t ext_tid);
 void ti_threadgroup_barrier(ti_threadgroup_t *tg, int16_t ext_tid);
+void ti_threadgroup_park(ti_threadgroup_t *tg, volatile int *addr, int val);
+void ti_threadgroup_unpark(ti_threadgroup_t *tg, volatile int *addr);
 int  ti_threadgroup_destroy(ti_threadgroup_t *tg);
 
 extern ti_threadgroup_t *tgworld;
@@ -27,6 +27,9 @@ TODO:
 
 #include "julia.h"
 #include "julia_internal.h"
+#ifdef _OS_LINUX_
+#include <sys/syscall.h>
+#endif
 
 #ifdef __cplusplus
 extern "C" {
@@ -72,7 +75,44 @@ JL_DLLEXPORT void jl_cpu_pause(void)
     cpu_pause();
 }
 
-#ifdef JULIA_ENABLE_THREADING
+// Profile of a thread, in ns (see jl_threading_profile_data)
+// This struct must be kept in sync with the Julia type of the same name in
+// base/threadingconstructs.jl
+typedef struct {
+    uint64_t    nregions;       // threaded regions run
+    uint64_t    prep;           // specializing and compiling them (thread 1 only)
+    uint64_t    fork;           // waiting to be released into them
+    uint64_t    fork_spin;      // waiting for a fork or barrier, spinning
+    uint64_t    fork_sleep;     // and asleep
+    uint64_t    nsleeps;
+    uint64_t    user;
+    uint64_t    join;
+    uint64_t    gc;             // in collections, waiting at their barriers included
+    uint64_t    imbalance;      // behind the slowest thread, summed over the regions
+    // regions whose user time, or imbalance, was in [2^(i-1), 2^i) us
+    uint64_t    user_hist[TI_PROFILE_HIST_SIZE];
+    uint64_t    imbalance_hist[TI_PROFILE_HIST_SIZE];
+} Thread_Profile;
+
+#if defined(JULIA_ENABLE_THREADING) && defined(CODEGEN_TLS)
+JL_DLLEXPORT __thread jl_tls_states_t jl_tls_states
+    __attribute__((tls_model("initial-exec")));
+JL_DLLEXPORT JL_CONST_FUNC jl_tls_states_t *(jl_get_ptls_states)(void)
+{
+    return &jl_tls_states;
+}
+JL_DLLEXPORT void jl_set_ptls_states_getter(jl_get_ptls_states_func f)
+{
+    // the states always live in `jl_tls_states`, which the runtime
+    // accesses directly, so a getter supplied by the executable is not used
+    (void)f;
+}
+jl_get_ptls_states_func jl_get_ptls_states_getter(void)
+{
+    // for codegen
+    return &(jl_get_ptls_states);
+}
+#elif defined(JULIA_ENABLE_THREADING)
 // fallback provided for embedding
 static JL_CONST_FUNC jl_tls_states_t *jl_get_ptls_states_fallback(void)
 {
@@ -131,10 +171,26 @@ JL_DLLEXPORT JL_CONST_FUNC jl_tls_states_t *(jl_get_ptls_states)(void)
 
 // thread ID
 JL_DLLEXPORT int jl_n_threads;     // # threads we're actually using
+int jl_max_foreign_threads;
+volatile int jl_n_foreign_threads = 0;
 jl_thread_task_state_t *jl_all_task_states;
 
 // return calling thread's ID
-JL_DLLEXPORT int16_t jl_threadid(void) { return ti_tid; }
+JL_DLLEXPORT int16_t jl_threadid(void)
+{
+    return ti_tid;
+}
+
+// the thread of the threaded region the calling thread is running: the
+// thread of the nested region if it runs one, otherwise its own ID. unlike
+// jl_threadid, two threads can have the same one at the same time
+JL_DLLEXPORT int16_t jl_threadregionid(void)
+{
+    if (ti_is_foreign(ti_tid))
+        return ti_tid;
+    ti_context_t *ctx = &ti_contexts[ti_tid];
+    return ctx->region != NULL ? ctx->tid : ti_tid;
+}
 
 struct _jl_thread_heap_t *jl_mk_thread_heap(void);
 // must be called by each thread at startup
@@ -150,30 +206,75 @@ static void ti_initthread(int16_t tid)
 #endif
 
     jl_all_task_states[tid].ptls = jl_get_ptls_states();
+#ifdef _OS_LINUX_
+    jl_all_task_states[tid].kernel_tid = syscall(SYS_gettid);
+#endif
     jl_all_task_states[tid].signal_stack = jl_install_thread_signal_handler();
 }
 
-static void ti_init_master_thread(void)
+// the id of the calling thread as used by the profiler and the signals; on
+// windows a real handle, valid in the other threads and after uv_thread_detach
+// closed the one of uv_thread_create
+static uv_thread_t ti_thread_system_id(void)
 {
 #ifdef _OS_WINDOWS_
+    HANDLE h;
     if (!DuplicateHandle(GetCurrentProcess(), GetCurrentThread(),
-                         GetCurrentProcess(), &hMainThread, 0,
+                         GetCurrentProcess(), &h, 0,
                          TRUE, DUPLICATE_SAME_ACCESS)) {
-        jl_printf(JL_STDERR, "WARNING: failed to access handle to main thread\n");
-        hMainThread = INVALID_HANDLE_VALUE;
+        jl_printf(JL_STDERR, "WARNING: failed to access handle to thread\n");
+        h = INVALID_HANDLE_VALUE;
     }
-    jl_all_task_states[0].system_id = hMainThread;
+    return h;
 #else
-    jl_all_task_states[0].system_id = pthread_self();
+    return pthread_self();
+#endif
+}
+
+static void ti_init_master_thread(void)
+{
+    jl_all_task_states[0].system_id = ti_thread_system_id();
+#ifdef _OS_WINDOWS_
+    hMainThread = jl_all_task_states[0].system_id;
 #endif
     ti_initthread(0);
 }
 
-// all threads call this function to run user code
-static jl_value_t *ti_run_fun(jl_function_t *f, jl_svec_t *args)
+// set up the calling thread of the embedding program like a thread of the
+// runtime, with a heap and a root task of its own. called by jl_adopt_thread
+// with the embedding lock held; returns the id of the thread, or -1 if all
+// the slots are taken
+int16_t jl_init_foreign_thread(void)
+{
+#ifdef JULIA_ENABLE_THREADING
+    if (jl_n_foreign_threads >= jl_max_foreign_threads)
+        return -1;
+    int16_t tid = jl_n_threads + jl_n_foreign_threads;
+    // the collector doesn't know this thread until it is counted
+    int en = jl_gc_enable(0);
+    ti_initthread(tid);
+    jl_all_task_states[tid].system_id = ti_thread_system_id();
+    jl_init_stack_limits(0);
+    jl_init_root_task(jl_stack_lo, jl_stack_hi - jl_stack_lo);
+    cpu_sfence();
+    jl_n_foreign_threads++;
+    jl_gc_enable(en);
+    return tid;
+#else
+    // there is only one set of thread states, the embedding lock keeps the
+    // threads that call into julia from using it at the same time
+    return 0;
+#endif
+}
+
+// all threads call this function to run user code; the value it returns is
+// stored in *ret if ret is not NULL
+static jl_value_t *ti_run_fun(jl_function_t *f, jl_svec_t *args, jl_value_t **ret)
 {
     JL_TRY {
-        jl_apply(f, jl_svec_data(args), jl_svec_len(args));
+        jl_value_t *v = jl_apply(f, jl_svec_data(args), jl_svec_len(args));
+        if (ret)
+            *ret = v;
     }
     JL_CATCH {
         return jl_exception_in_transit;
@@ -181,6 +282,216 @@ static jl_value_t *ti_run_fun(jl_function_t *f, jl_svec_t *args)
     return jl_nothing;
 }
 
+// the threads of the embedding program are not in the thread group
+static void ti_check_not_foreign(void)
+{
+    if (ti_is_foreign(ti_tid))
+        jl_error("threaded work can't be started from a thread of the embedding program");
+}
+
+// spawned work
+ti_workqueue_t *ti_workqueues;
+ti_context_t *ti_contexts;
+static volatile size_t ti_pending_work;      // queued and not finished yet
+static volatile size_t ti_syncing_work;      // running and waiting in a sync
+jl_value_t *volatile ti_spawn_exception;     // first exception thrown by spawned work
+
+#define ti_workqueue_lock(q) do {                                       \
+        while (JL_ATOMIC_TEST_AND_SET((q)->lock))                       \
+            cpu_pause();                                                \
+    } while (0)
+#define ti_workqueue_unlock(q) JL_ATOMIC_RELEASE((q)->lock)
+
+static void ti_init_workqueues(void)
+{
+    ti_workqueues = (ti_workqueue_t*)jl_malloc_aligned(jl_n_threads * sizeof(ti_workqueue_t), 64);
+    memset(ti_workqueues, 0, jl_n_threads * sizeof(ti_workqueue_t));
+    ti_contexts = (ti_context_t*)jl_malloc_aligned(jl_n_threads * sizeof(ti_context_t), 64);
+    memset(ti_contexts, 0, jl_n_threads * sizeof(ti_context_t));
+}
+
+static void ti_workqueue_push(ti_workqueue_t *q, jl_value_t *f, ti_region_t *region,
+                              int16_t tid)
+{
+    ti_workqueue_lock(q);
+    if (q->top == q->size) {
+        if (q->bottom > 0) {
+            memmove(q->items, &q->items[q->bottom], (q->top - q->bottom) * sizeof(ti_workitem_t));
+            q->top -= q->bottom;
+            q->bottom = 0;
+        }
+        else {
+            size_t newsz = q->size > 0 ? q->size * 2 : 64;
+            ti_workitem_t *items = (ti_workitem_t*)realloc(q->items, newsz * sizeof(ti_workitem_t));
+            if (items == NULL) {
+                ti_workqueue_unlock(q);
+                jl_throw(jl_memory_exception);
+            }
+            q->items = items;
+            q->size = newsz;
+        }
+    }
+    ti_workitem_t *it = &q->items[q->top];
+    it->fun = f;
+    it->region = region;
+    it->tid = tid;
+    q->top++;
+    ti_workqueue_unlock(q);
+}
+
+// take the most recently queued item (owner) or the oldest one (thief)
+static int ti_workqueue_take(ti_workqueue_t *q, int steal, ti_workitem_t *it)
+{
+    int found = 0;
+    if (q->top == q->bottom)
+        return 0;
+    ti_workqueue_lock(q);
+    if (q->top > q->bottom) {
+        *it = steal ? q->items[q->bottom++] : q->items[--q->top];
+        if (q->top == q->bottom)
+            q->top = q->bottom = 0;
+        found = 1;
+    }
+    ti_workqueue_unlock(q);
+    return found;
+}
+
+// run one item of one of the queues, ours first; returns 0 if there was none
+static int ti_run_queued(int16_t tid)
+{
+    ti_workitem_t it;
+    int found = ti_workqueue_take(&ti_workqueues[tid], 0, &it);
+    for (int i = 1; !found && i < jl_n_threads; i++)
+        found = ti_workqueue_take(&ti_workqueues[(tid + i) % jl_n_threads], 1, &it);
+    if (!found)
+        return 0;
+    JL_GC_PUSH1(&it.fun);
+    ti_contexts[tid].nitems++;
+    if (it.region == NULL) {
+        jl_value_t *e = ti_run_fun((jl_function_t*)it.fun, jl_emptysvec, NULL);
+        if (e != jl_nothing && ti_spawn_exception == NULL)
+            JL_ATOMIC_COMPARE_AND_SWAP(ti_spawn_exception, NULL, e);
+    }
+    else {
+        // run as thread it.tid of the region
+        ti_region_t *r = it.region;
+        ti_context_t *ctx = &ti_contexts[tid], saved = *ctx;
+        jl_value_t *v = jl_nothing;
+        ctx->region = r;
+        ctx->tid = it.tid;
+        jl_value_t *e = ti_run_fun(r->fun, r->args, r->results ? &v : NULL);
+        *ctx = saved;
+        if (r->results)
+            jl_cellset(r->results, it.tid, v);
+        if (e != jl_nothing && r->exception == NULL)
+            JL_ATOMIC_COMPARE_AND_SWAP(r->exception, NULL, e);
+        cpu_sfence();
+        JL_ATOMIC_FETCH_AND_ADD(r->nrunning, -1);
+    }
+    ti_contexts[tid].nitems--;
+    JL_GC_POP();
+    JL_ATOMIC_FETCH_AND_ADD(ti_pending_work, -1);
+    return 1;
+}
+
+// run queued work, ours first, then stolen from the other threads, until
+// none is left anywhere
+static void ti_run_spawned(int16_t tid)
+{
+    while (ti_pending_work > 0) {
+        if (ti_run_queued(tid))
+            continue;
+        // the others can't collect without us
+        jl_gc_safepoint();
+        cpu_pause();
+    }
+}
+
+// queue f() to be run by any thread, once the threaded region the caller is
+// in ends or at the next `jl_threading_sync`
+JL_DLLEXPORT void jl_threading_spawn(jl_function_t *f)
+{
+    JL_TYPECHK(jl_threading_spawn, function, (jl_value_t*)f);
+    ti_check_not_foreign();
+    JL_ATOMIC_FETCH_AND_ADD(ti_pending_work, 1);
+    ti_workqueue_push(&ti_workqueues[ti_tid], (jl_value_t*)f, NULL, 0);
+}
+
+// run queued work like ti_run_spawned for a sync: called from an item, the
+// wait ends once the only work left is items waiting in a sync themselves,
+// the caller's own item among them, which can't finish before it returns
+static void ti_sync_spawned(int16_t tid)
+{
+    int initem = ti_contexts[tid].nitems > 0;
+    if (initem)
+        JL_ATOMIC_FETCH_AND_ADD(ti_syncing_work, 1);
+    for (;;) {
+        size_t syncing = ti_syncing_work;
+        if (ti_pending_work <= syncing)
+            break;
+        if (ti_run_queued(tid))
+            continue;
+        jl_gc_safepoint();
+        cpu_pause();
+    }
+    if (initem)
+        JL_ATOMIC_FETCH_AND_ADD(ti_syncing_work, -1);
+}
+
+// take the exception thrown by spawned work, so that it's reported once
+static jl_value_t *ti_spawned_result(void)
+{
+    jl_value_t *e;
+    do {
+        e = ti_spawn_exception;
+    } while (e != NULL && !JL_ATOMIC_COMPARE_AND_SWAP(ti_spawn_exception, e, NULL));
+    return e != NULL ? e : jl_nothing;
+}
+
+#ifdef JULIA_ENABLE_THREADING
+// run a threaded region started inside another one: its threads are queued
+// for the threads of the pool that are free, and the caller runs them too
+// while it waits, so that nested regions neither deadlock nor add threads
+static jl_value_t *ti_run_nested(jl_function_t *f, jl_svec_t *args, jl_function_t *op)
+{
+    ti_region_t r;
+    int16_t tid = ti_tid;
+    r.fun = f;
+    r.args = args;
+    r.results = NULL;
+    r.exception = NULL;
+    r.loop_next = 0;
+    r.nrunning = jl_n_threads;
+    JL_GC_PUSH4(&r.fun, &r.args, &r.results, (jl_value_t**)&r.exception);
+    if (op != NULL)
+        r.results = jl_alloc_cell_1d(jl_n_threads);
+    cpu_sfence();
+    JL_ATOMIC_FETCH_AND_ADD(ti_pending_work, jl_n_threads);
+    for (int i = jl_n_threads - 1; i >= 0; i--)
+        ti_workqueue_push(&ti_workqueues[tid], (jl_value_t*)f, &r, i);
+    while (r.nrunning > 0) {
+        if (ti_run_queued(tid))
+            continue;
+        jl_gc_safepoint();
+        cpu_pause();
+    }
+    cpu_lfence();
+    jl_value_t *ret = r.exception != NULL ? r.exception : jl_nothing;
+    if (op != NULL) {
+        if (r.exception != NULL)
+            jl_throw(r.exception);
+        ret = jl_cellref(r.results, 0);
+        for (int i = 1; i < jl_n_threads; i++) {
+            jl_value_t *a[2] = { ret, jl_cellref(r.results, i) };
+            jl_cellset(r.results, 0, ret);
+            ret = jl_apply(op, a, 2);
+        }
+    }
+    JL_GC_POP();
+    return ret;
+}
+#endif
+
 
 #ifdef JULIA_ENABLE_THREADING
 
@@ -197,16 +508,123 @@ ti_threadgroup_t *tgworld;
 // for broadcasting work to threads
 ti_threadwork_t threadwork;
 
+// results of the threads for the reduction, and the region they belong to
+ti_result_t *ti_results;
+static volatile size_t ti_region;
+
 #if PROFILE_JL_THREADING
 double cpu_ghz;
-uint64_t prep_ticks;
-uint64_t *fork_ticks;
-uint64_t *user_ticks;
-uint64_t *join_ticks;
+ti_profile_t *ti_profile;
+
+// histogram bucket of a time in cycles, see ti_profile_t
+static int ti_profile_bucket(uint64_t ticks)
+{
+    int bucket = 0;
+    for (uint64_t us = (uint64_t)(ticks / (cpu_ghz * 1e3));
+         us > 0 && bucket < TI_PROFILE_HIST_SIZE - 1; us >>= 1)
+        bucket++;
+    return bucket;
+}
+
+// called on the thread that ran the region, with its user time
+static void ti_profile_region(int16_t tid, uint64_t ticks)
+{
+    ti_profile_t *p = &ti_profile[tid];
+    p->nregions++;
+    p->region_ticks = ticks;
+    p->user_hist[ti_profile_bucket(ticks)]++;
+}
+
+// called by the master after the join: how far each thread was behind the
+// slowest one
+static void ti_profile_imbalance(void)
+{
+    uint64_t max = 0;
+    int i;
+    cpu_lfence();
+    for (i = 0;  i < jl_n_threads;  i++)
+        if (ti_profile[i].region_ticks > max)
+            max = ti_profile[i].region_ticks;
+    for (i = 0;  i < jl_n_threads;  i++) {
+        uint64_t d = max - ti_profile[i].region_ticks;
+        ti_profile[i].imbalance_ticks += d;
+        ti_profile[i].imbalance_hist[ti_profile_bucket(d)]++;
+    }
+}
 #endif
 
 static uv_barrier_t thread_init_done;
 
+// combine the results of the threads in a binomial tree: at each level, a
+// thread waits for the result of its partner and folds it into its own.
+// this happens before the join, while the region is still running, so that
+// the threads waiting for their partners can take part in a collection
+static void ti_reduce(int16_t tid, jl_function_t *op)
+{
+    ti_result_t *r = &ti_results[tid];
+    size_t region = ti_region;
+    for (int s = 1; s < jl_n_threads && !(tid & s); s <<= 1) {
+        if (tid + s >= jl_n_threads)
+            continue;
+        ti_result_t *c = &ti_results[tid + s];
+        while (c->ready != region) {
+            jl_gc_safepoint();
+            cpu_pause();
+        }
+        cpu_lfence();
+        if (r->exception == NULL && c->exception != NULL) {
+            r->exception = c->exception;
+        }
+        else if (r->exception == NULL) {
+            jl_value_t *a[2] = { r->value, c->value };
+            JL_TRY {
+                r->value = jl_apply(op, a, 2);
+            }
+            JL_CATCH {
+                r->exception = jl_exception_in_transit;
+            }
+        }
+        c->value = c->exception = NULL;
+    }
+    cpu_sfence();
+    r->ready = region;
+}
+
+// run the user function of a region, and the work it spawned
+static void ti_run_region(ti_threadwork_t *work, int16_t tid)
+{
+    if (work->op == NULL) {
+        // TODO: return value?
+        jl_value_t *e = ti_run_fun(work->fun, work->args, NULL);
+        if (tid == 0)
+            work->ret = e;
+        ti_run_spawned(tid);
+    }
+    else {
+        ti_result_t *r = &ti_results[tid];
+        r->value = jl_nothing;
+        r->exception = NULL;
+        jl_value_t *e = ti_run_fun(work->fun, work->args, &r->value);
+        if (e != jl_nothing)
+            r->exception = e;
+        ti_run_spawned(tid);
+        ti_reduce(tid, work->op);
+    }
+}
+
+// pin the calling thread to cpu
+static void ti_pin_thread(int cpu)
+{
+    char mask[UV_CPU_SETSIZE];
+    uv_thread_t uvtid = (uv_thread_t)uv_thread_self();
+
+    if (cpu < 0 || cpu >= UV_CPU_SETSIZE)
+        return;
+    memset(mask, 0, UV_CPU_SETSIZE);
+    mask[cpu] = 1;
+    uv_thread_setaffinity(&uvtid, mask, NULL, UV_CPU_SETSIZE);
+}
+
 // thread function: used by all except the main thread
 void ti_threadfun(void *arg)
 {
@@ -214,8 +632,14 @@ void ti_threadfun(void *arg)
     ti_threadgroup_t *tg;
     ti_threadwork_t *work;
 
-    // initialize this thread (set tid, create heap, etc.)
+    // pin the thread before it allocates its heap, so that the heap is on
+    // the memory of its node
+    ti_pin_thread(ta->cpu);
+
+    // initialize this thread (set tid, create heap, etc.), before the
+    // barrier, after which the profiler can look at it
     ti_initthread(ta->tid);
+    jl_all_task_states[ti_tid].system_id = ti_thread_system_id();
     jl_init_stack_limits(0);
 
     // set up tasking
@@ -236,7 +660,8 @@ void ti_threadfun(void *arg)
     // free the thread argument here
     free(ta);
 
-    // work loop
+    // work loop, idle threads are in a gc safe region
+    jl_gc_safe_enter();
     for (; ;) {
 #if PROFILE_JL_THREADING
         uint64_t tstart = rdtsc();
@@ -246,27 +671,41 @@ void ti_threadfun(void *arg)
 
 #if PROFILE_JL_THREADING
         uint64_t tfork = rdtsc();
-        fork_ticks[ti_tid] += tfork - tstart;
+        ti_profile[ti_tid].fork_ticks += tfork - tstart;
 #endif
 
         if (work) {
-            if (work->command == TI_THREADWORK_DONE)
+            // the mark helpers work for a collection that is running
+            if (work->command == TI_THREADWORK_DONE) {
                 break;
-            else if (work->command == TI_THREADWORK_RUN)
-                // TODO: return value? reduction?
-                ti_run_fun(work->fun, work->args);
+            }
+            else if (work->command == TI_THREADWORK_RUN) {
+                jl_gc_unsafe_enter();
+                ti_run_region(work, ti_tid);
+                jl_gc_safe_enter();
+            }
+            else if (work->command == TI_THREADWORK_GC_MARK) {
+                jl_gc_mark_helper();
+            }
+            else if (work->command == TI_THREADWORK_SPAWNED) {
+                jl_gc_unsafe_enter();
+                ti_run_spawned(ti_tid);
+                jl_gc_safe_enter();
+            }
         }
 
 #if PROFILE_JL_THREADING
         uint64_t tuser = rdtsc();
-        user_ticks[ti_tid] += tuser - tfork;
+        ti_profile[ti_tid].user_ticks += tuser - tfork;
+        if (work && work->command == TI_THREADWORK_RUN)
+            ti_profile_region(ti_tid, tuser - tfork);
 #endif
 
         ti_threadgroup_join(tg, ti_tid);
 
 #if PROFILE_JL_THREADING
         uint64_t tjoin = rdtsc();
-        join_ticks[ti_tid] += tjoin - tuser;
+        ti_profile[ti_tid].join_ticks += tjoin - tuser;
 #endif
 
         // TODO:
@@ -292,10 +731,21 @@ void jl_init_threading(void)
     }
     if (jl_n_threads > max_threads)
         jl_n_threads = max_threads;
+    jl_max_foreign_threads = DEFAULT_MAX_FOREIGN_THREADS;
+    cp = getenv(MAX_FOREIGN_THREADS_NAME);
+    if (cp) {
+        jl_max_foreign_threads = (int)strtol(cp, NULL, 10);
+        if (jl_max_foreign_threads < 0)
+            jl_max_foreign_threads = 0;
+    }
 
     // set up space for per-thread heaps
-    jl_all_heaps = (struct _jl_thread_heap_t **)malloc(jl_n_threads * sizeof(void*));
-    jl_all_task_states = (jl_thread_task_state_t *)malloc(jl_n_threads * sizeof(jl_thread_task_state_t));
+    int nslots = jl_n_threads + jl_max_foreign_threads;
+    jl_all_heaps = (struct _jl_thread_heap_t **)malloc(nslots * sizeof(void*));
+    jl_all_task_states = (jl_thread_task_state_t *)malloc(nslots * sizeof(jl_thread_task_state_t));
+    ti_init_workqueues();
+    ti_results = (ti_result_t*)jl_malloc_aligned(jl_n_threads * sizeof(ti_result_t), 64);
+    memset(ti_results, 0, jl_n_threads * sizeof(ti_result_t));
 
 #if PROFILE_JL_THREADING
     // estimate CPU speed
@@ -304,9 +754,7 @@ void jl_init_threading(void)
     cpu_ghz = ((double)(rdtsc() - cpu_tim)) / 1e9;
 
     // set up space for profiling information
-    fork_ticks = (uint64_t*)jl_malloc_aligned(jl_n_threads * sizeof(uint64_t), 64);
-    user_ticks = (uint64_t*)jl_malloc_aligned(jl_n_threads * sizeof(uint64_t), 64);
-    join_ticks = (uint64_t*)jl_malloc_aligned(jl_n_threads * sizeof(uint64_t), 64);
+    ti_profile = (ti_profile_t*)jl_malloc_aligned(jl_n_threads * sizeof(ti_profile_t), 64);
     ti_reset_timings();
 #endif
 
@@ -314,28 +762,138 @@ void jl_init_threading(void)
     ti_init_master_thread();
 }
 
+// topology of a cpu
+typedef struct {
+    int cpu, socket, core, smt; // smt: rank of the cpu among those of its core
+} ti_cpuinfo_t;
+
+static int ti_read_topology(int cpu, const char *what)
+{
+    int v = -1;
+#ifdef _OS_LINUX_
+    char path[128];
+    snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d/topology/%s", cpu, what);
+    FILE *f = fopen(path, "r");
+    if (f) {
+        if (fscanf(f, "%d", &v) != 1)
+            v = -1;
+        fclose(f);
+    }
+#endif
+    return v;
+}
+
+static int ti_cpuinfo_compact(const void *a, const void *b)
+{
+    const ti_cpuinfo_t *x = (const ti_cpuinfo_t*)a, *y = (const ti_cpuinfo_t*)b;
+    if (x->socket != y->socket) return x->socket - y->socket;
+    if (x->core != y->core) return x->core - y->core;
+    return x->cpu - y->cpu;
+}
+
+static int ti_cpuinfo_spread(const void *a, const void *b)
+{
+    const ti_cpuinfo_t *x = (const ti_cpuinfo_t*)a, *y = (const ti_cpuinfo_t*)b;
+    if (x->socket != y->socket) return x->socket - y->socket;
+    if (x->smt != y->smt) return x->smt - y->smt;
+    return ti_cpuinfo_compact(a, b);
+}
+
+// choose the cpu of each thread (-1 for none) according to the affinity
+// policy; threads on the same socket get consecutive ids. returns the number
+// of sockets the threads are evenly spread over, or 1
+static int ti_place_threads(int16_t *cpus)
+{
+    const char *cp;
+    int i, j, ncpus = jl_cpu_cores(), nsockets = 1;
+
+    for (i = 0;  i < jl_n_threads;  ++i)
+        cpus[i] = -1;
+
+    cp = getenv(THREAD_AFFINITY_NAME);
+    if (cp == NULL) {
+        // exclusive use of the machine: thread i on cpu i, as it always was;
+        // the topology-aware policies are only used when asked for.
+        // non-exclusive: no affinity settings; let the kernel move threads about
+        int exclusive = DEFAULT_MACHINE_EXCLUSIVE;
+        char *ecp = getenv(MACHINE_EXCLUSIVE_NAME);
+        if (ecp)
+            exclusive = strtol(ecp, NULL, 10);
+        if (exclusive) {
+            for (i = 0;  i < jl_n_threads && i < ncpus;  ++i)
+                cpus[i] = i;
+        }
+        return 1;
+    }
+
+    if (strcmp(cp, "compact") != 0 && strcmp(cp, "spread") != 0) {
+        // a list of cpus and ranges of cpus, used in order
+        i = 0;
+        while (*cp && i < jl_n_threads) {
+            char *end;
+            long first = strtol(cp, &end, 10), last;
+            if (end == cp)
+                break;
+            last = first;
+            if (*end == '-')
+                last = strtol(end + 1, &end, 10);
+            for (long c = first;  c <= last && i < jl_n_threads;  ++c)
+                cpus[i++] = c;
+            cp = (*end == ',') ? end + 1 : end;
+        }
+        return 1;
+    }
+
+    ti_cpuinfo_t *info = (ti_cpuinfo_t*)malloc(ncpus * sizeof(ti_cpuinfo_t));
+    int maxsocket = 0;
+    for (i = 0;  i < ncpus;  ++i) {
+        info[i].cpu = i;
+        info[i].socket = ti_read_topology(i, "physical_package_id");
+        info[i].core = ti_read_topology(i, "core_id");
+        if (info[i].socket < 0) info[i].socket = 0;
+        if (info[i].core < 0) info[i].core = i;
+        if (info[i].socket > maxsocket) maxsocket = info[i].socket;
+        info[i].smt = 0;
+        for (j = 0;  j < i;  ++j)
+            if (info[j].socket == info[i].socket && info[j].core == info[i].core)
+                info[i].smt++;
+    }
+
+    if (!strcmp(cp, "compact")) {
+        qsort(info, ncpus, sizeof(ti_cpuinfo_t), ti_cpuinfo_compact);
+        for (i = 0;  i < jl_n_threads && i < ncpus;  ++i)
+            cpus[i] = info[i].cpu;
+    }
+    else {
+        // as many threads on each socket: the cpus of a socket are in a row
+        // after the sort, distinct cores first
+        int s, t = 0, msockets = maxsocket + 1;
+        qsort(info, ncpus, sizeof(ti_cpuinfo_t), ti_cpuinfo_spread);
+        for (s = 0, j = 0;  s < msockets;  ++s) {
+            int share = jl_n_threads / msockets + (s < jl_n_threads % msockets);
+            for (;  j < ncpus && info[j].socket < s;  ++j)
+                ;
+            for (;  j < ncpus && info[j].socket == s && share > 0;  ++j, --share)
+                cpus[t++] = info[j].cpu;
+        }
+        if (t == jl_n_threads && jl_n_threads % msockets == 0)
+            nsockets = msockets;
+    }
+
+    free(info);
+    return nsockets;
+}
+
 void jl_start_threads(void)
 {
-    char *cp, mask[UV_CPU_SETSIZE];
-    int i, exclusive;
+    int i, nsockets;
     uv_thread_t uvtid;
     ti_threadarg_t **targs;
+    int16_t *cpus = (int16_t*)malloc(jl_n_threads * sizeof(int16_t));
 
-    // do we have exclusive use of the machine? default is no
-    exclusive = DEFAULT_MACHINE_EXCLUSIVE;
-    cp = getenv(MACHINE_EXCLUSIVE_NAME);
-    if (cp)
-        exclusive = strtol(cp, NULL, 10);
-
-    // exclusive use: affinitize threads, master thread on proc 0, rest
-    // according to a 'compact' policy
-    // non-exclusive: no affinity settings; let the kernel move threads about
-    if (exclusive) {
-        memset(mask, 0, UV_CPU_SETSIZE);
-        mask[0] = 1;
-        uvtid = (uv_thread_t)uv_thread_self();
-        uv_thread_setaffinity(&uvtid, mask, NULL, UV_CPU_SETSIZE);
-    }
+    // master thread on the first cpu of the policy, the rest in order
+    nsockets = ti_place_threads(cpus);
+    ti_pin_thread(cpus[0]);
 
     // create threads
     targs = (ti_threadarg_t **)malloc((jl_n_threads - 1) * sizeof (ti_threadarg_t *));
@@ -346,18 +904,15 @@ void jl_start_threads(void)
         targs[i] = (ti_threadarg_t *)malloc(sizeof (ti_threadarg_t));
         targs[i]->state = TI_THREAD_INIT;
         targs[i]->tid = i + 1;
+        targs[i]->cpu = cpus[i + 1];
         uv_thread_create(&uvtid, ti_threadfun, targs[i]);
-        if (exclusive) {
-            memset(mask, 0, UV_CPU_SETSIZE);
-            mask[i+1] = 1;
-            uv_thread_setaffinity(&uvtid, mask, NULL, UV_CPU_SETSIZE);
-        }
         uv_thread_detach(&uvtid);
-        jl_all_task_states[i + 1].system_id = uvtid;
     }
 
+    free(cpus);
+
     // set up the world thread group
-    ti_threadgroup_create(1, jl_n_threads, 1, &tgworld);
+    ti_threadgroup_create(nsockets, jl_n_threads / nsockets, 1, &tgworld);
     for (i = 0;  i < jl_n_threads;  ++i)
         ti_threadgroup_addthread(tgworld, i, NULL);
     ti_threadgroup_initthread(tgworld, ti_tid);
@@ -392,20 +947,18 @@ void jl_shutdown_threading(void)
     // TODO: clean up and free the per-thread heaps
 
 #if PROFILE_JL_THREADING
-    jl_free_aligned(join_ticks);
-    jl_free_aligned(user_ticks);
-    jl_free_aligned(fork_ticks);
-    fork_ticks = user_ticks = join_ticks = NULL;
+    jl_free_aligned(ti_profile);
+    ti_profile = NULL;
 #endif
 }
 
 // return thread's thread group
 JL_DLLEXPORT void *jl_threadgroup(void) { return (void *)tgworld; }
 
-// interface to user code: specialize and compile the user thread function
-// and run it in all threads
-JL_DLLEXPORT jl_value_t *jl_threading_run(jl_function_t *f, jl_svec_t *args)
+// specialize and compile the user thread function and run it in all threads
+static jl_value_t *ti_threading_run(jl_function_t *f, jl_svec_t *args, jl_function_t *op)
 {
+    ti_check_not_foreign();
 #if PROFILE_JL_THREADING
     uint64_t tstart = rdtsc();
 #endif
@@ -427,14 +980,24 @@ JL_DLLEXPORT jl_value_t *jl_threading_run(jl_function_t *f, jl_svec_t *args)
         fun = f;
     jl_generate_fptr(fun);
 
+    if (tgworld->forked) {
+        // already in a threaded region
+        jl_value_t *ret = ti_run_nested(fun, args, op);
+        JL_GC_POP();
+        return ret;
+    }
+
     threadwork.command = TI_THREADWORK_RUN;
     threadwork.fun = fun;
     threadwork.args = args;
     threadwork.ret = jl_nothing;
+    threadwork.op = op;
+    ti_region++;
+    tgworld->loop_next = 0;
 
 #if PROFILE_JL_THREADING
     uint64_t tcompile = rdtsc();
-    prep_ticks += (tcompile - tstart);
+    ti_profile[ti_tid].prep_ticks += (tcompile - tstart);
 #endif
 
     // fork the world thread group
@@ -443,41 +1006,171 @@ JL_DLLEXPORT jl_value_t *jl_threading_run(jl_function_t *f, jl_svec_t *args)
 
 #if PROFILE_JL_THREADING
     uint64_t tfork = rdtsc();
-    fork_ticks[ti_tid] += (tfork - tcompile);
+    ti_profile[ti_tid].fork_ticks += (tfork - tcompile);
 #endif
 
-    // this thread must do work too (TODO: reduction?)
-    tw->ret = ti_run_fun(fun, args);
+    // this thread must do work too
+    ti_run_region(tw, ti_tid);
 
 #if PROFILE_JL_THREADING
     uint64_t trun = rdtsc();
-    user_ticks[ti_tid] += (trun - tfork);
+    ti_profile[ti_tid].user_ticks += (trun - tfork);
+    ti_profile_region(ti_tid, trun - tfork);
 #endif
 
-    // wait for completion (TODO: nowait?)
+    // wait for completion (TODO: nowait?), the threads that aren't done
+    // can still be stopped by a collection of the embedding program
+    int8_t gc_state = jl_gc_safe_enter();
     ti_threadgroup_join(tgworld, ti_tid);
+    jl_gc_state_restore(gc_state);
 
 #if PROFILE_JL_THREADING
     uint64_t tjoin = rdtsc();
-    join_ticks[ti_tid] += (tjoin - trun);
+    ti_profile[ti_tid].join_ticks += (tjoin - trun);
+    ti_profile_imbalance();
 #endif
 
     JL_GC_POP();
 
+    // the work spawned in the region is done, report what it threw
+    jl_value_t *se = ti_spawned_result();
+    if (op != NULL) {
+        // the whole reduction ended up in the result of this thread
+        ti_result_t *r = &ti_results[ti_tid];
+        jl_value_t *v = r->value, *e = r->exception;
+        r->value = r->exception = NULL;
+        if (e != NULL)
+            jl_throw(e);
+        if (se != jl_nothing)
+            jl_throw(se);
+        return v;
+    }
+    if (se != jl_nothing)
+        jl_throw(se);
     return tw->ret;
 }
 
+// interface to user code: run f(args...) in all threads
+JL_DLLEXPORT jl_value_t *jl_threading_run(jl_function_t *f, jl_svec_t *args)
+{
+    return ti_threading_run(f, args, NULL);
+}
+
+// same, and return op(op(r_1, r_2), ...) of the values r_i returned by the
+// threads, combined in a tree
+JL_DLLEXPORT jl_value_t *jl_threading_run_reduce(jl_function_t *f, jl_svec_t *args,
+                                                 jl_function_t *op)
+{
+    JL_TYPECHK(jl_threading_run_reduce, function, (jl_value_t*)op);
+    return ti_threading_run(f, args, op);
+}
+
+// hand out the iterations of a dynamic or guided loop over n iterations to
+// the threads of the region: returns the first one (counting from 0) of the
+// next *size iterations for the caller, *size being 0 once they are gone.
+// dynamic loops hand out `chunk` iterations at a time, guided ones a share
+// of what is left that shrinks down to `chunk`
+JL_DLLEXPORT int64_t jl_threading_next_chunk(int64_t n, int64_t chunk, int guided,
+                                             int64_t *size)
+{
+    ti_threadgroup_t *tg = tgworld;
+    ti_region_t *r = ti_contexts[ti_tid].region;
+    volatile int64_t *next = r != NULL ? &r->loop_next : &tg->loop_next;
+    int64_t first, sz;
+    if (chunk < 1)
+        chunk = 1;
+    if (!guided) {
+        first = JL_ATOMIC_FETCH_AND_ADD(*next, chunk);
+        sz = first >= n ? 0 : (n - first < chunk ? n - first : chunk);
+    }
+    else {
+        do {
+            first = *next;
+            if (first >= n) {
+                sz = 0;
+                break;
+            }
+            sz = (n - first) / (2 * tg->num_threads);
+            if (sz < chunk)
+                sz = chunk;
+            if (sz > n - first)
+                sz = n - first;
+        } while (!JL_ATOMIC_COMPARE_AND_SWAP(*next, first, first + sz));
+    }
+    *size = sz;
+    return first;
+}
+
+// run the work spawned so far on all the threads and wait for it to be done;
+// returns the first exception it threw, or nothing
+JL_DLLEXPORT jl_value_t *jl_threading_sync(void)
+{
+    ti_check_not_foreign();
+    if (tgworld->forked) {
+        // in a threaded region, help the other threads with it
+        ti_sync_spawned(ti_tid);
+    }
+    else if (ti_pending_work > 0) {
+        threadwork.command = TI_THREADWORK_SPAWNED;
+        ti_threadwork_t *tw = (ti_threadwork_t *)&threadwork;
+        ti_threadgroup_fork(tgworld, ti_tid, (void **)&tw);
+        ti_sync_spawned(ti_tid);
+        int8_t gc_state = jl_gc_safe_enter();
+        ti_threadgroup_join(tgworld, ti_tid);
+        jl_gc_state_restore(gc_state);
+    }
+    return ti_spawned_result();
+}
+
 #if PROFILE_JL_THREADING
 
 void ti_reset_timings(void)
 {
     int i;
-    prep_ticks = 0;
-    for (i = 0;  i < jl_n_threads;  i++)
-        fork_ticks[i] = user_ticks[i] = join_ticks[i] = 0;
+    memset(ti_profile, 0, jl_n_threads * sizeof(ti_profile_t));
+    for (i = 0;  tgworld && i < tgworld->num_threads;  i++) {
+        ti_thread_sense_t *ts = tgworld->thread_sense[i];
+        if (ts)
+            ts->spin_ticks = ts->sleep_ticks = ts->nsleeps = 0;
+    }
 }
 
-void ti_timings(uint64_t *times, uint64_t *min, uint64_t *max, uint64_t *avg)
+#define TICKS_TO_NS(t)          ((uint64_t)(((double)(t)) / cpu_ghz))
+#define TICKS_TO_SECS(t)        (((double)(t)) / (cpu_ghz * 1e9))
+
+// the profile of thread tid, returns -1 if there is no such thread (or the
+// runtime is built without profiling). all the times are in ns
+JL_DLLEXPORT int jl_threading_profile_data(int tid, Thread_Profile *prof)
+{
+    if (!ti_profile || !tgworld || tid < 0 || tid >= jl_n_threads)
+        return -1;
+    ti_profile_t *p = &ti_profile[tid];
+    ti_thread_sense_t *ts = tgworld->thread_sense[tgworld->tid_map[tid]];
+    int i;
+    prof->nregions = p->nregions;
+    prof->prep = TICKS_TO_NS(p->prep_ticks);
+    prof->fork = TICKS_TO_NS(p->fork_ticks);
+    prof->fork_spin = TICKS_TO_NS(ts->spin_ticks);
+    prof->fork_sleep = TICKS_TO_NS(ts->sleep_ticks);
+    prof->nsleeps = ts->nsleeps;
+    prof->user = TICKS_TO_NS(p->user_ticks);
+    prof->join = TICKS_TO_NS(p->join_ticks);
+    prof->gc = TICKS_TO_NS(p->gc_ticks);
+    prof->imbalance = TICKS_TO_NS(p->imbalance_ticks);
+    for (i = 0;  i < TI_PROFILE_HIST_SIZE;  i++) {
+        prof->user_hist[i] = p->user_hist[i];
+        prof->imbalance_hist[i] = p->imbalance_hist[i];
+    }
+    return 0;
+}
+
+JL_DLLEXPORT void jl_threading_profile_clear(void)
+{
+    if (ti_profile)
+        ti_reset_timings();
+}
+
+static void ti_timings(uint64_t *times, uint64_t *min, uint64_t *max, uint64_t *avg)
 {
     int i;
     *min = UINT64_MAX;
@@ -492,29 +1185,44 @@ void ti_timings(uint64_t *times, uint64_t *min, uint64_t *max, uint64_t *avg)
     *avg /= jl_n_threads;
 }
 
-#define TICKS_TO_SECS(t)        (((double)(t)) / (cpu_ghz * 1e9))
-
 JL_DLLEXPORT void jl_threading_profile(void)
 {
-    if (!fork_ticks) return;
-
-    printf("\nti profile:\n");
-    printf("prep: %g (%llu)\n", TICKS_TO_SECS(prep_ticks), (unsigned long long)prep_ticks);
+    if (!ti_profile) return;
 
+    uint64_t *times = (uint64_t*)alloca(jl_n_threads * sizeof(uint64_t));
     uint64_t min, max, avg;
-    ti_timings(fork_ticks, &min, &max, &avg);
-    printf("fork: %g (%g - %g)\n", TICKS_TO_SECS(min), TICKS_TO_SECS(max),
-            TICKS_TO_SECS(avg));
-    ti_timings(user_ticks, &min, &max, &avg);
-    printf("user: %g (%g - %g)\n", TICKS_TO_SECS(min), TICKS_TO_SECS(max),
-            TICKS_TO_SECS(avg));
-    ti_timings(join_ticks, &min, &max, &avg);
-    printf("join: %g (%g - %g)\n", TICKS_TO_SECS(min), TICKS_TO_SECS(max),
-            TICKS_TO_SECS(avg));
+    int i;
+
+    printf("\nti profile:\n");
+    printf("prep: %g (%llu)\n", TICKS_TO_SECS(ti_profile[0].prep_ticks),
+           (unsigned long long)ti_profile[0].prep_ticks);
+
+#define TI_PRINT_TIMINGS(name, field)                                   \
+    for (i = 0;  i < jl_n_threads;  i++)                                \
+        times[i] = ti_profile[i].field;                                 \
+    ti_timings(times, &min, &max, &avg);                                \
+    printf(name ": %g (%g - %g)\n", TICKS_TO_SECS(min), TICKS_TO_SECS(max), \
+           TICKS_TO_SECS(avg))
+
+    TI_PRINT_TIMINGS("fork", fork_ticks);
+    TI_PRINT_TIMINGS("user", user_ticks);
+    TI_PRINT_TIMINGS("join", join_ticks);
+    TI_PRINT_TIMINGS("gc", gc_ticks);
+    TI_PRINT_TIMINGS("imbalance", imbalance_ticks);
+#undef TI_PRINT_TIMINGS
 }
 
 #else //!PROFILE_JL_THREADING
 
+JL_DLLEXPORT int jl_threading_profile_data(int tid, Thread_Profile *prof)
+{
+    return -1;
+}
+
+JL_DLLEXPORT void jl_threading_profile_clear(void)
+{
+}
+
 JL_DLLEXPORT void jl_threading_profile(void)
 {
 }
@@ -523,13 +1231,65 @@ JL_DLLEXPORT void jl_threading_profile(void)
 
 #else // !JULIA_ENABLE_THREADING
 
+// the cursor of the innermost region running, saved by the regions that
+// nest in it, as each threaded region has its own
+static int64_t ti_loop_next;
+
 JL_DLLEXPORT jl_value_t *jl_threading_run(jl_function_t *f, jl_svec_t *args)
 {
     if ((jl_value_t*)args == jl_emptytuple)
         args = jl_emptysvec;
     JL_TYPECHK(jl_threading_run, function, (jl_value_t*)f);
     JL_TYPECHK(jl_threading_run, simplevector, (jl_value_t*)args);
-    return ti_run_fun(f, args);
+    int64_t outer_loop_next = ti_loop_next;
+    ti_loop_next = 0;
+    jl_value_t *ret = ti_run_fun(f, args, NULL);
+    ti_loop_next = outer_loop_next;
+    ti_run_spawned(0);
+    jl_value_t *se = ti_spawned_result();
+    if (se != jl_nothing)
+        jl_throw(se);
+    return ret;
+}
+
+JL_DLLEXPORT int64_t jl_threading_next_chunk(int64_t n, int64_t chunk, int guided,
+                                             int64_t *size)
+{
+    // a single thread takes all that is left
+    int64_t first = ti_loop_next;
+    *size = first < n ? n - first : 0;
+    ti_loop_next = n;
+    return first;
+}
+
+JL_DLLEXPORT jl_value_t *jl_threading_run_reduce(jl_function_t *f, jl_svec_t *args,
+                                                 jl_function_t *op)
+{
+    if ((jl_value_t*)args == jl_emptytuple)
+        args = jl_emptysvec;
+    JL_TYPECHK(jl_threading_run_reduce, function, (jl_value_t*)f);
+    JL_TYPECHK(jl_threading_run_reduce, simplevector, (jl_value_t*)args);
+    JL_TYPECHK(jl_threading_run_reduce, function, (jl_value_t*)op);
+    jl_value_t *ret = jl_nothing;
+    JL_GC_PUSH1(&ret);
+    int64_t outer_loop_next = ti_loop_next;
+    ti_loop_next = 0;
+    jl_value_t *e = ti_run_fun(f, args, &ret);
+    ti_loop_next = outer_loop_next;
+    ti_run_spawned(0);
+    JL_GC_POP();
+    jl_value_t *se = ti_spawned_result();
+    if (e != jl_nothing)
+        jl_throw(e);
+    if (se != jl_nothing)
+        jl_throw(se);
+    return ret;
+}
+
+JL_DLLEXPORT jl_value_t *jl_threading_sync(void)
+{
+    ti_sync_spawned(0);
+    return ti_spawned_result();
 }
 
 void jl_init_threading(void)
@@ -537,6 +1297,7 @@ void jl_init_threading(void)
     static jl_thread_task_state_t _jl_all_task_states;
     jl_all_task_states = &_jl_all_task_states;
     jl_n_threads = 1;
+    ti_init_workqueues();
 
 #if defined(__linux__) && defined(JL_USE_INTEL_JITEVENTS)
     if (jl_using_intel_jitevents)
@@ -550,6 +1311,19 @@ void jl_init_threading(void)
 
 void jl_start_threads(void) { }
 
+JL_DLLEXPORT int jl_threading_profile_data(int tid, Thread_Profile *prof)
+{
+    return -1;
+}
+
+JL_DLLEXPORT void jl_threading_profile_clear(void)
+{
+}
+
+JL_DLLEXPORT void jl_threading_profile(void)
+{
+}
+
 #endif // !JULIA_ENABLE_THREADING
 
 #ifdef __cplusplus
@@ -17,12 +17,43 @@ extern "C" {
 #define ti_tid (jl_get_ptls_states()->tid)
 extern jl_thread_task_state_t *jl_all_task_states;
 extern JL_DLLEXPORT int jl_n_threads;  // # threads we're actually using
+// threads of the embedding program registered with jl_adopt_thread; they
+// come after the julia threads in jl_all_task_states (and jl_all_heaps)
+extern int jl_max_foreign_threads;
+extern volatile int jl_n_foreign_threads;
+#define ti_is_foreign(tid) ((tid) >= jl_n_threads)
 
 #ifdef JULIA_ENABLE_THREADING
 // GC
 extern struct _jl_thread_heap_t **jl_all_heaps;
 #endif
 
+#define TI_PROFILE_HIST_SIZE 24
+
+#if PROFILE_JL_THREADING
+// what a thread did in the threaded regions, in cycles. written by the
+// thread itself, but for the imbalance that the master adds up after the
+// join; the records are on cache lines of their own
+typedef struct {
+    uint64_t    nregions;
+    uint64_t    prep_ticks;         // specializing and compiling (master only)
+    uint64_t    fork_ticks;         // waiting to be released (releasing, for the master)
+    uint64_t    user_ticks;
+    uint64_t    join_ticks;
+    uint64_t    gc_ticks;           // in collections, waiting at their barriers included
+    uint64_t    imbalance_ticks;    // behind the slowest thread, summed over the regions
+    uint64_t    region_ticks;       // user time of the last region
+    // regions whose user time, or imbalance, was in [2^(i-1), 2^i) us,
+    // the last one the longer ones
+    uint64_t    user_hist[TI_PROFILE_HIST_SIZE];
+    uint64_t    imbalance_hist[TI_PROFILE_HIST_SIZE];
+
+    uint8_t     pad[64 - ((8 + 2 * TI_PROFILE_HIST_SIZE) * sizeof(uint64_t)) % 64];
+} ti_profile_t;
+
+extern ti_profile_t *ti_profile;
+#endif
+
 // thread state
 enum {
     TI_THREAD_INIT,
@@ -34,6 +65,7 @@ enum {
 typedef struct {
     int16_t volatile    state;
     int16_t             tid;
+    int16_t             cpu;    // to pin the thread to, or -1
     ti_threadgroup_t    *tg;
 
 } ti_threadarg_t;
@@ -42,7 +74,9 @@ typedef struct {
 // commands to thread function
 enum {
     TI_THREADWORK_DONE,
-    TI_THREADWORK_RUN
+    TI_THREADWORK_RUN,
+    TI_THREADWORK_GC_MARK,
+    TI_THREADWORK_SPAWNED
 };
 
 
@@ -52,16 +86,85 @@ typedef struct {
     jl_function_t       *fun;
     jl_svec_t           *args;
     jl_value_t          *ret;
+    jl_function_t       *op;        // to reduce the results with, or NULL
 
 } ti_threadwork_t;
 
 
+// a threaded region started from inside another one; its "threads" are
+// items of the work queues, so that it runs on the threads that are free
+typedef struct {
+    jl_function_t       *fun;
+    jl_svec_t           *args;
+    jl_array_t          *results;   // value of each thread, for a reduction
+    jl_value_t          *volatile exception;
+    volatile int64_t    loop_next;  // for dynamic and guided loops
+    volatile int        nrunning;   // threads of the region not done yet
+
+} ti_region_t;
+
+// what a thread is running: the thread `tid` of a nested region, or its own
+// part of the top-level region when region is NULL
+typedef struct {
+    ti_region_t         *region;
+    int16_t             tid;
+    int16_t             nitems;     // queued items running on the thread's stack
+
+    uint8_t             pad[64 - sizeof(void*) - 2*sizeof(int16_t)];
+} ti_context_t;
+
+extern ti_context_t *ti_contexts;
+
+// item of a work queue: a function spawned with `jl_threading_spawn`, or
+// a thread of a nested region
+typedef struct {
+    jl_value_t          *fun;
+    ti_region_t         *region;
+    int16_t             tid;
+
+} ti_workitem_t;
+
+// queue of the work spawned by a thread; the owner pushes and pops at the
+// top, threads that are out of work steal from the bottom
+typedef struct {
+    volatile int        lock;
+    volatile size_t     top, bottom;
+    size_t              size;
+    ti_workitem_t       *items;
+
+} ti_workqueue_t;
+
+extern ti_workqueue_t *ti_workqueues;
+extern jl_value_t *volatile ti_spawn_exception;
+
+
 // thread function
 void ti_threadfun(void *arg);
 
 // helpers for thread function
 jl_value_t *ti_runthread(jl_function_t *f, jl_svec_t *args, size_t nargs);
 
+#ifdef JULIA_ENABLE_THREADING
+// result of one thread in a threaded region with a reduction
+typedef struct {
+    jl_value_t          *value;
+    jl_value_t          *exception;
+    volatile size_t     ready;      // region whose result this is
+
+    uint8_t             pad[64 - 2*sizeof(void*) - sizeof(size_t)];
+} ti_result_t;
+
+extern ti_result_t *ti_results;
+
+// set while a collection waits for all the threads of a threaded region
+extern volatile int jl_gc_running;
+// take part in a parallel mark of the garbage collector (see gc.c)
+void jl_gc_mark_helper(void);
+// the SIGSEGV handler's side of the safepoint page
+int jl_gc_is_safepoint_addr(void *addr);
+void jl_gc_signal_safepoint(void);
+#endif
+
 #ifdef __cplusplus
 }
 #endif
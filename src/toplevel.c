@@ -258,51 +258,112 @@ int jl_has_intrinsics(jl_expr_t *ast, jl_expr_t *e, jl_module_t *m)
     return 0;
 }
 
+static jl_value_t *first_gensym_in(jl_value_t *e)
+{
+    if (jl_is_gensym(e))
+        return e;
+    if (jl_is_expr(e)) {
+        size_t i;
+        for(i=0; i < jl_array_len(((jl_expr_t*)e)->args); i++) {
+            jl_value_t *g = first_gensym_in(jl_exprarg(e,i));
+            if (g != NULL)
+                return g;
+        }
+    }
+    return NULL;
+}
+
+// the number of iterations of a loop whose condition is `cond`, if it goes
+// over a range of literal integers, otherwise -1. the condition of such a
+// loop calls `done` on the gensym the range is assigned to.
+static ssize_t literal_range_trips(jl_array_t *body, jl_value_t *cond)
+{
+    jl_value_t *g = first_gensym_in(cond);
+    if (g == NULL)
+        return -1;
+    size_t i;
+    for(i=0; i < jl_array_len(body); i++) {
+        jl_value_t *stmt = jl_cellref(body,i);
+        if (!jl_is_expr(stmt) || ((jl_expr_t*)stmt)->head != assign_sym ||
+            !jl_is_gensym(jl_exprarg(stmt,0)) ||
+            ((jl_gensym_t*)jl_exprarg(stmt,0))->id != ((jl_gensym_t*)g)->id)
+            continue;
+        jl_value_t *rhs = jl_exprarg(stmt,1);
+        if (!jl_is_expr(rhs) || ((jl_expr_t*)rhs)->head != call_sym)
+            return -1;
+        size_t na = jl_array_len(((jl_expr_t*)rhs)->args);
+        if ((na != 3 && na != 4) || jl_exprarg(rhs,0) != (jl_value_t*)jl_symbol("colon"))
+            return -1;
+        for(size_t j=1; j < na; j++) {
+            if (!jl_is_long(jl_exprarg(rhs,j)))
+                return -1;
+        }
+        ssize_t start = jl_unbox_long(jl_exprarg(rhs,1));
+        ssize_t stop = jl_unbox_long(jl_exprarg(rhs,na-1));
+        ssize_t step = na == 4 ? jl_unbox_long(jl_exprarg(rhs,2)) : 1;
+        if (step == 0)
+            return -1;
+        ssize_t n = (stop - start)/step + 1;
+        return n < 0 ? 0 : n;
+    }
+    return -1;
+}
+
 // heuristic for whether a top-level input should be evaluated with
-// the compiler or the interpreter.
+// the compiler or the interpreter: compile when the statements it is
+// estimated to run (see INTERP_MAX_STMTS) would take longer to interpret.
+// code without loops runs each statement once, so it is only compiled for
+// the intrinsics, which the interpreter can't call.
 int jl_eval_with_compiler_p(jl_expr_t *ast, jl_expr_t *expr, int compileloops, jl_module_t *m)
 {
     assert(jl_is_expr(expr));
     if (expr->head==body_sym && compileloops) {
         jl_array_t *body = expr->args;
-        size_t i, maxlabl=0;
-        // compile if there are backwards branches
-        for(i=0; i < jl_array_len(body); i++) {
+        size_t i, maxlabl=0, n = jl_array_len(body);
+        for(i=0; i < n; i++) {
             jl_value_t *stmt = jl_cellref(body,i);
             if (jl_is_labelnode(stmt)) {
                 int l = jl_labelnode_label(stmt);
                 if (l > maxlabl) maxlabl = l;
             }
         }
-        size_t sz = (maxlabl+1+7)/8;
-        char *labls = (char*)alloca(sz); memset(labls,0,sz);
-        for(i=0; i < jl_array_len(body); i++) {
+        // statement index of each label seen so far, so a branch to one of
+        // them is the backward branch at the end of a loop
+        ssize_t *labls = (ssize_t*)alloca((maxlabl+1)*sizeof(ssize_t));
+        for(i=0; i <= maxlabl; i++) labls[i] = -1;
+        // how many times each statement runs: the product of the trips of
+        // the loops around it
+        double *runs = (double*)malloc(n*sizeof(double));
+        for(i=0; i < n; i++) runs[i] = 1;
+        int hasloops = 0;
+        for(i=0; i < n; i++) {
             jl_value_t *stmt = jl_cellref(body,i);
+            int l = -1;
+            ssize_t trips = INTERP_LOOP_TRIPS;
             if (jl_is_labelnode(stmt)) {
-                int l = jl_labelnode_label(stmt);
-                labls[l/8] |= (1<<(l&7));
+                labls[jl_labelnode_label(stmt)] = i;
             }
-            else if (compileloops && jl_is_gotonode(stmt)) {
-                int l = jl_gotonode_label(stmt);
-                if (labls[l/8]&(1<<(l&7))) {
-                    return 1;
-                }
+            else if (jl_is_gotonode(stmt)) {
+                l = jl_gotonode_label(stmt);
             }
-            else if (jl_is_expr(stmt)) {
-                if (compileloops && ((jl_expr_t*)stmt)->head==goto_ifnot_sym) {
-                    int l = jl_unbox_long(jl_exprarg(stmt,1));
-                    if (labls[l/8]&(1<<(l&7))) {
-                        return 1;
-                    }
-                }
-                // to compile code that uses exceptions
-                /*
-                if (((jl_expr_t*)stmt)->head == enter_sym) {
-                    return 1;
-                }
-                */
+            else if (jl_is_expr(stmt) && ((jl_expr_t*)stmt)->head==goto_ifnot_sym) {
+                l = jl_unbox_long(jl_exprarg(stmt,1));
+                ssize_t lt = literal_range_trips(body, jl_exprarg(stmt,0));
+                if (lt >= 0)
+                    trips = lt;
+            }
+            if (l >= 0 && l <= maxlabl && labls[l] >= 0) {
+                for(size_t j=labls[l]; j <= i; j++)
+                    runs[j] *= trips;
+                hasloops = 1;
             }
         }
+        double cost = 0;
+        for(i=0; i < n; i++)
+            cost += runs[i];
+        free(runs);
+        if (hasloops && cost > INTERP_MAX_STMTS)
+            return 1;
     }
     if (jl_has_intrinsics(ast, expr, m)) return 1;
     return 0;
@@ -555,7 +616,11 @@ JL_DLLEXPORT jl_value_t *jl_toplevel_eval(jl_value_t *v)
 }
 
 // repeatedly call jl_parse_next and eval everything
-jl_value_t *jl_parse_eval_all(const char *fname, size_t len)
+// evaluate the forms of the file being parsed. with forms, evaluate those
+// instead, a list of line numbers and forms, and with save, write the line
+// number and form parsed to it before evaluating each one
+static jl_value_t *jl_eval_forms(const char *fname, size_t len,
+                                 jl_array_t *forms, ios_t *save)
 {
     //jl_printf(JL_STDERR, "***** loading %s\n", fname);
     int last_lineno = jl_lineno;
@@ -566,7 +631,17 @@ jl_value_t *jl_parse_eval_all(const char *fname, size_t len)
     JL_GC_PUSH4(&fn, &ln, &form, &result);
     JL_TRY {
         // handle syntax error
+        size_t i = 0;
         while (1) {
+            if (forms != NULL) {
+                if (i >= jl_array_len(forms))
+                    break;
+                jl_lineno = jl_unbox_long(jl_cellref(forms, i));
+                form = jl_cellref(forms, i+1);
+                i += 2;
+                result = jl_toplevel_eval_flex(form, 1);
+                continue;
+            }
             form = jl_parse_next();
             if (form == NULL)
                 break;
@@ -578,11 +653,17 @@ jl_value_t *jl_parse_eval_all(const char *fname, size_t len)
                     jl_interpret_toplevel_expr(form);
                 }
             }
+            if (save != NULL) {
+                int32_t line = jl_lineno;
+                ios_write(save, (char*)&line, sizeof(line));
+                jl_serialize_data(save, form);
+            }
             result = jl_toplevel_eval_flex(form, 1);
         }
     }
     JL_CATCH {
-        jl_stop_parsing();
+        if (forms == NULL)
+            jl_stop_parsing();
         fn = jl_pchar_to_string(fname, len);
         ln = jl_box_long(jl_lineno);
         jl_lineno = last_lineno;
@@ -595,13 +676,132 @@ jl_value_t *jl_parse_eval_all(const char *fname, size_t len)
                                            jl_exception_in_transit));
         }
     }
-    jl_stop_parsing();
+    if (forms == NULL)
+        jl_stop_parsing();
     jl_lineno = last_lineno;
     jl_filename = last_filename;
     JL_GC_POP();
     return result;
 }
 
+jl_value_t *jl_parse_eval_all(const char *fname, size_t len)
+{
+    return jl_eval_forms(fname, len, NULL, NULL);
+}
+
+// cache of parsed files ------------------------------------------------------
+
+// with JULIA_AST_CACHE set to a directory, the forms jl_load parses from a
+// file are written there, to a file named after the hash of the path and
+// contents, and a later load of the same file with the same contents reads
+// them back instead of running the parser. the path is part of the key since
+// the parsed forms record it (in their line numbers and @__FILE__). a cache
+// file starts with a header telling which julia wrote it, the path, and the
+// length and second hash of the contents, then has the line number and
+// serialized form of each toplevel form. only the parsing is skipped:
+// expanding a form depends on the macros and bindings defined when it runs
+
+static const char ast_cache_magic[] = "JLAST\x02";
+
+static void ast_cache_write_header(ios_t *s, const char *fpath, const char *text, size_t sz)
+{
+    ios_write(s, ast_cache_magic, sizeof(ast_cache_magic));
+    ios_write(s, jl_ver_string(), strlen(jl_ver_string()) + 1);
+    ios_write(s, jl_git_commit(), strlen(jl_git_commit()) + 1);
+    ios_write(s, fpath, strlen(fpath) + 1);
+    uint64_t len = sz;
+    uint32_t h = memhash32(text, sz);
+    ios_write(s, (char*)&len, sizeof(len));
+    ios_write(s, (char*)&h, sizeof(h));
+}
+
+// the cached forms of text read from fpath, or NULL if they aren't in the cache file s
+static jl_array_t *ast_cache_read(ios_t *s, const char *fpath, const char *text, size_t sz)
+{
+    ios_t hdr;
+    ios_mem(&hdr, 0);
+    ast_cache_write_header(&hdr, fpath, text, sz);
+    size_t hlen;
+    char *expected = ios_takebuf(&hdr, &hlen);
+    ios_close(&hdr);
+    char *found = (char*)malloc(hlen);
+    int ok = ios_readall(s, found, hlen) == hlen && memcmp(found, expected, hlen) == 0;
+    free(found);
+    free(expected);
+    if (!ok)
+        return NULL;
+    jl_array_t *forms = jl_alloc_cell_1d(0);
+    jl_value_t *v = NULL;
+    JL_GC_PUSH2(&forms, &v);
+    int32_t line;
+    while (ios_readall(s, (char*)&line, sizeof(line)) == sizeof(line)) {
+        v = jl_box_long(line);
+        jl_cell_1d_push(forms, v);
+        v = jl_deserialize_data(s);
+        jl_cell_1d_push(forms, v);
+    }
+    JL_GC_POP();
+    return forms;
+}
+
+static jl_value_t *jl_load_cached(const char *dir, const char *fpath, size_t len)
+{
+    ios_t f;
+    if (ios_file(&f, fpath, 1, 0, 0, 0) == NULL)
+        jl_errorf("could not open file %s", fpath);
+    ios_t mem;
+    ios_mem(&mem, 0);
+    ios_copyall(&mem, &f);
+    ios_close(&f);
+    size_t sz;
+    char *text = ios_takebuf(&mem, &sz);
+    ios_close(&mem);
+
+    size_t dlen = strlen(dir);
+    char *cpath = (char*)alloca(dlen + 32);
+    uint64_t key = memhash_seed(text, sz, memhash32(fpath, strlen(fpath)));
+    snprintf(cpath, dlen + 32, "%s/%016" PRIx64 ".ast", dir, key);
+    jl_array_t *forms = NULL;
+    jl_value_t *result = NULL;
+    JL_GC_PUSH2(&forms, &result);
+    if (ios_file(&f, cpath, 1, 0, 0, 0) != NULL) {
+        forms = ast_cache_read(&f, fpath, text, sz);
+        ios_close(&f);
+    }
+    if (forms != NULL) {
+        free(text);
+        result = jl_eval_forms(fpath, len, forms, NULL);
+        JL_GC_POP();
+        return result;
+    }
+
+    // parse the file, writing it to the cache once it loaded without errors
+    ios_t save;
+    ios_mem(&save, 0);
+    ast_cache_write_header(&save, fpath, text, sz);
+    jl_start_parsing_string(text, sz, fpath);
+    JL_TRY {
+        result = jl_eval_forms(fpath, len, NULL, &save);
+    }
+    JL_CATCH {
+        ios_close(&save);
+        free(text);
+        jl_rethrow();
+    }
+    free(text);
+    char *tmppath = strcat(strcpy((char*)alloca(strlen(cpath) + 8), cpath), ".XXXXXX");
+    if (ios_mkstemp(&f, tmppath) != NULL) {
+        ios_seek(&save, 0);
+        ios_copyall(&f, &save);
+        ios_close(&f);
+        if (rename(tmppath, cpath) != 0)
+            unlink(tmppath);
+    }
+    ios_close(&save);
+    JL_GC_POP();
+    return result;
+}
+
 JL_DLLEXPORT jl_value_t *jl_load(const char *fname, size_t len)
 {
     if (jl_current_module->istopmod) {
@@ -615,6 +815,9 @@ JL_DLLEXPORT jl_value_t *jl_load(const char *fname, size_t len)
     if (jl_stat(fpath, (char*)&stbuf) != 0 || (stbuf.st_mode & S_IFMT) != S_IFREG) {
         jl_errorf("could not open file %s", fpath);
     }
+    const char *cachedir = getenv(AST_CACHE_DIR_NAME);
+    if (cachedir != NULL && *cachedir && jl_base_module != NULL)
+        return jl_load_cached(cachedir, fpath, len);
     if (jl_start_parsing_file(fpath) != 0) {
         jl_errorf("could not open file %s", fpath);
     }
@@ -645,6 +848,7 @@ void jl_set_datatype_super(jl_datatype_t *tt, jl_value_t *super)
     }
     tt->super = (jl_datatype_t*)super;
     jl_gc_wb(tt, tt->super);
+    jl_clear_type_memo();
     if (jl_svec_len(tt->parameters) > 0) {
         tt->name->cache = jl_emptysvec;
         tt->name->linearcache = jl_emptysvec;
@@ -1446,3 +1446,24 @@ end
 
 # issue #14482
 @inferred Base.map_to!(Int8, 1, Int8[0], Int[0])
+
+# malloc'd array data is cache-line aligned, and mapped when it's big
+let a = zeros(10000), b = zeros(UInt8, 5*1024*1024)
+    @test UInt(pointer(a)) % 64 == 0
+    @test UInt(pointer(b)) % 4096 == 0
+    v = Int[]
+    for i = 1:3*10^6
+        push!(v, i)
+    end
+    @test UInt(pointer(v)) % 64 == 0
+    @test v == 1:3*10^6
+end
+
+# copying pointer arrays
+let a = Any[1, "a", :b, 2.0], b = Array(Any, 6)
+    copy!(b, 2, a, 1, 4)
+    @test b[2:5] == a && !isdefined(b, 1) && !isdefined(b, 6)
+    copy!(a, 2, a, 1, 3)
+    @test a == Any[1, 1, "a", :b]
+    @test vcat(Any[1, "x"], Any[:y]) == Any[1, "x", :y]
+end
@@ -103,3 +103,17 @@ let
     @test (code_loc(b1[ind1[1]])[3]::Int == code_loc(b2[ind2[1]])[3]::Int) != # source line, for example: essentials.jl:58
           (code_loc(b1[ind1[1]])[5]::Int == code_loc(b2[ind2[1]])[5]::Int)    # inlined line, for example: backtrace.jl:82
 end
+
+# JULIA_BT_MAX_DEPTH caps the frames recorded for a thrown exception
+let exename = `$(joinpath(JULIA_HOME, Base.julia_exename())) --precompiled=yes`,
+    code = "f(n) = n == 0 ? error() : f(n-1); try f(1000) catch; print(length(catch_backtrace())) end"
+    @test parse(Int, readall(`$exename -e $code`)) > 1000
+    withenv("JULIA_BT_MAX_DEPTH" => "20") do
+        @test parse(Int, readall(`$exename -e $code`)) == 20
+    end
+end
+
+# @noinline functions keep their frames when their callers are compiled with them
+@noinline batch_bt() = backtrace()
+batch_bt_caller() = batch_bt()
+@test any(p -> code_loc(p)[1] == :batch_bt, batch_bt_caller())
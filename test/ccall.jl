@@ -219,6 +219,16 @@ foo13031(x,y,z) = z
 foo13031p = cfunction(foo13031, Cint, (Ref{Tuple{}},Ref{Tuple{}},Cint))
 ccall(foo13031p, Cint, (Ref{Tuple{}},Ref{Tuple{}},Cint), (), (), 8)
 
+# cfunction wrappers are reused until a new method could change the target
+cfcache(x) = x + Cint(1)
+cfcache_p = cfunction(cfcache, Cint, (Cint,))
+@test cfunction(cfcache, Cint, (Cint,)) == cfcache_p
+@test ccall(cfcache_p, Cint, (Cint,), 1) == 2
+cfcache(x::Cint) = x + Cint(2)
+cfcache_p2 = cfunction(cfcache, Cint, (Cint,))
+@test cfcache_p2 != cfcache_p
+@test ccall(cfcache_p2, Cint, (Cint,), 1) == 3
+
 # @threadcall functionality
 threadcall_test_func(x) =
     @threadcall((:testUcharX, libccalltest), Int32, (UInt8,), x % UInt8)
@@ -232,3 +242,22 @@ threadcall_test_func(x) =
 end
 
 @test ccall(:jl_getpagesize, Clong, ()) == @threadcall(:jl_getpagesize, Clong, ())
+
+# the classifications of struct types are cached per type: instances of one
+# parametric type with the same layout but different classes, passed in turn
+# to C and to cfunctions, each keep theirs
+immutable ClassPair{T}
+    x::T
+    y::T
+end
+clspair_echo{T}(p::ClassPair{T}) = p
+let pi = ClassPair{Int64}(7, 9), pf = ClassPair{Float64}(7.5, 9.25)
+    for i = 1:2
+        @test ccall((:test_3b, libccalltest), ClassPair{Int64}, (ClassPair{Int64},), pi) == ClassPair{Int64}(8, 7)
+        @test ccall((:test_15, libccalltest), ClassPair{Float64}, (ClassPair{Float64},), pf) == ClassPair{Float64}(8.5, 7.25)
+        @test ccall(cfunction(clspair_echo, ClassPair{Float64}, (ClassPair{Float64},)),
+                    ClassPair{Float64}, (ClassPair{Float64},), pf) == pf
+        @test ccall(cfunction(clspair_echo, ClassPair{Int64}, (ClassPair{Int64},)),
+                    ClassPair{Int64}, (ClassPair{Int64},), pi) == pi
+    end
+end
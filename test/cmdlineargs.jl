@@ -65,6 +65,12 @@ let exename = `$(joinpath(JULIA_HOME, Base.julia_exename())) --precompiled=yes`
     @unix_only if Libdl.dlopen_e(splitext(bytestring(Base.JLOptions().image_file))[1]) != C_NULL
         @test !success(`$exename -C invalidtarget`)
         @test !success(`$exename --cpu-target=invalidtarget`)
+        let target = bytestring(Base.JLOptions().cpu_target)
+            # the JIT uses the first of a list of targets
+            @test readchomp(`$exename -C $target,generic --precompiled=no -E "sum(collect(1:10))"`) == "55"
+            # and the native code of the image is only used with the list it was built for
+            @test !success(`$exename -C $target,generic -e "nothing"`)
+        end
     end
 
     # --procs
@@ -116,6 +122,21 @@ let exename = `$(joinpath(JULIA_HOME, Base.julia_exename())) --precompiled=yes`
     @test readchomp(`$exename -E "Bool(Base.JLOptions().code_coverage)" --code-coverage`) == "true"
     @test readchomp(`$exename -E "Bool(Base.JLOptions().code_coverage)" --code-coverage=user`) == "true"
 
+    # the line counts, and with JULIA_COVERAGE_MODE=once whether the lines ran
+    let dir = mktempdir(), src = joinpath(dir, "cov.jl")
+        open(io -> write(io, "function covf(n)\n    s = 0\n    for i = 1:n\n        s += i\n    end\n    s\nend\ncovf(10)\n"), src, "w")
+        for (mode, count) in (("count", "10"), ("once", "1"))
+            withenv("JULIA_COVERAGE_MODE" => mode) do
+                @test success(`$exename --code-coverage=user $src`)
+            end
+            covs = filter(f -> endswith(f, ".cov"), readdir(dir))
+            @test length(covs) == 1
+            @test split(readlines(joinpath(dir, covs[1]))[4])[1] == count
+            rm(joinpath(dir, covs[1]))
+        end
+        rm(dir, recursive=true)
+    end
+
     # --track-allocation
     @test readchomp(`$exename -E "Bool(Base.JLOptions().malloc_log)"`) == "false"
     @test readchomp(`$exename -E "Bool(Base.JLOptions().malloc_log)" --track-allocation=none`) == "false"
@@ -123,6 +144,42 @@ let exename = `$(joinpath(JULIA_HOME, Base.julia_exename())) --precompiled=yes`
     @test readchomp(`$exename -E "Bool(Base.JLOptions().malloc_log)" --track-allocation`) == "true"
     @test readchomp(`$exename -E "Bool(Base.JLOptions().malloc_log)" --track-allocation=user`) == "true"
 
+    # --fork-server, --fork-client
+    @linux_only let dir = mktempdir(), sock = joinpath(dir, "sock"), prog = joinpath(dir, "prog.jl")
+        open(io -> println(io, "println(preloaded, \" \", join(ARGS, \",\")); exit(3)"), prog, "w")
+        server = withenv("JULIA_NUM_THREADS" => "1") do
+            spawn(`$exename --fork-server=$sock -e "preloaded = 42"`)
+        end
+        try
+            for i = 1:100
+                ispath(sock) && break
+                sleep(0.1)
+            end
+            sleep(0.5)
+            julia = joinpath(JULIA_HOME, Base.julia_exename())
+            client = `$julia --fork-client=$sock $prog a b`
+            @test readchomp(ignorestatus(client)) == "42 a,b"
+            p = spawn(pipeline(client, stdout=DevNull))
+            wait(p)
+            @test p.exitcode == 3
+            # the signals sent to the client interrupt the job
+            open(io -> println(io, "println(\"ready\"); flush(STDOUT); sleep(30)"), prog, "w")
+            for (sig, code) in ((2, 130), (15, 143))  # SIGINT, SIGTERM
+                out, p = open(`$julia --fork-client=$sock $prog`, "r")
+                @test readline(out) == "ready\n"
+                t = time()
+                kill(p, sig)
+                wait(p)
+                @test p.exitcode == code
+                @test time() - t < 20
+            end
+        finally
+            kill(server)
+            rm(dir, recursive=true)
+        end
+    end
+    @test !success(`$exename --quiet --fork-client=sock`)
+
     # --optimize
     @test readchomp(`$exename -E "Bool(Base.JLOptions().opt_level)"`) == "false"
     @test readchomp(`$exename -E "Bool(Base.JLOptions().opt_level)" -O`) == "true"
@@ -241,4 +298,15 @@ let exename = `$(joinpath(JULIA_HOME, Base.julia_exename())) --precompiled=yes`
     @test readchomp(`$exename --compilecache=yes -E "Bool(Base.JLOptions().use_compilecache)"`) == "true"
     @test readchomp(`$exename --compilecache=no -E "Bool(Base.JLOptions().use_compilecache)"`) == "false"
     @test !success(`$exename --compilecache=foo -e "exit(0)"`)
+
+    # --compile=tiered
+    @test readchomp(`$exename --compile=tiered -E "Base.JLOptions().compile_enabled"`) == "3"
+    @test readchomp(`$exename --compile=tiered -E "f(x) = x+1; g(x) = (s = 0; for i = 1:x; s += f(i); end; s); sum([g(10) for i = 1:20])"`) == "1300"
+    # with type feedback k calls h(::Int) directly, until h gets a new method
+    withenv("JULIA_TYPE_FEEDBACK" => "1") do
+        @test readchomp(`$exename --compile=tiered -E "h(x) = x+1; k(v, i) = h(v[i]); g(fs, v) = (s = 0.0; for i = 1:length(v); s += fs[1](v, i); end; s); v = Any[1:99; 0.5]; a = g(Any[k], v); h(x::Int) = x+2; (a, g(Any[k], v))"`) == "(5050.5,5149.5)"
+        # the guarded direct call shows up in the code of k
+        @test readchomp(`$exename --compile=tiered -E "h(x) = x+1; k(v, i) = h(v[i]); g(fs, v) = (s = 0.0; for i = 1:length(v); s += fs[1](v, i); end; s); g(Any[k], Any[1:99; 0.5]); contains(sprint(code_llvm, k, (Vector{Any}, Int)), string(:mergedirect))"`) == "true"
+    end
+    @test readchomp(`$exename --compile=tiered -E "h(x) = x+1; k(v, i) = h(v[i]); g(fs, v) = (s = 0.0; for i = 1:length(v); s += fs[1](v, i); end; s); g(Any[k], Any[1:99; 0.5]); contains(sprint(code_llvm, k, (Vector{Any}, Int)), string(:mergedirect))"`) == "false"
 end
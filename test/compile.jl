@@ -146,6 +146,40 @@ let dir = mktempdir(),
     end
 end
 
+# the lazily bound ccall slots of same-named symbols from different libraries
+# stay apart in code compiled for a cache file
+let dir = mktempdir(),
+    Sym_module = :Sym4b3a94a1a081a8cb
+
+    try
+        open(joinpath(dir, "$Sym_module.jl"), "w") do io
+            write(io, """
+            __precompile__(true)
+            module $Sym_module
+                vers() = (ccall((:jl_ver_major, "libccalltest"), Cint, ()), ccall(:jl_ver_major, Cint, ()))
+                const v = vers()
+            end
+            """)
+        end
+
+        eval(quote
+            insert!(LOAD_PATH, 1, $(dir))
+            insert!(Base.LOAD_CACHE_PATH, 1, $(dir))
+            Base.compilecache(:Sym4b3a94a1a081a8cb)
+        end)
+        Base.require(Sym_module)
+
+        let Sym = eval(Main, Sym_module)
+            @test Sym.v == (-1, VERSION.major)
+            @test Sym.vers() == Sym.v
+        end
+    finally
+        splice!(Base.LOAD_CACHE_PATH, 1)
+        splice!(LOAD_PATH, 1)
+        rm(dir, recursive=true)
+    end
+end
+
 let module_name = string("a",randstring())
     insert!(LOAD_PATH, 1, pwd())
     file_name = string(module_name, ".jl")
@@ -159,3 +193,58 @@ let module_name = string("a",randstring())
     deleteat!(LOAD_PATH,1)
     rm(file_name)
 end
+
+# JULIA_LAZY_INIT defers __init__ of precompiled modules until first use
+let dir = mktempdir(),
+    Lazy_module = :Lazy4b3a94a1a081a8cb
+
+    try
+        open(joinpath(dir, "$Lazy_module.jl"), "w") do io
+            write(io, """
+            __precompile__(true)
+            module $Lazy_module
+                __init__() = println("init")
+                f() = 1
+            end
+            """)
+        end
+
+        eval(quote
+            insert!(LOAD_PATH, 1, $(dir))
+            insert!(Base.LOAD_CACHE_PATH, 1, $(dir))
+            Base.compilecache(:Lazy4b3a94a1a081a8cb)
+        end)
+
+        exename = `$(joinpath(JULIA_HOME, Base.julia_exename())) --precompiled=yes --compilecache=yes`
+
+        testcode = """
+            insert!(LOAD_PATH, 1, $(repr(dir)))
+            insert!(Base.LOAD_CACHE_PATH, 1, $(repr(dir)))
+            using $Lazy_module
+            println("loaded")
+            println($Lazy_module.f())
+        """
+
+        # the first read comes from compiled code, after inference has looked at f
+        compiledcode = """
+            insert!(LOAD_PATH, 1, $(repr(dir)))
+            insert!(Base.LOAD_CACHE_PATH, 1, $(repr(dir)))
+            using $Lazy_module
+            g() = $Lazy_module.f() + 1
+            code_typed(g, ())
+            println("inferred")
+            println(g())
+        """
+
+        @test readall(`$exename -e $(testcode)`) == "init\nloaded\n1\n"
+        withenv("JULIA_LAZY_INIT" => "1") do
+            @test readall(`$exename -e $(testcode)`) == "loaded\ninit\n1\n"
+            @test readall(`$exename -e $(compiledcode)`) == "inferred\ninit\n2\n"
+        end
+
+    finally
+        splice!(Base.LOAD_CACHE_PATH, 1)
+        splice!(LOAD_PATH, 1)
+        rm(dir, recursive=true)
+    end
+end
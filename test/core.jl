@@ -910,6 +910,32 @@ let
     @test_throws ErrorException pointer_to_array(pointer(a), -3)
 end
 
+# data adopted with a free function is copied, not realloc'd, when the array
+# grows, and goes back to its owner then
+function adopted_free(p::Ptr{Void}, nfreed::Ptr{Void})
+    unsafe_store!(convert(Ptr{Int}, nfreed), unsafe_load(convert(Ptr{Int}, nfreed)) + 1)
+    Libc.free(p)
+    nothing
+end
+let n = 10, p = convert(Ptr{UInt8}, Libc.malloc(n)), nfreed = Libc.malloc(sizeof(Int))
+    unsafe_store!(convert(Ptr{Int}, nfreed), 0)
+    unsafe_copy!(p, pointer(b"0123456789"), n)
+    s = ccall(:jl_ptr_to_string, Any, (Ptr{UInt8}, Csize_t, Ptr{Void}, Ptr{Void}),
+              p, n, cfunction(adopted_free, Void, (Ptr{Void}, Ptr{Void})), nfreed)
+    @test s == "0123456789"
+    @test pointer(s.data) == p
+    push!(s.data, UInt8('a'))
+    @test s == "0123456789a"
+    @test pointer(s.data) != p
+    @test unsafe_load(convert(Ptr{Int}, nfreed)) == 1
+    # the new buffer is the array's own
+    append!(s.data, b"bcdef")
+    s = nothing
+    gc(); gc()
+    @test unsafe_load(convert(Ptr{Int}, nfreed)) == 1
+    Libc.free(nfreed)
+end
+
 immutable FooBar
     foo::Int
     bar::Int
@@ -2288,6 +2314,36 @@ function test_wr()
 end
 test_wr()
 
+# an old weak reference given a young referent
+@noinline set_wr_young(wr) = (wr.value = Obj(3); nothing)
+function test_wr_young()
+    wr = WeakRef(nothing)
+    gc(); gc()
+    r = Obj(2)
+    set_wr_young(wr)
+    gc(false)
+    @test wr.value == nothing
+    wr.value = r
+    gc(false); gc(false); gc()
+    @test wr.value === r
+    r = nothing
+    gc(); gc()
+    @test wr.value == nothing
+end
+test_wr_young()
+
+# an old referent that dies after a full collection is freed by the next
+# quick one, which must clear the old weak references to it
+function test_wr_old_dead()
+    h = Ref{Any}(Obj(4))
+    wr = WeakRef(h[])
+    gc(); gc()
+    h[] = nothing
+    gc(false)
+    @test wr.value === nothing
+end
+test_wr_old_dead()
+
 # issue #9947
 function f9947()
     if 1 == 0
@@ -3611,3 +3667,446 @@ let T = TypeVar(:T, true)
     @test typeintersect(T, Type{Int8}) == Type{Int8}
     @test typeintersect(Tuple{T}, Tuple{Type{Int8}}) == Tuple{Type{Int8}}
 end
+
+# marking long chains of objects
+type GCChain
+    next::Union{GCChain,Void}
+end
+let c = nothing
+    for i = 1:1000000
+        c = GCChain(c)
+    end
+    gc()
+    n = 0
+    while c !== nothing
+        n += 1
+        c = c.next
+    end
+    @test n == 1000000
+end
+
+# lazy sweeping of the pages of old objects
+let prev = ccall(:jl_gc_enable_lazy_sweep, Cint, (Cint,), 1)
+    a = [Ref{Any}(i) for i = 1:100000]
+    gc(); gc(false); gc(false)
+    for i = 1:2:length(a)
+        # the write barrier sweeps the page of an old object
+        a[i][] = string(i)
+    end
+    b = [Ref{Any}(-i) for i = 1:100000]
+    gc(false)
+    @test all(i -> a[i][] == (isodd(i) ? string(i) : i), 1:length(a))
+    @test all(i -> b[i][] == -i, 1:length(b))
+    ccall(:jl_gc_enable_lazy_sweep, Cint, (Cint,), prev)
+end
+
+# incremental marking with a pause budget
+let prev = ccall(:jl_gc_set_pause_budget, UInt64, (UInt64,), 1)
+    a = Any[Ref{Any}(i) for i = 1:200000]
+    for k = 1:10
+        gc(false)
+        # stores into objects marked by the previous slices
+        for i = k:10:length(a)
+            a[i][] = string(i)
+        end
+    end
+    gc()
+    @test all(i -> a[i][] == string(i), 1:length(a))
+    ccall(:jl_gc_set_pause_budget, UInt64, (UInt64,), prev)
+end
+
+# collecting under a heap size limit
+let prev = ccall(:jl_gc_set_heap_limit, UInt64, (UInt64,), 2^30)
+    s = 0
+    for i = 1:100
+        a = zeros(UInt8, 2^20)
+        s += length(a)
+    end
+    @test s == 100*2^20
+    @test ccall(:jl_gc_set_heap_limit, UInt64, (UInt64,), prev) > 0
+end
+
+# collection statistics
+let s0 = Base.gc_stats()
+    gc()
+    s1 = Base.gc_stats()
+    @test s1.total_mark_time >= s0.total_mark_time + s1.last_mark_time
+    @test sum(s1.pause_hist) > sum(s0.pause_hist)
+    @test s1.max_pause >= s1.last_mark_time
+    # the last pause went to the bucket of its length
+    us = Int(Base.gc_pauses(1)[1] ÷ 1000)
+    i = us == 0 ? 1 : min(floor(Int, log2(us)) + 2, 24)
+    @test us == 0 || i == 24 || 2^(i-2) <= us < 2^(i-1)
+    @test s1.pause_hist[i] > s0.pause_hist[i]
+end
+
+# finalizers run in batches by a task
+let n = 0
+    t = Base.defer_finalizers(10)
+    for i = 1:100
+        finalizer(Ref(i), r->(n += 1))
+    end
+    gc()
+    @test n == 0
+    t0 = time()
+    while n < 99 && time() - t0 < 10
+        sleep(0.01)
+    end
+    @test n >= 99
+    Base.stop_deferred_finalizers()
+    @test istaskdone(t)
+    # the collections run the finalizers again
+    finalizer(Ref(0), r->(n = -1))
+    gc()
+    @test n == -1
+end
+
+# young objects stored in a big old array are remembered by cards
+let a = Array(Any, 2^16)
+    gc(); gc()
+    for i = 1:10
+        for j = i:997:length(a)
+            a[j] = Ref(j)
+        end
+        gc(false)
+    end
+    insert!(a, 2, Ref(0))
+    deleteat!(a, 1)
+    gc(false)
+    gc()
+    @test all(j -> j == 1 || !isassigned(a, j) || a[j][] == j, 1:length(a))
+    @test a[1][] == 0
+end
+# and those stored into a big old matrix survive the quick collections
+let a = Array(Any, 2^8, 2^8)
+    gc(); gc()
+    for i = 1:10
+        for j = i:997:length(a)
+            a[j] = Ref(j)
+        end
+        gc(false)
+        # reuse the memory of anything freed by mistake
+        [Ref(0) for k = 1:10^4]
+    end
+    gc(false)
+    @test all(j -> !isassigned(a, j) || a[j][] == j, 1:length(a))
+    @test count(j -> isassigned(a, j), 1:length(a)) == sum(i -> length(i:997:length(a)), 1:10)
+end
+
+# the stores into an object allocated just before don't get a write barrier
+type BarrierElision
+    a
+    b
+    BarrierElision(a) = (x = new(); x.a = a; x.b = Ref(a); x)
+end
+let l = Any[]
+    for i = 1:1000
+        push!(l, BarrierElision(string(i)))
+        i % 100 == 0 && gc(false)
+    end
+    gc()
+    @test all(i -> l[i].a == string(i) && l[i].b[] == string(i), 1:1000)
+end
+
+# per thread heap statistics
+let s0 = Base.gc_heap_stats()
+    @test length(s0) >= 1
+    a = [Ref(i) for i = 1:1000]
+    s1 = Base.gc_heap_stats()
+    @test s1[1].allocd >= s0[1].allocd + 1000*sizeof(Int)
+    @test s1[1].poolalloc >= s0[1].poolalloc + 1000
+    @test s1[1].pages > 0
+end
+
+# the full signature method cache is flushed by new definitions
+exactcache(x, y) = 1
+exactcache(::Type{Int}, y) = 2
+callexactcache(x, y) = exactcache(x, y)
+@test callexactcache(1, 2.0) == 1
+@test callexactcache(Int, 2.0) == 2
+@test callexactcache(Int8, 2.0) == 1
+exactcache(x::Int, y::Float64) = 3
+exactcache(::Type{Int8}, y) = 4
+@test callexactcache(1, 2.0) == 3
+@test callexactcache(Int8, 2.0) == 4
+@test callexactcache(1, 2) == 1
+
+# inline caches at dynamic call sites
+icfoo(x) = 1
+icfoo(x::Int) = 2
+icfoo(::Type{Int}) = 3
+function callicfoo(xs)
+    s = 0
+    for x in xs
+        s = s*10 + icfoo(x)
+    end
+    s
+end
+@test callicfoo(Any[1, 1.0, Int, Int8, "a", 2]) == 213112
+icfoo(x::Float64) = 4
+@test callicfoo(Any[1, 1.0, Int, Int8, "a", 2]) == 243112
+
+# memoized subtype and intersection queries give the same answers
+for i = 1:3
+    @test Tuple{Int,Float64} <: Tuple{Integer,Real}
+    @test !(Tuple{Int,AbstractString} <: Tuple{Integer,Real})
+    @test typeintersect(Tuple{Integer,Real}, Tuple{Int,Any}) == Tuple{Int,Real}
+    @test typeintersect(Union{Int,AbstractString}, Integer) == Int
+end
+
+# cached method matches are dropped when a method is added
+matchcache(x) = 1
+matchcache(x::Integer) = 2
+@test length(methods(matchcache, (Integer,))) == 1
+@test length(methods(matchcache, (Integer,))) == 1
+@test length(methods(matchcache, (Real,))) == 2
+matchcache(x::Int) = 3
+@test length(methods(matchcache, (Integer,))) == 2
+@test length(methods(matchcache, (Real,))) == 3
+
+# immutables without pointers or padding are compared and hashed as bytes
+immutable BitsEqualInner
+    a::Int32
+    b::Int32
+end
+immutable BitsEqualOuter
+    x::Int
+    y::BitsEqualInner
+    z::Float64
+end
+let a = BitsEqualOuter(1, BitsEqualInner(2, 3), 4.0),
+    b = BitsEqualOuter(1, BitsEqualInner(2, 3), 4.0),
+    c = BitsEqualOuter(1, BitsEqualInner(2, 4), 4.0)
+    @test a === b
+    @test !(a === c)
+    @test object_id(a) == object_id(b)
+    @test object_id(a) != object_id(c)
+    @test !(BitsEqualOuter(0, BitsEqualInner(0, 0), 0.0) === BitsEqualOuter(0, BitsEqualInner(0, 0), -0.0))
+    d = ObjectIdDict()
+    d[a] = 1
+    @test d[b] == 1
+    @test !haskey(d, c)
+end
+
+# temporaries that are only read from do not need to be allocated
+immutable ScalarRepl
+    v::Vector{Int}
+    i::Int
+end
+type MutableScalarRepl
+    v::Vector{Int}
+    s::AbstractString
+end
+scalarrepl(v, i) = (w = ScalarRepl(v, i); w.v[w.i] + w.i)
+scalarrepl_mutable(v) = (w = MutableScalarRepl(v, "a"); (length(w.v), w.s))
+scalarrepl_escape(v) = (w = ScalarRepl(v, 1); (w, w.i))
+@test scalarrepl([5,6,7], 2) == 8
+@test scalarrepl_mutable([1,2]) == (2, "a")
+@test scalarrepl_escape([3])[1].v == [3]
+@test scalarrepl_escape([3])[2] == 1
+
+# two-word isbits results are returned in registers rather than through sret
+pairret(x::Int, y::Int) = (x + y, x - y)
+pairret_mixed(x::Float64, n::Int) = (x * n, n + 1)
+pairret_caller(x, y) = (p = pairret(x, y); q = pairret_mixed(1.5, y); p[1] * p[2] + q[2])
+@test pairret(5, 3) === (8, 2)
+@test pairret_mixed(2.0, 3) === (6.0, 4)
+@test pairret_caller(5, 3) == 20
+
+# many short-lived tasks switching in the middle of deep recursion
+function taskdepth(n, c)
+    n == 0 && (produce(c); return c)
+    return taskdepth(n - 1, c) + 1
+end
+let ts = [Task(()->taskdepth(200, i)) for i = 1:100]
+    @test all(i->consume(ts[i]) == i, 1:100)
+    @test all(i->consume(ts[i]) == 200 + i, 1:100)
+    @test all(t->istaskdone(t), ts)
+    # the stacks of the finished tasks are reused
+    @test all(i->consume(Task(()->taskdepth(200, i))) == i, 1:200)
+end
+
+# task statistics
+let s0 = Base.task_stats()
+    @test consume(Task(()->taskdepth(10, 1))) == 1
+    s1 = Base.task_stats()
+    @test s1.ntasks == s0.ntasks + 1
+    @test s1.nswitches >= s0.nswitches + 2
+end
+
+# boxed value caches
+# === compares the values of immutables, so compare where the boxes are
+box_f64(x) = ccall(:jl_box_float64, Any, (Float64,), x)
+box_i64(x) = ccall(:jl_box_int64, Any, (Int64,), x)
+box_u64(x) = ccall(:jl_box_uint64, Any, (UInt64,), x)
+same_box(a, b) = pointer_from_objref(a) == pointer_from_objref(b)
+let
+    @test same_box(box_f64(1.0), box_f64(1.0))
+    @test same_box(box_f64(0.0), box_f64(0.0))
+    @test !same_box(box_f64(-0.0), box_f64(-0.0))
+    @test !same_box(box_f64(0.5), box_f64(0.5))
+    @test same_box(box_i64(4000), box_i64(4000))
+    @test same_box(box_u64(UInt64(4000)), box_u64(UInt64(4000)))
+    @test box_f64(-0.0) === -0.0 && !(box_f64(-0.0) === 0.0)
+end
+
+# branches and handlers in interpreted toplevel code
+interp_jump_x = 0
+if interp_jump_x == 1
+    interp_jump_x = 10
+elseif interp_jump_x == 0
+    try
+        error("x")
+    catch
+        interp_jump_x = interp_jump_x == 0 ? 20 : 30
+    end
+else
+    interp_jump_x = 40
+end
+@test interp_jump_x == 20
+
+# toplevel loops over small literal ranges run in the interpreter
+interp_loop_s = 0
+for i = 1:3, j = 10:-5:0
+    interp_loop_s += i*j
+end
+@test interp_loop_s == 90
+
+# cached binding lookups follow later assignments, usings and imports
+module BindCacheA
+export bcx, bcy
+bcx = 1
+bcy = :a
+end
+module BindCacheB
+bcy = :b
+end
+module BindCacheC
+using ..BindCacheA
+f() = bcx
+end
+@test BindCacheC.f() == 1
+BindCacheA.eval(:(bcx = 2))
+@test BindCacheC.f() == 2
+BindCacheC.eval(:(import ..BindCacheB.bcy))
+@test BindCacheC.bcy === :b
+
+# handlers entered on every iteration, compiled and interpreted
+function try_loop_count(n)
+    c = 0
+    for i = 1:n
+        try
+            iseven(i) && error()
+        catch
+            c += 1
+        end
+    end
+    c
+end
+@test try_loop_count(100) == 50
+try_loop_c = 0
+for i = 1:10
+    try
+        try
+            error()
+        finally
+            try_loop_c += 1
+        end
+    catch
+        try_loop_c += 10
+    end
+end
+@test try_loop_c == 110
+
+# field lookup by name in types wide enough to use the hashed index
+eval(Expr(:type, true, :WideFields, Expr(:block, [symbol("f$i") for i = 1:40]...)))
+let w = WideFields(1:40...), s = symbol("f", 40)
+    @test getfield(w, s) == 40
+    @test all(i -> getfield(w, fieldnames(w)[i]) == i, 1:40)
+    w.f17 = -17
+    @test w.f17 == -17
+    @test_throws ErrorException getfield(w, :f41)
+end
+
+# forwarding varargs after leading arguments
+va_fwd_target(a, b, xs...) = (a, b, xs)
+va_fwd1(a, xs...) = va_fwd_target(a, xs...)
+va_fwd2(a, b, xs...) = va_fwd_target(b, a, xs...)
+@test va_fwd1(1, 2) === (1, 2, ())
+@test va_fwd1(1, 2, 3, 4) === (1, 2, (3, 4))
+@test va_fwd2(1, 2) === (2, 1, ())
+@test va_fwd2(1, 2, "x", :y) === (2, 1, ("x", :y))
+@test_throws MethodError va_fwd1(1)
+
+# t-function caches inferred into the system image are still found through
+# their index: the indexes hash by address, so they are dropped by the image
+let found = false
+    for f in (+, convert, getindex, setindex!, length, promote_type, isequal)
+        for m in methods(f)
+            tf = m.func.code.tfunc
+            isa(tf, Array{Any,1}) && length(tf) >= 3*Core.Inference.TFUNC_INDEX_MIN || continue
+            for i = 1:3:length(tf)
+                if isleaftype(tf[i])
+                    j = Core.Inference.tfunc_lookup(m.func.code, tf[i])
+                    @test j > 0 && tf[j] === tf[i]
+                    found = true
+                end
+            end
+        end
+    end
+    @test found
+end
+
+# small callees compiled in the same batch as their caller are inlined into it
+batch_sq(x) = x*x
+batch_pair(x) = (x, x + 1)
+batch_check(x) = x < 0 ? throw(DomainError()) : x
+@noinline batch_noinline(x) = x + 2
+function batch_caller(x)
+    a, b = batch_pair(batch_sq(x))
+    y = try
+        batch_check(-x)
+    catch e
+        isa(e, DomainError) ? batch_noinline(a) : 0
+    end
+    a + b + y
+end
+@test batch_caller(3) == 30
+@test batch_caller(-3) == 22
+@test batch_caller(0) == 1
+
+# GenSyms that share gc frame slots stay rooted while they are live
+type SlotBox
+    r::Vector{Int}
+end
+Base.getindex(b::SlotBox, i) = b.r[i]
+Base.setindex!(b::SlotBox, v, i) = (b.r[i] = v)
+function gensym_slots(r, n)
+    for k = 1:n
+        # the GenSym of the SlotBox is live across the allocation and the collection
+        SlotBox(r)[1] += (gc(false); length([string(j) for j = 1:10]) - 9)
+        # and those of the comprehension across its loop
+        SlotBox(r)[2] += length(Any[SlotBox(r) for j = 1:3])
+    end
+    r
+end
+@test gensym_slots([0, 0], 100) == [100, 300]
+
+# code compiled one module at a time, with constants and calls to the code of
+# the earlier modules, keeps working when their sections share pooled pages
+for i = 1:200
+    @eval $(symbol("pool_chain_", i))(x) = $(i == 1 ? :(x + 0.5) : :($(symbol("pool_chain_", i-1))(x) + 0.5))
+end
+let ok = true
+    for i = 1:200
+        ok &= eval(symbol("pool_chain_", i))(1.0) == 1.0 + 0.5i
+        ok &= eval(:(x -> x * $(i + 0.25)))(2.0) == 2.0 * (i + 0.25)
+    end
+    @test ok
+end
+# nested ones multiply their trips, and these are compiled
+interp_loop_s = 0
+for i = 1:60, j = 1:60
+    interp_loop_s += 1
+end
+@test interp_loop_s == 3600
@@ -350,6 +350,26 @@ let
     Base.showdict(Base.IOContext(IOBuffer(), :limit_output => true), a)
 end
 
+# ObjectIdDict under churn: reinserting a key after deleting others that
+# collided with it must not duplicate it
+let a = ObjectIdDict(), d = Dict{Int,Int}()
+    srand(1)
+    for i = 1:100000
+        k = rand(1:5000)
+        r = rand(1:3)
+        if r == 1
+            a[k] = i
+            d[k] = i
+        elseif r == 2
+            @test pop!(a, k, nothing) == pop!(d, k, nothing)
+        else
+            @test get(a, k, nothing) == get(d, k, nothing)
+        end
+    end
+    @test length(a) == length(d)
+    @test sort!([p.first for p in a]) == sort!(collect(keys(d)))
+end
+
 
 # Issue #7944
 let d = Dict{Int,Int}()
@@ -0,0 +1,137 @@
+// This file is a part of Julia. License is MIT: http://julialang.org/license
+
+/*
+  calls into julia from threads of the embedding program
+  . NTHREADS threads register with jl_adopt_thread and then call a julia
+    function through jl_call1 and a call context, collecting garbage on the
+    way, all at the same time (the embedding lock serializes them), while
+    the main thread allocates in julia too
+  . julia calls back into C, which calls into julia again while holding the
+    embedding lock
+  . exits with the number of failed checks
+*/
+
+#include <julia.h>
+#include <uv.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+// exported by libjulia, declared in threading.h
+extern JL_DLLEXPORT int jl_n_threads;
+
+#define NTHREADS 4
+#define NCALLS 1000
+
+static jl_function_t *embed_f;
+static jl_function_t *embed_nested;
+static volatile int nfailed = 0; // the workers check outside of julia too
+
+#define check(cond) do { \
+        if (!(cond)) { \
+            fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+            __sync_fetch_and_add(&nfailed, 1); \
+        } \
+    } while (0)
+
+static jl_value_t *eval(const char *str)
+{
+    jl_value_t *v = (jl_value_t*)jl_eval_string(str);
+    if (jl_exception_occurred()) {
+        jl_show(jl_stderr_obj(), jl_exception_occurred());
+        jl_printf(jl_stderr_stream(), "\n");
+        exit(1);
+    }
+    return v;
+}
+
+// called by julia, from the thread that holds the embedding lock
+static int64_t embed_callback(int64_t x)
+{
+    return jl_unbox_int64(jl_call1(embed_f, jl_box_int64(x)));
+}
+
+typedef struct {
+    int16_t tid;
+    int64_t sum;
+    int64_t nested;
+} worker_t;
+
+static void worker(void *arg)
+{
+    worker_t *w = (worker_t*)arg;
+    w->tid = jl_adopt_thread();
+    // registering again returns the same thread
+    check(jl_adopt_thread() == w->tid);
+    int64_t sum = 0;
+    for (int64_t i = 0; i < NCALLS; i++) {
+        sum += jl_unbox_int64(jl_call1(embed_f, jl_box_int64(i)));
+        if (i % 100 == 0)
+            jl_eval_string("gc(false)");
+    }
+    jl_call_ctx_t *ctx = jl_call_ctx_new(embed_f, 1);
+    jl_value_t **args = jl_call_ctx_args(ctx);
+    for (int64_t i = 0; i < NCALLS; i++) {
+        args[0] = jl_box_int64(i);
+        sum += jl_unbox_int64(jl_call_ctx_invoke(ctx));
+    }
+    jl_call_ctx_free(ctx);
+    w->sum = sum;
+    w->nested = jl_unbox_int64(jl_call1(embed_nested, jl_box_int64(10)));
+    check(jl_exception_occurred() == NULL);
+    // done with julia for good, don't hold up the collections of the others
+    jl_gc_safe_enter();
+}
+
+int main(void)
+{
+    jl_init(NULL);
+    char defs[256];
+    eval("embed_f(x) = x + (x % 3 == 0 ? 1 : 2)");
+    snprintf(defs, sizeof(defs),
+             "embed_nested(x) = ccall(Ptr{Void}(%llu), Int, (Int,), x) + 1",
+             (unsigned long long)(uintptr_t)&embed_callback);
+    eval(defs);
+    embed_f = (jl_function_t*)eval("embed_f");
+    embed_nested = (jl_function_t*)eval("embed_nested");
+    int64_t expect = 0;
+    for (int64_t i = 0; i < NCALLS; i++)
+        expect += i + (i % 3 == 0 ? 1 : 2);
+
+    uv_thread_t threads[NTHREADS];
+    worker_t workers[NTHREADS];
+    for (int i = 0; i < NTHREADS; i++)
+        uv_thread_create(&threads[i], worker, &workers[i]);
+    // runs side by side with the workers, which collect while it allocates:
+    // their collections stop it at its safepoints and the ones it starts
+    // wait for them
+    check(jl_unbox_int64(eval("let s = 0\n"
+                              "    for i = 1:200000\n"
+                              "        s += length(Any[i, Ref(i)])\n"
+                              "        i % 20000 == 0 && gc(false)\n"
+                              "    end\n"
+                              "    s\n"
+                              "end")) == 400000);
+    int8_t gc_state = jl_gc_safe_enter();
+    for (int i = 0; i < NTHREADS; i++)
+        uv_thread_join(&threads[i]);
+    jl_gc_state_restore(gc_state);
+
+    for (int i = 0; i < NTHREADS; i++) {
+        check(workers[i].tid >= 0);
+        check(workers[i].sum == 2 * expect);
+        check(workers[i].nested == 13);
+#ifdef JULIA_ENABLE_THREADING
+        // each thread gets thread states of its own, after the julia threads
+        check(workers[i].tid >= jl_n_threads);
+        for (int j = 0; j < i; j++)
+            check(workers[i].tid != workers[j].tid);
+#endif
+    }
+    // the main thread still runs julia code afterwards
+    check(jl_unbox_int64(jl_call1(embed_f, jl_box_int64(3))) == 4);
+
+    jl_atexit_hook(nfailed != 0);
+    if (nfailed == 0)
+        printf("embedding: all checks passed\n");
+    return nfailed;
+}
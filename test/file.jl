@@ -215,6 +215,17 @@ unmark(s)
 @test !ismarked(s)
 close(s)
 
+# lines longer than the stream's read buffer
+longline = repeat("abcdefgh", 40000)
+open(io -> write(io, "short\n", longline, "\n", longline), file, "w")
+s = open(file)
+@test readline(s) == "short\n"
+@test readline(s) == longline * "\n"
+@test readline(s) == longline
+@test eof(s)
+@test readline(s) == ""
+close(s)
+
 #######################################################################
 # This section tests temporary file and directory creation.           #
 #######################################################################
@@ -349,6 +360,13 @@ c_stat = stat(cfile)
 @test a_stat.size == b_stat.size
 @test a_stat.size == c_stat.size
 
+# batched stat
+sts = Base.Filesystem.stat_batch([afile, bfile, cfile, joinpath(dir, "nonexistent")])
+@test sts[1] == a_stat && sts[2] == b_stat && sts[3] == c_stat
+@test !ispath(sts[4])
+@test Base.Filesystem.lstat_batch([dir]) == [lstat(dir)]
+@test isempty(Base.Filesystem.stat_batch(AbstractString[]))
+
 close(af)
 rm(afile)
 rm(bfile)
@@ -94,3 +94,10 @@ x.nzval[1] = 0
 let a = QuoteNode(1), b = QuoteNode(1.0)
     @test (hash(a)==hash(b)) == (a==b)
 end
+
+# strings of each length up to a few rounds of the long-input loop of memhash
+let s = "abcdefghijklmnopqrstuvwxyz"^5
+    hs = [hash(s[1:i]) for i = 0:length(s)]
+    @test length(unique(hs)) == length(hs)
+    @test hs == [hash(bytestring(s.data[1:i])) for i = 0:length(s)]
+end
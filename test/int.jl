@@ -142,3 +142,38 @@ end
 @test widemul(false, false) == false
 @test widemul(false, 3) == 0
 @test widemul(3, true) == widemul(true, 3) == 3
+
+# 128-bit intrinsics
+let a = typemax(Int128), b = Int128(-3), c = UInt128(1) << 100
+    @test a + Int128(1) == typemin(Int128)
+    @test b * b == Int128(9)
+    @test div(a, b) == -div(a, Int128(3))
+    @test rem(c + UInt128(7), UInt128(16)) == UInt128(7)
+    @test c >> 99 == UInt128(2) && c << 28 == UInt128(0)
+    @test (b >> 1) == Int128(-2) && (b >>> 126) == Int128(3)
+    @test b < Int128(0) && !(reinterpret(UInt128, b) < c)
+    @test (c $ (c - UInt128(1))) == (c << 1) - UInt128(1)
+    @test count_ones(c - UInt128(1)) == 100 && leading_zeros(c) == 27
+end
+
+# bit counts through the runtime intrinsics, as the interpreter calls them
+bitstype 24 BitCount24
+rt_ctpop(x) = ccall(:jl_ctpop_int, Any, (Any,), x)
+rt_ctlz(x) = ccall(:jl_ctlz_int, Any, (Any,), x)
+rt_cttz(x) = ccall(:jl_cttz_int, Any, (Any,), x)
+rt_low(x) = Int(reinterpret(UInt8, [x])[1])
+for T in (UInt8, UInt16, UInt32, UInt64, UInt128, Int128)
+    n = 8 * sizeof(T)
+    for x in (zero(T), one(T), ~zero(T), one(T) << (n - 1), T(0x5a) << div(n, 2))
+        @test rt_ctpop(x) == count_ones(x)
+        @test rt_ctlz(x) == leading_zeros(x)
+        @test rt_cttz(x) == trailing_zeros(x)
+    end
+end
+# sizes that are not a whole c-type must not count the padding
+let x = ccall(:jl_trunc_int, Any, (Any, Any), BitCount24, 0x00000100),
+    z = ccall(:jl_trunc_int, Any, (Any, Any), BitCount24, 0x00000000)
+    @test rt_low(rt_ctlz(x)) == 15
+    @test rt_low(rt_cttz(z)) == 24
+    @test rt_low(rt_ctpop(x)) == 1
+end
@@ -113,6 +113,16 @@ push!(j, 257)
 push!(j, 2, 3, 17)
 @test intersect(i, j) == IntSet([2, 3])
 
+# the word-wise operations, on sets of different sizes
+i = IntSet([1, 40, 100, 1000])
+j = IntSet([40, 70, 1000, 5000])
+@test union(i, j) == IntSet([1, 40, 70, 100, 1000, 5000])
+@test intersect(i, j) == intersect(j, i) == IntSet([40, 1000])
+@test setdiff(i, j) == IntSet([1, 100])
+@test setdiff(j, i) == IntSet([70, 5000])
+@test symdiff(i, j) == IntSet([1, 70, 100, 5000])
+@test length(intersect(j, i)) == 2
+
 ## equality
 i = IntSet([1, 2, 3])
 j = IntSet([1, 2, 4])
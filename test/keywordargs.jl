@@ -185,3 +185,12 @@ let
     @test kwf1(0; p, q) == 310
     @test kwf1(0; q, hundreds=4) == 410
 end
+
+# keyword calls to a known function from compiled code
+kwf_direct(x; a=1, b=2) = x + 10a + 100b
+kwf_direct_caller(x::Int) = kwf_direct(x; b=x, a=3) + kwf_direct(x; a=x)
+@test kwf_direct_caller(1) == (1 + 30 + 100) + (1 + 10 + 200)
+kwf_direct_caller(x::Float64) = kwf_direct(x; c=1)
+@test_throws ErrorException kwf_direct_caller(1.0)
+kwf_direct_mismatch() = kwf_direct(1, 2; a=1)
+@test_throws MethodError kwf_direct_mismatch()
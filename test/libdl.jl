@@ -171,4 +171,44 @@ let dl = C_NULL
     end
 end
 
+# a name that wasn't found is found once DL_LOAD_PATH leads to it
+let dir = mktempdir(), dl = C_NULL
+    try
+        cp(abspath(joinpath(private_libdir, "libccalltest.$(Libdl.dlext)")),
+           joinpath(dir, "libdlcachetest.$(Libdl.dlext)"))
+        @test Libdl.dlopen_e("libdlcachetest") == C_NULL
+        @test Libdl.dlopen_e("libdlcachetest") == C_NULL
+        push!(Libdl.DL_LOAD_PATH, dir)
+        try
+            dl = Libdl.dlopen_e("libdlcachetest")
+            @test dl != C_NULL
+            dl2 = Libdl.dlopen_e("libdlcachetest")
+            @test dl2 == dl
+            Libdl.dlclose(dl2)
+            @test Libdl.dlsym_e(dl, :set_verbose) != C_NULL
+        finally
+            pop!(Libdl.DL_LOAD_PATH)
+        end
+    finally
+        Libdl.dlclose(dl)
+        rm(dir, recursive=true)
+    end
+end
+
+# and once it's copied to a directory of DL_LOAD_PATH, without changing it
+let dir = mktempdir(), dl = C_NULL
+    push!(Libdl.DL_LOAD_PATH, dir)
+    try
+        @test Libdl.dlopen_e("libdlcachetest2") == C_NULL
+        cp(abspath(joinpath(private_libdir, "libccalltest.$(Libdl.dlext)")),
+           joinpath(dir, "libdlcachetest2.$(Libdl.dlext)"))
+        dl = Libdl.dlopen_e("libdlcachetest2")
+        @test dl != C_NULL
+    finally
+        pop!(Libdl.DL_LOAD_PATH)
+        Libdl.dlclose(dl)
+        rm(dir, recursive=true)
+    end
+end
+
 end
@@ -140,3 +140,20 @@ function ceilfloor(x::Float64)
 end
 
 @test_approx_eq ceilfloor(7.4) 8.0
+
+# tuples of VecElement are LLVM vectors
+typealias V4F32 NTuple{4,VecElement{Float32}}
+function vecadd(a::V4F32, b::V4F32)
+    llvmcall("""%3 = fadd <4 x float> %0, %1
+                ret <4 x float> %3""", V4F32, Tuple{V4F32,V4F32}, a, b)
+end
+let a = (VecElement(1.0f0), VecElement(2.0f0), VecElement(3.0f0), VecElement(4.0f0))
+    @test sizeof(V4F32) == 16
+    s = vecadd(a, a)
+    @test isa(s, V4F32)
+    @test [x.value for x in s] == [2.0f0, 4.0f0, 6.0f0, 8.0f0]
+    arr = [a, s]
+    @test arr[2][3].value == 6.0f0
+end
+@test sizeof(NTuple{3,VecElement{Float32}}) == 16
+@test sizeof(NTuple{3,Float32}) == 12
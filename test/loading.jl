@@ -25,3 +25,23 @@ let nfc_name = "\U00F4.jl"
     @test Base.isfile_casesensitive(nfc_name)
     rm(nfc_name)
 end
+
+# the cache of parsed files gives the same results as parsing them
+let dir = mktempdir(), src = joinpath(dir, "cached.jl")
+    write(src, "x = 1\nf(y) = y + x\nprintln(f(2), \" \", @__LINE__)\n")
+    env = copy(ENV)
+    env["JULIA_AST_CACHE"] = dir
+    cmd = setenv(`$(Base.julia_cmd()) --startup-file=no $src`, env)
+    @test readall(cmd) == "3 3\n"
+    @test any(f -> endswith(f, ".ast"), readdir(dir))
+    @test readall(cmd) == "3 3\n"
+    # a file with the same contents at another path gets its own entry
+    text = readall(src) * "println(@__FILE__)\n"
+    src2 = joinpath(dir, "copy.jl")
+    write(src, text)
+    write(src2, text)
+    @test readall(setenv(`$(Base.julia_cmd()) --startup-file=no $src`, env)) == "3 3\n$src\n"
+    @test readall(setenv(`$(Base.julia_cmd()) --startup-file=no $src2`, env)) == "3 3\n$src2\n"
+    @test readall(setenv(`$(Base.julia_cmd()) --startup-file=no $src2`, env)) == "3 3\n$src2\n"
+    rm(dir, recursive=true)
+end
@@ -207,3 +207,15 @@ end
 whos(IOBuffer(), Tmp14173) # warm up
 @test @allocated(whos(IOBuffer(), Tmp14173)) < 10000
 
+
+# time_ns is monotonic, and keeps up with the wall clock once the TSC source
+# (if any) is calibrated, and after its rate is checked again
+let t = time_ns(), w = time()
+    for d in (0.1, 0.1, 0.1, 1.2, 0.1)
+        sleep(d)
+        t2, w2 = time_ns(), time()
+        @test t2 > t
+        @test abs((t2 - t)/1e9 - (w2 - w)) < 0.005
+        t, w = t2, w2
+    end
+end
@@ -284,3 +284,25 @@ n = similar(m, 12)
 @test length(n) == 12
 @test size(n) == (12,)
 finalize(m); m = nothing; gc()
+
+# IOStream reading directly from a mapped file
+file = tempname()
+write(file, "first line\nsecond line\nthird")
+s = Base.open_mapped(file)
+@test isopen(s)
+@test readline(s) == "first line\n"
+@test read(s, UInt8) == UInt8('s')
+@test readuntil(s, '\n') == "econd line\n"
+@test !eof(s)
+@test readall(s) == "third"
+@test eof(s)
+seek(s, 6)
+@test readline(s) == "line\n"
+close(s)
+@test !isopen(s)
+touch(file * ".empty")
+s = Base.open_mapped(file * ".empty")
+@test eof(s)
+close(s)
+rm(file * ".empty")
+rm(file)
@@ -314,3 +314,12 @@ end
 # issue #11988 -- normalize \r and \r\n in literal strings to \n
 @test "foo\nbar" == parse("\"\"\"\r\nfoo\r\nbar\"\"\"") == parse("\"\"\"\nfoo\nbar\"\"\"") == parse("\"\"\"\rfoo\rbar\"\"\"") == parse("\"foo\r\nbar\"") == parse("\"foo\rbar\"") == parse("\"foo\nbar\"")
 @test '\r' == first("\r") == first("\r\n") # still allow explicit \r
+
+# string literals and comments are scanned in bulk; check the characters
+# around the stopping points and the line numbers after them
+@test parse("\"a\$(1+1)b\\\"c\\\\\"") == Expr(:string, "a", :(1+1), "b\"c\\")
+@test parse("x # comment \$ \" \\\\\n") === :x
+let ex = parse("begin\n  \"a\nb\nc\" # x\n  y\nend")
+    @test ex.args[2] == "a\nb\nc"
+    @test isa(ex.args[3], LineNumberNode) && ex.args[3].line == 5
+end
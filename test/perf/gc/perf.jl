@@ -0,0 +1,148 @@
+# This file is a part of Julia. License is MIT: http://julialang.org/license
+
+## Garbage collector stress and pause latency
+##
+## Every benchmark runs once to warm up, then once with the collector
+## statistics taken before and after. For each one the report has the time,
+## the number of collections (and of full ones), the p50, p99 and max pause,
+## the bytes promoted to the old generation, the growth of the pool pages
+## and the largest remset seen. With an argument the report is JSON.
+
+# a node of the deep structures
+type GCNode
+    next::Any
+    val::Int
+end
+
+GCNode(next) = GCNode(next, 0)
+
+## allocation rate: short-lived objects, with nlive of them kept alive in a
+## ring so that a part of every nursery survives
+function alloc_ring(n, nlive)
+    ring = Array(Any, max(nlive, 1))
+    for i = 1:n
+        ring[i % length(ring) + 1] = Ref(i)
+    end
+    ring
+end
+
+## a large old heap with sparse mutation: every round a few old objects are
+## made to point to new ones, among a lot of garbage
+function sparse_mutation(nold, rounds, nmut, garbage)
+    old = [GCNode(nothing, i) for i = 1:nold]
+    gc()
+    s = 0
+    for r = 1:rounds
+        for j = 1:nmut
+            old[rand(1:nold)].next = GCNode(nothing, r)
+        end
+        for j = 1:garbage
+            s += length(Array(Int, 4))
+        end
+        sample_remset()
+    end
+    old, s
+end
+
+## finalizers: objects with a finalizer each, dying in batches
+const nfinalized = Ref(0)
+function many_finalizers(rounds, n)
+    for r = 1:rounds
+        objs = [GCNode(nothing, i) for i = 1:n]
+        for o in objs
+            finalizer(o, o -> (nfinalized[] += 1))
+        end
+        objs = nothing
+    end
+    gc()
+    nfinalized[]
+end
+
+## deep linked structures: a long list kept alive, and binary trees of
+## temporaries (marking goes deep in both)
+function deep_list(n)
+    head = nothing
+    for i = 1:n
+        head = GCNode(head, i)
+    end
+    head
+end
+
+make_tree(d) = d == 0 ? GCNode(nothing) : GCNode((make_tree(d-1), make_tree(d-1)))
+
+function deep_structures(nlist, depth, ntrees)
+    list = deep_list(nlist)
+    s = 0
+    for i = 1:ntrees
+        s += make_tree(depth).val
+    end
+    list, s
+end
+
+const benchmarks = [
+    ("alloc_rate_0",      "10^7 objects, none kept alive",  () -> alloc_ring(10^7, 0)),
+    ("alloc_rate_1e4",    "10^7 objects, 10^4 kept alive",  () -> alloc_ring(10^7, 10^4)),
+    ("alloc_rate_1e6",    "10^7 objects, 10^6 kept alive",  () -> alloc_ring(10^7, 10^6)),
+    ("sparse_mutation",   "10^6 old objects, 10^3 mutated per round", () -> sparse_mutation(10^6, 200, 10^3, 10^4)),
+    ("finalizers",        "10 rounds of 10^5 finalizers",   () -> many_finalizers(10, 10^5)),
+    ("deep_structures",   "list of 10^6 nodes, trees of depth 16", () -> deep_structures(10^6, 16, 50)),
+]
+
+const max_remset = Ref(0)
+sample_remset() = (max_remset[] = max(max_remset[], sum(s -> Int(s.remset_len), Base.gc_heap_stats())))
+
+heap_pages() = sum(s -> Int(s.pages), Base.gc_heap_stats())
+
+function percentile(v, p)
+    isempty(v) && return 0.0
+    v = sort(v)
+    v[clamp(ceil(Int, p * length(v)), 1, length(v))]
+end
+
+function run_gc_benchmark(f)
+    f()
+    gc()
+    max_remset[] = 0
+    num0, stats0, pages0 = Base.gc_num(), Base.gc_stats(), heap_pages()
+    t0 = time_ns()
+    f()
+    t = (time_ns() - t0) / 1e9
+    num1, stats1, pages1 = Base.gc_num(), Base.gc_stats(), heap_pages()
+    sample_remset()
+    npauses = num1.pause - num0.pause
+    # only the last 4096 pauses are logged
+    pauses = Base.gc_pauses(npauses) ./ 1e6
+    Dict("time_s" => t,
+         "collections" => npauses,
+         "full_collections" => num1.full_sweep - num0.full_sweep,
+         "pauses_logged" => length(pauses),
+         "p50_pause_ms" => percentile(pauses, 0.5),
+         "p99_pause_ms" => percentile(pauses, 0.99),
+         "max_pause_ms" => isempty(pauses) ? 0.0 : maximum(pauses),
+         "promoted_bytes" => stats1.promoted - stats0.promoted,
+         "pages_growth" => pages1 - pages0,
+         "max_remset" => max_remset[])
+end
+
+const fields = ["time_s", "collections", "full_collections", "pauses_logged",
+                "p50_pause_ms", "p99_pause_ms", "max_pause_ms", "promoted_bytes",
+                "pages_growth", "max_remset"]
+
+json = !isempty(ARGS)
+json && println("[")
+for (i, (name, desc, f)) in enumerate(benchmarks)
+    r = run_gc_benchmark(f)
+    if json
+        print("  {\"name\": \"", name, "\", \"description\": \"", desc, "\"")
+        for k in fields
+            print(", \"", k, "\": ", r[k])
+        end
+        println("}", i < length(benchmarks) ? "," : "")
+    else
+        @printf("%-16s %8.3f s %5d gcs (%3d full)  pauses p50 %8.3f p99 %8.3f max %8.3f ms  promoted %6d kB  pages %+6d  remset %d\n",
+                name, r["time_s"], r["collections"], r["full_collections"],
+                r["p50_pause_ms"], r["p99_pause_ms"], r["max_pause_ms"],
+                div(r["promoted_bytes"], 1024), r["pages_growth"], r["max_remset"])
+    end
+end
+json && println("]")
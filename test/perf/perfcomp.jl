@@ -1,10 +1,139 @@
 # This file is a part of Julia. License is MIT: http://julialang.org/license
 
-# usage: perfcomp.jl <baseline file> [<suite>]
-# This will run the specified suite (default "all") and compare it to stored
-# results in the baseline file. Only test names present in both will be
-# compared.
-# The file format is the output of running `make` in this directory.
+# usage:
+#   perfcomp.jl record <store dir> [<suite>]
+#     Runs the specified suite (default "all") and writes the timings of all
+#     its runs, with the commit and the machine, to a new results file in the
+#     store directory, whose name it prints.
+#   perfcomp.jl compare <baseline> <results> [<threshold %>]
+#     Compares a results file to a baseline: a results file, or a store
+#     directory, in which case the latest other results of the same machine
+#     are the baseline and all of them give the noise of each test. A test
+#     regressed when even the lower end of the 95% confidence interval of the
+#     new/old ratio of the median times is slower by more than the threshold
+#     (default 5%, or twice the historical noise of the test if larger).
+#     Exits with status 1 if any test regressed.
+#   perfcomp.jl <baseline file> [<suite>]
+#     Runs the specified suite and compares it to the output of running
+#     `make` in this directory stored in the baseline file. Only test names
+#     present in both will be compared.
+
+## results files
+# "# key: value" header lines (format, commit, branch, machine, cpu, julia,
+# date), then a line per test: name, group, and the timings of its runs in
+# ms, separated by tabs (the timings by commas)
+
+const results_format = "1"
+
+function write_results(io, timings)
+    println(io, "# format: ", results_format)
+    println(io, "# commit: ", Base.GIT_VERSION_INFO.commit)
+    println(io, "# branch: ", Base.GIT_VERSION_INFO.branch)
+    println(io, "# machine: ", gethostname())
+    println(io, "# cpu: ", Sys.cpu_info()[1].model, " x ", CPU_CORES)
+    println(io, "# julia: ", VERSION)
+    println(io, "# date: ", Libc.strftime("%Y-%m-%dT%H:%M:%S", time()))
+    write(io, timings)
+end
+
+function read_results(file)
+    header = Dict{AbstractString,AbstractString}()
+    tests = Dict{AbstractString,Vector{Float64}}()
+    for l in eachline(open(file))
+        l = chomp(l)
+        if startswith(l, "# ")
+            k, v = split(l[3:end], ": ", limit=2)
+            header[k] = v
+        elseif !isempty(l)
+            name, group, ts = split(l, '\t')
+            tests[name] = [parse(Float64, t) for t in split(ts, ',')]
+        end
+    end
+    get(header, "format", "") == results_format ||
+        error("$file is not a results file of format $results_format")
+    header, tests
+end
+
+function record(store, suite)
+    tmp = tempname()
+    e = haskey(ENV,"J") ? "JULIA_EXECUTABLE=$(ENV["J"])" : ""
+    withenv("JULIA_PERF_RESULTS" => tmp) do
+        run(pipeline(`make $e -s $suite`, stdout=DevNull))
+    end
+    timings = readall(tmp)
+    rm(tmp)
+    mkpath(store)
+    file = joinpath(store, string(Libc.strftime("%Y%m%d-%H%M%S", time()), "-",
+                                  Base.GIT_VERSION_INFO.commit[1:min(end,10)], "-",
+                                  gethostname(), ".tsv"))
+    open(io -> write_results(io, timings), file, "w")
+    println(file)
+end
+
+## statistics
+
+# confidence interval of median(new)/median(old), by bootstrap
+function ratio_ci(old, new; nboot=2000, level=0.95)
+    rng = MersenneTwister(1776)
+    r = Array(Float64, nboot)
+    for i = 1:nboot
+        r[i] = median(new[rand(rng, 1:length(new), length(new))]) /
+               median(old[rand(rng, 1:length(old), length(old))])
+    end
+    sort!(r)
+    lo = r[max(1, floor(Int, (1-level)/2 * nboot))]
+    hi = r[min(nboot, ceil(Int, (1+level)/2 * nboot))]
+    lo, hi
+end
+
+# the noise of a test between runs: the standard deviation of the log of its
+# median times, over the stored results that have it
+function history_noise(history, name)
+    meds = [log(median(tests[name])) for (_, tests) in history if haskey(tests, name)]
+    length(meds) < 3 ? 0.0 : std(meds)
+end
+
+function compare(baseline, file, threshold)
+    header, new = read_results(file)
+    history = []
+    if isdir(baseline)
+        for f in readdir(baseline)
+            path = joinpath(baseline, f)
+            endswith(f, ".tsv") && realpath(path) != realpath(file) || continue
+            h, tests = read_results(path)
+            get(h, "machine", "") == get(header, "machine", "") && push!(history, (h, tests))
+        end
+        isempty(history) && error("no results of machine $(header["machine"]) in $baseline")
+        sort!(history, by = x -> x[1]["date"])
+        oldheader, old = history[end]
+    else
+        oldheader, old = read_results(baseline)
+    end
+    println("baseline ", get(oldheader, "commit", "?"), " (", get(oldheader, "date", "?"),
+            "), new ", get(header, "commit", "?"), " (", get(header, "date", "?"), ")")
+    get(oldheader, "machine", "") == get(header, "machine", "") ||
+        println("warning: the results are from different machines")
+
+    names = sort(collect(intersect(keys(old), keys(new))))
+    println("test name                 old ms      new ms   new/old   95% interval      noise")
+    println("--------------------------------------------------------------------------------------")
+    nregressed = 0
+    for n in names
+        m0, m1 = median(old[n]), median(new[n])
+        lo, hi = ratio_ci(old[n], new[n])
+        noise = history_noise(history, n)
+        tol = max(threshold, 2*(exp(noise) - 1))
+        status = lo > 1 + tol ? "REGRESSION" : hi < 1/(1 + tol) ? "improvement" : ""
+        status == "REGRESSION" && (nregressed += 1)
+        @printf("%-22s %10.3f  %10.3f   %7.3f   [%5.3f, %5.3f]  %6.2f%%  %s\n",
+                n, m0, m1, m1/m0, lo, hi, noise*100, status)
+    end
+    println()
+    @printf("%d of %d tests regressed by more than %.1f%%\n", nregressed, length(names), threshold*100)
+    nregressed
+end
+
+## comparison against the output of make
 
 function readperf(f)
     [ rstrip(l[1:19])=>[parse(Float64,l[20:27]),parse(Float64,l[29:36]),parse(Float64,l[38:45]),parse(Float64,l[47:54])] for l in eachline(f) ]
@@ -46,4 +175,11 @@ function main()
     @printf "avg %7.2f%%\n" mean(change)*100
 end
 
-main()
+if length(ARGS) >= 2 && ARGS[1] == "record"
+    record(ARGS[2], length(ARGS) > 2 ? ARGS[3] : "all")
+elseif length(ARGS) >= 3 && ARGS[1] == "compare"
+    threshold = length(ARGS) > 3 ? parse(Float64, ARGS[4])/100 : 0.05
+    exit(compare(ARGS[2], ARGS[3], threshold) > 0 ? 1 : 0)
+else
+    main()
+end
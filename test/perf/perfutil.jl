@@ -50,10 +50,22 @@ function submit_to_codespeed(vals,name,desc,unit,test_group,lessisbetter=true)
     return true
 end
 
+# with JULIA_PERF_RESULTS set to a file, the timings of every test are
+# appended to it, one line each (see `perfcomp.jl record`)
+const perf_results = get(ENV, "JULIA_PERF_RESULTS", "")
+
+function record_timings(t, name, test_group)
+    isempty(perf_results) && return
+    open(perf_results, "a") do io
+        println(io, name, '\t', test_group, '\t', join(t, ','))
+    end
+end
+
 macro output_timings(t,name,desc,group)
     quote
         # If we weren't given anything for the test group, infer off of file path!
         test_group = length($group) == 0 ? basename(dirname(Base.source_path())) : $group[1]
+        record_timings($t, $name, test_group)
         if codespeed
             submit_to_codespeed( $t, $name, $desc, "seconds", test_group )
         elseif print_output
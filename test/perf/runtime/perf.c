@@ -0,0 +1,281 @@
+// This file is a part of Julia. License is MIT: http://julialang.org/license
+
+/*
+  benchmarks of the runtime entry points, through the embedding API
+  . every benchmark runs a warm-up, then NSAMPLES samples of a number of
+    iterations calibrated to take about SAMPLE_NS, and reports the time of
+    one iteration in nanoseconds
+  . the results are printed as JSON, to stdout or to the file given by -o
+  . the benchmarks to run can be restricted with a substring of their names
+*/
+
+#include <julia.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// exported by libjulia, declared in julia_internal.h
+JL_DLLEXPORT uint64_t jl_hrtime(void);
+
+#define NSAMPLES 11
+#define SAMPLE_NS 10000000
+#define MIN_ITERS 16
+
+typedef void (*bench_fn)(size_t niter);
+
+typedef struct {
+    const char *name;
+    const char *desc;
+    bench_fn run;
+} bench_t;
+
+// values the benchmarks work on, rooted by globals of Main
+static jl_value_t *generic_f;
+static jl_value_t *generic_args[3];
+static jl_task_t *ping_task;
+static jl_array_t *eqtable;
+static jl_value_t *eqkeys;
+static char **sym_names;
+static jl_value_t *subtype_pairs;
+static jl_value_t *array_type;
+
+#define NSYMS 1024
+#define NKEYS 1024
+
+// result of the benchmarks the compiler could otherwise drop
+static volatile uintptr_t sink;
+
+static void bench_gc_alloc_small(size_t niter)
+{
+    for (size_t i = 0; i < niter; i++) {
+        jl_value_t *v = jl_gc_allocobj(sizeof(void*));
+        jl_set_typeof(v, jl_voidpointer_type);
+        *(void**)v = NULL;
+        sink = (uintptr_t)v;
+    }
+}
+
+static void bench_gc_alloc_box(size_t niter)
+{
+    for (size_t i = 0; i < niter; i++)
+        sink = (uintptr_t)jl_box_float64((double)i);
+}
+
+static void bench_gc_alloc_array(size_t niter)
+{
+    for (size_t i = 0; i < niter; i++)
+        sink = (uintptr_t)jl_alloc_array_1d(array_type, 16);
+}
+
+static void bench_apply_generic(size_t niter)
+{
+    for (size_t i = 0; i < niter; i++)
+        sink = (uintptr_t)jl_apply((jl_function_t*)generic_f, generic_args, 2);
+}
+
+static void bench_apply_generic_dynamic(size_t niter)
+{
+    // alternate between the argument types so the call site cache misses
+    for (size_t i = 0; i < niter; i++) {
+        jl_value_t **args = &generic_args[i & 1];
+        sink = (uintptr_t)jl_apply((jl_function_t*)generic_f, args, 2);
+    }
+}
+
+static void bench_switchto(size_t niter)
+{
+    // two switches per iteration: to the task and back
+    for (size_t i = 0; i < niter; i++)
+        sink = (uintptr_t)jl_switchto(ping_task, jl_nothing);
+}
+
+static void bench_eqtable_put(size_t niter)
+{
+    for (size_t i = 0; i < niter; i++) {
+        jl_value_t *k = jl_cellref(eqkeys, i % NKEYS);
+        eqtable = jl_eqtable_put(eqtable, k, k);
+    }
+}
+
+static void bench_eqtable_get(size_t niter)
+{
+    for (size_t i = 0; i < niter; i++) {
+        jl_value_t *k = jl_cellref(eqkeys, i % NKEYS);
+        sink = (uintptr_t)jl_eqtable_get(eqtable, k, jl_nothing);
+    }
+}
+
+static void bench_symbol(size_t niter)
+{
+    for (size_t i = 0; i < niter; i++)
+        sink = (uintptr_t)jl_symbol(sym_names[i % NSYMS]);
+}
+
+static void bench_subtype(size_t niter)
+{
+    size_t n = jl_array_len(subtype_pairs) / 2;
+    for (size_t i = 0; i < niter; i++) {
+        size_t j = 2 * (i % n);
+        sink = jl_subtype(jl_cellref(subtype_pairs, j),
+                          jl_cellref(subtype_pairs, j + 1), 0);
+    }
+}
+
+static const bench_t benchmarks[] = {
+    { "gc_alloc_small", "jl_gc_allocobj of a pointer", bench_gc_alloc_small },
+    { "gc_alloc_box", "jl_box_float64", bench_gc_alloc_box },
+    { "gc_alloc_array", "jl_alloc_array_1d of 16 Float64", bench_gc_alloc_array },
+    { "apply_generic", "generic function call, one signature", bench_apply_generic },
+    { "apply_generic_dynamic", "generic function call, alternating signatures", bench_apply_generic_dynamic },
+    { "switchto", "jl_switchto to a task that yields back", bench_switchto },
+    { "eqtable_put", "jl_eqtable_put of 1024 keys", bench_eqtable_put },
+    { "eqtable_get", "jl_eqtable_get of 1024 keys", bench_eqtable_get },
+    { "symbol", "jl_symbol of 1024 existing names", bench_symbol },
+    { "subtype", "jl_subtype of tuple, array and union types", bench_subtype },
+};
+
+static jl_value_t *eval(const char *str)
+{
+    jl_value_t *v = (jl_value_t*)jl_eval_string(str);
+    if (jl_exception_occurred()) {
+        jl_show(jl_stderr_obj(), jl_exception_occurred());
+        jl_printf(jl_stderr_stream(), "\n");
+        exit(1);
+    }
+    return v;
+}
+
+static void setup(void)
+{
+    eval("bench_f(x::Int, y::Int) = x; bench_f(x::Float64, y::Int) = y; bench_f(x, y) = x");
+    generic_f = eval("bench_f");
+    generic_args[0] = eval("const bench_a1 = 1.0; bench_a1");
+    generic_args[1] = eval("const bench_a2 = 2; bench_a2");
+    generic_args[2] = eval("const bench_a3 = 3; bench_a3");
+
+    eval("const bench_main_task = current_task()");
+    eval("bench_ping() = while true; yieldto(bench_main_task); end");
+    ping_task = (jl_task_t*)eval("const bench_task = Task(bench_ping); bench_task");
+
+    eqkeys = eval("const bench_keys = Any[Ref(i) for i = 1:1024]; bench_keys");
+    eqtable = (jl_array_t*)eval("const bench_table = Array(Any, 32); bench_table");
+
+    sym_names = (char**)malloc(NSYMS * sizeof(char*));
+    for (size_t i = 0; i < NSYMS; i++) {
+        sym_names[i] = (char*)malloc(32);
+        snprintf(sym_names[i], 32, "bench_sym_%d", (int)i);
+        jl_symbol(sym_names[i]);
+    }
+
+    subtype_pairs = eval("const bench_types = Any["
+                         "Tuple{Int,Float64}, Tuple{Integer,Real},"
+                         "Tuple{Int,Float64}, Tuple{Integer,Integer},"
+                         "Vector{Int}, AbstractVector,"
+                         "Vector{Int}, AbstractArray{Float64},"
+                         "Tuple{Int,Vararg{Int}}, Tuple{Vararg{Integer}},"
+                         "Union{Int,Float64}, Real,"
+                         "Type{Int}, DataType,"
+                         "Tuple{Vector{Int},Dict{Symbol,Any}}, Tuple{AbstractArray,Associative}"
+                         "]; bench_types");
+    array_type = eval("Vector{Float64}");
+}
+
+static int cmp_double(const void *a, const void *b)
+{
+    double x = *(const double*)a, y = *(const double*)b;
+    return x < y ? -1 : x > y;
+}
+
+static void run_bench(const bench_t *b, FILE *out, int first)
+{
+    double samples[NSAMPLES];
+    size_t niter = MIN_ITERS;
+    uint64_t t0, t1;
+
+    // the collections left over from the setup or from the last benchmark
+    // should not land in the samples
+    jl_gc_collect(1);
+
+    // warm up and calibrate
+    for (;;) {
+        t0 = jl_hrtime();
+        b->run(niter);
+        t1 = jl_hrtime();
+        if (t1 - t0 >= SAMPLE_NS / 4 || niter >= ((size_t)-1) / 4)
+            break;
+        niter *= 2;
+    }
+    niter = (size_t)((double)niter * SAMPLE_NS / (double)(t1 - t0 + 1));
+    if (niter < MIN_ITERS)
+        niter = MIN_ITERS;
+
+    double sum = 0;
+    for (int i = 0; i < NSAMPLES; i++) {
+        t0 = jl_hrtime();
+        b->run(niter);
+        t1 = jl_hrtime();
+        samples[i] = (double)(t1 - t0) / (double)niter;
+        sum += samples[i];
+    }
+    qsort(samples, NSAMPLES, sizeof(double), cmp_double);
+
+    fprintf(out, "%s\n  {\"name\": \"%s\", \"description\": \"%s\", "
+            "\"iterations\": %lu, \"samples\": %d, "
+            "\"min_ns\": %.3f, \"median_ns\": %.3f, \"mean_ns\": %.3f, "
+            "\"max_ns\": %.3f}",
+            first ? "" : ",", b->name, b->desc, (unsigned long)niter, NSAMPLES,
+            samples[0], samples[NSAMPLES / 2], sum / NSAMPLES,
+            samples[NSAMPLES - 1]);
+    fflush(out);
+}
+
+static void usage(const char *prog)
+{
+    fprintf(stderr, "usage: %s [-o file.json] [name-filter]\n", prog);
+    exit(1);
+}
+
+int main(int argc, char *argv[])
+{
+    const char *outname = NULL;
+    const char *filter = NULL;
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "-o")) {
+            if (++i >= argc)
+                usage(argv[0]);
+            outname = argv[i];
+        }
+        else if (argv[i][0] == '-' || filter != NULL) {
+            usage(argv[0]);
+        }
+        else {
+            filter = argv[i];
+        }
+    }
+    FILE *out = stdout;
+    if (outname != NULL && (out = fopen(outname, "w")) == NULL) {
+        perror(outname);
+        return 1;
+    }
+
+    jl_init(NULL);
+    setup();
+    // jl_eqtable_put returns a new table when it grows
+    JL_GC_PUSH1(&eqtable);
+
+    fprintf(out, "[");
+    int first = 1;
+    for (size_t i = 0; i < sizeof(benchmarks) / sizeof(benchmarks[0]); i++) {
+        if (filter != NULL && strstr(benchmarks[i].name, filter) == NULL)
+            continue;
+        run_bench(&benchmarks[i], out, first);
+        first = 0;
+    }
+    fprintf(out, "\n]\n");
+    if (out != stdout)
+        fclose(out);
+
+    JL_GC_POP();
+    jl_atexit_hook(0);
+    return 0;
+}
@@ -0,0 +1,214 @@
+# This file is a part of Julia. License is MIT: http://julialang.org/license
+
+## Startup and first-call latency
+##
+##   julia perf.jl [--reps 5] [--sysimage file]... [--json] [package...]
+##
+## Every measurement starts new julia processes and reports the min and the
+## median over the repetitions, in ms:
+##   . startup: `julia -e ''` for each configuration (the system image, with
+##     and without its precompiled code, each --sysimage given), with the
+##     phases reported by JULIA_STARTUP_TRACE for each of them
+##   . first_result: until `julia -e 'println(1+1)'` prints its result
+##   . first_prompt: until the REPL prints its prompt, through `script` for a
+##     terminal where it is available; otherwise until a line given to the
+##     REPL on its stdin is evaluated
+##   . using: `using` a package precompiled for the benchmark (and of each
+##     package given), and the time jl_restore_incremental takes to load its
+##     cache file
+##   . first_call: the first call of a few common functions, less the second
+
+const julia = Base.julia_cmd()
+
+function parse_args(args)
+    reps = 5
+    sysimages = AbstractString[]
+    json = false
+    packages = AbstractString[]
+    i = 1
+    while i <= length(args)
+        a = args[i]
+        if a == "--reps" && i < length(args)
+            reps = parse(Int, args[i+=1])
+        elseif a == "--sysimage" && i < length(args)
+            push!(sysimages, args[i+=1])
+        elseif a == "--json"
+            json = true
+        elseif startswith(a, "-")
+            error("usage: julia perf.jl [--reps 5] [--sysimage file]... [--json] [package...]")
+        else
+            push!(packages, a)
+        end
+        i += 1
+    end
+    reps, sysimages, json, packages
+end
+
+# ms until cmd exits, and what it wrote to stderr
+function timed_run(cmd)
+    errfile = tempname()
+    t0 = time_ns()
+    ok = success(pipeline(cmd, stdout=DevNull, stderr=errfile))
+    t = (time_ns() - t0) / 1e6
+    err = readall(errfile)
+    rm(errfile)
+    ok || error("$cmd failed:\n", err)
+    t, err
+end
+
+# ms until cmd writes pattern to its stdout
+function time_to_output(cmd, pattern)
+    t0 = time_ns()
+    out, proc = open(cmd, "r")
+    seen = UInt8[]
+    t = NaN
+    while !eof(out)
+        append!(seen, readavailable(out))
+        if contains(bytestring(seen), pattern)
+            t = (time_ns() - t0) / 1e6
+            break
+        end
+    end
+    kill(proc)
+    wait(proc)
+    isnan(t) && error("$cmd did not print $(repr(pattern))")
+    t
+end
+
+summary(ts) = (minimum(ts), median(ts))
+
+# the phases of a JULIA_STARTUP_TRACE report, in ms
+function startup_phases(err)
+    phases = Dict{AbstractString,Float64}()
+    for l in split(err, '\n')
+        m = match(r"^startup:\s+(.*?)\s+([0-9.]+) ms\s+[0-9.]+ ms total", l)
+        m === nothing && continue
+        phases[strip(m.captures[1])] = parse(Float64, m.captures[2])
+    end
+    phases
+end
+
+# a package with a few types and methods, precompiled in its own load path
+function bench_package(dir)
+    mkpath(joinpath(dir, "StartupBench", "src"))
+    open(joinpath(dir, "StartupBench", "src", "StartupBench.jl"), "w") do io
+        println(io, "__precompile__()")
+        println(io, "module StartupBench")
+        for i = 1:200
+            println(io, "immutable T$i; x::Int; y::Float64; end")
+            println(io, "f$i(a::T$i) = a.x + a.y")
+            println(io, "f$i(a::T$i, b) = f$i(a) * b")
+        end
+        println(io, "const table = Dict([(i, string(i)) for i = 1:1000])")
+        println(io, "end")
+    end
+end
+
+function measure(reps, sysimages, packages)
+    results = []
+    env = ("JULIA_STARTUP_TRACE" => "1",)
+
+    configs = Any[("default", ``), ("no_precompiled", `--precompiled=no`)]
+    for s in sysimages
+        push!(configs, ("sysimage $(basename(s))", `-J$s`))
+    end
+    for (name, flags) in configs
+        ts = Float64[]
+        phases = Dict{AbstractString,Vector{Float64}}()
+        for r = 1:reps
+            t, err = withenv(env...) do
+                timed_run(`$julia $flags --startup-file=no -e ''`)
+            end
+            push!(ts, t)
+            for (p, v) in startup_phases(err)
+                push!(get!(phases, p, Float64[]), v)
+            end
+        end
+        push!(results, ("startup", name, summary(ts),
+                        [(p, median(v)) for (p, v) in sort(collect(phases))]))
+    end
+
+    ts = [time_to_output(`$julia --startup-file=no -e 'println(1+1)'`, "2") for r = 1:reps]
+    push!(results, ("first_result", "println(1+1)", summary(ts), []))
+
+    if success(`sh -c "command -v script >/dev/null"`) && OS_NAME == :Linux
+        cmd = `script -qfc "$(join(julia.exec, ' ')) --startup-file=no -q" /dev/null`
+        ts = withenv("TERM" => "dumb") do
+            [time_to_output(cmd, "julia>") for r = 1:reps]
+        end
+        push!(results, ("first_prompt", "terminal", summary(ts), []))
+    else
+        input = tempname()
+        open(io -> println(io, "println(\"ready\")"), input, "w")
+        cmd = pipeline(`$julia --startup-file=no`, stdin=input)
+        ts = [time_to_output(cmd, "ready") for r = 1:reps]
+        rm(input)
+        push!(results, ("first_prompt", "piped", summary(ts), []))
+    end
+
+    dir = mktempdir()
+    try
+        bench_package(dir)
+        path = ("JULIA_LOAD_PATH" => dir,)
+        # writes the cache file
+        withenv(path...) do
+            timed_run(`$julia --startup-file=no -e 'using StartupBench'`)
+        end
+        for pkg in ["StartupBench"; packages]
+            ts = Float64[]
+            restore = Float64[]
+            for r = 1:reps
+                t, err = withenv(path..., env...) do
+                    timed_run(`$julia --startup-file=no -e "t = time_ns(); using $pkg; print(STDERR, \"using: \", (time_ns() - t) / 1e6, \" ms\n\")"`)
+                end
+                m = match(r"using: ([0-9.]+) ms", err)
+                push!(ts, parse(Float64, m.captures[1]))
+                push!(restore, sum(Float64[v for (p, v) in startup_phases(err) if startswith(p, "cache file")]))
+            end
+            push!(results, ("using", pkg, summary(ts),
+                            [("jl_restore_incremental", median(restore))]))
+        end
+    finally
+        rm(dir, recursive=true)
+    end
+
+    calls = ["sort(rand(100))", "sprint(show, Dict(1=>\"a\"))", "parse(\"f(x) = x + 1\")",
+             "string(1.5)", "collect(1:10)", "map(x -> x + 1, [1, 2])",
+             "[1 2; 3 4] * [1, 2]", "split(\"a,b,c\", ',')"]
+    for c in calls
+        ts = Float64[]
+        for r = 1:reps
+            _, err = timed_run(`$julia --startup-file=no -e "t1 = @elapsed $c; t2 = @elapsed $c; print(STDERR, \"first: \", (t1 - t2) * 1e3, \" ms\n\")"`)
+            push!(ts, parse(Float64, match(r"first: ([-0-9.e]+) ms", err).captures[1]))
+        end
+        push!(results, ("first_call", c, summary(ts), []))
+    end
+    results
+end
+
+function report(results, json)
+    if json
+        println("[")
+        for (i, (kind, name, (tmin, tmed), extra)) in enumerate(results)
+            print("  {\"benchmark\": \"", kind, "\", \"name\": ", repr(name),
+                  ", \"min_ms\": ", tmin, ", \"median_ms\": ", tmed)
+            if !isempty(extra)
+                print(", \"phases_ms\": {",
+                      join(["$(repr(p)): $v" for (p, v) in extra], ", "), "}")
+            end
+            println("}", i < length(results) ? "," : "")
+        end
+        println("]")
+    else
+        for (kind, name, (tmin, tmed), extra) in results
+            @printf("%-13s %-36s min %9.2f ms  median %9.2f ms\n", kind, name, tmin, tmed)
+            for (p, v) in extra
+                @printf("    %-45s %9.2f ms\n", p, v)
+            end
+        end
+    end
+end
+
+let (reps, sysimages, json, packages) = parse_args(ARGS)
+    report(measure(reps, sysimages, packages), json)
+end
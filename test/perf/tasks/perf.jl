@@ -0,0 +1,86 @@
+# This file is a part of Julia. License is MIT: http://julialang.org/license
+
+include("../perfutil.jl")
+
+const ntasks = 10_000
+const nswitches = 100_000
+
+# creating tasks and running each to completion
+function taskcreate(n)
+    s = 0
+    for i = 1:n
+        s += consume(Task(()->i))
+    end
+    s
+end
+
+# two tasks handing control back and forth with yieldto
+function pingpong(n)
+    main = current_task()
+    t = Task() do
+        while true
+            yieldto(main, nothing)
+        end
+    end
+    for i = 1:n
+        yieldto(t, nothing)
+    end
+end
+
+# the same in deep call stacks, where copying the stack on a switch costs the most
+deepswitch(d, k) = d == 0 ? (for i = 1:k; produce(i); end; 0) : deepswitch(d - 1, k) + 1
+function pingpong_deep(n, depth)
+    t = Task(()->deepswitch(depth, n))
+    s = 0
+    for i = 1:n
+        s += consume(t)
+    end
+    s
+end
+
+# producer and consumer tasks connected through a channel
+function channelpass(n)
+    c = Channel{Int}(32)
+    @schedule begin
+        for i = 1:n
+            put!(c, i)
+        end
+        close(c)
+    end
+    s = 0
+    for x in c
+        s += x
+    end
+    s
+end
+
+# producer and consumer through produce/consume
+function producerconsumer(n)
+    p = Task(()->(for i = 1:n; produce(i); end))
+    s = 0
+    for x in p
+        s += x
+    end
+    s
+end
+
+function printstats(name, s0, s1, n)
+    @printf("julia,%s.switches,%f,%f,%f,%f\n", name, (s1.nswitches - s0.nswitches)/n, 0, 0, 0)
+    @printf("julia,%s.bytes_copied,%f,%f,%f,%f\n", name,
+            (s1.saved_bytes - s0.saved_bytes + s1.restored_bytes - s0.restored_bytes)/n, 0, 0, 0)
+end
+
+@timeit taskcreate(ntasks) "task_create" "Create and run $ntasks tasks"
+@timeit pingpong(nswitches) "task_pingpong" "$nswitches round trips between two tasks"
+@timeit pingpong_deep(nswitches, 200) "task_pingpong_deep" "$nswitches switches 200 frames deep"
+@timeit channelpass(nswitches) "task_channel" "Pass $nswitches values through a Channel"
+@timeit producerconsumer(nswitches) "task_produce" "Pass $nswitches values with produce/consume"
+
+if !codespeed
+    s0 = Base.task_stats()
+    pingpong(nswitches)
+    printstats("task_pingpong", s0, Base.task_stats(), nswitches)
+    s0 = Base.task_stats()
+    pingpong_deep(nswitches, 200)
+    printstats("task_pingpong_deep", s0, Base.task_stats(), nswitches)
+end
@@ -131,6 +131,9 @@ function laplace3d(nx=290, ny=290, nz=290; iters=1000, verify=false)
     end
 end
 
-@time laplace3d()
+# scaling.jl runs it itself
+if !isdefined(:THREAD_SCALING)
+    @time laplace3d()
+end
 #ccall(:jl_threading_profile, Void, ())
 
@@ -218,6 +218,9 @@ function lbm3d(n)
     #title("Flow field at z = $(zcut)), after $(ts)")
 end
 
-@time lbm3d(36)
+# scaling.jl runs it itself
+if !isdefined(:THREAD_SCALING)
+    @time lbm3d(36)
+end
 #ccall(:jl_threading_profile, Void, ())
 
@@ -0,0 +1,142 @@
+# This file is a part of Julia. License is MIT: http://julialang.org/license
+
+## Thread scaling of the benchmarks in this directory
+##
+## Runs every benchmark in a fresh julia for each number of threads and each
+## thread affinity, and writes the scaling curves as JSON:
+##
+##   julia scaling.jl [--threads 1,2,4,8] [--affinity none,compact,spread]
+##                    [--reps 5] [--output scaling.json] [benchmark...]
+##
+## "none" leaves JULIA_THREAD_AFFINITY unset. The speedup and efficiency of a
+## run are relative to the run of the same benchmark and affinity with the
+## fewest threads. Every run also records the summed `Threads.profile()` of
+## its timed repetitions, where the time is lost when scaling breaks down:
+## `imbalance` (threads waiting for the slowest one), `fork_spin` and
+## `fork_sleep` (waiting to be released into a region), `gc`.
+
+const benchmarks = [
+    # name, file, call (run once to warm up, then timed)
+    ("laplace3d", "laplace3d/laplace3d.jl", :(laplace3d(130, 130, 130; iters=100))),
+    ("lbm3d",     "lbm3d/lbm3d.jl",         :(lbm3d(36))),
+    ("stockcorr", "stockcorr/pstockcorr.jl", :(pstockcorr(50000))),
+]
+
+const profile_fields = (:nregions, :prep, :fork, :fork_spin, :fork_sleep,
+                        :nsleeps, :user, :join, :gc, :imbalance)
+
+# empty if the runtime was built without threading profiling
+function json_profile(io, profs)
+    print(io, "{")
+    isempty(profs) && return print(io, "}")
+    for (i, f) in enumerate(profile_fields)
+        i > 1 && print(io, ", ")
+        # the totals over the threads, and the value of each thread
+        print(io, "\"", f, "\": ", sum(p -> getfield(p, f), profs),
+              ", \"", f, "_per_thread\": [", join([getfield(p, f) for p in profs], ", "), "]")
+    end
+    print(io, "}")
+end
+
+# in the julia started for a run: time the benchmark, and report the times
+# and the profile on a line of its own
+function run_benchmark(name, reps)
+    i = findfirst(b -> b[1] == name, benchmarks)
+    i == 0 && error("unknown benchmark $name")
+    _, file, call = benchmarks[i]
+    # keeps the file from running the benchmark when included
+    eval(Main, :(const THREAD_SCALING = true))
+    eval(Main, :(include($(joinpath(dirname(@__FILE__), file)))))
+    eval(Main, call)
+    gc()
+    Threads.clear_profile()
+    times = Float64[]
+    for r = 1:reps
+        t0 = time_ns()
+        eval(Main, call)
+        push!(times, (time_ns() - t0) / 1e9)
+        gc()
+    end
+    profs = Threads.profile()
+    io = IOBuffer()
+    json_profile(io, profs)
+    println(STDERR, "#scaling\t", minimum(times), "\t", median(times), "\t",
+            join(times, ","), "\t", takebuf_string(io))
+end
+
+function parse_args(args)
+    threads = [1, 2, 4, 8]
+    affinities = ["none"]
+    reps = 5
+    output = "scaling.json"
+    names = AbstractString[]
+    i = 1
+    while i <= length(args)
+        a = args[i]
+        if a in ("--threads", "--affinity", "--reps", "--output") && i < length(args)
+            v = args[i+=1]
+            a == "--threads"  && (threads = [parse(Int, s) for s in split(v, ',')])
+            a == "--affinity" && (affinities = split(v, ','))
+            a == "--reps"     && (reps = parse(Int, v))
+            a == "--output"   && (output = v)
+        elseif startswith(a, "-")
+            error("usage: julia scaling.jl [--threads 1,2,4,8] [--affinity none,compact,spread] [--reps 5] [--output scaling.json] [benchmark...]")
+        else
+            push!(names, a)
+        end
+        i += 1
+    end
+    isempty(names) && (names = [b[1] for b in benchmarks])
+    sort!(threads)
+    threads, affinities, reps, output, names
+end
+
+function run_scaling(args)
+    threads, affinities, reps, output, names = parse_args(args)
+    julia = Base.julia_cmd()
+    results = []
+    for name in names, affinity in affinities
+        tbase = 0.0
+        for n in threads
+            env = ["JULIA_NUM_THREADS" => string(n),
+                   "JULIA_THREAD_AFFINITY" => affinity == "none" ? nothing : affinity]
+            cmd = `$julia $(@__FILE__) --run $name $reps`
+            # the report is on stderr, the benchmarks print on stdout
+            errfile = tempname()
+            ok = withenv(env...) do
+                success(pipeline(cmd, stdout=DevNull, stderr=errfile))
+            end
+            err = readall(errfile)
+            rm(errfile)
+            ok || error("$name with $n threads ($affinity) failed:\n", err)
+            lines = filter(l -> startswith(l, "#scaling\t"), split(err, '\n'))
+            isempty(lines) && error("$name with $n threads ($affinity) did not report:\n", err)
+            _, tmin, tmed, ts, prof = split(chomp(lines[end]), '\t')
+            t = parse(Float64, tmed)
+            tbase == 0 && (tbase = t)
+            speedup = tbase / t
+            efficiency = speedup * threads[1] / n
+            @printf("%-12s %-10s %3d threads  %9.4f s  speedup %6.2f  efficiency %5.2f\n",
+                    name, affinity, n, t, speedup, efficiency)
+            push!(results, (name, affinity, n, tmin, tmed, ts, speedup, efficiency, prof))
+        end
+    end
+    open(output, "w") do io
+        println(io, "[")
+        for (i, (name, affinity, n, tmin, tmed, ts, speedup, efficiency, prof)) in enumerate(results)
+            print(io, "  {\"benchmark\": \"", name, "\", \"affinity\": \"", affinity,
+                  "\", \"threads\": ", n, ", \"min_s\": ", tmin, ", \"median_s\": ", tmed,
+                  ", \"times_s\": [", replace(ts, ",", ", "), "], \"speedup\": ", speedup,
+                  ", \"efficiency\": ", efficiency, ", \"profile\": ", prof, "}")
+            println(io, i < length(results) ? "," : "")
+        end
+        println(io, "]")
+    end
+    println("scaling curves written to ", output)
+end
+
+if length(ARGS) >= 1 && ARGS[1] == "--run"
+    run_benchmark(ARGS[2], parse(Int, ARGS[3]))
+else
+    run_scaling(ARGS)
+end
@@ -108,6 +108,9 @@ function pstockcorr(n)
     return (SimulPriceA, SimulPriceB)
 end
 
-@time pstockcorr(1000000)
+# scaling.jl runs it itself
+if !isdefined(:THREAD_SCALING)
+    @time pstockcorr(1000000)
+end
 #ccall(:jl_threading_profile, Void, ())
 
@@ -11,6 +11,13 @@ end
 
 Profile.clear()
 @profile busywait(1, 20)
+let data = Profile.fetch()
+    # batch symbolization agrees with looking up one frame at a time
+    lidict = Profile.getdict(data)
+    for ip in unique(data)
+        @test lidict[ip] == Profile.lookup(ip)
+    end
+end
 let iobuf = IOBuffer()
     Profile.print(iobuf, format=:tree, C=true)
     str = takebuf_string(iobuf)
@@ -32,3 +39,116 @@ let iobuf = IOBuffer()
     Profile.clear()
     @test isempty(Profile.fetch())
 end
+
+# every backtrace is tagged with its thread and task
+Profile.clear()
+@profile busywait(1, 20)
+let (data, tids, tasks) = Profile.fetch_threads()
+    @test length(tids) == length(tasks) == count(x -> x == 0, data)
+    @test all(t -> 1 <= t <= Threads.nthreads(), tids)
+    @test 1 in tids
+    main = Profile.fetch_thread(1)
+    @test !isempty(main) && main[end] == 0
+    @test length(main) <= length(data)
+    Profile.clear()
+end
+
+# sampling on a hardware counter, where the kernel lets us open one
+let (n, delay) = Profile.init()
+    @test_throws ArgumentError Profile.init_perf(n, :no_such_event, 1000)
+    perf = try
+        Profile.init_perf(n, :instructions, 100_000)
+        true
+    catch
+        false
+    end
+    if perf
+        Profile.clear()
+        @profile busywait(1, 20)
+        counts = Profile.fetch_counts()
+        @test !isempty(counts)
+        @test issorted(counts[Profile.fetch_threads()[2] .== 1])
+        @test all(c -> c > 0, counts)
+    end
+    Profile.init(n, delay)
+    Profile.clear()
+end
+
+# ring-buffer mode: drain while the profiler keeps running
+let (n, delay) = Profile.init()
+    Profile.init_ring(n, delay)
+    @test Profile.is_ring()
+    data = UInt[]
+    @profile for i = 1:5
+        busywait(0.2, 1)
+        chunk = Profile.drain()
+        @test isempty(chunk) || chunk[end] == 0
+        append!(data, chunk)
+    end
+    append!(data, Profile.drain())
+    @test !isempty(data)
+    @test Profile.len_data() == 0
+    @test Profile.dropped() == 0
+    iobuf = IOBuffer()
+    Profile.print(iobuf, data)
+    @test !isempty(takebuf_string(iobuf))
+    Profile.init(n, delay)
+    @test !Profile.is_ring()
+end
+
+# allocation sampling
+# the buffer is only allocated when the allocation profiler is first used
+@test readchomp(`$(Base.julia_cmd()) --startup-file=no -E "n() = Int(ccall(:jl_alloc_profile_maxlen_data, Csize_t, ())); a = n(); Profile.@profile_alloc 1; (a, n())"`) == "(0,1000000)"
+let interval = 1024
+    Profile.init_alloc(1_000_000, interval)
+    Profile.clear_alloc()
+    Profile.@profile_alloc for i = 1:1000
+        Ref(zeros(100))
+    end
+    types, sizes, data = Profile.fetch_alloc()
+    @test !isempty(types)
+    @test length(types) == length(sizes) == count(x -> x == 0, data)
+    @test Array{Float64,1} in types
+    iobuf = IOBuffer()
+    Profile.print_alloc(iobuf)
+    @test contains(takebuf_string(iobuf), "Array{Float64,1}")
+    Profile.clear_alloc()
+    @test isempty(Profile.fetch_alloc()[1])
+    Profile.init_alloc(1_000_000, 512*1024)
+end
+
+# dispatch profiling
+dispatchprof(x) = x
+let xs = Any[1, 2.0, "a", :b]
+    Profile.clear_dispatch()
+    Profile.@profile_dispatch for i = 1:100
+        for x in xs
+            dispatchprof(x)
+        end
+    end
+    names, stats = Profile.fetch_dispatch()
+    i = findfirst(names, :dispatchprof)
+    @test i > 0
+    @test stats[i].calls >= 400
+    iobuf = IOBuffer()
+    Profile.print_dispatch(iobuf)
+    @test contains(takebuf_string(iobuf), "dispatchprof")
+    Profile.clear_dispatch()
+    @test isempty(Profile.fetch_dispatch()[1])
+end
+
+# compile time profiling
+compileprof(x) = x + 1
+let xs = Any[1]
+    Profile.clear_compile()
+    Profile.@profile_compile compileprof(xs[1])
+    lambdas, stats = Profile.fetch_compile()
+    i = findfirst(li -> li.name === :compileprof, lambdas)
+    @test i > 0
+    @test Profile.total_time(stats[i]) > 0
+    iobuf = IOBuffer()
+    Profile.print_compile(iobuf)
+    @test contains(takebuf_string(iobuf), "compileprof")
+    Profile.clear_compile()
+    @test isempty(Profile.fetch_compile()[1])
+end
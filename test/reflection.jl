@@ -50,6 +50,16 @@ test_code_reflections(test_bin_reflection, code_native)
 
 @test_throws Exception code_llvm(+, Int, Int)
 @test_throws Exception code_llvm(+, Array{Float32}, Array{Float32})
+
+# code without loops compiled at run time only gets the short pass pipeline
+cheap_opt(x) = x > 0 ? x + 1 : x - 1
+full_opt(x) = (s = 0; for i = 1:x; s += i; end; s)
+if VersionNumber(Base.libllvm_version) >= v"3.7" && Base.JLOptions().opt_level == 0
+    @test contains(sprint(code_llvm, cheap_opt, (Int,), true, true), "julia-cheap-opt")
+    @test !contains(sprint(code_llvm, full_opt, (Int,), true, true), "julia-cheap-opt")
+end
+@test cheap_opt(2) == 3 && cheap_opt(-2) == -3
+@test full_opt(10) == 55
 end
 
 # code_warntype
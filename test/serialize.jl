@@ -345,3 +345,47 @@ str = takebuf_string(io)
 @test !isempty(search(str, "Shell"))
 
 end  # module Test13452
+
+# C-level data serializer
+module TestSerializeData
+using Base.Test
+
+immutable Point
+    x::Float64
+    y::Float64
+end
+
+let fname = tempname()
+    data = (rand(1000), Point(1.0, 2.0), Dict("a" => [1, 2, 3]), :sym, "str")
+    open(fname, "w") do f
+        ccall(:jl_serialize_data, Void, (Ptr{Void}, Any), f.ios, data)
+    end
+    data2 = open(fname) do f
+        ccall(:jl_deserialize_data, Any, (Ptr{Void},), f.ios)
+    end
+    rm(fname)
+    @test data2[1] == data[1]
+    @test isa(data2[2], Point) && data2[2] == data[2]
+    @test data2[3]["a"] == [1, 2, 3]
+    @test data2[4] === :sym
+    @test data2[5] == "str"
+end
+
+# an error while serializing releases the serializer and restores the gc
+let fname = tempname()
+    open(fname, "w") do f
+        @test_throws ErrorException ccall(:jl_serialize_data, Void, (Ptr{Void}, Any),
+                                          f.ios, Any[1, @task(1)])
+    end
+    @test gc_enable(true)
+    open(fname, "w") do f
+        ccall(:jl_serialize_data, Void, (Ptr{Void}, Any), f.ios, Point(3.0, 4.0))
+    end
+    p = open(fname) do f
+        ccall(:jl_deserialize_data, Any, (Ptr{Void},), f.ios)
+    end
+    rm(fname)
+    @test p == Point(3.0, 4.0)
+end
+
+end  # module TestSerializeData
@@ -137,3 +137,48 @@ function simd_sum_over_array(a)
 end
 @test 2001000 == simd_sum_over_array(collect(1:2000))
 @test 2001000 == simd_sum_over_array(Float32[i+j*500 for i=1:500, j=0:3])
+
+# reductions that mix + and -, and conditional reductions
+function simd_add_sub(x)
+    s = 0.0
+    @simd for i in 1:length(x)
+        @inbounds s += x[i]
+        @inbounds s -= 0.5*x[i]
+    end
+    s
+end
+@test simd_add_sub(collect(1.0:100.0)) == 2525.0
+
+function simd_positive_sum(x)
+    s = 0.0
+    @simd for i in 1:length(x)
+        @inbounds s = ifelse(x[i] > 0, s + x[i], s)
+    end
+    s
+end
+@test simd_positive_sum([isodd(i) ? Float64(i) : -1.0 for i = 1:100]) == 2500.0
+
+# the report of which loops were vectorized
+@unix_only let code = """
+        Base.SimdLoop.simd_report()
+        function f(x, m)
+            s = 0.0
+            @simd for i in 1:length(x)
+                for j in 1:m
+                    @inbounds s += x[i]
+                end
+            end
+            s
+        end
+        f(ones(100), 3)
+        """,
+        out = Pipe(),
+        proc = spawn(pipeline(`$(Base.julia_cmd()) --startup-file=no -e $code`, stderr=out))
+
+    wait(proc)
+    close(out.in)
+    @test success(proc)
+    report = readall(out)
+    @test contains(report, "@simd loop in julia_f")
+    @test contains(report, "was not vectorized: it is not an innermost loop")
+end
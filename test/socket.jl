@@ -170,6 +170,18 @@ begin
 
     @test_throws MethodError bind(UDPSocket(),port)
 
+    # batched send and receive
+    tsk = @async begin
+        msgs = recvmany(a)
+        while length(msgs) < 3
+            append!(msgs, recvmany(a))
+        end
+        @test [bytestring(data) for (addr,data) in msgs] == ["one", "two", "three"]
+        @test all(m -> m[1] == ip"127.0.0.1", msgs)
+    end
+    sendmany(b, ip"127.0.0.1", port, ["one", "two", "three"])
+    wait(tsk)
+
     close(a)
     close(b)
 end
@@ -268,3 +280,38 @@ let
     end
     [close(s) for s in [a, b, c]]
 end
+
+# writing several buffers at once, with and without write buffering
+let
+    port, server = listenany(defaultport)
+    tsk = @async begin
+        sock = accept(server)
+        @test write(sock, "head\n".data, "body\n".data, "tail\n".data) == 15
+        buffer_writes(sock, 1024)
+        @test write(sock, "a\n".data, "b\n".data) == 4
+        flush(sock)
+        close(sock)
+    end
+    @test readall(connect(port)) == "head\nbody\ntail\na\nb\n"
+    wait(tsk)
+    close(server)
+end
+
+# streaming part of a file straight to a socket
+let fname = tempname()
+    data = rand(UInt8, 300000)
+    open(io -> write(io, data), fname, "w")
+    port, server = listenany(defaultport)
+    tsk = @async begin
+        sock = accept(server)
+        write(sock, "start\n")
+        f = Base.Filesystem.open(fname, Base.Filesystem.JL_O_RDONLY)
+        Base.sendfile(sock, f, Int64(10), length(data) - 20)
+        close(f)
+        close(sock)
+    end
+    @test readbytes(connect(port)) == ["start\n".data; data[11:end-10]]
+    wait(tsk)
+    close(server)
+    rm(fname)
+end
@@ -233,6 +233,20 @@ sp = pointer(s)
 @test get(tryparse(Float32, "32")) == 32.0f0
 @test isnull(tryparse(Float32, "32o"))
 
+# decimal fast path and its fallbacks agree on rounding and edge cases
+for s in ["0.1", "-2.5e-3", "1.", ".5", "-0", "9007199254740993", "123456789012345678901",
+          "1e23", "4.9e-324", "1e400", "0x1p3", "inf", "  7.25", "3.0 ", "1e", "."]
+    @test isequal(tryparse(Float64, s), tryparse(Float64, SubString(s*"9", 1, length(s))))
+end
+@test get(tryparse(Float64, "0.1")) === 0.1
+@test get(tryparse(Float64, "-0")) === -0.0
+@test get(tryparse(Float64, "9007199254740993")) === 9.007199254740992e15
+@test get(tryparse(Float64, "1e23")) === 1e23
+@test get(tryparse(Float32, "0.1")) === 0.1f0
+@test get(tryparse(Float32, "16777217")) === 1.6777216f7
+@test isnull(tryparse(Float64, "1e"))
+@test isnull(tryparse(Float64, "."))
+
 # issue #10994: handle embedded NUL chars for string parsing
 for T in [BigInt, Int8, UInt8, Int16, UInt16, Int32, UInt32, Int64, UInt64, Int128, UInt128]
     @test_throws ArgumentError parse(T, "1\0")
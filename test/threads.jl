@@ -83,3 +83,375 @@ let lock = Threads.RecursiveSpinLock()
     @test unlock!(lock) == 0
     @test unlock!(lock) == 1
 end
+
+# parallel mark phase of the garbage collector
+let prev = ccall(:jl_gc_enable_parallel_mark, Cint, (Cint,), 1)
+    lists = [Any[] for i = 1:nthreads()]
+    @threads for i = 1:nthreads()
+        l = lists[i]
+        for j = 1:10000
+            push!(l, Any[j, string(j)])
+        end
+    end
+    gc()
+    gc(false)
+    for l in lists
+        @test all(i -> l[i][1] == i && l[i][2] == string(i), 1:length(l))
+    end
+    ccall(:jl_gc_enable_parallel_mark, Cint, (Cint,), prev)
+end
+
+# work spawned from any thread is run by whichever thread is free
+let x = Atomic()
+    @threads for i = 1:nthreads()
+        for j = 1:100
+            Threads.spawn(() -> (atomic_add!(x, 1); nothing))
+        end
+    end
+    @test x[] == 100*nthreads()
+    for j = 1:10
+        Threads.spawn(() -> (atomic_add!(x, 1); nothing))
+    end
+    Threads.sync()
+    @test x[] == 100*nthreads() + 10
+    Threads.spawn(() -> error("spawned"))
+    @test_throws ErrorException Threads.sync()
+    # reported once
+    Threads.sync()
+    @test_throws ErrorException @threads for i = 1:nthreads()
+        i == 1 && Threads.spawn(() -> error("spawned"))
+    end
+    Threads.sync()
+end
+
+# syncs from spawned work and from nested regions wait for the work they spawned
+let x = Atomic()
+    for j = 1:4
+        Threads.spawn() do
+            for k = 1:10
+                Threads.spawn(() -> (atomic_add!(x, 1); nothing))
+            end
+            Threads.sync()
+            atomic_add!(x, 100)
+            nothing
+        end
+    end
+    Threads.sync()
+    @test x[] == 4*110
+    x[] = 0
+    @threads for i = 1:nthreads()
+        @threads for j = 1:nthreads()
+            Threads.spawn(() -> (atomic_add!(x, 1); nothing))
+            Threads.sync()
+        end
+    end
+    @test x[] == nthreads()^2
+end
+
+# results of the threads reduced in a tree
+@test Threads.reduce_threads(+, () -> threadid()) == div(nthreads()*(nthreads()+1), 2)
+@test Threads.reduce_threads(vcat, () -> [threadid()]) == collect(1:nthreads())
+let r = 1:10000
+    @test Threads.reduce_threads(+, function ()
+        s = 0
+        for i = threadid():nthreads():length(r)
+            s += r[i]
+        end
+        s
+    end) == sum(r)
+end
+@test_throws ErrorException Threads.reduce_threads(+, () -> threadid() == nthreads() ? error("thread") : 1)
+
+# dynamic and guided scheduling of threaded loops
+for (sched, chunk) in ((:dynamic, 1), (:dynamic, 7), (:guided, 1), (:guided, 5))
+    a = zeros(Int, 1000)
+    x = Atomic()
+    if sched === :dynamic
+        @threads :dynamic chunk for i = 1:1000
+            a[i] += 1
+            atomic_add!(x, i)
+        end
+    else
+        @threads :guided chunk for i = 1:1000
+            a[i] += 1
+            atomic_add!(x, i)
+        end
+    end
+    @test all(a .== 1)
+    @test x[] == sum(1:1000)
+end
+@test_throws ArgumentError eval(:(@threads :other for i = 1:2 end))
+
+# a dynamic loop nested in another one doesn't take the iterations of the outer
+let a = zeros(Int, 20, 30)
+    @threads :dynamic 1 for i = 1:20
+        @threads :dynamic 3 for j = 1:30
+            a[i, j] += 1
+        end
+    end
+    @test all(a .== 1)
+end
+
+# nested threaded regions run on the same threads
+let a = zeros(Int, nthreads(), nthreads()), x = Atomic()
+    @threads for i = 1:nthreads()
+        @threads for j = 1:nthreads()
+            a[i, j] += 1
+            atomic_add!(x, 1)
+        end
+    end
+    @test all(a .== 1)
+    @test x[] == nthreads()^2
+    @test Threads.reduce_threads(+, () -> Threads.reduce_threads(+, () -> 1)) == nthreads()^2
+end
+
+# threadid() stays the physical thread in a nested region, so locks taken
+# there are still owned by one thread at a time
+let ids = zeros(Int, nthreads(), nthreads()), l = Threads.RecursiveTatasLock(), x = Ref(0)
+    @threads for i = 1:nthreads()
+        @threads for j = 1:nthreads()
+            ids[i, j] = threadid()
+            lock!(l)
+            x[] += 1
+            unlock!(l)
+        end
+    end
+    @test all(1 .<= ids .<= nthreads())
+    @test x[] == nthreads()^2
+end
+
+# profile of the threaded regions
+Threads.clear_profile()
+let prof = Threads.profile()
+    @test isempty(prof) || (length(prof) == nthreads() && all(p -> p.nregions == 0, prof))
+    @threads for i = 1:nthreads()
+        sum(rand(1000))
+    end
+    prof = Threads.profile()
+    if !isempty(prof)
+        @test all(p -> p.nregions == 1, prof)
+        @test all(p -> sum(p.user_hist) == 1 && sum(p.imbalance_hist) == 1, prof)
+        @test minimum(p -> p.imbalance, prof) == 0
+    end
+end
+
+# allocating on all the threads, through the collections this triggers
+let n = 200_000, s0 = Base.gc_num(), counts = zeros(Int, nthreads())
+    @threads for i = 1:nthreads()
+        c = 0
+        for j = 1:n
+            c += length(Any[j, j])
+        end
+        counts[threadid()] = c
+    end
+    d = Base.GC_Diff(Base.gc_num(), s0)
+    @test all(counts .== 2n)
+    @test d.poolalloc + d.malloc >= nthreads() * n
+    @test d.allocd >= nthreads() * n * sizeof(Int)
+end
+
+# arrays filled by all the threads
+let a = Threads.zeros(Float64, 1000, 3), b = Threads.fill(0x2, 10^6), c = Threads.fill("a", 3)
+    @test size(a) == (1000, 3) && all(a .== 0)
+    @test length(b) == 10^6 && all(b .== 0x2)
+    @test c == ["a", "a", "a"]
+end
+
+# parsing and lowering on all the threads, each with its own front end
+let srcs = [string("f", i, "(x) = [y^", i, " for y in x if y > ", i, "]") for i = 1:4nthreads()],
+    exprs = Array(Any, length(srcs)), lowered = Array(Any, length(srcs))
+    @threads for i = 1:length(srcs)
+        exprs[i] = parse(srcs[i])
+        lowered[i] = expand(exprs[i])
+    end
+    @test exprs == map(parse, srcs)
+    @test all(e -> isa(e, Expr), lowered)
+end
+
+# a collection on one thread while the others run loops that don't allocate
+function spin_nonalloc(n)
+    s = 0
+    for i = 1:n
+        s += i & 7
+    end
+    s
+end
+let n = 10^8, sums = zeros(Int, nthreads()), ngc = Base.gc_num().pause
+    @threads for i = 1:nthreads()
+        if threadid() == 1
+            for j = 1:3
+                gc()
+            end
+        else
+            sums[threadid()] = spin_nonalloc(n)
+        end
+    end
+    @test Base.gc_num().pause >= ngc + 3
+    @test all(sums[2:end] .== spin_nonalloc(n))
+end
+
+# atomic operations on array elements and fields
+type AtomicFields
+    count::Int
+    flag::Bool
+    x::Float64
+end
+let counts = zeros(Int, 4), n = 10_000
+    @threads for i = 1:nthreads()
+        for j = 1:n
+            atomic_modifyindex!(counts, :add, 1, 1 + j % 4)
+        end
+    end
+    @test counts == fill(div(n * nthreads(), 4), 4)
+end
+let obj = AtomicFields(0, false, 0.0), n = 10_000
+    @threads for i = 1:nthreads()
+        for j = 1:n
+            # a compare-and-swap loop on the counter
+            old = atomic_getfield(obj, :count, :monotonic)
+            while true
+                found = atomic_casfield!(obj, :count, old, old + 1, :acquire_release)
+                found == old && break
+                old = found
+            end
+        end
+    end
+    @test obj.count == n * nthreads()
+    @test atomic_modifyfield!(obj, :flag, :xchg, true) === false
+    @test obj.flag
+    atomic_setfield!(obj, :x, 2.5, :release)
+    @test atomic_getfield(obj, :x, :acquire) === 2.5
+    @test atomic_casfield!(obj, :x, 1.0, 3.0) === 2.5
+    @test obj.x === 2.5
+    @test_throws ArgumentError atomic_getfield(1 + 2im, :re)
+    @test_throws ErrorException atomic_getfield(obj, :nofield)
+    # with Val the field is resolved at compile time
+    @test atomic_getfield(obj, Val{:x}) === 2.5
+    @test Base.return_types(atomic_getfield, Tuple{AtomicFields, Type{Val{:x}}, Symbol}) == Any[Float64]
+    @test Base.return_types(Base.Threads.atomic_fieldpointer, Tuple{AtomicFields, Type{Val{:flag}}}) == Any[Ptr{Bool}]
+end
+# the inline atomic instructions check the alignment like the runtime does
+atomic_load_inline(p) = Core.Intrinsics.atomic_pointerref(p, :acquire)
+let a = zeros(UInt8, 16), order = :acquire
+    p = convert(Ptr{Int32}, pointer(a))
+    @test atomic_load_inline(p) === Int32(0)
+    @test_throws ErrorException atomic_load_inline(p + 1)
+    @test_throws ErrorException unsafe_atomic_load(p + 2, order)
+end
+# Float16 is an integer to LLVM, but rejected by the inline rmw all the same
+atomic_add_inline(p, x) = Core.Intrinsics.atomic_pointerrmw(p, :add, x, :acquire)
+atomic_max_inline(p, x) = Core.Intrinsics.atomic_pointerrmw(p, :max, x, :acquire)
+let a = Float16[1]
+    @test_throws ErrorException atomic_add_inline(pointer(a), Float16(1))
+    @test_throws ErrorException atomic_max_inline(pointer(a), Float16(2))
+    @test a == Float16[1]
+end
+let a = UInt8[1, 2, 3], order = :sequentially_consistent
+    # an order the compiler can't see goes through the runtime
+    @test atomic_modifyindex!(a, :max, 0x07, 2, order) === 0x02
+    @test atomic_modifyindex!(a, :sub, 0x02, 3, order) === 0x03
+    @test atomic_getindex(a, 2, order) === 0x07
+    @test atomic_setindex!(a, 0x09, 1, order) === a
+    @test a == UInt8[9, 7, 1]
+    @test atomic_modifyindex!(Int16[-1], :min, Int16(-5), 1) === Int16(-1)
+    @test_throws ErrorException atomic_getindex(a, 1, :release)
+    @test_throws ErrorException atomic_modifyindex!(Float64[1.0], :add, 1.0, 1)
+    @test_throws BoundsError atomic_getindex(a, 4)
+end
+
+# producers and consumers on a small queue
+let q = ThreadQueue(6), n = 1000, sums = zeros(Int, nthreads())
+    @test capacity(q) == 8
+    @test isempty(q) && isnull(tryshift!(q))
+    @test trypush!(q, "a") && length(q) == 1
+    @test get(tryshift!(q)) == "a"
+    for i = 1:capacity(q)
+        @test trypush!(q, i)
+    end
+    @test !trypush!(q, 0)
+    @test [shift!(q) for i = 1:capacity(q)] == collect(1:capacity(q))
+    if nthreads() > 1
+        # odd threads produce boxed values, even threads consume them
+        nprod = div(nthreads() + 1, 2)
+        ncons = nthreads() - nprod
+        @threads for t = 1:nthreads()
+            id = threadid()
+            if isodd(id)
+                for i = 1:n
+                    push!(q, Any[i])
+                end
+            else
+                # the consumers share out the values evenly
+                cnt = div(nprod * n, ncons) + (div(id, 2) <= rem(nprod * n, ncons))
+                s = 0
+                for i = 1:cnt
+                    s += shift!(q)[1]
+                end
+                sums[id] = s
+            end
+        end
+        @test sum(sums) == nprod * div(n * (n + 1), 2)
+        @test isempty(q)
+    end
+end
+
+# each worker thread writes to a file through the requests of its own event loop
+thread_fs_done(req::Ptr{Void}) = nothing
+let n = nthreads(), dir = mktempdir(), loops = zeros(UInt, n), results = zeros(Int, n)
+    cb = cfunction(thread_fs_done, Void, (Ptr{Void},))
+    files = [Base.FS.open(joinpath(dir, "t$i"), Base.JL_O_WRONLY | Base.JL_O_CREAT, 0o600) for i = 1:n]
+    datas = [convert(Vector{UInt8}, "written by thread $i") for i = 1:n]
+    reqs = [Libc.malloc(Base._sizeof_uv_fs) for i = 1:n]
+    # uv_buf_t is at most two words
+    bufs = [zeros(UInt, 2) for i = 1:n]
+    for i = 1:n
+        ccall(:jl_uv_buf_set_base, Void, (Ptr{Void}, Ptr{UInt8}), bufs[i], datas[i])
+        ccall(:jl_uv_buf_set_len, Void, (Ptr{Void}, Csize_t), bufs[i], length(datas[i]))
+    end
+    @threads for i = 1:n
+        id = threadid()
+        loop = ccall(:jl_thread_event_loop, Ptr{Void}, ())
+        loops[id] = UInt(loop)
+        err = ccall(:uv_fs_write, Int32,
+                    (Ptr{Void}, Ptr{Void}, Int32, Ptr{Void}, UInt32, Int64, Ptr{Void}),
+                    loop, reqs[id], files[id].handle.fd, bufs[id], 1, -1, cb)
+        if err == 0
+            while ccall(:jl_run_once, Int32, (Ptr{Void},), loop) != 0
+            end
+            results[id] = ccall(:jl_uv_fs_result, Int32, (Ptr{Void},), reqs[id])
+            ccall(:uv_fs_req_cleanup, Void, (Ptr{Void},), reqs[id])
+        else
+            results[id] = err
+        end
+    end
+    foreach(close, files)
+    foreach(Libc.free, reqs)
+    # thread 1 uses the global loop, the others one each
+    @test loops[1] == UInt(ccall(:jl_global_event_loop, Ptr{Void}, ()))
+    @test all(loops .!= 0) && length(unique(loops)) == n
+    @test results == map(length, datas)
+    for i = 1:n
+        @test readall(joinpath(dir, "t$i")) == "written by thread $i"
+    end
+    rm(dir, recursive=true)
+end
+
+# a collection requested by one thread doesn't wait for the loops of the
+# others to end: they poll on their back-edges, vectorized or not
+@linux_only if nthreads() > 1 && get(ENV, "JULIA_GC_SIGNAL_SAFEPOINTS", "1") != "0"
+    let n = 10^9, started = zeros(Int, nthreads()), spun = zeros(nthreads()), waited = Ref(0.0)
+        spin_nonalloc(10)
+        @threads for i = 1:nthreads()
+            if threadid() == 1
+                while sum(started) < nthreads() - 1
+                    ccall(:jl_cpu_pause, Void, ())
+                end
+                waited[] = @elapsed gc(false)
+            else
+                started[threadid()] = 1
+                spun[threadid()] = @elapsed spin_nonalloc(n)
+            end
+        end
+        @test waited[] < minimum(spun[2:end]) / 2
+    end
+end
@@ -37,3 +37,23 @@ end
 
 ## Specifically check UTF-8 string whose lead byte is same as a surrogate
 @test convert(UTF8String,b"\xed\x9f\xbf") == "\ud7ff"
+
+## u8_isvalid_batch: 0 for invalid, 1 for ASCII, 2 for other valid UTF-8
+function isvalid_batch(strs::Vector{Vector{UInt8}})
+    res = zeros(Cint, length(strs))
+    ccall(:u8_isvalid_batch, Void, (Ptr{Ptr{UInt8}}, Ptr{Csize_t}, Csize_t, Ptr{Cint}),
+          map(pointer, strs), map(length, strs), length(strs), res)
+    res
+end
+# the sequences sit across the 8-byte words that the ASCII scan skips
+for pad = 5:9
+    p = fill(UInt8('a'), pad)
+    strs = Vector{UInt8}[p, [p; 0xe2; 0x82; 0xac; p], [p; 0xe2; 0x82; 0x41; p],
+                         [p; 0xed; 0xa0; 0x80; p], [p; 0xf0; 0x9f; 0x98; 0x80],
+                         # truncated at the end of the string
+                         [p; 0xc3], [p; 0xe2; 0x82], [p; 0xf0; 0x9f; 0x98]]
+    @test isvalid_batch(strs) == Cint[1, 2, 0, 0, 2, 0, 0, 0]
+end
+# a sequence cut between two strings of the batch is invalid in both
+@test isvalid_batch(Vector{UInt8}[b"abc\xe2", b"\x82\xacdef", b"\xe2\x82\xac"]) == Cint[0, 0, 2]
+@test isvalid_batch(Vector{UInt8}[]) == Cint[]
@@ -5,6 +5,10 @@
   system startup, main(), and console interaction
 */
 
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE // struct ucred, for the fork server
+#endif
+
 #include <stdlib.h>
 #include <string.h>
 #include <stdarg.h>
@@ -29,12 +33,22 @@
 #include "uv.h"
 #define WHOLE_ARCHIVE
 #include "../src/julia.h"
+#include <options.h>
+
+#ifndef _OS_WINDOWS_
+#include <stdio.h>
+#include <poll.h>
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#endif
 
 #ifdef __cplusplus
 extern "C" {
 #endif
 
-#ifdef JULIA_ENABLE_THREADING
+#if defined(JULIA_ENABLE_THREADING) && !defined(CODEGEN_TLS)
 static JL_CONST_FUNC jl_tls_states_t *jl_get_ptls_states_static(void)
 {
 #  if !defined(_COMPILER_MICROSOFT_)
@@ -50,6 +64,7 @@ static int lisp_prompt = 0;
 static int codecov  = JL_LOG_NONE;
 static int malloclog= JL_LOG_NONE;
 static int imagepathspecified = 0;
+static char *fork_server_path = NULL;
 
 static const char usage[] = "julia [switches] -- [programfile] [args...]\n";
 static const char opts[]  =
@@ -85,7 +100,9 @@ static const char opts[]  =
     " --no-history-file         Don't load history file (deprecated, use --history-file=no)\n\n"
 
     // code generation options
-    " --compile={yes|no|all}    Enable or disable compiler, or request exhaustive compilation\n"
+    " --compile={yes|no|all|tiered}\n"
+    "                           Enable or disable compiler, request exhaustive compilation,\n"
+    "                           or interpret methods until they have been called a few times\n"
     " -C, --cpu-target <target> Limit usage of cpu features up to <target>\n"
     " -O, --optimize            Run time-intensive code optimizations\n"
     " --inline={yes|no}         Control whether inlining is permitted (overrides functions declared as @inline)\n"
@@ -105,7 +122,13 @@ static const char opts[]  =
     " --code-coverage={none|user|all}, --code-coverage\n"
     "                           Count executions of source lines (omitting setting is equivalent to \"user\")\n"
     " --track-allocation={none|user|all}, --track-allocation\n"
-    "                           Count bytes allocated by each source line\n";
+    "                           Count bytes allocated by each source line\n\n"
+
+    // fork server
+    " --fork-server=<socket>    Run the program file or -e/-E as usual, then fork\n"
+    "                           the initialized process for each program sent to <socket>\n"
+    " --fork-client=<socket>    Run the program file with its arguments in a child of\n"
+    "                           the fork server at <socket> (must be the first option)\n";
 
 void parse_opts(int *argcp, char ***argvp)
 {
@@ -129,7 +152,9 @@ void parse_opts(int *argcp, char ***argvp)
            opt_output_ji,
            opt_use_precompiled,
            opt_use_compilecache,
-           opt_incremental
+           opt_incremental,
+           opt_fork_server,
+           opt_fork_client
     };
     static char* shortopts = "+vhqFfH:e:E:P:L:J:C:ip:O";
     static struct option longopts[] = {
@@ -168,6 +193,8 @@ void parse_opts(int *argcp, char ***argvp)
         { "inline",          required_argument, 0, opt_inline },
         { "math-mode",       required_argument, 0, opt_math_mode },
         { "handle-signals",  required_argument, 0, opt_handle_signals },
+        { "fork-server",     required_argument, 0, opt_fork_server },
+        { "fork-client",     required_argument, 0, opt_fork_client },
         // hidden command line options
         { "worker",          no_argument,       0, opt_worker },
         { "bind-to",         required_argument, 0, opt_bind_to },
@@ -312,6 +339,8 @@ void parse_opts(int *argcp, char ***argvp)
                 jl_options.compile_enabled = JL_OPTIONS_COMPILE_OFF;
             else if (!strcmp(optarg,"all"))
                 jl_options.compile_enabled = JL_OPTIONS_COMPILE_ALL;
+            else if (!strcmp(optarg,"tiered"))
+                jl_options.compile_enabled = JL_OPTIONS_COMPILE_TIERED;
             else
                 jl_errorf("julia: invalid argument to --compile (%s)", optarg);
             break;
@@ -420,6 +449,15 @@ void parse_opts(int *argcp, char ***argvp)
             else
                 jl_errorf("julia: invalid argument to --handle-signals (%s)", optarg);
             break;
+        case opt_fork_server:
+#ifdef _OS_WINDOWS_
+            jl_errorf("julia: --fork-server is not supported on Windows");
+#endif
+            fork_server_path = strdup(optarg);
+            break;
+        case opt_fork_client:
+            jl_errorf("julia: --fork-client must be the first option");
+            break;
         default:
             jl_errorf("julia: unhandled option -- %c\n"
                       "This is a bug, please report it.", c);
@@ -497,7 +535,9 @@ static NOINLINE int true_main(int argc, char *argv[])
             args = jl_alloc_cell_1d(0);
             jl_set_const(jl_core_module, jl_symbol("ARGS"), (jl_value_t*)args);
         }
-        assert(jl_array_len(args) == 0);
+        // the arguments of the fork server's own program are still there in
+        // its children
+        jl_array_del_end(args, jl_array_len(args));
         jl_array_grow_end(args, argc);
         int i;
         for (i=0; i < argc; i++) {
@@ -560,6 +600,409 @@ static NOINLINE int true_main(int argc, char *argv[])
     return 0;
 }
 
+#ifndef _OS_WINDOWS_
+/*
+  fork server
+  . `julia --fork-server=<socket> [options] [programfile]` starts up, runs
+    the program file (or -e/-E) to load what the jobs need, then listens on
+    the unix socket <socket> and forks a child for each connection
+  . `julia --fork-client=<socket> [programfile] [args...]` connects to it
+    without initializing julia, and sends its stdio descriptors, working
+    directory, environment and arguments. the child takes all of them over
+    and runs the program file like `julia programfile args...` would, with
+    the options of the server
+  . the server sends back the pid of the child, so that the client can pass
+    the signals it gets on to it, and then its wait status, which the client
+    exits with
+  . the runtime must have a single thread. libuv work started in the server
+    that uses its thread pool (host name lookups) is not available in the
+    children
+*/
+
+// a request: this header, sent with the client's descriptors 0, 1 and 2, then
+// nbytes of NUL-terminated strings: the working directory, argc arguments
+// and envc environment entries
+typedef struct {
+    uint32_t nbytes;
+    uint32_t argc;
+    uint32_t envc;
+} fork_request_t;
+
+extern char **environ;
+
+static int read_all(int fd, void *buf, size_t n)
+{
+    while (n > 0) {
+        ssize_t r = read(fd, buf, n);
+        if (r < 0 && errno == EINTR)
+            continue;
+        if (r <= 0)
+            return -1;
+        buf = (char*)buf + r;
+        n -= r;
+    }
+    return 0;
+}
+
+static int write_all(int fd, const void *buf, size_t n)
+{
+    while (n > 0) {
+        ssize_t r = write(fd, buf, n);
+        if (r < 0 && errno == EINTR)
+            continue;
+        if (r <= 0)
+            return -1;
+        buf = (const char*)buf + r;
+        n -= r;
+    }
+    return 0;
+}
+
+static int fork_socket_addr(const char *path, struct sockaddr_un *addr)
+{
+    memset(addr, 0, sizeof(*addr));
+    addr->sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof(addr->sun_path)) {
+        fprintf(stderr, "julia: socket path too long: %s\n", path);
+        return -1;
+    }
+    strcpy(addr->sun_path, path);
+    return 0;
+}
+
+// only the user running the server may start jobs in it
+static int fork_peer_ok(int conn)
+{
+#ifdef SO_PEERCRED
+    struct ucred cred;
+    socklen_t len = sizeof(cred);
+    if (getsockopt(conn, SOL_SOCKET, SO_PEERCRED, &cred, &len) != 0)
+        return 0;
+    return cred.uid == geteuid();
+#else
+    uid_t uid;
+    gid_t gid;
+    if (getpeereid(conn, &uid, &gid) != 0)
+        return 0;
+    return uid == geteuid();
+#endif
+}
+
+// --- client ---
+
+static volatile sig_atomic_t fork_job_pid = 0;
+
+static void fork_forward_signal(int sig)
+{
+    if (fork_job_pid > 0)
+        kill((pid_t)fork_job_pid, sig);
+}
+
+static int fork_client(const char *path, int argc, char *argv[])
+{
+    struct sockaddr_un addr;
+    if (fork_socket_addr(path, &addr) != 0)
+        return 1;
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0 || connect(fd, (struct sockaddr*)&addr, sizeof(addr)) < 0) {
+        fprintf(stderr, "julia: cannot connect to the fork server at %s: %s\n",
+                path, strerror(errno));
+        return 1;
+    }
+
+    char cwd[PATH_MAX];
+    if (getcwd(cwd, sizeof(cwd)) == NULL)
+        strcpy(cwd, "/");
+    size_t envc = 0;
+    while (environ[envc] != NULL)
+        envc++;
+    size_t nbytes = strlen(cwd) + 1;
+    for (int i = 0; i < argc; i++)
+        nbytes += strlen(argv[i]) + 1;
+    for (size_t i = 0; i < envc; i++)
+        nbytes += strlen(environ[i]) + 1;
+    char *strs = (char*)malloc(nbytes);
+    char *p = strs;
+    p = stpcpy(p, cwd) + 1;
+    for (int i = 0; i < argc; i++)
+        p = stpcpy(p, argv[i]) + 1;
+    for (size_t i = 0; i < envc; i++)
+        p = stpcpy(p, environ[i]) + 1;
+
+    // a closed descriptor can't be sent: give the job /dev/null instead
+    for (int i = 0; i < 3; i++) {
+        if (fcntl(i, F_GETFD) < 0)
+            open("/dev/null", i == 0 ? O_RDONLY : O_WRONLY);
+    }
+    fork_request_t req = {(uint32_t)nbytes, (uint32_t)argc, (uint32_t)envc};
+    int fds[3] = {0, 1, 2};
+    char control[CMSG_SPACE(sizeof(fds))];
+    struct iovec iov = {&req, sizeof(req)};
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    memset(control, 0, sizeof(control));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+    struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(fds));
+    memcpy(CMSG_DATA(cmsg), fds, sizeof(fds));
+    if (sendmsg(fd, &msg, 0) != sizeof(req) || write_all(fd, strs, nbytes) != 0) {
+        fprintf(stderr, "julia: cannot send the job to the fork server: %s\n", strerror(errno));
+        return 1;
+    }
+    free(strs);
+
+    int32_t pid, status;
+    if (read_all(fd, &pid, sizeof(pid)) != 0) {
+        fprintf(stderr, "julia: the fork server did not start the job\n");
+        return 1;
+    }
+    fork_job_pid = pid;
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = fork_forward_signal;
+    sa.sa_flags = SA_RESTART;
+    sigemptyset(&sa.sa_mask);
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+    sigaction(SIGHUP, &sa, NULL);
+    sigaction(SIGQUIT, &sa, NULL);
+    if (read_all(fd, &status, sizeof(status)) != 0) {
+        fprintf(stderr, "julia: lost the connection to the fork server\n");
+        return 1;
+    }
+    if (WIFSIGNALED(status)) {
+        // die the same way, for the shell
+        signal(WTERMSIG(status), SIG_DFL);
+        raise(WTERMSIG(status));
+        return 128 + WTERMSIG(status);
+    }
+    return WIFEXITED(status) ? WEXITSTATUS(status) : 1;
+}
+
+// --- server ---
+
+typedef struct {
+    pid_t pid;
+    int conn;
+} fork_job_t;
+
+static int sigchld_pipe[2];
+
+static void fork_sigchld(int sig)
+{
+    int e = errno;
+    char c = 0;
+    if (write(sigchld_pipe[1], &c, 1) < 0) {
+        // full: a wakeup is pending anyway
+    }
+    errno = e;
+}
+
+// the arguments of the request on conn, after taking over its descriptors,
+// working directory and environment
+static int fork_take_request(int conn, char **argv_out[], int *argc_out)
+{
+    fork_request_t req;
+    int fds[3];
+    char control[CMSG_SPACE(sizeof(fds))];
+    struct iovec iov = {&req, sizeof(req)};
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+    ssize_t r;
+    do {
+        r = recvmsg(conn, &msg, 0);
+    } while (r < 0 && errno == EINTR);
+    struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+    if (r != sizeof(req) || cmsg == NULL || cmsg->cmsg_type != SCM_RIGHTS ||
+        cmsg->cmsg_len != CMSG_LEN(sizeof(fds)))
+        return -1;
+    memcpy(fds, CMSG_DATA(cmsg), sizeof(fds));
+    char *strs = (char*)malloc((size_t)req.nbytes + 1);
+    if (strs == NULL || read_all(conn, strs, req.nbytes) != 0)
+        return -1;
+    close(conn);
+    strs[req.nbytes] = '\0';
+
+    size_t nstrs = 1 + (size_t)req.argc + req.envc;
+    char **ptrs = (char**)malloc((nstrs + 2) * sizeof(char*));
+    char *p = strs, *end = strs + req.nbytes;
+    for (size_t i = 0; i < nstrs; i++) {
+        if (p >= end)
+            return -1;
+        ptrs[i] = p;
+        p += strlen(p) + 1;
+    }
+    if (chdir(ptrs[0]) != 0)
+        return -1;
+    // argv, then the environment, each NULL-terminated
+    char **argv = (char**)malloc(((size_t)req.argc + 1) * sizeof(char*));
+    memcpy(argv, ptrs + 1, req.argc * sizeof(char*));
+    argv[req.argc] = NULL;
+    char **envp = ptrs + 1 + req.argc;
+    envp[req.envc] = NULL;
+    environ = envp;
+    for (int i = 0; i < 3; i++) {
+        dup2(fds[i], i);
+        if (fds[i] > 2)
+            close(fds[i]);
+    }
+    *argv_out = argv;
+    *argc_out = (int)req.argc;
+    return 0;
+}
+
+static int fork_child(int conn)
+{
+    char **argv;
+    int argc;
+    if (fork_take_request(conn, &argv, &argc) != 0)
+        _exit(1);
+    // the server has done its options already
+    jl_options.eval = NULL;
+    jl_options.print = NULL;
+    jl_options.postboot = NULL;
+    jl_options.load = NULL;
+    jl_options.machinefile = NULL;
+    jl_options.nprocs = 0;
+    jl_options.startupfile = JL_OPTIONS_STARTUPFILE_OFF;
+    JL_TRY {
+        jl_init_forked_child();
+        jl_function_t *reinit = (jl_function_t*)jl_get_global(jl_base_module,
+                                                              jl_symbol("_reinit_forked"));
+        if (reinit != NULL)
+            jl_apply(reinit, NULL, 0);
+    }
+    JL_CATCH {
+        jl_printf(JL_STDERR, "julia: fork server child failed to start: ");
+        jl_static_show(JL_STDERR, jl_exception_in_transit);
+        jl_printf(JL_STDERR, "\n");
+        _exit(1);
+    }
+    return true_main(argc, argv);
+}
+
+static int fork_server(const char *path, int argc, char *argv[])
+{
+    if (!jl_can_fork()) {
+        jl_printf(JL_STDERR, "julia: the fork server needs JULIA_NUM_THREADS=1 and is not supported on OS X\n");
+        return 1;
+    }
+    // load what the jobs need; with neither a program nor -e/-E there is
+    // nothing to run (and no REPL)
+    if (argc > 0 || jl_options.eval != NULL || jl_options.print != NULL) {
+        int ret = true_main(argc, argv);
+        if (ret != 0)
+            return ret;
+    }
+
+    struct sockaddr_un addr;
+    if (fork_socket_addr(path, &addr) != 0)
+        return 1;
+    // replace the socket of an earlier server, but nothing else
+    struct stat st;
+    if (lstat(path, &st) == 0) {
+        if (!S_ISSOCK(st.st_mode)) {
+            jl_printf(JL_STDERR, "julia: %s exists and is not a socket\n", path);
+            return 1;
+        }
+        unlink(path);
+    }
+    int lfd = socket(AF_UNIX, SOCK_STREAM, 0);
+    // the socket is created with mode 0600
+    mode_t oldmask = umask(0077);
+    int bound = lfd >= 0 ? bind(lfd, (struct sockaddr*)&addr, sizeof(addr)) : -1;
+    umask(oldmask);
+    if (bound < 0 || listen(lfd, SOMAXCONN) < 0 || pipe(sigchld_pipe) < 0) {
+        jl_printf(JL_STDERR, "julia: cannot listen on %s: %s\n", path, strerror(errno));
+        return 1;
+    }
+    fcntl(lfd, F_SETFD, FD_CLOEXEC);
+    for (int i = 0; i < 2; i++) {
+        fcntl(sigchld_pipe[i], F_SETFD, FD_CLOEXEC);
+        fcntl(sigchld_pipe[i], F_SETFL, O_NONBLOCK);
+    }
+    struct sigaction sa, oldsa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = fork_sigchld;
+    sa.sa_flags = SA_RESTART | SA_NOCLDSTOP;
+    sigemptyset(&sa.sa_mask);
+    sigaction(SIGCHLD, &sa, &oldsa);
+
+    fork_job_t *jobs = NULL;
+    size_t njobs = 0, maxjobs = 0;
+    jl_flush_cstdio();
+    for (;;) {
+        struct pollfd pfd[2] = {{lfd, POLLIN, 0}, {sigchld_pipe[0], POLLIN, 0}};
+        if (poll(pfd, 2, -1) < 0) {
+            if (errno == EINTR)
+                continue;
+            break;
+        }
+        if (pfd[1].revents & POLLIN) {
+            char buf[64];
+            while (read(sigchld_pipe[0], buf, sizeof(buf)) > 0)
+                ;
+            pid_t pid;
+            int status;
+            while ((pid = waitpid(-1, &status, WNOHANG)) > 0) {
+                for (size_t i = 0; i < njobs; i++) {
+                    if (jobs[i].pid == pid) {
+                        int32_t st = status;
+                        write_all(jobs[i].conn, &st, sizeof(st));
+                        close(jobs[i].conn);
+                        jobs[i] = jobs[--njobs];
+                        break;
+                    }
+                }
+            }
+        }
+        if (pfd[0].revents & POLLIN) {
+            int conn = accept(lfd, NULL, NULL);
+            if (conn < 0)
+                continue;
+            if (!fork_peer_ok(conn)) {
+                close(conn);
+                continue;
+            }
+            fcntl(conn, F_SETFD, FD_CLOEXEC);
+            pid_t pid = fork();
+            if (pid == 0) {
+                close(lfd);
+                close(sigchld_pipe[0]);
+                close(sigchld_pipe[1]);
+                sigaction(SIGCHLD, &oldsa, NULL);
+                free(jobs);
+                return fork_child(conn);
+            }
+            if (pid < 0) {
+                close(conn);
+                continue;
+            }
+            int32_t p = pid;
+            write_all(conn, &p, sizeof(p));
+            if (njobs == maxjobs) {
+                maxjobs = maxjobs ? maxjobs * 2 : 16;
+                jobs = (fork_job_t*)realloc(jobs, maxjobs * sizeof(fork_job_t));
+            }
+            jobs[njobs].pid = pid;
+            jobs[njobs].conn = conn;
+            njobs++;
+        }
+    }
+    jl_printf(JL_STDERR, "julia: fork server: %s\n", strerror(errno));
+    return 1;
+}
+#endif
+
 #ifndef _OS_WINDOWS_
 int main(int argc, char *argv[])
 {
@@ -608,13 +1051,18 @@ int wmain(int argc, wchar_t *argv[], wchar_t *envp[])
         argv[i] = (wchar_t*)arg;
     }
 #endif
-#ifdef JULIA_ENABLE_THREADING
+#if defined(JULIA_ENABLE_THREADING) && !defined(CODEGEN_TLS)
     // We need to make sure this function is called before any reference to
     // TLS variables. Since the compiler is free to move calls to
     // `jl_get_ptls_states()` around, we should avoid referencing TLS
     // variables in this function. (Mark `true_main` as noinline for this
     // reason).
     jl_set_ptls_states_getter(jl_get_ptls_states_static);
+#endif
+#ifndef _OS_WINDOWS_
+    // the client only passes the job on: no julia in this process
+    if (argc > 1 && !strncmp(argv[1], "--fork-client=", 14))
+        return fork_client(argv[1] + 14, argc - 2, argv + 2);
 #endif
     libsupport_init();
     parse_opts(&argc, (char***)&argv);
@@ -623,7 +1071,14 @@ int wmain(int argc, wchar_t *argv[], wchar_t *envp[])
         return 0;
     }
     julia_init(imagepathspecified ? JL_IMAGE_CWD : JL_IMAGE_JULIA_HOME);
-    int ret = true_main(argc, (char**)argv);
+    int ret;
+#ifndef _OS_WINDOWS_
+    // returns in the children, with the status of their job
+    if (fork_server_path != NULL)
+        ret = fork_server(fork_server_path, argc, (char**)argv);
+    else
+#endif
+    ret = true_main(argc, (char**)argv);
     jl_atexit_hook(ret);
     return ret;
 }